@@ -23,6 +23,8 @@
 
 #include <DolphinRender.h>
 
+#include <psapi.h>
+
 #define CHR(x) { hr = (x); if (FAILED(hr)) {__debugbreak(); goto EXIT_RETURN; } }
 
 #define SAFE_RELEASE(x) { if (x) { (x)->Release(); (x) = NULL; } }
@@ -277,6 +279,283 @@ void SaveDolphin(int iFrame, ID3D11Device *pDevice, ID3D11DeviceContext* pContex
     SaveBMP(fileName, pDevice, pStaging);
 }
 
+//
+// Writes a single mesh/subset sdkmesh file with the requested amount of vertex data.
+//
+static HRESULT WriteSyntheticMesh(LPCWSTR fileName, UINT numVertices)
+{
+    HRESULT hr = S_OK;
+    const UINT stride = sizeof(FLOAT) * 8;
+    const UINT numIndices = 0xFFFF;
+
+    SDKMESH_HEADER header = {};
+    SDKMESH_VERTEX_BUFFER_HEADER vbHeader = {};
+    SDKMESH_INDEX_BUFFER_HEADER ibHeader = {};
+    SDKMESH_MESH mesh = {};
+    SDKMESH_SUBSET subset = {};
+    UINT subsetIndex = 0;
+
+    header.Version = SDKMESH_FILE_VERSION;
+    header.HeaderSize = sizeof(header);
+    header.NumVertexBuffers = 1;
+    header.NumIndexBuffers = 1;
+    header.NumMeshes = 1;
+    header.NumTotalSubsets = 1;
+    header.VertexStreamHeadersOffset = header.HeaderSize;
+    header.IndexStreamHeadersOffset = header.VertexStreamHeadersOffset + sizeof(vbHeader);
+    header.MeshDataOffset = header.IndexStreamHeadersOffset + sizeof(ibHeader);
+    header.SubsetDataOffset = header.MeshDataOffset + sizeof(mesh);
+    header.FrameDataOffset = header.SubsetDataOffset + sizeof(subset);
+    header.MaterialDataOffset = header.FrameDataOffset;
+    header.NonBufferDataSize = header.FrameDataOffset + sizeof(subsetIndex) - header.HeaderSize;
+
+    vbHeader.NumVertices = numVertices;
+    vbHeader.StrideBytes = stride;
+    vbHeader.SizeBytes = (UINT64)numVertices * stride;
+    vbHeader.DataOffset = header.HeaderSize + header.NonBufferDataSize;
+
+    ibHeader.NumIndices = numIndices;
+    ibHeader.IndexType = IT_16BIT;
+    ibHeader.SizeBytes = (UINT64)numIndices * sizeof(USHORT);
+    ibHeader.DataOffset = vbHeader.DataOffset + vbHeader.SizeBytes;
+
+    header.BufferDataSize = vbHeader.SizeBytes + ibHeader.SizeBytes;
+
+    mesh.NumVertexBuffers = 1;
+    mesh.NumSubsets = 1;
+    mesh.SubsetOffset = header.FrameDataOffset;
+    mesh.FrameInfluenceOffset = header.FrameDataOffset;
+
+    subset.PrimitiveType = PT_TRIANGLE_LIST;
+    subset.IndexCount = numIndices;
+    subset.VertexCount = numVertices;
+
+    FILE* pFile = NULL;
+    if (_wfopen_s(&pFile, fileName, L"wb") != 0)
+    {
+        return E_FAIL;
+    }
+
+    fwrite(&header, sizeof(header), 1, pFile);
+    fwrite(&vbHeader, sizeof(vbHeader), 1, pFile);
+    fwrite(&ibHeader, sizeof(ibHeader), 1, pFile);
+    fwrite(&mesh, sizeof(mesh), 1, pFile);
+    fwrite(&subset, sizeof(subset), 1, pFile);
+    fwrite(&subsetIndex, sizeof(subsetIndex), 1, pFile);
+
+    {
+        FLOAT vertex[8] = { 0 };
+        for (UINT i = 0; i < numVertices; i++)
+        {
+            vertex[0] = (FLOAT)(i % 1024);
+            vertex[1] = (FLOAT)(i / 1024);
+            fwrite(vertex, stride, 1, pFile);
+        }
+
+        // 9_1 only supports 16-bit indices, so only the first 64K vertices are referenced
+        for (UINT i = 0; i < numIndices; i++)
+        {
+            USHORT index = (USHORT)i;
+            fwrite(&index, sizeof(USHORT), 1, pFile);
+        }
+    }
+
+    if (ferror(pFile))
+    {
+        hr = E_FAIL;
+    }
+
+    fclose(pFile);
+
+    return hr;
+}
+
+//
+// Loads a synthetic mesh either the old way (whole file read into a heap buffer)
+// or memory-mapped, and reports load time and peak memory. Run each mode in its
+// own process since the peak counters only ever grow.
+//
+static int MeshLoadBenchmark(bool useMapping, bool useRosDriver)
+{
+    HRESULT hr = S_OK;
+    LPCWSTR fileName = L".\\SyntheticMesh.sdkmesh";
+    const UINT numVertices = 2 * 1024 * 1024;  // 64 MB of vertex data
+
+    CDXUTSDKMesh mesh;
+    PBYTE pFileData = NULL;
+    LARGE_INTEGER loadStart;
+    LARGE_INTEGER loadEnd;
+    LARGE_INTEGER frequency;
+    PROCESS_MEMORY_COUNTERS_EX memBefore = { sizeof(memBefore) };
+    PROCESS_MEMORY_COUNTERS_EX memAfter = { sizeof(memAfter) };
+
+    CHR(WriteSyntheticMesh(fileName, numVertices));
+    CHR(g_deviceState.Init(useRosDriver));
+
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memBefore, sizeof(memBefore));
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&loadStart);
+
+    if (useMapping)
+    {
+        CHR(mesh.CreateFromFile(g_deviceState.m_device, fileName));
+    }
+    else
+    {
+        HANDLE hFile = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            goto EXIT_RETURN;
+        }
+
+        DWORD fileSize = GetFileSize(hFile, NULL);
+        DWORD bytesRead = 0;
+
+        pFileData = (PBYTE)malloc(fileSize);
+        BOOL bRead = pFileData && ReadFile(hFile, pFileData, fileSize, &bytesRead, NULL);
+        CloseHandle(hFile);
+
+        if (!bRead || (bytesRead != fileSize))
+        {
+            hr = E_FAIL;
+            goto EXIT_RETURN;
+        }
+
+        CHR(mesh.Create(g_deviceState.m_device, pFileData, fileSize));
+    }
+
+    g_deviceState.m_context->Flush();
+
+    QueryPerformanceCounter(&loadEnd);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memAfter, sizeof(memAfter));
+
+    printf(
+        "%s load of %d vertices: %I64d us, peak working set +%Iu KB, private bytes +%Iu KB\n",
+        useMapping ? "Mapped" : "Heap",
+        numVertices,
+        ((loadEnd.QuadPart - loadStart.QuadPart) * 1000000) / frequency.QuadPart,
+        (memAfter.PeakWorkingSetSize - memBefore.PeakWorkingSetSize) / 1024,
+        (memAfter.PrivateUsage - memBefore.PrivateUsage) / 1024);
+
+EXIT_RETURN:
+
+    mesh.Destroy();
+    free(pFileData);
+    g_deviceState.Uninit();
+    DeleteFileW(fileName);
+
+    return SUCCEEDED(hr) ? 0 : 1;
+}
+
+//
+// Checks the SIMD normal tween kernel against the scalar formula, then renders
+// the same animation times with the normals tweened on the CPU and by
+// ShadeDolphinTweenVertex and compares the two sets of frames.
+//
+static int TweenTest(bool useRosDriver)
+{
+    HRESULT hr = S_OK;
+    const UINT numFrames = 8;
+    const float maxKernelError = 1e-5f;
+    const int maxPixelError = 2;    // blend order differs between the paths
+
+    ID3D11DeviceContext* pContext = NULL;
+    PBYTE pCpuFrames = NULL;
+    UINT rowBytes = 0;
+    UINT frameBytes = 0;
+    float kernelError = 0.0f;
+    int pixelError = 0;
+
+    CHR(g_deviceState.Init(useRosDriver));
+    CHR(g_targetState.Init(useRosDriver, 800, 600, g_deviceState.m_adapter, g_deviceState.m_device));
+    pContext = g_deviceState.m_context;
+
+    if (!InitTargetSizeDependentDolphinResources(g_targetState.m_width, g_targetState.m_height, g_deviceState.m_device, pContext,
+            g_targetState.m_renderTargetView, g_targetState.m_depthStencilView))
+    {
+        hr = E_FAIL;
+        goto EXIT_RETURN;
+    }
+
+    rowBytes = g_targetState.m_width * 4;
+    frameBytes = rowBytes * g_targetState.m_height;
+    pCpuFrames = (PBYTE)malloc(numFrames * frameBytes);
+    if (pCpuFrames == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto EXIT_RETURN;
+    }
+
+    // The 1st pass tweens on the CPU and keeps its frames, the 2nd tweens in the shader
+    for (UINT pass = 0; pass < 2; pass++)
+    {
+        bool useTweenedNormal = (pass == 0);
+
+        if (!InitDeviceDependentDolphinResources(useTweenedNormal, MyLoadResource, g_deviceState.m_device, pContext))
+        {
+            hr = E_FAIL;
+            goto EXIT_RETURN;
+        }
+
+        if (useTweenedNormal)
+        {
+            kernelError = VerifyDolphinTween();
+        }
+
+        for (UINT i = 0; i < numFrames; i++)
+        {
+            D3D11_MAPPED_SUBRESOURCE mapped;
+
+            // Spread the frames over one kick cycle, which covers both halves of the blend
+            UpdateDolphinAtTime(useTweenedNormal, pContext, i * DirectX::XM_PI / numFrames);
+            RenderDolphin(useTweenedNormal, pContext, g_targetState.m_renderTargetView, g_targetState.m_depthStencilView);
+
+            pContext->CopyResource(g_targetState.m_stagingResource, g_targetState.m_renderTargetResource);
+            CHR(pContext->Map(g_targetState.m_stagingResource, 0, D3D11_MAP_READ, 0, &mapped));
+
+            for (UINT y = 0; y < g_targetState.m_height; y++)
+            {
+                PBYTE pRow = (PBYTE)mapped.pData + y * mapped.RowPitch;
+                PBYTE pCpuRow = pCpuFrames + i * frameBytes + y * rowBytes;
+
+                if (useTweenedNormal)
+                {
+                    memcpy(pCpuRow, pRow, rowBytes);
+                    continue;
+                }
+
+                for (UINT x = 0; x < rowBytes; x++)
+                {
+                    pixelError = max(pixelError, abs((int)pRow[x] - (int)pCpuRow[x]));
+                }
+            }
+
+            pContext->Unmap(g_targetState.m_stagingResource, 0);
+        }
+
+        UninitDeviceDependentDolphinResources();
+    }
+
+    printf("Tween kernel max error: %g (limit %g)\n", kernelError, maxKernelError);
+    printf("CPU vs. shader tween max pixel error over %d frames: %d (limit %d)\n", numFrames, pixelError, maxPixelError);
+
+    if ((kernelError > maxKernelError) || (pixelError > maxPixelError))
+    {
+        hr = E_FAIL;
+    }
+
+EXIT_RETURN:
+
+    UninitDeviceDependentDolphinResources();
+    UninitTargetSizeDependentDolphinResources();
+    free(pCpuFrames);
+    g_targetState.Uninit();
+    g_deviceState.Uninit();
+
+    return SUCCEEDED(hr) ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
     BOOL            bPerfMode = false;
@@ -287,6 +566,10 @@ int main(int argc, char *argv[])
     useRosDriver = true;
 #endif
 
+    LARGE_INTEGER   updateStart;
+    LARGE_INTEGER   updateEnd;
+    LONGLONG        updateTicks = 0;
+
     UINT            rtWidth = 800;
     UINT            rtHeight = 600;
     UINT            frames = 3;
@@ -297,6 +580,18 @@ int main(int argc, char *argv[])
     LARGE_INTEGER   frequenceStart;
     LARGE_INTEGER   frequenceEnd;
 
+    // DolphinTests meshbench [heap|mapped]
+    if ((argc >= 2) && (_stricmp(argv[1], "meshbench") == 0))
+    {
+        return MeshLoadBenchmark((argc < 3) || (_stricmp(argv[2], "heap") != 0), useRosDriver);
+    }
+
+    // DolphinTests tweentest
+    if ((argc >= 2) && (_stricmp(argv[1], "tweentest") == 0))
+    {
+        return TweenTest(useRosDriver);
+    }
+
     if (argc >= 3)
     {
         bPerfMode = true;
@@ -320,6 +615,12 @@ int main(int argc, char *argv[])
         {
             frames = 20;
         }
+
+        // Optional 4th argument picks where the dolphin normals are tweened
+        if (argc > 4)
+        {
+            useTweenedNormal = (_stricmp(argv[4], "shader") != 0);
+        }
     }
 
     // TODO: We don't check return result of InitD3D
@@ -359,7 +660,15 @@ int main(int argc, char *argv[])
             QueryPerformanceFrequency(&frequenceStart);
         }
 
+        QueryPerformanceCounter(&updateStart);
         UpdateDolphin(useTweenedNormal, g_deviceState.m_context);
+        QueryPerformanceCounter(&updateEnd);
+
+        if (i >= 1)
+        {
+            updateTicks += updateEnd.QuadPart - updateStart.QuadPart;
+        }
+
         RenderDolphin(useTweenedNormal, g_deviceState.m_context, g_targetState.m_renderTargetView, g_targetState.m_depthStencilView);
 
         if (!bPerfMode)
@@ -417,6 +726,12 @@ int main(int argc, char *argv[])
                 rtHeight,
                 measuredFrames,
                 ((framesEnd.QuadPart - framesStart.QuadPart) * 1000) / (measuredFrames*frequenceEnd.QuadPart));
+
+            printf(
+                "Average UpdateDolphin CPU time (%s tween) from %d frames: %I64d us\n",
+                useTweenedNormal ? "cpu" : "shader",
+                measuredFrames,
+                (updateTicks * 1000000) / (measuredFrames*frequenceEnd.QuadPart));
         }
 
         SAFE_RELEASE(pDxgiDev2);
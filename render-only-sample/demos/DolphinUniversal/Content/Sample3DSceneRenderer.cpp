@@ -73,6 +73,7 @@ const wchar_t *  Sample3DSceneRenderer::ResourceFileName(int id)
     case IDD_DOLPHIN_VS: return L"DolphinTween.xvu";
     case IDD_SEAFLOOR_VS: return L"SeaFloor.xvu";
     case IDD_SHADE_PS: return L"ShadeCausticsPixel.xpu";
+    case IDD_DOLPHIN_TWEEN_VS: return L"DolphinTweenNormal.xvu";
 
     case IDD_DOLPHIN_MESH1: return L"Dolphin1.sdkmesh";
     case IDD_DOLPHIN_MESH2: return L"Dolphin2.sdkmesh";
@@ -463,12 +463,16 @@ void UninitDeviceDependentDolphinResources()
     SAFE_RELEASE(pDolphinIB);
     SAFE_RELEASE(pDolphinTextureView);
     SAFE_RELEASE(pDolphinVertexLayout);
+    DolphinMesh1.Destroy();
+    DolphinMesh2.Destroy();
+    DolphinMesh3.Destroy();
 
     SAFE_RELEASE(pSeaFloorVertexShader);
     SAFE_RELEASE(pSeaFloorVB);
     SAFE_RELEASE(pSeaFloorIB);
     SAFE_RELEASE(pSeaFloorTextureView);
     SAFE_RELEASE(pSeaFloorVertexLayout);
+    SeaFloorMesh.Destroy();
 }
 
 bool LoadDeviceDependentDolphinResources(bool useTweenedNormal, LoadResourceFunc loadResourceFunc, ID3D11Device * inDevice, ID3D11DeviceContext * inContext)
@@ -590,7 +594,7 @@ bool LoadDeviceDependentDolphinResources(bool useTweenedNormal, LoadResourceFunc
 
         {
             DWORD dwDolphinVSSize = 0;
-            PBYTE pDolphinVSData = (PBYTE)loadResourceFunc(IDD_DOLPHIN_VS, &dwDolphinVSSize);
+            PBYTE pDolphinVSData = (PBYTE)loadResourceFunc(useTweenedNormal ? IDD_DOLPHIN_VS : IDD_DOLPHIN_TWEEN_VS, &dwDolphinVSSize);
             if (pDolphinVSData == NULL)
             {
                 ErrorLine = __LINE__;
@@ -801,6 +805,151 @@ bool InitDeviceDependentDolphinResources(bool useTweenedNormal, LoadResourceFunc
     return success;
 }
 
+//
+// Blend weights for the current animation time. At most two of the three
+// weights are non-zero at any time.
+//
+static void GetDolphinBlendWeights(FLOAT fTime, FLOAT* pWeight1, FLOAT* pWeight2, FLOAT* pWeight3)
+{
+    FLOAT fBlendWeight = sinf(2 * fTime);
+
+    if (fBlendWeight > 0.0f)
+    {
+        *pWeight1 = fabsf(fBlendWeight);
+        *pWeight2 = 1.0f - fabsf(fBlendWeight);
+        *pWeight3 = 0.0f;
+    }
+    else
+    {
+        *pWeight1 = 0.0f;
+        *pWeight2 = 1.0f - fabsf(fBlendWeight);
+        *pWeight3 = fabsf(fBlendWeight);
+    }
+}
+
+//
+// Scalar reference for the tween, written the same way as ShadeDolphinTweenVertex:
+//     vNormal0 * g_vBlendWeights.x + vNormal1 * g_vBlendWeights.y + vNormal2 * g_vBlendWeights.z
+//
+static void TweenDolphinNormalsReference(
+    XMFLOAT3* pDst,
+    const DOLPHIN_VERTEX* pVertices1,
+    const DOLPHIN_VERTEX* pVertices2,
+    const DOLPHIN_VERTEX* pVertices3,
+    UINT numVertices,
+    FLOAT fWeight1,
+    FLOAT fWeight2,
+    FLOAT fWeight3)
+{
+    for (UINT n = 0; n < numVertices; n++)
+    {
+        pDst[n].x = pVertices1[n].normal.x * fWeight1 + pVertices2[n].normal.x * fWeight2 + pVertices3[n].normal.x * fWeight3;
+        pDst[n].y = pVertices1[n].normal.y * fWeight1 + pVertices2[n].normal.y * fWeight2 + pVertices3[n].normal.y * fWeight3;
+        pDst[n].z = pVertices1[n].normal.z * fWeight1 + pVertices2[n].normal.z * fWeight2 + pVertices3[n].normal.z * fWeight3;
+    }
+}
+
+//
+// SIMD tween kernel. Since one weight is always zero only two meshes are
+// read, and the weights are splatted once outside of the loop so each normal
+// costs one multiply and one multiply-add. The loop is unrolled by 4 to keep
+// the loads of independent vertices in flight.
+//
+static void TweenDolphinNormals(
+    XMFLOAT3* pDst,
+    const DOLPHIN_VERTEX* pVertices1,
+    const DOLPHIN_VERTEX* pVertices2,
+    const DOLPHIN_VERTEX* pVertices3,
+    UINT numVertices,
+    FLOAT fWeight1,
+    FLOAT fWeight2,
+    FLOAT fWeight3)
+{
+    const DOLPHIN_VERTEX* pSrcA = pVertices2;
+    const DOLPHIN_VERTEX* pSrcB;
+    FLOAT fWeightA = fWeight2;
+    FLOAT fWeightB;
+
+    if (fWeight3 == 0.0f)
+    {
+        pSrcB = pVertices1;
+        fWeightB = fWeight1;
+    }
+    else if (fWeight1 == 0.0f)
+    {
+        pSrcB = pVertices3;
+        fWeightB = fWeight3;
+    }
+    else
+    {
+        TweenDolphinNormalsReference(pDst, pVertices1, pVertices2, pVertices3, numVertices, fWeight1, fWeight2, fWeight3);
+        return;
+    }
+
+    XMVECTOR vWeightA = XMVectorReplicate(fWeightA);
+    XMVECTOR vWeightB = XMVectorReplicate(fWeightB);
+
+    UINT n = 0;
+    for (; n + 4 <= numVertices; n += 4)
+    {
+        XMVECTOR vNormal0 = XMVectorMultiply(XMLoadFloat3(&pSrcA[n + 0].normal), vWeightA);
+        XMVECTOR vNormal1 = XMVectorMultiply(XMLoadFloat3(&pSrcA[n + 1].normal), vWeightA);
+        XMVECTOR vNormal2 = XMVectorMultiply(XMLoadFloat3(&pSrcA[n + 2].normal), vWeightA);
+        XMVECTOR vNormal3 = XMVectorMultiply(XMLoadFloat3(&pSrcA[n + 3].normal), vWeightA);
+
+        vNormal0 = XMVectorMultiplyAdd(XMLoadFloat3(&pSrcB[n + 0].normal), vWeightB, vNormal0);
+        vNormal1 = XMVectorMultiplyAdd(XMLoadFloat3(&pSrcB[n + 1].normal), vWeightB, vNormal1);
+        vNormal2 = XMVectorMultiplyAdd(XMLoadFloat3(&pSrcB[n + 2].normal), vWeightB, vNormal2);
+        vNormal3 = XMVectorMultiplyAdd(XMLoadFloat3(&pSrcB[n + 3].normal), vWeightB, vNormal3);
+
+        XMStoreFloat3(&pDst[n + 0], vNormal0);
+        XMStoreFloat3(&pDst[n + 1], vNormal1);
+        XMStoreFloat3(&pDst[n + 2], vNormal2);
+        XMStoreFloat3(&pDst[n + 3], vNormal3);
+    }
+
+    for (; n < numVertices; n++)
+    {
+        XMVECTOR vNormal = XMVectorMultiply(XMLoadFloat3(&pSrcA[n].normal), vWeightA);
+        vNormal = XMVectorMultiplyAdd(XMLoadFloat3(&pSrcB[n].normal), vWeightB, vNormal);
+        XMStoreFloat3(&pDst[n], vNormal);
+    }
+}
+
+float VerifyDolphinTween()
+{
+    const DOLPHIN_VERTEX *pVertices1 = (const DOLPHIN_VERTEX *)DolphinMesh1.GetRawVerticesAt(0);
+    const DOLPHIN_VERTEX *pVertices2 = (const DOLPHIN_VERTEX *)DolphinMesh2.GetRawVerticesAt(0);
+    const DOLPHIN_VERTEX *pVertices3 = (const DOLPHIN_VERTEX *)DolphinMesh3.GetRawVerticesAt(0);
+    UINT numVertices = (UINT)DolphinMesh1.GetNumVertices(0, 0);
+
+    XMFLOAT3* pKernel = new XMFLOAT3[numVertices];
+    XMFLOAT3* pReference = new XMFLOAT3[numVertices];
+    float maxError = 0.0f;
+
+    // Sweep one full kick cycle, which covers both halves of the blend
+    for (UINT step = 0; step < 64; step++)
+    {
+        FLOAT fWeight1, fWeight2, fWeight3;
+        GetDolphinBlendWeights(step * XM_PI / 64, &fWeight1, &fWeight2, &fWeight3);
+
+        TweenDolphinNormals(pKernel, pVertices1, pVertices2, pVertices3, numVertices, fWeight1, fWeight2, fWeight3);
+        TweenDolphinNormalsReference(pReference, pVertices1, pVertices2, pVertices3, numVertices, fWeight1, fWeight2, fWeight3);
+
+        for (UINT n = 0; n < numVertices; n++)
+        {
+            maxError = max(maxError, fabsf(pKernel[n].x - pReference[n].x));
+            maxError = max(maxError, fabsf(pKernel[n].y - pReference[n].y));
+            maxError = max(maxError, fabsf(pKernel[n].z - pReference[n].z));
+        }
+    }
+
+    delete[] pKernel;
+    delete[] pReference;
+
+    return maxError;
+}
+
 void UpdateDolphin(bool useTweenedNormal, ID3D11DeviceContext * pContext)
 {
     /*
@@ -810,12 +959,14 @@ void UpdateDolphin(bool useTweenedNormal, ID3D11DeviceContext * pContext)
     */
 
     // Get the current time
-    FLOAT fTime = (FLOAT)AppTimer.GetAppTime();
+    UpdateDolphinAtTime(useTweenedNormal, pContext, (FLOAT)AppTimer.GetAppTime());
+}
 
+void UpdateDolphinAtTime(bool useTweenedNormal, ID3D11DeviceContext * pContext, FLOAT fTime)
+{
     // Animation attributes for the dolphin
     FLOAT fKickFreq = 2 * fTime;
     FLOAT fPhase = fTime / 3;
-    FLOAT fBlendWeight = sinf(fKickFreq);
 
     // Move the dolphin in a circle
     XMMATRIX matDolphin, matTrans, matRotate1, matRotate2;
@@ -835,51 +986,24 @@ void UpdateDolphin(bool useTweenedNormal, ID3D11DeviceContext * pContext)
     FLOAT fWeight2;
     FLOAT fWeight3;
 
-    if (fBlendWeight > 0.0f)
-    {
-        fWeight1 = fabsf(fBlendWeight);
-        fWeight2 = 1.0f - fabsf(fBlendWeight);
-        fWeight3 = 0.0f;
-    }
-    else
-    {
-        fWeight1 = 0.0f;
-        fWeight2 = 1.0f - fabsf(fBlendWeight);
-        fWeight3 = fabsf(fBlendWeight);
-    }
+    GetDolphinBlendWeights(fTime, &fWeight1, &fWeight2, &fWeight3);
 
     D3D11_MAPPED_SUBRESOURCE MappedResource;
 
+    // When the vertex shader tweens the normals there is nothing to do here
+    // beyond updating the blend weights in the constant buffer.
     if (useTweenedNormal)
     {
         pContext->Map(pDolphinTweenedNormalVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource);
-        {
-            XMFLOAT3* pTweenedNormal = (XMFLOAT3*)MappedResource.pData;
-
-            // Gather normal data from DolphinMesh.
-            DOLPHIN_VERTEX *pVertices1 = (DOLPHIN_VERTEX *)DolphinMesh1.GetRawVerticesAt(0);
-            DOLPHIN_VERTEX *pVertices2 = (DOLPHIN_VERTEX *)DolphinMesh2.GetRawVerticesAt(0);
-            DOLPHIN_VERTEX *pVertices3 = (DOLPHIN_VERTEX *)DolphinMesh3.GetRawVerticesAt(0);
-
-            for (UINT n = 0; n < DolphinMesh1.GetNumVertices(0, 0); n++)
-            {
-                // float3 vModelNormal = vNormal0 * g_vBlendWeights.x + 
-                //                       vNormal1 * g_vBlendWeights.y + 
-                //                       vNormal2 * g_vBlendWeights.z;
-
-                XMVECTOR vNormal0 = XMLoadFloat3(&pVertices1[n].normal);
-                XMVECTOR vNormal1 = XMLoadFloat3(&pVertices2[n].normal);
-                XMVECTOR vNormal2 = XMLoadFloat3(&pVertices3[n].normal);
-
-                vNormal0 = XMVectorScale(vNormal0, fWeight1);
-                vNormal1 = XMVectorScale(vNormal1, fWeight2);
-                vNormal2 = XMVectorScale(vNormal2, fWeight3);
-
-                XMVECTOR vNormal = XMVectorAdd(XMVectorAdd(vNormal0, vNormal1), vNormal2);
-
-                XMStoreFloat3(&pTweenedNormal[n], vNormal);
-            }
-        }
+        TweenDolphinNormals(
+            (XMFLOAT3*)MappedResource.pData,
+            (DOLPHIN_VERTEX *)DolphinMesh1.GetRawVerticesAt(0),
+            (DOLPHIN_VERTEX *)DolphinMesh2.GetRawVerticesAt(0),
+            (DOLPHIN_VERTEX *)DolphinMesh3.GetRawVerticesAt(0),
+            (UINT)DolphinMesh1.GetNumVertices(0, 0),
+            fWeight1,
+            fWeight2,
+            fWeight3);
         pContext->Unmap(pDolphinTweenedNormalVB, 0);
     }
 
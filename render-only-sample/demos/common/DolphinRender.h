@@ -6,8 +6,16 @@ void UninitTargetSizeDependentDolphinResources();
 bool InitTargetSizeDependentDolphinResources(UINT rtWidth, UINT rtHeight, ID3D11Device* pDevice, ID3D11DeviceContext * pContext,
     ID3D11RenderTargetView* pRenderTargetView, ID3D11DepthStencilView* pDepthStencilView);
 
+// useTweenedNormal selects where the dolphin normals are tweened: true blends them on the CPU
+// each frame into a dynamic vertex buffer, false lets ShadeDolphinTweenVertex blend them from
+// the three meshes using the weights in the constant buffer.
 void UninitDeviceDependentDolphinResources();
 bool InitDeviceDependentDolphinResources(bool useTweenedNormal, LoadResourceFunc loadResourceFunc, ID3D11Device* pDevice, ID3D11DeviceContext * pContext);
 
 void UpdateDolphin(bool useTweenedNormal, ID3D11DeviceContext * pContext);
+void UpdateDolphinAtTime(bool useTweenedNormal, ID3D11DeviceContext * pContext, FLOAT fTime);
 void RenderDolphin(bool useTweenedNormal, ID3D11DeviceContext * pContext, ID3D11RenderTargetView* pRenderTargetView, ID3D11DepthStencilView* pDepthStencilView);
+
+// Returns the largest difference between the CPU tween kernel and the shader formula
+// over one animation cycle. Requires the device dependent resources to be initialized.
+float VerifyDolphinTween();
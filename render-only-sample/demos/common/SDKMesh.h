@@ -310,6 +310,7 @@ private:
     ID3D11Device* m_pDev11;
     ID3D11DeviceContext* m_pDevContext11;
     bool m_bCopyStatic;
+    BYTE* m_pMappedData;
 
 protected:
     //These are the pointers to the two chunks of data loaded in from the mesh file
@@ -362,6 +363,11 @@ public:
     virtual void                    Destroy();
 
     virtual HRESULT                 Create( ID3D11Device* pDev11, PBYTE pMesh, ULONG MeshSize, bool bCreateAdjacencyIndices=false );
+
+    // Maps the file read-only instead of reading it into a heap buffer.  Vertex and
+    // index data are handed to buffer creation straight from the view, only the header
+    // and mesh tables, which the pointer fixups write to, are copied to the heap.
+    virtual HRESULT                 CreateFromFile( ID3D11Device* pDev11, LPCWSTR szFileName, bool bCreateAdjacencyIndices=false );
         
     //Helpers (D3D11 specific)
     static D3D11_PRIMITIVE_TOPOLOGY GetPrimitiveType11( SDKMESH_PRIMITIVE_TYPE PrimType );
@@ -225,6 +225,12 @@ CDXUTSDKMesh::CDXUTSDKMesh() : m_NumOutstandingResources( 0 ),
                                m_pMeshHeader( NULL ),
                                m_pStaticMeshData( NULL ),
                                m_pHeapData( NULL ),
+                               m_pVertexBufferArray( NULL ),
+                               m_pIndexBufferArray( NULL ),
+                               m_pMeshArray( NULL ),
+                               m_pSubsetArray( NULL ),
+                               m_pFrameArray( NULL ),
+                               m_pMaterialArray( NULL ),
                                m_pAdjacencyIndexBufferArray( NULL ),
                                m_pAnimationData( NULL ),
                                m_pAnimationHeader( NULL ),
@@ -234,7 +240,8 @@ CDXUTSDKMesh::CDXUTSDKMesh() : m_NumOutstandingResources( 0 ),
                                m_pTransformedFrameMatrices( NULL ),
                                m_pWorldPoseFrameMatrices( NULL ),
                                m_pDev11( NULL ),
-                               m_bCopyStatic( false )
+                               m_bCopyStatic( false ),
+                               m_pMappedData( NULL )
 {
 }
 
@@ -251,6 +258,61 @@ HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, PBYTE pMesh, ULONG MeshSize,
     return CreateFromMemory( pDev11, pMesh, MeshSize, bCreateAdjacencyIndices, true );
 }
 
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev11, LPCWSTR szFileName, bool bCreateAdjacencyIndices )
+{
+    HRESULT hr = S_OK;
+    LARGE_INTEGER FileSize;
+    SDKMESH_HEADER* pHeader;
+
+    m_hFile = CreateFile2( szFileName, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, NULL );
+    if( m_hFile == INVALID_HANDLE_VALUE )
+    {
+        m_hFile = 0;
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    if( !GetFileSizeEx( m_hFile, &FileSize ) || FileSize.QuadPart < sizeof( SDKMESH_HEADER ) || FileSize.HighPart != 0 )
+    {
+        hr = E_FAIL;
+        goto Error;
+    }
+
+    // Read-only, the fixups in CreateFromMemory go to a heap copy of the static data
+    m_hFileMappingObject = CreateFileMappingFromApp( m_hFile, NULL, PAGE_READONLY, 0, NULL );
+    if( !m_hFileMappingObject )
+    {
+        hr = HRESULT_FROM_WIN32( GetLastError() );
+        goto Error;
+    }
+
+    m_pMappedData = ( BYTE* )MapViewOfFileFromApp( m_hFileMappingObject, FILE_MAP_READ, 0, 0 );
+    if( !m_pMappedData )
+    {
+        hr = HRESULT_FROM_WIN32( GetLastError() );
+        goto Error;
+    }
+
+    pHeader = ( SDKMESH_HEADER* )m_pMappedData;
+    if( pHeader->Version != SDKMESH_FILE_VERSION ||
+        pHeader->HeaderSize + pHeader->NonBufferDataSize + pHeader->BufferDataSize > ( UINT64 )FileSize.QuadPart )
+    {
+        hr = E_FAIL;
+        goto Error;
+    }
+
+    wcsncpy_s( m_strPathW, MAX_PATH, szFileName, _TRUNCATE );
+    WideCharToMultiByte( CP_ACP, 0, m_strPathW, -1, m_strPath, MAX_PATH, NULL, FALSE );
+
+    hr = CreateFromMemory( pDev11, m_pMappedData, FileSize.LowPart, bCreateAdjacencyIndices, true );
+    if( SUCCEEDED( hr ) )
+        return hr;
+
+Error:
+    Destroy();
+    return hr;
+}
+
 //--------------------------------------------------------------------------------------
 void CDXUTSDKMesh::Destroy()
 {
@@ -324,9 +386,11 @@ void CDXUTSDKMesh::Destroy()
     
     if (m_pAdjacencyIndexBufferArray)
         delete [] m_pAdjacencyIndexBufferArray;
+    m_pAdjacencyIndexBufferArray = NULL;
 
     if (m_bCopyStatic && m_pHeapData)
         delete [] m_pHeapData;
+    m_pHeapData = NULL;
     m_pStaticMeshData = NULL;
     
     if (m_pAnimationData)
@@ -337,11 +401,17 @@ void CDXUTSDKMesh::Destroy()
         delete [] m_pTransformedFrameMatrices;
     if (m_pWorldPoseFrameMatrices)
         delete [] m_pWorldPoseFrameMatrices;
+    m_pAnimationData = NULL;
+    m_pBindPoseFrameMatrices = NULL;
+    m_pTransformedFrameMatrices = NULL;
+    m_pWorldPoseFrameMatrices = NULL;
 
     if (m_ppVertices)
         delete [] m_ppVertices;
     if (m_ppIndices)
         delete [] m_ppIndices;
+    m_ppVertices = NULL;
+    m_ppIndices = NULL;
 
     m_pMeshHeader = NULL;
     m_pVertexBufferArray = NULL;
@@ -353,6 +423,22 @@ void CDXUTSDKMesh::Destroy()
 
     m_pAnimationHeader = NULL;
     m_pAnimationFrameData = NULL;
+
+    if (m_pMappedData)
+    {
+        UnmapViewOfFile(m_pMappedData);
+        m_pMappedData = NULL;
+    }
+    if (m_hFileMappingObject)
+    {
+        CloseHandle(m_hFileMappingObject);
+        m_hFileMappingObject = 0;
+    }
+    if (m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = 0;
+    }
 }
 
 //--------------------------------------------------------------------------------------
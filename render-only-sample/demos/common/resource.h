@@ -6,6 +6,7 @@
 #define IDD_DOLPHIN_VS                  2000
 #define IDD_SEAFLOOR_VS                 2001
 #define IDD_SHADE_PS                    2002
+#define IDD_DOLPHIN_TWEEN_VS            2003
 
 #define IDD_DOLPHIN_MESH1               3000
 #define IDD_DOLPHIN_MESH2               3001
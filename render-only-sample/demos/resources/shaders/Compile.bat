@@ -12,6 +12,8 @@
 @REM
 call fxc /T vs_4_0_level_9_1 /E "ShadeDolphinVertex" /Fo DolphinTween.xvu /Fc DolphinTween.txt Dolphin.vsh
 
+call fxc /T vs_4_0_level_9_1 /E "ShadeDolphinTweenVertex" /Fo DolphinTweenNormal.xvu /Fc DolphinTweenNormal.txt Dolphin.vsh
+
 call fxc /T vs_4_0_level_9_1 /E "ShadeSeaFloorVertex" /Fo SeaFloor.xvu /Fc SeaFloor.txt Dolphin.vsh
 
 call fxc /T ps_4_0_level_9_1 /E "ShadeCausticsPixel" /Fo ShadeCausticsPixel.xpu /Fc ShadeCausticsPixel.txt Dolphin.psh
@@ -6,12 +6,14 @@
 #include <d3d10umddi.h>
 
 #include <Vc4Hw.h>
+#include <Vc4Ddi.h>
 #include <ntassert.h>
 
 enum RosHwLayout
 {
     Linear,
-    Tiled
+    Tiled,
+    Multisample     // Full resolution tile dumps, see RosMsaa.h
 };
 
 enum RosHwFormat
@@ -53,6 +55,64 @@ struct RosAllocationExchange
     UINT                    m_hwSizeBytes;
 };
 
+//
+// Dynamic buffers and staging resources live in the aperture segment only.
+// The CPU writes them in place and the GPU reads them without a paging
+// transfer, which also lets the UMD lock them with IgnoreSync.
+//
+
+inline bool RosAllocationUsesAperture (const RosAllocationExchange& Allocation)
+{
+    if ((Allocation.m_miscFlags & D3D10_DDI_RESOURCE_MISC_SHARED) ||
+        (Allocation.m_bindFlags & D3D10_DDI_BIND_PRESENT) ||
+        Allocation.m_isPrimary) {
+        return false;
+    }
+
+    if (Allocation.m_usage == D3D10_DDI_USAGE_STAGING) {
+        return true;
+    }
+
+    //
+    // The KMD copies a buffer whose pages the GPU can't read in place to the
+    // aperture bounce memory, a larger one stays in local video memory
+    //
+
+    return (Allocation.m_usage == D3D10_DDI_USAGE_DYNAMIC) &&
+           (Allocation.m_resourceDimension == D3D10DDIRESOURCE_BUFFER) &&
+           (Allocation.m_hwSizeBytes <= VC4_APERTURE_BOUNCE_SIZE);
+}
+
+//
+// A multisample render target or depth stencil buffer is rendered in the
+// smaller tiles of the multisample mode of the tile buffer
+//
+
+inline bool RosAllocationIsMultisampled (const RosAllocationExchange& Allocation)
+{
+    return Allocation.m_sampleDesc.Count > 1;
+}
+
+inline UINT Vc4TilePixels (const RosAllocationExchange& Allocation)
+{
+    return RosAllocationIsMultisampled(Allocation) ? VC4_MS_TILE_PIXELS : VC4_BINNING_TILE_PIXELS;
+}
+
+//
+// Tiles of the Rendering Control List across and down a render target,
+// whatever its layout pads the width and height to
+//
+
+inline UINT Vc4WidthInTiles (const RosAllocationExchange& Allocation)
+{
+    return (Allocation.m_mip0Info.TexelWidth + Vc4TilePixels(Allocation) - 1) / Vc4TilePixels(Allocation);
+}
+
+inline UINT Vc4HeightInTiles (const RosAllocationExchange& Allocation)
+{
+    return (Allocation.m_mip0Info.TexelHeight + Vc4TilePixels(Allocation) - 1) / Vc4TilePixels(Allocation);
+}
+
 struct RosAllocationGroupExchange
 {
     int     m_dummy;
@@ -119,11 +179,10 @@ inline VC4TextureDataType Vc4TextureTypeFromDxgiFormat (
         switch (Format) {
         case DXGI_FORMAT_R8G8B8A8_UNORM:
         case DXGI_FORMAT_B8G8R8A8_UNORM:
-            return VC4_TEX_RGBX8888; // XXX: shouldn't this be VC4_TEX_RGBA8888?
-            break;
+            return VC4_TEX_RGBA8888;
         default:
             NT_ASSERT(false);
-            return VC4_TEX_RGBX8888;
+            return VC4_TEX_RGBA8888;
         }
     default:
         NT_ASSERT(false);
@@ -0,0 +1,137 @@
+#include "RosAperturePageTable.h"
+
+RosAperturePageTable::RosAperturePageTable()
+{
+    m_baseAddress = 0;
+
+    m_pEntries = NULL;
+    m_pageCount = 0;
+    m_mappedPageCount = 0;
+}
+
+void
+RosAperturePageTable::Init(
+    UINT                baseAddress,
+    RosAperturePte *    pEntries,
+    UINT                pageCount)
+{
+    ROS_PORTABLE_ASSERT(0 == (baseAddress & (kPageSize - 1)));
+    ROS_PORTABLE_ASSERT(pageCount != 0);
+
+    m_baseAddress = baseAddress;
+
+    m_pEntries = pEntries;
+    m_pageCount = pageCount;
+    m_mappedPageCount = 0;
+
+    for (UINT i = 0; i < pageCount; i++)
+    {
+        m_pEntries[i].m_pfn = 0;
+        m_pEntries[i].m_runPages = 0;
+    }
+}
+
+void
+RosAperturePageTable::MapPage(
+    UINT    page,
+    UINT    pfn)
+{
+    ROS_PORTABLE_ASSERT(page < m_pageCount);
+
+    if (m_pEntries[page].m_runPages == 0)
+    {
+        m_mappedPageCount++;
+    }
+
+    m_pEntries[page].m_pfn = pfn;
+
+    // Made consistent by UpdateRuns()
+    m_pEntries[page].m_runPages = 1;
+}
+
+void
+RosAperturePageTable::UnmapPage(
+    UINT    page)
+{
+    ROS_PORTABLE_ASSERT(page < m_pageCount);
+
+    if (m_pEntries[page].m_runPages != 0)
+    {
+        m_mappedPageCount--;
+    }
+
+    m_pEntries[page].m_pfn = 0;
+    m_pEntries[page].m_runPages = 0;
+}
+
+void
+RosAperturePageTable::UpdateRuns(
+    UINT    firstPage,
+    UINT    pageCount)
+{
+    ROS_PORTABLE_ASSERT(firstPage + pageCount <= m_pageCount);
+
+    if (pageCount == 0)
+    {
+        return;
+    }
+
+    //
+    // Runs only extend forward, so walk down from the last updated page and
+    // continue below the range until a run length doesn't change
+    //
+
+    for (UINT page = firstPage + pageCount; page-- > 0;)
+    {
+        RosAperturePte *    pEntry = &m_pEntries[page];
+        UINT                runPages;
+
+        if (pEntry->m_runPages == 0)
+        {
+            runPages = 0;
+        }
+        else if ((page + 1 < m_pageCount) && Follows(page))
+        {
+            runPages = m_pEntries[page + 1].m_runPages + 1;
+        }
+        else
+        {
+            runPages = 1;
+        }
+
+        if ((page < firstPage) && (runPages == pEntry->m_runPages))
+        {
+            break;
+        }
+
+        pEntry->m_runPages = runPages;
+    }
+}
+
+bool
+RosAperturePageTable::Translate(
+    UINT    apertureAddress,
+    UINT    size,
+    UINT *  pPhysicalAddress) const
+{
+    ROS_PORTABLE_ASSERT(size != 0);
+
+    if ((apertureAddress < m_baseAddress) ||
+        (apertureAddress - m_baseAddress >= m_pageCount * kPageSize))
+    {
+        return false;
+    }
+
+    UINT    page = GetPageIndex(apertureAddress);
+    UINT    pageOffset = apertureAddress & (kPageSize - 1);
+    UINT    pagesNeeded = (pageOffset + size + kPageSize - 1) >> kPageShift;
+
+    if (m_pEntries[page].m_runPages < pagesNeeded)
+    {
+        return false;
+    }
+
+    *pPhysicalAddress = (m_pEntries[page].m_pfn << kPageShift) + pageOffset;
+
+    return true;
+}
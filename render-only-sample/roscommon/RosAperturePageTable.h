@@ -0,0 +1,101 @@
+#pragma once
+
+//
+// Page table of the aperture segment.
+//
+// VidMm backs aperture allocations with system pages and maps them into the
+// segment with DXGK_OPERATION_MAP_APERTURE_SEGMENT. The VC4 has no MMU, it
+// reads physical (bus) addresses, so a range of the aperture can only be
+// read in place when its pages are physically contiguous. Every entry keeps
+// the number of physically contiguous mapped pages that start at it, so
+// Translate() answers in constant time.
+//
+// The table doesn't allocate, the caller provides the entries.
+//
+
+#include "RosPortable.h"
+
+typedef struct _RosAperturePte
+{
+    UINT    m_pfn;
+
+    // Mapped pages from this one whose frames follow each other, 0 when the
+    // page isn't mapped
+    UINT    m_runPages;
+} RosAperturePte;
+
+class RosAperturePageTable
+{
+public:
+
+    static const UINT kPageShift = 12;
+    static const UINT kPageSize = 1 << kPageShift;
+
+    RosAperturePageTable();
+
+    void
+    Init(
+        UINT                baseAddress,
+        RosAperturePte *    pEntries,
+        UINT                pageCount);
+
+    //
+    // Frame numbers are passed one at a time because the KMD reads them
+    // straight from the MDL
+    //
+
+    void MapPage(UINT page, UINT pfn);
+    void UnmapPage(UINT page);
+
+    //
+    // Recomputes the contiguous runs after the pages in [firstPage,
+    // firstPage + pageCount) were mapped or unmapped
+    //
+
+    void
+    UpdateRuns(
+        UINT    firstPage,
+        UINT    pageCount);
+
+    //
+    // Returns the physical address of [apertureAddress, apertureAddress +
+    // size) when the range is mapped and physically contiguous
+    //
+
+    bool
+    Translate(
+        UINT    apertureAddress,
+        UINT    size,
+        UINT *  pPhysicalAddress) const;
+
+    UINT GetPageIndex(UINT apertureAddress) const
+    {
+        ROS_PORTABLE_ASSERT(apertureAddress >= m_baseAddress);
+        return (apertureAddress - m_baseAddress) >> kPageShift;
+    }
+
+    UINT GetPageCount() const
+    {
+        return m_pageCount;
+    }
+
+    UINT GetMappedPageCount() const
+    {
+        return m_mappedPageCount;
+    }
+
+private:
+
+    bool Follows(UINT page) const
+    {
+        return (m_pEntries[page].m_runPages != 0) &&
+               (m_pEntries[page + 1].m_runPages != 0) &&
+               (m_pEntries[page + 1].m_pfn == m_pEntries[page].m_pfn + 1);
+    }
+
+    UINT                m_baseAddress;
+
+    RosAperturePte *    m_pEntries;
+    UINT                m_pageCount;
+    UINT                m_mappedPageCount;
+};
@@ -0,0 +1,247 @@
+#include "RosBinnerMemory.h"
+
+RosBinnerMemory::RosBinnerMemory()
+{
+    Init(0, 0, 0, 0);
+}
+
+void
+RosBinnerMemory::Init(
+    UINT    blockSize,
+    UINT    numBlocks,
+    UINT    minInitialSize,
+    UINT    maxInitialSize)
+{
+    ROS_PORTABLE_ASSERT(numBlocks <= kMaxBlocks);
+
+    m_blockSize = blockSize;
+    m_numBlocks = numBlocks;
+    m_minInitialSize = minInitialSize;
+    m_maxInitialSize = maxInitialSize;
+
+    m_freeMask = (numBlocks < kMaxBlocks) ? ((1u << numBlocks) - 1) : 0xFFFFFFFF;
+    m_takenMask = 0;
+    m_supplied = kNoBlock;
+
+    m_bBinning = false;
+    m_initialSize = 0;
+    m_numTaken = 0;
+
+    m_historyCount = 0;
+    m_historyNext = 0;
+
+    m_numOverflows = 0;
+    m_numStarved = 0;
+}
+
+UINT
+RosBinnerMemory::GetTargetSize(
+    UINT    tileBlocksSize) const
+{
+    UINT    peak = GetPeakUsage();
+    UINT    target = peak + peak / 4;
+
+    //
+    // The initial blocks of the tiles and as much room for the tile lists
+    // to grow
+    //
+
+    UINT    minSize = 2 * tileBlocksSize;
+
+    if (minSize < m_minInitialSize)
+    {
+        minSize = m_minInitialSize;
+    }
+
+    UINT    maxSize = (m_maxInitialSize > minSize) ? m_maxInitialSize : minSize;
+
+    if (target < minSize)
+    {
+        target = minSize;
+    }
+
+    if (target > maxSize)
+    {
+        target = maxSize;
+    }
+
+    if (m_blockSize)
+    {
+        target = (target + m_blockSize - 1) / m_blockSize * m_blockSize;
+    }
+
+    return target;
+}
+
+bool
+RosBinnerMemory::NeedsResize(
+    UINT    currentSize,
+    UINT    tileBlocksSize,
+    UINT *  pNewSize) const
+{
+    UINT    target = GetTargetSize(tileBlocksSize);
+
+    *pNewSize = target;
+
+    return (target > currentSize) || (target <= currentSize / 2);
+}
+
+void
+RosBinnerMemory::Begin(
+    UINT    initialSize)
+{
+    ROS_PORTABLE_ASSERT(!m_bBinning);
+    ROS_PORTABLE_ASSERT(0 == m_takenMask);
+
+    m_bBinning = true;
+    m_initialSize = initialSize;
+    m_numTaken = 0;
+}
+
+void
+RosBinnerMemory::OnOverspillTaken()
+{
+    //
+    // The interrupt is also raised while no block is supplied, after a
+    // reset or when the pool was exhausted
+    //
+
+    if (kNoBlock == m_supplied)
+    {
+        return;
+    }
+
+    ROS_PORTABLE_ASSERT(m_bBinning);
+
+    m_takenMask |= 1u << m_supplied;
+    m_numTaken++;
+
+    m_supplied = kNoBlock;
+}
+
+bool
+RosBinnerMemory::Supply(
+    UINT *  pBlock)
+{
+    if (kNoBlock != m_supplied)
+    {
+        *pBlock = m_supplied;
+        return true;
+    }
+
+    if (0 == m_freeMask)
+    {
+        m_numStarved++;
+        return false;
+    }
+
+    UINT    block = 0;
+
+    while (0 == (m_freeMask & (1u << block)))
+    {
+        block++;
+    }
+
+    m_freeMask &= ~(1u << block);
+    m_supplied = block;
+
+    *pBlock = block;
+
+    return true;
+}
+
+UINT
+RosBinnerMemory::Complete(
+    UINT    remaining)
+{
+    ROS_PORTABLE_ASSERT(m_bBinning);
+
+    //
+    // V3D_BPCS is what is left of the initial memory, or of the last
+    // overspill block taken
+    //
+
+    UINT    poolSize = m_numTaken ? m_blockSize : m_initialSize;
+    UINT    usage = m_initialSize + ((m_numTaken > 1) ? (m_numTaken - 1) * m_blockSize : 0);
+
+    if (m_numTaken)
+    {
+        usage += m_blockSize;
+        m_numOverflows++;
+    }
+
+    usage -= (remaining < poolSize) ? remaining : poolSize;
+
+    m_freeMask |= m_takenMask;
+    m_takenMask = 0;
+
+    m_bBinning = false;
+
+    Record(usage);
+
+    return usage;
+}
+
+void
+RosBinnerMemory::Reset()
+{
+    if (m_bBinning)
+    {
+        m_numOverflows += m_numTaken ? 1 : 0;
+
+        Record(m_initialSize + (m_numTaken + 1) * m_blockSize);
+    }
+
+    m_freeMask |= m_takenMask;
+    m_takenMask = 0;
+
+    if (kNoBlock != m_supplied)
+    {
+        m_freeMask |= 1u << m_supplied;
+        m_supplied = kNoBlock;
+    }
+
+    m_bBinning = false;
+}
+
+UINT
+RosBinnerMemory::GetFreeCount() const
+{
+    UINT    count = 0;
+
+    for (UINT mask = m_freeMask; mask; mask &= mask - 1)
+    {
+        count++;
+    }
+
+    return count;
+}
+
+UINT
+RosBinnerMemory::GetPeakUsage() const
+{
+    UINT    peak = 0;
+
+    for (UINT i = 0; i < m_historyCount; i++)
+    {
+        if (m_history[i] > peak)
+        {
+            peak = m_history[i];
+        }
+    }
+
+    return peak;
+}
+
+void
+RosBinnerMemory::Record(
+    UINT    usage)
+{
+    m_history[m_historyNext] = usage;
+    m_historyNext = (m_historyNext + 1) % kHistory;
+
+    if (m_historyCount < kHistory)
+    {
+        m_historyCount++;
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+//
+// Tile allocation memory of the binner.
+//
+// The Tile Binning Mode Configuration gives the binner its initial tile
+// allocation memory: the initial block of every tile followed by the pool
+// the tile lists grow from. When that runs out the binner continues in the
+// overspill block of V3D_BPOA/V3D_BPOS, which leaves the overspill slot
+// empty and raises the out of memory interrupt. The KMD then supplies the
+// next overspill block from a fixed pool. A binner that runs out while the
+// slot is empty stalls until one is supplied.
+//
+// Overspill blocks hold tile lists until the rendering of the DMA buffer
+// that took them completes. A supplied block the binner didn't take
+// carries over to the next DMA buffer.
+//
+// The initial size follows the peak usage of the recent frames, so that
+// most frames bin without an interrupt and the memory is given back when
+// demand drops.
+//
+// It doesn't synchronize, the KMD calls it with the lock of the hardware
+// queue held.
+//
+
+#include "RosPortable.h"
+
+class RosBinnerMemory
+{
+public:
+
+    static const UINT kMaxBlocks = 32;
+    static const UINT kHistory = 16;
+    static const UINT kNoBlock = 0xFFFFFFFF;
+
+    RosBinnerMemory();
+
+    //
+    // Overspill pool of numBlocks of blockSize, the initial tile allocation
+    // memory is kept between minInitialSize and maxInitialSize
+    //
+
+    void
+    Init(
+        UINT    blockSize,
+        UINT    numBlocks,
+        UINT    minInitialSize,
+        UINT    maxInitialSize);
+
+    //
+    // Initial size for a render target whose initial blocks take
+    // tileBlocksSize: the peak usage of the recent frames with a quarter of
+    // headroom, rounded up to the block size
+    //
+
+    UINT GetTargetSize(UINT tileBlocksSize) const;
+
+    //
+    // Whether the initial tile allocation memory of currentSize should be
+    // reallocated. It grows as soon as a frame needed more, and shrinks
+    // once the target is at most half of it.
+    //
+
+    bool
+    NeedsResize(
+        UINT    currentSize,
+        UINT    tileBlocksSize,
+        UINT *  pNewSize) const;
+
+    // A DMA buffer starts binning with initial memory of initialSize
+    void Begin(UINT initialSize);
+
+    // Out of memory interrupt, the binner took the supplied block if any
+    void OnOverspillTaken();
+
+    //
+    // Picks a free block to supply in V3D_BPOA/V3D_BPOS when none is.
+    // Fails when the pool is exhausted, the binner stalls if it needs it.
+    //
+
+    bool Supply(UINT * pBlock);
+
+    //
+    // Rendering of the DMA buffer completed, remaining is V3D_BPCS after
+    // its binning. Frees the overspill blocks it took and records its
+    // usage, which is returned.
+    //
+
+    UINT Complete(UINT remaining);
+
+    //
+    // The V3D was reset, the blocks taken and supplied are free again. The
+    // DMA buffer that was binning counts as having used all it took and
+    // one more block.
+    //
+
+    void Reset();
+
+    bool IsSupplied() const
+    {
+        return kNoBlock != m_supplied;
+    }
+
+    UINT GetBlockOffset(UINT block) const
+    {
+        ROS_PORTABLE_ASSERT(block < m_numBlocks);
+        return block * m_blockSize;
+    }
+
+    UINT GetBlockSize() const
+    {
+        return m_blockSize;
+    }
+
+    UINT GetFreeCount() const;
+
+    UINT GetPeakUsage() const;
+
+    // Frames that took overspill blocks
+    UINT GetOverflowCount() const
+    {
+        return m_numOverflows;
+    }
+
+    // Supplies that found the pool exhausted
+    UINT GetStarvedCount() const
+    {
+        return m_numStarved;
+    }
+
+private:
+
+    void Record(UINT usage);
+
+    UINT            m_blockSize;
+    UINT            m_numBlocks;
+    UINT            m_minInitialSize;
+    UINT            m_maxInitialSize;
+
+    UINT            m_freeMask;
+    UINT            m_takenMask;
+    UINT            m_supplied;
+
+    // DMA buffer binning or rendering
+    bool            m_bBinning;
+    UINT            m_initialSize;
+    UINT            m_numTaken;
+
+    // Usage of the recent frames
+    UINT            m_history[kHistory];
+    UINT            m_historyCount;
+    UINT            m_historyNext;
+
+    UINT            m_numOverflows;
+    UINT            m_numStarved;
+};
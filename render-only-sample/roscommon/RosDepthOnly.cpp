@@ -0,0 +1,10 @@
+#include "RosDepthOnly.h"
+
+const ULONGLONG RosDepthOnly::s_shader[kShaderInstructions] =
+{
+    0x400009e7009e7000,     // sbwait    ; nop             ; nop
+    0x10020b27159cffc0,     //             mov tlb_z, rb15 ; nop
+    0x300009e7009e7000,     // thrend    ; nop             ; nop
+    0x100009e7009e7000,     //             nop             ; nop
+    0x500009e7009e7000      // sbdone    ; nop             ; nop
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+//
+// Draws rendering depth alone, as the passes of a Z-prepass or a shadow
+// map: no render target is bound, or the color write mask is 0.
+//
+// A depth-only draw runs a fragment shader that only writes the
+// interpolated Z to the tile buffer, in place of a pixel shader that
+// neither discards nor writes oDepth: its color goes nowhere. A render
+// pass whose draws were all depth-only and that doesn't clear the render
+// target neither loads nor stores its color, the tiles end with the store
+// of the depth stencil buffer.
+//
+
+#include "RosPortable.h"
+
+class RosDepthOnly
+{
+public:
+
+    static const UINT kShaderInstructions = 5;
+
+    // QPU code of the fragment shader of depth-only draws
+    static const ULONGLONG s_shader[kShaderInstructions];
+
+    static bool
+    IsDepthOnly(
+        bool    bRenderTarget,
+        UINT    colorWriteMask)
+    {
+        return !bRenderTarget || (0 == colorWriteMask);
+    }
+
+    // Whether the depth-only fragment shader stands in for the pixel shader
+    static bool
+    ReplacesShader(
+        bool    bDepthOnly,
+        bool    bDiscard,
+        bool    bDepthOutput)
+    {
+        return bDepthOnly && !bDiscard && !bDepthOutput;
+    }
+};
@@ -0,0 +1,28 @@
+#include "RosEarlyZ.h"
+
+RosZMode
+RosEarlyZ::GetZMode(
+    RosDepthFunc    depthFunc,
+    bool            bDepthWrite,
+    bool            bDiscard,
+    bool            bDepthOutput)
+{
+    if (bDepthOutput)
+    {
+        return ROS_Z_MODE_LATE;
+    }
+
+    if (!bDiscard || !bDepthWrite)
+    {
+        return ROS_Z_MODE_EARLY;
+    }
+
+    switch (depthFunc)
+    {
+    case ROS_DEPTH_FUNC_NOT_EQUAL:
+    case ROS_DEPTH_FUNC_ALWAYS:
+        return ROS_Z_MODE_LATE;
+    default:
+        return ROS_Z_MODE_EARLY_TEST;
+    }
+}
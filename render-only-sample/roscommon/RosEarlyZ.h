@@ -0,0 +1,59 @@
+#pragma once
+
+//
+// Z mode of a draw.
+//
+// Early-Z tests fragments against the depth buffer before the fragment
+// shader runs, and with updates writes the depth of those passing, so a
+// fragment hidden by one drawn before it is rejected without shading. It
+// is safe for a shader that neither discards nor writes oDepth, it then
+// behaves exactly like the late test after the shader.
+//
+// A shader writing oDepth is tested with a depth only known once it ran,
+// it can only be tested late. A discarding shader must not write the depth
+// of the fragments it discards, but it can still be tested early:
+//
+//  - Without depth writes early-Z never writes, any function is safe.
+//  - With depth writes the early test may only reject fragments the late
+//    test would reject as well. With a function ordering depths, or equal,
+//    the depth buffer only moves towards the depths that fail, a fragment
+//    failing early fails late. The late test writes the depth of those the
+//    shader kept.
+//  - With not equal a fragment failing early can pass after another one
+//    wrote the depth, and always never rejects: both test late.
+//
+
+#include "RosPortable.h"
+
+// Depth test functions, in the encoding of VC4DepthTestFunc
+enum RosDepthFunc
+{
+    ROS_DEPTH_FUNC_NEVER            = 0,
+    ROS_DEPTH_FUNC_LESS             = 1,
+    ROS_DEPTH_FUNC_EQUAL            = 2,
+    ROS_DEPTH_FUNC_LESS_EQUAL       = 3,
+    ROS_DEPTH_FUNC_GREATER          = 4,
+    ROS_DEPTH_FUNC_NOT_EQUAL        = 5,
+    ROS_DEPTH_FUNC_GREATER_EQUAL    = 6,
+    ROS_DEPTH_FUNC_ALWAYS           = 7
+};
+
+enum RosZMode
+{
+    ROS_Z_MODE_LATE,                    // Test and write after the shader
+    ROS_Z_MODE_EARLY_TEST,              // Reject before the shader, test and write after
+    ROS_Z_MODE_EARLY                    // Test and write before the shader
+};
+
+class RosEarlyZ
+{
+public:
+
+    // Cheapest safe Z mode for a pixel shader drawn with the depth state
+    static RosZMode
+    GetZMode(
+        RosDepthFunc    depthFunc,
+        bool            bDepthWrite,
+        bool            bDiscard,
+        bool            bDepthOutput);
+};
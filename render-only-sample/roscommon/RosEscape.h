@@ -0,0 +1,32 @@
+#pragma once
+
+#include "RosTraceRing.h"
+
+//
+// Driver private escapes, the private data starts with the escape ID
+//
+enum RosEscapeId
+{
+    ROS_ESCAPE_TRACE_CONTROL = 1,
+    ROS_ESCAPE_TRACE_READ,
+};
+
+typedef struct _ROS_ESCAPE_TRACE_CONTROL
+{
+    UINT                m_escapeId;     // ROS_ESCAPE_TRACE_CONTROL
+    BOOL                m_enable;
+} ROS_ESCAPE_TRACE_CONTROL;
+
+//
+// Snapshot of the submission trace, the private data is sized for up to
+// m_maxEvents events
+//
+typedef struct _ROS_ESCAPE_TRACE_READ
+{
+    UINT                m_escapeId;     // ROS_ESCAPE_TRACE_READ
+    UINT                m_maxEvents;
+    UINT                m_numEvents;    // Out
+    UINT                m_reserved;
+    ULONGLONG           m_frequency;    // Out, of the event timestamps
+    RosTraceEvent       m_events[1];
+} ROS_ESCAPE_TRACE_READ;
@@ -0,0 +1,131 @@
+#include "RosFlipQueue.h"
+
+RosFlipQueue::RosFlipQueue()
+{
+    Init(0);
+}
+
+void
+RosFlipQueue::Init(
+    UINT    address)
+{
+    m_head = 0;
+    m_count = 0;
+    m_bProgrammed = false;
+
+    m_scanoutAddress = address;
+    m_scanoutFenceId = 0;
+    m_lastFlipVSync = 0;
+
+    m_numPresents = 0;
+    m_numVSyncs = 0;
+    m_numFlips = 0;
+    m_numMissed = 0;
+    m_numDropped = 0;
+}
+
+bool
+RosFlipQueue::Queue(
+    UINT    address,
+    UINT    interval,
+    UINT    fenceId)
+{
+    ROS_PORTABLE_ASSERT(interval <= kMaxFlipInterval);
+
+    m_numPresents++;
+
+    //
+    // An immediate flip replaces the display list and the flips waiting
+    // for it
+    //
+
+    if (0 == interval)
+    {
+        m_numDropped += m_count;
+        m_count = 0;
+        m_bProgrammed = false;
+    }
+
+    ROS_PORTABLE_ASSERT(!IsFull());
+
+    RosFlip *   pFlip = &m_flips[(m_head + m_count) % kMaxQueuedFlips];
+
+    pFlip->m_address = address;
+    pFlip->m_interval = interval;
+    pFlip->m_fenceId = fenceId;
+
+    m_count++;
+
+    if (1 != m_count)
+    {
+        return false;
+    }
+
+    //
+    // Shown from the frame after the next VfpStart. Programmed by that
+    // VfpStart rather than now when the last one showed a flip, which may
+    // not be latched yet.
+    //
+
+    if ((0 == interval) ||
+        (((m_numVSyncs + 1) >= (m_lastFlipVSync + interval)) &&
+         ((0 == m_numFlips) || (m_numVSyncs > m_lastFlipVSync))))
+    {
+        m_bProgrammed = true;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool
+RosFlipQueue::OnVSync(
+    UINT *  pAddress)
+{
+    m_numVSyncs++;
+
+    if (m_bProgrammed)
+    {
+        Show();
+
+        return false;
+    }
+
+    if (m_count && (m_numVSyncs >= (m_lastFlipVSync + m_flips[m_head].m_interval)))
+    {
+        *pAddress = m_flips[m_head].m_address;
+
+        Show();
+
+        return true;
+    }
+
+    return false;
+}
+
+void
+RosFlipQueue::Show()
+{
+    const RosFlip & flip = m_flips[m_head];
+
+    //
+    // The first flip and immediate flips don't wait for the flip before
+    // them
+    //
+
+    if (m_numFlips && flip.m_interval &&
+        (m_numVSyncs > (m_lastFlipVSync + flip.m_interval)))
+    {
+        m_numMissed += m_numVSyncs - (m_lastFlipVSync + flip.m_interval);
+    }
+
+    m_scanoutAddress = flip.m_address;
+    m_scanoutFenceId = flip.m_fenceId;
+    m_lastFlipVSync = m_numVSyncs;
+    m_numFlips++;
+
+    m_head = (m_head + 1) % kMaxQueuedFlips;
+    m_count--;
+    m_bProgrammed = false;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+//
+// Flips of the primary queued to the display.
+//
+// The HVS latches the address of the primary in its display list at the
+// start of a frame, so the display list holds one flip at a time. The
+// VfpStart interrupt comes before the frame start: a flip programmed
+// before it is shown from the next frame, and the flips after it must not
+// be programmed before that frame starts. They wait in the queue, the
+// VfpStart interrupt of that frame programs the next one. The display
+// shows a new frame on every vsync while the application keeps the queue
+// filled.
+//
+// A flip is shown interval vsyncs after the flip before it. An immediate
+// flip (interval 0) is programmed right away and replaces the flips
+// waiting before it, they are never shown.
+//
+// The statistics count the presents, the vsyncs and the vsyncs missed by
+// flips shown later than their interval after the flip before them, as
+// when the application doesn't keep the queue filled.
+//
+// The queue doesn't synchronize, the KMD calls it from
+// SetVidPnSourceAddress, which the OS synchronizes with the interrupt
+// routine.
+//
+
+#include "RosPortable.h"
+
+typedef struct _RosFlip
+{
+    UINT            m_address;          // Of the primary
+    UINT            m_interval;         // Vsyncs after the flip before it, 0 immediate
+    UINT            m_fenceId;          // Of the last DMA buffer rendering the primary
+} RosFlip;
+
+class RosFlipQueue
+{
+public:
+
+    // MaxQueuedFlipOnVSync, the one in the display list included
+    static const UINT kMaxQueuedFlips = 3;
+
+    static const UINT kMaxFlipInterval = 4;
+
+    RosFlipQueue();
+
+    // Nothing queued, the display shows the primary at the address
+    void Init(UINT address);
+
+    //
+    // Queues a flip of the primary at the address. Returns true when the
+    // caller programs it into the display list now. The fence only ties the
+    // flip to its frame in the trace.
+    //
+
+    bool
+    Queue(
+        UINT    address,
+        UINT    interval,
+        UINT    fenceId);
+
+    //
+    // At the VfpStart interrupt, the flip in the display list is shown from
+    // the next frame. Otherwise returns true when the caller programs the
+    // address of the next flip, it is shown from the next frame instead.
+    //
+
+    bool OnVSync(UINT * pAddress);
+
+    bool IsFull() const
+    {
+        return kMaxQueuedFlips == m_count;
+    }
+
+    UINT GetQueuedCount() const
+    {
+        return m_count;
+    }
+
+    // Address of the primary shown
+    UINT GetScanoutAddress() const
+    {
+        return m_scanoutAddress;
+    }
+
+    UINT GetScanoutFenceId() const
+    {
+        return m_scanoutFenceId;
+    }
+
+    ULONGLONG GetPresentCount() const
+    {
+        return m_numPresents;
+    }
+
+    ULONGLONG GetVSyncCount() const
+    {
+        return m_numVSyncs;
+    }
+
+    // Flips shown
+    ULONGLONG GetFlipCount() const
+    {
+        return m_numFlips;
+    }
+
+    // Vsyncs the display repeated a frame past the interval of the next one
+    ULONGLONG GetMissedCount() const
+    {
+        return m_numMissed;
+    }
+
+    // Flips replaced by an immediate flip before they were shown
+    ULONGLONG GetDroppedCount() const
+    {
+        return m_numDropped;
+    }
+
+private:
+
+    // The flip at the head is shown from the frame after the VfpStart
+    void Show();
+
+    // Queued flips, oldest first, the oldest is in the display list when
+    // m_bProgrammed
+    RosFlip         m_flips[kMaxQueuedFlips];
+    UINT            m_head;
+    UINT            m_count;
+    bool            m_bProgrammed;
+
+    UINT            m_scanoutAddress;
+    UINT            m_scanoutFenceId;
+    ULONGLONG       m_lastFlipVSync;    // VfpStart after which it's shown
+
+    ULONGLONG       m_numPresents;
+    ULONGLONG       m_numVSyncs;
+    ULONGLONG       m_numFlips;
+    ULONGLONG       m_numMissed;
+    ULONGLONG       m_numDropped;
+};
@@ -3,11 +3,16 @@
 #pragma warning(disable:4201)
 
 #include "Vc4Hw.h"
+#include "Vc4Ddi.h"
 
 enum GpuCommandId
 {
     Nop,
     ResourceCopy,
+    Timestamp,
+    CacheInvalidate,
+    MaskedFill,
+    MsaaResolve,
     Header = 'RSCB'
 };
 
@@ -21,6 +26,14 @@ struct GpuCommandBufferHeader
 #if VC4
 
             UINT    m_hasVC4ClearColors : 1;
+            UINT    m_hasVC4PerfCounters : 1;
+            UINT    m_hasVC4CacheMaintenance : 1;
+
+            // Flushed in the middle of the draws to the render target
+            UINT    m_vc4PassContinues : 1;
+
+            // Draws wrote no color, only the depth stencil buffer
+            UINT    m_vc4DepthOnly : 1;
 
 #endif
         };
@@ -30,7 +43,21 @@ struct GpuCommandBufferHeader
 
 #if VC4
 
-    VC4ClearColors  m_vc4ClearColors;
+    VC4ClearColors          m_vc4ClearColors;
+    VC4PerfCounterSelect    m_vc4PerfCounters;
+    VC4CacheMaintenance     m_vc4CacheMaintenance;
+    VC4DepthStencilUse      m_vc4DepthStencil;
+    VC4ResolveUse           m_vc4Resolve;
+    VC4DirtyRect            m_vc4DirtyRect;
+
+    //
+    // The Binning Control List of a DMA buffer continuing a pass is chained
+    // to the one before it: the KMD writes a Branch to its draws, after the
+    // Start Tile Binning, over the epilog of the one before it
+    //
+
+    UINT                    m_vc4PassBodyOffset;
+    UINT                    m_vc4PassEpilogOffset;
 
 #endif
 };
@@ -42,6 +69,58 @@ struct GpuResourceCopy
     size_t              m_sizeBytes;
 };
 
+//
+// Run once the DMA buffers submitted before have completed, writes the
+// performance counter to the VC4PerfCounterReport at m_reportGpuAddress
+// and increments its sample count
+//
+
+struct GpuTimestamp
+{
+    PHYSICAL_ADDRESS    m_reportGpuAddress;
+};
+
+//
+// Invalidates the CPU caches over what the GPU wrote before the CPU reads it
+//
+
+struct GpuCacheInvalidate
+{
+    PHYSICAL_ADDRESS    m_gpuAddress;
+    size_t              m_sizeBytes;
+};
+
+//
+// Writes m_value over the bits of m_mask of each 32 bit word, clears the
+// depth or the stencil of a D24S8 buffer without the other
+//
+
+struct GpuMaskedFill
+{
+    PHYSICAL_ADDRESS    m_gpuAddress;
+    size_t              m_sizeBytes;
+    UINT                m_mask;
+    UINT                m_value;
+};
+
+//
+// Averages the samples of each pixel of the multisample render target at
+// m_srcGpuAddress, full resolution tile dumps (RosMsaa.h), into the linear
+// or T-format render target at m_dstGpuAddress. Resolves the render target
+// of a pass the tile buffer didn't resolve when it stored the tiles.
+//
+
+struct GpuMsaaResolve
+{
+    PHYSICAL_ADDRESS    m_dstGpuAddress;
+    PHYSICAL_ADDRESS    m_srcGpuAddress;
+    UINT                m_width;
+    UINT                m_height;
+    UINT                m_srcWidthInTiles;
+    UINT                m_dstPitchBytes;
+    UINT                m_bDstTFormat;
+};
+
 struct GpuCommand
 {
     GpuCommandId    m_commandId;
@@ -50,5 +129,9 @@ struct GpuCommand
     {
         GpuCommandBufferHeader  m_commandBufferHeader;
         GpuResourceCopy         m_resourceCopy;
+        GpuTimestamp            m_timestamp;
+        GpuCacheInvalidate      m_cacheInvalidate;
+        GpuMaskedFill           m_maskedFill;
+        GpuMsaaResolve          m_msaaResolve;
     };
 };
@@ -0,0 +1,251 @@
+#include "RosHwQueue.h"
+
+RosHwQueue::RosHwQueue()
+{
+    Init();
+}
+
+void
+RosHwQueue::Init()
+{
+    for (UINT i = 0; i < kMaxSlots; i++)
+    {
+        m_slots[i].m_state = ROS_HW_SLOT_FREE;
+    }
+
+    m_head = 0;
+    m_count = 0;
+    m_running = kNoSlot;
+
+    m_progressAddresses[0] = 0;
+    m_progressAddresses[1] = 0;
+    m_progressTime = 0;
+
+    m_numCompleted = 0;
+    m_numFaulted = 0;
+}
+
+bool
+RosHwQueue::Reserve(
+    UINT *  pSlot)
+{
+    if (IsFull())
+    {
+        return false;
+    }
+
+    UINT        slot = (m_head + m_count) % kMaxSlots;
+    RosHwSlot * pSlotInfo = &m_slots[slot];
+
+    ROS_PORTABLE_ASSERT(pSlotInfo->m_state == ROS_HW_SLOT_FREE);
+
+    pSlotInfo->m_state = ROS_HW_SLOT_PREPARING;
+    pSlotInfo->m_fenceId = 0;
+    pSlotInfo->m_bBinned = false;
+    pSlotInfo->m_bFaulted = false;
+    pSlotInfo->m_queueTime = 0;
+    pSlotInfo->m_startTime = 0;
+    pSlotInfo->m_binnedTime = 0;
+    pSlotInfo->m_completeTime = 0;
+
+    m_count++;
+
+    *pSlot = slot;
+
+    return true;
+}
+
+void
+RosHwQueue::Unreserve(
+    UINT    slot)
+{
+    ROS_PORTABLE_ASSERT(m_count != 0);
+    ROS_PORTABLE_ASSERT(slot == (m_head + m_count - 1) % kMaxSlots);
+    ROS_PORTABLE_ASSERT(m_slots[slot].m_state == ROS_HW_SLOT_PREPARING);
+
+    m_slots[slot].m_state = ROS_HW_SLOT_FREE;
+
+    m_count--;
+}
+
+bool
+RosHwQueue::Queue(
+    UINT        slot,
+    UINT        fenceId,
+    ULONGLONG   time)
+{
+    RosHwSlot * pSlotInfo = &m_slots[slot];
+
+    ROS_PORTABLE_ASSERT(pSlotInfo->m_state == ROS_HW_SLOT_PREPARING);
+
+    pSlotInfo->m_state = ROS_HW_SLOT_QUEUED;
+    pSlotInfo->m_fenceId = fenceId;
+    pSlotInfo->m_queueTime = time;
+
+    if (m_running != kNoSlot)
+    {
+        return false;
+    }
+
+    //
+    // The DMA buffers before it completed, otherwise one would run
+    //
+
+    ROS_PORTABLE_ASSERT((slot == m_head) || (m_slots[(slot + kMaxSlots - 1) % kMaxSlots].m_state == ROS_HW_SLOT_COMPLETED));
+
+    Start(slot, time);
+
+    return true;
+}
+
+void
+RosHwQueue::Start(
+    UINT        slot,
+    ULONGLONG   time)
+{
+    m_slots[slot].m_state = ROS_HW_SLOT_RUNNING;
+    m_slots[slot].m_startTime = time;
+
+    m_running = slot;
+
+    m_progressAddresses[0] = 0;
+    m_progressAddresses[1] = 0;
+    m_progressTime = time;
+}
+
+bool
+RosHwQueue::OnBinningDone(
+    ULONGLONG   time)
+{
+    if ((m_running == kNoSlot) || m_slots[m_running].m_bBinned)
+    {
+        return false;
+    }
+
+    m_slots[m_running].m_bBinned = true;
+    m_slots[m_running].m_binnedTime = time;
+
+    m_progressTime = time;
+
+    return true;
+}
+
+bool
+RosHwQueue::OnRenderingDone(
+    ULONGLONG   time,
+    UINT *      pCompletedSlot,
+    UINT *      pNextSlot)
+{
+    if (m_running == kNoSlot)
+    {
+        return false;
+    }
+
+    UINT        slot = m_running;
+    RosHwSlot * pSlotInfo = &m_slots[slot];
+
+    //
+    // Rendering waits for binning, its interrupt may have been merged
+    //
+
+    if (!pSlotInfo->m_bBinned)
+    {
+        pSlotInfo->m_bBinned = true;
+        pSlotInfo->m_binnedTime = time;
+    }
+
+    pSlotInfo->m_state = ROS_HW_SLOT_COMPLETED;
+    pSlotInfo->m_completeTime = time;
+
+    m_running = kNoSlot;
+    m_numCompleted++;
+
+    *pCompletedSlot = slot;
+    *pNextSlot = kNoSlot;
+
+    UINT    next = (slot + 1) % kMaxSlots;
+
+    if ((next != m_head) && (m_slots[next].m_state == ROS_HW_SLOT_QUEUED))
+    {
+        Start(next, time);
+
+        *pNextSlot = next;
+    }
+
+    return true;
+}
+
+bool
+RosHwQueue::IsHung(
+    ULONGLONG   time,
+    UINT        binningAddress,
+    UINT        renderingAddress,
+    ULONGLONG   timeout)
+{
+    if (m_running == kNoSlot)
+    {
+        return false;
+    }
+
+    if ((binningAddress != m_progressAddresses[0]) ||
+        (renderingAddress != m_progressAddresses[1]))
+    {
+        m_progressAddresses[0] = binningAddress;
+        m_progressAddresses[1] = renderingAddress;
+        m_progressTime = time;
+
+        return false;
+    }
+
+    return (time - m_progressTime) >= timeout;
+}
+
+UINT
+RosHwQueue::Reset(
+    ULONGLONG   time,
+    UINT *      pSlots)
+{
+    UINT    numFaulted = 0;
+
+    for (UINT i = 0; i < m_count; i++)
+    {
+        UINT        slot = (m_head + i) % kMaxSlots;
+        RosHwSlot * pSlotInfo = &m_slots[slot];
+
+        if ((pSlotInfo->m_state != ROS_HW_SLOT_RUNNING) &&
+            (pSlotInfo->m_state != ROS_HW_SLOT_QUEUED))
+        {
+            continue;
+        }
+
+        pSlotInfo->m_state = ROS_HW_SLOT_COMPLETED;
+        pSlotInfo->m_bFaulted = true;
+        pSlotInfo->m_completeTime = time;
+
+        pSlots[numFaulted++] = slot;
+    }
+
+    m_running = kNoSlot;
+    m_numFaulted += numFaulted;
+
+    return numFaulted;
+}
+
+bool
+RosHwQueue::Retire(
+    UINT *  pSlot)
+{
+    if ((0 == m_count) || (m_slots[m_head].m_state != ROS_HW_SLOT_COMPLETED))
+    {
+        return false;
+    }
+
+    *pSlot = m_head;
+
+    m_slots[m_head].m_state = ROS_HW_SLOT_FREE;
+
+    m_head = (m_head + 1) % kMaxSlots;
+    m_count--;
+
+    return true;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+//
+// DMA buffers queued to the V3D.
+//
+// The worker thread prepares a DMA buffer in a slot (aperture copies, the
+// rendering control list, cache maintenance) while the GPU runs the ones
+// before it, and queues it. The DPC of the frame done interrupt completes
+// the running DMA buffer and starts the next queued one right away, the
+// worker thread later retires the completed slots and releases what their
+// DMA buffers used.
+//
+// Binning control lists are patched with the one tile allocation memory,
+// so DMA buffers run one at a time in queue order.
+//
+// A running DMA buffer whose control lists don't advance for the hang
+// timeout is hung. The caller resets the V3D and calls Reset(), which
+// completes the running and the queued DMA buffers as faulted.
+//
+// The queue doesn't synchronize, the KMD calls it with its spin lock held.
+//
+
+#include "RosPortable.h"
+
+enum RosHwSlotState
+{
+    ROS_HW_SLOT_FREE,
+    ROS_HW_SLOT_PREPARING,              // Reserved by the worker thread
+    ROS_HW_SLOT_QUEUED,                 // Waits for the DMA buffers before it
+    ROS_HW_SLOT_RUNNING,                // Binning or rendering on the GPU
+    ROS_HW_SLOT_COMPLETED,              // Fence reported, waits to be retired
+};
+
+typedef struct _RosHwSlot
+{
+    RosHwSlotState  m_state;
+    UINT            m_fenceId;
+    bool            m_bBinned;
+    bool            m_bFaulted;         // Dropped by a reset of the V3D
+
+    // Performance counter
+    ULONGLONG       m_queueTime;
+    ULONGLONG       m_startTime;
+    ULONGLONG       m_binnedTime;
+    ULONGLONG       m_completeTime;
+} RosHwSlot;
+
+class RosHwQueue
+{
+public:
+
+    static const UINT kMaxSlots = 4;
+    static const UINT kNoSlot = 0xFFFFFFFF;
+
+    RosHwQueue();
+
+    void Init();
+
+    //
+    // Reserves the slot after the newest one for the worker thread to
+    // prepare a DMA buffer in. Fails when every slot is in use.
+    //
+
+    bool Reserve(UINT * pSlot);
+
+    // Frees the newest slot, reserved for a DMA buffer that won't run
+    void Unreserve(UINT slot);
+
+    //
+    // Queues the DMA buffer prepared in the slot. Returns true when no DMA
+    // buffer runs, the caller starts it.
+    //
+
+    bool
+    Queue(
+        UINT        slot,
+        UINT        fenceId,
+        ULONGLONG   time);
+
+    // Binning of the running DMA buffer is done, false if none runs
+    bool OnBinningDone(ULONGLONG time);
+
+    //
+    // Completes the running DMA buffer. Returns false if none runs,
+    // otherwise its slot and the slot of the queued DMA buffer the caller
+    // starts next, kNoSlot if there is none.
+    //
+
+    bool
+    OnRenderingDone(
+        ULONGLONG   time,
+        UINT *      pCompletedSlot,
+        UINT *      pNextSlot);
+
+    //
+    // Called periodically with the current addresses of the binning and
+    // rendering control list threads, true once they haven't advanced for
+    // timeout
+    //
+
+    bool
+    IsHung(
+        ULONGLONG   time,
+        UINT        binningAddress,
+        UINT        renderingAddress,
+        ULONGLONG   timeout);
+
+    //
+    // After a reset of the V3D, completes the running and the queued DMA
+    // buffers as faulted. pSlots receives their slots in queue order,
+    // returns how many.
+    //
+
+    UINT
+    Reset(
+        ULONGLONG   time,
+        UINT *      pSlots);
+
+    // Frees the oldest slot if it completed
+    bool Retire(UINT * pSlot);
+
+    // No slot is in use, completed slots are retired
+    bool IsIdle() const
+    {
+        return 0 == m_count;
+    }
+
+    bool IsFull() const
+    {
+        return kMaxSlots == m_count;
+    }
+
+    UINT GetRunningSlot() const
+    {
+        return m_running;
+    }
+
+    const RosHwSlot & GetSlot(UINT slot) const
+    {
+        ROS_PORTABLE_ASSERT(slot < kMaxSlots);
+        return m_slots[slot];
+    }
+
+    UINT GetCompletedCount() const
+    {
+        return m_numCompleted;
+    }
+
+    UINT GetFaultedCount() const
+    {
+        return m_numFaulted;
+    }
+
+private:
+
+    void Start(UINT slot, ULONGLONG time);
+
+    RosHwSlot       m_slots[kMaxSlots];
+
+    // Slots in use, oldest first
+    UINT            m_head;
+    UINT            m_count;
+
+    UINT            m_running;
+
+    // Control list addresses at the last check that saw them advance
+    UINT            m_progressAddresses[2];
+    ULONGLONG       m_progressTime;
+
+    UINT            m_numCompleted;
+    UINT            m_numFaulted;
+};
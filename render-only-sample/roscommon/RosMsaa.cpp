@@ -0,0 +1,91 @@
+#include "RosMsaa.h"
+
+//
+// Rotated grid of the 4x multisample mode
+//
+static const UINT s_samplePositions[RosMsaa::kSamples][2] = {
+    { 3, 1 },
+    { 7, 3 },
+    { 1, 5 },
+    { 5, 7 },
+};
+
+void
+RosMsaa::GetSamplePosition(
+    UINT    sample,
+    UINT   *pX,
+    UINT   *pY)
+{
+    ROS_PORTABLE_ASSERT(sample < kSamples);
+
+    *pX = s_samplePositions[sample][0];
+    *pY = s_samplePositions[sample][1];
+}
+
+UINT
+RosMsaa::GetSampleOffset(
+    UINT    widthInTiles,
+    UINT    x,
+    UINT    y,
+    UINT    sample)
+{
+    const UINT  quadBytes = 2 * 2 * kSamples * kSampleBytes;
+    const UINT  quadsPerRow = kTilePixels / 2;
+
+    ROS_PORTABLE_ASSERT(x < widthInTiles * kTilePixels);
+    ROS_PORTABLE_ASSERT(sample < kSamples);
+
+    UINT    tile = (y / kTilePixels) * widthInTiles + (x / kTilePixels);
+    UINT    tileX = x % kTilePixels;
+    UINT    tileY = y % kTilePixels;
+
+    return
+        tile * kTileBytes +
+        ((tileY / 2) * quadsPerRow + (tileX / 2)) * quadBytes +
+        sample * 2 * 2 * kSampleBytes +
+        ((tileY & 1) * 2 + (tileX & 1)) * kSampleBytes;
+}
+
+void
+RosMsaa::Resolve(
+    const BYTE *    pSrc,
+    UINT            srcWidthInTiles,
+    BYTE *          pDst,
+    UINT            dstPitchBytes,
+    bool            bDstTFormat,
+    UINT            width,
+    UINT            height)
+{
+    const UINT  dstWidthInTiles = RosTFormat::GetWidthInTiles(width, kSampleBytes);
+
+    for (UINT y = 0; y < height; y++)
+    {
+        for (UINT x = 0; x < width; x++)
+        {
+            UINT    sums[kSampleBytes] = { 0 };
+
+            for (UINT sample = 0; sample < kSamples; sample++)
+            {
+                const BYTE * pSample = pSrc + GetSampleOffset(srcWidthInTiles, x, y, sample);
+
+                for (UINT channel = 0; channel < kSampleBytes; channel++)
+                {
+                    sums[channel] += pSample[channel];
+                }
+            }
+
+            UINT    pixel = 0;
+
+            for (UINT channel = 0; channel < kSampleBytes; channel++)
+            {
+                pixel |= ((sums[channel] + kSamples / 2) / kSamples) << (8 * channel);
+            }
+
+            UINT    dstOffset = bDstTFormat ?
+                RosTFormat::GetPixelOffset(dstWidthInTiles, x, y, kSampleBytes) :
+                y * dstPitchBytes + x * kSampleBytes;
+
+            *(UINT *)(pDst + dstOffset) = pixel;
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+//
+// Layout and resolve of the 4x multisample render targets.
+//
+// The tile buffer renders a multisample render target in tiles of 32x32
+// pixels with 4 samples each, and stores them as full resolution tile
+// dumps: the 16KB of a tile are its 2x2 pixel quads in rows of 16, each
+// quad has sample 0 of its 4 pixels, then sample 1 and so on. The tiles
+// follow each other in rows of the width of the render target.
+//
+// The store of the tiles resolves the samples into a render target of one
+// sample at the end of the pass. Resolve() does the same on the CPU for a
+// pass the tile buffer already stored, into a linear or a T-format render
+// target.
+//
+
+#include "RosPortable.h"
+
+#include "RosTFormat.h"
+
+class RosMsaa
+{
+public:
+
+    static const UINT kSamples = 4;
+    static const UINT kTilePixels = 32;
+    static const UINT kSampleBytes = 4;
+    static const UINT kTileBytes = kTilePixels * kTilePixels * kSamples * kSampleBytes;
+
+    // Sample positions are in 1/8 of a pixel, from its top left corner
+    static const UINT kSubpixels = 8;
+
+    static void GetSamplePosition(UINT sample, UINT * pX, UINT * pY);
+
+    // Tiles across a width or a height in pixels
+    static UINT GetTiles(UINT pixels)
+    {
+        return (pixels + kTilePixels - 1) / kTilePixels;
+    }
+
+    static UINT GetSizeBytes(UINT width, UINT height)
+    {
+        return GetTiles(width) * GetTiles(height) * kTileBytes;
+    }
+
+    // Offset of a sample of the pixel in the tile dumps
+    static UINT GetSampleOffset(UINT widthInTiles, UINT x, UINT y, UINT sample);
+
+    //
+    // Box filters the samples of each pixel of a width x height render
+    // target into 32 bit pixels of the destination, per 8 bit channel
+    // rounded to nearest like the resolving store. A T-format destination
+    // has no pitch, dstPitchBytes is ignored.
+    //
+
+    static void
+    Resolve(
+        const BYTE *    pSrc,
+        UINT            srcWidthInTiles,
+        BYTE *          pDst,
+        UINT            dstPitchBytes,
+        bool            bDstTFormat,
+        UINT            width,
+        UINT            height);
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+//
+// Platform of the roscommon code shared by the KMD, the UMD and the host
+// tests. Off Windows it declares the Windows types the shared code uses.
+//
+
+#if defined(_KERNEL_MODE)
+
+#include <ntddk.h>
+
+#define ROS_PORTABLE_ASSERT(x) NT_ASSERT(x)
+
+#elif defined(_WIN32)
+
+#include <windows.h>
+#include <assert.h>
+
+#define ROS_PORTABLE_ASSERT(x) assert(x)
+
+#else
+
+#include <assert.h>
+#include <stddef.h>
+
+typedef unsigned char BYTE;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef int LONG;
+typedef unsigned long long ULONGLONG;
+
+#define ROS_PORTABLE_ASSERT(x) assert(x)
+
+#endif
@@ -0,0 +1,256 @@
+#include "RosRenderPass.h"
+
+static const RosRenderPassTiles s_noTiles = { 0, 0, 0, 0 };
+
+RosRenderPass::RosRenderPass()
+{
+    m_numDmaBuffers = 0;
+    m_bContinues = false;
+    m_bDepthStencilUsed = false;
+    m_bDepthStencilWritten = false;
+    m_bDiscardDepthStencil = false;
+    m_bDepthOnly = false;
+    m_dirtyTiles = s_noTiles;
+
+    m_first.m_renderTarget = 0;
+    m_first.m_widthInTiles = 0;
+    m_first.m_heightInTiles = 0;
+    m_first.m_dirtyTiles = s_noTiles;
+    m_first.m_bClear = false;
+    m_first.m_bContinues = false;
+    m_first.m_bPerfCounters = false;
+    m_first.m_bApertureBounce = false;
+    m_first.m_depthStencil = 0;
+    m_first.m_clearDepthStencil = 0;
+    m_first.m_bClearDepthStencil = false;
+    m_first.m_bDepthStencilUsed = false;
+    m_first.m_bDepthStencilWritten = false;
+    m_first.m_bDiscardDepthStencil = false;
+    m_first.m_bDepthOnly = false;
+
+    m_numPasses = 0;
+    m_numMerged = 0;
+    m_numDepthOnly = 0;
+    m_tileLoads = 0;
+    m_tileStores = 0;
+    m_depthStencilLoadBytes = 0;
+    m_depthStencilStoreBytes = 0;
+}
+
+bool
+RosRenderPass::CanAppend(
+    const RosRenderPassDmaBuf & dmaBuf) const
+{
+    if ((0 == m_numDmaBuffers) ||
+        (m_numDmaBuffers == kMaxDmaBuffers) ||
+        !m_bContinues)
+    {
+        return false;
+    }
+
+    //
+    // A clear starts a pass, the Rendering Control List clears the tile
+    // buffer rather than loading it
+    //
+
+    if (dmaBuf.m_bClear)
+    {
+        return false;
+    }
+
+    //
+    // The UMD clears a depth stencil buffer that no draw wrote since its
+    // clear in each DMA buffer, the tile buffer of the pass still has it
+    //
+
+    if (dmaBuf.m_bClearDepthStencil &&
+        (!m_first.m_bClearDepthStencil ||
+         (dmaBuf.m_clearDepthStencil != m_first.m_clearDepthStencil) ||
+         m_bDepthStencilWritten))
+    {
+        return false;
+    }
+
+    return
+        (dmaBuf.m_renderTarget == m_first.m_renderTarget) &&
+        (dmaBuf.m_depthStencil == m_first.m_depthStencil) &&
+        (dmaBuf.m_widthInTiles == m_first.m_widthInTiles) &&
+        (dmaBuf.m_heightInTiles == m_first.m_heightInTiles) &&
+        !dmaBuf.m_bPerfCounters &&
+        !dmaBuf.m_bApertureBounce;
+}
+
+bool
+RosRenderPass::Add(
+    const RosRenderPassDmaBuf & dmaBuf)
+{
+    if (0 == m_numDmaBuffers)
+    {
+        m_first = dmaBuf;
+
+        m_bDepthStencilUsed = false;
+        m_bDepthStencilWritten = false;
+        m_bDiscardDepthStencil = false;
+        m_bDepthOnly = true;
+        m_dirtyTiles = s_noTiles;
+    }
+    else
+    {
+        ROS_PORTABLE_ASSERT(CanAppend(dmaBuf));
+
+        m_numMerged++;
+    }
+
+    m_numDmaBuffers++;
+    m_bContinues = dmaBuf.m_bContinues;
+
+    //
+    // Discarded by the last DMA buffer that touched it, draws after the
+    // discard define it again
+    //
+
+    m_bDepthStencilUsed |= dmaBuf.m_bDepthStencilUsed;
+    m_bDepthStencilWritten |= dmaBuf.m_bDepthStencilWritten;
+    m_bDiscardDepthStencil =
+        dmaBuf.m_bDiscardDepthStencil ||
+        (m_bDiscardDepthStencil && !dmaBuf.m_bDepthStencilWritten);
+
+    m_bDepthOnly &= dmaBuf.m_bDepthOnly;
+
+    //
+    // Clipped to the render target, the UMD's clip windows aren't trusted
+    //
+
+    RosRenderPassTiles  tiles = dmaBuf.m_dirtyTiles;
+
+    if (tiles.m_right > dmaBuf.m_widthInTiles)
+    {
+        tiles.m_right = dmaBuf.m_widthInTiles;
+    }
+
+    if (tiles.m_bottom > dmaBuf.m_heightInTiles)
+    {
+        tiles.m_bottom = dmaBuf.m_heightInTiles;
+    }
+
+    if (tiles.GetCount())
+    {
+        if (m_dirtyTiles.GetCount())
+        {
+            m_dirtyTiles.m_left = (tiles.m_left < m_dirtyTiles.m_left) ? tiles.m_left : m_dirtyTiles.m_left;
+            m_dirtyTiles.m_top = (tiles.m_top < m_dirtyTiles.m_top) ? tiles.m_top : m_dirtyTiles.m_top;
+            m_dirtyTiles.m_right = (tiles.m_right > m_dirtyTiles.m_right) ? tiles.m_right : m_dirtyTiles.m_right;
+            m_dirtyTiles.m_bottom = (tiles.m_bottom > m_dirtyTiles.m_bottom) ? tiles.m_bottom : m_dirtyTiles.m_bottom;
+        }
+        else
+        {
+            m_dirtyTiles = tiles;
+        }
+    }
+
+    return
+        m_bContinues &&
+        (m_numDmaBuffers < kMaxDmaBuffers) &&
+        !m_first.m_bPerfCounters;
+}
+
+bool
+RosRenderPass::LoadsColor() const
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    return !m_first.m_bClear && StoresColor();
+}
+
+bool
+RosRenderPass::StoresColor() const
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    return m_first.m_bClear || !m_bDepthOnly;
+}
+
+bool
+RosRenderPass::LoadsDepthStencil() const
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    return
+        m_first.m_depthStencil &&
+        m_bDepthStencilUsed &&
+        !m_first.m_bClearDepthStencil;
+}
+
+bool
+RosRenderPass::StoresDepthStencil() const
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    return
+        m_first.m_depthStencil &&
+        m_bDepthStencilWritten &&
+        !m_bDiscardDepthStencil;
+}
+
+RosRenderPassTiles
+RosRenderPass::GetDirtyTiles() const
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    RosRenderPassTiles  tiles = m_dirtyTiles;
+
+    if (m_first.m_bClear ||
+        (m_first.m_bClearDepthStencil && StoresDepthStencil()))
+    {
+        tiles.m_left = 0;
+        tiles.m_top = 0;
+        tiles.m_right = m_first.m_widthInTiles;
+        tiles.m_bottom = m_first.m_heightInTiles;
+    }
+    else if (0 == tiles.GetCount())
+    {
+        tiles.m_left = 0;
+        tiles.m_top = 0;
+        tiles.m_right = 1;
+        tiles.m_bottom = 1;
+    }
+
+    return tiles;
+}
+
+void
+RosRenderPass::Close()
+{
+    ROS_PORTABLE_ASSERT(m_numDmaBuffers);
+
+    UINT    numTiles = GetDirtyTiles().GetCount();
+
+    m_numPasses++;
+
+    if (LoadsColor())
+    {
+        m_tileLoads += numTiles;
+    }
+
+    if (StoresColor())
+    {
+        m_tileStores += numTiles;
+    }
+    else
+    {
+        m_numDepthOnly++;
+    }
+
+    if (LoadsDepthStencil())
+    {
+        m_depthStencilLoadBytes += (ULONGLONG)numTiles * kTileDepthStencilBytes;
+    }
+
+    if (StoresDepthStencil())
+    {
+        m_depthStencilStoreBytes += (ULONGLONG)numTiles * kTileDepthStencilBytes;
+    }
+
+    m_numDmaBuffers = 0;
+    m_bContinues = false;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+//
+// Render pass built from the DMA buffers of the draws to a render target.
+//
+// The UMD flushes a command buffer when it runs out of room, in the middle
+// of the draws to the render target, and marks the DMA buffer as continuing
+// the pass. The KMD holds such a DMA buffer back and chains the Binning
+// Control List of the DMA buffer continuing the pass to it, so that the
+// pass is binned and rendered once: the render target is loaded into the
+// tile buffer and stored back once per pass rather than once per DMA buffer.
+//
+// A pass ends with a DMA buffer that doesn't continue it, or with the next
+// one that can't be chained: another render target, a clear, or what the
+// KMD only handles for the first DMA buffer of a pass. The KMD also submits
+// a held pass rather than let the GPU idle.
+//
+// The depth stencil buffer of the pass is loaded into the tile buffer only
+// when its draws test depth and it isn't cleared, and stored only when its
+// draws wrote it and it isn't discarded at the end of the pass.
+//
+// The render target is neither loaded nor stored when every draw of the
+// pass was depth-only (RosDepthOnly.h) and the pass doesn't clear it.
+//
+// Only the tiles under the draws of the pass are rendered, the others keep
+// what the render target and the depth stencil buffer have. A pass renders
+// every tile when it clears the render target, or stores a depth stencil
+// buffer it clears, since the clear is for the whole buffer.
+//
+// It doesn't synchronize, only the worker thread of the KMD calls it.
+//
+
+#include "RosPortable.h"
+
+//
+// Tiles of a render target, m_right and m_bottom excluded
+//
+
+struct RosRenderPassTiles
+{
+    UINT    m_left;
+    UINT    m_top;
+    UINT    m_right;
+    UINT    m_bottom;
+
+    UINT GetCount() const
+    {
+        return ((m_left < m_right) && (m_top < m_bottom)) ?
+            (m_right - m_left) * (m_bottom - m_top) : 0;
+    }
+};
+
+//
+// What the pass needs of a DMA buffer
+//
+
+struct RosRenderPassDmaBuf
+{
+    UINT    m_renderTarget;         // Address of the render target
+    UINT    m_widthInTiles;         // Tiles across the render target
+    UINT    m_heightInTiles;        // Tiles down the render target
+    RosRenderPassTiles  m_dirtyTiles;   // Tiles the draws may write
+    bool    m_bClear;               // Clears the render target, doesn't load it
+    bool    m_bContinues;           // Flushed in the middle of the pass
+    bool    m_bPerfCounters;        // Samples performance counters around it
+    bool    m_bApertureBounce;      // Has copies of aperture allocations
+
+    UINT    m_depthStencil;         // Address of the depth stencil buffer, 0 without one
+    UINT    m_clearDepthStencil;    // Clear value, depth << 8 | stencil
+    bool    m_bClearDepthStencil;   // Clears the depth stencil buffer, doesn't load it
+    bool    m_bDepthStencilUsed;    // Draws test depth
+    bool    m_bDepthStencilWritten; // Draws write depth
+    bool    m_bDiscardDepthStencil; // Undefined after the DMA buffer, isn't stored
+
+    bool    m_bDepthOnly;           // Draws wrote no color
+};
+
+class RosRenderPass
+{
+public:
+
+    // Longest chain of Binning Control Lists
+    static const UINT kMaxDmaBuffers = 8;
+
+    // Bytes of a tile of the D24S8 depth stencil buffer
+    static const UINT kTileDepthStencilBytes = 64 * 64 * 4;
+
+    // Bytes of a tile of a 32 bit render target
+    static const UINT kTileColorBytes = 64 * 64 * 4;
+
+    RosRenderPass();
+
+    // DMA buffers in the pass, 0 when none is held
+    UINT GetCount() const
+    {
+        return m_numDmaBuffers;
+    }
+
+    //
+    // Whether the DMA buffer is chained to the held pass. Counters are
+    // sampled around a whole DMA buffer and its aperture copies go to the
+    // slot of the pass, those DMA buffers start a pass of their own.
+    //
+
+    bool CanAppend(const RosRenderPassDmaBuf & dmaBuf) const;
+
+    //
+    // Adds the DMA buffer to the pass, the first one starts it. Returns
+    // true when the pass is held for the DMA buffer continuing it, false
+    // when the caller submits it and calls Close().
+    //
+
+    bool Add(const RosRenderPassDmaBuf & dmaBuf);
+
+    // Whether the held pass loads and stores the render target
+    bool LoadsColor() const;
+    bool StoresColor() const;
+
+    // Whether the held pass loads and stores the depth stencil buffer
+    bool LoadsDepthStencil() const;
+    bool StoresDepthStencil() const;
+
+    //
+    // Tiles the held pass renders. A pass that draws nothing still renders
+    // a tile, the store of the last tile signals the end of the frame.
+    //
+
+    RosRenderPassTiles GetDirtyTiles() const;
+
+    // The pass was submitted, counts its tile loads and stores
+    void Close();
+
+    ULONGLONG GetPassCount() const
+    {
+        return m_numPasses;
+    }
+
+    // DMA buffers chained to the pass before them
+    ULONGLONG GetMergedCount() const
+    {
+        return m_numMerged;
+    }
+
+    // Tiles of the render target loaded and stored
+    ULONGLONG GetTileLoads() const
+    {
+        return m_tileLoads;
+    }
+
+    ULONGLONG GetTileStores() const
+    {
+        return m_tileStores;
+    }
+
+    // Passes that rendered the depth stencil buffer alone
+    ULONGLONG GetDepthOnlyCount() const
+    {
+        return m_numDepthOnly;
+    }
+
+    ULONGLONG GetDepthStencilLoadBytes() const
+    {
+        return m_depthStencilLoadBytes;
+    }
+
+    ULONGLONG GetDepthStencilStoreBytes() const
+    {
+        return m_depthStencilStoreBytes;
+    }
+
+private:
+
+    UINT                    m_numDmaBuffers;
+    RosRenderPassDmaBuf     m_first;
+    bool                    m_bContinues;       // Of the last DMA buffer
+    bool                    m_bDepthStencilUsed;
+    bool                    m_bDepthStencilWritten;
+    bool                    m_bDiscardDepthStencil;
+    bool                    m_bDepthOnly;
+    RosRenderPassTiles      m_dirtyTiles;       // Of the DMA buffers
+
+    ULONGLONG               m_numPasses;
+    ULONGLONG               m_numMerged;
+    ULONGLONG               m_numDepthOnly;
+    ULONGLONG               m_tileLoads;
+    ULONGLONG               m_tileStores;
+    ULONGLONG               m_depthStencilLoadBytes;
+    ULONGLONG               m_depthStencilStoreBytes;
+};
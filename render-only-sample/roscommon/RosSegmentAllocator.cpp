@@ -0,0 +1,879 @@
+#include "RosSegmentAllocator.h"
+
+#if defined(_MSC_VER) && !defined(_KERNEL_MODE)
+#include <intrin.h>
+#endif
+
+//
+// Slot sizes step by 1.5x and 2x alternately, so rounding a request up to
+// its size class wastes at most a third of the slot
+//
+
+const UINT RosSegmentAllocator::s_sizeClasses[kNumSizeClasses] =
+{
+    64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536,
+    2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768
+};
+
+RosSegmentAllocator::RosSegmentAllocator()
+{
+    m_size = 0;
+    m_granularity = 0;
+
+    m_pBlocks = NULL;
+    m_maxBlocks = 0;
+    m_freeBlockRecord = kInvalidIndex;
+    m_freeBlockRecordCount = 0;
+
+    m_pHandles = NULL;
+    m_maxHandles = 0;
+    m_freeHandle = kInvalidIndex;
+
+    m_pSlabs = NULL;
+    m_maxSlabs = 0;
+    m_freeSlab = kInvalidIndex;
+
+    m_firstBlock = kInvalidIndex;
+    m_firstLevelMap = 0;
+}
+
+void
+RosSegmentAllocator::Init(
+    UINT                size,
+    UINT                granularity,
+    RosSegmentBlock *   pBlocks,
+    UINT                maxBlocks,
+    UINT *              pHandles,
+    UINT                maxHandles,
+    RosSegmentSlab *    pSlabs,
+    UINT                maxSlabs)
+{
+    ROS_PORTABLE_ASSERT((granularity != 0) && (0 == (granularity & (granularity - 1))));
+    ROS_PORTABLE_ASSERT(granularity <= ROS_SEGMENT_SLAB_SIZE);
+    ROS_PORTABLE_ASSERT(size >= granularity);
+    ROS_PORTABLE_ASSERT(maxBlocks >= 1);
+    ROS_PORTABLE_ASSERT(maxHandles < kSmallHandle);
+    ROS_PORTABLE_ASSERT(maxSlabs < (kSmallHandle >> kSlotBits));
+
+    m_size = size & ~(granularity - 1);
+    m_granularity = granularity;
+
+    m_pBlocks = pBlocks;
+    m_maxBlocks = maxBlocks;
+
+    for (UINT i = 0; i < maxBlocks; i++)
+    {
+        m_pBlocks[i].m_flags = 0;
+        m_pBlocks[i].m_nextFree = (i + 1 < maxBlocks) ? (i + 1) : kInvalidIndex;
+    }
+
+    m_freeBlockRecord = 0;
+    m_freeBlockRecordCount = maxBlocks;
+
+    m_pHandles = pHandles;
+    m_maxHandles = maxHandles;
+
+    for (UINT i = 0; i < maxHandles; i++)
+    {
+        m_pHandles[i] = (i + 1 < maxHandles) ? (i + 1) : kInvalidIndex;
+    }
+
+    m_freeHandle = maxHandles ? 0 : kInvalidIndex;
+
+    m_pSlabs = pSlabs;
+    m_maxSlabs = maxSlabs;
+
+    for (UINT i = 0; i < maxSlabs; i++)
+    {
+        m_pSlabs[i].m_next = (i + 1 < maxSlabs) ? (i + 1) : kInvalidIndex;
+    }
+
+    m_freeSlab = maxSlabs ? 0 : kInvalidIndex;
+
+    m_firstLevelMap = 0;
+
+    for (UINT i = 0; i < kFirstLevelCount; i++)
+    {
+        m_secondLevelMap[i] = 0;
+
+        for (UINT j = 0; j < kSecondLevelCount; j++)
+        {
+            m_freeLists[i][j] = kInvalidIndex;
+        }
+    }
+
+    for (UINT i = 0; i < kNumSizeClasses; i++)
+    {
+        m_partialSlabs[i] = kInvalidIndex;
+    }
+
+    m_firstBlock = NewBlock();
+
+    RosSegmentBlock *   pFirst = &m_pBlocks[m_firstBlock];
+
+    pFirst->m_offset = 0;
+    pFirst->m_size = m_size;
+    pFirst->m_alignment = 0;
+    pFirst->m_prevPhys = kInvalidIndex;
+    pFirst->m_nextPhys = kInvalidIndex;
+    pFirst->m_owner = kInvalidIndex;
+
+    InsertFree(m_firstBlock);
+}
+
+bool
+RosSegmentAllocator::Allocate(
+    UINT                size,
+    UINT                alignment,
+    UINT                flags,
+    RosSegmentHandle *  pHandle)
+{
+    if (alignment == 0)
+    {
+        alignment = 1;
+    }
+
+    ROS_PORTABLE_ASSERT(0 == (alignment & (alignment - 1)));
+
+    if ((size == 0) || (size > m_size))
+    {
+        return false;
+    }
+
+    if ((0 == (flags & ROS_SEGMENT_ALLOC_PINNED)) &&
+        (size <= kSmallLimit) &&
+        (alignment <= ROS_SEGMENT_SLAB_SIZE))
+    {
+        UINT    sizeClass = FindSizeClass(size, alignment);
+
+        //
+        // Fall back to a block of its own when no slab can be added
+        //
+
+        if ((sizeClass != kInvalidIndex) && AllocateSlot(sizeClass, pHandle))
+        {
+            return true;
+        }
+    }
+
+    if (m_freeHandle == kInvalidIndex)
+    {
+        return false;
+    }
+
+    UINT    block = AllocateBlock(size, alignment);
+
+    if (block == kInvalidIndex)
+    {
+        return false;
+    }
+
+    if (flags & ROS_SEGMENT_ALLOC_PINNED)
+    {
+        m_pBlocks[block].m_flags |= kBlockPinned;
+    }
+
+    UINT    handle = m_freeHandle;
+
+    m_freeHandle = m_pHandles[handle];
+    SetBlockOwner(block, handle);
+
+    *pHandle = handle;
+
+    return true;
+}
+
+void
+RosSegmentAllocator::Free(
+    RosSegmentHandle    handle)
+{
+    if (handle & kSmallHandle)
+    {
+        FreeSlot(handle);
+        return;
+    }
+
+    ROS_PORTABLE_ASSERT(handle < m_maxHandles);
+
+    FreeBlock(m_pHandles[handle]);
+
+    m_pHandles[handle] = m_freeHandle;
+    m_freeHandle = handle;
+}
+
+UINT
+RosSegmentAllocator::GetOffset(
+    RosSegmentHandle    handle) const
+{
+    if (handle & kSmallHandle)
+    {
+        UINT                    slab = (handle & ~kSmallHandle) >> kSlotBits;
+        UINT                    slot = handle & ((1 << kSlotBits) - 1);
+        const RosSegmentSlab *  pSlab = &m_pSlabs[slab];
+
+        return m_pBlocks[pSlab->m_block].m_offset + slot * s_sizeClasses[pSlab->m_sizeClass];
+    }
+
+    return m_pBlocks[m_pHandles[handle]].m_offset;
+}
+
+UINT
+RosSegmentAllocator::Compact(
+    RosSegmentMover *   pMover,
+    UINT                byteBudget)
+{
+    UINT    bytesMoved = 0;
+    UINT    block = m_firstBlock;
+
+    while (block != kInvalidIndex)
+    {
+        RosSegmentBlock *   pBlock = &m_pBlocks[block];
+
+        if (pBlock->m_flags & (kBlockFree | kBlockPinned))
+        {
+            block = pBlock->m_nextPhys;
+            continue;
+        }
+
+        if ((bytesMoved + pBlock->m_size > byteBudget) || (m_freeBlockRecordCount < 2))
+        {
+            break;
+        }
+
+        //
+        // Lowest free block below this one that fits it
+        //
+
+        UINT    target = kInvalidIndex;
+        UINT    targetOffset = 0;
+
+        for (UINT hole = m_firstBlock; hole != block; hole = m_pBlocks[hole].m_nextPhys)
+        {
+            const RosSegmentBlock * pHole = &m_pBlocks[hole];
+
+            if (0 == (pHole->m_flags & kBlockFree))
+            {
+                continue;
+            }
+
+            UINT    alignedOffset = (pHole->m_offset + pBlock->m_alignment - 1) & ~(pBlock->m_alignment - 1);
+
+            if (alignedOffset + pBlock->m_size <= pHole->m_offset + pHole->m_size)
+            {
+                target = hole;
+                targetOffset = alignedOffset;
+                break;
+            }
+        }
+
+        if (target == kInvalidIndex)
+        {
+            block = pBlock->m_nextPhys;
+            continue;
+        }
+
+        RemoveFree(target);
+
+        UINT                newBlock = Carve(target, targetOffset, pBlock->m_size);
+        RosSegmentBlock *   pNewBlock = &m_pBlocks[newBlock];
+
+        pMover->MoveBlock(targetOffset, pBlock->m_offset, pBlock->m_size);
+
+        pNewBlock->m_alignment = pBlock->m_alignment;
+        pNewBlock->m_flags = pBlock->m_flags;
+        SetBlockOwner(newBlock, pBlock->m_owner);
+
+        bytesMoved += pBlock->m_size;
+
+        block = m_pBlocks[FreeBlock(block)].m_nextPhys;
+    }
+
+    return bytesMoved;
+}
+
+void
+RosSegmentAllocator::GetStats(
+    RosSegmentStats *   pStats) const
+{
+    pStats->m_size = m_size;
+    pStats->m_usedBytes = 0;
+    pStats->m_slotBytes = 0;
+    pStats->m_freeBytes = 0;
+    pStats->m_largestFreeBlock = 0;
+    pStats->m_freeBlockCount = 0;
+    pStats->m_largeAllocationCount = 0;
+    pStats->m_slabCount = 0;
+
+    for (UINT block = m_firstBlock; block != kInvalidIndex; block = m_pBlocks[block].m_nextPhys)
+    {
+        const RosSegmentBlock * pBlock = &m_pBlocks[block];
+
+        if (pBlock->m_flags & kBlockFree)
+        {
+            pStats->m_freeBytes += pBlock->m_size;
+            pStats->m_freeBlockCount++;
+
+            if (pBlock->m_size > pStats->m_largestFreeBlock)
+            {
+                pStats->m_largestFreeBlock = pBlock->m_size;
+            }
+        }
+        else if (pBlock->m_flags & kBlockSlab)
+        {
+            const RosSegmentSlab *  pSlab = &m_pSlabs[pBlock->m_owner & ~kSlabOwner];
+
+            pStats->m_usedBytes += pBlock->m_size;
+            pStats->m_slotBytes += pSlab->m_usedSlots * s_sizeClasses[pSlab->m_sizeClass];
+            pStats->m_slabCount++;
+        }
+        else
+        {
+            pStats->m_usedBytes += pBlock->m_size;
+            pStats->m_largeAllocationCount++;
+        }
+    }
+}
+
+UINT
+RosSegmentAllocator::FindFirstSet(
+    UINT    value)
+{
+    ROS_PORTABLE_ASSERT(value != 0);
+
+#if defined(_MSC_VER)
+    unsigned long   index;
+
+    _BitScanForward(&index, value);
+
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+UINT
+RosSegmentAllocator::FindLastSet(
+    UINT    value)
+{
+    ROS_PORTABLE_ASSERT(value != 0);
+
+#if defined(_MSC_VER)
+    unsigned long   index;
+
+    _BitScanReverse(&index, value);
+
+    return index;
+#else
+    return 31 - __builtin_clz(value);
+#endif
+}
+
+//
+// Free lists cover [2^n, 2^(n+1)) granules in kSecondLevelCount linear steps,
+// sizes below kSecondLevelCount granules get a list each
+//
+
+void
+RosSegmentAllocator::MapSize(
+    UINT    granules,
+    UINT *  pFirstLevel,
+    UINT *  pSecondLevel) const
+{
+    if (granules < kSecondLevelCount)
+    {
+        *pFirstLevel = 0;
+        *pSecondLevel = granules;
+    }
+    else
+    {
+        UINT    lastSet = FindLastSet(granules);
+
+        *pFirstLevel = lastSet - kSecondLevelShift + 1;
+        *pSecondLevel = (granules >> (lastSet - kSecondLevelShift)) ^ kSecondLevelCount;
+    }
+}
+
+UINT
+RosSegmentAllocator::NewBlock()
+{
+    UINT    block = m_freeBlockRecord;
+
+    if (block != kInvalidIndex)
+    {
+        m_freeBlockRecord = m_pBlocks[block].m_nextFree;
+        m_freeBlockRecordCount--;
+
+        m_pBlocks[block].m_flags = 0;
+    }
+
+    return block;
+}
+
+void
+RosSegmentAllocator::DeleteBlock(
+    UINT    block)
+{
+    m_pBlocks[block].m_flags = 0;
+    m_pBlocks[block].m_nextFree = m_freeBlockRecord;
+
+    m_freeBlockRecord = block;
+    m_freeBlockRecordCount++;
+}
+
+void
+RosSegmentAllocator::InsertFree(
+    UINT    block)
+{
+    RosSegmentBlock *   pBlock = &m_pBlocks[block];
+    UINT                firstLevel, secondLevel;
+
+    MapSize(pBlock->m_size / m_granularity, &firstLevel, &secondLevel);
+
+    UINT    head = m_freeLists[firstLevel][secondLevel];
+
+    pBlock->m_flags = kBlockFree;
+    pBlock->m_owner = kInvalidIndex;
+    pBlock->m_prevFree = kInvalidIndex;
+    pBlock->m_nextFree = head;
+
+    if (head != kInvalidIndex)
+    {
+        m_pBlocks[head].m_prevFree = block;
+    }
+
+    m_freeLists[firstLevel][secondLevel] = block;
+
+    m_firstLevelMap |= 1 << firstLevel;
+    m_secondLevelMap[firstLevel] |= 1 << secondLevel;
+}
+
+void
+RosSegmentAllocator::RemoveFree(
+    UINT    block)
+{
+    RosSegmentBlock *   pBlock = &m_pBlocks[block];
+    UINT                firstLevel, secondLevel;
+
+    ROS_PORTABLE_ASSERT(pBlock->m_flags & kBlockFree);
+
+    MapSize(pBlock->m_size / m_granularity, &firstLevel, &secondLevel);
+
+    if (pBlock->m_prevFree != kInvalidIndex)
+    {
+        m_pBlocks[pBlock->m_prevFree].m_nextFree = pBlock->m_nextFree;
+    }
+    else
+    {
+        m_freeLists[firstLevel][secondLevel] = pBlock->m_nextFree;
+    }
+
+    if (pBlock->m_nextFree != kInvalidIndex)
+    {
+        m_pBlocks[pBlock->m_nextFree].m_prevFree = pBlock->m_prevFree;
+    }
+
+    if (m_freeLists[firstLevel][secondLevel] == kInvalidIndex)
+    {
+        m_secondLevelMap[firstLevel] &= ~(1 << secondLevel);
+
+        if (m_secondLevelMap[firstLevel] == 0)
+        {
+            m_firstLevelMap &= ~(1 << firstLevel);
+        }
+    }
+
+    pBlock->m_flags = 0;
+}
+
+//
+// Returns a free block of at least size bytes. The request is rounded up to
+// the next free list boundary so any block of the list found fits.
+//
+
+UINT
+RosSegmentAllocator::FindFree(
+    UINT    size)
+{
+    UINT    granules = size / m_granularity;
+
+    if (granules >= kSecondLevelCount)
+    {
+        UINT    roundUp = (1 << (FindLastSet(granules) - kSecondLevelShift)) - 1;
+
+        if (granules + roundUp < granules)
+        {
+            return kInvalidIndex;
+        }
+
+        granules += roundUp;
+    }
+
+    UINT    firstLevel, secondLevel;
+
+    MapSize(granules, &firstLevel, &secondLevel);
+
+    UINT    secondLevelMap = m_secondLevelMap[firstLevel] & (~0U << secondLevel);
+
+    if (secondLevelMap == 0)
+    {
+        UINT    firstLevelMap = (firstLevel + 1 < kFirstLevelCount) ? (m_firstLevelMap & (~0U << (firstLevel + 1))) : 0;
+
+        if (firstLevelMap == 0)
+        {
+            return kInvalidIndex;
+        }
+
+        firstLevel = FindFirstSet(firstLevelMap);
+        secondLevelMap = m_secondLevelMap[firstLevel];
+    }
+
+    secondLevel = FindFirstSet(secondLevelMap);
+
+    return m_freeLists[firstLevel][secondLevel];
+}
+
+//
+// Cuts block after size bytes, the tail goes to a new block record
+//
+
+UINT
+RosSegmentAllocator::Split(
+    UINT    block,
+    UINT    size)
+{
+    UINT                tail = NewBlock();
+    RosSegmentBlock *   pBlock = &m_pBlocks[block];
+    RosSegmentBlock *   pTail = &m_pBlocks[tail];
+
+    ROS_PORTABLE_ASSERT(tail != kInvalidIndex);
+    ROS_PORTABLE_ASSERT(size < pBlock->m_size);
+
+    pTail->m_offset = pBlock->m_offset + size;
+    pTail->m_size = pBlock->m_size - size;
+    pTail->m_alignment = 0;
+    pTail->m_owner = kInvalidIndex;
+
+    pTail->m_prevPhys = block;
+    pTail->m_nextPhys = pBlock->m_nextPhys;
+
+    if (pBlock->m_nextPhys != kInvalidIndex)
+    {
+        m_pBlocks[pBlock->m_nextPhys].m_prevPhys = tail;
+    }
+
+    pBlock->m_nextPhys = tail;
+    pBlock->m_size = size;
+
+    return tail;
+}
+
+//
+// Takes [offset, offset + size) out of a block already removed from the
+// free lists, the space before and after it stays free. Needs up to two
+// block records.
+//
+
+UINT
+RosSegmentAllocator::Carve(
+    UINT    block,
+    UINT    offset,
+    UINT    size)
+{
+    if (offset > m_pBlocks[block].m_offset)
+    {
+        UINT    aligned = Split(block, offset - m_pBlocks[block].m_offset);
+
+        InsertFree(block);
+        block = aligned;
+    }
+
+    if (m_pBlocks[block].m_size > size)
+    {
+        InsertFree(Split(block, size));
+    }
+
+    m_pBlocks[block].m_flags = kBlockUsed;
+
+    return block;
+}
+
+UINT
+RosSegmentAllocator::AllocateBlock(
+    UINT    size,
+    UINT    alignment)
+{
+    if (alignment < m_granularity)
+    {
+        alignment = m_granularity;
+    }
+
+    if ((size > m_size) || (alignment > m_size) || (m_freeBlockRecordCount < 2))
+    {
+        return kInvalidIndex;
+    }
+
+    size = (size + m_granularity - 1) & ~(m_granularity - 1);
+
+    UINT    block = FindFree(size + (alignment - m_granularity));
+
+    if (block == kInvalidIndex)
+    {
+        return kInvalidIndex;
+    }
+
+    RemoveFree(block);
+
+    UINT    offset = (m_pBlocks[block].m_offset + alignment - 1) & ~(alignment - 1);
+
+    block = Carve(block, offset, size);
+
+    m_pBlocks[block].m_alignment = alignment;
+
+    return block;
+}
+
+//
+// Returns the free block the freed block ended up in
+//
+
+UINT
+RosSegmentAllocator::FreeBlock(
+    UINT    block)
+{
+    UINT    prev = m_pBlocks[block].m_prevPhys;
+
+    ROS_PORTABLE_ASSERT(m_pBlocks[block].m_flags & kBlockUsed);
+
+    if ((prev != kInvalidIndex) && (m_pBlocks[prev].m_flags & kBlockFree))
+    {
+        RemoveFree(prev);
+
+        m_pBlocks[prev].m_size += m_pBlocks[block].m_size;
+        m_pBlocks[prev].m_nextPhys = m_pBlocks[block].m_nextPhys;
+
+        if (m_pBlocks[block].m_nextPhys != kInvalidIndex)
+        {
+            m_pBlocks[m_pBlocks[block].m_nextPhys].m_prevPhys = prev;
+        }
+
+        DeleteBlock(block);
+        block = prev;
+    }
+
+    UINT    next = m_pBlocks[block].m_nextPhys;
+
+    if ((next != kInvalidIndex) && (m_pBlocks[next].m_flags & kBlockFree))
+    {
+        RemoveFree(next);
+
+        m_pBlocks[block].m_size += m_pBlocks[next].m_size;
+        m_pBlocks[block].m_nextPhys = m_pBlocks[next].m_nextPhys;
+
+        if (m_pBlocks[next].m_nextPhys != kInvalidIndex)
+        {
+            m_pBlocks[m_pBlocks[next].m_nextPhys].m_prevPhys = block;
+        }
+
+        DeleteBlock(next);
+    }
+
+    InsertFree(block);
+
+    return block;
+}
+
+UINT
+RosSegmentAllocator::FindSizeClass(
+    UINT    size,
+    UINT    alignment) const
+{
+    for (UINT i = 0; i < kNumSizeClasses; i++)
+    {
+        if ((s_sizeClasses[i] >= size) && (0 == (s_sizeClasses[i] & (alignment - 1))))
+        {
+            return i;
+        }
+    }
+
+    return kInvalidIndex;
+}
+
+bool
+RosSegmentAllocator::AllocateSlot(
+    UINT                sizeClass,
+    RosSegmentHandle *  pHandle)
+{
+    UINT    slab = m_partialSlabs[sizeClass];
+
+    if (slab == kInvalidIndex)
+    {
+        if (m_freeSlab == kInvalidIndex)
+        {
+            return false;
+        }
+
+        UINT    block = AllocateBlock(ROS_SEGMENT_SLAB_SIZE, ROS_SEGMENT_SLAB_SIZE);
+
+        if (block == kInvalidIndex)
+        {
+            return false;
+        }
+
+        slab = m_freeSlab;
+        m_freeSlab = m_pSlabs[slab].m_next;
+
+        RosSegmentSlab *    pNewSlab = &m_pSlabs[slab];
+
+        pNewSlab->m_block = block;
+        pNewSlab->m_sizeClass = sizeClass;
+        pNewSlab->m_slotCount = ROS_SEGMENT_SLAB_SIZE / s_sizeClasses[sizeClass];
+        pNewSlab->m_usedSlots = 0;
+
+        //
+        // Slots past the end of the slab are never free
+        //
+
+        for (UINT i = 0; i < ROS_SEGMENT_SLAB_MASK_WORDS; i++)
+        {
+            UINT    firstSlot = i * 32;
+
+            if (firstSlot >= pNewSlab->m_slotCount)
+            {
+                pNewSlab->m_usedMask[i] = ~0U;
+            }
+            else if (pNewSlab->m_slotCount - firstSlot >= 32)
+            {
+                pNewSlab->m_usedMask[i] = 0;
+            }
+            else
+            {
+                pNewSlab->m_usedMask[i] = ~0U << (pNewSlab->m_slotCount - firstSlot);
+            }
+        }
+
+        m_pBlocks[block].m_flags |= kBlockSlab;
+        SetBlockOwner(block, kSlabOwner | slab);
+
+        LinkPartialSlab(slab);
+    }
+
+    RosSegmentSlab *    pSlab = &m_pSlabs[slab];
+    UINT                word = 0;
+
+    while (pSlab->m_usedMask[word] == ~0U)
+    {
+        word++;
+        ROS_PORTABLE_ASSERT(word < ROS_SEGMENT_SLAB_MASK_WORDS);
+    }
+
+    UINT    bit = FindFirstSet(~pSlab->m_usedMask[word]);
+    UINT    slot = word * 32 + bit;
+
+    pSlab->m_usedMask[word] |= 1 << bit;
+    pSlab->m_usedSlots++;
+
+    if (pSlab->m_usedSlots == pSlab->m_slotCount)
+    {
+        UnlinkPartialSlab(slab);
+    }
+
+    *pHandle = kSmallHandle | (slab << kSlotBits) | slot;
+
+    return true;
+}
+
+void
+RosSegmentAllocator::FreeSlot(
+    RosSegmentHandle    handle)
+{
+    UINT                slab = (handle & ~kSmallHandle) >> kSlotBits;
+    UINT                slot = handle & ((1 << kSlotBits) - 1);
+    RosSegmentSlab *    pSlab = &m_pSlabs[slab];
+
+    ROS_PORTABLE_ASSERT(slab < m_maxSlabs);
+    ROS_PORTABLE_ASSERT(pSlab->m_usedMask[slot / 32] & (1 << (slot % 32)));
+
+    pSlab->m_usedMask[slot / 32] &= ~(1 << (slot % 32));
+
+    if (pSlab->m_usedSlots == pSlab->m_slotCount)
+    {
+        LinkPartialSlab(slab);
+    }
+
+    pSlab->m_usedSlots--;
+
+    //
+    // Empty slabs go back to the block allocator, except the last one of the
+    // size class to avoid churn when a single slot is reused
+    //
+
+    if ((pSlab->m_usedSlots == 0) &&
+        ((m_partialSlabs[pSlab->m_sizeClass] != slab) || (pSlab->m_next != kInvalidIndex)))
+    {
+        UnlinkPartialSlab(slab);
+
+        FreeBlock(pSlab->m_block);
+
+        pSlab->m_next = m_freeSlab;
+        m_freeSlab = slab;
+    }
+}
+
+void
+RosSegmentAllocator::LinkPartialSlab(
+    UINT    slab)
+{
+    RosSegmentSlab *    pSlab = &m_pSlabs[slab];
+    UINT                head = m_partialSlabs[pSlab->m_sizeClass];
+
+    pSlab->m_prev = kInvalidIndex;
+    pSlab->m_next = head;
+
+    if (head != kInvalidIndex)
+    {
+        m_pSlabs[head].m_prev = slab;
+    }
+
+    m_partialSlabs[pSlab->m_sizeClass] = slab;
+}
+
+void
+RosSegmentAllocator::UnlinkPartialSlab(
+    UINT    slab)
+{
+    RosSegmentSlab *    pSlab = &m_pSlabs[slab];
+
+    if (pSlab->m_prev != kInvalidIndex)
+    {
+        m_pSlabs[pSlab->m_prev].m_next = pSlab->m_next;
+    }
+    else
+    {
+        m_partialSlabs[pSlab->m_sizeClass] = pSlab->m_next;
+    }
+
+    if (pSlab->m_next != kInvalidIndex)
+    {
+        m_pSlabs[pSlab->m_next].m_prev = pSlab->m_prev;
+    }
+
+    pSlab->m_prev = kInvalidIndex;
+    pSlab->m_next = kInvalidIndex;
+}
+
+void
+RosSegmentAllocator::SetBlockOwner(
+    UINT    block,
+    UINT    owner)
+{
+    m_pBlocks[block].m_owner = owner;
+
+    if (owner & kSlabOwner)
+    {
+        m_pSlabs[owner & ~kSlabOwner].m_block = block;
+    }
+    else
+    {
+        m_pHandles[owner] = block;
+    }
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+//
+// Suballocator for a range of video memory.
+//
+// Requests up to kSmallLimit bytes are served from 64KB slabs split in
+// fixed size slots, one list of partially used slabs per size class. Larger
+// requests, and the slabs themselves, come from a two level segregated fit
+// (TLSF) allocator working in granules of the range (usually a page), which
+// finds a free block in constant time and coalesces neighbours on free.
+//
+// Allocations are identified by handles that stay valid when Compact()
+// moves the underlying memory, owners look the offset up again after a
+// compaction pass.
+//
+// The allocator doesn't touch the memory it manages and doesn't allocate,
+// the caller provides the metadata arrays.
+//
+
+#include "RosPortable.h"
+
+typedef UINT RosSegmentHandle;
+
+const RosSegmentHandle  ROS_SEGMENT_INVALID_HANDLE = 0xFFFFFFFF;
+
+const UINT  ROS_SEGMENT_SLAB_SIZE = 64 * 1024;
+const UINT  ROS_SEGMENT_MIN_SLOT_SIZE = 64;
+const UINT  ROS_SEGMENT_SLAB_MASK_WORDS = ROS_SEGMENT_SLAB_SIZE / ROS_SEGMENT_MIN_SLOT_SIZE / 32;
+
+enum RosSegmentAllocFlags
+{
+    ROS_SEGMENT_ALLOC_DEFAULT   = 0,
+    ROS_SEGMENT_ALLOC_PINNED    = 1,    // Never moved by Compact(), always a block of its own
+};
+
+typedef struct _RosSegmentBlock
+{
+    UINT    m_offset;
+    UINT    m_size;
+    UINT    m_alignment;
+
+    // Neighbours in address order
+    UINT    m_prevPhys;
+    UINT    m_nextPhys;
+
+    // Free list of the block's size, or the list of unused block records
+    UINT    m_prevFree;
+    UINT    m_nextFree;
+
+    // Handle, or slab index with the top bit set, of a used block
+    UINT    m_owner;
+    UINT    m_flags;
+} RosSegmentBlock;
+
+typedef struct _RosSegmentSlab
+{
+    UINT    m_block;
+    UINT    m_sizeClass;
+    UINT    m_slotCount;
+    UINT    m_usedSlots;
+
+    // Partially used slabs of the size class, or the list of unused slab records
+    UINT    m_prev;
+    UINT    m_next;
+
+    UINT    m_usedMask[ROS_SEGMENT_SLAB_MASK_WORDS];
+} RosSegmentSlab;
+
+typedef struct _RosSegmentStats
+{
+    UINT    m_size;
+    UINT    m_usedBytes;            // Used blocks, whole slabs included
+    UINT    m_slotBytes;            // Used slots of the slabs
+    UINT    m_freeBytes;
+    UINT    m_largestFreeBlock;
+    UINT    m_freeBlockCount;
+    UINT    m_largeAllocationCount;
+    UINT    m_slabCount;
+} RosSegmentStats;
+
+//
+// Carries out the copies of a compaction pass, source and destination
+// never overlap
+//
+
+class RosSegmentMover
+{
+public:
+
+    virtual void MoveBlock(UINT dstOffset, UINT srcOffset, UINT size) = 0;
+};
+
+class RosSegmentAllocator
+{
+public:
+
+    static const UINT kSmallLimit = 32 * 1024;
+    static const UINT kNumSizeClasses = 19;
+
+    static const UINT kSecondLevelShift = 4;
+    static const UINT kSecondLevelCount = 1 << kSecondLevelShift;
+    static const UINT kFirstLevelCount = 32;
+
+    static const UINT kInvalidIndex = 0xFFFFFFFF;
+
+    RosSegmentAllocator();
+
+    //
+    // size and granularity are in bytes, granularity is a power of 2 and
+    // at most ROS_SEGMENT_SLAB_SIZE. Each live large allocation or slab uses
+    // a handle or a slab record, free space between them uses block records.
+    //
+
+    void
+    Init(
+        UINT                size,
+        UINT                granularity,
+        RosSegmentBlock *   pBlocks,
+        UINT                maxBlocks,
+        UINT *              pHandles,
+        UINT                maxHandles,
+        RosSegmentSlab *    pSlabs,
+        UINT                maxSlabs);
+
+    bool
+    Allocate(
+        UINT                size,
+        UINT                alignment,
+        UINT                flags,
+        RosSegmentHandle *  pHandle);
+
+    void Free(RosSegmentHandle handle);
+
+    UINT GetOffset(RosSegmentHandle handle) const;
+
+    //
+    // Moves movable blocks into the lowest free block that fits them until
+    // byteBudget bytes are moved. Returns the number of bytes moved.
+    //
+
+    UINT
+    Compact(
+        RosSegmentMover *   pMover,
+        UINT                byteBudget);
+
+    void GetStats(RosSegmentStats * pStats) const;
+
+    static UINT GetSizeClassSize(UINT sizeClass)
+    {
+        ROS_PORTABLE_ASSERT(sizeClass < kNumSizeClasses);
+        return s_sizeClasses[sizeClass];
+    }
+
+private:
+
+    static const UINT kSmallHandle = 0x80000000;
+    static const UINT kSlotBits = 10;
+    static const UINT kSlabOwner = 0x80000000;
+
+    static const UINT kBlockUsed = 1;
+    static const UINT kBlockFree = 2;
+    static const UINT kBlockSlab = 4;
+    static const UINT kBlockPinned = 8;
+
+    static const UINT s_sizeClasses[kNumSizeClasses];
+
+    static UINT FindFirstSet(UINT value);
+    static UINT FindLastSet(UINT value);
+
+    void MapSize(UINT granules, UINT * pFirstLevel, UINT * pSecondLevel) const;
+
+    UINT NewBlock();
+    void DeleteBlock(UINT block);
+
+    void InsertFree(UINT block);
+    void RemoveFree(UINT block);
+    UINT FindFree(UINT size);
+
+    UINT Split(UINT block, UINT size);
+
+    UINT Carve(UINT block, UINT offset, UINT size);
+    UINT AllocateBlock(UINT size, UINT alignment);
+    UINT FreeBlock(UINT block);
+
+    UINT FindSizeClass(UINT size, UINT alignment) const;
+    bool AllocateSlot(UINT sizeClass, RosSegmentHandle * pHandle);
+    void FreeSlot(RosSegmentHandle handle);
+
+    void LinkPartialSlab(UINT slab);
+    void UnlinkPartialSlab(UINT slab);
+
+    void SetBlockOwner(UINT block, UINT owner);
+
+    UINT                m_size;
+    UINT                m_granularity;
+
+    RosSegmentBlock *   m_pBlocks;
+    UINT                m_maxBlocks;
+    UINT                m_freeBlockRecord;
+    UINT                m_freeBlockRecordCount;
+
+    UINT *              m_pHandles;
+    UINT                m_maxHandles;
+    UINT                m_freeHandle;
+
+    RosSegmentSlab *    m_pSlabs;
+    UINT                m_maxSlabs;
+    UINT                m_freeSlab;
+
+    // Block at offset 0, coalescing always keeps the lower block
+    UINT                m_firstBlock;
+
+    UINT                m_firstLevelMap;
+    UINT                m_secondLevelMap[kFirstLevelCount];
+    UINT                m_freeLists[kFirstLevelCount][kSecondLevelCount];
+
+    UINT                m_partialSlabs[kNumSizeClasses];
+};
@@ -0,0 +1,126 @@
+#include "RosTFormat.h"
+
+//
+// Order of the subtiles of a tile by their position, top left, top right,
+// bottom left then bottom right
+//
+static const UINT s_evenRowSubtiles[4] = { 0, 3, 1, 2 };
+static const UINT s_oddRowSubtiles[4] = { 2, 1, 3, 0 };
+
+UINT
+RosTFormat::GetMicrotileWidth(
+    UINT    bytesPerPixel)
+{
+    ROS_PORTABLE_ASSERT((bytesPerPixel == 1) || (bytesPerPixel == 2) || (bytesPerPixel == 4));
+
+    return (bytesPerPixel == 4) ? 4 : 8;
+}
+
+UINT
+RosTFormat::GetMicrotileHeight(
+    UINT    bytesPerPixel)
+{
+    ROS_PORTABLE_ASSERT((bytesPerPixel == 1) || (bytesPerPixel == 2) || (bytesPerPixel == 4));
+
+    return (bytesPerPixel == 1) ? 8 : 4;
+}
+
+UINT
+RosTFormat::GetPixelOffset(
+    UINT    widthInTiles,
+    UINT    x,
+    UINT    y,
+    UINT    bytesPerPixel)
+{
+    const UINT  microtileWidth = GetMicrotileWidth(bytesPerPixel);
+    const UINT  microtileHeight = GetMicrotileHeight(bytesPerPixel);
+    const UINT  tileMicrotiles = kSubtileMicrotiles * kTileSubtiles;
+
+    UINT    microtileX = x / microtileWidth;
+    UINT    microtileY = y / microtileHeight;
+
+    UINT    tileX = microtileX / tileMicrotiles;
+    UINT    tileY = microtileY / tileMicrotiles;
+
+    ROS_PORTABLE_ASSERT(tileX < widthInTiles);
+
+    UINT    subtile =
+        ((microtileY / kSubtileMicrotiles) % kTileSubtiles) * kTileSubtiles +
+        ((microtileX / kSubtileMicrotiles) % kTileSubtiles);
+
+    if (tileY & 1)
+    {
+        tileX = widthInTiles - 1 - tileX;
+        subtile = s_oddRowSubtiles[subtile];
+    }
+    else
+    {
+        subtile = s_evenRowSubtiles[subtile];
+    }
+
+    UINT    microtile =
+        (microtileY % kSubtileMicrotiles) * kSubtileMicrotiles +
+        (microtileX % kSubtileMicrotiles);
+
+    return
+        (tileY * widthInTiles + tileX) * kTileBytes +
+        subtile * kSubtileBytes +
+        microtile * kMicrotileBytes +
+        ((y % microtileHeight) * microtileWidth + (x % microtileWidth)) * bytesPerPixel;
+}
+
+void
+RosTFormat::Tile(
+    const BYTE *    pSrc,
+    UINT            srcPitchBytes,
+    BYTE *          pDst,
+    UINT            dstWidthInTiles,
+    UINT            width,
+    UINT            height,
+    UINT            bytesPerPixel)
+{
+    const UINT  microtileWidth = GetMicrotileWidth(bytesPerPixel);
+
+    for (UINT y = 0; y < height; y++)
+    {
+        const BYTE *    pSrcRow = pSrc + y * srcPitchBytes;
+
+        for (UINT x = 0; x < width; x += microtileWidth)
+        {
+            UINT    pixels = ((width - x) < microtileWidth) ? (width - x) : microtileWidth;
+
+            memcpy(
+                pDst + GetPixelOffset(dstWidthInTiles, x, y, bytesPerPixel),
+                pSrcRow + x * bytesPerPixel,
+                pixels * bytesPerPixel);
+        }
+    }
+}
+
+void
+RosTFormat::Detile(
+    const BYTE *    pSrc,
+    UINT            srcWidthInTiles,
+    BYTE *          pDst,
+    UINT            dstPitchBytes,
+    UINT            width,
+    UINT            height,
+    UINT            bytesPerPixel)
+{
+    const UINT  microtileWidth = GetMicrotileWidth(bytesPerPixel);
+
+    for (UINT y = 0; y < height; y++)
+    {
+        BYTE *  pDstRow = pDst + y * dstPitchBytes;
+
+        for (UINT x = 0; x < width; x += microtileWidth)
+        {
+            UINT    pixels = ((width - x) < microtileWidth) ? (width - x) : microtileWidth;
+
+            memcpy(
+                pDstRow + x * bytesPerPixel,
+                pSrc + GetPixelOffset(srcWidthInTiles, x, y, bytesPerPixel),
+                pixels * bytesPerPixel);
+        }
+    }
+}
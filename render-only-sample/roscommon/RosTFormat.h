@@ -0,0 +1,106 @@
+#pragma once
+
+//
+// Layout of T-format textures and render targets.
+//
+// A T-format surface is made of 4KB tiles in rows, even rows left to right
+// and odd rows right to left. A tile is 2x2 subtiles of 1KB, a subtile is
+// 4x4 microtiles of 64 bytes in rows and a microtile is its pixels in rows:
+// 4x4 pixels of 32 bits, 8x4 of 16 bits or 8x8 of 8 bits. The subtiles of
+// a tile on an even row are in the order
+//
+//  [A  D]
+//  [B  C]
+//
+// and on an odd row
+//
+//  [C  B]
+//  [D  A]
+//
+// The tile buffer loads and stores T-format render targets and the TMU
+// samples T-format textures, except that it samples levels small enough
+// to be LT-format, microtiles in rows, as such.
+//
+
+#include "RosPortable.h"
+
+#if !defined(_KERNEL_MODE)
+#include <string.h>
+#endif
+
+class RosTFormat
+{
+public:
+
+    static const UINT kTileBytes = 4096;
+    static const UINT kSubtileBytes = 1024;
+    static const UINT kMicrotileBytes = 64;
+
+    // Microtiles across and down a subtile, subtiles across and down a tile
+    static const UINT kSubtileMicrotiles = 4;
+    static const UINT kTileSubtiles = 2;
+
+    // Pixels across and down a microtile of 1, 2 or 4 bytes per pixel
+    static UINT GetMicrotileWidth(UINT bytesPerPixel);
+    static UINT GetMicrotileHeight(UINT bytesPerPixel);
+
+    static UINT GetTileWidth(UINT bytesPerPixel)
+    {
+        return GetMicrotileWidth(bytesPerPixel) * kSubtileMicrotiles * kTileSubtiles;
+    }
+
+    static UINT GetTileHeight(UINT bytesPerPixel)
+    {
+        return GetMicrotileHeight(bytesPerPixel) * kSubtileMicrotiles * kTileSubtiles;
+    }
+
+    static UINT GetWidthInTiles(UINT width, UINT bytesPerPixel)
+    {
+        return (width + GetTileWidth(bytesPerPixel) - 1) / GetTileWidth(bytesPerPixel);
+    }
+
+    static UINT GetHeightInTiles(UINT height, UINT bytesPerPixel)
+    {
+        return (height + GetTileHeight(bytesPerPixel) - 1) / GetTileHeight(bytesPerPixel);
+    }
+
+    static UINT GetSizeBytes(UINT width, UINT height, UINT bytesPerPixel)
+    {
+        return GetWidthInTiles(width, bytesPerPixel) * GetHeightInTiles(height, bytesPerPixel) * kTileBytes;
+    }
+
+    // The TMU samples a level up to 4 microtiles across or down as LT-format
+    static bool IsLtFormat(UINT width, UINT height, UINT bytesPerPixel)
+    {
+        return (width <= kSubtileMicrotiles * GetMicrotileWidth(bytesPerPixel)) ||
+               (height <= kSubtileMicrotiles * GetMicrotileHeight(bytesPerPixel));
+    }
+
+    // Offset of a pixel in a surface widthInTiles tiles across
+    static UINT GetPixelOffset(UINT widthInTiles, UINT x, UINT y, UINT bytesPerPixel);
+
+    //
+    // Copy width x height pixels from a linear surface to a T-format one and
+    // back, a row of a microtile at a time
+    //
+
+    static void
+    Tile(
+        const BYTE *    pSrc,
+        UINT            srcPitchBytes,
+        BYTE *          pDst,
+        UINT            dstWidthInTiles,
+        UINT            width,
+        UINT            height,
+        UINT            bytesPerPixel);
+
+    static void
+    Detile(
+        const BYTE *    pSrc,
+        UINT            srcWidthInTiles,
+        BYTE *          pDst,
+        UINT            dstPitchBytes,
+        UINT            width,
+        UINT            height,
+        UINT            bytesPerPixel);
+};
@@ -0,0 +1,141 @@
+#include "RosTileOrder.h"
+
+RosTileOrder::RosTileOrder(
+    RosTileOrderType    type,
+    UINT                widthInTiles,
+    UINT                heightInTiles)
+{
+    ROS_PORTABLE_ASSERT(type != ROS_TILE_ORDER_AUTO);
+
+    m_type = type;
+    m_widthInTiles = widthInTiles;
+    m_heightInTiles = heightInTiles;
+    m_index = 0;
+
+    m_curveSize = 1;
+    while ((m_curveSize < widthInTiles) || (m_curveSize < heightInTiles))
+    {
+        m_curveSize *= 2;
+    }
+}
+
+RosTileOrderType
+RosTileOrder::Choose(
+    bool    bLinear)
+{
+    return bLinear ? ROS_TILE_ORDER_SERPENTINE : ROS_TILE_ORDER_MORTON;
+}
+
+bool
+RosTileOrder::Next(
+    UINT   *pX,
+    UINT   *pY)
+{
+    switch (m_type)
+    {
+    case ROS_TILE_ORDER_COLUMN_MAJOR:
+    case ROS_TILE_ORDER_ROW_MAJOR:
+    case ROS_TILE_ORDER_SERPENTINE:
+        if (m_index == GetCount())
+        {
+            m_index = 0;
+            return false;
+        }
+
+        if (m_type == ROS_TILE_ORDER_COLUMN_MAJOR)
+        {
+            *pX = m_index / m_heightInTiles;
+            *pY = m_index % m_heightInTiles;
+        }
+        else
+        {
+            *pX = m_index % m_widthInTiles;
+            *pY = m_index / m_widthInTiles;
+
+            if ((m_type == ROS_TILE_ORDER_SERPENTINE) && (*pY & 1))
+            {
+                *pX = m_widthInTiles - 1 - *pX;
+            }
+        }
+
+        m_index++;
+        return true;
+
+    default:
+        //
+        // Skip the tiles of the curve outside of the render target
+        //
+
+        while (m_index < m_curveSize * m_curveSize)
+        {
+            GetCurveTile(m_index++, pX, pY);
+
+            if ((*pX < m_widthInTiles) && (*pY < m_heightInTiles))
+            {
+                return true;
+            }
+        }
+
+        m_index = 0;
+        return false;
+    }
+}
+
+void
+RosTileOrder::GetCurveTile(
+    UINT    index,
+    UINT   *pX,
+    UINT   *pY) const
+{
+    UINT    x = 0;
+    UINT    y = 0;
+
+    if (m_type == ROS_TILE_ORDER_MORTON)
+    {
+        //
+        // Even bits of the index are x, odd bits are y
+        //
+
+        for (UINT bit = 0; (1u << (2 * bit)) < m_curveSize * m_curveSize; bit++)
+        {
+            x |= ((index >> (2 * bit)) & 1) << bit;
+            y |= ((index >> (2 * bit + 1)) & 1) << bit;
+        }
+    }
+    else
+    {
+        ROS_PORTABLE_ASSERT(m_type == ROS_TILE_ORDER_HILBERT);
+
+        //
+        // Each pair of bits picks the quadrant of the square of the size,
+        // the tiles in it are rotated to enter and leave the quadrant next
+        // to the ones before and after it
+        //
+
+        for (UINT size = 1; size < m_curveSize; size *= 2)
+        {
+            UINT    quadrantX = 1 & (index / 2);
+            UINT    quadrantY = 1 & (index ^ quadrantX);
+
+            if (quadrantY == 0)
+            {
+                if (quadrantX == 1)
+                {
+                    x = size - 1 - x;
+                    y = size - 1 - y;
+                }
+
+                UINT    swap = x;
+                x = y;
+                y = swap;
+            }
+
+            x += size * quadrantX;
+            y += size * quadrantY;
+            index /= 4;
+        }
+    }
+
+    *pX = x;
+    *pY = y;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+//
+// Order in which the Rendering Control List renders the tiles of a pass.
+//
+// Each tile loads and stores its part of the render target and samples the
+// textures its primitives cover. Tiles next to each other share the memory
+// pages of a linear render target, which rows of tiles walk in order, and
+// the texels of a texture stretched over the screen. Column-major order
+// shares neither.
+//
+// ROS_TILE_ORDER_AUTO picks the order for the layout of the render target:
+// serpentine walks the pages of a linear one row by row and turns back at
+// the end of the row over the texels it just sampled, a T-format one has
+// its own pages for every tile and the Morton curve keeps the texels of
+// consecutive tiles together.
+//
+// Morton and Hilbert curves cover the power of two square around the
+// render target and skip the tiles outside of it.
+//
+
+#include "RosPortable.h"
+
+enum RosTileOrderType
+{
+    ROS_TILE_ORDER_AUTO,
+    ROS_TILE_ORDER_COLUMN_MAJOR,
+    ROS_TILE_ORDER_ROW_MAJOR,
+    ROS_TILE_ORDER_SERPENTINE,          // Rows of tiles alternate direction
+    ROS_TILE_ORDER_MORTON,
+    ROS_TILE_ORDER_HILBERT,
+};
+
+class RosTileOrder
+{
+public:
+
+    RosTileOrder(RosTileOrderType type, UINT widthInTiles, UINT heightInTiles);
+
+    // Order of ROS_TILE_ORDER_AUTO for a linear or a T-format render target
+    static RosTileOrderType Choose(bool bLinear);
+
+    RosTileOrderType GetType() const
+    {
+        return m_type;
+    }
+
+    UINT GetCount() const
+    {
+        return m_widthInTiles * m_heightInTiles;
+    }
+
+    //
+    // Returns the next tile of the order, false after the last one. The
+    // order restarts after it.
+    //
+
+    bool Next(UINT * pX, UINT * pY);
+
+private:
+
+    void GetCurveTile(UINT index, UINT * pX, UINT * pY) const;
+
+    RosTileOrderType    m_type;
+    UINT                m_widthInTiles;
+    UINT                m_heightInTiles;
+
+    UINT                m_curveSize;        // Side of the square of the curves
+    UINT                m_index;            // Along the order or its curve
+};
@@ -0,0 +1,593 @@
+#include "RosTraceRing.h"
+
+#if !defined(_KERNEL_MODE)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#endif
+
+RosTraceRing::RosTraceRing()
+{
+    m_pEvents = NULL;
+    m_mask = 0;
+    m_writeCount = 0;
+}
+
+void
+RosTraceRing::Init(
+    RosTraceEvent * pEvents,
+    UINT            numEvents)
+{
+    ROS_PORTABLE_ASSERT(numEvents != 0);
+    ROS_PORTABLE_ASSERT(0 == (numEvents & (numEvents - 1)));
+
+    m_pEvents = pEvents;
+    m_mask = numEvents - 1;
+    m_writeCount = 0;
+
+    for (UINT i = 0; i < numEvents; i++)
+    {
+        m_pEvents[i].m_sequence = 0;
+    }
+}
+
+void
+RosTraceRing::Write(
+    UINT            cpu,
+    UINT            thread,
+    ULONGLONG       timestamp,
+    RosTraceStage   stage,
+    RosTracePhase   phase,
+    UINT            fenceId,
+    ULONGLONG       submission)
+{
+    UINT            index = (UINT)ROS_TRACE_INTERLOCKED_INCREMENT(&m_writeCount) - 1;
+    RosTraceEvent * pEvent = &m_pEvents[index & m_mask];
+
+    //
+    // Readers skip the event until the sequence is set again
+    //
+
+    pEvent->m_sequence = 0;
+
+    ROS_TRACE_MEMORY_BARRIER();
+
+    pEvent->m_fenceId = fenceId;
+    pEvent->m_timestamp = timestamp;
+    pEvent->m_submission = submission;
+    pEvent->m_thread = thread;
+    pEvent->m_stage = (USHORT)stage;
+    pEvent->m_phase = (BYTE)phase;
+    pEvent->m_cpu = (BYTE)cpu;
+
+    ROS_TRACE_MEMORY_BARRIER();
+
+    pEvent->m_sequence = index + 1;
+}
+
+UINT
+RosTraceRing::Snapshot(
+    RosTraceEvent * pEvents,
+    UINT            maxEvents) const
+{
+    UINT    end = (UINT)m_writeCount;
+
+    ROS_TRACE_MEMORY_BARRIER();
+
+    UINT    count = end;
+
+    if (count > m_mask + 1)
+    {
+        count = m_mask + 1;
+    }
+
+    if (count > maxEvents)
+    {
+        count = maxEvents;
+    }
+
+    UINT    numCopied = 0;
+
+    for (UINT index = end - count; index != end; index++)
+    {
+        const RosTraceEvent *   pEvent = &m_pEvents[index & m_mask];
+        RosTraceEvent *         pCopy = &pEvents[numCopied];
+
+        UINT    sequence = pEvent->m_sequence;
+
+        ROS_TRACE_MEMORY_BARRIER();
+
+        pCopy->m_fenceId = pEvent->m_fenceId;
+        pCopy->m_timestamp = pEvent->m_timestamp;
+        pCopy->m_submission = pEvent->m_submission;
+        pCopy->m_thread = pEvent->m_thread;
+        pCopy->m_stage = pEvent->m_stage;
+        pCopy->m_phase = pEvent->m_phase;
+        pCopy->m_cpu = pEvent->m_cpu;
+
+        ROS_TRACE_MEMORY_BARRIER();
+
+        //
+        // Skip events being written, and ones a writer has already reused
+        // the slot of
+        //
+
+        if ((sequence == index + 1) && (pEvent->m_sequence == sequence))
+        {
+            pCopy->m_sequence = sequence;
+            numCopied++;
+        }
+    }
+
+    return numCopied;
+}
+
+RosTrace::RosTrace()
+{
+    m_bEnabled = false;
+    m_numRings = 0;
+}
+
+void
+RosTrace::Init(
+    RosTraceEvent * pEvents,
+    UINT            numEventsPerRing,
+    UINT            numRings)
+{
+    ROS_PORTABLE_ASSERT((numRings != 0) && (numRings <= kMaxRings));
+
+    for (UINT i = 0; i < numRings; i++)
+    {
+        m_rings[i].Init(pEvents + i * numEventsPerRing, numEventsPerRing);
+    }
+
+    m_numRings = numRings;
+}
+
+UINT
+RosTrace::Snapshot(
+    RosTraceEvent * pEvents,
+    UINT            maxEvents) const
+{
+    UINT    numEvents = 0;
+
+    for (UINT i = 0; i < m_numRings; i++)
+    {
+        numEvents += m_rings[i].Snapshot(pEvents + numEvents, maxEvents - numEvents);
+    }
+
+    return numEvents;
+}
+
+const char *
+RosTrace::GetStageName(
+    RosTraceStage   stage)
+{
+    static const char * const s_stageNames[ROS_TRACE_NUM_STAGES] =
+    {
+        "Render",
+        "Patch",
+        "QueueDmaBuffer",
+        "RunDmaBuffer",
+        "GenerateRenderingControlList",
+        "BinningControlList",
+        "RenderingControlList",
+        "DmaBufferCompletion",
+        "QueueFlip",
+        "ProgramFlip",
+        "ShowFlip",
+    };
+
+    ROS_PORTABLE_ASSERT(stage < ROS_TRACE_NUM_STAGES);
+
+    return s_stageNames[stage];
+}
+
+#if !defined(_KERNEL_MODE)
+
+static int
+CompareEvents(
+    const void *    pLeft,
+    const void *    pRight)
+{
+    const RosTraceEvent *   pLeftEvent = (const RosTraceEvent *)pLeft;
+    const RosTraceEvent *   pRightEvent = (const RosTraceEvent *)pRight;
+
+    if (pLeftEvent->m_timestamp != pRightEvent->m_timestamp)
+    {
+        return (pLeftEvent->m_timestamp < pRightEvent->m_timestamp) ? -1 : 1;
+    }
+
+    //
+    // Events of a ring with the same timestamp keep their write order
+    //
+
+    if (pLeftEvent->m_cpu != pRightEvent->m_cpu)
+    {
+        return (pLeftEvent->m_cpu < pRightEvent->m_cpu) ? -1 : 1;
+    }
+
+    if (pLeftEvent->m_sequence != pRightEvent->m_sequence)
+    {
+        return (pLeftEvent->m_sequence < pRightEvent->m_sequence) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+//
+// Appends to the trace, counting what doesn't fit
+//
+
+class RosTraceWriter
+{
+public:
+
+    RosTraceWriter(char * pBuffer, size_t bufferSize) :
+        m_pBuffer(pBuffer),
+        m_bufferSize(bufferSize),
+        m_length(0)
+    {
+        if (m_bufferSize)
+        {
+            m_pBuffer[0] = 0;
+        }
+    }
+
+    void Print(const char * pFormat, ...)
+    {
+        va_list args;
+
+        char *  pDest = NULL;
+        size_t  available = 0;
+
+        if (m_length < m_bufferSize)
+        {
+            pDest = m_pBuffer + m_length;
+            available = m_bufferSize - m_length;
+        }
+
+        va_start(args, pFormat);
+        int length = vsnprintf(pDest, available, pFormat, args);
+        va_end(args);
+
+        ROS_PORTABLE_ASSERT(length >= 0);
+
+        m_length += length;
+    }
+
+    size_t GetLength() const
+    {
+        return m_length;
+    }
+
+private:
+
+    char *  m_pBuffer;
+    size_t  m_bufferSize;
+    size_t  m_length;
+};
+
+void
+RosTrace::SortSnapshot(
+    RosTraceEvent * pEvents,
+    UINT            numEvents)
+{
+    qsort(pEvents, numEvents, sizeof(RosTraceEvent), CompareEvents);
+
+    //
+    // The fence of a DMA buffer is only known once it is submitted, the
+    // next event of the same DMA buffer with a fence provides it
+    //
+
+    for (UINT i = 0; i < numEvents; i++)
+    {
+        if ((pEvents[i].m_fenceId != 0) || (pEvents[i].m_submission == 0))
+        {
+            continue;
+        }
+
+        for (UINT j = i + 1; j < numEvents; j++)
+        {
+            if ((pEvents[j].m_submission == pEvents[i].m_submission) &&
+                (pEvents[j].m_fenceId != 0))
+            {
+                pEvents[i].m_fenceId = pEvents[j].m_fenceId;
+                break;
+            }
+        }
+    }
+}
+
+size_t
+RosTrace::FormatChromeTrace(
+    RosTraceEvent * pEvents,
+    UINT            numEvents,
+    ULONGLONG       frequency,
+    char *          pBuffer,
+    size_t          bufferSize)
+{
+    SortSnapshot(pEvents, numEvents);
+
+    RosTraceWriter  writer(pBuffer, bufferSize);
+
+    writer.Print("{\"traceEvents\":[");
+
+    ULONGLONG   start = numEvents ? pEvents[0].m_timestamp : 0;
+
+    for (UINT i = 0; i < numEvents; i++)
+    {
+        const RosTraceEvent &   event = pEvents[i];
+
+        static const char s_phases[] = { 'B', 'E', 'i' };
+
+        ROS_PORTABLE_ASSERT(event.m_phase < sizeof(s_phases));
+
+        double  timestamp = (double)(event.m_timestamp - start) * 1000000.0 / (double)frequency;
+
+        writer.Print(
+            "%s\n{\"name\":\"%s\",\"cat\":\"roskmd\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%u,%s"
+            "\"args\":{\"fence\":%u,\"cpu\":%u,\"submission\":%llu}}",
+            i ? "," : "",
+            GetStageName((RosTraceStage)event.m_stage),
+            s_phases[event.m_phase],
+            timestamp,
+            event.m_thread,
+            (event.m_phase == ROS_TRACE_INSTANT) ? "\"s\":\"t\"," : "",
+            event.m_fenceId,
+            (UINT)event.m_cpu,
+            event.m_submission);
+    }
+
+    writer.Print("\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    return writer.GetLength();
+}
+
+UINT
+RosTrace::GetFrameRecords(
+    RosTraceEvent *     pEvents,
+    UINT                numEvents,
+    RosFrameRecord *    pFrames,
+    UINT                maxFrames)
+{
+    SortSnapshot(pEvents, numEvents);
+
+    UINT    numFrames = 0;
+
+    for (UINT i = 0; i < numEvents; i++)
+    {
+        if (pEvents[i].m_stage != ROS_TRACE_QUEUE_FLIP)
+        {
+            continue;
+        }
+
+        if (numFrames < maxFrames)
+        {
+            RosFrameRecord *    pFrame = &pFrames[numFrames];
+
+            memset(pFrame, 0, sizeof(RosFrameRecord));
+            pFrame->m_fenceId = pEvents[i].m_fenceId;
+            pFrame->m_flipQueued = pEvents[i].m_timestamp;
+        }
+
+        numFrames++;
+    }
+
+    UINT    numRecords = (numFrames < maxFrames) ? numFrames : maxFrames;
+
+    //
+    // The events are in order, the first one of a stage in a frame starts
+    // it and the last one ends it
+    //
+
+    for (UINT i = 0; i < numEvents; i++)
+    {
+        const RosTraceEvent &   event = pEvents[i];
+
+        if (0 == event.m_fenceId)
+        {
+            continue;
+        }
+
+        if ((ROS_TRACE_PROGRAM_FLIP == event.m_stage) || (ROS_TRACE_SHOW_FLIP == event.m_stage))
+        {
+            //
+            // The earliest flip of the primary queued before
+            //
+
+            for (UINT j = 0; j < numRecords; j++)
+            {
+                RosFrameRecord &    frame = pFrames[j];
+                ULONGLONG &         timestamp = (ROS_TRACE_PROGRAM_FLIP == event.m_stage) ? frame.m_flipProgrammed : frame.m_vsync;
+
+                if ((frame.m_fenceId == event.m_fenceId) &&
+                    (frame.m_flipQueued <= event.m_timestamp) &&
+                    (0 == timestamp))
+                {
+                    timestamp = event.m_timestamp;
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        //
+        // A DMA buffer is in the first frame with a fence past its own
+        //
+
+        RosFrameRecord *    pFrame = NULL;
+
+        for (UINT j = 0; j < numRecords; j++)
+        {
+            if (pFrames[j].m_fenceId >= event.m_fenceId)
+            {
+                pFrame = &pFrames[j];
+                break;
+            }
+        }
+
+        if (!pFrame)
+        {
+            continue;
+        }
+
+        switch (event.m_stage)
+        {
+        case ROS_TRACE_RENDER:
+            if ((ROS_TRACE_BEGIN == event.m_phase) && (0 == pFrame->m_submit))
+            {
+                pFrame->m_submit = event.m_timestamp;
+            }
+            break;
+        case ROS_TRACE_QUEUE:
+            if (ROS_TRACE_BEGIN == event.m_phase)
+            {
+                pFrame->m_numDmaBuffers++;
+
+                if (pFrame->m_fenceId == event.m_fenceId)
+                {
+                    pFrame->m_queue = event.m_timestamp;
+                }
+            }
+            break;
+        case ROS_TRACE_BINNING:
+            if (ROS_TRACE_END == event.m_phase)
+            {
+                pFrame->m_binningEnd = event.m_timestamp;
+            }
+            else if (0 == pFrame->m_binningStart)
+            {
+                pFrame->m_binningStart = event.m_timestamp;
+            }
+            break;
+        case ROS_TRACE_RENDERING:
+            if (ROS_TRACE_END == event.m_phase)
+            {
+                pFrame->m_renderingEnd = event.m_timestamp;
+            }
+            else if (0 == pFrame->m_renderingStart)
+            {
+                pFrame->m_renderingStart = event.m_timestamp;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return numFrames;
+}
+
+//
+// Microseconds from the start, nothing for a stage not in the trace
+//
+
+static void
+PrintFrameTimestamp(
+    RosTraceWriter &    writer,
+    ULONGLONG           timestamp,
+    ULONGLONG           start,
+    ULONGLONG           frequency)
+{
+    if (timestamp)
+    {
+        writer.Print(",%.3f", ((double)timestamp - (double)start) * 1000000.0 / (double)frequency);
+    }
+    else
+    {
+        writer.Print(",");
+    }
+}
+
+size_t
+RosTrace::FormatFrameCsv(
+    const RosFrameRecord *  pFrames,
+    UINT                    numFrames,
+    ULONGLONG               frequency,
+    char *                  pBuffer,
+    size_t                  bufferSize)
+{
+    RosTraceWriter  writer(pBuffer, bufferSize);
+
+    writer.Print(
+        "frame,fence,dmaBuffers,submit,queue,binningStart,binningEnd,renderingStart,renderingEnd,"
+        "flipQueued,flipProgrammed,vsync,frameTime,latency\n");
+
+    ULONGLONG   start = 0;
+
+    if (numFrames)
+    {
+        start = pFrames[0].m_submit ? pFrames[0].m_submit : pFrames[0].m_flipQueued;
+    }
+
+    ULONGLONG   lastVSync = 0;
+
+    for (UINT i = 0; i < numFrames; i++)
+    {
+        const RosFrameRecord &  frame = pFrames[i];
+
+        writer.Print("%u,%u,%u", i, frame.m_fenceId, frame.m_numDmaBuffers);
+
+        PrintFrameTimestamp(writer, frame.m_submit, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_queue, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_binningStart, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_binningEnd, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_renderingStart, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_renderingEnd, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_flipQueued, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_flipProgrammed, start, frequency);
+        PrintFrameTimestamp(writer, frame.m_vsync, start, frequency);
+
+        //
+        // Durations, in the same units
+        //
+
+        PrintFrameTimestamp(writer, (frame.m_vsync && lastVSync) ? frame.m_vsync - lastVSync : 0, 0, frequency);
+        PrintFrameTimestamp(writer, (frame.m_vsync && frame.m_submit) ? frame.m_vsync - frame.m_submit : 0, 0, frequency);
+
+        writer.Print("\n");
+
+        if (frame.m_vsync)
+        {
+            lastVSync = frame.m_vsync;
+        }
+    }
+
+    return writer.GetLength();
+}
+
+static int
+CompareValues(
+    const void *    pLeft,
+    const void *    pRight)
+{
+    ULONGLONG   left = *(const ULONGLONG *)pLeft;
+    ULONGLONG   right = *(const ULONGLONG *)pRight;
+
+    return (left < right) ? -1 : ((left > right) ? 1 : 0);
+}
+
+ULONGLONG
+RosTrace::GetPercentile(
+    ULONGLONG * pValues,
+    UINT        numValues,
+    UINT        percentile)
+{
+    ROS_PORTABLE_ASSERT(numValues != 0);
+    ROS_PORTABLE_ASSERT(percentile <= 100);
+
+    qsort(pValues, numValues, sizeof(ULONGLONG), CompareValues);
+
+    //
+    // The smallest value at least percentile % of the values don't exceed
+    //
+
+    UINT    rank = (UINT)(((ULONGLONG)percentile * numValues + 99) / 100);
+
+    return pValues[rank ? rank - 1 : 0];
+}
+
+#endif
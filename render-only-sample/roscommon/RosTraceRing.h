@@ -0,0 +1,279 @@
+#pragma once
+
+//
+// Timestamped trace of the DMA buffer submission path.
+//
+// Every CPU writes to a ring of its own, so writers on different CPUs never
+// share a cache line. A ring can still have more than one writer (a DPC
+// preempting the worker thread, or more CPUs than rings), the write index
+// is claimed with an interlocked increment and every event carries the
+// index it was written at, which the reader checks before and after copying
+// it. Old events are overwritten once a ring wraps.
+//
+// Events carry the submission fence of their DMA buffer, and a sequence
+// number the KMD gives it in DxgkDdiRender, which ties the events before the
+// DMA buffer is submitted to the fence. Kernel addresses never leave the KMD. The flip events of the display carry the fence of the last
+// DMA buffer rendering the primary, which ties them to the frame.
+//
+// The trace doesn't allocate, the caller provides the events. The Chrome
+// trace formatter and the frame records are user mode only.
+//
+
+#include "RosPortable.h"
+
+#if defined(_KERNEL_MODE)
+
+#define ROS_TRACE_INTERLOCKED_INCREMENT(p) InterlockedIncrement(p)
+#define ROS_TRACE_MEMORY_BARRIER() KeMemoryBarrier()
+
+#elif defined(_WIN32)
+
+#define ROS_TRACE_INTERLOCKED_INCREMENT(p) InterlockedIncrement(p)
+#define ROS_TRACE_MEMORY_BARRIER() MemoryBarrier()
+
+#else
+
+#define ROS_TRACE_INTERLOCKED_INCREMENT(p) __sync_add_and_fetch(p, 1)
+#define ROS_TRACE_MEMORY_BARRIER() __sync_synchronize()
+
+#endif
+
+enum RosTraceStage
+{
+    ROS_TRACE_RENDER,                   // DxgkDdiRender, copy and validation of the command buffer
+    ROS_TRACE_PATCH,                    // DxgkDdiPatch
+    ROS_TRACE_QUEUE,                    // DxgkDdiSubmitCommand, queueing the DMA buffer for the worker
+    ROS_TRACE_RUN,                      // Worker running the DMA buffer
+    ROS_TRACE_GENERATE_RCL,             // Generation of the rendering control list
+    ROS_TRACE_BINNING,                  // Binning control list on the GPU
+    ROS_TRACE_RENDERING,                // Rendering control list on the GPU
+    ROS_TRACE_COMPLETE,                 // Completion reported to the scheduler
+    ROS_TRACE_QUEUE_FLIP,               // DxgkDdiSetVidPnSourceAddress, flip queued to the display
+    ROS_TRACE_PROGRAM_FLIP,             // Flip written to the display list
+    ROS_TRACE_SHOW_FLIP,                // VfpStart interrupt after which the flip is shown
+    ROS_TRACE_NUM_STAGES
+};
+
+enum RosTracePhase
+{
+    ROS_TRACE_BEGIN,
+    ROS_TRACE_END,
+    ROS_TRACE_INSTANT,
+};
+
+typedef struct _RosTraceEvent
+{
+    volatile UINT   m_sequence;     // Write index + 1, 0 while the event is written
+    UINT            m_fenceId;      // 0 until the DMA buffer is submitted
+    ULONGLONG       m_timestamp;    // Performance counter
+    ULONGLONG       m_submission;   // Sequence number of the DMA buffer, 0 for none
+    UINT            m_thread;
+    USHORT          m_stage;
+    BYTE            m_phase;
+    BYTE            m_cpu;
+} RosTraceEvent;
+
+//
+// Timestamps of a frame from the submission of its first DMA buffer to the
+// vsync showing it. The stages not in the trace are 0, as the vsync of a
+// flip replaced by an immediate flip.
+//
+
+typedef struct _RosFrameRecord
+{
+    UINT        m_fenceId;          // Last DMA buffer rendering the primary
+    UINT        m_numDmaBuffers;
+    ULONGLONG   m_submit;           // DxgkDdiRender of the first DMA buffer
+    ULONGLONG   m_queue;            // DxgkDdiSubmitCommand of the last DMA buffer
+    ULONGLONG   m_binningStart;
+    ULONGLONG   m_binningEnd;
+    ULONGLONG   m_renderingStart;
+    ULONGLONG   m_renderingEnd;
+    ULONGLONG   m_flipQueued;
+    ULONGLONG   m_flipProgrammed;
+    ULONGLONG   m_vsync;            // VfpStart after which it's shown
+} RosFrameRecord;
+
+class RosTraceRing
+{
+public:
+
+    RosTraceRing();
+
+    // numEvents must be a power of 2
+    void Init(RosTraceEvent * pEvents, UINT numEvents);
+
+    void
+    Write(
+        UINT            cpu,
+        UINT            thread,
+        ULONGLONG       timestamp,
+        RosTraceStage   stage,
+        RosTracePhase   phase,
+        UINT            fenceId,
+        ULONGLONG       submission);
+
+    //
+    // Copies the events still in the ring, oldest first, skipping the ones
+    // being written. Returns the number of events copied.
+    //
+
+    UINT Snapshot(RosTraceEvent * pEvents, UINT maxEvents) const;
+
+    UINT GetWriteCount() const
+    {
+        return (UINT)m_writeCount;
+    }
+
+    UINT GetNumEvents() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+
+    RosTraceEvent *     m_pEvents;
+    UINT                m_mask;
+
+    // The write count is the only field writers modify, it gets a cache
+    // line of its own so the rings of different CPUs don't share one
+    BYTE                m_padding0[64 - sizeof(RosTraceEvent *) - sizeof(UINT)];
+    volatile LONG       m_writeCount;
+    BYTE                m_padding1[64 - sizeof(LONG)];
+};
+
+class RosTrace
+{
+public:
+
+    static const UINT kMaxRings = 4;
+
+    RosTrace();
+
+    //
+    // pEvents holds numEventsPerRing events for each of the numRings rings
+    //
+
+    void
+    Init(
+        RosTraceEvent * pEvents,
+        UINT            numEventsPerRing,
+        UINT            numRings);
+
+    void Enable(bool bEnable)
+    {
+        m_bEnabled = bEnable;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_bEnabled;
+    }
+
+    void
+    Write(
+        UINT            cpu,
+        UINT            thread,
+        ULONGLONG       timestamp,
+        RosTraceStage   stage,
+        RosTracePhase   phase,
+        UINT            fenceId,
+        ULONGLONG       submission)
+    {
+        m_rings[cpu % m_numRings].Write(cpu, thread, timestamp, stage, phase, fenceId, submission);
+    }
+
+    //
+    // Copies the events of every ring, ring after ring. Returns the number
+    // of events copied.
+    //
+
+    UINT Snapshot(RosTraceEvent * pEvents, UINT maxEvents) const;
+
+    UINT GetMaxEvents() const
+    {
+        return m_numRings * m_rings[0].GetNumEvents();
+    }
+
+    const RosTraceRing & GetRing(UINT ring) const
+    {
+        ROS_PORTABLE_ASSERT(ring < m_numRings);
+        return m_rings[ring];
+    }
+
+    static const char * GetStageName(RosTraceStage stage);
+
+#if !defined(_KERNEL_MODE)
+
+    //
+    // Formats a snapshot as a Chrome trace (chrome://tracing) JSON timeline.
+    // Sorts the events by timestamp and fills in the fence of the events
+    // before the submission of their DMA buffer. Like snprintf, returns the
+    // length of the whole trace and writes what fits in bufferSize, NUL
+    // terminated.
+    //
+
+    static size_t
+    FormatChromeTrace(
+        RosTraceEvent * pEvents,
+        UINT            numEvents,
+        ULONGLONG       frequency,
+        char *          pBuffer,
+        size_t          bufferSize);
+
+    //
+    // Builds the records of the frames flipped in a snapshot, in the order
+    // they were flipped. A frame is the DMA buffers submitted after the one
+    // rendering the primary of the flip before it, the first frame starts
+    // with the snapshot. Sorts the events like FormatChromeTrace. Returns the
+    // number of frames and writes the first maxFrames.
+    //
+
+    static UINT
+    GetFrameRecords(
+        RosTraceEvent *     pEvents,
+        UINT                numEvents,
+        RosFrameRecord *    pFrames,
+        UINT                maxFrames);
+
+    //
+    // Formats frame records as CSV, one line per frame, the timestamps in
+    // microseconds from the submission of the first frame. The frame time is
+    // from the vsync of the frame shown before. Like snprintf.
+    //
+
+    static size_t
+    FormatFrameCsv(
+        const RosFrameRecord *  pFrames,
+        UINT                    numFrames,
+        ULONGLONG               frequency,
+        char *                  pBuffer,
+        size_t                  bufferSize);
+
+    // Nearest rank percentile of the values, sorts them
+    static ULONGLONG
+    GetPercentile(
+        ULONGLONG * pValues,
+        UINT        numValues,
+        UINT        percentile);
+
+#endif
+
+private:
+
+#if !defined(_KERNEL_MODE)
+
+    //
+    // Sorts the events by timestamp and fills in the fence of the events
+    // before the submission of their DMA buffer
+    //
+
+    static void SortSnapshot(RosTraceEvent * pEvents, UINT numEvents);
+
+#endif
+
+    volatile bool   m_bEnabled;
+
+    RosTraceRing    m_rings[kMaxRings];
+    UINT            m_numRings;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Vc4Hw.h"
+
 //
 // VC4 DDI definitions
 //
@@ -10,6 +12,10 @@ typedef enum _VC4ResourceSlotId
     VC4_SLOT_TILE_STATE_DATA_ARRAY  = 0x81,
 
     VC4_SLOT_RT_BINNING_CONFIG      = 0xC0,
+    VC4_SLOT_PERF_COUNTER_REPORT    = 0xC1, // Patch offset is the counter's source in the header
+    VC4_SLOT_CACHE_CLEAN            = 0xC2, // Patch offset is the range's size in the header
+    VC4_SLOT_DEPTH_STENCIL          = 0xC3, // Patch offset is the depth stencil use in the header
+    VC4_SLOT_RESOLVE_TARGET         = 0xC4, // Patch offset is the resolve use in the header
 
     VC4_SLOT_NV_SHADER_STATE        = 0xE0, // For code 65, NV Shader State
     VC4_SLOT_BRANCH                 = 0xE1, // For code 16, Branch
@@ -26,14 +32,143 @@ typedef enum _VC4ResourceSlotId
 
 const UINT  VC4_MAX_DMA_BUFFER_SELF_REF = 31;
 
+//
+// References to aperture ranges that aren't physically contiguous, the KMD
+// copies them to video memory before the DMA buffer runs
+//
+
+const UINT  VC4_MAX_APERTURE_BOUNCE = 16;
+
+//
+// Increment Semaphore, Flush All State, 2 NOPs and Halt ending the Binning
+// Control List. As long as a Branch, which the KMD writes over it to chain
+// the DMA buffer continuing the render pass.
+//
+
+const UINT  VC4_BINNING_EPILOG_SIZE = sizeof(VC4Branch);
+
+//
+// What the draws of a DMA buffer do to the depth stencil buffer of the
+// VC4_SLOT_DEPTH_STENCIL patch. The KMD loads it into the tile buffer when
+// the draws test depth, unless m_bClear clears it to ClearZ and
+// ClearStencil of the header's Clear Colors, and stores it when the draws
+// wrote it, unless m_bDiscard leaves it undefined after the DMA buffer.
+//
+
+typedef struct _VC4DepthStencilUse
+{
+    UINT    m_bUsed     : 1;
+    UINT    m_bWritten  : 1;
+    UINT    m_bClear    : 1;
+    UINT    m_bDiscard  : 1;
+    UINT    m_reserved  : 28;
+} VC4DepthStencilUse;
+
+//
+// Render target of the VC4_SLOT_RESOLVE_TARGET patch. The render target of
+// the DMA buffer is multisampled, the KMD resolves its samples into the
+// resolve target when it stores the tiles at the end of the render pass.
+// m_bDiscard leaves the samples undefined after it, only the resolved
+// pixels are stored.
+//
+
+typedef struct _VC4ResolveUse
+{
+    UINT    m_bDiscard  : 1;
+    UINT    m_reserved  : 31;
+} VC4ResolveUse;
+
+//
+// Pixels of the render target the draws of a DMA buffer may write, the
+// union of their clip windows, m_right and m_bottom excluded. The KMD only
+// renders the tiles under it, the other tiles keep what the render target
+// has. It is empty when nothing was drawn.
+//
+
+typedef struct _VC4DirtyRect
+{
+    USHORT  m_left;
+    USHORT  m_top;
+    USHORT  m_right;
+    USHORT  m_bottom;
+} VC4DirtyRect;
+
+//
+// Bits of a D24S8 texel, depth is above stencil
+//
+
+const UINT  VC4_DEPTH_MASK = 0xFFFFFF00;
+const UINT  VC4_STENCIL_MASK = 0x000000FF;
+
+//
+// Performance counters sampled by a DMA buffer, m_sources are
+// V3D_PERF_COUNTER_SOURCE values. Counter i is reported to the allocation
+// of the VC4_SLOT_PERF_COUNTER_REPORT patch pointing at m_sources[i].
+//
+
+typedef struct _VC4PerfCounterSelect
+{
+    UINT    m_numCounters;
+    BYTE    m_sources[V3D_NUM_PERF_COUNTERS];
+} VC4PerfCounterSelect;
+
+//
+// The KMD adds the count of each DMA buffer that sampled the counter once
+// it has run, then increments m_sampleCount
+//
+
+typedef struct _VC4PerfCounterReport
+{
+    ULONGLONG   m_value;
+    UINT        m_sampleCount;
+    UINT        m_reserved;
+} VC4PerfCounterReport;
+
+//
+// GPU caches that may hold stale data. The control list executor, the
+// vertex fetch and the tile buffer read memory directly, the QPUs read
+// shader code, uniforms and textures through the slice caches, which are
+// backed by the L2 cache. The L2 cache is flushed along with any of them.
+//
+
+typedef enum _VC4GpuCache
+{
+    VC4_GPU_CACHE_INSTRUCTION   = 0x1,
+    VC4_GPU_CACHE_UNIFORM       = 0x2,
+    VC4_GPU_CACHE_TEXTURE       = 0x4,  // Both TMUs
+    VC4_GPU_CACHE_ALL           = 0x7
+} VC4GpuCache;
+
+//
+// Cache maintenance before a DMA buffer runs. The CPU caches are cleaned
+// over the ranges the CPU wrote, range i starts at the allocation offset of
+// the VC4_SLOT_CACHE_CLEAN patch pointing at m_cleanSizes[i]. When the
+// ranges don't fit, m_bCleanAll cleans the whole CPU caches instead.
+// m_gpuCaches are VC4GpuCache flags of the GPU caches to flush.
+//
+
+const UINT  VC4_MAX_CACHE_CLEAN = 8;
+
+typedef struct _VC4CacheMaintenance
+{
+    UINT    m_numCleans;
+    UINT    m_bCleanAll;
+    UINT    m_gpuCaches;
+    UINT    m_cleanSizes[VC4_MAX_CACHE_CLEAN];
+} VC4CacheMaintenance;
+
 //
 // TODO[indyz]: Decide the proper size of the needed memory for binning
 //              and handle binning memory usage spill over
 //
 // For now, reserve at the end of allocated contiguous memory:
 //   1. 64KB for Rendering Control List, 
-//   2. 1MB for Tile Allocation 
+//   2. Up to 1MB for Tile Allocation, sized by KMD from the usage of the
+//      recent frames
 //   3. 1MB for Tile State Data Array
+//   4. 1MB for copies of aperture ranges the GPU can't read in place
+//   5. 512KB for the overspill blocks KMD supplies when the binner runs out
+//      of tile allocation memory
 //
 // The default value used by UMD specifies that binning process generates
 // a 32 bytes control list and uses 48 bytes for state for each tile.
@@ -42,6 +177,10 @@ const UINT  VC4_MAX_DMA_BUFFER_SELF_REF = 31;
 const UINT  VC4_RENDERING_CTRL_LIST_POOL_SIZE = 1024 * 1024;
 const UINT  VC4_TILE_ALLOCATION_MEMORY_SIZE = 1024 * 1024;
 const UINT  VC4_TILE_STATE_DATA_ARRAY_SIZE = 1024 * 1024;
+const UINT  VC4_APERTURE_BOUNCE_SIZE = 1024 * 1024;
+const UINT  VC4_TILE_ALLOCATION_MEMORY_MIN_SIZE = 64 * 1024;
+const UINT  VC4_BINNER_OVERSPILL_POOL_SIZE = 512 * 1024;
+const UINT  VC4_BINNER_OVERSPILL_BLOCK_SIZE = 64 * 1024;
 
 //
 // TODO[indyz]: Choose proper size for VC4TileBinningModeConfig::TileAllocationBlockSize
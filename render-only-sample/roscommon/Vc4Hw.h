@@ -219,6 +219,19 @@ typedef union _V3D_REG_CT0CS
     UINT        Value;
 } V3D_REG_CT0CS, V3D_REG_CT1CS;
 
+// 0x0674   Performance Counter Enables
+typedef union _V3D_REG_PCTRE
+{
+    struct
+    {
+        UINT    CTEN        : 16;   // One bit per counter
+        UINT    RESERVED    : 15;
+        UINT    EN          : 1;
+    };
+
+    UINT        Value;
+} V3D_REG_PCTRE;
+
 // 0x0684   Performance Counter Mapping 0
 typedef union _V3D_REG_PCTRS0
 {
@@ -233,6 +246,46 @@ typedef union _V3D_REG_PCTRS0
 
 const UINT  V3D_NUM_PERF_COUNTERS = 16;
 
+//
+// Sources a performance counter can be mapped to with PCTRS
+//
+
+typedef enum _V3D_PERF_COUNTER_SOURCE
+{
+    V3D_PCTRS_FEP_VALID_PRIMS_NO_PIXELS         = 0,    // Valid primitives with no rendered pixels, for all rendered tiles
+    V3D_PCTRS_FEP_VALID_PRIMS                   = 1,    // Valid primitives for all rendered tiles
+    V3D_PCTRS_FEP_EZ_NFCLIP_QUADS               = 2,    // Early-Z/Near/Far clipped quads
+    V3D_PCTRS_FEP_VALID_QUADS                   = 3,    // Valid quads
+    V3D_PCTRS_TLB_QUADS_NO_STENCIL_PASS         = 4,    // Quads with no pixels passing the stencil test
+    V3D_PCTRS_TLB_QUADS_NO_Z_STENCIL_PASS       = 5,    // Quads with no pixels passing the Z and stencil tests
+    V3D_PCTRS_TLB_QUADS_Z_STENCIL_PASS          = 6,    // Quads with any pixels passing the Z and stencil tests
+    V3D_PCTRS_TLB_QUADS_ZERO_COVERAGE           = 7,    // Quads with all pixels having zero coverage
+    V3D_PCTRS_TLB_QUADS_NONZERO_COVERAGE        = 8,    // Quads with any pixels having non-zero coverage
+    V3D_PCTRS_TLB_QUADS_WRITTEN_TO_COLOR_BUF    = 9,    // Quads with valid pixels written to the color buffer
+    V3D_PCTRS_PTB_PRIMS_VIEWPORT_DISCARDED      = 10,   // Primitives discarded by being outside the viewport
+    V3D_PCTRS_PTB_PRIMS_NEED_CLIPPING           = 11,   // Primitives that need clipping
+    V3D_PCTRS_PSE_PRIMS_REVERSED                = 12,   // Primitives discarded because they are reversed
+    V3D_PCTRS_QPU_IDLE_CYCLES                   = 13,   // Idle clock cycles for all QPUs
+    V3D_PCTRS_QPU_VERTEX_COORD_SHADING_CYCLES   = 14,   // Clock cycles of QPUs doing vertex/coordinate shading
+    V3D_PCTRS_QPU_FRAGMENT_SHADING_CYCLES       = 15,   // Clock cycles of QPUs doing fragment shading
+    V3D_PCTRS_QPU_VALID_INSTRUCTION_CYCLES      = 16,   // Clock cycles of QPUs executing valid instructions
+    V3D_PCTRS_QPU_TMU_STALL_CYCLES              = 17,   // Clock cycles of QPUs stalled waiting for TMUs
+    V3D_PCTRS_QPU_SCOREBOARD_STALL_CYCLES       = 18,   // Clock cycles of QPUs stalled waiting for the scoreboard
+    V3D_PCTRS_QPU_VARYINGS_STALL_CYCLES         = 19,   // Clock cycles of QPUs stalled waiting for varyings
+    V3D_PCTRS_QPU_INSTRUCTION_CACHE_HITS        = 20,   // Instruction cache hits for all slices
+    V3D_PCTRS_QPU_INSTRUCTION_CACHE_MISSES      = 21,   // Instruction cache misses for all slices
+    V3D_PCTRS_QPU_UNIFORMS_CACHE_HITS           = 22,   // Uniforms cache hits for all slices
+    V3D_PCTRS_QPU_UNIFORMS_CACHE_MISSES         = 23,   // Uniforms cache misses for all slices
+    V3D_PCTRS_TMU_TEXTURE_QUADS                 = 24,   // Texture quads processed
+    V3D_PCTRS_TMU_TEXTURE_CACHE_MISSES          = 25,   // Texture cache misses
+    V3D_PCTRS_VPM_VDW_STALL_CYCLES              = 26,   // Clock cycles VDW is stalled waiting for VPM access
+    V3D_PCTRS_VPM_VCD_STALL_CYCLES              = 27,   // Clock cycles VCD is stalled waiting for VPM access
+    V3D_PCTRS_L2C_HITS                          = 28,   // Level 2 cache hits
+    V3D_PCTRS_L2C_MISSES                        = 29,   // Level 2 cache misses
+
+    V3D_NUM_PERF_COUNTER_SOURCES                = 30
+} V3D_PERF_COUNTER_SOURCE;
+
 typedef enum _VC4_COMMAND_ID : BYTE
 {
     VC4_CMD_HALT                        = 0,
@@ -414,6 +467,45 @@ typedef struct _VC4StoreMSResolvedTileColorBufAndSignalEndOfFrame
 
 static VC4StoreMSResolvedTileColorBufAndSignalEndOfFrame vc4StoreMSResolvedTileColorBufAndSignalEndOfFrame = { VC4_CMD_STORE_MS_RESOLVED_TILE_COLOR_BUF_AND_SIGNAL_END_OF_FRAME };
 
+// Code: 26,    Rendering only
+typedef struct _VC4StoreFullResolutionTileBuffer
+{
+    VC4_COMMAND_ID  CommandCode;
+    union
+    {
+        struct
+        {
+            UINT    DisableColorBufferWrite     : 1;
+            UINT    DisableZStencilBufferWrite  : 1;
+            UINT    DisableClear                : 1;    // Of both buffers
+            UINT    LastTileOfFrame             : 1;
+            UINT    MemoryBaseAddress           : 28;   // Address of the tile dump, 16 bytes aligned
+        };
+        UINT        UInt1;
+    };
+} VC4StoreFullResolutionTileBuffer;
+
+const VC4StoreFullResolutionTileBuffer vc4StoreFullResolutionTileBuffer = { VC4_CMD_STORE_FULL_RESOLUTION_TILE_BUFFER, 0 };
+
+// Code: 27,    Rendering only
+typedef struct _VC4LoadFullResolutionTileBuffer
+{
+    VC4_COMMAND_ID  CommandCode;
+    union
+    {
+        struct
+        {
+            UINT    DisableColorBufferRead      : 1;
+            UINT    DisableZStencilBufferRead   : 1;
+            UINT    Unused                      : 2;
+            UINT    MemoryBaseAddress           : 28;   // Address of the tile dump, 16 bytes aligned
+        };
+        UINT        UInt1;
+    };
+} VC4LoadFullResolutionTileBuffer;
+
+const VC4LoadFullResolutionTileBuffer vc4LoadFullResolutionTileBuffer = { VC4_CMD_LOAD_FULL_RESOLUTION_TILE_BUFFER, 0 };
+
 // Code: 28,    Rendering only
 typedef struct _VC4StoreTileBufferGeneral
 {
@@ -1001,6 +1093,16 @@ typedef enum _VC4TextureMinFilter
 
 const UINT VC4_BINNING_TILE_PIXELS  = 64;
 
+//
+// In multisample mode the tile buffer has 4 samples of each pixel of
+// smaller tiles. A full resolution tile dump has every sample of a tile
+// and is as large in either mode.
+//
+
+const UINT VC4_MAX_SAMPLES          = 4;
+const UINT VC4_MS_TILE_PIXELS       = 32;
+const UINT VC4_TILE_BUFFER_BYTES    = VC4_BINNING_TILE_PIXELS * VC4_BINNING_TILE_PIXELS * 4;
+
 //
 // Structure and constants related to tiled textures
 //
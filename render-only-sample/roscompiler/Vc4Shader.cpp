@@ -33,16 +33,28 @@ HRESULT Vc4ShaderStorage::Grow(uint32_t size)
     return S_OK;
 }
 
-void Vc4Shader::Emit_Prologue_VS()
+void Vc4Shader::Emit_Prologue_VS(uint8_t InputRegisterMask)
 {
     assert(this->uShaderType == D3D10_SB_VERTEX_SHADER);
 
-    VC4_ASSERT(cInput < 16); // VR_SETUP:NUM limitation, vpm only can read up to 16 values.
+    // Only inputs in InputRegisterMask are in VPM, the coordinate shader
+    // gets a reduced set of attributes.
+    uint8_t cRead = 0;
+    for (uint8_t iRegIndex = 0; iRegIndex < 8 * 4; iRegIndex++)
+    {
+        if (this->InputRegister[iRegIndex / 4][iRegIndex % 4].GetFlags().valid &&
+            (InputRegisterMask & (1 << (iRegIndex / 4))))
+        {
+            cRead++;
+        }
+    }
+
+    VC4_ASSERT(cRead < 16); // VR_SETUP:NUM limitation, vpm only can read up to 16 values.
 
     {
         Vc4Instruction Vc4Inst(vc4_load_immediate_32);
         Vc4Register vr_setup(VC4_QPU_ALU_REG_A, VC4_QPU_WADDR_VPMVCD_RD_SETUP);
-        Vc4Register value; value.SetImmediateI(MAKE_VR_SETUP(cInput, 1, true, false, VC4_QPU_32BIT_VECTOR, 0));
+        Vc4Register value; value.SetImmediateI(MAKE_VR_SETUP(cRead, 1, true, false, VC4_QPU_32BIT_VECTOR, 0));
         Vc4Inst.Vc4_a_LOAD32(vr_setup, value);
         Vc4Inst.Emit(CurrentStorage);
     }
@@ -55,11 +67,11 @@ void Vc4Shader::Emit_Prologue_VS()
         Vc4Inst.Emit(CurrentStorage);
     }
 
-    for (uint8_t iRegUsed = 0, iRegIndex = 0; iRegUsed < this->cInput; iRegIndex++)
+    for (uint8_t iRegUsed = 0, iRegIndex = 0; iRegUsed < cRead; iRegIndex++)
     {
         Vc4Instruction Vc4Inst;
         Vc4Register raX = this->InputRegister[iRegIndex / 4][iRegIndex % 4];
-        if (raX.GetFlags().valid)
+        if (raX.GetFlags().valid && (InputRegisterMask & (1 << (iRegIndex / 4))))
         {
             assert(raX.GetMux() == VC4_QPU_ALU_REG_A || raX.GetMux() == VC4_QPU_ALU_REG_B);
             Vc4Register vpm(raX.GetMux(), VC4_QPU_RADDR_VPM);
@@ -754,6 +766,22 @@ void Vc4Shader::Emit_Sample(CInstruction &Inst)
         }
     }
 
+    // Let the other thread run while the texture is fetched, the switch
+    // happens after 2 delay slots. Dropped if shader can't run threaded.
+    {
+        {
+            Vc4Instruction Vc4Inst;
+            Vc4Inst.Vc4_Sig(VC4_QPU_SIG_THREAD_SWITCH);
+            Vc4Inst.Emit(CurrentStorage);
+        }
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            Vc4Instruction Vc4Inst;
+            Vc4Inst.Emit(CurrentStorage);
+        }
+    }
+
     // Sample texture, result come up in r4.
     {
         Vc4Instruction Vc4Inst;
@@ -900,8 +928,8 @@ void Vc4Shader::HLSL_ParseDecl()
                 this->OutputRegister[0][0].flags.valid = true;
                 this->OutputRegister[0][0].flags.color = true;
                 this->OutputRegister[0][0].flags.packed = true; // RGBA components are packed in single register (see above WriteMask assert).
-                this->OutputRegister[0][0].addr = ROS_VC4_OUTPUT_REGISTER_FILE_START;
-                this->OutputRegister[0][0].mux = ROS_VC4_OUTPUT_REGISTER_FILE;
+                this->OutputRegister[0][0].addr = ROS_VC4_PS_OUTPUT_REGISTER;
+                this->OutputRegister[0][0].mux = ROS_VC4_PS_OUTPUT_REGISTER_FILE;
                 this->OutputRegister[0][0].swizzleMask = (uint8_t)(Inst.m_Operands[0].m_WriteMask & D3D10_SB_OPERAND_4_COMPONENT_MASK_MASK);
                 // TODO: more generic color channel swizzle support.
                 DXGI_FORMAT texFormat = UmdCompiler->GetRenderTargetFormat(0);
@@ -947,15 +975,24 @@ void Vc4Shader::HLSL_ParseDecl()
             // Temp register doesn't have swizzle mask, so assume all 4 components to be used.
             // TODO: AllocateRegister(); Currently temps are allocated at ra16~ra31.
             //       since currently reserve temp to ra16~31, so only upto 4 temps are allowed.
+            //       Pixel shader with up to 3 temps uses rb0~rb11, so it can run threaded.
             VC4_ASSERT(Inst.m_TempsDecl.NumTemps <= 4);
-            for (uint8_t i = 0; i < Inst.m_TempsDecl.NumTemps * 4; i++)
             {
-                VC4_ASSERT((ROS_VC4_TEMP_REGISTER_FILE_START + cTemp) <= ROS_VC4_TEMP_REGISTER_FILE_END);
-                this->TempRegister[i / 4][i % 4].flags.valid = true;
-                this->TempRegister[i / 4][i % 4].flags.temp = true;
-                this->TempRegister[i / 4][i % 4].addr = ROS_VC4_TEMP_REGISTER_FILE_START + cTemp++;
-                this->TempRegister[i / 4][i % 4].mux = ROS_VC4_TEMP_REGISTER_FILE;
-                this->TempRegister[i / 4][i % 4].swizzleMask = D3D10_SB_OPERAND_4_COMPONENT_MASK_X << (i % 4);
+                boolean bThreadedTemp = (this->uShaderType == D3D10_SB_PIXEL_SHADER) &&
+                                        ((Inst.m_TempsDecl.NumTemps * 4) <= (ROS_VC4_PS_TEMP_REGISTER_FILE_END - ROS_VC4_PS_TEMP_REGISTER_FILE_START + 1));
+                uint8_t TempStart = bThreadedTemp ? ROS_VC4_PS_TEMP_REGISTER_FILE_START : ROS_VC4_TEMP_REGISTER_FILE_START;
+                uint8_t TempEnd = bThreadedTemp ? ROS_VC4_PS_TEMP_REGISTER_FILE_END : ROS_VC4_TEMP_REGISTER_FILE_END;
+                uint8_t TempFile = bThreadedTemp ? ROS_VC4_PS_TEMP_REGISTER_FILE : ROS_VC4_TEMP_REGISTER_FILE;
+
+                for (uint8_t i = 0; i < Inst.m_TempsDecl.NumTemps * 4; i++)
+                {
+                    VC4_ASSERT((TempStart + cTemp) <= TempEnd);
+                    this->TempRegister[i / 4][i % 4].flags.valid = true;
+                    this->TempRegister[i / 4][i % 4].flags.temp = true;
+                    this->TempRegister[i / 4][i % 4].addr = TempStart + cTemp++;
+                    this->TempRegister[i / 4][i % 4].mux = TempFile;
+                    this->TempRegister[i / 4][i % 4].swizzleMask = D3D10_SB_OPERAND_4_COMPONENT_MASK_X << (i % 4);
+                }
             }
             break;
         case D3D10_SB_OPCODE_DCL_GLOBAL_FLAGS:
@@ -985,6 +1022,119 @@ void Vc4Shader::HLSL_ParseDecl()
     }
 }
 
+void Vc4Shader::HLSL_Find_CS_Inputs()
+{
+    assert(this->uShaderType == D3D10_SB_VERTEX_SHADER);
+
+    //
+    // CS only emits position, find the inputs it depends on. VS has no flow
+    // control, so dependencies are propagated backward from the position
+    // output until nothing changes. Registers are tracked as a whole since
+    // vertex attributes are fetched as a whole.
+    //
+    uint8_t PositionMask = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (this->OutputRegister[i][0].GetFlags().position)
+        {
+            PositionMask |= (1 << i);
+        }
+    }
+
+    ParserPositionToken Start = this->HLSLParser.GetCurrentToken();
+
+    uint8_t LiveOutput = PositionMask;
+    uint8_t LiveTemp = 0;
+    uint8_t LiveInput = 0;
+    boolean bChanged = true;
+
+    while (bChanged)
+    {
+        bChanged = false;
+
+        this->HLSLParser.SetCurrentToken(Start);
+
+        CInstruction Inst;
+        while (HLSL_GetShaderInstruction(this->HLSLParser, Inst))
+        {
+            if (Inst.m_NumOperands < 2)
+            {
+                continue;
+            }
+
+            const COperandBase &Dst = Inst.m_Operands[0];
+            uint8_t DstBit = (uint8_t)(1 << Dst.m_Index[0].m_RegIndex);
+            if (!(((Dst.m_Type == D3D10_SB_OPERAND_TYPE_OUTPUT) && (LiveOutput & DstBit)) ||
+                  ((Dst.m_Type == D3D10_SB_OPERAND_TYPE_TEMP) && (LiveTemp & DstBit))))
+            {
+                continue;
+            }
+
+            for (UINT i = 1; i < Inst.m_NumOperands; i++)
+            {
+                const COperandBase &Src = Inst.m_Operands[i];
+                if (Src.m_IndexDimension != D3D10_SB_OPERAND_INDEX_1D)
+                {
+                    continue;
+                }
+
+                uint8_t SrcBit = (uint8_t)(1 << Src.m_Index[0].m_RegIndex);
+                uint8_t *pLive = NULL;
+                switch (Src.m_Type)
+                {
+                case D3D10_SB_OPERAND_TYPE_INPUT:
+                    pLive = &LiveInput;
+                    break;
+                case D3D10_SB_OPERAND_TYPE_TEMP:
+                    pLive = &LiveTemp;
+                    break;
+                case D3D10_SB_OPERAND_TYPE_OUTPUT:
+                    pLive = &LiveOutput;
+                    break;
+                default:
+                    break;
+                }
+
+                if (pLive && !(*pLive & SrcBit))
+                {
+                    *pLive |= SrcBit;
+                    bChanged = true;
+                }
+            }
+        }
+    }
+
+    this->HLSLParser.SetCurrentToken(Start);
+
+    //
+    // The VCD needs at least one attribute array, fall back to all inputs
+    // when position doesn't depend on any.
+    //
+    if (LiveInput == 0)
+    {
+        LiveInput = 0xFF;
+    }
+
+    this->CSInputRegisterMask = LiveInput;
+
+    // Vertex elements map to declared input registers in order.
+    this->CSInputMask = 0;
+    for (uint8_t iReg = 0, iInput = 0; iReg < 8; iReg++)
+    {
+        if (this->InputRegister[iReg][0].GetFlags().valid ||
+            this->InputRegister[iReg][1].GetFlags().valid ||
+            this->InputRegister[iReg][2].GetFlags().valid ||
+            this->InputRegister[iReg][3].GetFlags().valid)
+        {
+            if (LiveInput & (1 << iReg))
+            {
+                this->CSInputMask |= (1 << iInput);
+            }
+            iInput++;
+        }
+    }
+}
+
 void Vc4Shader::HLSL_Link_PS()
 {
     assert(this->uShaderType == D3D10_SB_VERTEX_SHADER);
@@ -1033,7 +1183,16 @@ HRESULT Vc4Shader::Translate_VS()
     this->SetCurrentStorage(this->ShaderStorage, this->ShaderUniform);
     this->HLSL_ParseDecl();
     this->HLSL_Link_PS();  
-    this->Emit_Prologue_VS();
+    this->HLSL_Find_CS_Inputs();
+
+    // CS only reads the inputs position depends on.
+    this->SetCurrentStorage(this->ShaderStorageAux, this->ShaderUniformAux);
+    this->Emit_Prologue_VS(this->CSInputRegisterMask);
+
+    this->SetCurrentStorage(this->ShaderStorage, this->ShaderUniform);
+    this->Emit_Prologue_VS(0xFF);
+
+    uint32_t BodyOffset = this->ShaderStorage->GetUsedSize();
 
     {
         CInstruction Inst;
@@ -1071,7 +1230,7 @@ HRESULT Vc4Shader::Translate_VS()
         }
     }
 
-    this->ShaderStorageAux->CopyFrom(*this->ShaderStorage); // Copy VS to CS.
+    this->ShaderStorageAux->AppendFrom(*this->ShaderStorage, BodyOffset); // Copy VS body to CS.
     this->ShaderUniformAux->CopyFrom(*this->ShaderUniform); // Copy VS uniform to CS.
 
     this->Emit_ShaderOutput_VS(true);  // VS
@@ -1084,11 +1243,49 @@ HRESULT Vc4Shader::Translate_VS()
     return S_OK;
 }
 
+void Vc4Shader::HLSL_Find_Depth_Properties()
+{
+    assert(this->uShaderType == D3D10_SB_PIXEL_SHADER);
+
+    //
+    // Early-Z is only safe when the depth the fragment is tested with is
+    // interpolated and every fragment passing the test is written, the
+    // UMD picks the Z mode from these.
+    //
+    ParserPositionToken Start = this->HLSLParser.GetCurrentToken();
+
+    CInstruction Inst;
+    while (HLSL_GetShaderInstruction(this->HLSLParser, Inst))
+    {
+        if (Inst.m_OpCode == D3D10_SB_OPCODE_DISCARD)
+        {
+            this->bDiscard = true;
+        }
+
+        for (UINT i = 0; i < Inst.m_NumOperands; i++)
+        {
+            switch (Inst.m_Operands[i].m_Type)
+            {
+            case D3D10_SB_OPERAND_TYPE_OUTPUT_DEPTH:
+            case D3D11_SB_OPERAND_TYPE_OUTPUT_DEPTH_GREATER_EQUAL:
+            case D3D11_SB_OPERAND_TYPE_OUTPUT_DEPTH_LESS_EQUAL:
+                this->bDepthOutput = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    this->HLSLParser.SetCurrentToken(Start);
+}
+
 HRESULT Vc4Shader::Translate_PS()
 {
     assert(this->uShaderType == D3D10_SB_PIXEL_SHADER);
 
     this->SetCurrentStorage(this->ShaderStorage, this->ShaderUniform);
+    this->HLSL_Find_Depth_Properties();
     this->HLSL_ParseDecl();
     this->Emit_Prologue_PS();
 
@@ -1130,7 +1327,54 @@ HRESULT Vc4Shader::Translate_PS()
     }
         
     this->Emit_Epilogue();
+    this->Finalize_Threading_PS();
 
     return S_OK;
 }
 
+void Vc4Shader::Finalize_Threading_PS()
+{
+    assert(this->uShaderType == D3D10_SB_PIXEL_SHADER);
+
+    VC4_QPU_INSTRUCTION *pCode = CurrentStorage->GetStorage<VC4_QPU_INSTRUCTION>();
+    uint32_t cCode = CurrentStorage->GetUsedSize<VC4_QPU_INSTRUCTION>();
+
+    // Threading only pays off when there is texture fetch to wait on.
+    VC4_QPU_INSTRUCTION *pLastSwitch = NULL;
+    for (uint32_t i = 0; i < cCode; i++)
+    {
+        if (VC4_QPU_GET_SIG(pCode[i]) == VC4_QPU_SIG_THREAD_SWITCH)
+        {
+            pLastSwitch = &pCode[i];
+        }
+    }
+
+    if (pLastSwitch == NULL)
+    {
+        return;
+    }
+
+    VC4_QPU_SET_SIG(*pLastSwitch, VC4_QPU_SIG_LAST_THREAD_SWITCH);
+
+    const TCHAR *pError;
+    if (Vc4ThreadValidator::Validate(pCode, cCode, &pError))
+    {
+        this->bThreaded = true;
+        return;
+    }
+
+#if DBG
+    xprintf(TEXT("Pixel shader runs single threaded: %s\n"), pError);
+#endif // DBG
+
+    // Run single threaded, thread switch signals are dropped.
+    for (uint32_t i = 0; i < cCode; i++)
+    {
+        if ((VC4_QPU_GET_SIG(pCode[i]) == VC4_QPU_SIG_THREAD_SWITCH) ||
+            (VC4_QPU_GET_SIG(pCode[i]) == VC4_QPU_SIG_LAST_THREAD_SWITCH))
+        {
+            VC4_QPU_SET_SIG(pCode[i], VC4_QPU_SIG_NO_SIGNAL);
+        }
+    }
+}
+
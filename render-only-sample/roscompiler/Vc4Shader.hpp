@@ -109,6 +109,17 @@ public:
         this->cUsed = Storage.GetUsedSize();
         this->pCurrent = this->pStorage + this->cUsed;
     }
+
+    void AppendFrom(Vc4ShaderStorage &Storage, uint32_t Offset)
+    {
+        assert(Offset <= Storage.GetUsedSize());
+        uint32_t Size = Storage.GetUsedSize() - Offset;
+        if (Size)
+        {
+            VC4_THROW(this->Ensure(Size)); // throw RosCompilerException on failure.
+            this->Store(Storage.GetStorage() + Offset, Size);
+        }
+    }
     
     BYTE *GetStorage()
     {
@@ -202,11 +213,16 @@ public:
         ShaderStorageAux(NULL),
         ShaderUniformAux(NULL),
         cInput(0),
+        CSInputRegisterMask(0),
+        CSInputMask(0),
         cOutput(0),
         cTemp(0),
         cSampler(0),
         cConstants(0),
-        cResources(0)
+        cResources(0),
+        bThreaded(false),
+        bDiscard(false),
+        bDepthOutput(false)
     { 
         memset(this->InputRegister, 0, sizeof(this->InputRegister));
         memset(this->OutputRegister, 0, sizeof(this->OutputRegister));
@@ -267,6 +283,30 @@ public:
         return cOutput;
     }
 
+    // Bit i is set when the coordinate shader reads the i-th declared input.
+    uint32_t GetCoordinateShaderInputMask()
+    {
+        return CSInputMask;
+    }
+
+    // Pixel shader can run as 2 threads per QPU.
+    boolean IsThreaded()
+    {
+        return bThreaded;
+    }
+
+    // Pixel shader discards fragments.
+    boolean UsesDiscard()
+    {
+        return bDiscard;
+    }
+
+    // Pixel shader writes oDepth.
+    boolean OutputsDepth()
+    {
+        return bDepthOutput;
+    }
+
     HRESULT Translate_VS(); // vertex shader
     HRESULT Translate_PS(); // Fragmaent shader
 
@@ -300,12 +340,15 @@ private:
 
     void HLSL_ParseDecl();
     void HLSL_Link_PS();
+    void HLSL_Find_CS_Inputs();
+    void HLSL_Find_Depth_Properties();
 
-    void Emit_Prologue_VS();
+    void Emit_Prologue_VS(uint8_t InputRegisterMask);
     void Emit_Prologue_PS();
     void Emit_Epilogue();
 
     void Emit_Blending_PS();
+    void Finalize_Threading_PS();
     void Emit_ShaderOutput_VS(boolean bVS);
 
     void Emit_Mad(CInstruction &Inst);
@@ -691,6 +734,8 @@ private:
     // Register map
     uint8_t cInput;
     Vc4Register InputRegister[8][4];
+    uint8_t CSInputRegisterMask; // Input registers (vN) read by coordinate shader.
+    uint8_t CSInputMask; // Same as above, indexed by declaration order.
 
     uint8_t cOutput;
     Vc4Register OutputRegister[8][4];
@@ -700,6 +745,10 @@ private:
 
      uint32_t ResourceDimension[16];
 
+    boolean bThreaded;
+    boolean bDiscard;
+    boolean bDepthOutput;
+
     // TEMPORARY Register Usage Map
     //
     // r0 - scratch. 
@@ -720,15 +769,23 @@ private:
 #define ROS_VC4_TEMP_REGISTER_FILE_START    16
 #define ROS_VC4_TEMP_REGISTER_FILE_END      31
     C_ASSERT((ROS_VC4_TEMP_REGISTER_FILE_END - ROS_VC4_TEMP_REGISTER_FILE_START + 1) == (4*4));
-    // rb16 ~ rb31 : Scratch (15 floats)
-#define ROS_VC4_SCRATCH_REGISTER_FILE       VC4_QPU_ALU_REG_B
-#define ROS_VC4_SCRATCH_REGISTER_FILE_START 0
-#define ROS_VC4_SCRATCH_REGISTER_FILE_END   14
+    // rb0 ~ rb14  : Pixel shader temps and colour output, see below
     // rb15        : Reserved - Z (in pixel shader only)
-    // rb0 ~ rb14  : Output (up to 16 floats)
+    // rb16 ~ rb31 : Output (up to 16 floats)
 #define ROS_VC4_OUTPUT_REGISTER_FILE        VC4_QPU_ALU_REG_B
 #define ROS_VC4_OUTPUT_REGISTER_FILE_START  16
 #define ROS_VC4_OUTPUT_REGISTER_FILE_END    31 
+
+    // Pixel shader, threaded mode only allows registers 0~15 of each file:
+    // rb0 ~ rb11  : Temp (4x3, up to 3 temps, otherwise temps are at ra16 ~ ra31)
+    // rb14        : Output colour
+#define ROS_VC4_PS_TEMP_REGISTER_FILE       VC4_QPU_ALU_REG_B
+#define ROS_VC4_PS_TEMP_REGISTER_FILE_START 0
+#define ROS_VC4_PS_TEMP_REGISTER_FILE_END   11
+#define ROS_VC4_PS_OUTPUT_REGISTER_FILE     VC4_QPU_ALU_REG_B
+#define ROS_VC4_PS_OUTPUT_REGISTER          14
+    C_ASSERT(ROS_VC4_PS_TEMP_REGISTER_FILE_END < ROS_VC4_PS_OUTPUT_REGISTER);
+    C_ASSERT(ROS_VC4_PS_OUTPUT_REGISTER < 15);
 };
 
 #endif // VC4
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "precomp.h"
+#include "Vc4Validate.hpp"
+
+#if VC4
+
+boolean Vc4ThreadValidator::Validate(const VC4_QPU_INSTRUCTION* pShader, ULONG cInstruction, const TCHAR** ppError)
+{
+    const TCHAR* pError = NULL;
+    uint32_t validAccumulators = 0x3f; // r0~r5, content before the first switch is the shader's own.
+    ULONG switchAt = MAXULONG;
+    boolean bLastSwitch = false;
+
+    for (ULONG i = 0; (i < cInstruction) && (pError == NULL); i++)
+    {
+        VC4_QPU_INSTRUCTION Instruction = pShader[i];
+        uint32_t sig = (uint32_t)VC4_QPU_GET_SIG(Instruction);
+
+        // Thread switch takes effect after 2 delay slots.
+        if (i == switchAt)
+        {
+            validAccumulators = 0;
+            switchAt = MAXULONG;
+        }
+
+        uint32_t waddr[2] = { (uint32_t)VC4_QPU_GET_WADDR_ADD(Instruction), (uint32_t)VC4_QPU_GET_WADDR_MUL(Instruction) };
+        uint32_t raddr_a = (uint32_t)VC4_QPU_GET_RADDR_A(Instruction);
+        uint32_t raddr_b = (uint32_t)VC4_QPU_GET_RADDR_B(Instruction);
+
+        // Register file accesses must stay in the thread's half.
+        for (uint8_t j = 0; j < ARRAYSIZE(waddr); j++)
+        {
+            if (IsRegisterFileAddress(waddr[j]) && (waddr[j] >= VC4_QPU_THREADED_REGISTER_COUNT))
+            {
+                pError = TEXT("write to register outside of thread's register file half");
+            }
+        }
+
+        if (sig < VC4_QPU_SIG_LOAD_IMMEDIATE)
+        {
+            if (IsRegisterFileAddress(raddr_a) && (raddr_a >= VC4_QPU_THREADED_REGISTER_COUNT))
+            {
+                pError = TEXT("read from register outside of thread's register file half");
+            }
+
+            if ((sig != VC4_QPU_SIG_ALU_WITH_RADDR_B) &&
+                IsRegisterFileAddress(raddr_b) && (raddr_b >= VC4_QPU_THREADED_REGISTER_COUNT))
+            {
+                pError = TEXT("read from register outside of thread's register file half");
+            }
+
+            // Accumulator reads.
+            uint32_t mux[4] = { 0 };
+            uint8_t cMux = 0;
+            if (!VC4_QPU_IS_OPCODE_ADD_NOP(Instruction))
+            {
+                mux[cMux++] = (uint32_t)VC4_QPU_GET_ADD_A(Instruction);
+                mux[cMux++] = (uint32_t)VC4_QPU_GET_ADD_B(Instruction);
+            }
+            if (!VC4_QPU_IS_OPCODE_MUL_NOP(Instruction))
+            {
+                mux[cMux++] = (uint32_t)VC4_QPU_GET_MUL_A(Instruction);
+                mux[cMux++] = (uint32_t)VC4_QPU_GET_MUL_B(Instruction);
+            }
+
+            for (uint8_t j = 0; j < cMux; j++)
+            {
+                if ((mux[j] <= VC4_QPU_ALU_R5) && !(validAccumulators & (1 << mux[j])))
+                {
+                    pError = TEXT("accumulator read across thread switch");
+                }
+            }
+
+            // Varying read loads C coefficient to r5.
+            if ((raddr_a == VC4_QPU_RADDR_VERYING) || (raddr_b == VC4_QPU_RADDR_VERYING))
+            {
+                validAccumulators |= (1 << VC4_QPU_ALU_R5);
+            }
+        }
+
+        // Accumulator writes.
+        for (uint8_t j = 0; j < ARRAYSIZE(waddr); j++)
+        {
+            if ((waddr[j] >= VC4_QPU_WADDR_ACC0) && (waddr[j] <= VC4_QPU_WADDR_ACC3))
+            {
+                validAccumulators |= (1 << (waddr[j] - VC4_QPU_WADDR_ACC0));
+            }
+            else if (waddr[j] == VC4_QPU_WADDR_ACC5)
+            {
+                validAccumulators |= (1 << VC4_QPU_ALU_R5);
+            }
+            else if ((waddr[j] >= VC4_QPU_WADDR_SFU_RECIP) && (waddr[j] <= VC4_QPU_WADDR_SFU_LOG))
+            {
+                validAccumulators |= (1 << VC4_QPU_ALU_R4);
+            }
+        }
+
+        switch (sig)
+        {
+        case VC4_QPU_SIG_LOAD_TMU0:
+        case VC4_QPU_SIG_LOAD_TMU1:
+        case VC4_QPU_SIG_COLOR_LOAD:
+        case VC4_QPU_SIG_ALPAH_MASK_LOAD:
+            validAccumulators |= (1 << VC4_QPU_ALU_R4);
+            break;
+        case VC4_QPU_SIG_THREAD_SWITCH:
+        case VC4_QPU_SIG_LAST_THREAD_SWITCH:
+            if (bLastSwitch)
+            {
+                pError = TEXT("thread switch after last thread switch");
+            }
+            bLastSwitch = (sig == VC4_QPU_SIG_LAST_THREAD_SWITCH);
+            switchAt = i + 3;
+            break;
+        case VC4_QPU_SIG_PROGRAM_END:
+        case VC4_QPU_SIG_COLOR_LOAD_AND_PROGRAM_END:
+            if (!bLastSwitch)
+            {
+                pError = TEXT("program end without last thread switch");
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (ppError)
+    {
+        *ppError = pError;
+    }
+
+    return (pError == NULL);
+}
+
+#endif // VC4
@@ -0,0 +1,27 @@
+#pragma once
+#include "..\roscommon\Vc4Qpu.h"
+
+#if VC4
+
+//
+// In threaded mode 2 fragment shader threads share a QPU. Each thread only
+// sees registers 0~15 of each register file, accumulators (r0~r5) aren't
+// preserved across a thread switch, and the last thread switch must be
+// signalled with 'lthrsw' so the thread can access the tile buffer.
+//
+#define VC4_QPU_THREADED_REGISTER_COUNT 16
+
+class Vc4ThreadValidator
+{
+public:
+    // Returns false with the reason in *ppError when the code can't run threaded.
+    static boolean Validate(const VC4_QPU_INSTRUCTION* pShader, ULONG cInstruction, const TCHAR** ppError = NULL);
+
+private:
+    static boolean IsRegisterFileAddress(uint32_t addr)
+    {
+        return addr < 32;
+    }
+};
+
+#endif // VC4
@@ -80,7 +80,11 @@ RosCompiler::RosCompiler(D3D10_SB_TOKENIZED_PROGRAM_TYPE ProgramType,
     m_numPatchConstantSignatureEntries(numPatchConstantSignatureEntries),
     m_pPatchConstantSignatureEntries(pPatchConstantSignatureEntries),
     m_cShaderInput(0),
-    m_cShaderOutput(0)
+    m_cShaderOutput(0),
+    m_CoordinateShaderInputMask(0),
+    m_bThreaded(false),
+    m_bDiscard(false),
+    m_bDepthOutput(false)
 {
 }
 
@@ -142,6 +146,7 @@ HRESULT RosCompiler::Compile()
         {
             m_cShaderInput = Vc4ShaderCompiler.GetInputCount();
             m_cShaderOutput = Vc4ShaderCompiler.GetOutputCount();
+            m_CoordinateShaderInputMask = Vc4ShaderCompiler.GetCoordinateShaderInputMask();
 
 #if DBG
             // Disassemble h/w shader.
@@ -175,6 +180,9 @@ HRESULT RosCompiler::Compile()
         {
             m_cShaderInput = Vc4ShaderCompiler.GetInputCount();
             m_cShaderOutput = Vc4ShaderCompiler.GetOutputCount();
+            m_bThreaded = Vc4ShaderCompiler.IsThreaded() ? true : false;
+            m_bDiscard = Vc4ShaderCompiler.UsesDiscard() ? true : false;
+            m_bDepthOutput = Vc4ShaderCompiler.OutputsDepth() ? true : false;
 
 #if DBG
             // Disassemble h/w shader.
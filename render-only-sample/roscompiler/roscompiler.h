@@ -10,6 +10,7 @@
 #include "Vc4Disasm.hpp"
 #include "Vc4Emit.hpp"
 #include "Vc4Shader.hpp"
+#include "Vc4Validate.hpp"
 #endif // VC4
 
 class RosUmdDevice;
@@ -203,6 +204,31 @@ public:
         return m_cShaderOutput;
     }
 
+    // Bit i is set when the coordinate shader reads the i-th shader input,
+    // other vertex attributes needn't be fetched for binning.
+    UINT GetCoordinateShaderInputMask()
+    {
+        return m_CoordinateShaderInputMask;
+    }
+
+    // Pixel shader qualifies for 2 threads per QPU.
+    bool IsThreaded()
+    {
+        return m_bThreaded;
+    }
+
+    // Pixel shader may discard fragments.
+    bool UsesDiscard()
+    {
+        return m_bDiscard;
+    }
+
+    // Pixel shader writes the depth of fragments.
+    bool OutputsDepth()
+    {
+        return m_bDepthOutput;
+    }
+
 private:
 
     void Disassemble_HLSL() 
@@ -264,6 +290,10 @@ private:
 
     UINT m_cShaderInput;
     UINT m_cShaderOutput;
+    UINT m_CoordinateShaderInputMask;
+    bool m_bThreaded;
+    bool m_bDiscard;
+    bool m_bDepthOutput;
 
 #if VC4
     //
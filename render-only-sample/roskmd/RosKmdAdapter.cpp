@@ -14,6 +14,7 @@
 #include "RosKmdGlobal.h"
 #include "RosKmdUtil.h"
 #include "RosGpuCommand.h"
+#include "RosEscape.h"
 #include "RosKmdAcpi.h"
 #include "RosKmdUtil.h"
 #include "Vc4Hw.h"
@@ -31,7 +32,7 @@ void RosKmAdapter::operator delete(void * ptr)
 }
 
 RosKmAdapter::RosKmAdapter(IN_CONST_PDEVICE_OBJECT PhysicalDeviceObject, OUT_PPVOID MiniportDeviceContext) :
-    m_display(PhysicalDeviceObject, m_DxgkInterface, m_DxgkStartInfo, m_deviceInfo)
+    m_display(PhysicalDeviceObject, m_DxgkInterface, m_DxgkStartInfo, m_deviceInfo, m_trace)
 {
     m_magic = kMagic;
     m_pPhysicalDevice = PhysicalDeviceObject;
@@ -50,6 +51,8 @@ RosKmAdapter::RosKmAdapter(IN_CONST_PDEVICE_OBJECT PhysicalDeviceObject, OUT_PPV
 
     m_flags.m_value = 0;
 
+    m_traceSubmissions = 0;
+
 #if VC4
 
 #if GPU_CACHE_WORKAROUND
@@ -58,6 +61,18 @@ RosKmAdapter::RosKmAdapter(IN_CONST_PDEVICE_OBJECT PhysicalDeviceObject, OUT_PPV
 
 #endif
 
+    RtlZeroMemory(m_numApertureBounce, sizeof(m_numApertureBounce));
+    m_apertureBytesBounced = 0;
+
+    m_numDmaBuffersSinceFlush = 0;
+
+    m_bytesCleaned = 0;
+    m_fullCacheCleans = 0;
+    m_gpuCacheFlushes = 0;
+
+    m_tileAllocationMemorySize = 0;
+    m_binnerOverspillPoolPhysicalAddress = 0;
+
     m_busAddressOffset = 0;
 
 #endif
@@ -132,15 +147,24 @@ void RosKmAdapter::DoWork(void)
 
     while (!done)
     {
+        //
+        // Wakes up periodically while the GPU is busy, for the hang check
+        // of the hardware queue
+        //
+
+        LARGE_INTEGER   timeOut;
+
+        timeOut.QuadPart = -((LONGLONG)kGpuBusyCheckIntervalMs) * 1000 * 10;
+
         NTSTATUS status = KeWaitForSingleObject(
             &m_workerThreadEvent,
             Executive,
             KernelMode,
             FALSE,
-            NULL);
+            IsGpuIdle() ? NULL : &timeOut);
 
         status;
-        NT_ASSERT(status == STATUS_SUCCESS);
+        NT_ASSERT((status == STATUS_SUCCESS) || (status == STATUS_TIMEOUT));
 
         if (m_workerExit)
         {
@@ -148,6 +172,8 @@ void RosKmAdapter::DoWork(void)
             continue;
         }
 
+        RetireHwDmaBuffers();
+
         for (;;)
         {
             ROSDMABUFSUBMISSION *   pDmaBufSubmission = DequeueDmaBuffer(&m_dmaBufQueueLock);
@@ -158,15 +184,20 @@ void RosKmAdapter::DoWork(void)
 
             ROSDMABUFINFO * pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
 
+            Trace(ROS_TRACE_RUN, ROS_TRACE_BEGIN, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+            bool    bCompleted = true;
+
             if (pDmaBufInfo->m_DmaBufState.m_bPaging)
             {
                 //
-                // Run paging buffer in software
+                // Run paging buffer in software, once the DMA buffers
+                // before it no longer use the memory it moves
                 //
 
-                ProcessPagingBuffer(pDmaBufSubmission);
+                WaitForGpuIdle();
 
-                NotifyDmaBufCompletion(pDmaBufSubmission);
+                ProcessPagingBuffer(pDmaBufSubmission);
             }
             else
             {
@@ -174,16 +205,53 @@ void RosKmAdapter::DoWork(void)
                 // Process render DMA buffer
                 //
 
-                ProcessRenderBuffer(pDmaBufSubmission);
+                bCompleted = ProcessRenderBuffer(pDmaBufSubmission);
+
+#if VC4
 
+                if (bCompleted && pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+                {
+                    ReportPerfCounters(pDmaBufInfo);
+                }
+
+#endif
+            }
+
+            Trace(ROS_TRACE_RUN, ROS_TRACE_END, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+            if (bCompleted)
+            {
                 NotifyDmaBufCompletion(pDmaBufSubmission);
+
+                FreeDmaBufSubmission(pDmaBufSubmission);
             }
+        }
+
+        SubmitHeldDmaBuffers();
+
+#if VC4
+
+        //
+        // The driver heap holds the aperture copies of the queued DMA
+        // buffers, it is only compacted while the GPU is idle
+        //
 
-            ExInterlockedInsertTailList(&m_dmaBufSubmissionFree, &pDmaBufSubmission->m_QueueEntry, &m_dmaBufQueueLock);
+        if (IsGpuIdle())
+        {
+            CompactDriverHeap();
         }
+
+#endif
     }
 }
 
+void
+RosKmAdapter::FreeDmaBufSubmission(
+    ROSDMABUFSUBMISSION *   pDmaBufSubmission)
+{
+    ExInterlockedInsertTailList(&m_dmaBufSubmissionFree, &pDmaBufSubmission->m_QueueEntry, &m_dmaBufQueueLock);
+}
+
 ROSDMABUFSUBMISSION *
 RosKmAdapter::DequeueDmaBuffer(
     KSPIN_LOCK *pDmaBufQueueLock)
@@ -238,6 +306,8 @@ RosKmAdapter::ProcessPagingBuffer(
             {
                 *ptr = pPagingBuffer->Fill.FillPattern;
             }
+
+            KeInvalidateRangeAllCaches(startAddress, (ULONG)pPagingBuffer->Fill.FillSize);
         }
         break;
         case DXGK_OPERATION_TRANSFER:
@@ -274,39 +344,706 @@ RosKmAdapter::ProcessPagingBuffer(
             {
                 NT_ASSERT(pPagingBuffer->Transfer.Destination.SegmentId == 0);
 
-                pMdlToRestore = pPagingBuffer->Transfer.Destination.pMdl;
-                savedMdlFlags = pMdlToRestore->MdlFlags;
+                pMdlToRestore = pPagingBuffer->Transfer.Destination.pMdl;
+                savedMdlFlags = pMdlToRestore->MdlFlags;
+
+                pDestination = (PBYTE)MmGetSystemAddressForMdlSafe(pPagingBuffer->Transfer.Destination.pMdl, HighPagePriority);
+
+                pKmAddrToUnmap = pDestination;
+
+                // Adjust the destination address by MdlOffset
+                pDestination += (pPagingBuffer->Transfer.MdlOffset*PAGE_SIZE);
+            }
+
+            if (pSource && pDestination)
+            {
+                //
+                // The GPU may have written the source, the GPU reads the
+                // destination
+                //
+
+                if (pPagingBuffer->Transfer.Source.SegmentId == ROSD_SEGMENT_VIDEO_MEMORY)
+                {
+                    KeInvalidateRangeAllCaches(pSource, (ULONG)pPagingBuffer->Transfer.TransferSize);
+                }
+
+                RtlCopyMemory(pDestination, pSource, pPagingBuffer->Transfer.TransferSize);
+
+                if (pPagingBuffer->Transfer.Destination.SegmentId == ROSD_SEGMENT_VIDEO_MEMORY)
+                {
+                    KeInvalidateRangeAllCaches(pDestination, (ULONG)pPagingBuffer->Transfer.TransferSize);
+                }
+            }
+            else
+            {
+                // TODO[indyz]: Propagate the error back to runtime
+                m_ErrorHit.m_PagingFailure = 1;
+            }
+
+            // Restore the state of the Mdl (for source or destionation)
+            if ((0 == (savedMdlFlags & MDL_MAPPED_TO_SYSTEM_VA)) && pKmAddrToUnmap)
+            {
+                MmUnmapLockedPages(pKmAddrToUnmap, pMdlToRestore);
+            }
+        }
+        break;
+
+        default:
+            NT_ASSERT(false);
+        }
+    }
+}
+
+#if VC4
+
+NTSTATUS
+RosKmAdapter::InitDriverHeap()
+{
+    m_driverHeap.Init(
+        (UINT)RosKmdGlobal::s_videoMemorySize - m_localVidMemSegmentSize,
+        kPageSize,
+        m_driverHeapBlocks,
+        kDriverHeapMaxBlocks,
+        m_driverHeapHandles,
+        kDriverHeapMaxHandles,
+        m_driverHeapSlabs,
+        kDriverHeapMaxSlabs);
+
+    m_binnerMemory.Init(
+        VC4_BINNER_OVERSPILL_BLOCK_SIZE,
+        VC4_BINNER_OVERSPILL_POOL_SIZE / VC4_BINNER_OVERSPILL_BLOCK_SIZE,
+        VC4_TILE_ALLOCATION_MEMORY_MIN_SIZE,
+        VC4_TILE_ALLOCATION_MEMORY_SIZE);
+
+    m_tileAllocationMemorySize = m_binnerMemory.GetTargetSize(0);
+
+    //
+    // The V3D holds the overspill block it was given between DMA buffers,
+    // the pool must not move
+    //
+
+    if (!m_driverHeap.Allocate(VC4_RENDERING_CTRL_LIST_POOL_SIZE, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &m_hControlListPool) ||
+        !m_driverHeap.Allocate(m_tileAllocationMemorySize, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &m_hTileAllocPool) ||
+        !m_driverHeap.Allocate(VC4_TILE_STATE_DATA_ARRAY_SIZE, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &m_hTileStatePool) ||
+        !m_driverHeap.Allocate(VC4_BINNER_OVERSPILL_POOL_SIZE, kPageSize, ROS_SEGMENT_ALLOC_PINNED, &m_hBinnerOverspillPool))
+    {
+        ROS_LOG_ERROR(
+            "Failed to allocate control list and binner memory from the driver heap. (size=%d)",
+            (UINT)RosKmdGlobal::s_videoMemorySize - m_localVidMemSegmentSize);
+        return STATUS_NO_MEMORY;
+    }
+
+    UpdateDriverHeapAddresses();
+
+    return STATUS_SUCCESS;
+}
+
+void
+RosKmAdapter::UpdateDriverHeapAddresses()
+{
+    NT_ASSERT(0 == RosKmdGlobal::s_videoMemoryPhysicalAddress.HighPart);
+
+    UINT    heapPhysicalAddress = RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart + m_localVidMemSegmentSize;
+    UINT    controlListPoolOffset = m_driverHeap.GetOffset(m_hControlListPool);
+
+    m_pControlListPool = ((PBYTE)RosKmdGlobal::s_pVideoMemory) + m_localVidMemSegmentSize + controlListPoolOffset;
+
+    m_controlListPoolPhysicalAddress = heapPhysicalAddress + controlListPoolOffset;
+    m_tileAllocPoolPhysicalAddress = heapPhysicalAddress + m_driverHeap.GetOffset(m_hTileAllocPool);
+    m_tileStatePoolPhysicalAddress = heapPhysicalAddress + m_driverHeap.GetOffset(m_hTileStatePool);
+    m_binnerOverspillPoolPhysicalAddress = heapPhysicalAddress + m_driverHeap.GetOffset(m_hBinnerOverspillPool);
+
+    m_pRenderingControlList = m_pControlListPool;
+    m_renderingControlListPhysicalAddress = m_controlListPoolPhysicalAddress;
+
+    m_tileAllocationMemoryPhysicalAddress = m_tileAllocPoolPhysicalAddress;
+    m_tileStateDataArrayPhysicalAddress = m_tileStatePoolPhysicalAddress;
+}
+
+//
+// Must only be called while the GPU is idle, the hardware holds no
+// reference to the driver heap between DMA buffers
+//
+
+void
+RosKmAdapter::CompactDriverHeap()
+{
+    RosKmdDriverHeapMover   mover(((PBYTE)RosKmdGlobal::s_pVideoMemory) + m_localVidMemSegmentSize);
+
+    UINT    bytesMoved = m_driverHeap.Compact(&mover, kDriverHeapCompactionBudget);
+
+    if (bytesMoved)
+    {
+        ROS_LOG_TRACE("Compacted driver heap. (bytesMoved=%d)", bytesMoved);
+
+        UpdateDriverHeapAddresses();
+    }
+}
+
+//
+// Sizes the initial tile allocation memory of the DMA buffer by the usage
+// of the recent frames and patches its Tile Binning Mode Config. It is
+// only reallocated while the GPU is idle, the GPU is waited for when the
+// initial blocks of the render target don't fit.
+//
+
+UINT
+RosKmAdapter::PrepareTileAllocationMemory(
+    ROSDMABUFINFO * pDmaBufInfo)
+{
+    if (!pDmaBufInfo->m_DmaBufState.m_bTileAllocMemRef)
+    {
+        return m_tileAllocationMemorySize;
+    }
+
+    VC4TileBinningModeConfig *  pConfig = (VC4TileBinningModeConfig *)(
+        pDmaBufInfo->m_pDmaBuffer +
+        pDmaBufInfo->m_TileAllocMemPatchOffset -
+        offsetof(VC4TileBinningModeConfig, TileAllocationMemoryAddress));
+
+    UINT    tileBlocksSize = pConfig->WidthInTiles * pConfig->HeightInTiles * VC4_TILE_ALLOCATION_BLOCK_SIZE;
+    UINT    size;
+
+    if (m_binnerMemory.NeedsResize(m_tileAllocationMemorySize, tileBlocksSize, &size))
+    {
+        if (tileBlocksSize >= m_tileAllocationMemorySize)
+        {
+            WaitForGpuIdle();
+        }
+
+        if (IsGpuIdle())
+        {
+            ResizeTileAllocationMemory(size);
+        }
+    }
+
+    pConfig->TileAllocationMemoryAddress = m_tileAllocationMemoryPhysicalAddress + m_busAddressOffset;
+    pConfig->TileAllocationMemorySize = m_tileAllocationMemorySize;
+
+    return m_tileAllocationMemorySize;
+}
+
+//
+// Must only be called while the GPU is idle
+//
+
+bool
+RosKmAdapter::ResizeTileAllocationMemory(
+    UINT    size)
+{
+    NT_ASSERT(IsGpuIdle());
+
+    UINT    oldSize = m_tileAllocationMemorySize;
+    bool    bResized;
+
+    m_driverHeap.Free(m_hTileAllocPool);
+
+    bResized = m_driverHeap.Allocate(size, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &m_hTileAllocPool);
+
+    if (bResized)
+    {
+        m_tileAllocationMemorySize = size;
+
+        ROS_LOG_TRACE(
+            "Resized tile allocation memory. (oldSize=%d, size=%d, peakUsage=%d, overflows=%d)",
+            oldSize,
+            size,
+            m_binnerMemory.GetPeakUsage(),
+            m_binnerMemory.GetOverflowCount());
+    }
+    else
+    {
+        ROS_LOG_ERROR(
+            "Failed to resize tile allocation memory. (oldSize=%d, size=%d)",
+            oldSize,
+            size);
+
+        //
+        // The block just freed holds the old size
+        //
+
+        bool    bAllocated = m_driverHeap.Allocate(oldSize, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &m_hTileAllocPool);
+
+        NT_ASSERT(bAllocated);
+        UNREFERENCED_PARAMETER(bAllocated);
+    }
+
+    UpdateDriverHeapAddresses();
+
+    return bResized;
+}
+
+//
+// Returns the physical address of an aperture reference the GPU can read in
+// place. Otherwise the reference is recorded in the DMA buffer, it is copied
+// to the driver heap and patched when the DMA buffer runs. A DMA buffer with
+// more references than it can record doesn't run.
+//
+
+bool
+RosKmAdapter::TranslateApertureReference(
+    ROSDMABUFINFO *                     pDmaBufInfo,
+    const RosKmdAllocation *            pRosKmdAllocation,
+    const DXGK_ALLOCATIONLIST *         pAllocation,
+    const D3DDDI_PATCHLOCATIONLIST *    pPatch,
+    UINT *                              pPhysicalAddress)
+{
+    UINT    apertureAddress = pAllocation->PhysicalAddress.LowPart;
+    UINT    size = pRosKmdAllocation->m_hwSizeBytes;
+
+    NT_ASSERT(pPatch->AllocationOffset < size);
+
+    //
+    // The GPU may read up to the end of the allocation from the patched
+    // address
+    //
+
+    bool    bInPlace = m_aperturePageTable.Translate(
+        apertureAddress + pPatch->AllocationOffset,
+        size - pPatch->AllocationOffset,
+        pPhysicalAddress);
+
+    //
+    // Earlier patching of the DMA buffer may have seen other pages
+    //
+
+    UINT    i;
+
+    for (i = 0; i < pDmaBufInfo->m_NumApertureBounce; i++)
+    {
+        if (pDmaBufInfo->m_ApertureBounce[i].m_PatchOffset == pPatch->PatchOffset)
+        {
+            break;
+        }
+    }
+
+    if (bInPlace)
+    {
+        if (i < pDmaBufInfo->m_NumApertureBounce)
+        {
+            pDmaBufInfo->m_NumApertureBounce--;
+            pDmaBufInfo->m_ApertureBounce[i] = pDmaBufInfo->m_ApertureBounce[pDmaBufInfo->m_NumApertureBounce];
+        }
+
+        return true;
+    }
+
+    if (i == VC4_MAX_APERTURE_BOUNCE)
+    {
+        ROS_LOG_ERROR(
+            "Too many references to aperture allocations that aren't physically contiguous. (pDmaBufInfo=0x%p)",
+            pDmaBufInfo);
+
+        m_ErrorHit.m_ApertureBounceFailure = 1;
+
+        pDmaBufInfo->m_DmaBufState.m_bApertureBounceFailed = 1;
+
+        return false;
+    }
+
+    if (i == pDmaBufInfo->m_NumApertureBounce)
+    {
+        pDmaBufInfo->m_NumApertureBounce++;
+    }
+
+    ROSAPERTUREBOUNCE * pBounce = &pDmaBufInfo->m_ApertureBounce[i];
+
+    pBounce->m_PatchOffset = pPatch->PatchOffset;
+    pBounce->m_ApertureAddress = apertureAddress;
+    pBounce->m_AllocationOffset = pPatch->AllocationOffset;
+    pBounce->m_Size = size;
+
+    return false;
+}
+
+bool
+RosKmAdapter::CopyFromAperture(
+    BYTE *  pDestination,
+    UINT    apertureAddress,
+    UINT    size)
+{
+    UINT    page = m_aperturePageTable.GetPageIndex(apertureAddress);
+    UINT    pageOffset = apertureAddress & (kPageSize - 1);
+
+    while (size)
+    {
+        //
+        // Map each run of pages backed by consecutive pages of one MDL once
+        //
+
+        PMDL    pMdl = m_apertureMdls[page];
+        UINT    mdlPage = m_apertureMdlPages[page];
+        UINT    runPages = 1;
+
+        if (NULL == pMdl)
+        {
+            return false;
+        }
+
+        while ((pageOffset + size > runPages*kPageSize) &&
+               (m_apertureMdls[page + runPages] == pMdl) &&
+               (m_apertureMdlPages[page + runPages] == mdlPage + runPages))
+        {
+            runPages++;
+        }
+
+        UINT    copySize = min(size, runPages*kPageSize - pageOffset);
+
+        CSHORT  savedMdlFlags = pMdl->MdlFlags;
+        PBYTE   pSource = (PBYTE)MmGetSystemAddressForMdlSafe(pMdl, HighPagePriority);
+
+        if (NULL == pSource)
+        {
+            return false;
+        }
+
+        RtlCopyMemory(pDestination, pSource + mdlPage*kPageSize + pageOffset, copySize);
+
+        // Restore the state of the Mdl
+        if (0 == (savedMdlFlags & MDL_MAPPED_TO_SYSTEM_VA))
+        {
+            MmUnmapLockedPages(pSource, pMdl);
+        }
+
+        pDestination += copySize;
+        size -= copySize;
+
+        page += runPages;
+        pageOffset = 0;
+    }
+
+    return true;
+}
+
+bool
+RosKmAdapter::CleanAperture(
+    UINT    apertureAddress,
+    UINT    size)
+{
+    UINT    page = m_aperturePageTable.GetPageIndex(apertureAddress);
+    UINT    pageOffset = apertureAddress & (kPageSize - 1);
+
+    while (size)
+    {
+        PMDL    pMdl = m_apertureMdls[page];
+        UINT    mdlPage = m_apertureMdlPages[page];
+        UINT    runPages = 1;
+
+        if (NULL == pMdl)
+        {
+            return false;
+        }
+
+        while ((pageOffset + size > runPages*kPageSize) &&
+               (m_apertureMdls[page + runPages] == pMdl) &&
+               (m_apertureMdlPages[page + runPages] == mdlPage + runPages))
+        {
+            runPages++;
+        }
+
+        UINT    cleanSize = min(size, runPages*kPageSize - pageOffset);
+
+        CSHORT  savedMdlFlags = pMdl->MdlFlags;
+        PBYTE   pPages = (PBYTE)MmGetSystemAddressForMdlSafe(pMdl, HighPagePriority);
+
+        if (NULL == pPages)
+        {
+            return false;
+        }
+
+        CleanCpuCaches(pPages + mdlPage*kPageSize + pageOffset, cleanSize);
+
+        if (0 == (savedMdlFlags & MDL_MAPPED_TO_SYSTEM_VA))
+        {
+            MmUnmapLockedPages(pPages, pMdl);
+        }
+
+        size -= cleanSize;
+
+        page += runPages;
+        pageOffset = 0;
+    }
+
+    return true;
+}
+
+//
+// Runs on the worker thread when the DMA buffer is prepared for a slot of
+// the hardware queue, the copies reflect what the CPU wrote before the
+// submission. Returns false if an aperture reference can't be patched, the
+// caller releases the copies of the slot and the DMA buffer must not run.
+//
+
+bool
+RosKmAdapter::BounceApertureReferences(
+    ROSDMABUFINFO * pDmaBufInfo,
+    UINT            slot)
+{
+    NT_ASSERT(m_numApertureBounce[slot] == 0);
+
+    if (pDmaBufInfo->m_DmaBufState.m_bApertureBounceFailed)
+    {
+        return false;
+    }
+
+    UINT    bounceOffsets[VC4_MAX_APERTURE_BOUNCE];
+    UINT    bounceStarts[VC4_MAX_APERTURE_BOUNCE];
+
+    for (UINT i = 0; i < pDmaBufInfo->m_NumApertureBounce; i++)
+    {
+        ROSAPERTUREBOUNCE * pBounce = &pDmaBufInfo->m_ApertureBounce[i];
+
+        //
+        // References to the same allocation share its copy
+        //
+
+        UINT    j;
+
+        for (j = 0; j < i; j++)
+        {
+            if (pDmaBufInfo->m_ApertureBounce[j].m_ApertureAddress == pBounce->m_ApertureAddress)
+            {
+                break;
+            }
+        }
+
+        if (j < i)
+        {
+            bounceOffsets[i] = bounceOffsets[j];
+            bounceStarts[i] = bounceStarts[j];
+        }
+        else
+        {
+            //
+            // The GPU reads from the referenced offsets up to the end of the
+            // allocation, the copy starts at the page of the lowest one
+            //
+
+            UINT    start = pBounce->m_AllocationOffset;
+
+            for (j = i + 1; j < pDmaBufInfo->m_NumApertureBounce; j++)
+            {
+                if (pDmaBufInfo->m_ApertureBounce[j].m_ApertureAddress == pBounce->m_ApertureAddress)
+                {
+                    start = min(start, pDmaBufInfo->m_ApertureBounce[j].m_AllocationOffset);
+                }
+            }
+
+            start &= ~(kPageSize - 1);
+
+            UINT                size = pBounce->m_Size - start;
+            RosSegmentHandle    hBounce;
+
+            if (!m_driverHeap.Allocate(size, kPageSize, ROS_SEGMENT_ALLOC_DEFAULT, &hBounce))
+            {
+                ROS_LOG_ERROR(
+                    "Failed to allocate driver heap memory for an aperture copy. (size=%d)",
+                    size);
+
+                m_ErrorHit.m_ApertureBounceFailure = 1;
+
+                return false;
+            }
+
+            m_hApertureBounce[slot][m_numApertureBounce[slot]++] = hBounce;
+
+            bounceOffsets[i] = m_driverHeap.GetOffset(hBounce);
+            bounceStarts[i] = start;
+
+            PBYTE   pBounceMemory = ((PBYTE)RosKmdGlobal::s_pVideoMemory) + m_localVidMemSegmentSize + bounceOffsets[i];
+
+            if (!CopyFromAperture(pBounceMemory, pBounce->m_ApertureAddress + start, size))
+            {
+                ROS_LOG_ERROR(
+                    "Failed to copy an aperture allocation to the driver heap. (apertureAddress=0x%x, size=%d)",
+                    pBounce->m_ApertureAddress,
+                    size);
+
+                m_ErrorHit.m_ApertureBounceFailure = 1;
+
+                return false;
+            }
+
+            KeInvalidateRangeAllCaches(pBounceMemory, size);
+
+            m_apertureBytesBounced += size;
+        }
+
+        *((UINT *)(pDmaBufInfo->m_pDmaBuffer + pBounce->m_PatchOffset)) =
+            RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart +
+            m_localVidMemSegmentSize +
+            bounceOffsets[i] +
+            pBounce->m_AllocationOffset - bounceStarts[i] +
+            m_busAddressOffset;
+    }
+
+    if (m_numApertureBounce[slot])
+    {
+        ROS_LOG_TRACE(
+            "Copied aperture allocations to the driver heap. (count=%d, totalBytes=%I64d)",
+            m_numApertureBounce[slot],
+            m_apertureBytesBounced);
+    }
+
+    return true;
+}
+
+void
+RosKmAdapter::ReleaseApertureBounce(
+    UINT    slot)
+{
+    for (UINT i = 0; i < m_numApertureBounce[slot]; i++)
+    {
+        m_driverHeap.Free(m_hApertureBounce[slot][i]);
+    }
+
+    m_numApertureBounce[slot] = 0;
+}
+
+//
+// Adds the counts sampled while the DMA buffer ran to the reports of the
+// UMD, the UMD considers a report complete once m_sampleCount matches the
+// number of DMA buffers that sampled it
+//
+
+void
+RosKmAdapter::ReportPerfCounters(
+    ROSDMABUFINFO * pDmaBufInfo)
+{
+    for (UINT i = 0; i < pDmaBufInfo->m_VC4PerfCounters.m_numCounters; i++)
+    {
+        VC4PerfCounterReport *  pReport = pDmaBufInfo->m_pPerfCounterReports[i];
+
+        if (NULL == pReport)
+        {
+            continue;
+        }
+
+        pReport->m_value += pDmaBufInfo->m_PerfCounterValues[i];
+
+        KeMemoryBarrier();
+
+        pReport->m_sampleCount++;
+    }
+}
+
+void
+RosKmAdapter::CleanCpuCaches(
+    PVOID   pAddress,
+    UINT    size)
+{
+    KeInvalidateRangeAllCaches(pAddress, size);
+
+    m_bytesCleaned += size;
+}
+
+//
+// Video memory is mapped cached. The KMD wrote the control lists, the UMD
+// tells which ranges the CPU wrote since the GPU last read them, only those
+// are cleaned instead of the whole CPU caches.
+//
+
+UINT
+RosKmAdapter::MaintainCaches(
+    ROSDMABUFSUBMISSION *   pDmaBufSubmission,
+    UINT                    dmaBufBaseAddress,
+    UINT                    renderingControlListLength)
+{
+    ROSDMABUFINFO *             pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+    const VC4CacheMaintenance * pMaintenance = &pDmaBufInfo->m_VC4CacheMaintenance;
+    bool                        bHasMaintenance = (pDmaBufInfo->m_DmaBufState.m_HasVC4CacheMaintenance != 0);
 
-                pDestination = (PBYTE)MmGetSystemAddressForMdlSafe(pPagingBuffer->Transfer.Destination.pMdl, HighPagePriority);
+    if (bHasMaintenance && pMaintenance->m_bCleanAll)
+    {
+        KeInvalidateAllCaches();
 
-                pKmAddrToUnmap = pDestination;
+        m_fullCacheCleans++;
+    }
+    else
+    {
+        CleanCpuCaches(pDmaBufInfo->m_pDmaBuffer, pDmaBufSubmission->m_EndOffset);
+        CleanCpuCaches(m_pRenderingControlList, renderingControlListLength);
 
-                // Adjust the destination address by MdlOffset
-                pDestination += (pPagingBuffer->Transfer.MdlOffset*PAGE_SIZE);
-            }
+        for (UINT i = 0; bHasMaintenance && (i < pMaintenance->m_numCleans); i++)
+        {
+            const ROSCACHECLEAN *   pClean = &pDmaBufInfo->m_CacheCleans[i];
 
-            if (pSource && pDestination)
+            if (pClean->m_SegmentId == ROSD_SEGMENT_VIDEO_MEMORY)
             {
-                RtlCopyMemory(pDestination, pSource, pPagingBuffer->Transfer.TransferSize);
+                CleanCpuCaches(
+                    ((PBYTE)RosKmdGlobal::s_pVideoMemory) + pClean->m_Address,
+                    pMaintenance->m_cleanSizes[i]);
             }
-            else
+            else if (pClean->m_SegmentId == ROSD_SEGMENT_APERTURE)
             {
-                // TODO[indyz]: Propagate the error back to runtime
-                m_ErrorHit.m_PagingFailure = 1;
-            }
+                if (!CleanAperture(pClean->m_Address, pMaintenance->m_cleanSizes[i]))
+                {
+                    KeInvalidateAllCaches();
 
-            // Restore the state of the Mdl (for source or destionation)
-            if ((0 == (savedMdlFlags & MDL_MAPPED_TO_SYSTEM_VA)) && pKmAddrToUnmap)
-            {
-                MmUnmapLockedPages(pKmAddrToUnmap, pMdlToRestore);
+                    m_fullCacheCleans++;
+                    break;
+                }
             }
         }
-        break;
+    }
 
-        default:
-            NT_ASSERT(false);
+    UINT    gpuCaches = bHasMaintenance ? pMaintenance->m_gpuCaches : 0;
+
+    //
+    // The uniform cache may have the uniforms of an earlier run of the DMA
+    // buffer's memory
+    //
+
+    UINT    i;
+
+    for (i = 0; i < m_numDmaBuffersSinceFlush; i++)
+    {
+        if (m_dmaBuffersSinceFlush[i] == dmaBufBaseAddress)
+        {
+            break;
         }
     }
+
+    if ((i < m_numDmaBuffersSinceFlush) || (m_numDmaBuffersSinceFlush == kMaxDmaBuffersSinceFlush))
+    {
+        gpuCaches |= VC4_GPU_CACHE_UNIFORM;
+    }
+
+    if (gpuCaches & VC4_GPU_CACHE_UNIFORM)
+    {
+        m_numDmaBuffersSinceFlush = 0;
+    }
+
+    m_dmaBuffersSinceFlush[m_numDmaBuffersSinceFlush++] = dmaBufBaseAddress;
+
+    if (gpuCaches)
+    {
+        m_gpuCacheFlushes++;
+    }
+
+    return gpuCaches;
+}
+
+#endif // VC4
+
+//
+// Timestamp command of a software DMA buffer. DMA buffers run to completion
+// in submission order, so the timestamp follows the completion of every DMA
+// buffer submitted before it.
+//
+
+void
+RosKmAdapter::ReportTimestamp(
+    PHYSICAL_ADDRESS    reportAddress)
+{
+    VC4PerfCounterReport *  pReport = (VC4PerfCounterReport *)(
+        static_cast<BYTE*>(RosKmdGlobal::s_pVideoMemory) + reportAddress.QuadPart);
+
+    pReport->m_value = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    KeMemoryBarrier();
+
+    pReport->m_sampleCount++;
 }
 
 void
@@ -320,6 +1057,8 @@ RosKmAdapter::NotifyDmaBufCompletion(
         pDmaBufInfo->m_DmaBufState.m_bCompleted = 1;
     }
 
+    Trace(ROS_TRACE_COMPLETE, ROS_TRACE_INSTANT, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
     //
     // Notify the VidSch of the completion of the DMA buffer
     //
@@ -476,7 +1215,13 @@ RosKmAdapter::Start(
     // Initialize apperture state
     //
 
-    memset(m_aperturePageTable, 0, sizeof(m_aperturePageTable));
+    m_aperturePageTable.Init(
+        ROSD_SEGMENT_APERTURE_BASE_ADDRESS,
+        m_aperturePtes,
+        kApertureSegmentPageCount);
+
+    memset(m_apertureMdls, 0, sizeof(m_apertureMdls));
+    memset(m_apertureMdlPages, 0, sizeof(m_apertureMdlPages));
 
     //
     // Intialize DMA buffer queue and lock
@@ -498,6 +1243,17 @@ RosKmAdapter::Start(
     KeInitializeEvent(&m_hwDmaBufCompletionEvent, SynchronizationEvent, FALSE);
     KeInitializeDpc(&m_hwDmaBufCompletionDpc, HwDmaBufCompletionDpcRoutine, this);
 
+    //
+    // Initialize submission trace
+    //
+
+    LARGE_INTEGER   traceFrequency;
+
+    KeQueryPerformanceCounter(&traceFrequency);
+    m_traceFrequency = traceFrequency.QuadPart;
+
+    m_trace.Init(m_traceEvents, kTraceEventsPerRing, kTraceRings);
+
     ROS_LOG_TRACE("Adapter was successfully started.");
     return STATUS_SUCCESS;
 }
@@ -555,19 +1311,7 @@ RosKmAdapter::BuildPagingBuffer(
     {
         if (pArgs->MapApertureSegment.SegmentId == kApertureSegmentId)
         {
-            size_t pageIndex = pArgs->MapApertureSegment.OffsetInPages;
-            size_t pageCount = pArgs->MapApertureSegment.NumberOfPages;
-
-            NT_ASSERT(pageIndex + pageCount <= kApertureSegmentPageCount);
-
-            size_t mdlPageOffset = pArgs->MapApertureSegment.MdlOffset;
-
-            PMDL pMdl = pArgs->MapApertureSegment.pMdl;
-
-            for (UINT i = 0; i < pageCount; i++)
-            {
-                m_aperturePageTable[pageIndex + i] = MmGetMdlPfnArray(pMdl)[mdlPageOffset + i];
-            }
+            MapApertureSegment(pArgs);
         }
 
     }
@@ -577,15 +1321,7 @@ RosKmAdapter::BuildPagingBuffer(
     {
         if (pArgs->MapApertureSegment.SegmentId == kApertureSegmentId)
         {
-            size_t pageIndex = pArgs->MapApertureSegment.OffsetInPages;
-            size_t pageCount = pArgs->MapApertureSegment.NumberOfPages;
-
-            NT_ASSERT(pageIndex + pageCount <= kApertureSegmentPageCount);
-
-            while (pageCount--)
-            {
-                m_aperturePageTable[pageIndex++] = 0;
-            }
+            UnmapApertureSegment(pArgs);
         }
     }
 
@@ -664,6 +1400,7 @@ RosKmAdapter::BuildPagingBuffer(
     {
         pDmaBufInfo->m_DmaBufState.m_Value = 0;
         pDmaBufInfo->m_DmaBufState.m_bPaging = 1;
+        pDmaBufInfo->m_TraceSubmission = NewTraceSubmission();
 
         pDmaBufInfo->m_pDmaBuffer = pDmaBufStart;
         pDmaBufInfo->m_DmaBufferSize = pArgs->DmaSize;
@@ -672,6 +1409,60 @@ RosKmAdapter::BuildPagingBuffer(
     return Status;
 }
 
+//
+// Mapping happens when the paging buffer is built, so the page table is
+// current by the time a DMA buffer referencing the pages is patched
+//
+
+void
+RosKmAdapter::MapApertureSegment(
+    IN_PDXGKARG_BUILDPAGINGBUFFER   pArgs)
+{
+    UINT    pageIndex = (UINT)pArgs->MapApertureSegment.OffsetInPages;
+    UINT    pageCount = (UINT)pArgs->MapApertureSegment.NumberOfPages;
+
+    NT_ASSERT(pageIndex + pageCount <= kApertureSegmentPageCount);
+
+    UINT    mdlPageOffset = (UINT)pArgs->MapApertureSegment.MdlOffset;
+
+    PMDL    pMdl = pArgs->MapApertureSegment.pMdl;
+
+    for (UINT i = 0; i < pageCount; i++)
+    {
+        PFN_NUMBER  pfn = MmGetMdlPfnArray(pMdl)[mdlPageOffset + i];
+
+        // VC4 addresses are 32 bits
+        NT_ASSERT(pfn <= (MAXULONG >> kPageShift));
+
+        m_aperturePageTable.MapPage(pageIndex + i, (UINT)pfn);
+
+        m_apertureMdls[pageIndex + i] = pMdl;
+        m_apertureMdlPages[pageIndex + i] = mdlPageOffset + i;
+    }
+
+    m_aperturePageTable.UpdateRuns(pageIndex, pageCount);
+}
+
+void
+RosKmAdapter::UnmapApertureSegment(
+    IN_PDXGKARG_BUILDPAGINGBUFFER   pArgs)
+{
+    UINT    pageIndex = (UINT)pArgs->MapApertureSegment.OffsetInPages;
+    UINT    pageCount = (UINT)pArgs->MapApertureSegment.NumberOfPages;
+
+    NT_ASSERT(pageIndex + pageCount <= kApertureSegmentPageCount);
+
+    for (UINT i = 0; i < pageCount; i++)
+    {
+        m_aperturePageTable.UnmapPage(pageIndex + i);
+
+        m_apertureMdls[pageIndex + i] = NULL;
+        m_apertureMdlPages[pageIndex + i] = 0;
+    }
+
+    m_aperturePageTable.UpdateRuns(pageIndex, pageCount);
+}
+
 NTSTATUS
 RosKmAdapter::DispatchIoRequest(
     IN_ULONG                    VidPnSourceId,
@@ -694,6 +1485,12 @@ RosKmAdapter::SubmitCommand(
 {
     NTSTATUS        Status = STATUS_SUCCESS;
 
+    RosKmdTraceScope    traceScope(
+        this,
+        ROS_TRACE_QUEUE,
+        pSubmitCommand->SubmissionFenceId,
+        ((ROSDMABUFINFO *)pSubmitCommand->pDmaBufferPrivateData)->m_TraceSubmission);
+
 #if VC4
 
     if (!pSubmitCommand->Flags.Paging)
@@ -722,6 +1519,17 @@ RosKmAdapter::SubmitCommand(
                 m_busAddressOffset +
                 pPatchLoc->AllocationOffset;
         }
+
+        //
+        // The frame of a flip ends with the last DMA buffer rendering the
+        // primary, into the resolve target of a multisampled render target
+        //
+        RosKmdAllocation   *pFrameTarget = pDmaBufInfo->m_pResolveTarget ? pDmaBufInfo->m_pResolveTarget : pDmaBufInfo->m_pRenderTarget;
+
+        if (pFrameTarget)
+        {
+            pFrameTarget->m_lastRenderFenceId = pSubmitCommand->SubmissionFenceId;
+        }
     }
 
 #endif
@@ -746,6 +1554,8 @@ RosKmAdapter::Patch(
 {
     ROSDMABUFINFO *pDmaBufInfo = (ROSDMABUFINFO *)pPatch->pDmaBufferPrivateData;
 
+    RosKmdTraceScope    traceScope(this, ROS_TRACE_PATCH, pPatch->SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
     RosKmContext * pRosKmContext = (RosKmContext *)pPatch->hContext;
     pRosKmContext;
 
@@ -815,6 +1625,7 @@ RosKmAdapter::CreateAllocation(
     }
 
     *(RosAllocationExchange *)pRosKmdAllocation = *pRosAllocation;
+    pRosKmdAllocation->m_lastRenderFenceId = 0;
 
     pAllocationInfo->hAllocation = pRosKmdAllocation;
 
@@ -843,16 +1654,26 @@ RosKmAdapter::CreateAllocation(
     pAllocationInfo->pAllocationUsageHint = NULL;
     pAllocationInfo->PhysicalAdapterIndex = 0;
     pAllocationInfo->PitchAlignedSize = 0;
+
+    //
+    // Dynamic buffers and staging resources are read by the GPU (or only by
+    // the CPU) where the application wrote them, instead of being paged
+    // into local video memory
+    //
+    UINT segmentId = RosAllocationUsesAperture(*pRosAllocation) ?
+        ROSD_SEGMENT_APERTURE :
+        ROSD_SEGMENT_VIDEO_MEMORY;
+
     pAllocationInfo->PreferredSegment.Value = 0;
-    pAllocationInfo->PreferredSegment.SegmentId0 = ROSD_SEGMENT_VIDEO_MEMORY;
+    pAllocationInfo->PreferredSegment.SegmentId0 = segmentId;
     pAllocationInfo->PreferredSegment.Direction0 = 0;
 
     // zero-size allocations are not allowed
     NT_ASSERT(pRosAllocation->m_hwSizeBytes != 0);
     pAllocationInfo->Size = pRosAllocation->m_hwSizeBytes;
 
-    pAllocationInfo->SupportedReadSegmentSet = 1 << (ROSD_SEGMENT_VIDEO_MEMORY - 1);
-    pAllocationInfo->SupportedWriteSegmentSet = 1 << (ROSD_SEGMENT_VIDEO_MEMORY - 1);
+    pAllocationInfo->SupportedReadSegmentSet = 1 << (segmentId - 1);
+    pAllocationInfo->SupportedWriteSegmentSet = 1 << (segmentId - 1);
 
 #if GPU_CACHE_WORKAROUND
 
@@ -963,8 +1784,9 @@ RosKmAdapter::QueryAdapterInfo(
         //
 
         //
-        // TODO[bhouse] ApertureSegmentCommitLimit
+        // Every aperture page can be committed
         //
+        pDriverCaps->ApertureSegmentCommitLimit = kApertureSegmentSize;
 
         //
         // TODO[bhouse] MaxPointerWidth
@@ -1025,9 +1847,10 @@ RosKmAdapter::QueryAdapterInfo(
         if (!RosKmdGlobal::IsRenderOnly())
         {
             //
-            // The hardware can store at most one pending flip operation.
+            // The display list holds one pending flip, the VfpStart
+            // interrupt programs the flips queued after it (RosFlipQueue).
             //
-            pDriverCaps->MaxQueuedFlipOnVSync = 1;
+            pDriverCaps->MaxQueuedFlipOnVSync = RosFlipQueue::kMaxQueuedFlips;
 
             //
             // FlipOnVSyncWithNoWait - we don't have to wait for the next VSync
@@ -1039,15 +1862,16 @@ RosKmAdapter::QueryAdapterInfo(
 
             //
             // We do not support the scheduling of a flip command to take effect
-            // after two, three, or four vertical syncs.
+            // after two, three, or four vertical syncs, the OS holds such flips
+            // in its flip queue until they are due.
             //
             pDriverCaps->FlipCaps.FlipInterval = FALSE;
 
             //
-            // The address we program into hardware does not take effect until
-            // the next vsync.
+            // The address we program into hardware takes effect at the next
+            // frame start, without waiting for the flips queued before it.
             //
-            pDriverCaps->FlipCaps.FlipImmediateMmIo = FALSE;
+            pDriverCaps->FlipCaps.FlipImmediateMmIo = TRUE;
 
             //
             // WDDM 1.3 and later drivers must set this to TRUE.
@@ -1479,19 +2303,122 @@ RosKmAdapter::Escape(
 
     UINT    EscapeId = *((UINT *)pEscape->pPrivateDriverData);
 
-#pragma warning( disable : 4065 )
     switch (EscapeId)
     {
+    case ROS_ESCAPE_TRACE_CONTROL:
+
+        Status = CheckTracePrivilege();
+        if (NT_SUCCESS(Status))
+        {
+            Status = EscapeTraceControl(pEscape);
+        }
+        break;
+
+    case ROS_ESCAPE_TRACE_READ:
+
+        Status = CheckTracePrivilege();
+        if (NT_SUCCESS(Status))
+        {
+            Status = EscapeTraceRead(pEscape);
+        }
+        break;
 
     default:
 
-        NT_ASSERT(false);
+        ROS_LOG_ERROR("Unknown escape. (EscapeId=%d)", EscapeId);
         Status = STATUS_NOT_SUPPORTED;
         break;
     }
 
-    ROS_LOG_ASSERTION("Not implemented");
-    return STATUS_NOT_IMPLEMENTED;
+    return Status;
+}
+
+//
+// The trace times the GPU work of every process, only callers allowed to
+// profile the system may control or read it. Escapes run in the context of
+// the calling thread.
+//
+
+NTSTATUS
+RosKmAdapter::CheckTracePrivilege()
+{
+    if (!SeSinglePrivilegeCheck(RtlConvertLongToLuid(SE_SYSTEM_PROFILE_PRIVILEGE), UserMode))
+    {
+        ROS_LOG_WARNING("Trace escape from a caller without the system profile privilege.");
+        return STATUS_PRIVILEGE_NOT_HELD;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RosKmAdapter::EscapeTraceControl(
+    IN_CONST_PDXGKARG_ESCAPE        pEscape)
+{
+    if (pEscape->PrivateDriverDataSize < sizeof(ROS_ESCAPE_TRACE_CONTROL))
+    {
+        ROS_LOG_ERROR(
+            "PrivateDriverDataSize is too small. (pEscape->PrivateDriverDataSize=%d, sizeof(ROS_ESCAPE_TRACE_CONTROL)=%d)",
+            pEscape->PrivateDriverDataSize,
+            sizeof(ROS_ESCAPE_TRACE_CONTROL));
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    ROS_ESCAPE_TRACE_CONTROL *  pTraceControl = (ROS_ESCAPE_TRACE_CONTROL *)pEscape->pPrivateDriverData;
+
+    m_trace.Enable(pTraceControl->m_enable != FALSE);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RosKmAdapter::EscapeTraceRead(
+    IN_CONST_PDXGKARG_ESCAPE        pEscape)
+{
+    const UINT  headerSize = FIELD_OFFSET(ROS_ESCAPE_TRACE_READ, m_events);
+
+    if (pEscape->PrivateDriverDataSize < headerSize)
+    {
+        ROS_LOG_ERROR(
+            "PrivateDriverDataSize is too small. (pEscape->PrivateDriverDataSize=%d, headerSize=%d)",
+            pEscape->PrivateDriverDataSize,
+            headerSize);
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    ROS_ESCAPE_TRACE_READ * pTraceRead = (ROS_ESCAPE_TRACE_READ *)pEscape->pPrivateDriverData;
+    UINT                    maxEvents = (pEscape->PrivateDriverDataSize - headerSize) / sizeof(RosTraceEvent);
+
+    if (pTraceRead->m_maxEvents < maxEvents)
+    {
+        maxEvents = pTraceRead->m_maxEvents;
+    }
+
+    //
+    // The rings keep being written, the snapshot skips events in flight
+    //
+
+    pTraceRead->m_numEvents = m_trace.Snapshot(pTraceRead->m_events, maxEvents);
+    pTraceRead->m_frequency = m_traceFrequency;
+
+    return STATUS_SUCCESS;
+}
+
+void
+RosKmAdapter::WriteTrace(
+    RosTraceStage   stage,
+    RosTracePhase   phase,
+    UINT            fenceId,
+    ULONGLONG       submission)
+{
+    m_trace.Write(
+        KeGetCurrentProcessorNumberEx(NULL),
+        (UINT)(ULONG_PTR)PsGetCurrentThreadId(),
+        KeQueryPerformanceCounter(NULL).QuadPart,
+        stage,
+        phase,
+        fenceId,
+        submission);
 }
 
 NTSTATUS
@@ -1576,6 +2503,13 @@ RosKmAdapter::PatchDmaBuffer(
 {
     PBYTE       pDmaBuf = (PBYTE)pDmaBufInfo->m_pDmaBuffer;
 
+#if VC4
+
+    // Patching again sees the current pages of the aperture allocations
+    pDmaBufInfo->m_DmaBufState.m_bApertureBounceFailed = 0;
+
+#endif
+
     for (UINT i = 0; i < patchAllocationList; i++)
     {
         auto patch = &pPatchLocationList[i];
@@ -1593,9 +2527,13 @@ RosKmAdapter::PatchDmaBuffer(
             DbgPrintEx(DPFLTR_IHVVIDEO_ID, DPFLTR_TRACE_LEVEL, "Patch buffer offset %lx allocation offset %lx\n", patch->PatchOffset, patch->AllocationOffset);
 
             // Patch in dma buffer
-            NT_ASSERT(allocation->SegmentId == ROSD_SEGMENT_VIDEO_MEMORY);
+            NT_ASSERT((allocation->SegmentId == ROSD_SEGMENT_VIDEO_MEMORY) ||
+                      (allocation->SegmentId == ROSD_SEGMENT_APERTURE));
             if (pDmaBufInfo->m_DmaBufState.m_bSwCommandBuffer)
             {
+                // Only copies between default resources, in local video memory
+                NT_ASSERT(allocation->SegmentId == ROSD_SEGMENT_VIDEO_MEMORY);
+
                 PHYSICAL_ADDRESS    allocAddress;
 
                 allocAddress.QuadPart = allocation->PhysicalAddress.QuadPart + (LONGLONG)patch->AllocationOffset;
@@ -1605,10 +2543,40 @@ RosKmAdapter::PatchDmaBuffer(
             {
                 // Patch HW command buffer
 #if VC4
-                UINT    physicalAddress =
-                    RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart +
-                    allocation->PhysicalAddress.LowPart +
-                    patch->AllocationOffset;
+                if (patch->SlotId == VC4_SLOT_CACHE_CLEAN)
+                {
+                    // Cleaned when the DMA buffer runs, the header isn't patched
+                    ROSCACHECLEAN * pClean = &pDmaBufInfo->m_CacheCleans[
+                        (patch->PatchOffset - offsetof(GpuCommand, m_commandBufferHeader.m_vc4CacheMaintenance.m_cleanSizes)) / sizeof(UINT)];
+
+                    pClean->m_SegmentId = allocation->SegmentId;
+                    pClean->m_Address = allocation->PhysicalAddress.LowPart + patch->AllocationOffset;
+
+                    continue;
+                }
+
+                UINT    physicalAddress;
+
+                if (allocation->SegmentId == ROSD_SEGMENT_APERTURE)
+                {
+                    if (!TranslateApertureReference(
+                            pDmaBufInfo,
+                            pRosKmdDeviceAllocation->m_pRosKmdAllocation,
+                            allocation,
+                            patch,
+                            &physicalAddress))
+                    {
+                        // Patched when the DMA buffer runs
+                        continue;
+                    }
+                }
+                else
+                {
+                    physicalAddress =
+                        RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart +
+                        allocation->PhysicalAddress.LowPart +
+                        patch->AllocationOffset;
+                }
 
                 switch (patch->SlotId)
                 {
@@ -1619,6 +2587,21 @@ RosKmAdapter::PatchDmaBuffer(
                         allocation->PhysicalAddress.LowPart +
                         patch->AllocationOffset;
                     break;
+                case VC4_SLOT_DEPTH_STENCIL:
+                    pDmaBufInfo->m_DepthStencilPhysicalAddress = physicalAddress;
+                    break;
+                case VC4_SLOT_RESOLVE_TARGET:
+                    pDmaBufInfo->m_ResolveTargetPhysicalAddress = physicalAddress;
+                    break;
+                case VC4_SLOT_PERF_COUNTER_REPORT:
+                    NT_ASSERT(allocation->SegmentId == ROSD_SEGMENT_VIDEO_MEMORY);
+
+                    pDmaBufInfo->m_pPerfCounterReports[patch->PatchOffset - offsetof(GpuCommand, m_commandBufferHeader.m_vc4PerfCounters.m_sources)] =
+                        (VC4PerfCounterReport *)(
+                            static_cast<BYTE*>(RosKmdGlobal::s_pVideoMemory) +
+                            allocation->PhysicalAddress.LowPart +
+                            patch->AllocationOffset);
+                    break;
                 case VC4_SLOT_TILE_ALLOCATION_MEMORY:
                     *((UINT *)(pDmaBuf + patch->PatchOffset)) = m_tileAllocationMemoryPhysicalAddress + m_busAddressOffset;
                     break;
@@ -1683,9 +2666,15 @@ RosKmAdapter::ValidateDmaBuffer(
                 {
                     return false;   // Allow one per DMA buffer
                 }
+                else if ((patch->PatchOffset < offsetof(VC4TileBinningModeConfig, TileAllocationMemoryAddress)) ||
+                         (patch->PatchOffset - offsetof(VC4TileBinningModeConfig, TileAllocationMemoryAddress) + sizeof(VC4TileBinningModeConfig) > pDmaBufInfo->m_DmaBufferSize))
+                {
+                    return false;   // KMD writes the Tile Binning Mode Config
+                }
                 else
                 {
                     pDmaBufState->m_bTileAllocMemRef = 1;
+                    pDmaBufInfo->m_TileAllocMemPatchOffset = patch->PatchOffset;
                 }
                 break;
             case VC4_SLOT_TILE_STATE_DATA_ARRAY:
@@ -1709,6 +2698,63 @@ RosKmAdapter::ValidateDmaBuffer(
                     pDmaBufState->m_bRenderTargetRef = 1;
                 }
                 break;
+            case VC4_SLOT_DEPTH_STENCIL:
+                if (pDmaBufState->m_bDepthStencilRef ||
+                    (patch->PatchOffset != offsetof(GpuCommand, m_commandBufferHeader.m_vc4DepthStencil)) ||
+                    (patch->AllocationOffset != 0) ||
+                    (pRosKmdDeviceAllocation->m_pRosKmdAllocation->m_hwFormat != RosHwFormat::D24S8))
+                {
+                    return false;   // Allow one per DMA buffer, in the header
+                }
+                else
+                {
+                    pDmaBufInfo->m_pDepthStencil = pRosKmdDeviceAllocation->m_pRosKmdAllocation;
+                    pDmaBufState->m_bDepthStencilRef = 1;
+                }
+                break;
+            case VC4_SLOT_RESOLVE_TARGET:
+                if (pDmaBufState->m_bResolveTargetRef ||
+                    (patch->PatchOffset != offsetof(GpuCommand, m_commandBufferHeader.m_vc4Resolve)) ||
+                    (patch->AllocationOffset != 0) ||
+                    RosAllocationIsMultisampled(*pRosKmdDeviceAllocation->m_pRosKmdAllocation))
+                {
+                    return false;   // Allow one per DMA buffer, in the header
+                }
+                else
+                {
+                    pDmaBufInfo->m_pResolveTarget = pRosKmdDeviceAllocation->m_pRosKmdAllocation;
+                    pDmaBufState->m_bResolveTargetRef = 1;
+                }
+                break;
+            case VC4_SLOT_PERF_COUNTER_REPORT:
+                if ((patch->PatchOffset < offsetof(GpuCommand, m_commandBufferHeader.m_vc4PerfCounters.m_sources)) ||
+                    (patch->PatchOffset >= offsetof(GpuCommand, m_commandBufferHeader.m_vc4PerfCounters.m_sources) + V3D_NUM_PERF_COUNTERS) ||
+                    ((patch->AllocationOffset % sizeof(VC4PerfCounterReport)) != 0))
+                {
+                    return false;   // Reports one of the header's counters
+                }
+                break;
+            case VC4_SLOT_CACHE_CLEAN:
+            {
+                const UINT                  cleanSizesOffset = offsetof(GpuCommand, m_commandBufferHeader.m_vc4CacheMaintenance.m_cleanSizes);
+                const VC4CacheMaintenance * pMaintenance = &((GpuCommand *)pDmaBuf)->m_commandBufferHeader.m_vc4CacheMaintenance;
+
+                if ((patch->PatchOffset < cleanSizesOffset) ||
+                    (patch->PatchOffset >= cleanSizesOffset + VC4_MAX_CACHE_CLEAN*sizeof(UINT)) ||
+                    (((patch->PatchOffset - cleanSizesOffset) % sizeof(UINT)) != 0))
+                {
+                    return false;   // Cleans one of the header's ranges
+                }
+
+                UINT    size = pMaintenance->m_cleanSizes[(patch->PatchOffset - cleanSizesOffset) / sizeof(UINT)];
+
+                if ((patch->AllocationOffset > pRosKmdDeviceAllocation->m_pRosKmdAllocation->m_hwSizeBytes) ||
+                    (size > pRosKmdDeviceAllocation->m_pRosKmdAllocation->m_hwSizeBytes - patch->AllocationOffset))
+                {
+                    return false;   // Within the allocation
+                }
+            }
+            break;
             case VC4_SLOT_NV_SHADER_STATE:
             case VC4_SLOT_BRANCH:
             case VC4_SLOT_GL_SHADER_STATE:
@@ -1738,6 +2784,46 @@ RosKmAdapter::ValidateDmaBuffer(
         {
             bValidateDmaBuffer = false;
         }
+
+#if VC4
+
+        //
+        // The tile buffer loads and stores the depth stencil buffer over
+        // the frame of the render target
+        //
+
+        if (pDmaBufState->m_bDepthStencilRef &&
+            pDmaBufState->m_bRenderTargetRef &&
+            ((pDmaBufInfo->m_pDepthStencil->m_mip0Info.TexelWidth != pDmaBufInfo->m_pRenderTarget->m_mip0Info.TexelWidth) ||
+             (pDmaBufInfo->m_pDepthStencil->m_mip0Info.TexelHeight != pDmaBufInfo->m_pRenderTarget->m_mip0Info.TexelHeight)))
+        {
+            bValidateDmaBuffer = false;
+        }
+
+        //
+        // The tile buffer has the samples of the depth stencil buffer in
+        // the mode of the render target, and resolves a multisample render
+        // target into one of its size
+        //
+
+        if (pDmaBufState->m_bDepthStencilRef &&
+            pDmaBufState->m_bRenderTargetRef &&
+            (RosAllocationIsMultisampled(*pDmaBufInfo->m_pDepthStencil) != RosAllocationIsMultisampled(*pDmaBufInfo->m_pRenderTarget)))
+        {
+            bValidateDmaBuffer = false;
+        }
+
+        if (pDmaBufState->m_bResolveTargetRef &&
+            ((0 == pDmaBufState->m_bRenderTargetRef) ||
+             !RosAllocationIsMultisampled(*pDmaBufInfo->m_pRenderTarget) ||
+             (pDmaBufInfo->m_pRenderTarget->m_hwFormat == RosHwFormat::D24S8) ||
+             (pDmaBufInfo->m_pResolveTarget->m_mip0Info.TexelWidth != pDmaBufInfo->m_pRenderTarget->m_mip0Info.TexelWidth) ||
+             (pDmaBufInfo->m_pResolveTarget->m_mip0Info.TexelHeight != pDmaBufInfo->m_pRenderTarget->m_mip0Info.TexelHeight)))
+        {
+            bValidateDmaBuffer = false;
+        }
+
+#endif
     }
 
     return bValidateDmaBuffer;
@@ -1796,8 +2882,14 @@ RosKmAdapter::HwDmaBufCompletionDpcRoutine(
     UNREFERENCED_PARAMETER(systemArgument1);
     UNREFERENCED_PARAMETER(systemArgument2);
 
+    pRosKmAdapter->OnHwDmaBufCompletion();
+}
+
+void
+RosKmAdapter::OnHwDmaBufCompletion()
+{
     // Signal to the worker thread that a HW DMA buffer has completed
-    KeSetEvent(&pRosKmAdapter->m_hwDmaBufCompletionEvent, 0, FALSE);
+    KeSetEvent(&m_hwDmaBufCompletionEvent, 0, FALSE);
 }
 
 ROS_NONPAGED_SEGMENT_BEGIN; //================================================
@@ -6,9 +6,17 @@
 
 #include "Vc4Hw.h"
 #include "VC4Ddi.h"
+#include "RosSegmentAllocator.h"
+#include "RosHwQueue.h"
+#include "RosBinnerMemory.h"
+#include "RosRenderPass.h"
+#include "RosTileOrder.h"
 
 #endif
 
+#include "RosAperturePageTable.h"
+#include "RosTraceRing.h"
+#include "RosMsaa.h"
 #include "RosKmdAllocation.h"
 #include "RosKmdGlobal.h"
 #include "Vc4Display.h"
@@ -27,6 +35,9 @@ typedef struct __ROSKMERRORCONDITION
             UINT    m_NotifyDmaBufFault             : 1;
             UINT    m_PreparationError              : 1;
             UINT    m_PagingFailure                 : 1;
+            UINT    m_ApertureBounceFailure         : 1;
+            UINT    m_GpuHang                       : 1;
+            UINT    m_BinnerOutOfMemory             : 1;
         };
 
         UINT        m_Value;
@@ -47,6 +58,13 @@ typedef struct _ROSDMABUFSTATE
             UINT    m_bTileStateDataRef : 1;
             UINT    m_NumDmaBufSelfRef  : 5;    // Up to 32 DMA buffer self reference
             UINT    m_HasVC4ClearColors : 1;
+            UINT    m_HasVC4PerfCounters : 1;
+            UINT    m_HasVC4CacheMaintenance : 1;
+            UINT    m_bPassContinues    : 1;    // Flushed in the middle of the render pass
+            UINT    m_bDepthStencilRef  : 1;
+            UINT    m_bResolveTargetRef : 1;
+            UINT    m_bDepthOnly        : 1;    // Draws wrote no color
+            UINT    m_bApertureBounceFailed : 1;    // Too many aperture references to copy
 
 #endif
             UINT    m_bPresent          : 1;
@@ -64,6 +82,34 @@ typedef struct _ROSDMABUFSTATE
     };
 } ROSDMABUFSTATE;
 
+#if VC4
+
+//
+// Reference of a DMA buffer to an aperture allocation whose pages aren't
+// physically contiguous
+//
+
+typedef struct _ROSAPERTUREBOUNCE
+{
+    UINT    m_PatchOffset;
+    UINT    m_ApertureAddress;      // Start of the allocation
+    UINT    m_AllocationOffset;
+    UINT    m_Size;                 // Size of the allocation
+} ROSAPERTUREBOUNCE;
+
+//
+// Start of a range the CPU wrote, cleaned from the CPU caches before the
+// DMA buffer runs
+//
+
+typedef struct _ROSCACHECLEAN
+{
+    UINT    m_SegmentId;            // 0 when the allocation wasn't resident
+    UINT    m_Address;              // Video memory offset or aperture address
+} ROSCACHECLEAN;
+
+#endif
+
 typedef struct _ROSDMABUFINFO
 {
     PBYTE                       m_pDmaBuffer;
@@ -71,16 +117,54 @@ typedef struct _ROSDMABUFINFO
     UINT                        m_DmaBufferSize;
     ROSDMABUFSTATE              m_DmaBufState;
 
+    // Identifies the DMA buffer in the trace before its fence is known
+    ULONGLONG                   m_TraceSubmission;
+
 #if VC4
 
     RosKmdAllocation           *m_pRenderTarget;
     UINT                        m_RenderTargetPhysicalAddress;
     const void*                 m_RenderTargetVirtualAddress;
 
+    // Depth stencil buffer of the render pass, NULL without one, and what
+    // the draws do to it
+    RosKmdAllocation           *m_pDepthStencil;
+    UINT                        m_DepthStencilPhysicalAddress;
+    VC4DepthStencilUse          m_VC4DepthStencil;
+
+    // Render target the multisample render target is resolved into at the
+    // end of the render pass, NULL without one
+    RosKmdAllocation           *m_pResolveTarget;
+    UINT                        m_ResolveTargetPhysicalAddress;
+    VC4ResolveUse               m_VC4Resolve;
+
+    // Pixels of the render target the draws may write
+    VC4DirtyRect                m_VC4DirtyRect;
+
     D3DDDI_PATCHLOCATIONLIST    m_DmaBufSelfRef[VC4_MAX_DMA_BUFFER_SELF_REF];
 
+    ROSAPERTUREBOUNCE           m_ApertureBounce[VC4_MAX_APERTURE_BOUNCE];
+    UINT                        m_NumApertureBounce;
+
     VC4ClearColors              m_VC4ClearColors;
 
+    // Counters sampled around the control lists and where they are reported
+    VC4PerfCounterSelect        m_VC4PerfCounters;
+    VC4PerfCounterReport       *m_pPerfCounterReports[V3D_NUM_PERF_COUNTERS];
+    UINT                        m_PerfCounterValues[V3D_NUM_PERF_COUNTERS];
+
+    VC4CacheMaintenance         m_VC4CacheMaintenance;
+    ROSCACHECLEAN               m_CacheCleans[VC4_MAX_CACHE_CLEAN];
+
+    // Tile Binning Mode Config, its tile allocation memory is given when
+    // the DMA buffer runs
+    UINT                        m_TileAllocMemPatchOffset;
+
+    // Draws of the Binning Control List and its epilog, which a Branch to
+    // the DMA buffer continuing the render pass replaces
+    UINT                        m_PassBodyOffset;
+    UINT                        m_PassEpilogOffset;
+
 #endif
 } ROSDMABUFINFO;
 
@@ -105,6 +189,34 @@ typedef union _RosKmAdapterFlags
 
 #pragma warning(default:4201) // nameless struct/union
 
+#if VC4
+
+//
+// Moves driver heap blocks with the same CPU copy as the paging buffer
+// TRANSFER operation
+//
+
+class RosKmdDriverHeapMover : public RosSegmentMover
+{
+public:
+
+    RosKmdDriverHeapMover(BYTE * pHeap) :
+        m_pHeap(pHeap)
+    {
+    }
+
+    virtual void MoveBlock(UINT dstOffset, UINT srcOffset, UINT size)
+    {
+        RtlCopyMemory(m_pHeap + dstOffset, m_pHeap + srcOffset, size);
+    }
+
+private:
+
+    BYTE *  m_pHeap;
+};
+
+#endif
+
 class RosKmdDdi;
 
 class RosKmAdapter
@@ -295,6 +407,30 @@ public:
         CONST D3DDDI_PATCHLOCATIONLIST* pPatchLocationList,
         UINT                            patchAllocationList);
 
+    //
+    // Records a stage of the submission path in the trace, submission
+    // identifies the DMA buffer before its fence is known
+    //
+
+    void
+    Trace(
+        RosTraceStage   stage,
+        RosTracePhase   phase,
+        UINT            fenceId,
+        ULONGLONG       submission)
+    {
+        if (m_trace.IsEnabled())
+        {
+            WriteTrace(stage, phase, fenceId, submission);
+        }
+    }
+
+    // Sequence number of a DMA buffer in the trace, never 0
+    ULONGLONG NewTraceSubmission()
+    {
+        return (ULONGLONG)InterlockedIncrement64(&m_traceSubmissions);
+    }
+
 protected:
 
     friend class RosKmdDdi;
@@ -318,38 +454,153 @@ protected:
 
 protected:
 
-    virtual void ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission) = 0;
+    //
+    // Returns true once the DMA buffer ran. Otherwise it was queued to the
+    // GPU, whose completion notifies it.
+    //
+
+    virtual bool ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission) = 0;
+
+    //
+    // DMA buffers queued to the GPU. The worker thread retires them when
+    // woken up, waits for the GPU to be idle before running a paging buffer
+    // and only compacts the driver heap while it is idle.
+    //
+
+    virtual bool IsGpuIdle()
+    {
+        return true;
+    }
+
+    virtual void WaitForGpuIdle()
+    {
+        // do nothing
+    }
+
+    virtual void RetireHwDmaBuffers()
+    {
+        // do nothing
+    }
+
+    //
+    // Called by the worker thread once the DMA buffer queue is empty, to
+    // submit what it held back for the DMA buffers after it
+    //
+
+    virtual void SubmitHeldDmaBuffers()
+    {
+        // do nothing
+    }
+
+    // Called by the DPC queued by the interrupt routine
+    virtual void OnHwDmaBufCompletion();
+
+    void ReportTimestamp(PHYSICAL_ADDRESS reportAddress);
+
+    void NotifyDmaBufCompletion(ROSDMABUFSUBMISSION * pDmaBufSubmission);
+    void FreeDmaBufSubmission(ROSDMABUFSUBMISSION * pDmaBufSubmission);
+
+    // Period of the worker thread's checks while the GPU is busy
+    static const UINT           kGpuBusyCheckIntervalMs = 100;
 
 private:
 
     static void WorkerThread(void * StartContext);
     void DoWork(void);
     void DpcRoutine(void);
-    void NotifyDmaBufCompletion(ROSDMABUFSUBMISSION * pDmaBufSubmission);
     static BOOLEAN SynchronizeNotifyInterrupt(PVOID SynchronizeContext);
     BOOLEAN SynchronizeNotifyInterrupt();
     ROSDMABUFSUBMISSION * DequeueDmaBuffer(KSPIN_LOCK * pDmaBufQueueLock);
     void ProcessPagingBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission);
     static void HwDmaBufCompletionDpcRoutine(KDPC *, PVOID, PVOID, PVOID);
 
+    void MapApertureSegment(IN_PDXGKARG_BUILDPAGINGBUFFER pArgs);
+    void UnmapApertureSegment(IN_PDXGKARG_BUILDPAGINGBUFFER pArgs);
+
+    void WriteTrace(RosTraceStage stage, RosTracePhase phase, UINT fenceId, ULONGLONG submission);
+    NTSTATUS CheckTracePrivilege();
+    NTSTATUS EscapeTraceControl(IN_CONST_PDXGKARG_ESCAPE pEscape);
+    NTSTATUS EscapeTraceRead(IN_CONST_PDXGKARG_ESCAPE pEscape);
+
+#if VC4
+
+    void CompactDriverHeap();
+
+    bool
+    TranslateApertureReference(
+        ROSDMABUFINFO *                     pDmaBufInfo,
+        const RosKmdAllocation *            pRosKmdAllocation,
+        const DXGK_ALLOCATIONLIST *         pAllocation,
+        const D3DDDI_PATCHLOCATIONLIST *    pPatch,
+        UINT *                              pPhysicalAddress);
+
+    bool
+    CopyFromAperture(
+        BYTE *  pDestination,
+        UINT    apertureAddress,
+        UINT    size);
+
+    bool
+    CleanAperture(
+        UINT    apertureAddress,
+        UINT    size);
+
+protected:
+
+    NTSTATUS InitDriverHeap();
+    void UpdateDriverHeapAddresses();
+
+    UINT PrepareTileAllocationMemory(ROSDMABUFINFO * pDmaBufInfo);
+    bool ResizeTileAllocationMemory(UINT size);
+
+    bool BounceApertureReferences(ROSDMABUFINFO * pDmaBufInfo, UINT slot);
+    void ReleaseApertureBounce(UINT slot);
+
+    void ReportPerfCounters(ROSDMABUFINFO * pDmaBufInfo);
+
+    //
+    // Cleans what the CPU wrote for the DMA buffer from the CPU caches, and
+    // returns the GPU caches (VC4GpuCache) to flush before it runs
+    //
+
+    UINT
+    MaintainCaches(
+        ROSDMABUFSUBMISSION *   pDmaBufSubmission,
+        UINT                    dmaBufBaseAddress,
+        UINT                    renderingControlListLength);
+
+    void CleanCpuCaches(PVOID pAddress, UINT size);
+
+#endif
+
 protected:
 
     static const size_t kPageSize = 4096;
     static const size_t kPageShift = 12;
 
     static const size_t kApertureSegmentId = 1;
-    static const size_t kApertureSegmentPageCount = 1024;
+    static const size_t kApertureSegmentPageCount = 8192;
     static const size_t kApertureSegmentSize = kApertureSegmentPageCount * kPageSize;
 
-    PFN_NUMBER  m_aperturePageTable[kApertureSegmentPageCount];
+    RosAperturePageTable    m_aperturePageTable;
+    RosAperturePte          m_aperturePtes[kApertureSegmentPageCount];
+
+    // Backing MDL page of each aperture page, to copy ranges the GPU can't
+    // read in place
+    PMDL                    m_apertureMdls[kApertureSegmentPageCount];
+    UINT                    m_apertureMdlPages[kApertureSegmentPageCount];
 
     static const size_t kVideoMemorySegmentId = 2;
 
     UINT GetAperturePhysicalAddress(UINT apertureAddress)
     {
-        UINT pageIndex = (apertureAddress - ROSD_SEGMENT_APERTURE_BASE_ADDRESS) / kPageSize;
+        UINT    physicalAddress = 0;
+        bool    bMapped = m_aperturePageTable.Translate(apertureAddress, 1, &physicalAddress);
+
+        bMapped;
+        NT_ASSERT(bMapped);
 
-        return ((UINT)m_aperturePageTable[pageIndex])*kPageSize + (apertureAddress & (kPageSize - 1));
+        return physicalAddress;
     };
 
 protected:
@@ -395,6 +646,19 @@ protected:
     KDPC                        m_hwDmaBufCompletionDpc;
     KEVENT                      m_hwDmaBufCompletionEvent;
 
+    //
+    // Submission trace, one ring per CPU of the Raspberry Pi, disabled
+    // until enabled with ROS_ESCAPE_TRACE_CONTROL
+    //
+
+    static const UINT           kTraceRings = RosTrace::kMaxRings;
+    static const UINT           kTraceEventsPerRing = 1024;
+
+    RosTrace                    m_trace;
+    RosTraceEvent               m_traceEvents[kTraceRings * kTraceEventsPerRing];
+    ULONGLONG                   m_traceFrequency;
+    volatile LONG64             m_traceSubmissions;
+
     DXGKARGCB_NOTIFY_INTERRUPT_DATA m_interruptData;
 
     DXGKARG_RESETENGINE        *m_pResetEngine;
@@ -422,6 +686,60 @@ protected:
     UINT                        m_tileAllocPoolPhysicalAddress;
     UINT                        m_tileStatePoolPhysicalAddress;
 
+    //
+    // Driver owned video memory past the local video memory segment, the
+    // pools above are suballocated from it and may move when it is
+    // compacted while the GPU is idle
+    //
+
+    static const UINT           kDriverHeapMaxBlocks = 64;
+    static const UINT           kDriverHeapMaxHandles = 32;
+    static const UINT           kDriverHeapMaxSlabs = 4;
+    static const UINT           kDriverHeapCompactionBudget = 1024 * 1024;
+
+    RosSegmentAllocator         m_driverHeap;
+    RosSegmentBlock             m_driverHeapBlocks[kDriverHeapMaxBlocks];
+    UINT                        m_driverHeapHandles[kDriverHeapMaxHandles];
+    RosSegmentSlab              m_driverHeapSlabs[kDriverHeapMaxSlabs];
+
+    RosSegmentHandle            m_hControlListPool;
+    RosSegmentHandle            m_hTileAllocPool;
+    RosSegmentHandle            m_hTileStatePool;
+
+    //
+    // Initial tile allocation memory sized by the usage of the recent
+    // frames, and the pinned pool of overspill blocks the binner continues
+    // in when it runs out
+    //
+
+    RosBinnerMemory             m_binnerMemory;
+    UINT                        m_tileAllocationMemorySize;
+    RosSegmentHandle            m_hBinnerOverspillPool;
+    UINT                        m_binnerOverspillPoolPhysicalAddress;
+
+    // Driver heap blocks holding aperture copies of the DMA buffer of each
+    // slot of the hardware queue
+    RosSegmentHandle            m_hApertureBounce[RosHwQueue::kMaxSlots][VC4_MAX_APERTURE_BOUNCE];
+    UINT                        m_numApertureBounce[RosHwQueue::kMaxSlots];
+    ULONGLONG                   m_apertureBytesBounced;
+
+    //
+    // DMA buffers carry the uniforms they don't read in place, the
+    // uniform cache may still have those of an earlier DMA buffer at the
+    // same address. Bus addresses of the DMA buffers run since the last
+    // flush of the uniform cache.
+    //
+
+    static const UINT           kMaxDmaBuffersSinceFlush = 8;
+
+    UINT                        m_dmaBuffersSinceFlush[kMaxDmaBuffersSinceFlush];
+    UINT                        m_numDmaBuffersSinceFlush;
+
+    // Cache maintenance statistics
+    ULONGLONG                   m_bytesCleaned;
+    UINT                        m_fullCacheCleans;
+    UINT                        m_gpuCacheFlushes;
+
     // Firmware device RPIQ
     PFILE_OBJECT                m_pRpiqDevice;
 
@@ -583,9 +901,51 @@ public: // PAGED
         );
 };
 
+//
+// Traces the begin and end of a stage around a scope with early returns
+//
+
+class RosKmdTraceScope
+{
+public:
+
+    RosKmdTraceScope(
+        RosKmAdapter *  pRosKmAdapter,
+        RosTraceStage   stage,
+        UINT            fenceId,
+        ULONGLONG       submission) :
+        m_pRosKmAdapter(pRosKmAdapter),
+        m_stage(stage),
+        m_fenceId(fenceId),
+        m_submission(submission)
+    {
+        m_pRosKmAdapter->Trace(m_stage, ROS_TRACE_BEGIN, m_fenceId, m_submission);
+    }
+
+    ~RosKmdTraceScope()
+    {
+        m_pRosKmAdapter->Trace(m_stage, ROS_TRACE_END, m_fenceId, m_submission);
+    }
+
+private:
+
+    RosKmAdapter *  m_pRosKmAdapter;
+    RosTraceStage   m_stage;
+    UINT            m_fenceId;
+    ULONGLONG       m_submission;
+};
+
 template<typename TypeCur, typename TypeNext>
 void MoveToNextCommand(TypeCur pCurCommand, TypeNext &pNextCommand)
 {
     pNextCommand = (TypeNext)(pCurCommand + 1);
 }
 
+template<typename TypeCommand>
+void WriteCommand(PBYTE &pCommand, const TypeCommand &command)
+{
+    *((TypeCommand *)pCommand) = command;
+
+    pCommand += sizeof(TypeCommand);
+}
+
@@ -2,6 +2,9 @@
 
 struct RosKmdAllocation : public RosAllocationExchange
 {
+    // Submission fence of the last DMA buffer rendering to it, ties the
+    // flip of a primary to its frame in the trace
+    UINT                m_lastRenderFenceId;
 };
 
 struct RosKmdDeviceAllocation
@@ -22,6 +22,13 @@ RosKmContext::DdiRender(
     RosKmContext  *pRosKmContext = RosKmContext::Cast(hContext);
     RosKmAdapter  *pRosKmAdapter = pRosKmContext->m_pDevice->m_pRosKmAdapter;
 
+    ROSDMABUFINFO * pDmaBufInfo = (ROSDMABUFINFO *)pRender->pDmaBufferPrivateData;
+
+    // The fence is only known once the DMA buffer is submitted
+    pDmaBufInfo->m_TraceSubmission = pRosKmAdapter->NewTraceSubmission();
+
+    RosKmdTraceScope traceScope(pRosKmAdapter, ROS_TRACE_RENDER, 0, pDmaBufInfo->m_TraceSubmission);
+
     pRender->MultipassOffset;
     pRender->DmaBufferSegmentId;
     pRender->DmaBufferPhysicalAddress;
@@ -78,8 +85,6 @@ RosKmContext::DdiRender(
     pRender->pPatchLocationListOut += pRender->PatchLocationListInSize;
 
     // Record DMA buffer information
-    ROSDMABUFINFO * pDmaBufInfo = (ROSDMABUFINFO *)pRender->pDmaBufferPrivateData;
-
     pDmaBufInfo->m_DmaBufState.m_Value = 0;
     pDmaBufInfo->m_DmaBufState.m_bRender = 1;
     pDmaBufInfo->m_DmaBufState.m_bSwCommandBuffer = pCmdBufHeader->m_commandBufferHeader.m_swCommandBuffer;
@@ -89,6 +94,16 @@ RosKmContext::DdiRender(
     pDmaBufInfo->m_DmaBufferSize = pRender->DmaSize;
 
     pDmaBufInfo->m_pRenderTarget = NULL;
+    pDmaBufInfo->m_pDepthStencil = NULL;
+    pDmaBufInfo->m_pResolveTarget = NULL;
+    pDmaBufInfo->m_NumApertureBounce = 0;
+
+    RtlZeroMemory(&pDmaBufInfo->m_VC4PerfCounters, sizeof(pDmaBufInfo->m_VC4PerfCounters));
+    RtlZeroMemory(pDmaBufInfo->m_pPerfCounterReports, sizeof(pDmaBufInfo->m_pPerfCounterReports));
+    RtlZeroMemory(pDmaBufInfo->m_PerfCounterValues, sizeof(pDmaBufInfo->m_PerfCounterValues));
+
+    RtlZeroMemory(&pDmaBufInfo->m_VC4CacheMaintenance, sizeof(pDmaBufInfo->m_VC4CacheMaintenance));
+    RtlZeroMemory(pDmaBufInfo->m_CacheCleans, sizeof(pDmaBufInfo->m_CacheCleans));
 
     // Validate DMA buffer
     bool isValidDmaBuffer;
@@ -106,10 +121,92 @@ RosKmContext::DdiRender(
         return STATUS_INVALID_PARAMETER;
     }
 
+    //
+    // The clear colors have the clear depth and stencil too
+    //
+
+    pDmaBufInfo->m_VC4ClearColors = pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors;
+    pDmaBufInfo->m_VC4ClearColors.CommandCode = VC4_CMD_CLEAR_COLOR;
+
     if (pCmdBufHeader->m_commandBufferHeader.m_hasVC4ClearColors)
     {
         pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors = 1;
-        pDmaBufInfo->m_VC4ClearColors = pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors;
+    }
+
+    if (pCmdBufHeader->m_commandBufferHeader.m_vc4DepthOnly)
+    {
+        pDmaBufInfo->m_DmaBufState.m_bDepthOnly = 1;
+    }
+
+    if (pDmaBufInfo->m_pDepthStencil)
+    {
+        pDmaBufInfo->m_VC4DepthStencil = pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil;
+    }
+    else
+    {
+        RtlZeroMemory(&pDmaBufInfo->m_VC4DepthStencil, sizeof(pDmaBufInfo->m_VC4DepthStencil));
+    }
+
+    if (pDmaBufInfo->m_pResolveTarget)
+    {
+        pDmaBufInfo->m_VC4Resolve = pCmdBufHeader->m_commandBufferHeader.m_vc4Resolve;
+    }
+    else
+    {
+        RtlZeroMemory(&pDmaBufInfo->m_VC4Resolve, sizeof(pDmaBufInfo->m_VC4Resolve));
+    }
+
+    pDmaBufInfo->m_VC4DirtyRect = pCmdBufHeader->m_commandBufferHeader.m_vc4DirtyRect;
+
+    if (pCmdBufHeader->m_commandBufferHeader.m_hasVC4PerfCounters)
+    {
+        if (pCmdBufHeader->m_commandBufferHeader.m_vc4PerfCounters.m_numCounters > V3D_NUM_PERF_COUNTERS)
+        {
+            ROS_LOG_ERROR("DMA buffer samples too many performance counters. (pDmaBufInfo=0x%p)", pDmaBufInfo);
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters = 1;
+        pDmaBufInfo->m_VC4PerfCounters = pCmdBufHeader->m_commandBufferHeader.m_vc4PerfCounters;
+    }
+
+    if (pCmdBufHeader->m_commandBufferHeader.m_hasVC4CacheMaintenance &&
+        !pDmaBufInfo->m_DmaBufState.m_bSwCommandBuffer)
+    {
+        if (pCmdBufHeader->m_commandBufferHeader.m_vc4CacheMaintenance.m_numCleans > VC4_MAX_CACHE_CLEAN)
+        {
+            ROS_LOG_ERROR("DMA buffer cleans too many ranges. (pDmaBufInfo=0x%p)", pDmaBufInfo);
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        pDmaBufInfo->m_DmaBufState.m_HasVC4CacheMaintenance = 1;
+        pDmaBufInfo->m_VC4CacheMaintenance = pCmdBufHeader->m_commandBufferHeader.m_vc4CacheMaintenance;
+    }
+
+    if (pCmdBufHeader->m_commandBufferHeader.m_vc4PassContinues &&
+        !pDmaBufInfo->m_DmaBufState.m_bSwCommandBuffer)
+    {
+        UINT    bodyOffset = pCmdBufHeader->m_commandBufferHeader.m_vc4PassBodyOffset;
+        UINT    epilogOffset = pCmdBufHeader->m_commandBufferHeader.m_vc4PassEpilogOffset;
+
+        //
+        // The KMD writes a Branch over the epilog and to the draws of the
+        // DMA buffer continuing the pass
+        //
+
+        if ((pRender->CommandLength < VC4_BINNING_EPILOG_SIZE) ||
+            (bodyOffset < sizeof(GpuCommand)) ||
+            (bodyOffset > epilogOffset) ||
+            (epilogOffset > pRender->CommandLength - VC4_BINNING_EPILOG_SIZE) ||
+            (((PBYTE)pRender->pDmaBuffer)[epilogOffset] != VC4_CMD_INCREMENT_SEMAPHORE))
+        {
+            ROS_LOG_ERROR("DMA buffer continues the render pass at an invalid offset. (pDmaBufInfo=0x%p)", pDmaBufInfo);
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        pDmaBufInfo->m_DmaBufState.m_bPassContinues = 1;
+        pDmaBufInfo->m_PassBodyOffset = bodyOffset;
+        pDmaBufInfo->m_PassEpilogOffset = epilogOffset;
     }
 
     // Perform pre-patch
@@ -18,11 +18,26 @@ bool g_bUseSimPenrose = false;
 
 bool g_bUseInterrupt = true;
 
+//
+// Order of the tiles of the Rendering Control List, ROS_TILE_ORDER_AUTO
+// picks it for the layout of the render target
+//
+RosTileOrderType g_tileOrder = ROS_TILE_ORDER_AUTO;
+
 RosKmdRapAdapter::RosKmdRapAdapter(IN_CONST_PDEVICE_OBJECT PhysicalDeviceObject, OUT_PPVOID MiniportDeviceContext) :
     RosKmAdapter(PhysicalDeviceObject, MiniportDeviceContext)
 {
     m_pVC4RegFile = NULL;
     m_flags.m_isVC4 = TRUE;
+
+    KeInitializeSpinLock(&m_hwQueueLock);
+    RtlZeroMemory(m_hwDmaBufs, sizeof(m_hwDmaBufs));
+
+    m_hwInterrupts = 0;
+    m_hwResets = 0;
+    m_hwResetDmaBufs = 0;
+
+    m_renderPassSlot = RosHwQueue::kNoSlot;
 }
 
 RosKmdRapAdapter::~RosKmdRapAdapter()
@@ -194,20 +209,25 @@ RosKmdRapAdapter::Start(
     m_localVidMemSegmentSize = ((UINT)RosKmdGlobal::s_videoMemorySize) -
         (VC4_RENDERING_CTRL_LIST_POOL_SIZE +
             VC4_TILE_ALLOCATION_MEMORY_SIZE +
-            VC4_TILE_STATE_DATA_ARRAY_SIZE);
+            VC4_TILE_STATE_DATA_ARRAY_SIZE +
+            VC4_APERTURE_BOUNCE_SIZE +
+            VC4_BINNER_OVERSPILL_POOL_SIZE);
 
-    m_pControlListPool = ((PBYTE)RosKmdGlobal::s_pVideoMemory) + m_localVidMemSegmentSize;
+    status = InitDriverHeap();
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
 
-    NT_ASSERT(0 == RosKmdGlobal::s_videoMemoryPhysicalAddress.HighPart);
-    m_controlListPoolPhysicalAddress = RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart + m_localVidMemSegmentSize;
-    m_tileAllocPoolPhysicalAddress = m_controlListPoolPhysicalAddress + VC4_RENDERING_CTRL_LIST_POOL_SIZE;
-    m_tileStatePoolPhysicalAddress = m_tileAllocPoolPhysicalAddress + VC4_TILE_ALLOCATION_MEMORY_SIZE;
+    //
+    // Give the binner its first overspill block
+    //
 
-    m_pRenderingControlList = m_pControlListPool;
-    m_renderingControlListPhysicalAddress = m_controlListPoolPhysicalAddress;
+    KIRQL   oldIrql;
 
-    m_tileAllocationMemoryPhysicalAddress = m_tileAllocPoolPhysicalAddress;
-    m_tileStateDataArrayPhysicalAddress = m_tileStatePoolPhysicalAddress;
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+    SupplyBinnerMemory();
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
 
 #endif // VC4
 
@@ -221,20 +241,7 @@ RosKmdRapAdapter::Start(
 
     if (g_bUseInterrupt)
     {
-        //
-        // Enable End of Frame interrupt when Render Control List completes
-        //
-
-        V3D_REG_INTENA  regIntEna = { 0 };
-
-        regIntEna.EI_FRDONE = 1;
-
-        // TODO[jordanrh]: register operations should use READ/WRITE_REGISTER_ULONG
-        WRITE_REGISTER_ULONG(reinterpret_cast<volatile ULONG*>(
-            &m_pVC4RegFile->V3D_INTENA),
-            regIntEna.Value);
-
-        m_bReadyToHandleInterrupt = TRUE;
+        EnableInterrupts();
         disableInterrupt.DoNot(false);
     }
 
@@ -332,16 +339,19 @@ NTSTATUS RosKmdRapAdapter::Stop ()
     return RosKmAdapter::Stop();
 }
 
-void
+bool
 RosKmdRapAdapter::ProcessRenderBuffer(
     ROSDMABUFSUBMISSION * pDmaBufSubmission)
-{   
+{
     ROSDMABUFINFO * pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
 
     if (pDmaBufInfo->m_DmaBufState.m_bSwCommandBuffer)
     {
         NT_ASSERT(0 == (pDmaBufSubmission->m_EndOffset - pDmaBufSubmission->m_StartOffset) % sizeof(GpuCommand));
 
+        // The commands run on the CPU after the DMA buffers queued before
+        WaitForGpuIdle();
+
         GpuCommand * pGpuCommand = (GpuCommand *)(pDmaBufInfo->m_pDmaBuffer + pDmaBufSubmission->m_StartOffset);
         GpuCommand * pEndofCommand = (GpuCommand *)(pDmaBufInfo->m_pDmaBuffer + pDmaBufSubmission->m_EndOffset);
 
@@ -354,6 +364,9 @@ RosKmdRapAdapter::ProcessRenderBuffer(
                 break;
             case ResourceCopy:
             {
+                // The source may have been written by the GPU
+                KeInvalidateRangeAllCaches(((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_resourceCopy.m_srcGpuAddress.QuadPart, (ULONG)pGpuCommand->m_resourceCopy.m_sizeBytes);
+
                 RtlCopyMemory(
                     ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_resourceCopy.m_dstGpuAddress.QuadPart,
                     ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_resourceCopy.m_srcGpuAddress.QuadPart,
@@ -361,6 +374,56 @@ RosKmdRapAdapter::ProcessRenderBuffer(
 				KeInvalidateRangeAllCaches(((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_resourceCopy.m_dstGpuAddress.QuadPart, (ULONG)pGpuCommand->m_resourceCopy.m_sizeBytes);
             }
             break;
+            case Timestamp:
+                ReportTimestamp(pGpuCommand->m_timestamp.m_reportGpuAddress);
+                break;
+            case CacheInvalidate:
+                KeInvalidateRangeAllCaches(
+                    ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_cacheInvalidate.m_gpuAddress.QuadPart,
+                    (ULONG)pGpuCommand->m_cacheInvalidate.m_sizeBytes);
+                break;
+            case MaskedFill:
+            {
+                // The GPU may have written the depth stencil buffer, the
+                // tile buffer reads the fill from memory
+                UINT *  pWords = (UINT *)(((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_maskedFill.m_gpuAddress.QuadPart);
+
+                KeInvalidateRangeAllCaches(pWords, (ULONG)pGpuCommand->m_maskedFill.m_sizeBytes);
+
+                for (size_t i = 0; i < pGpuCommand->m_maskedFill.m_sizeBytes / sizeof(UINT); i++)
+                {
+                    pWords[i] = (pWords[i] & ~pGpuCommand->m_maskedFill.m_mask) | pGpuCommand->m_maskedFill.m_value;
+                }
+
+                KeInvalidateRangeAllCaches(pWords, (ULONG)pGpuCommand->m_maskedFill.m_sizeBytes);
+            }
+            break;
+            case MsaaResolve:
+            {
+                // The GPU stored the samples, the next pass may read the
+                // resolved render target
+                const GpuMsaaResolve *  pResolve = &pGpuCommand->m_msaaResolve;
+                BYTE *  pSrc = ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pResolve->m_srcGpuAddress.QuadPart;
+                BYTE *  pDst = ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pResolve->m_dstGpuAddress.QuadPart;
+                ULONG   srcSize = pResolve->m_srcWidthInTiles * RosMsaa::GetTiles(pResolve->m_height) * RosMsaa::kTileBytes;
+                ULONG   dstSize = pResolve->m_bDstTFormat ?
+                    RosTFormat::GetSizeBytes(pResolve->m_width, pResolve->m_height, RosMsaa::kSampleBytes) :
+                    pResolve->m_dstPitchBytes * pResolve->m_height;
+
+                KeInvalidateRangeAllCaches(pSrc, srcSize);
+
+                RosMsaa::Resolve(
+                    pSrc,
+                    pResolve->m_srcWidthInTiles,
+                    pDst,
+                    pResolve->m_dstPitchBytes,
+                    pResolve->m_bDstTFormat != 0,
+                    pResolve->m_width,
+                    pResolve->m_height);
+
+                KeInvalidateRangeAllCaches(pDst, dstSize);
+            }
+            break;
             default:
                 break;
             }
@@ -378,6 +441,14 @@ RosKmdRapAdapter::ProcessRenderBuffer(
 
         if (g_bUseSimPenrose)
         {
+            //
+            // Copy the aperture allocations the GPU can't read in place
+            //
+
+            BounceApertureReferences(pDmaBufInfo, 0);
+
+            PrepareTileAllocationMemory(pDmaBufInfo);
+
             //
             // SimPenrose requires CL to be in the "local video memory segment"
             //
@@ -408,16 +479,32 @@ RosKmdRapAdapter::ProcessRenderBuffer(
                 binningCLPhysicalAddress + m_busAddressOffset + pDmaBufSubmission->m_EndOffset);
 
             //
-            // Generate the Rendering Control List
+            // Generate the Rendering Control List of the DMA buffer alone
             //
+            RosRenderPass       renderPass;
+            RosRenderPassDmaBuf passDmaBuf;
+
+            GetRenderPassDmaBuf(pDmaBufInfo, &passDmaBuf);
+
+            renderPass.Add(passDmaBuf);
+
             UINT    renderingControlListLength;
-            renderingControlListLength = GenerateRenderingControlList(pDmaBufInfo);
+            renderingControlListLength = GenerateRenderingControlList(
+                pDmaBufInfo,
+                pDmaBufInfo,
+                renderPass.LoadsColor(),
+                renderPass.StoresColor(),
+                renderPass.LoadsDepthStencil(),
+                renderPass.StoresDepthStencil(),
+                renderPass.GetDirtyTiles());
 
             simpenrose_do_rendering(
                 m_renderingControlListPhysicalAddress + m_busAddressOffset,
                 m_renderingControlListPhysicalAddress + m_busAddressOffset + renderingControlListLength);
 
             MoveToNextBinnerRenderMemChunk(renderingControlListLength);
+
+            ReleaseApertureBounce(0);
         }
         else
 
@@ -425,101 +512,386 @@ RosKmdRapAdapter::ProcessRenderBuffer(
 
         if (m_flags.m_isVC4)
         {
-            //
-            // TODO[indyz]:
-            //
-            // 1. Submit the Binning and Rendering Control list simultaneously
-            //    and use semaphore for synchronization
-            // 2. Enable interrupt to signal end of frame
-            //
+            RosRenderPassDmaBuf passDmaBuf;
 
-            //
-            // Generate the Rendering Control List
-            //
-            UINT    renderingControlListLength;
-            renderingControlListLength = GenerateRenderingControlList(pDmaBufInfo);
+            GetRenderPassDmaBuf(pDmaBufInfo, &passDmaBuf);
+
+            if (passDmaBuf.m_bContinues)
+            {
+                //
+                // A DMA buffer run again may still have the Branch of the
+                // pass it was in
+                //
+
+                PBYTE   pEpilog = pDmaBufInfo->m_pDmaBuffer + pDmaBufInfo->m_PassEpilogOffset;
+
+                pEpilog[0] = VC4_CMD_INCREMENT_SEMAPHORE;
+                pEpilog[1] = VC4_CMD_FLUSH_ALL_STATE;
+                pEpilog[2] = VC4_CMD_NOP;
+                pEpilog[3] = VC4_CMD_NOP;
+                pEpilog[4] = VC4_CMD_HALT;
+            }
+
+            if (m_renderPassSlot != RosHwQueue::kNoSlot)
+            {
+                if (m_renderPass.CanAppend(passDmaBuf))
+                {
+                    AppendToRenderPass(pDmaBufSubmission, passDmaBuf);
 
+                    return false;
+                }
 
+                SubmitRenderPass();
+            }
 
-            // TODO[indyz]: Decide the best way to handle the cache
             //
-            //KeInvalidateAllCaches();
-			KeInvalidateRangeAllCaches((PVOID)pDmaBufInfo->m_DmaBufferPhysicalAddress.LowPart, m_busAddressOffset);
+            // The tile allocation memory is resized before the slot is
+            // reserved, it may wait for the GPU to be idle
+            //
+
+            UINT            tileAllocationMemorySize = PrepareTileAllocationMemory(pDmaBufInfo);
 
             //
-            // Flush the VC4 GPU caches
+            // Prepare the DMA buffer in a slot of the hardware queue while
+            // the GPU runs the ones before it
             //
-#if 1
-            V3D_REG_L2CACTL regL2CACTL = { 0 };
 
-            regL2CACTL.L2CCLR = 1;
+            UINT            slot = ReserveHwDmaBuffer();
+            ROSHWDMABUF    *pHwDmaBuf = &m_hwDmaBufs[slot];
 
-            m_pVC4RegFile->V3D_L2CACTL = regL2CACTL.Value;
+            pHwDmaBuf->m_tileAllocationMemorySize = tileAllocationMemorySize;
 
-            V3D_REG_SLCACTL regSLCACTL = { 0 };
+            //
+            // Copy the aperture allocations the GPU can't read in place
+            //
 
-            regSLCACTL.ICCS0123 = 0xF;
-            regSLCACTL.UCCS0123 = 0xF;
-            regSLCACTL.T0CCS0123 = 0xF;
-            regSLCACTL.T1CCS0123 = 0xF;
+            if (!BounceApertureReferences(pDmaBufInfo, slot))
+            {
+                ROS_LOG_ERROR(
+                    "DMA buffer not run, its aperture references can't be patched. (fenceId=%d)",
+                    pDmaBufSubmission->m_SubmissionFenceId);
 
-            m_pVC4RegFile->V3D_SLCACTL = regSLCACTL.Value;
+                ReleaseApertureBounce(slot);
 
-#endif
+                KIRQL   oldIrql;
 
-            //
-            // Submit the Binning Control List from UMD to the GPU
-            //
-            NT_ASSERT(pDmaBufInfo->m_DmaBufferPhysicalAddress.HighPart == 0);
-            NT_ASSERT(pDmaBufInfo->m_DmaBufferSize <= kPageSize);
+                KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+                m_hwQueue.Unreserve(slot);
+                KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
 
-            UINT dmaBufBaseAddress;
+                //
+                // It is completed once the DMA buffers before it are, its
+                // queries report the counters as zero
+                //
 
-            dmaBufBaseAddress = GetAperturePhysicalAddress(pDmaBufInfo->m_DmaBufferPhysicalAddress.LowPart);
-            dmaBufBaseAddress += m_busAddressOffset;
+                WaitForGpuIdle();
 
-#if DBG
+                if (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+                {
+                    RtlZeroMemory(pDmaBufInfo->m_PerfCounterValues, sizeof(pDmaBufInfo->m_PerfCounterValues));
+                }
 
-            m_pVC4RegFile->V3D_PCTRC = ((1 << V3D_NUM_PERF_COUNTERS) - 1);
+                return true;
+            }
 
-#endif
+            NT_ASSERT(pDmaBufInfo->m_DmaBufferPhysicalAddress.HighPart == 0);
+            NT_ASSERT(pDmaBufInfo->m_DmaBufferSize <= kPageSize);
 
-            // Skip the command buffer header at the beginning
-            SubmitControlList(
-                true,
-                dmaBufBaseAddress + pDmaBufSubmission->m_StartOffset + sizeof(GpuCommand),
-                dmaBufBaseAddress + pDmaBufSubmission->m_EndOffset);
+            UINT dmaBufBaseAddress = GetDmaBufBusAddress(pDmaBufInfo);
 
-#if DBG
+            pHwDmaBuf->m_pDmaBufSubmission = pDmaBufSubmission;
+            pHwDmaBuf->m_numChainedDmaBufSubmissions = 0;
 
-            m_pVC4RegFile->V3D_PCTRC = ((1 << V3D_NUM_PERF_COUNTERS) - 1);
+            // Skip the command buffer header at the beginning
+            pHwDmaBuf->m_binningStart = dmaBufBaseAddress + pDmaBufSubmission->m_StartOffset + sizeof(GpuCommand);
+            pHwDmaBuf->m_binningEnd = dmaBufBaseAddress + pDmaBufSubmission->m_EndOffset;
 
-#endif
+            m_renderPassSlot = slot;
 
             //
-            // Submit the Rendering Control List to the GPU
+            // A DMA buffer flushed in the middle of the pass is held for the
+            // one continuing it, the worker thread submits it if the GPU
+            // would idle first
             //
-            SubmitControlList(
-                false,
-                m_renderingControlListPhysicalAddress + m_busAddressOffset,
-                m_renderingControlListPhysicalAddress + m_busAddressOffset + renderingControlListLength);
 
-            ROS_LOG_TRACE(
-                "Completed rendering to 0x%p",
-                pDmaBufInfo->m_RenderTargetVirtualAddress);
-                
-            MoveToNextBinnerRenderMemChunk(renderingControlListLength);
+            if (!m_renderPass.Add(passDmaBuf))
+            {
+                SubmitRenderPass();
+            }
 
             //
-            // Flush the VC4 GPU caches
+            // Completed from the DPC of the frame done interrupt
             //
-#if 1
-            m_pVC4RegFile->V3D_L2CACTL = regL2CACTL.Value;
-            m_pVC4RegFile->V3D_SLCACTL = regSLCACTL.Value;
-#endif
+            return false;
         }
+
 #endif  // VC4
     }
+
+    return true;
+}
+
+void
+RosKmdRapAdapter::GetRenderPassDmaBuf(
+    ROSDMABUFINFO *         pDmaBufInfo,
+    RosRenderPassDmaBuf *   pPassDmaBuf)
+{
+    RosKmdAllocation   *pRenderTarget = pDmaBufInfo->m_pRenderTarget;
+    UINT                tilePixels = Vc4TilePixels(*pRenderTarget);
+
+    pPassDmaBuf->m_renderTarget = pDmaBufInfo->m_RenderTargetPhysicalAddress;
+    pPassDmaBuf->m_widthInTiles = Vc4WidthInTiles(*pRenderTarget);
+    pPassDmaBuf->m_heightInTiles = Vc4HeightInTiles(*pRenderTarget);
+
+    //
+    // The tiles under the clip windows of the draws. The resolving store
+    // writes the tiles of the whole resolve target.
+    //
+
+    const VC4DirtyRect &    dirtyRect = pDmaBufInfo->m_VC4DirtyRect;
+
+    if (pDmaBufInfo->m_pResolveTarget)
+    {
+        pPassDmaBuf->m_dirtyTiles.m_left = 0;
+        pPassDmaBuf->m_dirtyTiles.m_top = 0;
+        pPassDmaBuf->m_dirtyTiles.m_right = pPassDmaBuf->m_widthInTiles;
+        pPassDmaBuf->m_dirtyTiles.m_bottom = pPassDmaBuf->m_heightInTiles;
+    }
+    else if ((dirtyRect.m_left < dirtyRect.m_right) && (dirtyRect.m_top < dirtyRect.m_bottom))
+    {
+        pPassDmaBuf->m_dirtyTiles.m_left = dirtyRect.m_left / tilePixels;
+        pPassDmaBuf->m_dirtyTiles.m_top = dirtyRect.m_top / tilePixels;
+        pPassDmaBuf->m_dirtyTiles.m_right = (dirtyRect.m_right + tilePixels - 1) / tilePixels;
+        pPassDmaBuf->m_dirtyTiles.m_bottom = (dirtyRect.m_bottom + tilePixels - 1) / tilePixels;
+    }
+    else
+    {
+        RtlZeroMemory(&pPassDmaBuf->m_dirtyTiles, sizeof(pPassDmaBuf->m_dirtyTiles));
+    }
+
+    //
+    // Without a render target the depth stencil buffer stands in for it,
+    // there is no color to clear or store
+    //
+
+    bool    bColorBuffer = (pRenderTarget->m_hwFormat != RosHwFormat::D24S8);
+
+    pPassDmaBuf->m_bClear = (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors != 0) && bColorBuffer;
+    pPassDmaBuf->m_bContinues = (pDmaBufInfo->m_DmaBufState.m_bPassContinues != 0);
+    pPassDmaBuf->m_bPerfCounters = (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters != 0);
+    pPassDmaBuf->m_bApertureBounce = (pDmaBufInfo->m_NumApertureBounce != 0);
+
+    pPassDmaBuf->m_depthStencil = pDmaBufInfo->m_pDepthStencil ? pDmaBufInfo->m_DepthStencilPhysicalAddress : 0;
+    pPassDmaBuf->m_clearDepthStencil = (pDmaBufInfo->m_VC4ClearColors.ClearZ << 8) | pDmaBufInfo->m_VC4ClearColors.ClearStencil;
+    pPassDmaBuf->m_bClearDepthStencil = (pDmaBufInfo->m_VC4DepthStencil.m_bClear != 0);
+    pPassDmaBuf->m_bDepthStencilUsed = (pDmaBufInfo->m_VC4DepthStencil.m_bUsed != 0);
+    pPassDmaBuf->m_bDepthStencilWritten = (pDmaBufInfo->m_VC4DepthStencil.m_bWritten != 0);
+    pPassDmaBuf->m_bDiscardDepthStencil = (pDmaBufInfo->m_VC4DepthStencil.m_bDiscard != 0);
+
+    // The resolving store writes the color of the resolve target
+    pPassDmaBuf->m_bDepthOnly =
+        ((pDmaBufInfo->m_DmaBufState.m_bDepthOnly != 0) || !bColorBuffer) &&
+        !pDmaBufInfo->m_pResolveTarget;
+}
+
+//
+// Chains the Binning Control List of the DMA buffer to the held pass: the
+// Branch replaces the epilog of the last one and skips the Tile Binning
+// Mode Config of this one, the tile lists of the pass are rendered once
+//
+
+void
+RosKmdRapAdapter::AppendToRenderPass(
+    ROSDMABUFSUBMISSION *       pDmaBufSubmission,
+    const RosRenderPassDmaBuf & passDmaBuf)
+{
+    ROSHWDMABUF    *pHwDmaBuf = &m_hwDmaBufs[m_renderPassSlot];
+    ROSDMABUFINFO  *pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+    ROSDMABUFINFO  *pLastDmaBufInfo = pHwDmaBuf->m_numChainedDmaBufSubmissions ?
+                        pHwDmaBuf->m_pChainedDmaBufSubmissions[pHwDmaBuf->m_numChainedDmaBufSubmissions - 1]->m_pDmaBufInfo :
+                        pHwDmaBuf->m_pDmaBufSubmission->m_pDmaBufInfo;
+
+    NT_ASSERT(pLastDmaBufInfo->m_DmaBufState.m_bPassContinues);
+    NT_ASSERT(pHwDmaBuf->m_numChainedDmaBufSubmissions < RosRenderPass::kMaxDmaBuffers - 1);
+
+    UINT    dmaBufBaseAddress = GetDmaBufBusAddress(pDmaBufInfo);
+
+    VC4Branch * pVC4Branch = (VC4Branch *)(pLastDmaBufInfo->m_pDmaBuffer + pLastDmaBufInfo->m_PassEpilogOffset);
+    VC4Branch   branch = vc4Branch;
+
+    branch.BranchAddress = dmaBufBaseAddress + pDmaBufInfo->m_PassBodyOffset;
+
+    *pVC4Branch = branch;
+
+    pHwDmaBuf->m_pChainedDmaBufSubmissions[pHwDmaBuf->m_numChainedDmaBufSubmissions++] = pDmaBufSubmission;
+    pHwDmaBuf->m_binningEnd = dmaBufBaseAddress + pDmaBufSubmission->m_EndOffset;
+
+    if (!m_renderPass.Add(passDmaBuf))
+    {
+        SubmitRenderPass();
+    }
+}
+
+//
+// Generates the Rendering Control List of the held pass and queues it
+//
+
+void
+RosKmdRapAdapter::SubmitRenderPass()
+{
+    UINT                    slot = m_renderPassSlot;
+    ROSHWDMABUF            *pHwDmaBuf = &m_hwDmaBufs[slot];
+    ROSDMABUFSUBMISSION    *pDmaBufSubmission = pHwDmaBuf->m_pDmaBufSubmission;
+    ROSDMABUFINFO          *pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+    ROSDMABUFINFO          *pLastDmaBufInfo = pHwDmaBuf->m_numChainedDmaBufSubmissions ?
+                                pHwDmaBuf->m_pChainedDmaBufSubmissions[pHwDmaBuf->m_numChainedDmaBufSubmissions - 1]->m_pDmaBufInfo :
+                                pDmaBufInfo;
+
+    NT_ASSERT(slot != RosHwQueue::kNoSlot);
+
+    m_renderPassSlot = RosHwQueue::kNoSlot;
+
+    //
+    // Generate the Rendering Control List in the part of the pool of the
+    // slot, the first DMA buffer of the pass has its clear colors and the
+    // last one the resolve target. The depth stencil buffer is loaded and
+    // stored for the whole pass.
+    //
+    UINT    renderingControlListLength;
+
+    m_pRenderingControlList = m_pControlListPool + slot * kRenderingControlListSlotSize;
+    m_renderingControlListPhysicalAddress = m_controlListPoolPhysicalAddress + slot * kRenderingControlListSlotSize;
+
+    Trace(ROS_TRACE_GENERATE_RCL, ROS_TRACE_BEGIN, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+    renderingControlListLength = GenerateRenderingControlList(
+        pDmaBufInfo,
+        pLastDmaBufInfo,
+        m_renderPass.LoadsColor(),
+        m_renderPass.StoresColor(),
+        m_renderPass.LoadsDepthStencil(),
+        m_renderPass.StoresDepthStencil(),
+        m_renderPass.GetDirtyTiles());
+
+    Trace(ROS_TRACE_GENERATE_RCL, ROS_TRACE_END, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+    NT_ASSERT(renderingControlListLength <= kRenderingControlListSlotSize);
+
+    //
+    // Clean what the CPU wrote for the DMA buffers, Branches included, the
+    // VC4 GPU caches that may have old contents of what they read are
+    // flushed when the pass starts
+    //
+    pHwDmaBuf->m_gpuCaches = MaintainCaches(pDmaBufSubmission, GetDmaBufBusAddress(pDmaBufInfo), renderingControlListLength);
+
+    for (UINT i = 0; i < pHwDmaBuf->m_numChainedDmaBufSubmissions; i++)
+    {
+        ROSDMABUFSUBMISSION    *pChained = pHwDmaBuf->m_pChainedDmaBufSubmissions[i];
+
+        pHwDmaBuf->m_gpuCaches |= MaintainCaches(pChained, GetDmaBufBusAddress(pChained->m_pDmaBufInfo), 0);
+    }
+
+    //
+    // Every DMA buffer of the pass reads its uniforms after the flush
+    //
+    C_ASSERT(RosRenderPass::kMaxDmaBuffers <= kMaxDmaBuffersSinceFlush);
+
+    if (pHwDmaBuf->m_numChainedDmaBufSubmissions && (pHwDmaBuf->m_gpuCaches & VC4_GPU_CACHE_UNIFORM))
+    {
+        m_numDmaBuffersSinceFlush = 0;
+
+        m_dmaBuffersSinceFlush[m_numDmaBuffersSinceFlush++] = GetDmaBufBusAddress(pDmaBufInfo);
+
+        for (UINT i = 0; i < pHwDmaBuf->m_numChainedDmaBufSubmissions; i++)
+        {
+            m_dmaBuffersSinceFlush[m_numDmaBuffersSinceFlush++] = GetDmaBufBusAddress(pHwDmaBuf->m_pChainedDmaBufSubmissions[i]->m_pDmaBufInfo);
+        }
+    }
+
+    pHwDmaBuf->m_renderingStart = m_renderingControlListPhysicalAddress + m_busAddressOffset;
+    pHwDmaBuf->m_renderingEnd = pHwDmaBuf->m_renderingStart + renderingControlListLength;
+
+    MoveToNextBinnerRenderMemChunk(renderingControlListLength);
+
+    m_renderPass.Close();
+
+    QueueHwDmaBuffer(slot);
+
+    ROS_LOG_TRACE(
+        "Queued rendering to 0x%p. (numDmaBuffers=%d, tileLoads=%I64d, tileStores=%I64d, depthOnlyPasses=%I64d, depthStencilLoadBytes=%I64d, depthStencilStoreBytes=%I64d)",
+        pDmaBufInfo->m_RenderTargetVirtualAddress,
+        1 + pHwDmaBuf->m_numChainedDmaBufSubmissions,
+        m_renderPass.GetTileLoads(),
+        m_renderPass.GetTileStores(),
+        m_renderPass.GetDepthOnlyCount(),
+        m_renderPass.GetDepthStencilLoadBytes(),
+        m_renderPass.GetDepthStencilStoreBytes());
+
+    if (!g_bUseInterrupt)
+    {
+        //
+        // Without the interrupt the worker thread polls the GPU until the
+        // DMA buffer is done
+        //
+        WaitForGpuIdle();
+    }
+}
+
+//
+// The held pass is submitted rather than let the GPU idle waiting for the
+// DMA buffer continuing it
+//
+
+void
+RosKmdRapAdapter::SubmitHeldDmaBuffers()
+{
+    if ((m_renderPassSlot != RosHwQueue::kNoSlot) &&
+        (m_hwQueue.GetRunningSlot() == RosHwQueue::kNoSlot))
+    {
+        SubmitRenderPass();
+    }
+}
+
+UINT
+RosKmdRapAdapter::GetDmaBufBusAddress(
+    ROSDMABUFINFO * pDmaBufInfo)
+{
+    return GetAperturePhysicalAddress(pDmaBufInfo->m_DmaBufferPhysicalAddress.LowPart) + m_busAddressOffset;
+}
+
+void
+RosKmdRapAdapter::FlushGpuCaches(
+    UINT    gpuCaches)
+{
+    //
+    // The slice caches are backed by the L2 cache, it is flushed with them
+    //
+
+    V3D_REG_L2CACTL regL2CACTL = { 0 };
+
+    regL2CACTL.L2CCLR = 1;
+
+    m_pVC4RegFile->V3D_L2CACTL = regL2CACTL.Value;
+
+    V3D_REG_SLCACTL regSLCACTL = { 0 };
+
+    if (gpuCaches & VC4_GPU_CACHE_INSTRUCTION)
+    {
+        regSLCACTL.ICCS0123 = 0xF;
+    }
+
+    if (gpuCaches & VC4_GPU_CACHE_UNIFORM)
+    {
+        regSLCACTL.UCCS0123 = 0xF;
+    }
+
+    if (gpuCaches & VC4_GPU_CACHE_TEXTURE)
+    {
+        regSLCACTL.T0CCS0123 = 0xF;
+        regSLCACTL.T1CCS0123 = 0xF;
+    }
+
+    m_pVC4RegFile->V3D_SLCACTL = regSLCACTL.Value;
 }
 
 void
@@ -553,7 +925,6 @@ RosKmdRapAdapter::SubmitControlList(
         // No need to wait for binning to be done.
         // Render job waits on sempahore to be signaled by binning job.
         //
-        return;
     }
     else
     {
@@ -569,103 +940,105 @@ RosKmdRapAdapter::SubmitControlList(
 
     //
     // Completion of DMA buffer is acknowledged with interrupt and
-    // subsequent DPC signals m_hwDmaBufCompletionEvent
+    // subsequent DPC completes it, see CompleteHwDmaBuffers()
+    //
+}
+
+//
+// Maps counter i to pSelect->m_sources[i], then clears and enables them
+//
+
+void
+RosKmdRapAdapter::StartPerfCounters(
+    const VC4PerfCounterSelect * pSelect)
+{
+    NT_ASSERT(pSelect->m_numCounters <= V3D_NUM_PERF_COUNTERS);
+
+    m_pVC4RegFile->V3D_PCTRE = 0;
+
     //
-    // TODO[indyz]: Enable interrupt and handle TDR
+    // Count and mapping registers of a counter are interleaved
     //
 
-    NTSTATUS status;
-    LARGE_INTEGER timeOut;
+    volatile UINT * pPCTRS = &m_pVC4RegFile->V3D_PCTRS0;
 
-    if (! g_bUseInterrupt)
+    for (UINT i = 0; i < pSelect->m_numCounters; i++)
     {
-        //
-        // Set time out to 64 millisecond
-        //
+        V3D_REG_PCTRS0 regPCTRS = { 0 };
 
-        timeOut.QuadPart = -64 * 1000 * 1000 / 10;
+        regPCTRS.PCTRS = pSelect->m_sources[i];
 
-        UINT i;
-        for (i = 0; i < 32; i++)
-        {
-            status = KeWaitForSingleObject(
-                &m_hwDmaBufCompletionEvent,
-                Executive,
-                KernelMode,
-                FALSE,
-                &timeOut);
+        pPCTRS[2 * i] = regPCTRS.Value;
+    }
 
-            NT_ASSERT(status == STATUS_TIMEOUT);
+    UINT    counterMask = (1 << pSelect->m_numCounters) - 1;
 
-            // Check Control List Executor Thread 0 or 1 Control and Status
+    m_pVC4RegFile->V3D_PCTRC = counterMask;
 
-            if (bBinningControlList)
-            {
-                regCTnCS.Value = m_pVC4RegFile->V3D_CT0CS;
-            }
-            else
-            {
-                regCTnCS.Value = m_pVC4RegFile->V3D_CT1CS;
-            }
+    V3D_REG_PCTRE regPCTRE = { 0 };
 
-            if (regCTnCS.CTRUN == 0)
-            {
-                break;
-            }
-        }
+    regPCTRE.CTEN = counterMask;
+    regPCTRE.EN = 1;
 
-        // Check for TDR condition
-        NT_ASSERT(i < 32);
-    }
-    else
-    {
-        //
-        // Set time out to 2 seconds
-        //
+    KeMemoryBarrier();
 
-        timeOut.QuadPart = -2000 * 1000 * 1000 / 10;
+    m_pVC4RegFile->V3D_PCTRE = regPCTRE.Value;
+}
 
-        status = KeWaitForSingleObject(
-            &m_hwDmaBufCompletionEvent,
-            Executive,
-            KernelMode,
-            FALSE,
-            &timeOut);
+void
+RosKmdRapAdapter::StopPerfCounters(
+    UINT    numCounters,
+    UINT *  pValues)
+{
+    volatile UINT * pPCTR = &m_pVC4RegFile->V3D_PCTR0;
 
-        NT_ASSERT(status == STATUS_SUCCESS);
+    for (UINT i = 0; i < numCounters; i++)
+    {
+        pValues[i] = pPCTR[2 * i];
     }
+
+    m_pVC4RegFile->V3D_PCTRE = 0;
 }
 
 UINT
 RosKmdRapAdapter::GenerateRenderingControlList(
-    ROSDMABUFINFO *pDmaBufInfo)
+    ROSDMABUFINFO  *pDmaBufInfo,
+    ROSDMABUFINFO  *pLastDmaBufInfo,
+    bool            bLoadColor,
+    bool            bStoreColor,
+    bool            bLoadDepthStencil,
+    bool            bStoreDepthStencil,
+    const RosRenderPassTiles &  tiles)
 {
     RosKmdAllocation *pRenderTarget = pDmaBufInfo->m_pRenderTarget;
+    RosKmdAllocation *pDepthStencil = pDmaBufInfo->m_pDepthStencil;
+    RosKmdAllocation *pResolveTarget = pLastDmaBufInfo->m_pResolveTarget;
+    PBYTE   pCommand = m_pRenderingControlList;
 
-    // Write Clear Colors command from UMD
-    VC4ClearColors *pVC4ClearColors;
-    VC4WaitOnSemaphore *pVC4WaitOnSempahore;
+    //
+    // Draws without a render target render to the depth stencil buffer
+    // alone, it stands in for the render target
+    //
+    bool    bColorBuffer = (pRenderTarget->m_hwFormat != RosHwFormat::D24S8);
 
-    if (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors)
-    {
-        pVC4ClearColors = (VC4ClearColors *)m_pRenderingControlList;
+    bool    bClearColor = (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors != 0) && bColorBuffer;
+    bool    bClearDepthStencil = pDepthStencil && pDmaBufInfo->m_VC4DepthStencil.m_bClear;
+    bool    bMultisample = RosAllocationIsMultisampled(*pRenderTarget);
+    bool    bStoreSamples = !pResolveTarget || !pLastDmaBufInfo->m_VC4Resolve.m_bDiscard;
 
-        *pVC4ClearColors = pDmaBufInfo->m_VC4ClearColors;
+    NT_ASSERT(pDepthStencil || (!bLoadDepthStencil && !bStoreDepthStencil));
+    NT_ASSERT(bMultisample || !pResolveTarget);
+    NT_ASSERT(bStoreColor || (!bLoadColor && !pResolveTarget));
+    NT_ASSERT(bColorBuffer || !bStoreColor);
 
-        MoveToNextCommand(pVC4ClearColors, pVC4WaitOnSempahore);
-    }
-    else
+    // Write Clear Colors command from UMD, it has the clear depth and stencil
+    if (bClearColor || bClearDepthStencil)
     {
-        pVC4WaitOnSempahore = (VC4WaitOnSemaphore *)m_pRenderingControlList;
+        WriteCommand(pCommand, pDmaBufInfo->m_VC4ClearColors);
     }
 
     // Wait binning to be done.
-
-    VC4WaitOnSemaphore waitOnSemaphore = vc4WaitOnSemaphore;
-    *pVC4WaitOnSempahore = waitOnSemaphore;
-
-    VC4TileRenderingModeConfig *pVC4TileRenderingModeConfig;
-    MoveToNextCommand(pVC4WaitOnSempahore, pVC4TileRenderingModeConfig);
+    WriteCommand(pCommand, vc4WaitOnSemaphore);
 
     // Write Tile Rendering Mode Config command
 
@@ -677,121 +1050,268 @@ RosKmdRapAdapter::GenerateRenderingControlList(
     tileRenderingModeConfig.HeightInPixels = (USHORT)pRenderTarget->m_mip0Info.TexelHeight;
 
     tileRenderingModeConfig.NonHDRFrameBufferColorFormat = static_cast<USHORT>(
-        Vc4FrameBufferColorFormatFromDxgiFormat(pRenderTarget->m_format));
+        bColorBuffer ?
+            Vc4FrameBufferColorFormatFromDxgiFormat(pRenderTarget->m_format) :
+            VC4_NON_HDR_FRAME_BUFFER_COLOR_FORMAT::RGBA8888);
 
-    tileRenderingModeConfig.MemoryFormat = static_cast<USHORT>(
-        Vc4MemoryFormatFromRosHwLayout(pRenderTarget->m_hwLayout));
-
-    *pVC4TileRenderingModeConfig = tileRenderingModeConfig;
+    if (bMultisample)
+    {
+        //
+        // The frame buffer is the resolve target, the resolving store
+        // decimates the 4 samples of each pixel into it
+        //
 
-    // Clear the tile buffer by store the 1st tile
-    VC4TileCoordinates *pVC4TileCoordinates = NULL;
-    VC4StoreTileBufferGeneral  *pVC4StoreTileBufferGeneral = NULL;
+        tileRenderingModeConfig.MultisampleMode = 1;
 
-    if (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors)
+        if (pResolveTarget)
+        {
+            tileRenderingModeConfig.MemoryAddress = pLastDmaBufInfo->m_ResolveTargetPhysicalAddress + m_busAddressOffset;
+            tileRenderingModeConfig.DecimateMode = 1;
+            tileRenderingModeConfig.MemoryFormat = static_cast<USHORT>(
+                Vc4MemoryFormatFromRosHwLayout(pResolveTarget->m_hwLayout));
+        }
+    }
+    else
     {
-        MoveToNextCommand(pVC4TileRenderingModeConfig, pVC4TileCoordinates);
-
-        *pVC4TileCoordinates = vc4TileCoordinates;
+        tileRenderingModeConfig.MemoryFormat = static_cast<USHORT>(
+            Vc4MemoryFormatFromRosHwLayout(pRenderTarget->m_hwLayout));
+    }
 
-        MoveToNextCommand(pVC4TileCoordinates, pVC4StoreTileBufferGeneral);
+    WriteCommand(pCommand, tileRenderingModeConfig);
 
-        *pVC4StoreTileBufferGeneral = vc4StoreTileBufferGeneral;
+    // Clear the tile buffer by store the 1st tile, each store clears it for
+    // the next tile
+    if (bClearColor || bClearDepthStencil)
+    {
+        WriteCommand(pCommand, vc4TileCoordinates);
+        WriteCommand(pCommand, vc4StoreTileBufferGeneral);
     }
 
     //
-    // Calling control list generated by the Binning Control List
+    // Loads and stores of each tile. A load runs with the next Tile
+    // Coordinates, a store of nothing runs the color load before the depth
+    // stencil load. The store of the depth stencil buffer keeps the color
+    // for its own store.
     //
-    UINT    widthInTiles = pRenderTarget->m_hwWidthPixels / VC4_BINNING_TILE_PIXELS;
-    UINT    heightInTiles = pRenderTarget->m_hwHeightPixels / VC4_BINNING_TILE_PIXELS;
 
-    VC4TileCoordinates  tileCoordinates = vc4TileCoordinates;
-    VC4BranchToSubList  branchToSubList = vc4BranchToSubList;
     VC4LoadTileBufferGeneral    loadTileBufColor = vc4LoadTileBufferGeneral;
-    UINT    tileAllocationPhysicalAddress = m_tileAllocationMemoryPhysicalAddress + m_busAddressOffset;
-    VC4LoadTileBufferGeneral    *pVC4LoadTileBufGeneral = NULL;
-    VC4BranchToSubList *pVC4BranchToSubList = NULL;
-    VC4StoreMSResolvedTileColorBuf *pVC4StoreMSResolvedTileColorBuf = NULL;
-    VC4StoreMSResolvedTileColorBufAndSignalEndOfFrame  *pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame = NULL;
+    VC4LoadTileBufferGeneral    loadTileBufDepthStencil = vc4LoadTileBufferGeneral;
+    VC4StoreTileBufferGeneral   storeTileBufNone = vc4StoreTileBufferGeneral;
+    VC4StoreTileBufferGeneral   storeTileBufDepthStencil = vc4StoreTileBufferGeneral;
+
+    UINT    renderTargetAddress = pDmaBufInfo->m_RenderTargetPhysicalAddress + m_busAddressOffset;
+    UINT    depthStencilAddress = pDepthStencil ? pDmaBufInfo->m_DepthStencilPhysicalAddress + m_busAddressOffset : 0;
 
-    if (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors)
+    if (!bMultisample && bLoadColor)
     {
-        MoveToNextCommand(pVC4StoreTileBufferGeneral, pVC4TileCoordinates);
-        pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame = (VC4StoreMSResolvedTileColorBufAndSignalEndOfFrame *)pVC4TileCoordinates;
+        loadTileBufColor.BufferToLoad = VC4_TILE_BUFFER_COLOR;
+
+        loadTileBufColor.Fortmat = static_cast<USHORT>(
+            Vc4MemoryFormatFromRosHwLayout(pRenderTarget->m_hwLayout));
+
+        loadTileBufColor.PixelColorFormat = static_cast<USHORT>(
+            Vc4TileBufferPixelFormatFromDxgiFormat(pRenderTarget->m_format));
+
+        loadTileBufColor.MemoryBaseAddress = renderTargetAddress >> 4;
     }
-    else
+
+    storeTileBufNone.BufferToStore = VC4_TILE_BUFFER_NONE;
+    storeTileBufNone.DisableColorBufferClear = 1;
+    storeTileBufNone.DisableZStencilClear = 1;
+    storeTileBufNone.DisableVGMaskBufferClear = 1;
+
+    if (pDepthStencil && !bMultisample)
     {
-        if (pDmaBufInfo->m_pRenderTarget)
-        {
-            loadTileBufColor.BufferToLoad = VC4_TILE_BUFFER_COLOR;
+        loadTileBufDepthStencil.BufferToLoad = VC4_TILE_BUFFER_Z_STENCIL;
+        loadTileBufDepthStencil.Fortmat = static_cast<USHORT>(
+            Vc4MemoryFormatFromRosHwLayout(pDepthStencil->m_hwLayout));
+        loadTileBufDepthStencil.MemoryBaseAddress = depthStencilAddress >> 4;
+
+        storeTileBufDepthStencil.BufferToStore = VC4_TILE_BUFFER_Z_STENCIL;
+        storeTileBufDepthStencil.Fortmat = loadTileBufDepthStencil.Fortmat;
+        storeTileBufDepthStencil.DisableColorBufferClear = 1;
+        storeTileBufDepthStencil.MemoryBaseAddress = depthStencilAddress >> 4;
+    }
+
+    //
+    // In multisample mode the samples are loaded and stored as full
+    // resolution tile dumps, one per tile (RosMsaa.h). Only the last store
+    // of a tile clears the tile buffer, the samples of the color buffer are
+    // stored before the resolving store unless discarded.
+    //
 
-            loadTileBufColor.Fortmat = static_cast<USHORT>(
-                Vc4MemoryFormatFromRosHwLayout(
-                    pDmaBufInfo->m_pRenderTarget->m_hwLayout));
+    VC4LoadFullResolutionTileBuffer     loadFullResColor = vc4LoadFullResolutionTileBuffer;
+    VC4LoadFullResolutionTileBuffer     loadFullResDepthStencil = vc4LoadFullResolutionTileBuffer;
+    VC4StoreFullResolutionTileBuffer    storeFullResColor = vc4StoreFullResolutionTileBuffer;
+    VC4StoreFullResolutionTileBuffer    storeFullResDepthStencil = vc4StoreFullResolutionTileBuffer;
 
-            loadTileBufColor.PixelColorFormat = static_cast<USHORT>(
-                Vc4TileBufferPixelFormatFromDxgiFormat(
-                    pDmaBufInfo->m_pRenderTarget->m_format));
+    loadFullResColor.DisableZStencilBufferRead = 1;
+    loadFullResDepthStencil.DisableColorBufferRead = 1;
 
-            loadTileBufColor.MemoryBaseAddress = (pDmaBufInfo->m_RenderTargetPhysicalAddress + m_busAddressOffset) >> 4;
+    storeFullResColor.DisableZStencilBufferWrite = 1;
+    storeFullResColor.DisableClear = pResolveTarget ? 1 : 0;
 
-            MoveToNextCommand(pVC4TileRenderingModeConfig, pVC4LoadTileBufGeneral);
-        }
+    storeFullResDepthStencil.DisableColorBufferWrite = 1;
+    storeFullResDepthStencil.DisableClear = 1;
+
+    //
+    // The tiles of a pass that doesn't store the render target end with
+    // the store of the depth stencil buffer, or of nothing, that clears the
+    // tile buffer for the next tile. The last one signals the end of the
+    // frame.
+    //
+
+    VC4StoreTileBufferGeneral           storeTileBufLast = bStoreDepthStencil ? storeTileBufDepthStencil : vc4StoreTileBufferGeneral;
+    VC4StoreFullResolutionTileBuffer    storeFullResLast = storeFullResDepthStencil;
+
+    storeTileBufLast.DisableColorBufferClear = 0;
+    storeFullResLast.DisableClear = 0;
+
+    //
+    // Calling control list generated by the Binning Control List, in the
+    // order of the tiles of g_tileOrder. Only the tiles of the pass the
+    // draws touched are rendered, the tile lists of the others are empty.
+    //
+    UINT    widthInTiles = Vc4WidthInTiles(*pRenderTarget);
+
+    VC4TileCoordinates  tileCoordinates = vc4TileCoordinates;
+    VC4BranchToSubList  branchToSubList = vc4BranchToSubList;
+    UINT    tileAllocationPhysicalAddress = m_tileAllocationMemoryPhysicalAddress + m_busAddressOffset;
+
+    RosTileOrderType    tileOrderType = g_tileOrder;
+
+    if (tileOrderType == ROS_TILE_ORDER_AUTO)
+    {
+        tileOrderType = RosTileOrder::Choose(
+            pResolveTarget ?
+                (pResolveTarget->m_hwLayout == RosHwLayout::Linear) :
+                (pRenderTarget->m_hwLayout == RosHwLayout::Linear));
     }
 
-    for (UINT x = 0; x < widthInTiles; x++)
+    NT_ASSERT((tiles.m_right <= widthInTiles) && (tiles.m_bottom <= Vc4HeightInTiles(*pRenderTarget)));
+    NT_ASSERT(tiles.GetCount() != 0);
+
+    RosTileOrder    tileOrder(tileOrderType, tiles.m_right - tiles.m_left, tiles.m_bottom - tiles.m_top);
+    UINT    numTiles = 0;
+    UINT    x;
+    UINT    y;
+
+    while (tileOrder.Next(&x, &y))
     {
-        for (UINT y = 0; y < heightInTiles; y++)
+        numTiles++;
+
+        x += tiles.m_left;
+        y += tiles.m_top;
+
+        bool    bLastTile = (numTiles == tileOrder.GetCount());
+
+        tileCoordinates.TileColumnNumber = (BYTE)x;
+        tileCoordinates.TileRowNumber = (BYTE)y;
+
+        if (bMultisample)
         {
-            if (! pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors)
+            UINT    tileOffset = (y*widthInTiles + x)*VC4_TILE_BUFFER_BYTES;
+
+            loadFullResColor.MemoryBaseAddress = (renderTargetAddress + tileOffset) >> 4;
+            loadFullResDepthStencil.MemoryBaseAddress = (depthStencilAddress + tileOffset) >> 4;
+            storeFullResColor.MemoryBaseAddress = loadFullResColor.MemoryBaseAddress;
+            storeFullResColor.LastTileOfFrame = (bLastTile && !pResolveTarget) ? 1 : 0;
+            storeFullResDepthStencil.MemoryBaseAddress = loadFullResDepthStencil.MemoryBaseAddress;
+        }
+
+        if (bLoadColor)
+        {
+            if (bMultisample)
             {
-                if (pDmaBufInfo->m_pRenderTarget)
-                {
-                    *pVC4LoadTileBufGeneral = loadTileBufColor;
+                WriteCommand(pCommand, loadFullResColor);
+            }
+            else
+            {
+                WriteCommand(pCommand, loadTileBufColor);
+            }
 
-                    MoveToNextCommand(pVC4LoadTileBufGeneral, pVC4TileCoordinates);
-                }
+            if (bLoadDepthStencil)
+            {
+                WriteCommand(pCommand, tileCoordinates);
+                WriteCommand(pCommand, storeTileBufNone);
             }
+        }
 
-            tileCoordinates.TileColumnNumber = (BYTE)x;
-            tileCoordinates.TileRowNumber = (BYTE)y;
+        if (bLoadDepthStencil)
+        {
+            if (bMultisample)
+            {
+                WriteCommand(pCommand, loadFullResDepthStencil);
+            }
+            else
+            {
+                WriteCommand(pCommand, loadTileBufDepthStencil);
+            }
+        }
 
-            *pVC4TileCoordinates = tileCoordinates;
+        WriteCommand(pCommand, tileCoordinates);
 
-            MoveToNextCommand(pVC4TileCoordinates, pVC4BranchToSubList);
+        branchToSubList.BranchAddress = tileAllocationPhysicalAddress + (y*widthInTiles + x)*VC4_TILE_ALLOCATION_BLOCK_SIZE;
 
-            branchToSubList.BranchAddress = tileAllocationPhysicalAddress + (y*widthInTiles + x)*VC4_TILE_ALLOCATION_BLOCK_SIZE;
+        WriteCommand(pCommand, branchToSubList);
 
-            *pVC4BranchToSubList = branchToSubList;
+        if (!bStoreColor)
+        {
+            if (bStoreDepthStencil && bMultisample)
+            {
+                storeFullResLast.MemoryBaseAddress = storeFullResDepthStencil.MemoryBaseAddress;
+                storeFullResLast.LastTileOfFrame = bLastTile ? 1 : 0;
 
-            if ((x == (widthInTiles - 1)) &&
-                (y == (heightInTiles - 1)))
+                WriteCommand(pCommand, storeFullResLast);
+            }
+            else
             {
-                MoveToNextCommand(pVC4BranchToSubList, pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame);
+                storeTileBufLast.LastTileOfFrame = bLastTile ? 1 : 0;
 
-                *pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame = vc4StoreMSResolvedTileColorBufAndSignalEndOfFrame;
+                WriteCommand(pCommand, storeTileBufLast);
+            }
+
+            continue;
+        }
 
-                pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame++;
+        if (bStoreDepthStencil)
+        {
+            if (bMultisample)
+            {
+                WriteCommand(pCommand, storeFullResDepthStencil);
             }
             else
             {
-                MoveToNextCommand(pVC4BranchToSubList, pVC4StoreMSResolvedTileColorBuf);
+                WriteCommand(pCommand, storeTileBufDepthStencil);
+            }
 
-                *pVC4StoreMSResolvedTileColorBuf = vc4StoreMSResolvedTileColorBuf;
+            WriteCommand(pCommand, tileCoordinates);
+        }
 
-                if (pDmaBufInfo->m_DmaBufState.m_HasVC4ClearColors)
-                {
-                    MoveToNextCommand(pVC4StoreMSResolvedTileColorBuf, pVC4TileCoordinates);
-                }
-                else
-                {
-                    MoveToNextCommand(pVC4StoreMSResolvedTileColorBuf, pVC4LoadTileBufGeneral);
-                }
+        if (bMultisample && bStoreSamples)
+        {
+            WriteCommand(pCommand, storeFullResColor);
+
+            // Ends the tile without a resolve target
+            if (!pResolveTarget)
+            {
+                continue;
             }
+
+            WriteCommand(pCommand, tileCoordinates);
+        }
+
+        if (bLastTile)
+        {
+            WriteCommand(pCommand, vc4StoreMSResolvedTileColorBufAndSignalEndOfFrame);
+        }
+        else
+        {
+            WriteCommand(pCommand, vc4StoreMSResolvedTileColorBuf);
         }
     }
 
-    return ((UINT)(((PBYTE)pVC4StoreMSResolvedTileColorBufAndSignalEndOfFrame) - m_pRenderingControlList));
+    return ((UINT)(pCommand - m_pRenderingControlList));
 }
 
 NTSTATUS
@@ -832,8 +1352,557 @@ RosKmdRapAdapter::SetVC4Power(
     }
 }
 
+void
+RosKmdRapAdapter::EnableInterrupts()
+{
+    //
+    // Enable the interrupts when the Binning Control List is flushed and
+    // the End of Frame interrupt when Render Control List completes
+    //
+
+    V3D_REG_INTENA  regIntEna = { 0 };
+
+    regIntEna.EI_FRDONE = 1;
+    regIntEna.EI_FLDONE = 1;
+    regIntEna.EI_OUTOFMEM = 1;
+
+    // TODO[jordanrh]: register operations should use READ/WRITE_REGISTER_ULONG
+    WRITE_REGISTER_ULONG(reinterpret_cast<volatile ULONG*>(
+        &m_pVC4RegFile->V3D_INTENA),
+        regIntEna.Value);
+
+    m_bReadyToHandleInterrupt = TRUE;
+}
+
+UINT
+RosKmdRapAdapter::ReserveHwDmaBuffer()
+{
+    for (;;)
+    {
+        RetireHwDmaBuffers();
+
+        KIRQL   oldIrql;
+        UINT    slot;
+        bool    bReserved;
+
+        KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+        bReserved = m_hwQueue.Reserve(&slot);
+        KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+
+        if (bReserved)
+        {
+            return slot;
+        }
+
+        WaitForHwDmaBuffer();
+    }
+}
+
+void
+RosKmdRapAdapter::QueueHwDmaBuffer(
+    UINT    slot)
+{
+    KIRQL   oldIrql;
+
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+
+    if (m_hwQueue.Queue(
+            slot,
+            m_hwDmaBufs[slot].m_pDmaBufSubmission->m_SubmissionFenceId,
+            KeQueryPerformanceCounter(NULL).QuadPart))
+    {
+        StartHwDmaBuffer(slot);
+    }
+
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+}
+
+//
+// Waits for a DMA buffer to complete or for the check interval, whichever
+// comes first, and checks for a hang of the GPU
+//
+
+void
+RosKmdRapAdapter::WaitForHwDmaBuffer()
+{
+    if (g_bUseInterrupt)
+    {
+        LARGE_INTEGER   timeOut;
+
+        timeOut.QuadPart = -((LONGLONG)kGpuBusyCheckIntervalMs) * 1000 * 10;
+
+        NTSTATUS status = KeWaitForSingleObject(
+            &m_hwDmaBufCompletionEvent,
+            Executive,
+            KernelMode,
+            FALSE,
+            &timeOut);
+
+        NT_ASSERT((status == STATUS_SUCCESS) || (status == STATUS_TIMEOUT));
+        UNREFERENCED_PARAMETER(status);
+    }
+    else
+    {
+        PollHwDmaBuffer();
+    }
+
+    CheckHwHang();
+}
+
+void
+RosKmdRapAdapter::PollHwDmaBuffer()
+{
+    LARGE_INTEGER   interval;
+
+    interval.QuadPart = -((LONGLONG)kPollIntervalMs) * 1000 * 10;
+
+    KeDelayExecutionThread(KernelMode, FALSE, &interval);
+
+    //
+    // Rendering waits for binning, the DMA buffer is done when Control
+    // List Executor Thread 1 stopped
+    //
+
+    V3D_REG_CT1CS   regCT1CS;
+
+    regCT1CS.Value = m_pVC4RegFile->V3D_CT1CS;
+
+    V3D_REG_INTCTL  regIntCtl = { 0 };
+    V3D_REG_INTCTL  regIntSts;
+
+    regIntSts.Value = m_pVC4RegFile->V3D_INTCTL;
+
+    regIntCtl.INT_OUTOFMEM = regIntSts.INT_OUTOFMEM;
+
+    if ((m_hwQueue.GetRunningSlot() != RosHwQueue::kNoSlot) && (regCT1CS.CTRUN == 0))
+    {
+        regIntCtl.INT_FLDONE = 1;
+        regIntCtl.INT_FRDONE = 1;
+    }
+
+    if (regIntCtl.Value)
+    {
+        CompleteHwDmaBuffers(regIntCtl.Value);
+    }
+}
+
+void
+RosKmdRapAdapter::WaitForGpuIdle()
+{
+    if (m_renderPassSlot != RosHwQueue::kNoSlot)
+    {
+        SubmitRenderPass();
+    }
+
+    for (;;)
+    {
+        RetireHwDmaBuffers();
+
+        if (m_hwQueue.IsIdle())
+        {
+            break;
+        }
+
+        WaitForHwDmaBuffer();
+    }
+}
+
+void
+RosKmdRapAdapter::RetireHwDmaBuffers()
+{
+    if (m_hwQueue.IsIdle())
+    {
+        return;
+    }
+
+    CheckHwHang();
+
+    for (;;)
+    {
+        KIRQL   oldIrql;
+        UINT    slot;
+        bool    bRetired;
+
+        KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+        bRetired = m_hwQueue.Retire(&slot);
+        KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+
+        if (!bRetired)
+        {
+            break;
+        }
+
+        ReleaseApertureBounce(slot);
+
+        FreeDmaBufSubmission(m_hwDmaBufs[slot].m_pDmaBufSubmission);
+
+        for (UINT i = 0; i < m_hwDmaBufs[slot].m_numChainedDmaBufSubmissions; i++)
+        {
+            FreeDmaBufSubmission(m_hwDmaBufs[slot].m_pChainedDmaBufSubmissions[i]);
+        }
+
+        m_hwDmaBufs[slot].m_pDmaBufSubmission = NULL;
+        m_hwDmaBufs[slot].m_numChainedDmaBufSubmissions = 0;
+    }
+}
+
+//
+// A DMA buffer whose control lists don't advance for kHangTimeoutMs hung
+// the V3D. The V3D is reset and the running and queued DMA buffers are
+// completed so that the VidSch doesn't wait for them, the DMA buffers
+// after them run as usual.
+//
+// The KMD doesn't implement ResetFromTimeout, so the hang is recovered here
+// instead of being reported as DXGK_INTERRUPT_DMA_FAULTED, which would make
+// the VidSch reset the adapter. The VidSch sees the faulted DMA buffers as
+// completed although the hung one stopped part way and the queued ones
+// never ran, each of them is marked m_bReset and logged.
+//
+
+void
+RosKmdRapAdapter::CheckHwHang()
+{
+    KIRQL           oldIrql;
+    LARGE_INTEGER   frequency;
+    ULONGLONG       now = KeQueryPerformanceCounter(&frequency).QuadPart;
+    UINT            faultedSlots[RosHwQueue::kMaxSlots];
+    UINT            numFaulted = 0;
+
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+
+    if (m_hwQueue.IsHung(
+            now,
+            m_pVC4RegFile->V3D_CT0CA,
+            m_pVC4RegFile->V3D_CT1CA,
+            frequency.QuadPart * kHangTimeoutMs / 1000))
+    {
+        numFaulted = m_hwQueue.Reset(now, faultedSlots);
+    }
+
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+
+    if (0 == numFaulted)
+    {
+        return;
+    }
+
+    ROS_LOG_ERROR(
+        "V3D hang detected, resetting the GPU. (fenceId=%d, numFaulted=%d, CT0CA=0x%x, CT1CA=0x%x)",
+        m_hwDmaBufs[faultedSlots[0]].m_pDmaBufSubmission->m_SubmissionFenceId,
+        numFaulted,
+        m_pVC4RegFile->V3D_CT0CA,
+        m_pVC4RegFile->V3D_CT1CA);
+
+    m_ErrorHit.m_GpuHang = 1;
+    m_hwResets++;
+
+    ResetV3D();
+
+    //
+    // Complete the faulted DMA buffers in order, their queries report
+    // the counters as zero. Only the 1st slot was running.
+    //
+
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+
+    for (UINT i = 0; i < numFaulted; i++)
+    {
+        ROSHWDMABUF            *pHwDmaBuf = &m_hwDmaBufs[faultedSlots[i]];
+        ROSDMABUFSUBMISSION    *pDmaBufSubmission = pHwDmaBuf->m_pDmaBufSubmission;
+        ROSDMABUFINFO          *pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+
+        ROS_LOG_ERROR(
+            "%s DMA buffer lost to the V3D reset. (fenceId=%d, numChained=%d)",
+            (i == 0) ? "Hung" : "Queued",
+            pDmaBufSubmission->m_SubmissionFenceId,
+            pHwDmaBuf->m_numChainedDmaBufSubmissions);
+
+        pDmaBufInfo->m_DmaBufState.m_bReset = 1;
+
+        for (UINT j = 0; j < pHwDmaBuf->m_numChainedDmaBufSubmissions; j++)
+        {
+            pHwDmaBuf->m_pChainedDmaBufSubmissions[j]->m_pDmaBufInfo->m_DmaBufState.m_bReset = 1;
+        }
+
+        m_hwResetDmaBufs += 1 + pHwDmaBuf->m_numChainedDmaBufSubmissions;
+
+        if (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+        {
+            RtlZeroMemory(pDmaBufInfo->m_PerfCounterValues, sizeof(pDmaBufInfo->m_PerfCounterValues));
+
+            ReportPerfCounters(pDmaBufInfo);
+        }
+
+        NotifyRenderPassCompletion(faultedSlots[i]);
+    }
+
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+}
+
+void
+RosKmdRapAdapter::ResetV3D()
+{
+    m_bReadyToHandleInterrupt = FALSE;
+
+    V3D_REG_INTDIS  regIntDis = { 0 };
+
+    regIntDis.DI_FRDONE = 1;
+    regIntDis.DI_FLDONE = 1;
+    regIntDis.DI_OUTOFMEM = 1;
+
+    m_pVC4RegFile->V3D_INTDIS = regIntDis.Value;
+
+    //
+    // Power cycling the V3D stops the control list executors and empties
+    // the GPU caches
+    //
+
+    NTSTATUS status = SetVC4Power(false);
+
+    if (NT_SUCCESS(status))
+    {
+        status = SetVC4Power(true);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        ROS_LOG_ERROR(
+            "Failed to power cycle VC4. (status=%!STATUS!)",
+            status);
+    }
+
+    m_numDmaBuffersSinceFlush = 0;
+
+    //
+    // Drop the interrupts of the hung DMA buffer
+    //
+
+    V3D_REG_INTCTL  regIntCtl = { 0 };
+
+    regIntCtl.INT_FRDONE = 1;
+    regIntCtl.INT_FLDONE = 1;
+    regIntCtl.INT_OUTOFMEM = 1;
+
+    m_pVC4RegFile->V3D_INTCTL = regIntCtl.Value;
+
+    InterlockedExchange(&m_hwInterrupts, 0);
+
+    //
+    // The overspill blocks of the hung DMA buffer are free again, give the
+    // binner a new one
+    //
+
+    KIRQL   oldIrql;
+
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+    m_binnerMemory.Reset();
+    SupplyBinnerMemory();
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+
+    if (g_bUseInterrupt)
+    {
+        EnableInterrupts();
+    }
+}
+
 ROS_NONPAGED_SEGMENT_BEGIN; //================================================
 
+//
+// Called with m_hwQueueLock held
+//
+
+void
+RosKmdRapAdapter::StartHwDmaBuffer(
+    UINT    slot)
+{
+    ROSHWDMABUF            *pHwDmaBuf = &m_hwDmaBufs[slot];
+    ROSDMABUFSUBMISSION    *pDmaBufSubmission = pHwDmaBuf->m_pDmaBufSubmission;
+    ROSDMABUFINFO          *pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+
+    if (pHwDmaBuf->m_gpuCaches)
+    {
+        FlushGpuCaches(pHwDmaBuf->m_gpuCaches);
+    }
+
+    if (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+    {
+        StartPerfCounters(&pDmaBufInfo->m_VC4PerfCounters);
+    }
+
+    m_binnerMemory.Begin(pHwDmaBuf->m_tileAllocationMemorySize);
+
+    Trace(ROS_TRACE_BINNING, ROS_TRACE_BEGIN, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+    //
+    // Submit the Binning Control List from UMD and the Rendering Control
+    // List to the GPU, rendering waits on the semaphore of binning
+    //
+
+    SubmitControlList(true, pHwDmaBuf->m_binningStart, pHwDmaBuf->m_binningEnd);
+
+    SubmitControlList(false, pHwDmaBuf->m_renderingStart, pHwDmaBuf->m_renderingEnd);
+}
+
+//
+// Advances the running DMA buffer by the V3D_REG_INTCTL bits of the
+// interrupts, completes it and starts the next one at the end of frame
+//
+
+void
+RosKmdRapAdapter::CompleteHwDmaBuffers(
+    UINT    interrupts)
+{
+    V3D_REG_INTCTL  regIntCtl;
+    KIRQL           oldIrql;
+
+    regIntCtl.Value = interrupts;
+
+    KeAcquireSpinLock(&m_hwQueueLock, &oldIrql);
+
+    ULONGLONG   now = KeQueryPerformanceCounter(NULL).QuadPart;
+    UINT        runningSlot = m_hwQueue.GetRunningSlot();
+
+    //
+    // The binner continued in the overspill block, it needs the next one
+    // before it runs out again
+    //
+    if (regIntCtl.INT_OUTOFMEM)
+    {
+        m_binnerMemory.OnOverspillTaken();
+
+        SupplyBinnerMemory();
+    }
+
+    if (regIntCtl.INT_FLDONE && m_hwQueue.OnBinningDone(now))
+    {
+        ROSDMABUFSUBMISSION *pDmaBufSubmission = m_hwDmaBufs[runningSlot].m_pDmaBufSubmission;
+
+        Trace(ROS_TRACE_BINNING, ROS_TRACE_END, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufSubmission->m_pDmaBufInfo->m_TraceSubmission);
+        Trace(ROS_TRACE_RENDERING, ROS_TRACE_BEGIN, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufSubmission->m_pDmaBufInfo->m_TraceSubmission);
+    }
+
+    UINT    completedSlot;
+    UINT    nextSlot;
+
+    if (regIntCtl.INT_FRDONE && m_hwQueue.OnRenderingDone(now, &completedSlot, &nextSlot))
+    {
+        ROSDMABUFSUBMISSION    *pDmaBufSubmission = m_hwDmaBufs[completedSlot].m_pDmaBufSubmission;
+        ROSDMABUFINFO          *pDmaBufInfo = pDmaBufSubmission->m_pDmaBufInfo;
+
+        //
+        // Rendering waits for binning, both are done
+        //
+        if (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+        {
+            StopPerfCounters(
+                pDmaBufInfo->m_VC4PerfCounters.m_numCounters,
+                pDmaBufInfo->m_PerfCounterValues);
+        }
+
+        Trace(ROS_TRACE_RENDERING, ROS_TRACE_END, pDmaBufSubmission->m_SubmissionFenceId, pDmaBufInfo->m_TraceSubmission);
+
+        //
+        // Its tile lists were read, free its overspill blocks and record
+        // how much tile allocation memory its binning used
+        //
+        m_binnerMemory.Complete(m_pVC4RegFile->V3D_BPCS);
+
+        if (!m_binnerMemory.IsSupplied())
+        {
+            SupplyBinnerMemory();
+        }
+
+        //
+        // Keep the GPU busy before notifying the VidSch
+        //
+        if (nextSlot != RosHwQueue::kNoSlot)
+        {
+            StartHwDmaBuffer(nextSlot);
+        }
+
+        if (pDmaBufInfo->m_DmaBufState.m_HasVC4PerfCounters)
+        {
+            ReportPerfCounters(pDmaBufInfo);
+        }
+
+        NotifyRenderPassCompletion(completedSlot);
+    }
+
+    KeReleaseSpinLock(&m_hwQueueLock, oldIrql);
+
+    //
+    // Wake up the worker thread to retire the slot and to prepare the
+    // next DMA buffer in it
+    //
+    KeSetEvent(&m_hwDmaBufCompletionEvent, 0, FALSE);
+    KeSetEvent(&m_workerThreadEvent, 0, FALSE);
+}
+
+//
+// Notifies the DMA buffers of the render pass in the slot in submission
+// order. Called with m_hwQueueLock held.
+//
+
+void
+RosKmdRapAdapter::NotifyRenderPassCompletion(
+    UINT    slot)
+{
+    ROSHWDMABUF    *pHwDmaBuf = &m_hwDmaBufs[slot];
+
+    NotifyDmaBufCompletion(pHwDmaBuf->m_pDmaBufSubmission);
+
+    for (UINT i = 0; i < pHwDmaBuf->m_numChainedDmaBufSubmissions; i++)
+    {
+        NotifyDmaBufCompletion(pHwDmaBuf->m_pChainedDmaBufSubmissions[i]);
+    }
+}
+
+//
+// Called with m_hwQueueLock held. Without a free overspill block the out of
+// memory interrupt stays disabled until a DMA buffer completes and frees
+// its blocks, the binner stalls meanwhile.
+//
+
+void
+RosKmdRapAdapter::SupplyBinnerMemory()
+{
+    UINT    block;
+
+    if (!m_binnerMemory.Supply(&block))
+    {
+        m_ErrorHit.m_BinnerOutOfMemory = 1;
+        return;
+    }
+
+    m_pVC4RegFile->V3D_BPOA = m_binnerOverspillPoolPhysicalAddress + m_busAddressOffset + m_binnerMemory.GetBlockOffset(block);
+    m_pVC4RegFile->V3D_BPOS = m_binnerMemory.GetBlockSize();
+
+    //
+    // The interrupt is raised as long as the binner has no overspill block
+    //
+
+    V3D_REG_INTCTL  regIntCtl = { 0 };
+
+    regIntCtl.INT_OUTOFMEM = 1;
+
+    m_pVC4RegFile->V3D_INTCTL = regIntCtl.Value;
+
+    if (m_bReadyToHandleInterrupt)
+    {
+        V3D_REG_INTENA  regIntEna = { 0 };
+
+        regIntEna.EI_OUTOFMEM = 1;
+
+        m_pVC4RegFile->V3D_INTENA = regIntEna.Value;
+    }
+}
+
+void
+RosKmdRapAdapter::OnHwDmaBufCompletion()
+{
+    CompleteHwDmaBuffers(InterlockedExchange(&m_hwInterrupts, 0));
+}
+
 _Use_decl_annotations_
 BOOLEAN RosKmdRapAdapter::InterruptRoutine(ULONG MessageNumber)
 {
@@ -855,19 +1924,43 @@ BOOLEAN RosKmdRapAdapter::RendererInterruptRoutine (ULONG /*MessageNumber*/)
     }
 
     V3D_REG_INTCTL  regIntCtl;
+    V3D_REG_INTCTL  regIntAck = { 0 };
+
+    V3D_REG_INTENA  regIntEna;
+    V3D_REG_INTCTL  regOutOfMem = { 0 };
 
     regIntCtl.Value = m_pVC4RegFile->V3D_INTCTL;
+    regIntEna.Value = m_pVC4RegFile->V3D_INTENA;
+
+    regIntAck.INT_FRDONE = regIntCtl.INT_FRDONE;
+    regIntAck.INT_FLDONE = regIntCtl.INT_FLDONE;
 
-    if (regIntCtl.INT_FRDONE)
+    //
+    // Out of memory stays raised until the DPC supplies an overspill block,
+    // it is disabled until then
+    //
+    regOutOfMem.INT_OUTOFMEM = regIntCtl.INT_OUTOFMEM & regIntEna.EI_OUTOFMEM;
+
+    if (regOutOfMem.Value)
     {
-        regIntCtl.Value = 0;
-        regIntCtl.INT_FRDONE = 1;
+        V3D_REG_INTDIS  regIntDis = { 0 };
+
+        regIntDis.DI_OUTOFMEM = 1;
 
+        m_pVC4RegFile->V3D_INTDIS = regIntDis.Value;
+    }
+
+    if (regIntAck.Value || regOutOfMem.Value)
+    {
         // Acknowledge the interrupt
-        m_pVC4RegFile->V3D_INTCTL = regIntCtl.Value;
+        if (regIntAck.Value)
+        {
+            m_pVC4RegFile->V3D_INTCTL = regIntAck.Value;
+        }
+
+        // The DPC advances the DMA buffers by the interrupts since it last ran
+        InterlockedOr(&m_hwInterrupts, regIntAck.Value | regOutOfMem.Value);
 
-        // If the interrupt is for DMA buffer completion,
-        // queue the DPC to wake up the worker thread
         KeInsertQueueDpc(&m_hwDmaBufCompletionDpc, NULL, NULL);
 
         return TRUE;
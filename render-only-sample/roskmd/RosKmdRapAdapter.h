@@ -2,6 +2,25 @@
 
 #include "RosKmdAdapter.h"
 
+//
+// Control lists of the render pass prepared in a slot of the hardware queue.
+// The Binning Control Lists of the DMA buffers chained to the first one run
+// with it, they complete along with it.
+//
+
+typedef struct _ROSHWDMABUF
+{
+    ROSDMABUFSUBMISSION    *m_pDmaBufSubmission;
+    ROSDMABUFSUBMISSION    *m_pChainedDmaBufSubmissions[RosRenderPass::kMaxDmaBuffers - 1];
+    UINT                    m_numChainedDmaBufSubmissions;
+    UINT                    m_binningStart;
+    UINT                    m_binningEnd;
+    UINT                    m_renderingStart;
+    UINT                    m_renderingEnd;
+    UINT                    m_gpuCaches;        // VC4GpuCache flushed before it starts
+    UINT                    m_tileAllocationMemorySize;
+} ROSHWDMABUF;
+
 class RosKmdRapAdapter : public RosKmAdapter
 {
 private:
@@ -16,7 +35,17 @@ private:
 
 protected:
 
-    virtual void ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission);
+    virtual bool ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission);
+
+    virtual bool IsGpuIdle() override
+    {
+        return m_hwQueue.IsIdle();
+    }
+
+    virtual void WaitForGpuIdle() override;
+    virtual void RetireHwDmaBuffers() override;
+    virtual void SubmitHeldDmaBuffers() override;
+    virtual void OnHwDmaBufCompletion() override;
 
     virtual NTSTATUS Start(
         IN_PDXGK_START_INFO     DxgkStartInfo,
@@ -37,8 +66,64 @@ private:
 
     VC4_REGISTER_FILE          *m_pVC4RegFile;
 
+    //
+    // DMA buffers queued to the V3D, the rendering control list pool is
+    // split between the slots. The queue is protected by the spin lock,
+    // the interrupt routine only records the interrupts for the DPC.
+    //
+
+    static const UINT           kRenderingControlListSlotSize = VC4_RENDERING_CTRL_LIST_POOL_SIZE / RosHwQueue::kMaxSlots;
+
+    // No progress of the control lists for this long is a hang, below the
+    // default TDR delay of the OS
+    static const UINT           kHangTimeoutMs = 1000;
+
+    // Period of the checks of the control list threads without interrupt
+    static const UINT           kPollIntervalMs = 1;
+
+    RosHwQueue                  m_hwQueue;
+    KSPIN_LOCK                  m_hwQueueLock;
+    ROSHWDMABUF                 m_hwDmaBufs[RosHwQueue::kMaxSlots];
+
+    volatile LONG               m_hwInterrupts;
+
+    UINT                        m_hwResets;
+    UINT                        m_hwResetDmaBufs;   // DMA buffers whose rendering the resets lost
+
+    //
+    // Render pass held in its reserved slot for the DMA buffer continuing
+    // it, kNoSlot when none is
+    //
+
+    RosRenderPass               m_renderPass;
+    UINT                        m_renderPassSlot;
+
+    UINT ReserveHwDmaBuffer();
+    void QueueHwDmaBuffer(UINT slot);
+    void StartHwDmaBuffer(UINT slot);
+    void CompleteHwDmaBuffers(UINT interrupts);
+    void WaitForHwDmaBuffer();
+    void PollHwDmaBuffer();
+    void CheckHwHang();
+    void ResetV3D();
+    void EnableInterrupts();
+    void SupplyBinnerMemory();
+
+    void GetRenderPassDmaBuf(ROSDMABUFINFO * pDmaBufInfo, RosRenderPassDmaBuf * pPassDmaBuf);
+    void AppendToRenderPass(ROSDMABUFSUBMISSION * pDmaBufSubmission, const RosRenderPassDmaBuf & passDmaBuf);
+    void SubmitRenderPass();
+    void NotifyRenderPassCompletion(UINT slot);
+
+    UINT GetDmaBufBusAddress(ROSDMABUFINFO * pDmaBufInfo);
+
     void SubmitControlList(bool bBinningControlist, UINT startAddress, UINT endAddress);
-    UINT GenerateRenderingControlList(ROSDMABUFINFO *pDmaBufInf);
+
+    void FlushGpuCaches(UINT gpuCaches);
+
+    void StartPerfCounters(const VC4PerfCounterSelect * pSelect);
+    void StopPerfCounters(UINT numCounters, UINT * pValues);
+
+    UINT GenerateRenderingControlList(ROSDMABUFINFO *pDmaBufInf, ROSDMABUFINFO *pLastDmaBufInfo, bool bLoadColor, bool bStoreColor, bool bLoadDepthStencil, bool bStoreDepthStencil, const RosRenderPassTiles & tiles);
 
     NTSTATUS SetVC4Power(bool bOn);
 
@@ -57,16 +142,9 @@ private:
             m_renderingControlListPhysicalAddress = m_controlListPoolPhysicalAddress;
         }
 
-        m_tileAllocationMemoryPhysicalAddress += 64 * kPageSize;
-
-        if ((m_tileAllocationMemoryPhysicalAddress + 64 * kPageSize) >= m_tileStatePoolPhysicalAddress)
-        {
-            m_tileAllocationMemoryPhysicalAddress = m_tileAllocPoolPhysicalAddress;
-        }
-
         m_tileStateDataArrayPhysicalAddress += 64 * kPageSize;
 
-        if ((m_tileStateDataArrayPhysicalAddress + 64 * kPageSize) >= (RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart + RosKmdGlobal::s_videoMemorySize))
+        if ((m_tileStateDataArrayPhysicalAddress + 64 * kPageSize) >= (m_tileStatePoolPhysicalAddress + VC4_TILE_STATE_DATA_ARRAY_SIZE))
         {
             m_tileStateDataArrayPhysicalAddress = m_tileStatePoolPhysicalAddress;
         }
@@ -26,7 +26,7 @@ RosKmdSoftAdapter::Start(
     return RosKmAdapter::Start(DxgkStartInfo, DxgkInterface, NumberOfVideoPresentSources, NumberOfChildren);
 }
 
-void
+bool
 RosKmdSoftAdapter::ProcessRenderBuffer(
     ROSDMABUFSUBMISSION * pDmaBufSubmission)
 {
@@ -54,10 +54,38 @@ RosKmdSoftAdapter::ProcessRenderBuffer(
                 pGpuCommand->m_resourceCopy.m_sizeBytes);
         }
         break;
+        case Timestamp:
+            ReportTimestamp(pGpuCommand->m_timestamp.m_reportGpuAddress);
+            break;
+        case CacheInvalidate:
+            // Only the CPU reads and writes the memory
+            break;
+        case MaskedFill:
+        {
+            UINT *  pWords = (UINT *)(((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_maskedFill.m_gpuAddress.QuadPart);
+
+            for (size_t i = 0; i < pGpuCommand->m_maskedFill.m_sizeBytes / sizeof(UINT); i++)
+            {
+                pWords[i] = (pWords[i] & ~pGpuCommand->m_maskedFill.m_mask) | pGpuCommand->m_maskedFill.m_value;
+            }
+        }
+        break;
+        case MsaaResolve:
+            RosMsaa::Resolve(
+                ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_msaaResolve.m_srcGpuAddress.QuadPart,
+                pGpuCommand->m_msaaResolve.m_srcWidthInTiles,
+                ((BYTE *)RosKmdGlobal::s_pVideoMemory) + pGpuCommand->m_msaaResolve.m_dstGpuAddress.QuadPart,
+                pGpuCommand->m_msaaResolve.m_dstPitchBytes,
+                pGpuCommand->m_msaaResolve.m_bDstTFormat != 0,
+                pGpuCommand->m_msaaResolve.m_width,
+                pGpuCommand->m_msaaResolve.m_height);
+            break;
         default:
             break;
         }
     }
+
+    return true;
 }
 
 BOOLEAN RosKmdSoftAdapter::InterruptRoutine(
@@ -24,7 +24,7 @@ private:
 
 protected:
 
-    virtual void ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission);
+    virtual bool ProcessRenderBuffer(ROSDMABUFSUBMISSION * pDmaBufSubmission);
 
     virtual NTSTATUS Start(
         IN_PDXGK_START_INFO     DxgkStartInfo,
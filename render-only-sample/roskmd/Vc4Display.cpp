@@ -98,13 +98,7 @@ NTSTATUS VC4_DISPLAY::SetVidPnSourceAddress (
     }
 
     NT_ASSERT(Args->ContextCount > 0);
-
-    // We indicated we do not support immediate flip by setting
-    // pDriverCaps->FlipCaps.FlipImmediateMmIo to FALSE.
-    // TODO[jordanrh]: store the capabilities somewhere so we can ASSERT them
-    // whenever we make an assumption based on them
-    NT_ASSERT(!Args->Flags.FlipImmediate);
-    NT_ASSERT(Args->Flags.FlipOnNextVSync);
+    NT_ASSERT(Args->Flags.FlipImmediate != Args->Flags.FlipOnNextVSync);
 
     if (Args->Flags.SharedPrimaryTransition) {
         ROS_LOG_WARNING("What do we do here?");
@@ -127,27 +121,73 @@ NTSTATUS VC4_DISPLAY::SetVidPnSourceAddress (
             RosKmdGlobal::s_videoMemorySize);
     }
 
+    // The OS keeps at most MaxQueuedFlipOnVSync flips outstanding
+    NT_ASSERT(Args->Flags.FlipImmediate || !this->flipQueue.IsFull());
+
+    //
+    // The display list holds one flip, the ones after it are programmed by
+    // the VfpStart interrupts after it is latched. An immediate flip is
+    // programmed right away, the HVS still picks it up at the next frame
+    // start but the OS renders to the previous primary while it is scanned
+    // out.
+    //
+    const UINT fenceId =
+        rosKmdAllocation ? rosKmdAllocation->m_lastRenderFenceId : 0;
+
+    this->TraceFlip(ROS_TRACE_QUEUE_FLIP, fenceId);
+
+    if (this->flipQueue.Queue(
+            Args->PrimaryAddress.LowPart,
+            Args->Flags.FlipImmediate ? 0 : 1,
+            fenceId)) {
+
+        this->ProgramSourceAddress(Args->PrimaryAddress.LowPart);
+        this->TraceFlip(ROS_TRACE_PROGRAM_FLIP, fenceId);
+    }
+
+    ROS_TRACE_EVENTS(
+        TRACE_LEVEL_VERBOSE,
+        ROS_TRACING_PRESENT,
+        "Successfully queued VidPn source address. (PrimaryAddress.LowPart=0x%lx, FlipImmediate=%d, queuedFlips=%d, presents=%I64d, vsyncs=%I64d, missedVSyncs=%I64d, droppedFlips=%I64d)",
+        Args->PrimaryAddress.LowPart,
+        Args->Flags.FlipImmediate,
+        this->flipQueue.GetQueuedCount(),
+        this->flipQueue.GetPresentCount(),
+        this->flipQueue.GetVSyncCount(),
+        this->flipQueue.GetMissedCount(),
+        this->flipQueue.GetDroppedCount());
+    return STATUS_SUCCESS;
+}
+
+void VC4_DISPLAY::ProgramSourceAddress (ULONG PrimaryAddress)
+{
     // PrimaryAddress is an offset into the memory segment
     ULONG physicAddress =
         RosKmdGlobal::s_videoMemoryPhysicalAddress.LowPart +
         VC4_BUS_ADDRESS_ALIAS_UNCACHED +
-        Args->PrimaryAddress.LowPart;
+        PrimaryAddress;
 
-    // Update the source address in the display list
+    // Update the source address in the display list, the HVS latches it at
+    // the start of the next frame
     WRITE_REGISTER_NOFENCE_ULONG(
         &this->displayListPtr->PointerWord0,
         physicAddress);
+}
 
-    this->currentVidPnSourceAddress = Args->PrimaryAddress;
-
-    ROS_TRACE_EVENTS(
-        TRACE_LEVEL_VERBOSE,
-        ROS_TRACING_PRESENT,
-        "Successfully programmed VidPn source address. (PrimaryAddress.LowPart=0x%lx, physicAddress=0x%lx, virtualAddress = 0x%p)",
-        Args->PrimaryAddress.LowPart,
-        physicAddress,
-        static_cast<const BYTE*>(RosKmdGlobal::s_pVideoMemory) + Args->PrimaryAddress.LowPart);
-    return STATUS_SUCCESS;
+void VC4_DISPLAY::TraceFlip (RosTraceStage Stage, UINT FenceId)
+{
+    if (!this->trace.IsEnabled()) {
+        return;
+    }
+
+    this->trace.Write(
+        KeGetCurrentProcessorNumberEx(nullptr),
+        static_cast<UINT>(reinterpret_cast<ULONG_PTR>(PsGetCurrentThreadId())),
+        KeQueryPerformanceCounter(nullptr).QuadPart,
+        Stage,
+        ROS_TRACE_INSTANT,
+        FenceId,
+        0);
 }
 
 _Use_decl_annotations_
@@ -168,6 +208,26 @@ BOOLEAN VC4_DISPLAY::InterruptRoutine (
     if (intStat.VfpStart) {
         // ROS_LOG_TRACE("Notifying dxgkrnl of VSYNC interrupt.");
 
+        // The flip in the display list is shown from the next frame,
+        // otherwise program the next queued one for it
+        const ULONGLONG flipCount = this->flipQueue.GetFlipCount();
+        UINT nextAddress;
+        if (this->flipQueue.OnVSync(&nextAddress)) {
+            this->ProgramSourceAddress(nextAddress);
+            this->TraceFlip(
+                ROS_TRACE_PROGRAM_FLIP,
+                this->flipQueue.GetScanoutFenceId());
+        }
+
+        if (this->flipQueue.GetFlipCount() != flipCount) {
+            this->TraceFlip(
+                ROS_TRACE_SHOW_FLIP,
+                this->flipQueue.GetScanoutFenceId());
+        }
+
+        this->currentVidPnSourceAddress.QuadPart =
+            this->flipQueue.GetScanoutAddress();
+
         // Notify framework that previous active buffer is now safe
         // to use again
         DXGKARGCB_NOTIFY_INTERRUPT_DATA args = {};
@@ -206,7 +266,8 @@ VC4_DISPLAY::VC4_DISPLAY (
     const DEVICE_OBJECT* PhysicalDeviceObjectPtr,
     const DXGKRNL_INTERFACE& DxgkInterface,
     const DXGK_START_INFO& DxgkStartInfo,
-    const DXGK_DEVICE_INFO& DxgkDeviceInfo
+    const DXGK_DEVICE_INFO& DxgkDeviceInfo,
+    RosTrace& Trace
     ) :
     physicalDeviceObjectPtr(PhysicalDeviceObjectPtr),
     dxgkInterface(DxgkInterface),
@@ -222,7 +283,8 @@ VC4_DISPLAY::VC4_DISPLAY (
     biosFrameBufferPtr(),
     displayListPtr(),
     displayListControlWord0(),
-    currentVidPnSourceAddress()
+    currentVidPnSourceAddress(),
+    trace(Trace)
 {
     PAGED_CODE();
     ROS_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
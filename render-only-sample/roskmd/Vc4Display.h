@@ -19,7 +19,8 @@
 //        the flow of pixels from the HVS to the HDMI controller. Generates
 //        interrupts at various points in the scanout process, including the
 //        VfpStart (Vertical Front Porch) interrupt, which is used to know
-//        when the current frame buffer is no longer needed
+//        when the current frame buffer is no longer needed and to program
+//        the next queued flip
 //      - HDMI - receives output from the pixelvalve, participates in mode
 //        setting
 //
@@ -36,6 +37,8 @@
 #include "Vc4Hvs.h"
 #include "Vc4PixelValve.h"
 #include "Vc4Debug.h"
+#include "RosFlipQueue.h"
+#include "RosTraceRing.h"
 
 class VC4_DISPLAY {
 public: // NONPAGED
@@ -81,6 +84,14 @@ private: // NONPAGED
     
     static ULONG Vc4PhysicalAddressFromVirtual (VOID* Address);
 
+    // Writes the primary at the offset into the video memory segment to
+    // the display list
+    void ProgramSourceAddress (ULONG PrimaryAddress);
+
+    // Records a flip in the trace of the adapter, the fence of the last DMA
+    // buffer rendering the primary ties it to its frame
+    void TraceFlip (RosTraceStage Stage, UINT FenceId);
+
     const DEVICE_OBJECT* const physicalDeviceObjectPtr;
     const DXGKRNL_INTERFACE& dxgkInterface;
     const DXGK_START_INFO& dxgkStartInfo;
@@ -96,6 +107,8 @@ private: // NONPAGED
     VC4HVS_DLIST_ENTRY_UNITY* displayListPtr;
     VC4HVS_DLIST_CONTROL_WORD_0 displayListControlWord0;
     PHYSICAL_ADDRESS currentVidPnSourceAddress;
+    RosFlipQueue flipQueue;     // PrimaryAddress of the flips
+    RosTrace& trace;
 
 public: // PAGED
 
@@ -104,7 +117,8 @@ public: // PAGED
         const DEVICE_OBJECT* PhysicalDeviceObjectPtr,
         const DXGKRNL_INTERFACE& DxgkInterface,
         const DXGK_START_INFO& DxgkStartInfo,
-        const DXGK_DEVICE_INFO& DxgkDeviceInfo
+        const DXGK_DEVICE_INFO& DxgkDeviceInfo,
+        RosTrace& Trace
         );
 
     _IRQL_requires_(PASSIVE_LEVEL)
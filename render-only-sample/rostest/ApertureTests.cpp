@@ -0,0 +1,326 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "ApertureTests.h"
+
+#include "RosAperturePageTable.h"
+#include "RosSegmentAllocator.h"
+
+#include <vector>
+#include <deque>
+
+using namespace WEX::TestExecution;
+
+const UINT APERTURE_BASE_ADDRESS = 0xC0000000;
+const UINT APERTURE_PAGE_COUNT = 8192;
+const UINT PAGE_SIZE_BYTES = RosAperturePageTable::kPageSize;
+
+class HostAperturePageTable : public RosAperturePageTable {
+public:
+    HostAperturePageTable () :
+        m_entries(APERTURE_PAGE_COUNT)
+    {
+        Init(APERTURE_BASE_ADDRESS, m_entries.data(), APERTURE_PAGE_COUNT);
+    }
+
+private:
+    std::vector<RosAperturePte> m_entries;
+};
+
+//
+// Walks the pages of the range like the GPU would have to
+//
+static bool ReferenceTranslate (
+    const std::vector<UINT>& Pfns,
+    UINT Address,
+    UINT Size,
+    UINT* pPhysicalAddress)
+{
+    const UINT firstPage = (Address - APERTURE_BASE_ADDRESS) / PAGE_SIZE_BYTES;
+    const UINT lastPage = (Address - APERTURE_BASE_ADDRESS + Size - 1) / PAGE_SIZE_BYTES;
+
+    if (lastPage >= APERTURE_PAGE_COUNT) {
+        return false;
+    }
+
+    for (UINT page = firstPage; page <= lastPage; ++page) {
+        if ((Pfns[page] == 0) || (Pfns[page] != Pfns[firstPage] + (page - firstPage))) {
+            return false;
+        }
+    }
+
+    *pPhysicalAddress = Pfns[firstPage] * PAGE_SIZE_BYTES + (Address % PAGE_SIZE_BYTES);
+    return true;
+}
+
+void ApertureTests::TestPageTableTranslation ()
+{
+    HostAperturePageTable pageTable;
+
+    // 0 marks an unmapped page in the reference
+    std::vector<UINT> pfns(APERTURE_PAGE_COUNT, 0);
+
+    UINT seed = 1;
+    auto random = [&seed] () {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+
+    UINT inPlace = 0;
+    UINT translations = 0;
+
+    for (UINT op = 0; op < 20000; ++op) {
+        const UINT firstPage = random() % APERTURE_PAGE_COUNT;
+        const UINT pageCount = min(random() % 64 + 1, APERTURE_PAGE_COUNT - firstPage);
+
+        if (random() % 3) {
+            //
+            // Mostly contiguous frames with breaks, like pages handed out
+            // by a fragmented system
+            //
+            UINT pfn = random() % 0x10000 + 1;
+            for (UINT i = 0; i < pageCount; ++i) {
+                if ((random() % 8) == 0) {
+                    pfn = random() % 0x10000 + 1;
+                }
+
+                pageTable.MapPage(firstPage + i, pfn);
+                pfns[firstPage + i] = pfn++;
+            }
+        } else {
+            for (UINT i = 0; i < pageCount; ++i) {
+                pageTable.UnmapPage(firstPage + i);
+                pfns[firstPage + i] = 0;
+            }
+        }
+
+        pageTable.UpdateRuns(firstPage, pageCount);
+
+        for (UINT check = 0; check < 8; ++check) {
+            const UINT address = APERTURE_BASE_ADDRESS + random() % (APERTURE_PAGE_COUNT * PAGE_SIZE_BYTES);
+            const UINT size = (random() % 4) ? (random() % 256 + 1) : (random() % (128 * PAGE_SIZE_BYTES) + 1);
+
+            UINT expected = 0;
+            UINT actual = 0;
+
+            const bool expectedResult = ReferenceTranslate(pfns, address, size, &expected);
+            const bool actualResult = pageTable.Translate(address, size, &actual);
+
+            VERIFY_ARE_EQUAL(expectedResult, actualResult);
+            if (expectedResult) {
+                VERIFY_ARE_EQUAL(expected, actual);
+                ++inPlace;
+            }
+
+            ++translations;
+        }
+    }
+
+    UINT mappedPages = 0;
+    for (UINT pfn : pfns) {
+        mappedPages += (pfn != 0) ? 1 : 0;
+    }
+
+    VERIFY_ARE_EQUAL(mappedPages, pageTable.GetMappedPageCount());
+
+    LogComment(
+        L"%u translations, %u physically contiguous, %u pages mapped",
+        translations,
+        inPlace,
+        mappedPages);
+
+    VERIFY_IS_TRUE(inPlace > 0);
+    VERIFY_IS_TRUE(inPlace < translations);
+}
+
+//
+// System page frames handed out to VidMm, freed frames go to the back of
+// the list. Shuffle is the fraction of frames swapped out of order at
+// startup.
+//
+class HostPageFrames {
+public:
+    HostPageFrames (UINT Count, double Shuffle, UINT Seed)
+    {
+        std::vector<UINT> frames(Count);
+        for (UINT i = 0; i < Count; ++i) {
+            frames[i] = 0x1000 + i;
+        }
+
+        const UINT swaps = UINT(Count * Shuffle);
+        for (UINT i = 0; i < swaps; ++i) {
+            Seed = Seed * 1103515245 + 12345;
+            const UINT a = (Seed >> 8) % Count;
+            Seed = Seed * 1103515245 + 12345;
+            const UINT b = (Seed >> 8) % Count;
+            std::swap(frames[a], frames[b]);
+        }
+
+        m_free.assign(frames.begin(), frames.end());
+    }
+
+    UINT Allocate ()
+    {
+        VERIFY_IS_FALSE(m_free.empty());
+        const UINT frame = m_free.front();
+        m_free.pop_front();
+        return frame;
+    }
+
+    void Free (UINT Frame)
+    {
+        m_free.push_back(Frame);
+    }
+
+private:
+    std::deque<UINT> m_free;
+};
+
+struct STREAMING_BUFFER {
+    UINT Size;
+    bool GpuRead;   // Staging readbacks are only touched by the CPU
+};
+
+struct APERTURE_INSTANCE {
+    RosSegmentHandle Handle;
+    UINT Size;
+    UINT Frame;
+};
+
+struct STREAMING_RESULT {
+    ULONGLONG BytesWritten;
+    ULONGLONG BytesInPlace;
+    ULONGLONG BytesBounced;
+};
+
+//
+// Every frame renames each buffer (map with discard) and reads the GPU
+// visible ones in a draw. Instances are released once the frame that
+// used them is out of flight, which unmaps their pages.
+//
+static STREAMING_RESULT RunStreamingWorkload (
+    const std::vector<STREAMING_BUFFER>& Buffers,
+    UINT NumFrames,
+    double Shuffle)
+{
+    const UINT framesInFlight = 3;
+
+    HostAperturePageTable pageTable;
+    HostPageFrames frames(APERTURE_PAGE_COUNT * 2, Shuffle, 7);
+
+    // Stands in for VidMm placing allocations in the aperture
+    std::vector<RosSegmentBlock> blocks(APERTURE_PAGE_COUNT + 1);
+    std::vector<UINT> handles(APERTURE_PAGE_COUNT);
+    RosSegmentAllocator placement;
+    placement.Init(
+        APERTURE_PAGE_COUNT * PAGE_SIZE_BYTES,
+        PAGE_SIZE_BYTES,
+        blocks.data(),
+        UINT(blocks.size()),
+        handles.data(),
+        UINT(handles.size()),
+        NULL,
+        0);
+
+    std::deque<APERTURE_INSTANCE> instances;
+
+    STREAMING_RESULT result = {};
+
+    for (UINT frame = 0; frame < NumFrames; ++frame) {
+        while (!instances.empty() && (instances.front().Frame + framesInFlight <= frame)) {
+            const APERTURE_INSTANCE& instance = instances.front();
+            const UINT firstPage = placement.GetOffset(instance.Handle) / PAGE_SIZE_BYTES;
+            const UINT pageCount = (instance.Size + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES;
+
+            for (UINT i = 0; i < pageCount; ++i) {
+                UINT physicalAddress;
+                VERIFY_IS_TRUE(pageTable.Translate(APERTURE_BASE_ADDRESS + (firstPage + i) * PAGE_SIZE_BYTES, 1, &physicalAddress));
+                frames.Free(physicalAddress / PAGE_SIZE_BYTES);
+                pageTable.UnmapPage(firstPage + i);
+            }
+
+            pageTable.UpdateRuns(firstPage, pageCount);
+            placement.Free(instance.Handle);
+
+            instances.pop_front();
+        }
+
+        for (const STREAMING_BUFFER& buffer : Buffers) {
+            APERTURE_INSTANCE instance;
+            instance.Size = buffer.Size;
+            instance.Frame = frame;
+
+            VERIFY_IS_TRUE(placement.Allocate(buffer.Size, PAGE_SIZE_BYTES, ROS_SEGMENT_ALLOC_PINNED, &instance.Handle));
+
+            const UINT firstPage = placement.GetOffset(instance.Handle) / PAGE_SIZE_BYTES;
+            const UINT pageCount = (buffer.Size + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES;
+
+            for (UINT i = 0; i < pageCount; ++i) {
+                pageTable.MapPage(firstPage + i, frames.Allocate());
+            }
+
+            pageTable.UpdateRuns(firstPage, pageCount);
+
+            result.BytesWritten += buffer.Size;
+
+            if (buffer.GpuRead) {
+                UINT physicalAddress;
+                if (pageTable.Translate(APERTURE_BASE_ADDRESS + firstPage * PAGE_SIZE_BYTES, buffer.Size, &physicalAddress)) {
+                    result.BytesInPlace += buffer.Size;
+                } else {
+                    result.BytesBounced += buffer.Size;
+                }
+            }
+
+            instances.push_back(instance);
+        }
+    }
+
+    return result;
+}
+
+void ApertureTests::TestStreamingTransfers ()
+{
+    //
+    // Per frame: vertex data streamed through a few dynamic vertex and
+    // index buffers, many small dynamic buffers for sprites and UI, and a
+    // staging texture read back by the CPU
+    //
+    std::vector<STREAMING_BUFFER> buffers;
+
+    for (UINT i = 0; i < 4; ++i) {
+        buffers.push_back({ 64 * 1024, true });
+        buffers.push_back({ 16 * 1024, true });
+    }
+
+    for (UINT i = 0; i < 32; ++i) {
+        buffers.push_back({ 2 * 1024, true });
+    }
+
+    buffers.push_back({ 256 * 256 * 4, false });
+
+    const UINT numFrames = 600;
+    const double shuffles[] = { 0.0, 0.1, 0.5, 1.0 };
+
+    for (double shuffle : shuffles) {
+        const STREAMING_RESULT result = RunStreamingWorkload(buffers, numFrames, shuffle);
+
+        //
+        // In local video memory every renamed instance is copied in by a
+        // paging buffer TRANSFER when VidMm pages it in
+        //
+        const double videoMemoryBytes = double(result.BytesWritten) / numFrames;
+        const double bouncedBytes = double(result.BytesBounced) / numFrames;
+        const double inPlaceBytes = double(result.BytesInPlace) / numFrames;
+
+        LogComment(
+            L"Page frames %.0f%% shuffled: local video memory %.0f bytes/frame transferred, aperture %.0f bytes/frame read in place, %.0f bytes/frame copied",
+            shuffle * 100.0,
+            videoMemoryBytes,
+            inPlaceBytes,
+            bouncedBytes);
+
+        VERIFY_IS_TRUE(result.BytesBounced < result.BytesWritten);
+        VERIFY_IS_TRUE(result.BytesInPlace > 0);
+    }
+}
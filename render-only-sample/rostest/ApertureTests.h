@@ -0,0 +1,26 @@
+#ifndef _APERTURE_TESTS_H_
+#define _APERTURE_TESTS_H_
+
+//
+// Tests of the aperture segment page table. These run on the host, page
+// frame numbers are simulated.
+//
+class ApertureTests {
+    BEGIN_TEST_CLASS(ApertureTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestPageTableTranslation)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies translation and physical contiguity of aperture ranges against a reference across random map and unmap operations.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestStreamingTransfers)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Measures the bytes copied per frame for a streaming workload of dynamic buffers and staging readbacks, with resources in local video memory against resources in the aperture segment.")
+    END_TEST_METHOD()
+};
+
+#endif // _APERTURE_TESTS_H_
@@ -0,0 +1,546 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "BinnerMemoryTests.h"
+
+#include "RosBinnerMemory.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Sizes of the KMD (Vc4Ddi.h)
+//
+const UINT TILE_ALLOCATION_MEMORY_MIN_SIZE = 64 * 1024;
+const UINT TILE_ALLOCATION_MEMORY_SIZE = 1024 * 1024;
+const UINT OVERSPILL_POOL_SIZE = 512 * 1024;
+const UINT OVERSPILL_BLOCK_SIZE = 64 * 1024;
+const UINT TILE_ALLOCATION_BLOCK_SIZE = 32;
+
+//
+// Bus addresses of the tile allocation memory and of the overspill pool
+//
+const UINT TILE_ALLOCATION_ADDRESS = 0x10000000;
+const UINT OVERSPILL_POOL_ADDRESS = 0x20000000;
+
+// A tile list block ends with the branch to the next one
+const UINT BRANCH_SIZE = 5;
+
+// Compressed primitive list record of a triangle
+const UINT PRIMITIVE_RECORD_SIZE = 3;
+
+//
+// Tile list blocks the binner allocates before the DPC services the out of
+// memory interrupt
+//
+const UINT INTERRUPT_LATENCY_BLOCKS = 256;
+
+//
+// Passes the binner may stay stalled before the KMD detects the hang
+//
+const UINT HANG_PASSES = 4;
+
+// 1920x1088 in 64x64 tiles
+const UINT WIDTH_IN_TILES = 30;
+const UINT HEIGHT_IN_TILES = 17;
+const UINT NUM_TILES = WIDTH_IN_TILES * HEIGHT_IN_TILES;
+
+//
+// Binner of the V3D building the tile lists of a frame. The initial block
+// of every tile is at the start of the tile allocation memory, the rest of
+// it is the pool of V3D_BPCA/V3D_BPCS the lists grow from. When the pool
+// can't hold a block the binner continues in the overspill block of
+// V3D_BPOA/V3D_BPOS, which leaves V3D_BPOS empty and raises the out of
+// memory interrupt. Without an overspill block it stalls.
+//
+class SimulatedBinner {
+public:
+    SimulatedBinner () :
+        m_bpca(0),
+        m_bpcs(0),
+        m_bpoa(0),
+        m_bpos(0),
+        m_pRecords(nullptr),
+        m_next(0),
+        m_consumed(0),
+        m_stalled(false)
+    {
+    }
+
+    // Tile Binning Mode Config, the records are the tiles of the primitives
+    void Start (UINT Address, UINT Size, const std::vector<UINT> * pRecords)
+    {
+        const UINT initialBlocksSize = NUM_TILES * TILE_ALLOCATION_BLOCK_SIZE;
+
+        m_bpca = Address + initialBlocksSize;
+        m_bpcs = Size - initialBlocksSize;
+        m_pRecords = pRecords;
+        m_next = 0;
+        m_consumed = initialBlocksSize;
+        m_stalled = false;
+        m_tileFree.assign(NUM_TILES, TILE_ALLOCATION_BLOCK_SIZE - BRANCH_SIZE);
+        m_overspill.clear();
+    }
+
+    //
+    // Bins until the frame is done, it stalls or MaxBlocks tile list blocks
+    // were allocated. Returns true when the frame is done.
+    //
+    bool Run (UINT MaxBlocks)
+    {
+        UINT blocks = 0;
+
+        while (m_next < m_pRecords->size()) {
+            const UINT tile = (*m_pRecords)[m_next];
+
+            if (m_tileFree[tile] < PRIMITIVE_RECORD_SIZE) {
+                if (blocks == MaxBlocks) {
+                    return false;
+                }
+                if (!AllocateBlock()) {
+                    m_stalled = true;
+                    return false;
+                }
+                ++blocks;
+                m_tileFree[tile] = TILE_ALLOCATION_BLOCK_SIZE - BRANCH_SIZE;
+            }
+
+            m_tileFree[tile] -= PRIMITIVE_RECORD_SIZE;
+            ++m_next;
+        }
+
+        return true;
+    }
+
+    // V3D_REG_INTCTL.INT_OUTOFMEM
+    bool IsOutOfMemory () const
+    {
+        return m_bpos == 0;
+    }
+
+    bool IsStalled () const
+    {
+        return m_stalled;
+    }
+
+    void SetOverspill (UINT Address, UINT Size)
+    {
+        m_bpoa = Address;
+        m_bpos = Size;
+    }
+
+    UINT GetBPOA () const
+    {
+        return m_bpoa;
+    }
+
+    UINT GetBPCS () const
+    {
+        return m_bpcs;
+    }
+
+    // Bytes taken from the tile allocation memory and overspill blocks
+    UINT GetConsumed () const
+    {
+        return m_consumed;
+    }
+
+    // Overspill blocks the lists of the frame continued in
+    const std::vector<UINT> & GetOverspill () const
+    {
+        return m_overspill;
+    }
+
+    // The rendering read the tile lists
+    void EndFrame ()
+    {
+        m_overspill.clear();
+    }
+
+    // Power cycle
+    void Reset ()
+    {
+        m_bpca = 0;
+        m_bpcs = 0;
+        m_bpoa = 0;
+        m_bpos = 0;
+        m_stalled = false;
+    }
+
+private:
+    bool AllocateBlock ()
+    {
+        if (m_bpcs < TILE_ALLOCATION_BLOCK_SIZE) {
+            if (m_bpos == 0) {
+                return false;
+            }
+
+            // What is left of the pool stays unused
+            m_consumed += m_bpcs;
+
+            m_bpca = m_bpoa;
+            m_bpcs = m_bpos;
+            m_bpos = 0;
+            m_overspill.push_back(m_bpca);
+        }
+
+        m_stalled = false;
+        m_bpca += TILE_ALLOCATION_BLOCK_SIZE;
+        m_bpcs -= TILE_ALLOCATION_BLOCK_SIZE;
+        m_consumed += TILE_ALLOCATION_BLOCK_SIZE;
+
+        return true;
+    }
+
+    UINT m_bpca;
+    UINT m_bpcs;
+    UINT m_bpoa;
+    UINT m_bpos;
+
+    const std::vector<UINT> * m_pRecords;
+    size_t m_next;
+    std::vector<UINT> m_tileFree;
+
+    UINT m_consumed;
+    bool m_stalled;
+    std::vector<UINT> m_overspill;
+};
+
+//
+// Dense geometry: small triangles each in one tile, spread over the frame
+//
+static std::vector<UINT> DenseGeometry (UINT NumTriangles, UINT Seed)
+{
+    std::vector<UINT> records(NumTriangles);
+
+    UINT state = Seed;
+    for (UINT i = 0; i < NumTriangles; ++i) {
+        state = state * 1664525 + 1013904223;
+        records[i] = (state >> 8) % NUM_TILES;
+    }
+
+    return records;
+}
+
+static void InitBinnerMemory (RosBinnerMemory * pMemory, UINT PoolSize)
+{
+    pMemory->Init(
+        OVERSPILL_BLOCK_SIZE,
+        PoolSize / OVERSPILL_BLOCK_SIZE,
+        TILE_ALLOCATION_MEMORY_MIN_SIZE,
+        TILE_ALLOCATION_MEMORY_SIZE);
+}
+
+//
+// DPC of the out of memory interrupt. A supplied block must not hold tile
+// lists of the frame.
+//
+static void ServiceOutOfMemory (RosBinnerMemory & Memory, SimulatedBinner & Binner)
+{
+    if (!Binner.IsOutOfMemory()) {
+        return;
+    }
+
+    Memory.OnOverspillTaken();
+
+    UINT block;
+    if (Memory.Supply(&block)) {
+        const UINT address = OVERSPILL_POOL_ADDRESS + Memory.GetBlockOffset(block);
+        const std::vector<UINT> & overspill = Binner.GetOverspill();
+
+        VERIFY_IS_TRUE(std::find(overspill.begin(), overspill.end(), address) == overspill.end());
+
+        Binner.SetOverspill(address, Memory.GetBlockSize());
+    }
+}
+
+struct FRAME_RESULT {
+    bool Completed;
+    UINT Usage;
+    UINT Overspill;
+    UINT Stalls;
+};
+
+//
+// Bins a frame with initial tile allocation memory of InitialSize, the
+// interrupt is serviced every INTERRUPT_LATENCY_BLOCKS. A binner stalled
+// for HANG_PASSES is reset.
+//
+static FRAME_RESULT RunFrame (
+    RosBinnerMemory & Memory,
+    SimulatedBinner & Binner,
+    UINT InitialSize,
+    const std::vector<UINT> & Records)
+{
+    FRAME_RESULT result = { false, 0, 0, 0 };
+
+    Memory.Begin(InitialSize);
+    Binner.Start(TILE_ALLOCATION_ADDRESS, InitialSize, &Records);
+
+    UINT stalledPasses = 0;
+
+    while (!Binner.Run(INTERRUPT_LATENCY_BLOCKS)) {
+        ServiceOutOfMemory(Memory, Binner);
+
+        if (!Binner.IsStalled()) {
+            continue;
+        }
+
+        ++result.Stalls;
+
+        if (Binner.IsOutOfMemory() && (++stalledPasses == HANG_PASSES)) {
+            Memory.Reset();
+            Binner.Reset();
+            Binner.EndFrame();
+            ServiceOutOfMemory(Memory, Binner);
+            return result;
+        }
+    }
+
+    //
+    // The overspill blocks the frame continued in are distinct blocks of
+    // the pool
+    //
+    std::vector<UINT> overspill = Binner.GetOverspill();
+    std::sort(overspill.begin(), overspill.end());
+    VERIFY_IS_TRUE(std::adjacent_find(overspill.begin(), overspill.end()) == overspill.end());
+    for (size_t i = 0; i < overspill.size(); ++i) {
+        VERIFY_IS_TRUE(overspill[i] >= OVERSPILL_POOL_ADDRESS);
+        VERIFY_IS_TRUE(overspill[i] < OVERSPILL_POOL_ADDRESS + OVERSPILL_POOL_SIZE);
+        VERIFY_ARE_EQUAL(0u, (overspill[i] - OVERSPILL_POOL_ADDRESS) % OVERSPILL_BLOCK_SIZE);
+    }
+
+    // Frame done
+    result.Completed = true;
+    result.Usage = Memory.Complete(Binner.GetBPCS());
+    result.Overspill = UINT(overspill.size());
+
+    VERIFY_ARE_EQUAL(Binner.GetConsumed(), result.Usage);
+
+    Binner.EndFrame();
+
+    ServiceOutOfMemory(Memory, Binner);
+
+    return result;
+}
+
+void BinnerMemoryTests::TestOverflowProtocol ()
+{
+    RosBinnerMemory memory;
+    SimulatedBinner binner;
+
+    InitBinnerMemory(&memory, OVERSPILL_POOL_SIZE);
+
+    //
+    // The binner has its first overspill block when it starts
+    //
+    ServiceOutOfMemory(memory, binner);
+    VERIFY_IS_TRUE(memory.IsSupplied());
+    VERIFY_IS_FALSE(binner.IsOutOfMemory());
+
+    const UINT numBlocks = OVERSPILL_POOL_SIZE / OVERSPILL_BLOCK_SIZE;
+    const UINT initialSize = memory.GetTargetSize(NUM_TILES * TILE_ALLOCATION_BLOCK_SIZE);
+    VERIFY_ARE_EQUAL(TILE_ALLOCATION_MEMORY_MIN_SIZE, initialSize);
+
+    //
+    // A light frame fits in the initial memory, the supplied block carries
+    // over
+    //
+    const UINT supplied = binner.GetBPOA();
+    const std::vector<UINT> light = DenseGeometry(2000, 1);
+    FRAME_RESULT result = RunFrame(memory, binner, initialSize, light);
+    VERIFY_IS_TRUE(result.Completed);
+    VERIFY_IS_TRUE(result.Usage <= initialSize);
+    VERIFY_ARE_EQUAL(0u, memory.GetOverflowCount());
+    VERIFY_ARE_EQUAL(supplied, binner.GetBPOA());
+
+    //
+    // Dense geometry takes several overspill blocks, each replaced before
+    // the binner needs the next one
+    //
+    const std::vector<UINT> dense = DenseGeometry(100000, 2);
+    result = RunFrame(memory, binner, initialSize, dense);
+    VERIFY_IS_TRUE(result.Completed);
+    VERIFY_ARE_EQUAL(0u, result.Stalls);
+    VERIFY_ARE_EQUAL(1u, memory.GetOverflowCount());
+    VERIFY_ARE_EQUAL(0u, memory.GetStarvedCount());
+    VERIFY_IS_TRUE(result.Overspill > 1);
+    VERIFY_IS_TRUE(result.Usage > initialSize + OVERSPILL_BLOCK_SIZE);
+
+    LogComment(
+        L"Dense frame: %u triangles, %u bytes of tile lists, %u overspill blocks",
+        UINT(dense.size()),
+        result.Usage,
+        result.Overspill);
+
+    //
+    // Its blocks are free once it completed, but the one supplied for the
+    // next frame
+    //
+    VERIFY_ARE_EQUAL(numBlocks - 1, memory.GetFreeCount());
+    VERIFY_IS_TRUE(memory.IsSupplied());
+    VERIFY_ARE_EQUAL(result.Usage, memory.GetPeakUsage());
+
+    //
+    // Frames that overflow again reuse the same blocks
+    //
+    for (UINT i = 0; i < 4; ++i) {
+        result = RunFrame(memory, binner, initialSize, dense);
+        VERIFY_IS_TRUE(result.Completed);
+        VERIFY_ARE_EQUAL(numBlocks - 1, memory.GetFreeCount());
+    }
+
+    VERIFY_ARE_EQUAL(5u, memory.GetOverflowCount());
+}
+
+void BinnerMemoryTests::TestPoolExhaustion ()
+{
+    const UINT poolSize = 2 * OVERSPILL_BLOCK_SIZE;
+    const UINT tileBlocksSize = NUM_TILES * TILE_ALLOCATION_BLOCK_SIZE;
+
+    RosBinnerMemory memory;
+    SimulatedBinner binner;
+
+    InitBinnerMemory(&memory, poolSize);
+    ServiceOutOfMemory(memory, binner);
+
+    //
+    // The frame needs more than the initial memory and the pool hold, the
+    // binner stalls until the reset. Each reset records more usage than the
+    // frame could have, the initial size grows until it fits.
+    //
+    const std::vector<UINT> dense = DenseGeometry(200000, 3);
+
+    UINT initialSize = memory.GetTargetSize(tileBlocksSize);
+    FRAME_RESULT result = RunFrame(memory, binner, initialSize, dense);
+    VERIFY_IS_FALSE(result.Completed);
+    VERIFY_IS_TRUE(result.Stalls > 0);
+    VERIFY_IS_TRUE(memory.GetStarvedCount() > 0);
+
+    // Every block is free after the reset, but the new one supplied
+    VERIFY_ARE_EQUAL(1u, memory.GetFreeCount());
+    VERIFY_IS_TRUE(memory.IsSupplied());
+    VERIFY_IS_FALSE(binner.IsOutOfMemory());
+
+    UINT resets = 1;
+    for (;;) {
+        UINT newSize;
+        VERIFY_IS_TRUE(memory.NeedsResize(initialSize, tileBlocksSize, &newSize));
+        VERIFY_IS_TRUE(newSize > initialSize);
+        initialSize = newSize;
+
+        result = RunFrame(memory, binner, initialSize, dense);
+        if (result.Completed) {
+            break;
+        }
+
+        ++resets;
+        VERIFY_IS_TRUE(resets < 8);
+    }
+
+    LogComment(
+        L"Frame of %u bytes of tile lists fits after %u resets, initial size %u",
+        result.Usage,
+        resets,
+        initialSize);
+
+    VERIFY_IS_TRUE(result.Usage <= initialSize + poolSize);
+
+    //
+    // The next ones don't stall
+    //
+    for (UINT i = 0; i < 4; ++i) {
+        result = RunFrame(memory, binner, initialSize, dense);
+        VERIFY_IS_TRUE(result.Completed);
+        VERIFY_ARE_EQUAL(0u, result.Stalls);
+    }
+}
+
+void BinnerMemoryTests::TestAdaptiveSizing ()
+{
+    const UINT tileBlocksSize = NUM_TILES * TILE_ALLOCATION_BLOCK_SIZE;
+    const UINT history = RosBinnerMemory::kHistory;
+
+    RosBinnerMemory memory;
+    SimulatedBinner binner;
+
+    InitBinnerMemory(&memory, OVERSPILL_POOL_SIZE);
+    ServiceOutOfMemory(memory, binner);
+
+    const std::vector<UINT> light = DenseGeometry(5000, 4);
+    const std::vector<UINT> heavy = DenseGeometry(120000, 5);
+
+    UINT initialSize = memory.GetTargetSize(tileBlocksSize);
+    UINT overflows = 0;
+    UINT resizes = 0;
+    ULONGLONG footprint = 0;
+    UINT frames = 0;
+
+    //
+    // The KMD resizes the tile allocation memory between DMA buffers
+    //
+    auto runFrame = [&] (const std::vector<UINT> & Records) {
+        UINT newSize;
+        if (memory.NeedsResize(initialSize, tileBlocksSize, &newSize)) {
+            initialSize = newSize;
+            ++resizes;
+        }
+
+        const UINT before = memory.GetOverflowCount();
+        const FRAME_RESULT result = RunFrame(memory, binner, initialSize, Records);
+        VERIFY_IS_TRUE(result.Completed);
+
+        overflows += memory.GetOverflowCount() - before;
+        footprint += initialSize;
+        ++frames;
+
+        return memory.GetOverflowCount() != before;
+    };
+
+    for (UINT i = 0; i < 20; ++i) {
+        VERIFY_IS_FALSE(runFrame(light));
+    }
+    VERIFY_ARE_EQUAL(TILE_ALLOCATION_MEMORY_MIN_SIZE, initialSize);
+
+    //
+    // The first heavy frame overflows, the initial memory grows to fit the
+    // ones after it
+    //
+    VERIFY_IS_TRUE(runFrame(heavy));
+    for (UINT i = 0; i < 10; ++i) {
+        VERIFY_IS_FALSE(runFrame(heavy));
+    }
+    VERIFY_IS_TRUE(initialSize > TILE_ALLOCATION_MEMORY_MIN_SIZE);
+    VERIFY_IS_TRUE(initialSize <= TILE_ALLOCATION_MEMORY_SIZE);
+    VERIFY_IS_TRUE(initialSize >= memory.GetPeakUsage());
+
+    const UINT grownSize = initialSize;
+
+    //
+    // It stays while the heavy frames are in the history and shrinks back
+    // once they left it
+    //
+    for (UINT i = 0; i < history; ++i) {
+        VERIFY_IS_FALSE(runFrame(light));
+        VERIFY_ARE_EQUAL(grownSize, initialSize);
+    }
+    VERIFY_IS_FALSE(runFrame(light));
+    VERIFY_ARE_EQUAL(TILE_ALLOCATION_MEMORY_MIN_SIZE, initialSize);
+
+    for (UINT i = 0; i < 10; ++i) {
+        VERIFY_IS_FALSE(runFrame(light));
+    }
+
+    VERIFY_ARE_EQUAL(1u, overflows);
+    VERIFY_ARE_EQUAL(2u, resizes);
+
+    LogComment(
+        L"%u frames, %u overflows, %u resizes, average initial size %u bytes (fixed %u bytes)",
+        frames,
+        overflows,
+        resizes,
+        UINT(footprint / frames),
+        TILE_ALLOCATION_MEMORY_SIZE);
+}
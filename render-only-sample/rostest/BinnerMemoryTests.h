@@ -0,0 +1,33 @@
+#ifndef _BINNER_MEMORY_TESTS_H_
+#define _BINNER_MEMORY_TESTS_H_
+
+//
+// Tests of the tile allocation memory of the binner. These run on the host
+// without a device, a simulated binner builds the tile lists of dense
+// geometry and runs out of memory the way the V3D does.
+//
+class BinnerMemoryTests {
+    BEGIN_TEST_CLASS(BinnerMemoryTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestOverflowProtocol)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a frame of dense geometry overflowing its initial tile allocation memory completes with the overspill blocks supplied on the out of memory interrupt, that no block is handed out twice and that the usage is accounted exactly.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestPoolExhaustion)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a binner stalled on an exhausted overspill pool is recovered by the reset, that every block is free again and that the initial size grows until the frame fits.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestAdaptiveSizing)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that the initial tile allocation memory grows after a burst of heavy frames so that they stop overflowing, and shrinks back once demand has dropped for the history window.")
+    END_TEST_METHOD()
+};
+
+#endif // _BINNER_MEMORY_TESTS_H_
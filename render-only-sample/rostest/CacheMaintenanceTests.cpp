@@ -0,0 +1,531 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "CacheMaintenanceTests.h"
+
+#include "RosUmdCacheMaintenance.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+const UINT LINE_SIZE = RosUmdDirtyRanges::kLineSize;
+
+//
+// Size of the DMA buffers and of the rendering control list the KMD cleans
+// for every DMA buffer
+//
+const UINT DMA_BUFFER_SIZE = 4096;
+const UINT RENDERING_CONTROL_LIST_SIZE = 2048;
+
+//
+// Full clean and flush of the instruction, uniform and texture caches per
+// DMA buffer, before and after the DMA buffer runs
+//
+const UINT FULL_CLEANS_PER_DMA_BUFFER = 1;
+const UINT GPU_FLUSHES_PER_DMA_BUFFER = 2;
+const UINT GPU_CACHES_PER_FLUSH = 3;
+
+struct MODEL_RESOURCE {
+    UINT Size;
+    UINT ReadCaches;
+
+    //
+    // What the UMD keeps for the resource
+    //
+    RosUmdDirtyRanges DirtyRanges;
+    UINT StaleGpuCaches;
+    bool StaleCpuCaches;
+
+    //
+    // What the caches hold: lines the CPU wrote that are not in memory yet,
+    // GPU caches with lines of the resource, GPU caches with lines older
+    // than memory and whether the CPU caches may be older than memory
+    //
+    std::vector<bool> DirtyLines;
+    UINT HeldCaches;
+    UINT OldCaches;
+    bool OldCpuLines;
+};
+
+//
+// CPU and GPU caches of the resources of a device, DMA buffers reference
+// the resources through RosUmdCacheMaintenance and the KMD part follows
+// RosKmAdapter::MaintainCaches
+//
+class CacheModel {
+public:
+    CacheModel () :
+        m_dmaBuffers(0),
+        m_bytesCleaned(0),
+        m_fullCleans(0),
+        m_gpuFlushes(0),
+        m_gpuCachesFlushed(0),
+        m_cpuInvalidations(0),
+        m_violations(0),
+        m_numDmaBuffersSinceFlush(0)
+    {}
+
+    UINT AddResource (UINT Size, UINT ReadCaches)
+    {
+        MODEL_RESOURCE resource;
+        resource.Size = Size;
+        resource.ReadCaches = ReadCaches;
+        resource.StaleGpuCaches = 0;
+        resource.StaleCpuCaches = false;
+        resource.DirtyLines.assign((Size + LINE_SIZE - 1) / LINE_SIZE, false);
+        resource.HeldCaches = 0;
+        resource.OldCaches = 0;
+        resource.OldCpuLines = false;
+
+        m_resources.push_back(resource);
+
+        return UINT(m_resources.size() - 1);
+    }
+
+    void CpuWrite (UINT Index, UINT Offset, UINT Size)
+    {
+        MODEL_RESOURCE& resource = m_resources[Index];
+
+        for (UINT line = Offset / LINE_SIZE; line < (Offset + Size + LINE_SIZE - 1) / LINE_SIZE; ++line) {
+            resource.DirtyLines[line] = true;
+        }
+
+        resource.OldCaches |= resource.HeldCaches;
+
+        resource.DirtyRanges.Add(Offset, Size);
+        resource.StaleGpuCaches |= resource.ReadCaches;
+    }
+
+    void CpuRead (UINT Index)
+    {
+        MODEL_RESOURCE& resource = m_resources[Index];
+
+        if (resource.StaleCpuCaches) {
+            resource.StaleCpuCaches = false;
+            resource.OldCpuLines = false;
+            ++m_cpuInvalidations;
+        }
+
+        if (resource.OldCpuLines) {
+            ++m_violations;
+        }
+    }
+
+    void GpuRead (UINT Index, UINT Caches)
+    {
+        MODEL_RESOURCE& resource = m_resources[Index];
+
+        m_maintenance.Reference(Index, &resource.DirtyRanges, &resource.StaleGpuCaches);
+
+        m_reads.push_back(Index);
+        m_readCaches.push_back(Caches);
+    }
+
+    void GpuWrite (UINT Index)
+    {
+        MODEL_RESOURCE& resource = m_resources[Index];
+
+        m_maintenance.Reference(Index, &resource.DirtyRanges, &resource.StaleGpuCaches);
+
+        resource.StaleGpuCaches |= resource.ReadCaches;
+        resource.StaleCpuCaches = true;
+
+        m_writes.push_back(Index);
+    }
+
+    //
+    // Runs the DMA buffer built since the last submission, DmaBufferAddress
+    // is where the KMD placed the DMA buffer with the uniforms
+    //
+    void Submit (UINT DmaBufferAddress)
+    {
+        const VC4CacheMaintenance& maintenance = m_maintenance.GetMaintenance();
+
+        if (maintenance.m_bCleanAll) {
+            for (size_t i = 0; i < m_resources.size(); ++i) {
+                m_resources[i].DirtyLines.assign(m_resources[i].DirtyLines.size(), false);
+            }
+
+            ++m_fullCleans;
+        } else {
+            m_bytesCleaned += DMA_BUFFER_SIZE + RENDERING_CONTROL_LIST_SIZE;
+
+            for (UINT i = 0; i < maintenance.m_numCleans; ++i) {
+                MODEL_RESOURCE& resource = m_resources[m_maintenance.GetCleanAllocationIndex(i)];
+
+                const UINT offset = m_maintenance.GetCleanOffset(i);
+                const UINT size = maintenance.m_cleanSizes[i];
+
+                VERIFY_ARE_EQUAL(0u, offset % LINE_SIZE);
+                VERIFY_IS_TRUE(offset + size <= resource.DirtyLines.size() * LINE_SIZE);
+
+                for (UINT line = offset / LINE_SIZE; line < (offset + size) / LINE_SIZE; ++line) {
+                    resource.DirtyLines[line] = false;
+                }
+
+                m_bytesCleaned += size;
+            }
+        }
+
+        UINT gpuCaches = maintenance.m_gpuCaches;
+
+        UINT i;
+        for (i = 0; i < m_numDmaBuffersSinceFlush; ++i) {
+            if (m_dmaBuffersSinceFlush[i] == DmaBufferAddress) {
+                break;
+            }
+        }
+
+        if ((i < m_numDmaBuffersSinceFlush) || (m_numDmaBuffersSinceFlush == ARRAYSIZE(m_dmaBuffersSinceFlush))) {
+            gpuCaches |= VC4_GPU_CACHE_UNIFORM;
+        }
+
+        if (gpuCaches & VC4_GPU_CACHE_UNIFORM) {
+            m_numDmaBuffersSinceFlush = 0;
+        }
+
+        m_dmaBuffersSinceFlush[m_numDmaBuffersSinceFlush++] = DmaBufferAddress;
+
+        if (gpuCaches) {
+            ++m_gpuFlushes;
+        }
+
+        for (UINT cache = VC4_GPU_CACHE_INSTRUCTION; cache <= VC4_GPU_CACHE_TEXTURE; cache <<= 1) {
+            if (gpuCaches & cache) {
+                ++m_gpuCachesFlushed;
+            }
+        }
+
+        //
+        // The GPU flushes its caches and runs the DMA buffer
+        //
+        for (size_t j = 0; j < m_resources.size(); ++j) {
+            m_resources[j].HeldCaches &= ~gpuCaches;
+            m_resources[j].OldCaches &= ~gpuCaches;
+        }
+
+        if (gpuCaches & VC4_GPU_CACHE_UNIFORM) {
+            m_heldDmaBuffers.clear();
+        }
+
+        for (size_t j = 0; j < m_heldDmaBuffers.size(); ++j) {
+            if (m_heldDmaBuffers[j] == DmaBufferAddress) {
+                ++m_violations;
+            }
+        }
+
+        m_heldDmaBuffers.push_back(DmaBufferAddress);
+
+        for (size_t j = 0; j < m_reads.size(); ++j) {
+            MODEL_RESOURCE& resource = m_resources[m_reads[j]];
+
+            for (size_t line = 0; line < resource.DirtyLines.size(); ++line) {
+                if (resource.DirtyLines[line]) {
+                    ++m_violations;
+                    break;
+                }
+            }
+
+            if (resource.OldCaches & m_readCaches[j]) {
+                ++m_violations;
+            }
+
+            resource.HeldCaches |= m_readCaches[j];
+        }
+
+        for (size_t j = 0; j < m_writes.size(); ++j) {
+            MODEL_RESOURCE& resource = m_resources[m_writes[j]];
+
+            resource.OldCaches |= resource.HeldCaches;
+            resource.OldCpuLines = true;
+        }
+
+        m_maintenance.Reset();
+        m_reads.clear();
+        m_readCaches.clear();
+        m_writes.clear();
+
+        ++m_dmaBuffers;
+    }
+
+    UINT GetResourceBytes () const
+    {
+        UINT bytes = 0;
+        for (size_t i = 0; i < m_resources.size(); ++i) {
+            bytes += m_resources[i].Size;
+        }
+
+        return bytes;
+    }
+
+    UINT m_dmaBuffers;
+    ULONGLONG m_bytesCleaned;
+    UINT m_fullCleans;
+    UINT m_gpuFlushes;
+    UINT m_gpuCachesFlushed;
+    UINT m_cpuInvalidations;
+    UINT m_violations;
+
+private:
+    std::vector<MODEL_RESOURCE> m_resources;
+
+    RosUmdCacheMaintenance m_maintenance;
+    std::vector<UINT> m_reads;
+    std::vector<UINT> m_readCaches;
+    std::vector<UINT> m_writes;
+
+    UINT m_dmaBuffersSinceFlush[8];
+    UINT m_numDmaBuffersSinceFlush;
+
+    // DMA buffers with uniforms in the uniform cache
+    std::vector<UINT> m_heldDmaBuffers;
+};
+
+static UINT NextRandom (UINT* pSeed)
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+    return *pSeed >> 16;
+}
+
+void CacheMaintenanceTests::TestDirtyRanges ()
+{
+    RosUmdDirtyRanges ranges;
+
+    ranges.Add(10, 1);
+    VERIFY_ARE_EQUAL(1u, ranges.GetCount());
+    VERIFY_ARE_EQUAL(0u, ranges.GetOffset(0));
+    VERIFY_ARE_EQUAL(LINE_SIZE, ranges.GetSize(0));
+
+    ranges.Add(LINE_SIZE, LINE_SIZE);
+    VERIFY_ARE_EQUAL(1u, ranges.GetCount());
+    VERIFY_ARE_EQUAL(2 * LINE_SIZE, ranges.GetSize(0));
+
+    ranges.Add(1000, 100);
+    VERIFY_ARE_EQUAL(2u, ranges.GetCount());
+    VERIFY_ARE_EQUAL(960u, ranges.GetOffset(1));
+    VERIFY_ARE_EQUAL(192u, ranges.GetSize(1));
+
+    ranges.Add(100, 900);
+    VERIFY_ARE_EQUAL(1u, ranges.GetCount());
+    VERIFY_ARE_EQUAL(1152u, ranges.GetBytes());
+
+    ranges.Add(4096, 64);
+    ranges.Add(8192, 64);
+    ranges.Add(16384, 64);
+    VERIFY_ARE_EQUAL(4u, ranges.GetCount());
+
+    //
+    // Full, the two ranges with the smallest gap merge
+    //
+    ranges.Add(2048, 64);
+    VERIFY_ARE_EQUAL(4u, ranges.GetCount());
+    VERIFY_ARE_EQUAL(0u, ranges.GetOffset(0));
+    VERIFY_ARE_EQUAL(2048u + 64u, ranges.GetSize(0));
+
+    ranges.Clear();
+    VERIFY_IS_TRUE(ranges.IsEmpty());
+
+    //
+    // Random writes, every written byte stays in a range
+    //
+    const UINT size = 64 * 1024;
+
+    UINT seed = 3;
+    for (UINT round = 0; round < 200; ++round) {
+        std::vector<bool> written(size, false);
+        ranges.Clear();
+
+        const UINT writes = 1 + NextRandom(&seed) % 12;
+        for (UINT i = 0; i < writes; ++i) {
+            const UINT offset = NextRandom(&seed) % size;
+            const UINT length = 1 + NextRandom(&seed) % min(size - offset, 2048u);
+
+            for (UINT j = offset; j < offset + length; ++j) {
+                written[j] = true;
+            }
+
+            ranges.Add(offset, length);
+        }
+
+        VERIFY_IS_TRUE(ranges.GetCount() <= RosUmdDirtyRanges::kMaxRanges);
+
+        for (UINT i = 0; i < ranges.GetCount(); ++i) {
+            VERIFY_ARE_EQUAL(0u, ranges.GetOffset(i) % LINE_SIZE);
+            VERIFY_ARE_EQUAL(0u, ranges.GetSize(i) % LINE_SIZE);
+
+            if (i > 0) {
+                VERIFY_IS_TRUE(ranges.GetOffset(i - 1) + ranges.GetSize(i - 1) < ranges.GetOffset(i));
+            }
+        }
+
+        for (UINT j = 0; j < size; ++j) {
+            if (!written[j]) {
+                continue;
+            }
+
+            bool covered = false;
+            for (UINT i = 0; i < ranges.GetCount(); ++i) {
+                covered |= (j >= ranges.GetOffset(i)) && (j < ranges.GetOffset(i) + ranges.GetSize(i));
+            }
+
+            VERIFY_IS_TRUE(covered);
+        }
+    }
+}
+
+void CacheMaintenanceTests::TestCoherence ()
+{
+    CacheModel model;
+
+    const UINT numResources = 12;
+    const UINT caches[] = { 0, VC4_GPU_CACHE_TEXTURE, VC4_GPU_CACHE_UNIFORM, VC4_GPU_CACHE_INSTRUCTION };
+
+    UINT seed = 11;
+
+    std::vector<UINT> sizes;
+    for (UINT i = 0; i < numResources; ++i) {
+        sizes.push_back(4096 * (1 + NextRandom(&seed) % 16));
+        model.AddResource(sizes[i], caches[i % ARRAYSIZE(caches)]);
+    }
+
+    for (UINT dmaBuffer = 0; dmaBuffer < 4000; ++dmaBuffer) {
+        const UINT cpuWrites = NextRandom(&seed) % 8;
+        for (UINT i = 0; i < cpuWrites; ++i) {
+            const UINT index = NextRandom(&seed) % numResources;
+            const UINT offset = NextRandom(&seed) % sizes[index];
+            const UINT length = 1 + NextRandom(&seed) % min(sizes[index] - offset, 4096u);
+
+            model.CpuWrite(index, offset, length);
+        }
+
+        const UINT written = NextRandom(&seed) % (numResources + 4);
+
+        const UINT gpuReads = 1 + NextRandom(&seed) % 8;
+        for (UINT i = 0; i < gpuReads; ++i) {
+            const UINT index = NextRandom(&seed) % numResources;
+            if (index != written) {
+                model.GpuRead(index, caches[index % ARRAYSIZE(caches)]);
+            }
+        }
+
+        if (written < numResources) {
+            model.GpuWrite(written);
+        }
+
+        model.Submit(NextRandom(&seed) % 6);
+
+        if ((NextRandom(&seed) % 16) == 0) {
+            model.CpuRead(NextRandom(&seed) % numResources);
+        }
+    }
+
+    LogComment(
+        L"%u DMA buffers, %I64u bytes cleaned, %u full cleans, %u GPU cache flushes, %u CPU cache invalidations",
+        model.m_dmaBuffers,
+        model.m_bytesCleaned,
+        model.m_fullCleans,
+        model.m_gpuFlushes,
+        model.m_cpuInvalidations);
+
+    VERIFY_ARE_EQUAL(0u, model.m_violations);
+    VERIFY_IS_TRUE(model.m_fullCleans > 0, L"Maintenance beyond the patch locations falls back to a full clean");
+    VERIFY_IS_TRUE(model.m_fullCleans < model.m_dmaBuffers / 4);
+    VERIFY_IS_TRUE(model.m_gpuFlushes < model.m_dmaBuffers);
+}
+
+void CacheMaintenanceTests::TestMaintenanceCost ()
+{
+    CacheModel model;
+
+    //
+    // A frame renders a shadow map sampled by the pass to the back buffer,
+    // both passes draw from a dynamic vertex buffer with constants updated
+    // every frame
+    //
+    const UINT vertexBuffer = model.AddResource(256 * 1024, 0);
+    const UINT constants = model.AddResource(64 * 1024, VC4_GPU_CACHE_UNIFORM);
+    const UINT shaderHeap = model.AddResource(64 * 1024, VC4_GPU_CACHE_INSTRUCTION);
+    const UINT texture = model.AddResource(1024 * 1024, VC4_GPU_CACHE_TEXTURE);
+    const UINT shadowMap = model.AddResource(1024 * 1024, VC4_GPU_CACHE_TEXTURE);
+    const UINT backBuffer = model.AddResource(1920 * 1080 * 4, 0);
+    const UINT staging = model.AddResource(64 * 1024, 0);
+
+    model.CpuWrite(shaderHeap, 0, 8 * 1024);
+    model.CpuWrite(texture, 0, 1024 * 1024);
+
+    const UINT numFrames = 120;
+
+    UINT vertexOffset = 0;
+    UINT constantOffset = 0;
+    UINT dmaBufferAddress = 0;
+
+    for (UINT frame = 0; frame < numFrames; ++frame) {
+        for (UINT pass = 0; pass < 2; ++pass) {
+            model.CpuWrite(vertexBuffer, vertexOffset, 6 * 1024);
+            vertexOffset = (vertexOffset + 6 * 1024) % (252 * 1024);
+
+            for (UINT draw = 0; draw < 3; ++draw) {
+                model.CpuWrite(constants, constantOffset, 256);
+                constantOffset = (constantOffset + 256) % (64 * 1024);
+            }
+
+            model.GpuRead(vertexBuffer, 0);
+            model.GpuRead(constants, VC4_GPU_CACHE_UNIFORM);
+            model.GpuRead(shaderHeap, VC4_GPU_CACHE_INSTRUCTION);
+
+            if (pass == 0) {
+                model.GpuRead(texture, VC4_GPU_CACHE_TEXTURE);
+                model.GpuWrite(shadowMap);
+            } else {
+                model.GpuRead(shadowMap, VC4_GPU_CACHE_TEXTURE);
+                model.GpuWrite(backBuffer);
+            }
+
+            //
+            // DMA buffers come from a pool of 4 pages
+            //
+            model.Submit(dmaBufferAddress);
+            dmaBufferAddress = (dmaBufferAddress + 1) % 4;
+        }
+
+        //
+        // Every 30 frames a screenshot goes through the staging buffer
+        //
+        if ((frame % 30) == 29) {
+            model.GpuWrite(staging);
+            model.Submit(dmaBufferAddress);
+            dmaBufferAddress = (dmaBufferAddress + 1) % 4;
+
+            model.CpuRead(staging);
+        }
+    }
+
+    LogComment(
+        L"%u frames, %u DMA buffers, %u bytes of resources",
+        numFrames,
+        model.m_dmaBuffers,
+        model.GetResourceBytes());
+
+    LogComment(
+        L"Full clean per DMA buffer: %u full cleans, %u GPU cache flushes of %u caches",
+        model.m_dmaBuffers * FULL_CLEANS_PER_DMA_BUFFER,
+        model.m_dmaBuffers * GPU_FLUSHES_PER_DMA_BUFFER,
+        model.m_dmaBuffers * GPU_FLUSHES_PER_DMA_BUFFER * GPU_CACHES_PER_FLUSH);
+
+    LogComment(
+        L"Targeted maintenance: %u full cleans, %I64u bytes cleaned, %I64u bytes per frame, %u GPU cache flushes of %u caches, %u CPU cache invalidations",
+        model.m_fullCleans,
+        model.m_bytesCleaned,
+        model.m_bytesCleaned / numFrames,
+        model.m_gpuFlushes,
+        model.m_gpuCachesFlushed,
+        model.m_cpuInvalidations);
+
+    VERIFY_ARE_EQUAL(0u, model.m_violations);
+    VERIFY_ARE_EQUAL(0u, model.m_fullCleans);
+    VERIFY_ARE_EQUAL(numFrames / 30, model.m_cpuInvalidations);
+    VERIFY_IS_TRUE(model.m_gpuFlushes < model.m_dmaBuffers * GPU_FLUSHES_PER_DMA_BUFFER);
+    VERIFY_IS_TRUE(model.m_gpuCachesFlushed < model.m_dmaBuffers * GPU_CACHES_PER_FLUSH);
+    VERIFY_IS_TRUE(model.m_bytesCleaned / numFrames < 64 * 1024);
+}
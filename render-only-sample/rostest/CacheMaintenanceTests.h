@@ -0,0 +1,33 @@
+#ifndef _CACHE_MAINTENANCE_TESTS_H_
+#define _CACHE_MAINTENANCE_TESTS_H_
+
+//
+// Tests of the cache maintenance of DMA buffers. These run on the host
+// without a device, a model of the CPU and GPU caches checks that every
+// read by the GPU sees what the CPU wrote.
+//
+class CacheMaintenanceTests {
+    BEGIN_TEST_CLASS(CacheMaintenanceTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestDirtyRanges)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that dirty ranges are rounded to cache lines, merge when they overlap or touch and never lose a written byte when full.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestCoherence)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies with random CPU writes and GPU reads and writes that no DMA buffer reads a line still dirty in the CPU caches or a stale GPU cache.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestMaintenanceCost)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Reports the bytes cleaned and GPU cache flushes per frame of a frame workload against a full clean and flush of every cache per DMA buffer.")
+    END_TEST_METHOD()
+};
+
+#endif // _CACHE_MAINTENANCE_TESTS_H_
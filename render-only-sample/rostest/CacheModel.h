@@ -0,0 +1,64 @@
+#ifndef _CACHE_MODEL_H_
+#define _CACHE_MODEL_H_
+
+#include <vector>
+
+//
+// Fully associative cache with least recently used replacement
+//
+class LruCache {
+public:
+    explicit LruCache (UINT Entries) :
+        m_entries(Entries),
+        m_time(0),
+        m_misses(0)
+    {
+    }
+
+    void Access (UINT Key)
+    {
+        ++m_time;
+
+        for (Entry & entry : m_cache) {
+            if (entry.m_key == Key) {
+                entry.m_time = m_time;
+                return;
+            }
+        }
+
+        ++m_misses;
+
+        Entry entry = { Key, m_time };
+        if (m_cache.size() < m_entries) {
+            m_cache.push_back(entry);
+            return;
+        }
+
+        Entry * pLeastRecent = &m_cache[0];
+        for (Entry & cached : m_cache) {
+            if (cached.m_time < pLeastRecent->m_time) {
+                pLeastRecent = &cached;
+            }
+        }
+
+        *pLeastRecent = entry;
+    }
+
+    UINT Misses () const
+    {
+        return m_misses;
+    }
+
+private:
+    struct Entry {
+        UINT m_key;
+        UINT m_time;
+    };
+
+    const UINT m_entries;
+    UINT m_time;
+    UINT m_misses;
+    std::vector<Entry> m_cache;
+};
+
+#endif // _CACHE_MODEL_H_
@@ -0,0 +1,226 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "ConstantRingTests.h"
+
+#include "RosUmdConstantRing.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Ring whose chunks are system memory, recycling a chunk counts as a
+// discard of its allocation
+//
+class HostConstantRing : public RosUmdConstantRing {
+public:
+    HostConstantRing () :
+        m_discards(0)
+    {}
+
+    ~HostConstantRing ()
+    {
+        Teardown();
+    }
+
+    UINT m_discards;
+
+protected:
+
+    virtual void MapChunk (RosUmdConstantRingChunk* pChunk, bool bRecycle)
+    {
+        if (bRecycle) {
+            ++m_discards;
+            return;
+        }
+
+        pChunk->m_pData = new BYTE[kChunkSize];
+    }
+
+    virtual void UnmapChunk (RosUmdConstantRingChunk* pChunk)
+    {
+        delete[] pChunk->m_pData;
+    }
+};
+
+struct SLICE_RECORD {
+    RosUmdConstantSlice Slice;
+    ULONGLONG LastReadFence;    // Last command buffer that may read the slice
+};
+
+static bool Overlaps (const RosUmdConstantSlice& A, const RosUmdConstantSlice& B)
+{
+    return (A.m_chunk == B.m_chunk) &&
+           (A.m_offset < B.m_offset + B.m_size) &&
+           (B.m_offset < A.m_offset + A.m_size);
+}
+
+void ConstantRingTests::TestSliceLifetime ()
+{
+    HostConstantRing ring;
+
+    const UINT numBuffers = 40;
+    const UINT numUpdates = 20000;
+
+    std::vector<SLICE_RECORD> live(numBuffers);
+    std::vector<SLICE_RECORD> dead;
+
+    ULONGLONG fence = 1;
+
+    for (UINT i = 0; i < numBuffers; ++i) {
+        VERIFY_IS_TRUE(ring.Allocate(256 + (i % 4) * 1024, fence, &live[i].Slice));
+        live[i].LastReadFence = fence;
+    }
+
+    UINT seed = 1;
+    for (UINT update = 0; update < numUpdates; ++update) {
+        seed = seed * 1103515245 + 12345;
+        const UINT buffer = (seed >> 16) % numBuffers;
+
+        // Draw with the buffer's current slice, then discard it
+        live[buffer].LastReadFence = fence;
+
+        RosUmdConstantSlice slice;
+        if (!ring.Allocate(live[buffer].Slice.m_size, fence, &slice)) {
+            ++fence;
+            VERIFY_IS_TRUE(ring.Allocate(live[buffer].Slice.m_size, fence, &slice));
+        }
+
+        for (const SLICE_RECORD& record : live) {
+            VERIFY_IS_FALSE(Overlaps(slice, record.Slice), L"Live slice handed out");
+        }
+
+        for (const SLICE_RECORD& record : dead) {
+            if (record.LastReadFence == fence) {
+                VERIFY_IS_FALSE(
+                    Overlaps(slice, record.Slice),
+                    L"Slice read by the current command buffer handed out");
+            }
+        }
+
+        ring.Release(live[buffer].Slice, fence);
+        dead.push_back(live[buffer]);
+        live[buffer].Slice = slice;
+        live[buffer].LastReadFence = fence;
+
+        // Submit every 50 updates
+        if ((update % 50) == 49) {
+            ++fence;
+            dead.clear();
+        }
+    }
+
+    LogComment(
+        L"%u updates of %u buffers: %u chunks, %u recycled",
+        numUpdates,
+        numBuffers,
+        ring.GetChunkCount(),
+        ring.GetRecycleCount());
+
+    VERIFY_ARE_EQUAL(ring.GetRecycleCount(), ring.m_discards);
+    VERIFY_IS_TRUE(ring.GetRecycleCount() > 0, L"Chunks are recycled once submitted");
+    VERIFY_IS_TRUE(ring.GetChunkCount() < RosUmdConstantRing::kMaxChunks);
+}
+
+//
+// Synthetic frame: a per frame buffer updated once, a per object buffer
+// mapped with DISCARD before every draw, and a material buffer partially
+// updated every few draws. The vertex and coordinate shaders gather their
+// uniforms (they mix constants with the viewport scale), the pixel shader
+// reads a run of the material buffer which the ring lets it read in place.
+//
+void ConstantRingTests::TestConstantUpdateBandwidth ()
+{
+    const UINT numFrames = 10;
+    const UINT drawsPerFrame = 500;
+    const UINT drawsPerSubmit = 100;
+    const UINT materialUpdateInterval = 8;
+
+    const UINT frameBufferSize = 256;
+    const UINT objectBufferSize = 64;
+    const UINT materialBufferSize = 64;
+    const UINT materialUpdateSize = 16;
+
+    const UINT vsUniformBytes = (16 + 2) * sizeof(FLOAT);  // World matrix and viewport scale
+    const UINT csUniformBytes = (16 + 2) * sizeof(FLOAT);
+    const UINT psUniformBytes = 4 * sizeof(FLOAT);          // Material colour
+
+    HostConstantRing ring;
+    ULONGLONG fence = 1;
+
+    RosUmdConstantSlice frameSlice;
+    RosUmdConstantSlice objectSlice;
+    RosUmdConstantSlice materialSlice;
+    VERIFY_IS_TRUE(ring.Allocate(frameBufferSize, fence, &frameSlice));
+    VERIFY_IS_TRUE(ring.Allocate(objectBufferSize, fence, &objectSlice));
+    VERIFY_IS_TRUE(ring.Allocate(materialBufferSize, fence, &materialSlice));
+
+    auto rename = [&](RosUmdConstantSlice* pSlice, bool bPreserve) -> UINT64 {
+        RosUmdConstantSlice slice;
+        if (!ring.Allocate(pSlice->m_size, fence, &slice)) {
+            ++fence;
+            VERIFY_IS_TRUE(ring.Allocate(pSlice->m_size, fence, &slice));
+        }
+
+        UINT64 copied = 0;
+        if (bPreserve) {
+            memcpy(slice.m_pData, pSlice->m_pData, pSlice->m_size);
+            copied = pSlice->m_size;
+        }
+
+        ring.Release(*pSlice, fence);
+        *pSlice = slice;
+
+        return copied;
+    };
+
+    UINT64 copyBytes = 0;       // Constant buffers copied into the command buffer at each draw
+    UINT64 ringBytes = 0;       // Driver copies with the ring
+    UINT draws = 0;
+
+    for (UINT frame = 0; frame < numFrames; ++frame) {
+        // Whole buffer writes, no copies either way
+        rename(&frameSlice, false);
+
+        for (UINT draw = 0; draw < drawsPerFrame; ++draw, ++draws) {
+            rename(&objectSlice, false);
+            memset(objectSlice.m_pData, draw & 0xFF, objectBufferSize);
+
+            if ((draw % materialUpdateInterval) == 0) {
+                // Partial UpdateSubresource, system memory copy is updated
+                // in place, the ring preserves the rest of the slice
+                copyBytes += materialUpdateSize;
+
+                ringBytes += rename(&materialSlice, true);
+                ringBytes += materialUpdateSize;
+            }
+
+            copyBytes += vsUniformBytes + csUniformBytes + psUniformBytes;
+            ringBytes += vsUniformBytes + csUniformBytes;
+
+            if ((draws % drawsPerSubmit) == (drawsPerSubmit - 1)) {
+                ++fence;
+            }
+        }
+    }
+
+    ring.Release(frameSlice, fence);
+    ring.Release(objectSlice, fence);
+    ring.Release(materialSlice, fence);
+
+    const double copyPerDraw = double(copyBytes) / draws;
+    const double ringPerDraw = double(ringBytes) / draws;
+
+    LogComment(
+        L"%u draws: copied into command buffer %.1f bytes/draw, ring %.1f bytes/draw, %u chunks, %u recycled, %I64u bytes of slices",
+        draws,
+        copyPerDraw,
+        ringPerDraw,
+        ring.GetChunkCount(),
+        ring.GetRecycleCount(),
+        ring.GetBytesAllocated());
+
+    VERIFY_IS_TRUE(ringBytes < copyBytes);
+    VERIFY_IS_TRUE(ring.GetChunkCount() <= 2, L"Submitted slices are recycled");
+}
@@ -0,0 +1,26 @@
+#ifndef _CONSTANT_RING_TESTS_H_
+#define _CONSTANT_RING_TESTS_H_
+
+//
+// Tests of the UMD constant buffer ring. These run on the host without a
+// device, chunks are backed by system memory.
+//
+class ConstantRingTests {
+    BEGIN_TEST_CLASS(ConstantRingTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestSliceLifetime)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a slice is never handed out while it is live or readable by the command buffer being built.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestConstantUpdateBandwidth)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Measures the constant bytes copied by the driver per draw across a synthetic frame with many small constant updates.")
+    END_TEST_METHOD()
+};
+
+#endif // _CONSTANT_RING_TESTS_H_
@@ -0,0 +1,248 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "EarlyZTests.h"
+
+#include "RosEarlyZ.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+const UINT TARGET_WIDTH = 64;
+const UINT TARGET_HEIGHT = 64;
+
+// Depths in units of the depth buffer, cleared to the far plane
+const UINT CLEAR_DEPTH = 1000;
+const UINT CLEAR_COLOR = 0xFF000000;
+
+enum Shader {
+    SHADER_OPAQUE,
+    SHADER_DISCARD,             // Discards a checkerboard of 2x2 pixels
+    SHADER_DEPTH_OUTPUT,        // Writes a depth ramp in x to oDepth
+};
+
+struct Draw {
+    UINT m_left;
+    UINT m_top;
+    UINT m_right;
+    UINT m_bottom;
+    UINT m_depth;
+    RosDepthFunc m_depthFunc;
+    bool m_bDepthWrite;
+    Shader m_shader;
+    UINT m_color;
+};
+
+//
+// Mostly front to back like a sorted frame: occluders, alpha tested
+// foliage, a decal without depth writes, a shader writing oDepth, foliage
+// tested with not equal, then the background and foliage behind all of it
+//
+static const Draw s_scene[] = {
+    {  0,  0, 40, 40, 300, ROS_DEPTH_FUNC_LESS,       true,  SHADER_OPAQUE,       0xFFFF0000 },
+    { 16, 16, 64, 64, 500, ROS_DEPTH_FUNC_LESS,       true,  SHADER_DISCARD,      0xFF00FF00 },
+    {  8,  8, 56, 56, 600, ROS_DEPTH_FUNC_LESS,       true,  SHADER_OPAQUE,       0xFF0000FF },
+    {  0,  0, 64, 64, 400, ROS_DEPTH_FUNC_LESS_EQUAL, false, SHADER_DISCARD,      0xFFFFFF00 },
+    { 24,  0, 48, 64, 350, ROS_DEPTH_FUNC_LESS,       true,  SHADER_DEPTH_OUTPUT, 0xFF00FFFF },
+    {  0, 32, 32, 64, 700, ROS_DEPTH_FUNC_NOT_EQUAL,  true,  SHADER_DISCARD,      0xFFFF00FF },
+    {  0,  0, 64, 64, 900, ROS_DEPTH_FUNC_LESS,       true,  SHADER_OPAQUE,       0xFF808080 },
+    {  0,  0, 64, 64, 800, ROS_DEPTH_FUNC_LESS,       true,  SHADER_DISCARD,      0xFF008000 },
+};
+
+enum Policy {
+    POLICY_LATE,                // Every draw tests late, the reference
+    POLICY_LATE_UNSAFE,         // Early-Z off for discard and depth output
+    POLICY_SHADER_AWARE,        // RosEarlyZ
+    POLICY_ALWAYS_EARLY,        // Early-Z regardless of the shader
+    POLICY_COUNT,
+};
+
+static const wchar_t * const s_policyNames[POLICY_COUNT] = {
+    L"Late Z",
+    L"Early-Z off for discard and depth output",
+    L"Shader aware early-Z",
+    L"Early-Z always on",
+};
+
+struct Target {
+    std::vector<UINT> m_color;
+    std::vector<UINT> m_depth;
+    UINT m_invocations;
+    UINT m_earlyRejects;
+};
+
+static bool DepthTest (
+    RosDepthFunc Func,
+    UINT Depth,
+    UINT Buffer)
+{
+    switch (Func) {
+    case ROS_DEPTH_FUNC_NEVER: return false;
+    case ROS_DEPTH_FUNC_LESS: return Depth < Buffer;
+    case ROS_DEPTH_FUNC_EQUAL: return Depth == Buffer;
+    case ROS_DEPTH_FUNC_LESS_EQUAL: return Depth <= Buffer;
+    case ROS_DEPTH_FUNC_GREATER: return Depth > Buffer;
+    case ROS_DEPTH_FUNC_NOT_EQUAL: return Depth != Buffer;
+    case ROS_DEPTH_FUNC_GREATER_EQUAL: return Depth >= Buffer;
+    default: return true;
+    }
+}
+
+static RosZMode GetPolicyZMode (
+    Policy Pol,
+    const Draw & D)
+{
+    bool bDiscard = (D.m_shader == SHADER_DISCARD);
+    bool bDepthOutput = (D.m_shader == SHADER_DEPTH_OUTPUT);
+
+    switch (Pol) {
+    case POLICY_LATE:
+        return ROS_Z_MODE_LATE;
+    case POLICY_LATE_UNSAFE:
+        return (bDiscard || bDepthOutput) ? ROS_Z_MODE_LATE : ROS_Z_MODE_EARLY;
+    case POLICY_SHADER_AWARE:
+        return RosEarlyZ::GetZMode(D.m_depthFunc, D.m_bDepthWrite, bDiscard, bDepthOutput);
+    default:
+        return ROS_Z_MODE_EARLY;
+    }
+}
+
+//
+// Rasterizes the rectangles of the scene one pixel at a time in draw
+// order, early-Z tests with the depth interpolated at the pixel before the
+// shader runs, the late test with the depth the shader output after
+//
+static void DrawScene (
+    Policy Pol,
+    Target * T)
+{
+    T->m_color.assign(TARGET_WIDTH * TARGET_HEIGHT, CLEAR_COLOR);
+    T->m_depth.assign(TARGET_WIDTH * TARGET_HEIGHT, CLEAR_DEPTH);
+    T->m_invocations = 0;
+    T->m_earlyRejects = 0;
+
+    for (UINT i = 0; i < ARRAYSIZE(s_scene); ++i) {
+        const Draw & d = s_scene[i];
+        RosZMode zMode = GetPolicyZMode(Pol, d);
+
+        for (UINT y = d.m_top; y < d.m_bottom; ++y) {
+            for (UINT x = d.m_left; x < d.m_right; ++x) {
+                UINT & buffer = T->m_depth[y * TARGET_WIDTH + x];
+                UINT depth = d.m_depth;
+
+                if (zMode != ROS_Z_MODE_LATE) {
+                    if (!DepthTest(d.m_depthFunc, depth, buffer)) {
+                        ++T->m_earlyRejects;
+                        continue;
+                    }
+
+                    if ((zMode == ROS_Z_MODE_EARLY) && d.m_bDepthWrite) {
+                        buffer = depth;
+                    }
+                }
+
+                ++T->m_invocations;
+
+                if ((d.m_shader == SHADER_DISCARD) && (((x / 2) + (y / 2)) & 1)) {
+                    continue;
+                }
+
+                if (d.m_shader == SHADER_DEPTH_OUTPUT) {
+                    depth = d.m_depth + (x & 7) * 20;
+                }
+
+                if (zMode != ROS_Z_MODE_EARLY) {
+                    if (!DepthTest(d.m_depthFunc, depth, buffer)) {
+                        continue;
+                    }
+
+                    if (d.m_bDepthWrite) {
+                        buffer = depth;
+                    }
+                }
+
+                T->m_color[y * TARGET_WIDTH + x] = d.m_color;
+            }
+        }
+    }
+}
+
+void EarlyZTests::TestZModes ()
+{
+    static const RosDepthFunc funcs[] = {
+        ROS_DEPTH_FUNC_NEVER,
+        ROS_DEPTH_FUNC_LESS,
+        ROS_DEPTH_FUNC_EQUAL,
+        ROS_DEPTH_FUNC_LESS_EQUAL,
+        ROS_DEPTH_FUNC_GREATER,
+        ROS_DEPTH_FUNC_NOT_EQUAL,
+        ROS_DEPTH_FUNC_GREATER_EQUAL,
+        ROS_DEPTH_FUNC_ALWAYS,
+    };
+
+    for (UINT i = 0; i < ARRAYSIZE(funcs); ++i) {
+        for (UINT write = 0; write < 2; ++write) {
+            bool bDepthWrite = (write != 0);
+
+            VERIFY_ARE_EQUAL(
+                RosEarlyZ::GetZMode(funcs[i], bDepthWrite, false, false),
+                ROS_Z_MODE_EARLY);
+            VERIFY_ARE_EQUAL(
+                RosEarlyZ::GetZMode(funcs[i], bDepthWrite, false, true),
+                ROS_Z_MODE_LATE);
+            VERIFY_ARE_EQUAL(
+                RosEarlyZ::GetZMode(funcs[i], bDepthWrite, true, true),
+                ROS_Z_MODE_LATE);
+
+            RosZMode expected;
+            if (!bDepthWrite) {
+                expected = ROS_Z_MODE_EARLY;
+            } else if ((funcs[i] == ROS_DEPTH_FUNC_NOT_EQUAL) ||
+                       (funcs[i] == ROS_DEPTH_FUNC_ALWAYS)) {
+                expected = ROS_Z_MODE_LATE;
+            } else {
+                expected = ROS_Z_MODE_EARLY_TEST;
+            }
+
+            VERIFY_ARE_EQUAL(
+                RosEarlyZ::GetZMode(funcs[i], bDepthWrite, true, false),
+                expected);
+        }
+    }
+}
+
+void EarlyZTests::TestOverdraw ()
+{
+    Target targets[POLICY_COUNT];
+
+    for (UINT p = 0; p < POLICY_COUNT; ++p) {
+        DrawScene(static_cast<Policy>(p), &targets[p]);
+
+        LogComment(
+            L"%s: %u fragment shader invocations, %u early-Z rejections",
+            s_policyNames[p],
+            targets[p].m_invocations,
+            targets[p].m_earlyRejects);
+    }
+
+    const Target & reference = targets[POLICY_LATE];
+    const Target & lateUnsafe = targets[POLICY_LATE_UNSAFE];
+    const Target & shaderAware = targets[POLICY_SHADER_AWARE];
+    const Target & alwaysEarly = targets[POLICY_ALWAYS_EARLY];
+
+    VERIFY_IS_TRUE(lateUnsafe.m_color == reference.m_color);
+    VERIFY_IS_TRUE(lateUnsafe.m_depth == reference.m_depth);
+    VERIFY_IS_TRUE(shaderAware.m_color == reference.m_color);
+    VERIFY_IS_TRUE(shaderAware.m_depth == reference.m_depth);
+
+    VERIFY_IS_TRUE(lateUnsafe.m_invocations < reference.m_invocations);
+    VERIFY_IS_TRUE(shaderAware.m_invocations < lateUnsafe.m_invocations);
+    VERIFY_IS_TRUE(shaderAware.m_earlyRejects > lateUnsafe.m_earlyRejects);
+
+    // Early-Z writes the depth of discarded fragments and tests the
+    // interpolated depth instead of oDepth
+    VERIFY_IS_FALSE(
+        (alwaysEarly.m_color == reference.m_color) &&
+        (alwaysEarly.m_depth == reference.m_depth));
+}
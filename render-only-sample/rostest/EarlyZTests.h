@@ -0,0 +1,26 @@
+#ifndef _EARLY_Z_TESTS_H_
+#define _EARLY_Z_TESTS_H_
+
+//
+// Tests of the Z mode of draws. These run on the host, a raster emulator
+// with early and late depth tests stands in for the V3D.
+//
+class EarlyZTests {
+    BEGIN_TEST_CLASS(EarlyZTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestZModes)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that shaders without discard or depth output always test and write early, that shaders writing depth always test late, and that discarding shaders test early unless they write depth with a function of not equal or always.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestOverdraw)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Draws an overdraw scene of opaque, discarding and depth writing shaders with early-Z off for discarding and depth writing shaders, with the Z mode of the policy and with early-Z always on, reports the fragment shader invocations and early-Z rejections of each, and verifies that the policy renders the same colors and depths as the late test with fewer invocations while early-Z always on does not.")
+    END_TEST_METHOD()
+};
+
+#endif // _EARLY_Z_TESTS_H_
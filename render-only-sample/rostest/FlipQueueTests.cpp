@@ -0,0 +1,544 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "FlipQueueTests.h"
+
+#include "RosFlipQueue.h"
+#include "RosTraceRing.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// 1080p at 60Hz (Vc4Display.cpp), the VfpStart interrupt comes 45 of the
+// 1125 lines before the frame start
+//
+const UINT REFRESH_US = 16667;
+const UINT VBLANK_US = 667;
+
+//
+// PixelValve and HVS of the display. VfpStart is raised every refresh
+// period, the interrupt routine of Vc4Display runs the flip queue. The HVS
+// latches the address of the display list at the start of the frame after
+// it. Flips are identified by increasing addresses, which are also the fence
+// of the frame in the trace of the flips.
+//
+class SimulatedPixelValve {
+public:
+    SimulatedPixelValve (RosFlipQueue & FlipQueue, UINT Address, RosTrace * pTrace = nullptr) :
+        m_flipQueue(FlipQueue),
+        m_pTrace(pTrace),
+        m_pointerWord0(Address),
+        m_scanout(Address),
+        m_reported(Address),
+        m_nextVfpStart(REFRESH_US),
+        m_numEarlyReports(0)
+    {
+        m_flipQueue.Init(Address);
+    }
+
+    // SetVidPnSourceAddress
+    void Flip (UINT Address, UINT Interval, ULONGLONG Time)
+    {
+        Trace(Time, ROS_TRACE_QUEUE_FLIP, Address);
+
+        if (m_flipQueue.Queue(Address, Interval, Address)) {
+            m_pointerWord0 = Address;
+            Trace(Time, ROS_TRACE_PROGRAM_FLIP, Address);
+        }
+    }
+
+    //
+    // Runs the display up to Time, calls OnFrame with the start time of
+    // each frame and the address the HVS latched
+    //
+    template<typename FRAME_CALLBACK>
+    void RunTo (ULONGLONG Time, FRAME_CALLBACK OnFrame)
+    {
+        while (m_nextVfpStart + VBLANK_US <= Time) {
+            const ULONGLONG frameStart = m_nextVfpStart + VBLANK_US;
+            const ULONGLONG numFlips = m_flipQueue.GetFlipCount();
+
+            //
+            // The interrupt routine runs along with the frame start, the
+            // flips queued in the vertical blanking are in time for it
+            //
+            UINT address;
+            if (m_flipQueue.OnVSync(&address)) {
+                m_pointerWord0 = address;
+                Trace(frameStart, ROS_TRACE_PROGRAM_FLIP, address);
+            }
+
+            if (m_flipQueue.GetFlipCount() != numFlips) {
+                Trace(frameStart, ROS_TRACE_SHOW_FLIP, m_flipQueue.GetScanoutFenceId());
+            }
+
+            // Reported to the OS as shown, it may reuse the primary before
+            m_reported = m_flipQueue.GetScanoutAddress();
+
+            //
+            // Frame start. A primary reported before it's latched is still
+            // scanned out after the OS reused it.
+            //
+            m_scanout = m_pointerWord0;
+
+            if (m_reported > m_scanout) {
+                ++m_numEarlyReports;
+            }
+
+            OnFrame(frameStart, m_scanout);
+
+            m_nextVfpStart += REFRESH_US;
+        }
+    }
+
+    UINT GetScanoutAddress () const
+    {
+        return m_scanout;
+    }
+
+    UINT GetEarlyReportCount () const
+    {
+        return m_numEarlyReports;
+    }
+
+private:
+    void Trace (ULONGLONG Time, RosTraceStage Stage, UINT FenceId)
+    {
+        if (m_pTrace) {
+            m_pTrace->Write(0, 0, Time, Stage, ROS_TRACE_INSTANT, FenceId, 0);
+        }
+    }
+
+    RosFlipQueue & m_flipQueue;
+    RosTrace * m_pTrace;
+    UINT m_pointerWord0;
+    UINT m_scanout;
+    UINT m_reported;
+    ULONGLONG m_nextVfpStart;
+    UINT m_numEarlyReports;
+};
+
+void FlipQueueTests::TestFlipOrder ()
+{
+    RosFlipQueue queue;
+    UINT address = 0;
+
+    queue.Init(100);
+    VERIFY_ARE_EQUAL(100u, queue.GetScanoutAddress());
+
+    //
+    // The display list holds the first flip, the others wait
+    //
+    VERIFY_IS_TRUE(queue.Queue(1, 1, 1));
+    VERIFY_IS_FALSE(queue.Queue(2, 1, 2));
+    VERIFY_IS_FALSE(queue.Queue(3, 1, 3));
+    VERIFY_IS_TRUE(queue.IsFull());
+
+    VERIFY_IS_FALSE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(1u, queue.GetScanoutAddress());
+
+    VERIFY_IS_TRUE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(2u, address);
+    VERIFY_ARE_EQUAL(2u, queue.GetScanoutAddress());
+
+    //
+    // The flip shown by the last VfpStart may not be latched yet, the next
+    // one waits for the VfpStart after it
+    //
+    VERIFY_IS_FALSE(queue.Queue(4, 1, 4));
+
+    VERIFY_IS_TRUE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(3u, address);
+    VERIFY_IS_TRUE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(4u, address);
+    VERIFY_IS_FALSE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(4u, queue.GetScanoutAddress());
+    VERIFY_ARE_EQUAL(0u, queue.GetQueuedCount());
+
+    //
+    // The display repeated a frame, the next flip is programmed right away
+    // and missed a vsync
+    //
+    VERIFY_IS_TRUE(queue.Queue(5, 1, 5));
+    VERIFY_IS_FALSE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(5u, queue.GetScanoutAddress());
+    VERIFY_ARE_EQUAL(1ull, queue.GetMissedCount());
+
+    //
+    // An immediate flip replaces the flips waiting before it
+    //
+    VERIFY_IS_FALSE(queue.OnVSync(&address));
+    VERIFY_IS_TRUE(queue.Queue(6, 1, 6));
+    VERIFY_IS_FALSE(queue.Queue(7, 1, 7));
+    VERIFY_IS_TRUE(queue.Queue(8, 0, 8));
+    VERIFY_ARE_EQUAL(1u, queue.GetQueuedCount());
+    VERIFY_IS_FALSE(queue.OnVSync(&address));
+    VERIFY_ARE_EQUAL(8u, queue.GetScanoutAddress());
+    VERIFY_ARE_EQUAL(8u, queue.GetScanoutFenceId());
+
+    VERIFY_ARE_EQUAL(8ull, queue.GetPresentCount());
+    VERIFY_ARE_EQUAL(8ull, queue.GetVSyncCount());
+    VERIFY_ARE_EQUAL(6ull, queue.GetFlipCount());
+    VERIFY_ARE_EQUAL(2ull, queue.GetDroppedCount());
+    VERIFY_ARE_EQUAL(1ull, queue.GetMissedCount());
+}
+
+void FlipQueueTests::TestFlipIntervals ()
+{
+    const UINT NUM_FLIPS = 12;
+    const UINT LATE_VSYNCS = 3;
+
+    for (UINT interval = 1; interval <= RosFlipQueue::kMaxFlipInterval; ++interval) {
+        RosFlipQueue queue;
+        SimulatedPixelValve pixelValve(queue, 0);
+        std::vector<ULONGLONG> shown;
+        UINT queued = 0;
+        ULONGLONG time = 0;
+
+        //
+        // The queue is kept filled
+        //
+        while (shown.size() < NUM_FLIPS) {
+            while ((queued < NUM_FLIPS) && !queue.IsFull()) {
+                pixelValve.Flip(++queued, interval, time);
+            }
+
+            time += REFRESH_US;
+            pixelValve.RunTo(time, [&] (ULONGLONG FrameStart, UINT Address) {
+                if (Address > shown.size()) {
+                    VERIFY_ARE_EQUAL(UINT(shown.size() + 1), Address);
+                    shown.push_back(FrameStart);
+                }
+            });
+        }
+
+        for (UINT i = 1; i < NUM_FLIPS; ++i) {
+            VERIFY_ARE_EQUAL(ULONGLONG(interval) * REFRESH_US, shown[i] - shown[i - 1]);
+        }
+
+        VERIFY_ARE_EQUAL(0ull, queue.GetMissedCount());
+        VERIFY_ARE_EQUAL(0u, pixelValve.GetEarlyReportCount());
+
+        //
+        // A flip queued late misses the vsyncs after its interval
+        //
+        for (UINT i = 0; i < interval + LATE_VSYNCS - 1; ++i) {
+            UINT address;
+            VERIFY_IS_FALSE(queue.OnVSync(&address));
+        }
+
+        UINT address;
+        VERIFY_IS_TRUE(queue.Queue(NUM_FLIPS + 1, interval, NUM_FLIPS + 1));
+        VERIFY_IS_FALSE(queue.OnVSync(&address));
+        VERIFY_ARE_EQUAL(NUM_FLIPS + 1, queue.GetScanoutAddress());
+        VERIFY_ARE_EQUAL(ULONGLONG(LATE_VSYNCS), queue.GetMissedCount());
+    }
+}
+
+//
+// Frames of the application: CPU time, then GPU time of 6 to 22ms, 14ms
+// on average
+//
+const UINT NUM_FRAMES = 600;
+const UINT CPU_US = 3000;
+const UINT MIN_GPU_US = 6000;
+const UINT GPU_RANGE_US = 16000;
+const UINT TIME_STEP_US = 50;
+
+//
+// Threads of the trace of the frames, the display writes from thread 0
+//
+const UINT APP_THREAD = 100;
+const UINT WORKER_THREAD = 300;
+const UINT TRACE_EVENTS = 1 << 14;
+
+struct PacingMode {
+    const wchar_t * m_name;
+    UINT m_maxQueued;                   // Frames presented and not retired
+    UINT m_interval;
+};
+
+struct PacingResult {
+    UINT m_shown;
+    ULONGLONG m_vsyncs;
+    ULONGLONG m_missed;
+    ULONGLONG m_dropped;
+    bool m_bInOrder;
+    UINT m_earlyReports;
+    double m_meanLatencyMs;             // Start of the frame to its scanout
+    double m_maxLatencyMs;
+    double m_stallMs;                   // CPU waiting for the queue
+    double m_elapsedMs;
+    ULONGLONG m_frameTimeUs[3];         // p50, p95, p99 from the frame records
+    ULONGLONG m_latencyUs[3];           // Submission to the vsync showing it
+};
+
+//
+// The application renders a frame on the CPU, then on the GPU, and flips
+// it when the GPU is done. It waits before a frame while MaxQueued frames
+// presented aren't retired. A flip on vsync is retired once the OS saw it
+// shown, an immediate flip when it's queued. Each frame is one DMA buffer,
+// its stages and flip are traced with a tick per microsecond, and the
+// percentiles come from the frame records of the trace.
+//
+static PacingResult RunPacing (const PacingMode & Mode)
+{
+    struct Frame {
+        ULONGLONG m_startTime;
+        ULONGLONG m_gpuDoneTime;
+        ULONGLONG m_shownTime;
+    };
+
+    std::vector<Frame> frames;
+    frames.reserve(NUM_FRAMES);
+
+    std::vector<RosTraceEvent> traceEvents(TRACE_EVENTS);
+
+    RosTrace trace;
+    trace.Init(traceEvents.data(), TRACE_EVENTS, 1);
+    trace.Enable(true);
+
+    RosFlipQueue queue;
+    SimulatedPixelValve pixelValve(queue, 0, &trace);
+
+    PacingResult result = PacingResult();
+    result.m_bInOrder = true;
+
+    UINT seed = 1;
+    auto gpuUs = [&seed] () {
+        seed = seed * 1103515245 + 12345;
+        return MIN_GPU_US + (seed >> 16) % GPU_RANGE_US;
+    };
+
+    UINT flipped = 0;
+    UINT lastScanout = 0;
+    bool bCpuBusy = false;
+    ULONGLONG cpuDoneTime = 0;
+    ULONGLONG gpuIdleTime = 0;
+    ULONGLONG stallUs = 0;
+    ULONGLONG time = 0;
+
+    while ((flipped < NUM_FRAMES) || (pixelValve.GetScanoutAddress() < NUM_FRAMES && queue.GetQueuedCount())) {
+        time += TIME_STEP_US;
+
+        pixelValve.RunTo(time, [&] (ULONGLONG FrameStart, UINT Address) {
+            if (Address < lastScanout) {
+                result.m_bInOrder = false;
+            }
+
+            if (Address > lastScanout) {
+                Frame & frame = frames[Address - 1];
+
+                frame.m_shownTime = FrameStart;
+                result.m_shown++;
+                lastScanout = Address;
+            }
+        });
+
+        //
+        // The OS flips a frame once the GPU rendered it
+        //
+        while ((flipped < frames.size()) && (frames[flipped].m_gpuDoneTime <= time)) {
+            pixelValve.Flip(++flipped, Mode.m_interval, time);
+        }
+
+        if (bCpuBusy && (cpuDoneTime <= time)) {
+            Frame & frame = frames.back();
+            const UINT fenceId = UINT(frames.size());
+            const ULONGLONG submission = fenceId;
+            const ULONGLONG gpuStartTime = max(time, gpuIdleTime);
+
+            frame.m_gpuDoneTime = gpuStartTime + gpuUs();
+            gpuIdleTime = frame.m_gpuDoneTime;
+            bCpuBusy = false;
+
+            //
+            // Submitted at the end of its CPU time, binning takes a quarter
+            // of the GPU time
+            //
+            const ULONGLONG binningEndTime = gpuStartTime + (frame.m_gpuDoneTime - gpuStartTime) / 4;
+
+            trace.Write(0, APP_THREAD, time, ROS_TRACE_RENDER, ROS_TRACE_BEGIN, 0, submission);
+            trace.Write(0, APP_THREAD, time, ROS_TRACE_RENDER, ROS_TRACE_END, 0, submission);
+            trace.Write(0, APP_THREAD, time, ROS_TRACE_QUEUE, ROS_TRACE_BEGIN, fenceId, submission);
+            trace.Write(0, APP_THREAD, time, ROS_TRACE_QUEUE, ROS_TRACE_END, fenceId, submission);
+            trace.Write(0, WORKER_THREAD, gpuStartTime, ROS_TRACE_BINNING, ROS_TRACE_BEGIN, fenceId, submission);
+            trace.Write(0, WORKER_THREAD, binningEndTime, ROS_TRACE_BINNING, ROS_TRACE_END, fenceId, submission);
+            trace.Write(0, WORKER_THREAD, binningEndTime, ROS_TRACE_RENDERING, ROS_TRACE_BEGIN, fenceId, submission);
+            trace.Write(0, WORKER_THREAD, frame.m_gpuDoneTime, ROS_TRACE_RENDERING, ROS_TRACE_END, fenceId, submission);
+        }
+
+        if (!bCpuBusy && (frames.size() < NUM_FRAMES)) {
+            const UINT retired = Mode.m_interval ? queue.GetScanoutAddress() : flipped;
+
+            if ((frames.size() - retired) < Mode.m_maxQueued) {
+                Frame frame = { time, ~0ull, 0 };
+
+                frames.push_back(frame);
+                cpuDoneTime = time + CPU_US;
+                bCpuBusy = true;
+            } else {
+                stallUs += TIME_STEP_US;
+            }
+        }
+    }
+
+    //
+    // Shown from the next frame start
+    //
+    pixelValve.RunTo(time + REFRESH_US + VBLANK_US, [&] (ULONGLONG FrameStart, UINT Address) {
+        if (Address > lastScanout) {
+            frames[Address - 1].m_shownTime = FrameStart;
+            result.m_shown++;
+            lastScanout = Address;
+        }
+    });
+
+    ULONGLONG totalLatencyUs = 0;
+    ULONGLONG maxLatencyUs = 0;
+
+    for (const Frame & frame : frames) {
+        if (frame.m_shownTime) {
+            const ULONGLONG latencyUs = frame.m_shownTime - frame.m_startTime;
+
+            totalLatencyUs += latencyUs;
+            maxLatencyUs = max(maxLatencyUs, latencyUs);
+        }
+    }
+
+    result.m_vsyncs = queue.GetVSyncCount();
+    result.m_missed = queue.GetMissedCount();
+    result.m_dropped = queue.GetDroppedCount();
+    result.m_earlyReports = pixelValve.GetEarlyReportCount();
+    result.m_meanLatencyMs = double(totalLatencyUs) / result.m_shown / 1000.0;
+    result.m_maxLatencyMs = double(maxLatencyUs) / 1000.0;
+    result.m_stallMs = double(stallUs) / 1000.0;
+    result.m_elapsedMs = double(frames.back().m_shownTime) / 1000.0;
+
+    //
+    // The frame records agree with the simulation
+    //
+    std::vector<RosTraceEvent> snapshot(trace.GetMaxEvents());
+    const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+
+    VERIFY_ARE_EQUAL(trace.GetRing(0).GetWriteCount(), numEvents);
+
+    std::vector<RosFrameRecord> records(NUM_FRAMES);
+    VERIFY_ARE_EQUAL(NUM_FRAMES, RosTrace::GetFrameRecords(snapshot.data(), numEvents, records.data(), NUM_FRAMES));
+
+    std::vector<ULONGLONG> frameTimes;
+    std::vector<ULONGLONG> latencies;
+    ULONGLONG lastVSync = 0;
+
+    for (UINT i = 0; i < NUM_FRAMES; ++i) {
+        const RosFrameRecord & record = records[i];
+
+        VERIFY_ARE_EQUAL(i + 1, record.m_fenceId);
+        VERIFY_ARE_EQUAL(1u, record.m_numDmaBuffers);
+        VERIFY_ARE_EQUAL(frames[i].m_gpuDoneTime, record.m_renderingEnd);
+        VERIFY_ARE_EQUAL(frames[i].m_shownTime, record.m_vsync);
+
+        if (record.m_vsync) {
+            if (lastVSync) {
+                frameTimes.push_back(record.m_vsync - lastVSync);
+            }
+
+            latencies.push_back(record.m_vsync - record.m_submit);
+            lastVSync = record.m_vsync;
+        }
+    }
+
+    const UINT percentiles[] = { 50, 95, 99 };
+
+    for (UINT i = 0; i < ARRAYSIZE(percentiles); ++i) {
+        result.m_frameTimeUs[i] = RosTrace::GetPercentile(frameTimes.data(), UINT(frameTimes.size()), percentiles[i]);
+        result.m_latencyUs[i] = RosTrace::GetPercentile(latencies.data(), UINT(latencies.size()), percentiles[i]);
+    }
+
+    return result;
+}
+
+void FlipQueueTests::TestPacingUnderLoad ()
+{
+    const PacingMode modes[] = {
+        { L"1 flip queued", 1, 1 },
+        { L"2 flips queued", 2, 1 },
+        { L"3 flips queued", 3, 1 },
+        { L"3 flips queued, interval 2", 3, 2 },
+        { L"immediate", 2, 0 },
+    };
+
+    PacingResult results[ARRAYSIZE(modes)];
+
+    for (UINT i = 0; i < ARRAYSIZE(modes); ++i) {
+        const PacingResult & result = results[i] = RunPacing(modes[i]);
+
+        LogComment(
+            L"%s: %u frames shown in %.0fms, %I64u vsyncs, %I64u missed, %I64u dropped, latency %.1fms mean %.1fms max, CPU stalled %.0fms",
+            modes[i].m_name,
+            result.m_shown,
+            result.m_elapsedMs,
+            result.m_vsyncs,
+            result.m_missed,
+            result.m_dropped,
+            result.m_meanLatencyMs,
+            result.m_maxLatencyMs,
+            result.m_stallMs);
+
+        LogComment(
+            L"%s: frame time p50 %.1fms p95 %.1fms p99 %.1fms, submission to vsync p50 %.1fms p95 %.1fms p99 %.1fms",
+            modes[i].m_name,
+            result.m_frameTimeUs[0] / 1000.0,
+            result.m_frameTimeUs[1] / 1000.0,
+            result.m_frameTimeUs[2] / 1000.0,
+            result.m_latencyUs[0] / 1000.0,
+            result.m_latencyUs[1] / 1000.0,
+            result.m_latencyUs[2] / 1000.0);
+
+        VERIFY_IS_TRUE(result.m_bInOrder);
+
+        //
+        // Flips on vsync are all shown, and only once the OS was told
+        //
+        if (modes[i].m_interval) {
+            VERIFY_ARE_EQUAL(NUM_FRAMES, result.m_shown);
+            VERIFY_ARE_EQUAL(0ull, result.m_dropped);
+            VERIFY_ARE_EQUAL(0u, result.m_earlyReports);
+        }
+    }
+
+    const PacingResult & oneQueued = results[0];
+    const PacingResult & twoQueued = results[1];
+    const PacingResult & threeQueued = results[2];
+    const PacingResult & interval2 = results[3];
+    const PacingResult & immediate = results[4];
+
+    //
+    // The CPU and the GPU overlap with a deeper queue, it rides out the
+    // frames over a refresh period
+    //
+    VERIFY_IS_TRUE(twoQueued.m_missed < oneQueued.m_missed);
+    VERIFY_IS_TRUE(threeQueued.m_missed <= twoQueued.m_missed);
+    VERIFY_IS_TRUE(threeQueued.m_elapsedMs < oneQueued.m_elapsedMs);
+    VERIFY_IS_TRUE(threeQueued.m_stallMs < oneQueued.m_stallMs);
+
+    //
+    // The deeper queue shows frames every vsync at the cost of latency
+    //
+    VERIFY_ARE_EQUAL(ULONGLONG(REFRESH_US), threeQueued.m_frameTimeUs[0]);
+    VERIFY_IS_TRUE(threeQueued.m_frameTimeUs[2] < oneQueued.m_frameTimeUs[2]);
+    VERIFY_IS_TRUE(threeQueued.m_latencyUs[0] > oneQueued.m_latencyUs[0]);
+
+    //
+    // Interval 2 frames are shown every other vsync
+    //
+    VERIFY_IS_TRUE(interval2.m_vsyncs >= 2ull * (NUM_FRAMES - 1));
+    VERIFY_ARE_EQUAL(2ull * REFRESH_US, interval2.m_frameTimeUs[0]);
+
+    //
+    // Immediate flips don't wait for the frames before them
+    //
+    VERIFY_IS_TRUE(immediate.m_meanLatencyMs < threeQueued.m_meanLatencyMs);
+}
@@ -0,0 +1,33 @@
+#ifndef _FLIP_QUEUE_TESTS_H_
+#define _FLIP_QUEUE_TESTS_H_
+
+//
+// Tests of the queue of flips of the primary. These run on the host, a
+// simulated PixelValve raises the VfpStart interrupt on a simulated clock
+// and latches the display list at the start of each frame.
+//
+class FlipQueueTests {
+    BEGIN_TEST_CLASS(FlipQueueTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestFlipOrder)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that queued flips are shown in order one per vsync, that only the flip in the display list is programmed, and that an immediate flip replaces the flips waiting before it.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestFlipIntervals)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that flips of intervals 1 to 4 are shown that many vsyncs after the flip before them, and that flips shown later count the vsyncs they missed.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestPacingUnderLoad)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Renders frames of varying GPU time at 60Hz through flip queues of 1 to 3 flips, with flip intervals 1 and 2 and immediate flips, reports the frames shown, missed vsyncs, latency and CPU stalls, and the p50, p95 and p99 frame time and latency of the frame records of the trace, and verifies the frame order, the records against the simulation and that a deeper queue misses fewer vsyncs.")
+    END_TEST_METHOD()
+};
+
+#endif // _FLIP_QUEUE_TESTS_H_
@@ -0,0 +1,818 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "HwQueueTests.h"
+
+#include "RosHwQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// V3D_REG_INTCTL bits of the binning flush and frame done interrupts
+//
+const UINT INT_FRDONE = 0x1;
+const UINT INT_FLDONE = 0x2;
+
+//
+// The KMD checks for a hang every kGpuBusyCheckIntervalMs and resets after
+// kHangTimeoutMs, scaled down for the simulated V3D (microseconds)
+//
+const UINT CHECK_INTERVAL_US = 2000;
+const UINT HANG_TIMEOUT_US = 20000;
+
+//
+// Sleep of the worker thread between checks of the control list threads
+// when it polls (milliseconds)
+//
+const UINT POLL_INTERVAL_MS = 1;
+
+// Time of the queue, microseconds
+static ULONGLONG NowUs ()
+{
+    return ULONGLONG(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static void SpinUs (UINT Us)
+{
+    const ULONGLONG end = NowUs() + Us;
+    while (NowUs() < end) {}
+}
+
+// CPU time of the calling thread, milliseconds
+static double ThreadCpuMs ()
+{
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+
+    GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+
+    ULARGE_INTEGER kernel;
+    ULARGE_INTEGER user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+
+    return double(kernel.QuadPart + user.QuadPart) / 10000.0;
+}
+
+//
+// V3D that runs one DMA buffer at a time on its own thread. The control
+// list addresses advance while binning and rendering run, the interrupt
+// routine is called with the V3D_REG_INTCTL bits when binning is flushed
+// and at the end of frame. A hung DMA buffer stops advancing in binning
+// until Reset().
+//
+class SimulatedV3d {
+public:
+    typedef void (*INTERRUPT_ROUTINE) (void * Context, UINT Interrupts);
+
+    SimulatedV3d (INTERRUPT_ROUTINE InterruptRoutine, void * Context) :
+        m_interruptRoutine(InterruptRoutine),
+        m_context(Context),
+        m_exit(false),
+        m_kicked(false),
+        m_abort(false),
+        m_running(false),
+        m_binningAddress(0),
+        m_renderingAddress(0),
+        m_frameDoneTime(0),
+        m_binningUs(0),
+        m_renderingUs(0),
+        m_hang(false)
+    {
+        m_thread = std::thread([this] { Run(); });
+    }
+
+    ~SimulatedV3d ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_exit = true;
+            m_abort = true;
+        }
+        m_kick.notify_one();
+        m_thread.join();
+    }
+
+    // Starts the control lists, nothing may run
+    void Kick (UINT BinningUs, UINT RenderingUs, bool Hang)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_binningUs = BinningUs;
+            m_renderingUs = RenderingUs;
+            m_hang = Hang;
+            m_running = true;
+            m_binningAddress = 0x10000000;
+            m_renderingAddress = 0x20000000;
+            m_kicked = true;
+        }
+
+        m_kick.notify_one();
+    }
+
+    // CT1CS.CTRUN, rendering waits for binning
+    bool IsRunning () const
+    {
+        return m_running;
+    }
+
+    UINT GetBinningAddress () const
+    {
+        return m_binningAddress;
+    }
+
+    UINT GetRenderingAddress () const
+    {
+        return m_renderingAddress;
+    }
+
+    ULONGLONG GetFrameDoneTime () const
+    {
+        return m_frameDoneTime;
+    }
+
+    // Power cycle, the running DMA buffer is dropped without interrupt
+    void Reset ()
+    {
+        m_abort = true;
+        while (m_running || m_kicked) {
+            std::this_thread::yield();
+        }
+        m_abort = false;
+    }
+
+private:
+    void Run ()
+    {
+        for (;;) {
+            UINT binningUs;
+            UINT renderingUs;
+            bool hang;
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_kick.wait(lock, [this] { return m_kicked || m_exit; });
+                if (m_exit) {
+                    return;
+                }
+                binningUs = m_binningUs;
+                renderingUs = m_renderingUs;
+                hang = m_hang;
+            }
+
+            bool done = Execute(&m_binningAddress, binningUs, hang);
+
+            if (done) {
+                m_interruptRoutine(m_context, INT_FLDONE);
+
+                done = Execute(&m_renderingAddress, renderingUs, false);
+            }
+
+            if (done) {
+                m_frameDoneTime = NowUs();
+                m_running = false;
+                m_kicked = false;
+
+                m_interruptRoutine(m_context, INT_FRDONE);
+            } else {
+                m_running = false;
+                m_kicked = false;
+            }
+        }
+    }
+
+    //
+    // Advances the control list address for Us, returns false when it was
+    // aborted. A hung control list stops half way.
+    //
+    bool Execute (std::atomic<UINT> * pAddress, UINT Us, bool Hang)
+    {
+        const UINT startAddress = *pAddress;
+        const ULONGLONG start = NowUs();
+
+        for (;;) {
+            if (m_abort) {
+                return false;
+            }
+
+            const ULONGLONG elapsed = NowUs() - start;
+
+            if (elapsed >= Us) {
+                if (!Hang) {
+                    return true;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (!Hang || (elapsed < Us / 2)) {
+                *pAddress = startAddress + UINT(elapsed);
+            }
+        }
+    }
+
+    INTERRUPT_ROUTINE m_interruptRoutine;
+    void * m_context;
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_kick;
+    bool m_exit;
+
+    std::atomic<bool> m_kicked;
+    std::atomic<bool> m_abort;
+    std::atomic<bool> m_running;
+    std::atomic<UINT> m_binningAddress;
+    std::atomic<UINT> m_renderingAddress;
+    std::atomic<ULONGLONG> m_frameDoneTime;
+
+    UINT m_binningUs;
+    UINT m_renderingUs;
+    bool m_hang;
+};
+
+enum COMPLETION_MODE {
+    COMPLETION_POLLED,                  // Sleeps between checks of CTRUN
+    COMPLETION_BUSY_POLLED,             // Spins on CTRUN
+    COMPLETION_INTERRUPT,               // Frame done interrupt and DPC
+};
+
+struct RIG_RESULT {
+    UINT Completed;
+    UINT Faulted;
+    bool InOrder;
+    double ElapsedMs;
+    double MeanLatencyUs;               // Frame done to fence reported
+    double MaxLatencyUs;
+    double WorkerCpuMs;
+    std::vector<bool> FaultedFences;
+};
+
+//
+// Worker thread, DPC and V3D of RosKmdRapAdapter. The worker prepares each
+// DMA buffer, queues it and, without the interrupt, polls until it is
+// done. With the interrupt the DPC completes the running DMA buffer and
+// starts the next one while the worker prepares ahead.
+//
+class HwQueueRig {
+public:
+    HwQueueRig (COMPLETION_MODE Mode, UINT PreparationUs, UINT BinningUs, UINT RenderingUs) :
+        m_mode(Mode),
+        m_preparationUs(PreparationUs),
+        m_binningUs(BinningUs),
+        m_renderingUs(RenderingUs),
+        m_completionEvent(false),
+        m_pendingInterrupts(0),
+        m_dpcExit(false),
+        m_v3d(InterruptRoutine, this)
+    {
+        for (UINT i = 0; i < RosHwQueue::kMaxSlots; ++i) {
+            m_fenceIds[i] = 0;
+            m_hung[i] = false;
+        }
+
+        m_dpcThread = std::thread([this] { DpcRoutine(); });
+    }
+
+    ~HwQueueRig ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_dpcLock);
+            m_dpcExit = true;
+        }
+        m_dpc.notify_one();
+        m_dpcThread.join();
+    }
+
+    //
+    // Runs NumDmaBuffers with fences 1 to NumDmaBuffers on the worker
+    // thread, the DMA buffer HungDmaBuffer hangs the V3D
+    //
+    RIG_RESULT Run (UINT NumDmaBuffers, UINT HungDmaBuffer)
+    {
+        m_completedFences.clear();
+        m_faultedFences.assign(NumDmaBuffers + 1, false);
+        m_totalLatencyUs = 0;
+        m_maxLatencyUs = 0;
+
+        const double startCpuMs = ThreadCpuMs();
+        const ULONGLONG start = NowUs();
+
+        for (UINT i = 0; i < NumDmaBuffers; ++i) {
+            const UINT slot = Reserve();
+
+            // Aperture copies, rendering control list and cache maintenance
+            SpinUs(m_preparationUs);
+
+            m_fenceIds[slot] = i + 1;
+            m_hung[slot] = (i == HungDmaBuffer);
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_queue.Queue(slot, i + 1, NowUs())) {
+                    Start(slot);
+                }
+            }
+
+            if (m_mode != COMPLETION_INTERRUPT) {
+                WaitForIdle();
+            }
+        }
+
+        WaitForIdle();
+
+        RIG_RESULT result;
+        result.ElapsedMs = double(NowUs() - start) / 1000.0;
+        result.WorkerCpuMs = ThreadCpuMs() - startCpuMs;
+        result.Completed = UINT(m_completedFences.size());
+        result.Faulted = m_queue.GetFaultedCount();
+
+        result.InOrder = true;
+        for (UINT i = 0; i < m_completedFences.size(); ++i) {
+            result.InOrder &= (m_completedFences[i] == i + 1);
+        }
+
+        const UINT numCompleted = result.Completed - result.Faulted;
+        result.MeanLatencyUs = numCompleted ? m_totalLatencyUs / numCompleted : 0;
+        result.MaxLatencyUs = m_maxLatencyUs;
+        result.FaultedFences = m_faultedFences;
+
+        return result;
+    }
+
+private:
+    static void InterruptRoutine (void * Context, UINT Interrupts)
+    {
+        HwQueueRig * pRig = static_cast<HwQueueRig *>(Context);
+
+        if (pRig->m_mode != COMPLETION_INTERRUPT) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pRig->m_dpcLock);
+            pRig->m_pendingInterrupts |= Interrupts;
+        }
+        pRig->m_dpc.notify_one();
+    }
+
+    void DpcRoutine ()
+    {
+        for (;;) {
+            UINT interrupts;
+
+            {
+                std::unique_lock<std::mutex> lock(m_dpcLock);
+                m_dpc.wait(lock, [this] { return m_pendingInterrupts || m_dpcExit; });
+                if (m_dpcExit) {
+                    return;
+                }
+                interrupts = m_pendingInterrupts;
+                m_pendingInterrupts = 0;
+            }
+
+            Complete(interrupts);
+        }
+    }
+
+    // Called with m_lock held
+    void Start (UINT Slot)
+    {
+        m_v3d.Kick(m_binningUs, m_renderingUs, m_hung[Slot]);
+    }
+
+    // Called with m_lock held
+    void Notify (UINT Slot, bool Faulted)
+    {
+        m_completedFences.push_back(m_fenceIds[Slot]);
+
+        if (Faulted) {
+            m_faultedFences[m_fenceIds[Slot]] = true;
+            return;
+        }
+
+        const double latencyUs = double(NowUs() - m_v3d.GetFrameDoneTime());
+
+        m_totalLatencyUs += latencyUs;
+        m_maxLatencyUs = std::max(m_maxLatencyUs, latencyUs);
+    }
+
+    void Complete (UINT Interrupts)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            const ULONGLONG now = NowUs();
+
+            if (Interrupts & INT_FLDONE) {
+                m_queue.OnBinningDone(now);
+            }
+
+            UINT completedSlot;
+            UINT nextSlot;
+
+            if ((Interrupts & INT_FRDONE) && m_queue.OnRenderingDone(now, &completedSlot, &nextSlot)) {
+                if (nextSlot != RosHwQueue::kNoSlot) {
+                    Start(nextSlot);
+                }
+
+                Notify(completedSlot, false);
+            }
+
+            m_completionEvent = true;
+        }
+        m_completion.notify_one();
+    }
+
+    void CheckHang ()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        const ULONGLONG now = NowUs();
+
+        if (!m_queue.IsHung(now, m_v3d.GetBinningAddress(), m_v3d.GetRenderingAddress(), HANG_TIMEOUT_US)) {
+            return;
+        }
+
+        UINT faultedSlots[RosHwQueue::kMaxSlots];
+        const UINT numFaulted = m_queue.Reset(now, faultedSlots);
+
+        m_v3d.Reset();
+
+        {
+            std::lock_guard<std::mutex> dpcLock(m_dpcLock);
+            m_pendingInterrupts = 0;
+        }
+
+        for (UINT i = 0; i < numFaulted; ++i) {
+            Notify(faultedSlots[i], true);
+        }
+    }
+
+    void WaitForHwDmaBuffer ()
+    {
+        switch (m_mode) {
+        case COMPLETION_INTERRUPT:
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_completion.wait_for(
+                lock,
+                std::chrono::microseconds(CHECK_INTERVAL_US),
+                [this] { return m_completionEvent; });
+            m_completionEvent = false;
+        }
+        break;
+
+        case COMPLETION_POLLED:
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+            __fallthrough;
+
+        case COMPLETION_BUSY_POLLED:
+            if ((m_queue.GetRunningSlot() != RosHwQueue::kNoSlot) && !m_v3d.IsRunning()) {
+                Complete(INT_FLDONE | INT_FRDONE);
+            }
+            break;
+        }
+
+        CheckHang();
+    }
+
+    void Retire ()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        UINT slot;
+        while (m_queue.Retire(&slot)) {
+            m_fenceIds[slot] = 0;
+        }
+    }
+
+    UINT Reserve ()
+    {
+        for (;;) {
+            Retire();
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                UINT slot;
+                if (m_queue.Reserve(&slot)) {
+                    return slot;
+                }
+            }
+
+            WaitForHwDmaBuffer();
+        }
+    }
+
+    void WaitForIdle ()
+    {
+        for (;;) {
+            Retire();
+
+            if (m_queue.IsIdle()) {
+                return;
+            }
+
+            WaitForHwDmaBuffer();
+        }
+    }
+
+    const COMPLETION_MODE m_mode;
+    const UINT m_preparationUs;
+    const UINT m_binningUs;
+    const UINT m_renderingUs;
+
+    RosHwQueue m_queue;
+    std::mutex m_lock;
+    UINT m_fenceIds[RosHwQueue::kMaxSlots];
+    bool m_hung[RosHwQueue::kMaxSlots];
+
+    std::condition_variable m_completion;
+    bool m_completionEvent;
+
+    std::thread m_dpcThread;
+    std::mutex m_dpcLock;
+    std::condition_variable m_dpc;
+    UINT m_pendingInterrupts;
+    bool m_dpcExit;
+
+    std::vector<UINT> m_completedFences;
+    std::vector<bool> m_faultedFences;
+    double m_totalLatencyUs;
+    double m_maxLatencyUs;
+
+    // Destroyed first, its thread calls InterruptRoutine
+    SimulatedV3d m_v3d;
+};
+
+void HwQueueTests::TestQueueOrder ()
+{
+    const UINT noSlot = RosHwQueue::kNoSlot;
+
+    RosHwQueue queue;
+
+    VERIFY_IS_TRUE(queue.IsIdle());
+    VERIFY_ARE_EQUAL(noSlot, queue.GetRunningSlot());
+
+    //
+    // Every slot can be prepared at once, in order
+    //
+    UINT slots[RosHwQueue::kMaxSlots];
+    for (UINT i = 0; i < RosHwQueue::kMaxSlots; ++i) {
+        VERIFY_IS_TRUE(queue.Reserve(&slots[i]));
+        VERIFY_ARE_EQUAL(i, slots[i]);
+    }
+
+    UINT slot;
+    VERIFY_IS_TRUE(queue.IsFull());
+    VERIFY_IS_FALSE(queue.Reserve(&slot));
+
+    //
+    // The first DMA buffer queued starts, the next one waits for it
+    //
+    VERIFY_IS_TRUE(queue.Queue(slots[0], 1, 10));
+    VERIFY_IS_FALSE(queue.Queue(slots[1], 2, 11));
+    VERIFY_ARE_EQUAL(slots[0], queue.GetRunningSlot());
+    VERIFY_IS_TRUE(queue.GetSlot(slots[1]).m_state == ROS_HW_SLOT_QUEUED);
+
+    VERIFY_IS_FALSE(queue.Retire(&slot));
+
+    //
+    // Binning is done once, at the end of frame the next DMA buffer starts
+    //
+    VERIFY_IS_TRUE(queue.OnBinningDone(20));
+    VERIFY_IS_FALSE(queue.OnBinningDone(21));
+
+    UINT completedSlot;
+    UINT nextSlot;
+    VERIFY_IS_TRUE(queue.OnRenderingDone(30, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(slots[0], completedSlot);
+    VERIFY_ARE_EQUAL(slots[1], nextSlot);
+    VERIFY_ARE_EQUAL(slots[1], queue.GetRunningSlot());
+    VERIFY_ARE_EQUAL(10ull, queue.GetSlot(slots[0]).m_startTime);
+    VERIFY_ARE_EQUAL(20ull, queue.GetSlot(slots[0]).m_binnedTime);
+    VERIFY_ARE_EQUAL(30ull, queue.GetSlot(slots[0]).m_completeTime);
+
+    //
+    // The binning interrupt may be merged with the frame done one, the DMA
+    // buffer still being prepared after it doesn't start
+    //
+    VERIFY_IS_TRUE(queue.OnRenderingDone(40, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(slots[1], completedSlot);
+    VERIFY_ARE_EQUAL(noSlot, nextSlot);
+    VERIFY_IS_TRUE(queue.GetSlot(slots[1]).m_bBinned);
+    VERIFY_ARE_EQUAL(noSlot, queue.GetRunningSlot());
+
+    //
+    // Spurious interrupts while nothing runs
+    //
+    VERIFY_IS_FALSE(queue.OnBinningDone(41));
+    VERIFY_IS_FALSE(queue.OnRenderingDone(41, &completedSlot, &nextSlot));
+
+    //
+    // Queued while the GPU is idle it starts right away
+    //
+    VERIFY_IS_TRUE(queue.Queue(slots[2], 3, 50));
+    VERIFY_ARE_EQUAL(slots[2], queue.GetRunningSlot());
+
+    //
+    // Completed slots retire in order, the running one doesn't
+    //
+    VERIFY_IS_TRUE(queue.Retire(&slot));
+    VERIFY_ARE_EQUAL(slots[0], slot);
+    VERIFY_IS_TRUE(queue.Retire(&slot));
+    VERIFY_ARE_EQUAL(slots[1], slot);
+    VERIFY_IS_FALSE(queue.Retire(&slot));
+
+    //
+    // The slots wrap around
+    //
+    VERIFY_IS_TRUE(queue.Reserve(&slot));
+    VERIFY_ARE_EQUAL(slots[0], slot);
+
+    VERIFY_IS_FALSE(queue.Queue(slots[3], 4, 60));
+    VERIFY_IS_FALSE(queue.Queue(slots[0], 5, 61));
+
+    VERIFY_IS_TRUE(queue.OnRenderingDone(70, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(slots[2], completedSlot);
+    VERIFY_ARE_EQUAL(slots[3], nextSlot);
+
+    VERIFY_IS_TRUE(queue.OnRenderingDone(80, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(slots[3], completedSlot);
+    VERIFY_ARE_EQUAL(slots[0], nextSlot);
+
+    VERIFY_IS_TRUE(queue.OnRenderingDone(90, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(slots[0], completedSlot);
+    VERIFY_ARE_EQUAL(noSlot, nextSlot);
+
+    const UINT expected[] = { slots[2], slots[3], slots[0] };
+    for (UINT i = 0; i < ARRAYSIZE(expected); ++i) {
+        VERIFY_IS_TRUE(queue.Retire(&slot));
+        VERIFY_ARE_EQUAL(expected[i], slot);
+    }
+
+    VERIFY_IS_TRUE(queue.IsIdle());
+    VERIFY_ARE_EQUAL(5u, queue.GetCompletedCount());
+    VERIFY_ARE_EQUAL(0u, queue.GetFaultedCount());
+
+    //
+    // A slot reserved for a DMA buffer that doesn't run is freed, the next
+    // DMA buffer gets it
+    //
+    VERIFY_IS_TRUE(queue.Reserve(&slot));
+    VERIFY_ARE_EQUAL(slots[1], slot);
+    queue.Unreserve(slot);
+    VERIFY_IS_TRUE(queue.IsIdle());
+
+    VERIFY_IS_TRUE(queue.Reserve(&slot));
+    VERIFY_ARE_EQUAL(slots[1], slot);
+    VERIFY_IS_TRUE(queue.Queue(slot, 6, 100));
+    VERIFY_ARE_EQUAL(slots[1], queue.GetRunningSlot());
+}
+
+void HwQueueTests::TestHangRecovery ()
+{
+    const UINT noSlot = RosHwQueue::kNoSlot;
+
+    RosHwQueue queue;
+
+    UINT first;
+    UINT second;
+    UINT third;
+
+    VERIFY_IS_TRUE(queue.Reserve(&first));
+    VERIFY_IS_TRUE(queue.Queue(first, 1, 0));
+    VERIFY_IS_TRUE(queue.Reserve(&second));
+    VERIFY_IS_FALSE(queue.Queue(second, 2, 0));
+    VERIFY_IS_TRUE(queue.Reserve(&third));
+
+    //
+    // Control lists that advance are not hung however long they run
+    //
+    VERIFY_IS_FALSE(queue.IsHung(100, 0x100, 0x200, 1000));
+    VERIFY_IS_FALSE(queue.IsHung(900, 0x180, 0x200, 1000));
+    VERIFY_IS_FALSE(queue.IsHung(1800, 0x180, 0x200, 1000));
+    VERIFY_IS_TRUE(queue.IsHung(1900, 0x180, 0x200, 1000));
+
+    //
+    // The reset completes the running and the queued DMA buffers in order,
+    // the one being prepared runs after it
+    //
+    UINT faultedSlots[RosHwQueue::kMaxSlots];
+    VERIFY_ARE_EQUAL(2u, queue.Reset(1900, faultedSlots));
+    VERIFY_ARE_EQUAL(first, faultedSlots[0]);
+    VERIFY_ARE_EQUAL(second, faultedSlots[1]);
+    VERIFY_IS_TRUE(queue.GetSlot(first).m_bFaulted);
+    VERIFY_IS_TRUE(queue.GetSlot(second).m_bFaulted);
+    VERIFY_IS_TRUE(queue.GetSlot(third).m_state == ROS_HW_SLOT_PREPARING);
+    VERIFY_ARE_EQUAL(noSlot, queue.GetRunningSlot());
+    VERIFY_IS_FALSE(queue.IsHung(5000, 0x180, 0x200, 1000));
+
+    VERIFY_IS_TRUE(queue.Queue(third, 3, 2000));
+    VERIFY_IS_FALSE(queue.IsHung(2000, 0x180, 0x200, 1000));
+
+    UINT slot;
+    VERIFY_IS_TRUE(queue.Retire(&slot));
+    VERIFY_ARE_EQUAL(first, slot);
+    VERIFY_IS_TRUE(queue.Retire(&slot));
+    VERIFY_ARE_EQUAL(second, slot);
+    VERIFY_IS_FALSE(queue.Retire(&slot));
+
+    UINT completedSlot;
+    UINT nextSlot;
+    VERIFY_IS_TRUE(queue.OnRenderingDone(2500, &completedSlot, &nextSlot));
+    VERIFY_ARE_EQUAL(third, completedSlot);
+    VERIFY_IS_FALSE(queue.GetSlot(third).m_bFaulted);
+    VERIFY_ARE_EQUAL(2u, queue.GetFaultedCount());
+
+    //
+    // A DMA buffer hangs the simulated V3D while the worker prepares ahead
+    //
+    const UINT numDmaBuffers = 60;
+    const UINT hungDmaBuffer = 20;
+
+    HwQueueRig rig(COMPLETION_INTERRUPT, 200, 300, 600);
+
+    const RIG_RESULT result = rig.Run(numDmaBuffers, hungDmaBuffer);
+
+    VERIFY_ARE_EQUAL(numDmaBuffers, result.Completed);
+    VERIFY_IS_TRUE(result.InOrder);
+    VERIFY_IS_TRUE(result.FaultedFences[hungDmaBuffer + 1]);
+    VERIFY_IS_TRUE((result.Faulted >= 1) && (result.Faulted <= RosHwQueue::kMaxSlots));
+
+    //
+    // Only the hung DMA buffer and the ones queued behind it are dropped
+    //
+    for (UINT fence = 1; fence <= numDmaBuffers; ++fence) {
+        if ((fence <= hungDmaBuffer) || (fence > hungDmaBuffer + RosHwQueue::kMaxSlots)) {
+            VERIFY_IS_FALSE(result.FaultedFences[fence]);
+        }
+    }
+
+    LogComment(
+        L"Hung DMA buffer detected and reset in %.1fms of the run, %u DMA buffers faulted",
+        result.ElapsedMs,
+        result.Faulted);
+}
+
+void HwQueueTests::TestPolledVsInterrupt ()
+{
+    //
+    // A DMA buffer takes 300us to prepare on the CPU, 400us to bin and
+    // 1200us to render
+    //
+    const UINT numDmaBuffers = 200;
+    const UINT preparationUs = 300;
+    const UINT binningUs = 400;
+    const UINT renderingUs = 1200;
+
+    const struct {
+        COMPLETION_MODE Mode;
+        const wchar_t * Name;
+    } modes[] = {
+        { COMPLETION_POLLED, L"polled" },
+        { COMPLETION_BUSY_POLLED, L"busy polled" },
+        { COMPLETION_INTERRUPT, L"interrupt" },
+    };
+
+    RIG_RESULT results[ARRAYSIZE(modes)];
+
+    for (UINT i = 0; i < ARRAYSIZE(modes); ++i) {
+        HwQueueRig rig(modes[i].Mode, preparationUs, binningUs, renderingUs);
+
+        results[i] = rig.Run(numDmaBuffers, UINT(-1));
+
+        VERIFY_ARE_EQUAL(numDmaBuffers, results[i].Completed);
+        VERIFY_ARE_EQUAL(0u, results[i].Faulted);
+        VERIFY_IS_TRUE(results[i].InOrder);
+
+        LogComment(
+            L"%s: %.0f DMA buffers/s, completion latency %.0fus mean %.0fus max, worker thread CPU %.0fus per DMA buffer",
+            modes[i].Name,
+            numDmaBuffers * 1000.0 / results[i].ElapsedMs,
+            results[i].MeanLatencyUs,
+            results[i].MaxLatencyUs,
+            results[i].WorkerCpuMs * 1000.0 / numDmaBuffers);
+    }
+
+    //
+    // The interrupt reports the fence sooner than the sleeping worker
+    // thread notices CTRUN cleared, and the GPU runs while the worker
+    // prepares the next DMA buffer
+    //
+    VERIFY_IS_TRUE(results[2].MeanLatencyUs < results[0].MeanLatencyUs);
+    VERIFY_IS_TRUE(results[2].ElapsedMs < results[0].ElapsedMs);
+}
@@ -0,0 +1,33 @@
+#ifndef _HW_QUEUE_TESTS_H_
+#define _HW_QUEUE_TESTS_H_
+
+//
+// Tests of the queue of DMA buffers on the V3D. These run on the host
+// without a device, a simulated V3D on its own thread raises the binning
+// and frame done interrupts.
+//
+class HwQueueTests {
+    BEGIN_TEST_CLASS(HwQueueTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestQueueOrder)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that DMA buffers start in queue order one at a time, that spurious interrupts are ignored and that slots retire in order.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestHangRecovery)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a DMA buffer whose control lists stop advancing is detected as hung and that the DMA buffers after the reset complete in order.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestPolledVsInterrupt)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Reports the throughput, completion latency and worker thread CPU time of DMA buffers completed by polling and by the frame done interrupt.")
+    END_TEST_METHOD()
+};
+
+#endif // _HW_QUEUE_TESTS_H_
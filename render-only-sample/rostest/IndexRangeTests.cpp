@@ -0,0 +1,251 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "IndexRangeTests.h"
+
+#include "RosUmdIndexRange.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+typedef std::tuple<UINT, UINT, UINT> Triangle;
+
+//
+// Expands a triangle strip into triangles in their drawn winding order,
+// odd triangles have their first two vertices swapped. Degenerate triangles
+// aren't drawn and are skipped.
+//
+static void ExpandTriangleStrip (
+    const std::vector<UINT>& Indices,
+    std::vector<Triangle>* Triangles
+    )
+{
+    for (size_t i = 0; i + 2 < Indices.size(); ++i) {
+        UINT a = Indices[i];
+        UINT b = Indices[i + 1];
+        UINT c = Indices[i + 2];
+
+        if ((a == b) || (b == c) || (a == c)) {
+            continue;
+        }
+
+        if (i & 1) {
+            std::swap(a, b);
+        }
+
+        Triangles->push_back(Triangle(a, b, c));
+    }
+}
+
+//
+// Writes the batch the way DrawIndexed does and returns the indices
+// the hardware fetches, translated back by the batch's vertex rebase
+//
+static std::vector<UINT> EmitBatch (
+    const std::vector<UINT>& Indices,
+    const RosUmdIndexBatch& Batch,
+    VC4PrimitiveMode PrimitiveMode
+    )
+{
+    BYTE packet[sizeof(VC4IndexedPrimitiveList)];
+    VC4IndexedPrimitiveList* pList = reinterpret_cast<VC4IndexedPrimitiveList*>(packet);
+
+    const UINT length = Batch.m_leadingPad + Batch.m_indexCount;
+
+    RosUmdIndexRange::WriteIndexedPrimitiveList(
+        pList,
+        PrimitiveMode,
+        length,
+        Batch.m_maxIndex - Batch.m_minIndex);
+
+    VERIFY_ARE_EQUAL(static_cast<UINT>(VC4_CMD_INDEXED_PRIMITIVE_LIST), static_cast<UINT>(packet[0]));
+    VERIFY_ARE_EQUAL(static_cast<UINT>(PrimitiveMode), static_cast<UINT>(packet[1] & 0xF));
+    VERIFY_ARE_EQUAL(1u, static_cast<UINT>(packet[1] >> 4), L"Index type must be 16 bit");
+    VERIFY_ARE_EQUAL(length, pList->Length);
+    VERIFY_IS_TRUE(pList->MaximumIndex <= 0xFFFF);
+
+    std::vector<USHORT> shadow(length);
+    RosUmdIndexRange::WriteBatchIndices(Indices.data(), sizeof(UINT), Batch, shadow.data());
+
+    std::vector<UINT> fetched;
+    UINT maxFetched = 0;
+    for (USHORT index : shadow) {
+        maxFetched = max(maxFetched, static_cast<UINT>(index));
+        fetched.push_back(index + Batch.m_minIndex);
+    }
+
+    VERIFY_ARE_EQUAL(pList->MaximumIndex, maxFetched, L"MaximumIndex must be the tight bound");
+
+    return fetched;
+}
+
+static std::vector<RosUmdIndexBatch> SplitIndices (
+    const std::vector<UINT>& Indices,
+    VC4PrimitiveMode PrimitiveMode
+    )
+{
+    const UINT count = static_cast<UINT>(Indices.size());
+
+    UINT numBatches = RosUmdIndexRange::Split(Indices.data(), sizeof(UINT), count, PrimitiveMode, nullptr, 0, nullptr);
+
+    std::vector<RosUmdIndexBatch> batches(numBatches);
+    VERIFY_ARE_EQUAL(
+        numBatches,
+        RosUmdIndexRange::Split(Indices.data(), sizeof(UINT), count, PrimitiveMode, batches.data(), numBatches, nullptr));
+
+    return batches;
+}
+
+void IndexRangeTests::TestTriangleListPackets ()
+{
+    static_assert(
+        sizeof(VC4IndexedPrimitiveList) == 14,
+        "Indexed Primitive List packet is 14 bytes");
+
+    // 300 triangles spread over 300K vertices, plus one spanning more than
+    // 64K vertices which cannot be drawn with 16 bit indices
+    const UINT numTriangles = 300;
+    std::vector<UINT> indices;
+    for (UINT i = 0; i < numTriangles; ++i) {
+        indices.push_back(i * 1000);
+        indices.push_back(i * 1000 + 2);
+        indices.push_back(i * 1000 + 1);
+    }
+    indices.push_back(0);
+    indices.push_back(70000);
+    indices.push_back(1);
+
+    std::vector<RosUmdIndexBatch> batches = SplitIndices(indices, VC4_TRIANGLES);
+
+    LogComment(L"%u indices were split into %u batches", UINT(indices.size()), UINT(batches.size()));
+    VERIFY_IS_TRUE(batches.size() >= (numTriangles * 1000) / 0x10000);
+
+    std::vector<UINT> drawn;
+    for (const RosUmdIndexBatch& batch : batches) {
+        VERIFY_ARE_EQUAL(0u, batch.m_indexCount % 3, L"Batches hold whole triangles");
+        VERIFY_ARE_EQUAL(0u, batch.m_leadingPad);
+
+        std::vector<UINT> fetched = EmitBatch(indices, batch, VC4_TRIANGLES);
+        drawn.insert(drawn.end(), fetched.begin(), fetched.end());
+    }
+
+    VERIFY_ARE_EQUAL(numTriangles * 3, UINT(drawn.size()), L"Only the wide triangle is dropped");
+    VERIFY_IS_TRUE(std::equal(drawn.begin(), drawn.end(), indices.begin()));
+
+    UINT numDropped;
+    RosUmdIndexRange::Split(indices.data(), sizeof(UINT), UINT(indices.size()), VC4_TRIANGLES, nullptr, 0, &numDropped);
+    VERIFY_ARE_EQUAL(1u, numDropped);
+}
+
+void IndexRangeTests::TestTriangleStripWinding ()
+{
+    // Vertex indices jump by 20000 every 8 vertices, so the strip has to be
+    // restarted at both even and odd triangles
+    std::vector<UINT> indices;
+    for (UINT i = 0; i < 203; ++i) {
+        indices.push_back((i / 8) * 20000 + (i % 8));
+    }
+
+    std::vector<Triangle> expected;
+    ExpandTriangleStrip(indices, &expected);
+
+    std::vector<RosUmdIndexBatch> batches = SplitIndices(indices, VC4_TRIANGLE_STRIP);
+
+    UINT paddedBatches = 0;
+    std::vector<Triangle> drawn;
+    for (const RosUmdIndexBatch& batch : batches) {
+        VERIFY_ARE_EQUAL((batch.m_firstIndex & 1) ? 1u : 0u, batch.m_leadingPad);
+        paddedBatches += batch.m_leadingPad;
+
+        ExpandTriangleStrip(EmitBatch(indices, batch, VC4_TRIANGLE_STRIP), &drawn);
+    }
+
+    LogComment(
+        L"%u strip indices were split into %u batches, %u restarted on an odd triangle",
+        UINT(indices.size()),
+        UINT(batches.size()),
+        paddedBatches);
+
+    VERIFY_IS_TRUE(batches.size() > 1);
+    VERIFY_ARE_EQUAL(expected.size(), drawn.size());
+    VERIFY_IS_TRUE(expected == drawn, L"Every triangle is drawn once with its original winding");
+}
+
+void IndexRangeTests::TestRangeCacheHitRate ()
+{
+    const UINT numFrames = 100;
+    const UINT numStaticRanges = 12;
+    const UINT indexCount = 30000;
+
+    std::vector<UINT> indices(indexCount);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    RosUmdIndexRangeCache cache;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+
+    // Static meshes are drawn every frame, one dynamic mesh is rewritten
+    // before each draw and so always rescanned
+    ULONGLONG dynamicVersion = 0;
+    for (UINT frame = 0; frame < numFrames; ++frame) {
+        for (UINT range = 0; range <= numStaticRanges; ++range) {
+            const bool isDynamic = (range == numStaticRanges);
+
+            RosUmdIndexRangeKey key = {};
+            key.m_pIndexBuffer = reinterpret_cast<const RosUmdResource*>(
+                static_cast<UINT_PTR>(range + 1) * 0x100);
+            key.m_contentVersion = isDynamic ? ++dynamicVersion : 0;
+            key.m_byteOffset = 0;
+            key.m_indexCount = indexCount;
+            key.m_indexSize = sizeof(UINT);
+            key.m_primitiveMode = VC4_TRIANGLES;
+
+            if (cache.Find(key) == nullptr) {
+                RosUmdIndexRangeEntry* pEntry = cache.Insert(key);
+
+                cache.ReserveBatches(pEntry, 1);
+                pEntry->m_pBatches[0].m_firstIndex = 0;
+                pEntry->m_pBatches[0].m_indexCount = indexCount;
+                pEntry->m_pBatches[0].m_leadingPad = 0;
+
+                RosUmdIndexRange::Scan(
+                    indices.data(),
+                    sizeof(UINT),
+                    indexCount,
+                    &pEntry->m_pBatches[0].m_minIndex,
+                    &pEntry->m_pBatches[0].m_maxIndex);
+
+                pEntry->m_numBatches = 1;
+            }
+        }
+    }
+
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+
+    const UINT draws = numFrames * (numStaticRanges + 1);
+    const double hitRate = double(cache.GetHitCount()) / draws;
+    const double microsecondsPerDraw =
+        double(end.QuadPart - start.QuadPart) * 1000000.0 / frequency.QuadPart / draws;
+
+    LogComment(
+        L"Index range cache: %u draws, %u hits, %u misses, hit rate %.1f%%, %.2f us per draw",
+        draws,
+        cache.GetHitCount(),
+        cache.GetMissCount(),
+        hitRate * 100.0,
+        microsecondsPerDraw);
+
+    // Rescanning the dynamic range replaces its stale entry instead of
+    // evicting a static one
+    VERIFY_ARE_EQUAL(numStaticRanges * (numFrames - 1), cache.GetHitCount());
+    VERIFY_ARE_EQUAL(numStaticRanges + numFrames, cache.GetMissCount());
+}
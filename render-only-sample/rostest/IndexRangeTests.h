@@ -0,0 +1,32 @@
+#ifndef _INDEX_RANGE_TESTS_H_
+#define _INDEX_RANGE_TESTS_H_
+
+//
+// Tests of the UMD index range scanning, 16 bit batch splitting and
+// index range cache. These run on the host without a device.
+//
+class IndexRangeTests {
+    BEGIN_TEST_CLASS(IndexRangeTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestTriangleListPackets)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies the Indexed Primitive List packets emitted for a 32 bit triangle list spanning more than 64K vertices.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestTriangleStripWinding)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a split 32 bit triangle strip draws the same triangles with the same winding.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestRangeCacheHitRate)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Measures the index range cache hit rate and scan cost across redraws.")
+    END_TEST_METHOD()
+};
+
+#endif // _INDEX_RANGE_TESTS_H_
@@ -0,0 +1,317 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "MsaaTests.h"
+
+#include "RosMsaa.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Frame of the Dolphin demo, 32 bit render targets
+//
+const UINT FRAME_WIDTH = 800;
+const UINT FRAME_HEIGHT = 480;
+const UINT PIXEL_BYTES = 4;
+
+//
+// Tiles of the Rendering Control List (Vc4Ddi.h) of a render target of
+// one sample
+//
+const UINT TILE_PIXELS = 64;
+
+const UINT CLEAR_COLOR = 0xFF203040;
+
+struct Triangle {
+    int m_x[3];
+    int m_y[3];
+    UINT m_color;
+};
+
+//
+// A large triangle with edges at all angles and a sliver
+//
+static const Triangle s_triangles[] = {
+    { { 100, 700, 300 }, { 40, 120, 440 }, 0xFFF08010 },
+    { { 520, 790, 530 }, { 300, 310, 330 }, 0xFF10C0E0 },
+};
+
+//
+// Edge function of a point in 1/8 of a pixel, positive inside of a
+// clockwise triangle in screen space
+//
+static long long EdgeFunction (
+    int X0,
+    int Y0,
+    int X1,
+    int Y1,
+    int X,
+    int Y)
+{
+    return (long long)(X1 - X0) * (Y - Y0) - (long long)(Y1 - Y0) * (X - X0);
+}
+
+static bool Covers (
+    const Triangle & Tri,
+    UINT X,
+    UINT Y,
+    UINT Sample)
+{
+    UINT sampleX;
+    UINT sampleY;
+    RosMsaa::GetSamplePosition(Sample, &sampleX, &sampleY);
+
+    const int s = RosMsaa::kSubpixels;
+    const int px = X * s + sampleX;
+    const int py = Y * s + sampleY;
+
+    for (UINT i = 0; i < 3; ++i) {
+        const UINT j = (i + 1) % 3;
+        if (EdgeFunction(
+                Tri.m_x[i] * s, Tri.m_y[i] * s,
+                Tri.m_x[j] * s, Tri.m_y[j] * s,
+                px, py) < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Samples of the tile buffer after the triangles are drawn over the clear
+// color, 4 per pixel
+//
+static std::vector<UINT> RasterizeSamples ()
+{
+    std::vector<UINT> samples(FRAME_WIDTH * FRAME_HEIGHT * RosMsaa::kSamples, CLEAR_COLOR);
+
+    for (const Triangle & tri : s_triangles) {
+        for (UINT y = 0; y < FRAME_HEIGHT; ++y) {
+            for (UINT x = 0; x < FRAME_WIDTH; ++x) {
+                for (UINT s = 0; s < RosMsaa::kSamples; ++s) {
+                    if (Covers(tri, x, y, s)) {
+                        samples[(y * FRAME_WIDTH + x) * RosMsaa::kSamples + s] = tri.m_color;
+                    }
+                }
+            }
+        }
+    }
+
+    return samples;
+}
+
+//
+// Store of the tile buffer decimating the samples of each pixel into the
+// render target of one sample
+//
+static std::vector<UINT> ResolvingStore (const std::vector<UINT> & Samples)
+{
+    std::vector<UINT> pixels(FRAME_WIDTH * FRAME_HEIGHT);
+
+    for (UINT i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i) {
+        UINT pixel = 0;
+
+        for (UINT channel = 0; channel < PIXEL_BYTES; ++channel) {
+            UINT sum = 0;
+
+            for (UINT s = 0; s < RosMsaa::kSamples; ++s) {
+                sum += (Samples[i * RosMsaa::kSamples + s] >> (8 * channel)) & 0xFF;
+            }
+
+            pixel |= ((sum + 2) / 4) << (8 * channel);
+        }
+
+        pixels[i] = pixel;
+    }
+
+    return pixels;
+}
+
+void MsaaTests::TestSampleLayout ()
+{
+    const UINT widthInTiles = RosMsaa::GetTiles(FRAME_WIDTH);
+    const UINT sizeBytes = RosMsaa::GetSizeBytes(FRAME_WIDTH, FRAME_HEIGHT);
+
+    VERIFY_ARE_EQUAL(25u, widthInTiles);
+    VERIFY_ARE_EQUAL(15u, RosMsaa::GetTiles(FRAME_HEIGHT));
+    VERIFY_ARE_EQUAL(16384u, RosMsaa::kTileBytes);
+    VERIFY_ARE_EQUAL(25u * 15u * 16384u, sizeBytes);
+
+    //
+    // Sample 0 of the quad, then sample 1, quads in rows of 16, tiles in
+    // rows of the width of the render target
+    //
+    VERIFY_ARE_EQUAL(0u, RosMsaa::GetSampleOffset(widthInTiles, 0, 0, 0));
+    VERIFY_ARE_EQUAL(4u, RosMsaa::GetSampleOffset(widthInTiles, 1, 0, 0));
+    VERIFY_ARE_EQUAL(8u, RosMsaa::GetSampleOffset(widthInTiles, 0, 1, 0));
+    VERIFY_ARE_EQUAL(16u, RosMsaa::GetSampleOffset(widthInTiles, 0, 0, 1));
+    VERIFY_ARE_EQUAL(64u, RosMsaa::GetSampleOffset(widthInTiles, 2, 0, 0));
+    VERIFY_ARE_EQUAL(1024u, RosMsaa::GetSampleOffset(widthInTiles, 0, 2, 0));
+    VERIFY_ARE_EQUAL(16384u, RosMsaa::GetSampleOffset(widthInTiles, 32, 0, 0));
+    VERIFY_ARE_EQUAL(25u * 16384u, RosMsaa::GetSampleOffset(widthInTiles, 0, 32, 0));
+
+    std::vector<bool> written(sizeBytes / PIXEL_BYTES, false);
+
+    for (UINT y = 0; y < FRAME_HEIGHT; ++y) {
+        for (UINT x = 0; x < FRAME_WIDTH; ++x) {
+            for (UINT s = 0; s < RosMsaa::kSamples; ++s) {
+                const UINT offset = RosMsaa::GetSampleOffset(widthInTiles, x, y, s);
+
+                VERIFY_ARE_EQUAL(0u, offset % PIXEL_BYTES);
+                VERIFY_IS_TRUE(offset + PIXEL_BYTES <= sizeBytes);
+                VERIFY_IS_FALSE(written[offset / PIXEL_BYTES]);
+
+                written[offset / PIXEL_BYTES] = true;
+            }
+        }
+    }
+
+    //
+    // The positions are a rotated grid, no two share a row or a column
+    //
+    for (UINT i = 0; i < RosMsaa::kSamples; ++i) {
+        UINT xi;
+        UINT yi;
+        RosMsaa::GetSamplePosition(i, &xi, &yi);
+
+        VERIFY_IS_TRUE(xi < RosMsaa::kSubpixels);
+        VERIFY_IS_TRUE(yi < RosMsaa::kSubpixels);
+
+        for (UINT j = i + 1; j < RosMsaa::kSamples; ++j) {
+            UINT xj;
+            UINT yj;
+            RosMsaa::GetSamplePosition(j, &xj, &yj);
+
+            VERIFY_ARE_NOT_EQUAL(xi, xj);
+            VERIFY_ARE_NOT_EQUAL(yi, yj);
+        }
+    }
+}
+
+void MsaaTests::TestResolvedOutput ()
+{
+    const std::vector<UINT> samples = RasterizeSamples();
+    const std::vector<UINT> resolved = ResolvingStore(samples);
+
+    //
+    // Full resolution store of the tile buffer, then the resolve of the
+    // software command
+    //
+    const UINT widthInTiles = RosMsaa::GetTiles(FRAME_WIDTH);
+    std::vector<BYTE> tileDumps(RosMsaa::GetSizeBytes(FRAME_WIDTH, FRAME_HEIGHT), 0);
+
+    for (UINT y = 0; y < FRAME_HEIGHT; ++y) {
+        for (UINT x = 0; x < FRAME_WIDTH; ++x) {
+            for (UINT s = 0; s < RosMsaa::kSamples; ++s) {
+                const UINT offset = RosMsaa::GetSampleOffset(widthInTiles, x, y, s);
+
+                *(UINT *)&tileDumps[offset] = samples[(y * FRAME_WIDTH + x) * RosMsaa::kSamples + s];
+            }
+        }
+    }
+
+    std::vector<UINT> cpuResolved(FRAME_WIDTH * FRAME_HEIGHT, 0);
+
+    RosMsaa::Resolve(
+        &tileDumps[0],
+        widthInTiles,
+        (BYTE *)&cpuResolved[0],
+        FRAME_WIDTH * PIXEL_BYTES,
+        false,
+        FRAME_WIDTH,
+        FRAME_HEIGHT);
+
+    //
+    // Resolved into a T-format render target
+    //
+    std::vector<BYTE> tFormat(RosTFormat::GetSizeBytes(FRAME_WIDTH, FRAME_HEIGHT, PIXEL_BYTES), 0);
+    std::vector<UINT> detiled(FRAME_WIDTH * FRAME_HEIGHT, 0);
+
+    RosMsaa::Resolve(
+        &tileDumps[0],
+        widthInTiles,
+        &tFormat[0],
+        0,
+        true,
+        FRAME_WIDTH,
+        FRAME_HEIGHT);
+
+    RosTFormat::Detile(
+        &tFormat[0],
+        RosTFormat::GetWidthInTiles(FRAME_WIDTH, PIXEL_BYTES),
+        (BYTE *)&detiled[0],
+        FRAME_WIDTH * PIXEL_BYTES,
+        FRAME_WIDTH,
+        FRAME_HEIGHT,
+        PIXEL_BYTES);
+
+    UINT mismatches = 0;
+    UINT edgePixels = 0;
+
+    for (UINT i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i) {
+        if ((cpuResolved[i] != resolved[i]) || (detiled[i] != resolved[i])) {
+            ++mismatches;
+        }
+
+        if ((resolved[i] != CLEAR_COLOR) &&
+            (resolved[i] != s_triangles[0].m_color) &&
+            (resolved[i] != s_triangles[1].m_color)) {
+            ++edgePixels;
+        }
+    }
+
+    LogComment(L"%u of %u pixels blend the edges", edgePixels, FRAME_WIDTH * FRAME_HEIGHT);
+
+    VERIFY_ARE_EQUAL(0u, mismatches);
+
+    //
+    // Inside and outside of the large triangle, and the edge pixels are
+    // between the two
+    //
+    VERIFY_ARE_EQUAL(s_triangles[0].m_color, resolved[200 * FRAME_WIDTH + 350]);
+    VERIFY_ARE_EQUAL(CLEAR_COLOR, resolved[10 * FRAME_WIDTH + 10]);
+    VERIFY_IS_TRUE(edgePixels > 0);
+
+    for (UINT i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i) {
+        const UINT blue = resolved[i] & 0xFF;
+        VERIFY_IS_TRUE((blue >= 0x10) && (blue <= 0xE0));
+    }
+}
+
+void MsaaTests::TestBandwidth ()
+{
+    const UINT resolvedBytes = FRAME_WIDTH * FRAME_HEIGHT * PIXEL_BYTES;
+    const UINT sampleBytes = RosMsaa::GetSizeBytes(FRAME_WIDTH, FRAME_HEIGHT);
+    const UINT msaaTiles = RosMsaa::GetTiles(FRAME_WIDTH) * RosMsaa::GetTiles(FRAME_HEIGHT);
+
+    //
+    // The tile buffer resolves the samples as it stores the render target,
+    // the samples are stored too unless they are discarded
+    //
+    const UINT discardedBytes = resolvedBytes;
+    const UINT storedBytes = resolvedBytes + sampleBytes;
+
+    //
+    // Supersampling renders a render target of twice the width and height,
+    // stores it, then reads it back to filter it down
+    //
+    const UINT superWidth = 2 * FRAME_WIDTH;
+    const UINT superHeight = 2 * FRAME_HEIGHT;
+    const UINT superBytes = superWidth * superHeight * PIXEL_BYTES;
+    const UINT superTiles =
+        ((superWidth + TILE_PIXELS - 1) / TILE_PIXELS) *
+        ((superHeight + TILE_PIXELS - 1) / TILE_PIXELS);
+    const UINT supersampledBytes = superBytes + superBytes + resolvedBytes;
+
+    LogComment(L"4x MSAA, samples discarded: %u tiles, %u bytes", msaaTiles, discardedBytes);
+    LogComment(L"4x MSAA, samples stored: %u tiles, %u bytes", msaaTiles, storedBytes);
+    LogComment(L"2x2 supersampling: %u tiles, %u bytes", superTiles, supersampledBytes);
+
+    VERIFY_ARE_EQUAL(superTiles, msaaTiles);
+    VERIFY_IS_TRUE(discardedBytes < storedBytes);
+    VERIFY_IS_TRUE(storedBytes < supersampledBytes);
+    VERIFY_ARE_EQUAL(supersampledBytes / discardedBytes, 9u);
+}
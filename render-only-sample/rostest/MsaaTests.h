@@ -0,0 +1,33 @@
+#ifndef _MSAA_TESTS_H_
+#define _MSAA_TESTS_H_
+
+//
+// Tests of the layout and resolve of the 4x multisample render targets.
+// These run on the host, a model of the samples of the tile buffer stands
+// in for the V3D.
+//
+class MsaaTests {
+    BEGIN_TEST_CLASS(MsaaTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestSampleLayout)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that the samples of the full resolution tile dumps are laid out in 2x2 pixel quads within 16KB tiles, each at its own offset within the size of the render target, and that the sample positions are distinct.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestResolvedOutput)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Rasterizes triangles at the sample positions, verifies that resolving the stored full resolution tile dumps on the CPU into a linear or a T-format render target matches the resolving store of the tile buffer, and that the edges of the triangles are blended.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestBandwidth)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Reports the memory traffic of a frame resolved in the tile buffer with and without its samples discarded, and of the same frame supersampled 2x2 and filtered down, and verifies that the resolve in the tile buffer moves the fewest bytes.")
+    END_TEST_METHOD()
+};
+
+#endif // _MSAA_TESTS_H_
@@ -0,0 +1,816 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "PerfCounterTests.h"
+
+#include "RosUmdPerfCounters.h"
+#include "RosUmdPredication.h"
+
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+
+using namespace WEX::TestExecution;
+
+//
+// Performance counter queries whose reports are system memory, the report
+// pointer doubles as the report buffer
+//
+class HostPerfCounters : public RosUmdPerfCounters {
+public:
+    HostPerfCounters () :
+        m_maps(0)
+    {}
+
+    ~HostPerfCounters ()
+    {
+        Teardown();
+    }
+
+    UINT m_maps;
+
+protected:
+
+    virtual void MapReports (RosUmdPerfCounterReports* pReports)
+    {
+        pReports->m_pReports = new VC4PerfCounterReport[kMaxReports];
+        pReports->m_pBuffer = reinterpret_cast<RosUmdResource*>(pReports->m_pReports);
+
+        memset(pReports->m_pReports, 0xCD, kMaxReports * sizeof(VC4PerfCounterReport));
+
+        ++m_maps;
+    }
+
+    virtual void UnmapReports (RosUmdPerfCounterReports* pReports)
+    {
+        delete[] pReports->m_pReports;
+    }
+};
+
+struct DMA_BUFFER {
+    UINT Id;
+    VC4PerfCounterSelect Select;
+    UINT ReportOffsets[V3D_NUM_PERF_COUNTERS];
+};
+
+//
+// Runs DMA buffers in submission order once more than Latency of them are
+// queued, and reports the sampled counters like the KMD does after the
+// control lists complete
+//
+class SimulatedGpu {
+public:
+    SimulatedGpu (HostPerfCounters& Counters, UINT Latency) :
+        m_counters(Counters),
+        m_latency(Latency),
+        m_nextId(1),
+        m_completedId(0)
+    {}
+
+    //
+    // Count of the source during the DMA buffer, stands in for the V3D
+    // counter hardware
+    //
+    static UINT Count (UINT Id, UINT Source)
+    {
+        UINT hash = Id * 2654435761u ^ (Source + 1) * 40503u;
+        hash ^= hash >> 13;
+        return hash % 100000;
+    }
+
+    UINT Submit ()
+    {
+        DMA_BUFFER dmaBuffer;
+
+        dmaBuffer.Id = m_nextId++;
+        m_counters.Sample(&dmaBuffer.Select, dmaBuffer.ReportOffsets);
+
+        m_queue.push_back(dmaBuffer);
+
+        while (m_queue.size() > m_latency) {
+            RunOne();
+        }
+
+        return dmaBuffer.Id;
+    }
+
+    void Drain ()
+    {
+        while (!m_queue.empty()) {
+            RunOne();
+        }
+    }
+
+    UINT CompletedId () const
+    {
+        return m_completedId;
+    }
+
+private:
+
+    void RunOne ()
+    {
+        const DMA_BUFFER& dmaBuffer = m_queue.front();
+        BYTE* pReports = reinterpret_cast<BYTE*>(m_counters.GetReportBuffer());
+
+        for (UINT i = 0; i < dmaBuffer.Select.m_numCounters; ++i) {
+            VC4PerfCounterReport* pReport =
+                reinterpret_cast<VC4PerfCounterReport*>(pReports + dmaBuffer.ReportOffsets[i]);
+
+            pReport->m_value += Count(dmaBuffer.Id, dmaBuffer.Select.m_sources[i]);
+            pReport->m_sampleCount++;
+        }
+
+        m_completedId = dmaBuffer.Id;
+        m_queue.pop_front();
+    }
+
+    HostPerfCounters& m_counters;
+    UINT m_latency;
+    UINT m_nextId;
+    UINT m_completedId;
+    std::deque<DMA_BUFFER> m_queue;
+};
+
+struct QUERY_RECORD {
+    RosUmdPerfCounterQuery Query;
+    bool Begun;
+    bool HasReport;
+    ULONGLONG Expected;
+    UINT LastSampledId;
+};
+
+static UINT NextRandom (UINT* pSeed)
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+    return *pSeed >> 16;
+}
+
+static void VerifyGetData (
+    const HostPerfCounters& Counters,
+    const SimulatedGpu& Gpu,
+    const QUERY_RECORD& Record)
+{
+    ULONGLONG value = 0;
+    const bool ready = Counters.GetData(Record.Query, &value);
+
+    if (Record.LastSampledId > Gpu.CompletedId()) {
+        VERIFY_IS_FALSE(ready, L"DMA buffers that sampled the query haven't run");
+        return;
+    }
+
+    VERIFY_IS_TRUE(ready);
+    VERIFY_ARE_EQUAL(Record.Expected, value);
+}
+
+void PerfCounterTests::TestOverlappingQueries ()
+{
+    //
+    // Every source a counter can be mapped to is described
+    //
+    std::set<std::string> names;
+    for (UINT source = 0; source < V3D_NUM_PERF_COUNTER_SOURCES; ++source) {
+        const RosUmdPerfCounterDesc& desc = RosUmdPerfCounters::GetDesc(V3D_PERF_COUNTER_SOURCE(source));
+
+        VERIFY_IS_TRUE(strlen(desc.m_pName) && strlen(desc.m_pUnits) && strlen(desc.m_pDescription));
+        names.insert(desc.m_pName);
+    }
+
+    VERIFY_ARE_EQUAL(size_t(V3D_NUM_PERF_COUNTER_SOURCES), names.size());
+
+    HostPerfCounters counters;
+    SimulatedGpu gpu(counters, 3);
+
+    const UINT numQueries = 24;
+    const UINT numSteps = 20000;
+
+    std::vector<QUERY_RECORD> queries(numQueries);
+
+    for (UINT i = 0; i < numQueries; ++i) {
+        counters.InitQuery(V3D_PERF_COUNTER_SOURCE((i * 7) % V3D_NUM_PERF_COUNTER_SOURCES), &queries[i].Query);
+        queries[i].Begun = false;
+    }
+
+    UINT seed = 5;
+    UINT submissions = 0;
+    UINT samples = 0;
+    UINT begins = 0;
+    UINT beginFailures = 0;
+    UINT maxActive = 0;
+
+    for (UINT step = 0; step < numSteps; ++step) {
+        const UINT action = NextRandom(&seed) % 4;
+        QUERY_RECORD& record = queries[NextRandom(&seed) % numQueries];
+
+        if (action == 0) {
+            if (!record.Query.m_bActive) {
+                record.Begun = true;
+                record.HasReport = counters.Begin(&record.Query);
+                record.Expected = 0;
+                record.LastSampledId = 0;
+
+                ++begins;
+
+                if (!record.HasReport) {
+                    //
+                    // All counters are in use, the query reports no data
+                    //
+                    VERIFY_ARE_EQUAL(V3D_NUM_PERF_COUNTERS, counters.GetActiveCount());
+                    ++beginFailures;
+                }
+            }
+        } else if (action == 1) {
+            counters.End(&record.Query);
+        } else {
+            //
+            // The DMA buffer samples every active query
+            //
+            maxActive = max(maxActive, counters.GetActiveCount());
+
+            const UINT id = gpu.Submit();
+            ++submissions;
+
+            for (UINT i = 0; i < numQueries; ++i) {
+                if (queries[i].Query.m_bActive) {
+                    queries[i].Expected += SimulatedGpu::Count(id, queries[i].Query.m_source);
+                    queries[i].LastSampledId = id;
+                    ++samples;
+                }
+            }
+        }
+
+        for (UINT i = 0; i < numQueries; ++i) {
+            if (queries[i].Begun && !queries[i].Query.m_bActive) {
+                VerifyGetData(counters, gpu, queries[i]);
+            }
+        }
+    }
+
+    LogComment(
+        L"%u queries, %u begins, %u DMA buffers, %u counter samples, at most %u counters active, %u begins without a counter",
+        numQueries,
+        begins,
+        submissions,
+        samples,
+        maxActive,
+        beginFailures);
+
+    VERIFY_IS_TRUE(maxActive <= V3D_NUM_PERF_COUNTERS);
+    VERIFY_IS_TRUE(beginFailures > 0, L"More queries than counters were active");
+
+    for (UINT i = 0; i < numQueries; ++i) {
+        counters.End(&queries[i].Query);
+    }
+
+    gpu.Drain();
+
+    for (UINT i = 0; i < numQueries; ++i) {
+        if (queries[i].Begun) {
+            VerifyGetData(counters, gpu, queries[i]);
+        }
+
+        counters.DestroyQuery(&queries[i].Query);
+    }
+
+    VERIFY_ARE_EQUAL(1u, counters.m_maps);
+}
+
+void PerfCounterTests::TestReportReuse ()
+{
+    HostPerfCounters counters;
+    SimulatedGpu gpu(counters, 8);
+
+    //
+    // A query restarted every DMA buffer while the GPU runs 8 DMA buffers
+    // behind, the reports of the previous runs are still being added to
+    //
+    RosUmdPerfCounterQuery query;
+    counters.InitQuery(V3D_PCTRS_QPU_TMU_STALL_CYCLES, &query);
+
+    const UINT numRestarts = 10000;
+
+    std::deque<QUERY_RECORD> pending;
+    UINT reads = 0;
+
+    for (UINT i = 0; i < numRestarts; ++i) {
+        //
+        // Keep a copy of the query, it stands in for an application reading
+        // the results of a previous frame
+        //
+        VERIFY_IS_TRUE(counters.Begin(&query));
+
+        const UINT id = gpu.Submit();
+
+        counters.End(&query);
+
+        QUERY_RECORD record;
+        record.Query = query;
+        record.Begun = true;
+        record.HasReport = true;
+        record.Expected = SimulatedGpu::Count(id, query.m_source);
+        record.LastSampledId = id;
+
+        pending.push_back(record);
+
+        while (!pending.empty() && (pending.front().LastSampledId <= gpu.CompletedId())) {
+            VerifyGetData(counters, gpu, pending.front());
+            pending.pop_front();
+            ++reads;
+        }
+    }
+
+    LogComment(
+        L"%u restarts of one query, %u results read while the GPU ran %u DMA buffers behind",
+        numRestarts,
+        reads,
+        8);
+
+    //
+    // With the GPU stalled, every report ends up waiting for a DMA buffer,
+    // Begin fails until they have run
+    //
+    SimulatedGpu stalledGpu(counters, 0xFFFFFFFF);
+
+    UINT begins = 0;
+    while (counters.Begin(&query)) {
+        stalledGpu.Submit();
+        counters.End(&query);
+        ++begins;
+    }
+
+    LogComment(
+        L"%u reports in flight before Begin fails, %u reports in the buffer",
+        begins,
+        RosUmdPerfCounters::kMaxReports);
+
+    VERIFY_IS_TRUE(begins <= RosUmdPerfCounters::kMaxReports);
+    VERIFY_IS_TRUE(begins + 16 >= RosUmdPerfCounters::kMaxReports);
+
+    gpu.Drain();
+    stalledGpu.Drain();
+
+    VERIFY_IS_TRUE(counters.Begin(&query));
+    counters.End(&query);
+
+    ULONGLONG value = 1;
+    VERIFY_IS_TRUE(counters.GetData(query, &value));
+    VERIFY_ARE_EQUAL(0ull, value);
+
+    counters.DestroyQuery(&query);
+
+    VERIFY_ARE_EQUAL(1u, counters.m_maps);
+}
+
+struct BINNING_BUFFER {
+    UINT Id;
+    std::vector<BYTE> BinningList;
+    UINT PassedQuads;
+    VC4PerfCounterSelect Select;
+    UINT ReportOffsets[V3D_NUM_PERF_COUNTERS];
+    bool Timestamp;
+    UINT TimestampOffset;
+};
+
+//
+// Records draws into binning control lists the way the device does,
+// skipping the ones predication rules out, and runs the DMA buffers in
+// submission order once more than Latency of them are queued. Every draw
+// gives the number of its quads passing the Z and stencil tests, the
+// simulated tile buffer counts them. Each DMA buffer takes TicksPerDmaBuffer
+// of the simulated clock.
+//
+class SimulatedBinner {
+public:
+    static const ULONGLONG TicksPerDmaBuffer = 1000;
+
+    SimulatedBinner (HostPerfCounters& Counters, RosUmdPredication& Predication, UINT Latency) :
+        m_counters(Counters),
+        m_predication(Predication),
+        m_latency(Latency),
+        m_nextId(1),
+        m_completedId(0),
+        m_passedQuads(0),
+        m_clock(0),
+        m_packets(0),
+        m_waits(0)
+    {}
+
+    void Draw (UINT VertexCount, UINT PassedQuads)
+    {
+        RosUmdPredicateResult result = m_predication.Evaluate(m_counters);
+
+        //
+        // The device waits for the predicate's result, the GPU keeps
+        // running meanwhile
+        //
+        while (result == ROS_PREDICATE_PENDING) {
+            VERIFY_IS_FALSE(m_queue.empty(), L"The DMA buffers of the predicate were submitted");
+
+            RunOne();
+            ++m_waits;
+
+            result = m_predication.Evaluate(m_counters);
+        }
+
+        if (result == ROS_PREDICATE_SKIP) {
+            return;
+        }
+
+        VC4VertexArrayPrimitives packet = vc4VertexArrayPrimitives;
+        packet.PrimitiveMode = VC4_TRIANGLES;
+        packet.Length = VertexCount;
+
+        const BYTE* pPacket = reinterpret_cast<const BYTE*>(&packet);
+        m_binningList.insert(m_binningList.end(), pPacket, pPacket + sizeof(packet));
+
+        m_passedQuads += PassedQuads;
+    }
+
+    bool IsEmpty () const
+    {
+        return m_binningList.empty();
+    }
+
+    UINT Flush ()
+    {
+        BINNING_BUFFER buffer;
+
+        buffer.Id = m_nextId++;
+        buffer.BinningList.swap(m_binningList);
+        buffer.PassedQuads = m_passedQuads;
+        buffer.Timestamp = false;
+        buffer.TimestampOffset = 0;
+
+        m_counters.Sample(&buffer.Select, buffer.ReportOffsets);
+
+        m_passedQuads = 0;
+
+        return Submit(buffer);
+    }
+
+    //
+    // Software DMA buffer of a timestamp command
+    //
+    UINT Timestamp (UINT ReportOffset)
+    {
+        if (!IsEmpty()) {
+            Flush();
+        }
+
+        BINNING_BUFFER buffer;
+
+        buffer.Id = m_nextId++;
+        buffer.PassedQuads = 0;
+        buffer.Select.m_numCounters = 0;
+        buffer.Timestamp = true;
+        buffer.TimestampOffset = ReportOffset;
+
+        return Submit(buffer);
+    }
+
+    void Drain ()
+    {
+        while (!m_queue.empty()) {
+            RunOne();
+        }
+    }
+
+    UINT CompletedId () const
+    {
+        return m_completedId;
+    }
+
+    UINT Packets () const
+    {
+        return m_packets;
+    }
+
+    UINT Waits () const
+    {
+        return m_waits;
+    }
+
+private:
+
+    UINT Submit (const BINNING_BUFFER& Buffer)
+    {
+        m_queue.push_back(Buffer);
+
+        while (m_queue.size() > m_latency) {
+            RunOne();
+        }
+
+        return Buffer.Id;
+    }
+
+    void RunOne ()
+    {
+        const BINNING_BUFFER& buffer = m_queue.front();
+        BYTE* pReports = reinterpret_cast<BYTE*>(m_counters.GetReportBuffer());
+
+        //
+        // The binning packets the GPU gets to see
+        //
+        for (size_t offset = 0; offset < buffer.BinningList.size(); offset += sizeof(VC4VertexArrayPrimitives)) {
+            VERIFY_ARE_EQUAL(BYTE(VC4_CMD_VERTEX_ARRAY_PRIMITIVES), buffer.BinningList[offset]);
+            ++m_packets;
+        }
+
+        for (UINT i = 0; i < buffer.Select.m_numCounters; ++i) {
+            VC4PerfCounterReport* pReport =
+                reinterpret_cast<VC4PerfCounterReport*>(pReports + buffer.ReportOffsets[i]);
+
+            if (buffer.Select.m_sources[i] == V3D_PCTRS_TLB_QUADS_Z_STENCIL_PASS) {
+                pReport->m_value += buffer.PassedQuads;
+            }
+
+            pReport->m_sampleCount++;
+        }
+
+        if (buffer.Timestamp) {
+            VC4PerfCounterReport* pReport =
+                reinterpret_cast<VC4PerfCounterReport*>(pReports + buffer.TimestampOffset);
+
+            pReport->m_value = m_clock;
+            pReport->m_sampleCount++;
+        }
+
+        m_clock += TicksPerDmaBuffer;
+
+        m_completedId = buffer.Id;
+        m_queue.pop_front();
+    }
+
+    HostPerfCounters& m_counters;
+    RosUmdPredication& m_predication;
+    UINT m_latency;
+    UINT m_nextId;
+    UINT m_completedId;
+    std::vector<BYTE> m_binningList;
+    UINT m_passedQuads;
+    ULONGLONG m_clock;
+    UINT m_packets;
+    UINT m_waits;
+    std::deque<BINNING_BUFFER> m_queue;
+};
+
+//
+// Draws the bounding box of every object in an occlusion predicate query,
+// then every object under its predicate. Every third object is occluded.
+// Returns the number of occluded objects.
+//
+static UINT DrawOccludedScene (
+    HostPerfCounters& Counters,
+    RosUmdPredication& Predication,
+    SimulatedBinner& Binner,
+    std::vector<RosUmdPerfCounterQuery>& Predicates,
+    bool Hint)
+{
+    const UINT boundingBoxVertices = 36;
+    const UINT objectVertices = 3000;
+
+    UINT occluded = 0;
+
+    for (UINT i = 0; i < Predicates.size(); ++i) {
+        //
+        // Counters are sampled per DMA buffer, QueryBegin and QueryEnd
+        // submit the work recorded so far
+        //
+        if (!Binner.IsEmpty()) {
+            Binner.Flush();
+        }
+
+        Counters.Begin(&Predicates[i]);
+
+        Binner.Draw(boundingBoxVertices, (i % 3) ? 20 + i : 0);
+        Binner.Flush();
+
+        Counters.End(&Predicates[i]);
+
+        if ((i % 3) == 0) {
+            ++occluded;
+        }
+    }
+
+    for (UINT i = 0; i < Predicates.size(); ++i) {
+        //
+        // Skip the object when its bounding box had no visible pixel
+        //
+        Predication.Set(&Predicates[i], false, Hint);
+
+        Binner.Draw(objectVertices, 1000);
+    }
+
+    Predication.Set(NULL, false, false);
+
+    Binner.Flush();
+
+    return occluded;
+}
+
+void PerfCounterTests::TestPredicatedDraws ()
+{
+    HostPerfCounters counters;
+    RosUmdPredication predication;
+
+    const UINT numObjects = 48;
+
+    std::vector<RosUmdPerfCounterQuery> predicates(numObjects);
+
+    for (UINT i = 0; i < numObjects; ++i) {
+        counters.InitQuery(V3D_PCTRS_TLB_QUADS_Z_STENCIL_PASS, &predicates[i]);
+    }
+
+    //
+    // Predicates that aren't hints wait for their results, the draws of
+    // occluded objects never reach the binning control list
+    //
+    {
+        SimulatedBinner binner(counters, predication, 4);
+
+        const UINT skipsBefore = UINT(predication.GetSkipCount());
+        const UINT occluded = DrawOccludedScene(counters, predication, binner, predicates, false);
+
+        binner.Drain();
+
+        LogComment(
+            L"%u objects, %u occluded, %u binning packets, %u waits for a predicate",
+            numObjects,
+            occluded,
+            binner.Packets(),
+            binner.Waits());
+
+        VERIFY_ARE_EQUAL(numObjects + numObjects - occluded, binner.Packets());
+        VERIFY_ARE_EQUAL(occluded, UINT(predication.GetSkipCount()) - skipsBefore);
+        VERIFY_IS_TRUE(binner.Waits() > 0);
+    }
+
+    //
+    // With the GPU stalled hint predicates have no result yet, every object
+    // is drawn. Once the GPU caught up the same predicates skip the occluded
+    // objects.
+    //
+    {
+        SimulatedBinner binner(counters, predication, 0xFFFFFFFF);
+
+        const UINT skipsBefore = UINT(predication.GetSkipCount());
+        DrawOccludedScene(counters, predication, binner, predicates, true);
+
+        VERIFY_ARE_EQUAL(skipsBefore, UINT(predication.GetSkipCount()));
+
+        binner.Drain();
+
+        VERIFY_ARE_EQUAL(2 * numObjects, binner.Packets());
+        VERIFY_ARE_EQUAL(0u, binner.Waits());
+
+        UINT packets = binner.Packets();
+
+        for (UINT i = 0; i < numObjects; ++i) {
+            predication.Set(&predicates[i], false, true);
+            binner.Draw(3000, 1000);
+        }
+
+        predication.Set(NULL, false, false);
+
+        binner.Flush();
+        binner.Drain();
+
+        packets = binner.Packets() - packets;
+
+        LogComment(L"%u objects drawn under hint predicates that completed", packets);
+
+        VERIFY_ARE_EQUAL(numObjects - (numObjects + 2) / 3, packets);
+    }
+
+    //
+    // Predicates drawn with TRUE skip the visible objects instead
+    //
+    {
+        SimulatedBinner binner(counters, predication, 0);
+
+        for (UINT i = 0; i < numObjects; ++i) {
+            predication.Set(&predicates[i], true, false);
+            binner.Draw(3000, 1000);
+        }
+
+        predication.Set(NULL, false, false);
+
+        binner.Flush();
+
+        VERIFY_ARE_EQUAL((numObjects + 2) / 3, binner.Packets());
+    }
+
+    //
+    // A predicate that got no counter counts as visible, its object is drawn
+    //
+    {
+        SimulatedBinner binner(counters, predication, 0);
+
+        std::vector<RosUmdPerfCounterQuery> others(V3D_NUM_PERF_COUNTERS);
+
+        for (UINT i = 0; i < V3D_NUM_PERF_COUNTERS; ++i) {
+            counters.InitQuery(V3D_PCTRS_QPU_IDLE_CYCLES, &others[i]);
+            VERIFY_IS_TRUE(counters.Begin(&others[i]));
+        }
+
+        VERIFY_IS_FALSE(counters.Begin(&predicates[0]));
+        binner.Draw(36, 0);
+        binner.Flush();
+        counters.End(&predicates[0]);
+
+        for (UINT i = 0; i < V3D_NUM_PERF_COUNTERS; ++i) {
+            counters.DestroyQuery(&others[i]);
+        }
+
+        predication.Set(&predicates[0], false, false);
+        binner.Draw(3000, 1000);
+        predication.Set(NULL, false, false);
+        binner.Flush();
+
+        VERIFY_ARE_EQUAL(2u, binner.Packets());
+    }
+
+    for (UINT i = 0; i < numObjects; ++i) {
+        predication.Release(&predicates[i]);
+        counters.DestroyQuery(&predicates[i]);
+    }
+}
+
+void PerfCounterTests::TestTimestamps ()
+{
+    HostPerfCounters counters;
+    RosUmdPredication predication;
+    SimulatedBinner gpu(counters, predication, 5);
+
+    struct TIMESTAMP_RECORD {
+        RosUmdPerfCounterQuery Query;
+        UINT Id;
+        ULONGLONG Expected;
+    };
+
+    const UINT numQueries = 8;
+    const UINT numSteps = 10000;
+
+    std::vector<TIMESTAMP_RECORD> queries(numQueries);
+
+    for (UINT i = 0; i < numQueries; ++i) {
+        counters.InitTimestampQuery(&queries[i].Query);
+        queries[i].Id = 0;
+    }
+
+    UINT seed = 11;
+    UINT ends = 0;
+    UINT reads = 0;
+    ULONGLONG lastRead = 0;
+
+    for (UINT step = 0; step < numSteps; ++step) {
+        if (NextRandom(&seed) % 3) {
+            gpu.Draw(3, 1);
+            gpu.Flush();
+        } else {
+            TIMESTAMP_RECORD& record = queries[NextRandom(&seed) % numQueries];
+
+            VERIFY_IS_TRUE(counters.Timestamp(&record.Query));
+
+            record.Id = gpu.Timestamp(counters.GetReportOffset(record.Query));
+
+            //
+            // Taken once the DMA buffers submitted before it completed
+            //
+            record.Expected = (record.Id - 1) * SimulatedBinner::TicksPerDmaBuffer;
+
+            ++ends;
+        }
+
+        for (UINT i = 0; i < numQueries; ++i) {
+            if (queries[i].Id == 0) {
+                continue;
+            }
+
+            ULONGLONG value = 0;
+            const bool ready = counters.GetData(queries[i].Query, &value);
+
+            if (queries[i].Id > gpu.CompletedId()) {
+                VERIFY_IS_FALSE(ready, L"The timestamp command hasn't run");
+                continue;
+            }
+
+            VERIFY_IS_TRUE(ready);
+            VERIFY_ARE_EQUAL(queries[i].Expected, value);
+
+            lastRead = max(lastRead, value);
+            ++reads;
+        }
+    }
+
+    LogComment(L"%u timestamps ended, %u results read, last at tick %llu", ends, reads, lastRead);
+
+    gpu.Drain();
+
+    for (UINT i = 0; i < numQueries; ++i) {
+        counters.DestroyQuery(&queries[i].Query);
+    }
+
+    VERIFY_ARE_EQUAL(1u, counters.m_maps);
+}
@@ -0,0 +1,39 @@
+#ifndef _PERF_COUNTER_TESTS_H_
+#define _PERF_COUNTER_TESTS_H_
+
+//
+// Tests of the performance counter queries, and of the timestamp queries
+// and predication built on them. These run on the host, a simulated GPU
+// runs the DMA buffers and reports the counters the way the KMD does.
+//
+class PerfCounterTests {
+    BEGIN_TEST_CLASS(PerfCounterTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestOverlappingQueries)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Begins and ends counter queries at random across DMA buffers the simulated GPU completes late, and verifies each query reports the counts of exactly the DMA buffers it was active in once they have run.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestReportReuse)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Restarts queries while earlier DMA buffers still add to their reports, and verifies reports are only reused once those DMA buffers have run.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestPredicatedDraws)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Draws occluders and objects under their occlusion predicates, and verifies the draws of occluded objects emit no binning packets, hint predicates render while the result is pending and other predicates wait for it.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestTimestamps)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Ends timestamp queries between DMA buffers the simulated GPU completes late, and verifies each reports the completion time of the DMA buffers before it.")
+    END_TEST_METHOD()
+};
+
+#endif // _PERF_COUNTER_TESTS_H_
@@ -0,0 +1,264 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "QpuThreadingTests.h"
+
+#include "Vc4Validate.hpp"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+typedef std::vector<VC4_QPU_INSTRUCTION> QpuProgram;
+
+static VC4_QPU_INSTRUCTION QpuNop (UINT Sig = VC4_QPU_SIG_NO_SIGNAL)
+{
+    VC4_QPU_INSTRUCTION inst = 0;
+    VC4_QPU_SET_SIG(inst, Sig);
+    VC4_QPU_SET_WADDR_ADD(inst, VC4_QPU_WADDR_NOP);
+    VC4_QPU_SET_WADDR_MUL(inst, VC4_QPU_WADDR_NOP);
+    VC4_QPU_SET_RADDR_A(inst, VC4_QPU_RADDR_NOP);
+    VC4_QPU_SET_RADDR_B(inst, VC4_QPU_RADDR_NOP);
+    return inst;
+}
+
+//
+// fadd on the add pipe. WriteB selects register file B for a register file
+// destination, RAddrA/RAddrB are the register file reads for MuxA/MuxB.
+//
+static VC4_QPU_INSTRUCTION QpuFAdd (
+    UINT WAddr,
+    bool WriteB,
+    UINT MuxA,
+    UINT MuxB,
+    UINT RAddrA = VC4_QPU_RADDR_NOP,
+    UINT RAddrB = VC4_QPU_RADDR_NOP,
+    UINT Sig = VC4_QPU_SIG_NO_SIGNAL
+    )
+{
+    VC4_QPU_INSTRUCTION inst = QpuNop(Sig);
+    VC4_QPU_SET_COND_ADD(inst, VC4_QPU_COND_ALWAYS);
+    VC4_QPU_SET_WRITESWAP(inst, WriteB);
+    VC4_QPU_SET_WADDR_ADD(inst, WAddr);
+    VC4_QPU_SET_OPCODE_ADD(inst, VC4_QPU_OPCODE_ADD_FADD);
+    VC4_QPU_SET_ADD_A(inst, MuxA);
+    VC4_QPU_SET_ADD_B(inst, MuxB);
+    VC4_QPU_SET_RADDR_A(inst, RAddrA);
+    VC4_QPU_SET_RADDR_B(inst, RAddrB);
+    return inst;
+}
+
+//
+// Builds a fragment shader shaped like the compiler's output for a texture
+// sample: ALU work computing the coordinates, TMU request, thread switch
+// with its 2 delay slots, TMU result load, ALU work on the colour, and the
+// tile buffer write.
+//
+static QpuProgram BuildTexturingShader (
+    UINT PreTextureAlu,
+    UINT PostTextureAlu,
+    bool Threaded
+    )
+{
+    QpuProgram code;
+
+    for (UINT i = 0; i < PreTextureAlu; ++i) {
+        code.push_back(QpuFAdd(1, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 0));
+    }
+
+    code.push_back(QpuFAdd(VC4_QPU_WADDR_TMU0_T, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 1));
+    code.push_back(QpuFAdd(VC4_QPU_WADDR_TMU0_S, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 1));
+
+    code.push_back(QpuNop(Threaded ? VC4_QPU_SIG_LAST_THREAD_SWITCH : VC4_QPU_SIG_NO_SIGNAL));
+    code.push_back(QpuNop());
+    code.push_back(QpuNop());
+
+    code.push_back(QpuNop(VC4_QPU_SIG_LOAD_TMU0));
+    code.push_back(QpuFAdd(14, true, VC4_QPU_ALU_R4, VC4_QPU_ALU_R4));
+
+    for (UINT i = 0; i < PostTextureAlu; ++i) {
+        code.push_back(QpuFAdd(14, true, VC4_QPU_ALU_REG_B, VC4_QPU_ALU_REG_A, 0, 14));
+    }
+
+    code.push_back(QpuNop(VC4_QPU_SIG_WAIT_FOR_SCOREBOARD));
+    code.push_back(QpuFAdd(
+        VC4_QPU_WADDR_TLB_COLOUR_ALL,
+        false,
+        VC4_QPU_ALU_REG_B,
+        VC4_QPU_ALU_REG_B,
+        VC4_QPU_RADDR_NOP,
+        14,
+        VC4_QPU_SIG_PROGRAM_END));
+    code.push_back(QpuNop());
+    code.push_back(QpuNop(VC4_QPU_SIG_SCOREBOARD_UNBLOCK));
+
+    return code;
+}
+
+static bool Validate (const QpuProgram& Code, const wchar_t* Name)
+{
+    const TCHAR* error = nullptr;
+    bool valid = Vc4ThreadValidator::Validate(Code.data(), ULONG(Code.size()), &error) ? true : false;
+
+    LogComment(L"%s: %s", Name, valid ? L"valid" : error);
+
+    return valid;
+}
+
+void QpuThreadingTests::TestThreadValidator ()
+{
+    QpuProgram legal = BuildTexturingShader(4, 4, true);
+    VERIFY_IS_TRUE(Validate(legal, L"Threaded texturing shader"));
+
+    // Temp in the upper half of register file A
+    QpuProgram upperRegister = legal;
+    upperRegister[0] = QpuFAdd(20, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 0);
+    VERIFY_IS_FALSE(Validate(upperRegister, L"Write to ra20"));
+
+    QpuProgram upperRead = legal;
+    upperRead[0] = QpuFAdd(1, false, VC4_QPU_ALU_REG_B, VC4_QPU_ALU_REG_B, VC4_QPU_RADDR_NOP, 16);
+    VERIFY_IS_FALSE(Validate(upperRead, L"Read from rb16"));
+
+    // Accumulator written before the switch and read after it
+    QpuProgram accumulator = legal;
+    accumulator[0] = QpuFAdd(VC4_QPU_WADDR_ACC0, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 0);
+    accumulator.insert(
+        accumulator.end() - 4,
+        QpuFAdd(14, true, VC4_QPU_ALU_R0, VC4_QPU_ALU_R0));
+    VERIFY_IS_FALSE(Validate(accumulator, L"r0 live across thread switch"));
+
+    // Accumulators written after the switch are fine
+    QpuProgram accumulatorAfter = legal;
+    accumulatorAfter.insert(
+        accumulatorAfter.end() - 4,
+        QpuFAdd(VC4_QPU_WADDR_ACC0, false, VC4_QPU_ALU_REG_A, VC4_QPU_ALU_REG_A, 0));
+    accumulatorAfter.insert(
+        accumulatorAfter.end() - 4,
+        QpuFAdd(14, true, VC4_QPU_ALU_R0, VC4_QPU_ALU_R0));
+    VERIFY_IS_TRUE(Validate(accumulatorAfter, L"r0 written after thread switch"));
+
+    // Texture result read before it's loaded into r4 on this thread
+    QpuProgram r4 = legal;
+    for (VC4_QPU_INSTRUCTION& inst : r4) {
+        if (VC4_QPU_GET_SIG(inst) == VC4_QPU_SIG_LOAD_TMU0) {
+            VC4_QPU_SET_SIG(inst, VC4_QPU_SIG_NO_SIGNAL);
+        }
+    }
+    VERIFY_IS_FALSE(Validate(r4, L"r4 read without ldtmu0"));
+
+    // Every switch but the last must be a plain thread switch
+    QpuProgram noLastSwitch = BuildTexturingShader(4, 4, false);
+    VERIFY_IS_FALSE(Validate(noLastSwitch, L"No last thread switch"));
+
+    QpuProgram switchAfterLast = legal;
+    switchAfterLast.insert(switchAfterLast.end() - 4, QpuNop(VC4_QPU_SIG_THREAD_SWITCH));
+    VERIFY_IS_FALSE(Validate(switchAfterLast, L"Thread switch after last thread switch"));
+}
+
+//
+// Instruction timing model of one QPU. Every instruction issues in one
+// slot, a TMU result load stalls until the request issued by tmu0_s has
+// been serviced, and a thread switch hands the QPU to the other thread
+// after its 2 delay slots. Each program run shades 16 fragments.
+//
+static UINT64 SimulateFragments (
+    const QpuProgram& Code,
+    UINT Threads,
+    UINT TmuLatency,
+    UINT64 Cycles
+    )
+{
+    struct QPU_THREAD {
+        size_t Pc;
+        UINT64 TmuReady;
+        UINT SwitchIn;
+        UINT EndIn;
+    } threads[2] = {};
+
+    UINT64 fragments = 0;
+    UINT64 time = 0;
+    UINT current = 0;
+
+    while (time < Cycles) {
+        QPU_THREAD& thread = threads[current];
+        const VC4_QPU_INSTRUCTION inst = Code[thread.Pc++];
+        const UINT sig = UINT(VC4_QPU_GET_SIG(inst));
+
+        if ((sig == VC4_QPU_SIG_LOAD_TMU0) && (time < thread.TmuReady)) {
+            time = thread.TmuReady;
+        }
+
+        ++time;
+
+        if ((VC4_QPU_GET_WADDR_ADD(inst) == VC4_QPU_WADDR_TMU0_S) ||
+            (VC4_QPU_GET_WADDR_MUL(inst) == VC4_QPU_WADDR_TMU0_S)) {
+            thread.TmuReady = time + TmuLatency;
+        }
+
+        if ((sig == VC4_QPU_SIG_THREAD_SWITCH) || (sig == VC4_QPU_SIG_LAST_THREAD_SWITCH)) {
+            thread.SwitchIn = 3;
+        }
+
+        if (sig == VC4_QPU_SIG_PROGRAM_END) {
+            thread.EndIn = 3;
+        }
+
+        bool yield = false;
+
+        if (thread.SwitchIn && (--thread.SwitchIn == 0)) {
+            yield = true;
+        }
+
+        if (thread.EndIn && (--thread.EndIn == 0)) {
+            fragments += 16;
+            thread.Pc = 0;
+            yield = true;
+        }
+
+        if (yield && (Threads > 1)) {
+            current = (current + 1) % Threads;
+        }
+    }
+
+    return fragments;
+}
+
+void QpuThreadingTests::TestThreadedFragmentThroughput ()
+{
+    UINT tmuLatency = 40;
+    if (SUCCEEDED(RuntimeParameters::TryGetValue(L"TmuLatency", tmuLatency))) {
+        LogComment(L"Overriding default TMU latency with runtime parameter: %d", tmuLatency);
+    }
+
+    const UINT64 cycles = 1000000;
+
+    QpuProgram singleThreaded = BuildTexturingShader(4, 4, false);
+    QpuProgram threaded = BuildTexturingShader(4, 4, true);
+
+    VERIFY_ARE_EQUAL(singleThreaded.size(), threaded.size());
+    VERIFY_IS_TRUE(Validate(threaded, L"Threaded texturing shader"));
+
+    UINT64 singleFragments = SimulateFragments(singleThreaded, 1, tmuLatency, cycles);
+    UINT64 threadedFragments = SimulateFragments(threaded, 2, tmuLatency, cycles);
+
+    LogComment(
+        L"%u instruction shader, TMU latency %u: single threaded %.2f fragments/cycle, 2 threads %.2f fragments/cycle (%.2fx)",
+        UINT(threaded.size()),
+        tmuLatency,
+        double(singleFragments) / cycles,
+        double(threadedFragments) / cycles,
+        double(threadedFragments) / double(singleFragments));
+
+    VERIFY_IS_TRUE(threadedFragments > singleFragments);
+
+    // Without latency to hide the 2 threads just take turns
+    UINT64 singleNoLatency = SimulateFragments(singleThreaded, 1, 0, cycles);
+    UINT64 threadedNoLatency = SimulateFragments(threaded, 2, 0, cycles);
+
+    LogComment(
+        L"No TMU latency: single threaded %.2f fragments/cycle, 2 threads %.2f fragments/cycle",
+        double(singleNoLatency) / cycles,
+        double(threadedNoLatency) / cycles);
+
+    VERIFY_IS_TRUE(threadedNoLatency + 16 >= singleNoLatency);
+}
@@ -0,0 +1,27 @@
+#ifndef _QPU_THREADING_TESTS_H_
+#define _QPU_THREADING_TESTS_H_
+
+//
+// Tests of threaded fragment shader code: the validator the compiler runs
+// before clearing FragmentShaderIsSingleThreaded, and a QPU timing model
+// with texture fetch latency. These run on the host without a device.
+//
+class QpuThreadingTests {
+    BEGIN_TEST_CLASS(QpuThreadingTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestThreadValidator)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that register use which is illegal in threaded mode is rejected.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestThreadedFragmentThroughput)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Compares fragment throughput of single and 2 threaded texturing shaders with TMU latency modelled. Set TmuLatency to override.")
+    END_TEST_METHOD()
+};
+
+#endif // _QPU_THREADING_TESTS_H_
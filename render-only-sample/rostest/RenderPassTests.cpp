@@ -0,0 +1,1476 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "RenderPassTests.h"
+
+#include "RosRenderPass.h"
+#include "RosDepthOnly.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Command buffer of the UMD (RosUmdCommandBuffer.h), a page starting with
+// the header
+//
+const UINT COMMAND_BUFFER_SIZE = 4096;
+const UINT COMMAND_BUFFER_HEADER_SIZE = 128;
+const UINT COMMAND_BUFFER_FLUSH_THRESHOLD = 512;
+const UINT PATCH_LOCATION_LIST_SIZE = 128;
+const UINT PATCH_LOCATION_LIST_FLUSH_THRESHOLD = 2 + 16 + 8;
+
+//
+// Tile Binning Mode Config and Start Tile Binning before the first draw of
+// a DMA buffer, with the patches of the tile allocation memory, the tile
+// state data array and the render target
+//
+const UINT BINNING_PROLOG_SIZE = 17;
+const UINT BINNING_PROLOG_PATCHES = 3;
+const UINT BINNING_EPILOG_SIZE = 5;
+
+//
+// Draws of the Dolphin demo (demos/common/DolphinRender.cpp): full state,
+// shader records and uniforms of the sea floor and of the tweened dolphin,
+// then the glyph runs of the frame rate overlay
+//
+const UINT SEA_FLOOR_DRAW_SIZE = 320;
+const UINT SEA_FLOOR_DRAW_PATCHES = 12;
+const UINT DOLPHIN_DRAW_SIZE = 360;
+const UINT DOLPHIN_DRAW_PATCHES = 14;
+const UINT GLYPH_RUN_DRAW_SIZE = 180;
+const UINT GLYPH_RUN_DRAW_PATCHES = 8;
+const UINT OVERLAY_GLYPH_RUNS = 32;
+
+// 800x480 in 64x64 tiles
+const UINT TILE_PIXELS = 64;
+const UINT FRAME_WIDTH = 800;
+const UINT FRAME_HEIGHT = 480;
+const UINT WIDTH_IN_TILES = 13;
+const UINT HEIGHT_IN_TILES = 8;
+const UINT NUM_TILES = WIDTH_IN_TILES * HEIGHT_IN_TILES;
+
+const RosRenderPassTiles ALL_TILES = { 0, 0, WIDTH_IN_TILES, HEIGHT_IN_TILES };
+
+//
+// Addresses of the render targets
+//
+const UINT BACK_BUFFER = 0x10000000;
+const UINT DEPTH_BUFFER = 0x10200000;
+const UINT SHADOW_MAP = 0x10400000;
+
+//
+// Device context of the UMD flushing its command buffer. Before render
+// passes were merged it flushed whenever the render targets were bound
+// after a draw and the KMD rendered each DMA buffer on its own.
+//
+class ReplayedContext {
+public:
+    explicit ReplayedContext (bool MergePasses) :
+        m_mergePasses(MergePasses),
+        m_target(0),
+        m_depthStencil(0)
+    {
+        Reset();
+    }
+
+    void ClearRenderTargetView ()
+    {
+        if (m_hasDrawCall) {
+            FlushCommandBuffer();
+        }
+
+        m_clear = true;
+    }
+
+    void ClearDepthStencilView ()
+    {
+        if (m_hasDrawCall) {
+            FlushCommandBuffer();
+        }
+    }
+
+    void SetRenderTargets (UINT Target, UINT DepthStencil)
+    {
+        const bool sameTargets =
+            (Target == m_target) && (DepthStencil == m_depthStencil);
+
+        if (m_hasDrawCall && !(m_mergePasses && sameTargets)) {
+            FlushCommandBuffer();
+        }
+
+        m_target = Target;
+        m_depthStencil = DepthStencil;
+    }
+
+    void Draw (UINT CommandSize, UINT PatchLocations)
+    {
+        //
+        // The space of the binning prolog is reserved with every draw
+        //
+        if (((m_commandBufferPos + CommandSize + BINNING_PROLOG_SIZE + COMMAND_BUFFER_FLUSH_THRESHOLD) > COMMAND_BUFFER_SIZE) ||
+            ((m_patchLocationPos + PatchLocations + BINNING_PROLOG_PATCHES + PATCH_LOCATION_LIST_FLUSH_THRESHOLD) > PATCH_LOCATION_LIST_SIZE)) {
+            m_continues = m_mergePasses && m_binningStarted;
+            FlushCommandBuffer();
+        }
+
+        if (!m_binningStarted) {
+            m_commandBufferPos += BINNING_PROLOG_SIZE;
+            m_patchLocationPos += BINNING_PROLOG_PATCHES;
+            m_binningStarted = true;
+        }
+
+        m_commandBufferPos += CommandSize;
+        m_patchLocationPos += PatchLocations;
+        m_hasDrawCall = true;
+    }
+
+    // DdiFlush or Present
+    void Flush ()
+    {
+        FlushCommandBuffer();
+    }
+
+    const std::vector<RosRenderPassDmaBuf> & DmaBuffers () const
+    {
+        return m_dmaBuffers;
+    }
+
+private:
+    void FlushCommandBuffer ()
+    {
+        if (m_commandBufferPos == COMMAND_BUFFER_HEADER_SIZE) {
+            return;
+        }
+
+        m_commandBufferPos += BINNING_EPILOG_SIZE;
+        VERIFY_IS_TRUE(m_commandBufferPos <= COMMAND_BUFFER_SIZE);
+
+        RosRenderPassDmaBuf dmaBuf;
+        dmaBuf.m_renderTarget = m_target;
+        dmaBuf.m_widthInTiles = WIDTH_IN_TILES;
+        dmaBuf.m_heightInTiles = HEIGHT_IN_TILES;
+
+        //
+        // The sea floor covers the frame and the overlay is in every DMA
+        // buffer of it
+        //
+        dmaBuf.m_dirtyTiles = ALL_TILES;
+
+        dmaBuf.m_bClear = m_clear;
+        dmaBuf.m_bContinues = m_continues;
+        dmaBuf.m_bPerfCounters = false;
+        dmaBuf.m_bApertureBounce = false;
+
+        //
+        // The depth buffer of the demo is covered by TestDepthStencilPasses
+        //
+        dmaBuf.m_depthStencil = 0;
+        dmaBuf.m_clearDepthStencil = 0;
+        dmaBuf.m_bClearDepthStencil = false;
+        dmaBuf.m_bDepthStencilUsed = false;
+        dmaBuf.m_bDepthStencilWritten = false;
+        dmaBuf.m_bDiscardDepthStencil = false;
+
+        dmaBuf.m_bDepthOnly = false;
+
+        m_dmaBuffers.push_back(dmaBuf);
+
+        Reset();
+    }
+
+    void Reset ()
+    {
+        m_commandBufferPos = COMMAND_BUFFER_HEADER_SIZE;
+        m_patchLocationPos = 0;
+        m_clear = false;
+        m_continues = false;
+        m_binningStarted = false;
+        m_hasDrawCall = false;
+    }
+
+    const bool m_mergePasses;
+    UINT m_target;
+    UINT m_depthStencil;
+
+    UINT m_commandBufferPos;
+    UINT m_patchLocationPos;
+    bool m_clear;
+    bool m_continues;
+    bool m_binningStarted;
+    bool m_hasDrawCall;
+
+    std::vector<RosRenderPassDmaBuf> m_dmaBuffers;
+};
+
+//
+// RenderDolphin() and the frame rate overlay, each of its glyph runs binds
+// the render targets again
+//
+static void ReplayDolphinFrame (ReplayedContext & Context)
+{
+    Context.ClearRenderTargetView();
+    Context.ClearDepthStencilView();
+    Context.SetRenderTargets(BACK_BUFFER, DEPTH_BUFFER);
+
+    Context.Draw(SEA_FLOOR_DRAW_SIZE, SEA_FLOOR_DRAW_PATCHES);
+    Context.Draw(DOLPHIN_DRAW_SIZE, DOLPHIN_DRAW_PATCHES);
+
+    for (UINT i = 0; i < OVERLAY_GLYPH_RUNS; ++i) {
+        Context.SetRenderTargets(BACK_BUFFER, DEPTH_BUFFER);
+        Context.Draw(GLYPH_RUN_DRAW_SIZE, GLYPH_RUN_DRAW_PATCHES);
+    }
+
+    // Present
+    Context.Flush();
+}
+
+//
+// Worker thread of the KMD. The DMA buffers of the frame are submitted
+// faster than the GPU renders them, the pass held at the end of the frame
+// is submitted once the GPU would idle.
+//
+static void SubmitDmaBuffers (
+    RosRenderPass & Pass,
+    const std::vector<RosRenderPassDmaBuf> & DmaBuffers)
+{
+    for (const RosRenderPassDmaBuf & dmaBuf : DmaBuffers) {
+        if (Pass.GetCount() && !Pass.CanAppend(dmaBuf)) {
+            Pass.Close();
+        }
+
+        if (!Pass.Add(dmaBuf)) {
+            Pass.Close();
+        }
+    }
+
+    if (Pass.GetCount()) {
+        Pass.Close();
+    }
+}
+
+void RenderPassTests::TestReplayedFrame ()
+{
+    //
+    // Each DMA buffer used to be a pass of its own
+    //
+    ReplayedContext unmergedContext(false);
+    ReplayDolphinFrame(unmergedContext);
+
+    RosRenderPass unmerged;
+    SubmitDmaBuffers(unmerged, unmergedContext.DmaBuffers());
+
+    const UINT unmergedDmaBuffers = UINT(unmergedContext.DmaBuffers().size());
+
+    LogComment(
+        L"Unmerged: %u DMA buffers, %u passes, %u tile loads, %u tile stores",
+        unmergedDmaBuffers,
+        UINT(unmerged.GetPassCount()),
+        UINT(unmerged.GetTileLoads()),
+        UINT(unmerged.GetTileStores()));
+
+    VERIFY_ARE_EQUAL(OVERLAY_GLYPH_RUNS + 1, unmergedDmaBuffers);
+    VERIFY_ARE_EQUAL(ULONGLONG(unmergedDmaBuffers), unmerged.GetPassCount());
+    VERIFY_ARE_EQUAL(ULONGLONG(OVERLAY_GLYPH_RUNS * NUM_TILES), unmerged.GetTileLoads());
+    VERIFY_ARE_EQUAL(ULONGLONG(unmergedDmaBuffers * NUM_TILES), unmerged.GetTileStores());
+
+    //
+    // Binding the same targets again continues the pass, the DMA buffers
+    // flushed when the command buffer is full are chained
+    //
+    ReplayedContext mergedContext(true);
+    ReplayDolphinFrame(mergedContext);
+
+    RosRenderPass merged;
+    SubmitDmaBuffers(merged, mergedContext.DmaBuffers());
+
+    const UINT mergedDmaBuffers = UINT(mergedContext.DmaBuffers().size());
+
+    LogComment(
+        L"Merged: %u DMA buffers, %u passes, %u tile loads, %u tile stores",
+        mergedDmaBuffers,
+        UINT(merged.GetPassCount()),
+        UINT(merged.GetTileLoads()),
+        UINT(merged.GetTileStores()));
+
+    VERIFY_IS_TRUE(mergedDmaBuffers > 1);
+    VERIFY_IS_TRUE(mergedDmaBuffers <= RosRenderPass::kMaxDmaBuffers);
+    VERIFY_ARE_EQUAL(1ull, merged.GetPassCount());
+    VERIFY_ARE_EQUAL(ULONGLONG(mergedDmaBuffers - 1), merged.GetMergedCount());
+    VERIFY_ARE_EQUAL(0ull, merged.GetTileLoads());
+    VERIFY_ARE_EQUAL(ULONGLONG(NUM_TILES), merged.GetTileStores());
+
+    //
+    // Only the last DMA buffer of the frame doesn't continue the pass
+    //
+    for (UINT i = 0; i < mergedDmaBuffers; ++i) {
+        VERIFY_ARE_EQUAL(i + 1 < mergedDmaBuffers, mergedContext.DmaBuffers()[i].m_bContinues);
+        VERIFY_ARE_EQUAL(i == 0, mergedContext.DmaBuffers()[i].m_bClear);
+    }
+}
+
+void RenderPassTests::TestPassBoundaries ()
+{
+    RosRenderPassDmaBuf cleared = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, ALL_TILES, true, true, false, false };
+    RosRenderPassDmaBuf continued = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, ALL_TILES, false, true, false, false };
+    RosRenderPassDmaBuf last = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, ALL_TILES, false, false, false, false };
+
+    RosRenderPass pass;
+    ULONGLONG passes = 0;
+    ULONGLONG loads = 0;
+    ULONGLONG merges = 0;
+
+    //
+    // Held until the DMA buffer that doesn't continue it
+    //
+    VERIFY_IS_TRUE(pass.Add(cleared));
+    VERIFY_IS_TRUE(pass.CanAppend(continued));
+    VERIFY_IS_TRUE(pass.Add(continued));
+    VERIFY_IS_TRUE(pass.CanAppend(last));
+    VERIFY_IS_FALSE(pass.Add(last));
+    VERIFY_ARE_EQUAL(3u, pass.GetCount());
+    pass.Close();
+    ++passes;
+    merges += 2;
+
+    VERIFY_ARE_EQUAL(0u, pass.GetCount());
+    VERIFY_IS_FALSE(pass.CanAppend(continued));
+
+    //
+    // A clear starts a pass, the pass before it loaded the render target
+    //
+    VERIFY_IS_TRUE(pass.Add(continued));
+    VERIFY_IS_FALSE(pass.CanAppend(cleared));
+    pass.Close();
+    ++passes;
+    loads += NUM_TILES;
+
+    //
+    // So does another render target
+    //
+    VERIFY_IS_TRUE(pass.Add(cleared));
+    RosRenderPassDmaBuf shadowMap = continued;
+    shadowMap.m_renderTarget = SHADOW_MAP;
+    VERIFY_IS_FALSE(pass.CanAppend(shadowMap));
+    pass.Close();
+    ++passes;
+
+    //
+    // Aperture copies go to the slot of the first DMA buffer of the pass
+    //
+    RosRenderPassDmaBuf bounced = continued;
+    bounced.m_bApertureBounce = true;
+    VERIFY_IS_TRUE(pass.Add(bounced));
+    VERIFY_IS_TRUE(pass.CanAppend(continued));
+    VERIFY_IS_FALSE(pass.CanAppend(bounced));
+    VERIFY_IS_FALSE(pass.Add(last));
+    pass.Close();
+    ++passes;
+    ++merges;
+    loads += NUM_TILES;
+
+    //
+    // Counters are sampled around the whole pass, it isn't held
+    //
+    RosRenderPassDmaBuf sampled = cleared;
+    sampled.m_bPerfCounters = true;
+    VERIFY_IS_FALSE(pass.Add(sampled));
+    VERIFY_ARE_EQUAL(1u, pass.GetCount());
+    pass.Close();
+    ++passes;
+
+    VERIFY_IS_TRUE(pass.Add(continued));
+    sampled.m_bClear = false;
+    VERIFY_IS_FALSE(pass.CanAppend(sampled));
+    pass.Close();
+    ++passes;
+    loads += NUM_TILES;
+
+    //
+    // Longest chain
+    //
+    VERIFY_IS_TRUE(pass.Add(cleared));
+    for (UINT i = 2; i < RosRenderPass::kMaxDmaBuffers; ++i) {
+        VERIFY_IS_TRUE(pass.Add(continued));
+    }
+    VERIFY_IS_FALSE(pass.Add(continued));
+    VERIFY_ARE_EQUAL(RosRenderPass::kMaxDmaBuffers, pass.GetCount());
+    VERIFY_IS_FALSE(pass.CanAppend(last));
+    pass.Close();
+    ++passes;
+    merges += RosRenderPass::kMaxDmaBuffers - 1;
+
+    //
+    // The GPU would have idled, the held pass was submitted. The DMA buffer
+    // continuing it loads what it rendered.
+    //
+    VERIFY_IS_TRUE(pass.Add(cleared));
+    pass.Close();
+    ++passes;
+
+    VERIFY_IS_FALSE(pass.CanAppend(continued));
+    VERIFY_IS_FALSE(pass.Add(last));
+    pass.Close();
+    ++passes;
+    loads += NUM_TILES;
+
+    VERIFY_ARE_EQUAL(passes, pass.GetPassCount());
+    VERIFY_ARE_EQUAL(merges, pass.GetMergedCount());
+    VERIFY_ARE_EQUAL(loads, pass.GetTileLoads());
+    VERIFY_ARE_EQUAL(passes * NUM_TILES, pass.GetTileStores());
+}
+
+//
+// Depth stencil buffer of the UMD (Vc4Ddi.h), D24S8 is stored as S8Z24
+//
+const UINT DEPTH_MASK = 0xFFFFFF00;
+const UINT STENCIL_MASK = 0xFF;
+const UINT MAX_DEPTH = 0xFFFFFF;
+
+//
+// Model of the render target and of the depth stencil buffer, 2x2 pixels
+// for each 64x64 tile
+//
+const UINT MODEL_TILE_SIZE = 2;
+const UINT MODEL_WIDTH = 13 * MODEL_TILE_SIZE;
+const UINT MODEL_HEIGHT = 8 * MODEL_TILE_SIZE;
+const UINT MODEL_PIXELS = MODEL_WIDTH * MODEL_HEIGHT;
+
+//
+// What the tile buffer has of a depth stencil buffer that is neither
+// loaded nor cleared, no draw passes a depth test against it
+//
+const UINT UNDEFINED_DEPTH_STENCIL = 0;
+
+// What the tile buffer has of a render target that is neither loaded nor
+// cleared
+const UINT UNDEFINED_COLOR = 0xDEADBEEF;
+
+struct ModelDraw {
+    UINT m_left;
+    UINT m_top;
+    UINT m_right;
+    UINT m_bottom;
+    UINT m_depth;
+    UINT m_color;
+    bool m_bDepthTest;
+    bool m_bDepthWrite;
+    bool m_bDepthOnly;      // Writes no color
+};
+
+struct ModelDmaBuf {
+    RosRenderPassDmaBuf m_pass;
+    UINT m_clearColor;
+    std::vector<ModelDraw> m_draws;
+
+    //
+    // Software DMA buffer with a masked fill of the depth stencil buffer
+    //
+    bool m_bFill;
+    UINT m_fillMask;
+    UINT m_fillValue;
+};
+
+//
+// Device context of the UMD with a depth stencil buffer bound. Clears of
+// the depth stencil buffer are recorded until the next pass draws to it
+// (RosUmdDevice::ClearDepthStencilView), the command buffer is flushed
+// after a number of draws. TrackDirtyTiles records the tiles under the
+// draws, as the clip windows of the UMD, or else all the tiles.
+//
+class DepthTestedContext {
+public:
+    DepthTestedContext (UINT DrawsPerCommandBuffer, bool TrackDirtyTiles) :
+        m_drawsPerCommandBuffer(DrawsPerCommandBuffer),
+        m_trackDirtyTiles(TrackDirtyTiles),
+        m_bDepthUniform(true),
+        m_bStencilUniform(true),
+        m_uniformDepth(0),
+        m_uniformStencil(0)
+    {
+        Reset();
+    }
+
+    void ClearRenderTargetView (UINT Color)
+    {
+        if (!m_current.m_draws.empty()) {
+            FlushCommandBuffer();
+        }
+
+        m_current.m_pass.m_bClear = true;
+        m_current.m_clearColor = Color;
+    }
+
+    void ClearDepthStencilView (bool ClearDepth, bool ClearStencil, UINT Depth, UINT Stencil)
+    {
+        if (m_current.m_pass.m_depthStencil) {
+            FlushCommandBuffer();
+        }
+
+        UINT mask = 0;
+
+        if (ClearDepth) {
+            m_bDepthUniform = true;
+            m_uniformDepth = Depth;
+            mask |= DEPTH_MASK;
+        }
+
+        if (ClearStencil) {
+            m_bStencilUniform = true;
+            m_uniformStencil = Stencil;
+            mask |= STENCIL_MASK;
+        }
+
+        if (mask && !(m_bDepthUniform && m_bStencilUniform)) {
+            ModelDmaBuf fill = ModelDmaBuf();
+            fill.m_bFill = true;
+            fill.m_fillMask = mask;
+            fill.m_fillValue = ((Depth << 8) | Stencil) & mask;
+
+            m_dmaBuffers.push_back(fill);
+        }
+    }
+
+    void Discard ()
+    {
+        m_bDepthUniform = true;
+        m_bStencilUniform = true;
+
+        if (m_current.m_pass.m_depthStencil) {
+            m_current.m_pass.m_bDiscardDepthStencil = true;
+        }
+    }
+
+    void Draw (const ModelDraw & Draw)
+    {
+        if (m_current.m_draws.size() == m_drawsPerCommandBuffer) {
+            m_current.m_pass.m_bContinues = true;
+            FlushCommandBuffer();
+        }
+
+        //
+        // Binning prolog
+        //
+        if (m_current.m_draws.empty()) {
+            m_current.m_pass.m_depthStencil = DEPTH_BUFFER;
+
+            if (m_bDepthUniform && m_bStencilUniform) {
+                m_current.m_pass.m_bClearDepthStencil = true;
+                m_current.m_pass.m_clearDepthStencil = (m_uniformDepth << 8) | m_uniformStencil;
+            }
+
+            m_current.m_pass.m_bDepthOnly = true;
+        }
+
+        // RosUmdCommandBuffer::UseRenderTarget
+        m_current.m_pass.m_bDepthOnly &= Draw.m_bDepthOnly;
+
+        if (Draw.m_bDepthTest) {
+            m_current.m_pass.m_bDepthStencilUsed = true;
+
+            if (Draw.m_bDepthWrite) {
+                m_current.m_pass.m_bDepthStencilWritten = true;
+                m_current.m_pass.m_bDiscardDepthStencil = false;
+                m_bDepthUniform = false;
+            }
+        }
+
+        if (m_trackDirtyTiles) {
+            RosRenderPassTiles & tiles = m_current.m_pass.m_dirtyTiles;
+            const RosRenderPassTiles drawTiles = {
+                Draw.m_left / MODEL_TILE_SIZE,
+                Draw.m_top / MODEL_TILE_SIZE,
+                (Draw.m_right + MODEL_TILE_SIZE - 1) / MODEL_TILE_SIZE,
+                (Draw.m_bottom + MODEL_TILE_SIZE - 1) / MODEL_TILE_SIZE };
+
+            if (m_current.m_draws.empty()) {
+                tiles = drawTiles;
+            } else {
+                tiles.m_left = min(tiles.m_left, drawTiles.m_left);
+                tiles.m_top = min(tiles.m_top, drawTiles.m_top);
+                tiles.m_right = max(tiles.m_right, drawTiles.m_right);
+                tiles.m_bottom = max(tiles.m_bottom, drawTiles.m_bottom);
+            }
+        }
+
+        m_current.m_draws.push_back(Draw);
+    }
+
+    // Present
+    void Flush ()
+    {
+        FlushCommandBuffer();
+    }
+
+    // DMA buffers flushed since the last call
+    std::vector<ModelDmaBuf> TakeDmaBuffers ()
+    {
+        std::vector<ModelDmaBuf> dmaBuffers;
+        dmaBuffers.swap(m_dmaBuffers);
+
+        return dmaBuffers;
+    }
+
+private:
+    void FlushCommandBuffer ()
+    {
+        if (m_current.m_draws.empty()) {
+            return;
+        }
+
+        m_dmaBuffers.push_back(m_current);
+
+        Reset();
+    }
+
+    void Reset ()
+    {
+        m_current = ModelDmaBuf();
+        m_current.m_pass.m_renderTarget = BACK_BUFFER;
+        m_current.m_pass.m_widthInTiles = WIDTH_IN_TILES;
+        m_current.m_pass.m_heightInTiles = HEIGHT_IN_TILES;
+
+        if (!m_trackDirtyTiles) {
+            m_current.m_pass.m_dirtyTiles = ALL_TILES;
+        }
+    }
+
+    const UINT m_drawsPerCommandBuffer;
+    const bool m_trackDirtyTiles;
+
+    bool m_bDepthUniform;
+    bool m_bStencilUniform;
+    UINT m_uniformDepth;
+    UINT m_uniformStencil;
+
+    ModelDmaBuf m_current;
+    std::vector<ModelDmaBuf> m_dmaBuffers;
+};
+
+//
+// Memory of the render target and of the depth stencil buffer, rendered
+// through the tile buffer the way the Rendering Control List of the KMD
+// loads, clears and stores it
+//
+struct ModelMemory {
+    UINT m_color[MODEL_PIXELS];
+    UINT m_depthStencil[MODEL_PIXELS];
+};
+
+static void RenderModelPass (
+    ModelMemory & Memory,
+    const std::vector<const ModelDmaBuf *> & Pass,
+    bool LoadsColor,
+    bool StoresColor,
+    bool LoadsDepthStencil,
+    bool StoresDepthStencil,
+    const RosRenderPassTiles & Tiles)
+{
+    const ModelDmaBuf & first = *Pass.front();
+
+    VERIFY_IS_TRUE(!LoadsColor || !first.m_pass.m_bClear);
+
+    for (UINT y = Tiles.m_top * MODEL_TILE_SIZE; y < Tiles.m_bottom * MODEL_TILE_SIZE; ++y) {
+        for (UINT x = Tiles.m_left * MODEL_TILE_SIZE; x < Tiles.m_right * MODEL_TILE_SIZE; ++x) {
+            const UINT pixel = y * MODEL_WIDTH + x;
+
+            UINT color = UNDEFINED_COLOR;
+            if (first.m_pass.m_bClear) {
+                color = first.m_clearColor;
+            } else if (LoadsColor) {
+                color = Memory.m_color[pixel];
+            }
+
+            UINT depthStencil = UNDEFINED_DEPTH_STENCIL;
+            if (LoadsDepthStencil) {
+                depthStencil = Memory.m_depthStencil[pixel];
+            } else if (first.m_pass.m_bClearDepthStencil) {
+                depthStencil = first.m_pass.m_clearDepthStencil;
+            }
+
+            for (const ModelDmaBuf * pDmaBuf : Pass) {
+                for (const ModelDraw & draw : pDmaBuf->m_draws) {
+                    if ((x < draw.m_left) || (x >= draw.m_right) ||
+                        (y < draw.m_top) || (y >= draw.m_bottom)) {
+                        continue;
+                    }
+
+                    // D3D11_COMPARISON_LESS
+                    if (draw.m_bDepthTest && !(draw.m_depth < (depthStencil >> 8))) {
+                        continue;
+                    }
+
+                    if (!draw.m_bDepthOnly) {
+                        color = draw.m_color;
+                    }
+
+                    if (draw.m_bDepthTest && draw.m_bDepthWrite) {
+                        depthStencil = (draw.m_depth << 8) | (depthStencil & STENCIL_MASK);
+                    }
+                }
+            }
+
+            if (StoresColor) {
+                Memory.m_color[pixel] = color;
+            }
+
+            if (StoresDepthStencil) {
+                Memory.m_depthStencil[pixel] = depthStencil;
+            }
+        }
+    }
+}
+
+//
+// Worker thread of the KMD as in SubmitDmaBuffers(). SplitPasses submits
+// every DMA buffer as a pass of its own, as when the GPU would idle.
+//
+static void RenderModelDmaBuffers (
+    ModelMemory & Memory,
+    RosRenderPass & Pass,
+    const std::vector<ModelDmaBuf> & DmaBuffers,
+    bool SplitPasses)
+{
+    std::vector<const ModelDmaBuf *> held;
+
+    auto submit = [&] () {
+        RenderModelPass(
+            Memory,
+            held,
+            Pass.LoadsColor(),
+            Pass.StoresColor(),
+            Pass.LoadsDepthStencil(),
+            Pass.StoresDepthStencil(),
+            Pass.GetDirtyTiles());
+        Pass.Close();
+        held.clear();
+    };
+
+    for (const ModelDmaBuf & dmaBuf : DmaBuffers) {
+        if (dmaBuf.m_bFill) {
+            if (Pass.GetCount()) {
+                submit();
+            }
+
+            for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+                Memory.m_depthStencil[i] =
+                    (Memory.m_depthStencil[i] & ~dmaBuf.m_fillMask) | dmaBuf.m_fillValue;
+            }
+
+            continue;
+        }
+
+        if (Pass.GetCount() && !Pass.CanAppend(dmaBuf.m_pass)) {
+            submit();
+        }
+
+        held.push_back(&dmaBuf);
+
+        if (!Pass.Add(dmaBuf.m_pass) || SplitPasses) {
+            submit();
+        }
+    }
+
+    if (Pass.GetCount()) {
+        submit();
+    }
+}
+
+static ModelDraw RandomDraw (UINT & Seed, bool DepthTest, bool DepthWrite)
+{
+    auto next = [&Seed] (UINT Range) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 16) % Range;
+    };
+
+    ModelDraw draw;
+    draw.m_left = next(MODEL_WIDTH);
+    draw.m_top = next(MODEL_HEIGHT);
+    draw.m_right = draw.m_left + 1 + next(MODEL_WIDTH - draw.m_left);
+    draw.m_bottom = draw.m_top + 1 + next(MODEL_HEIGHT - draw.m_top);
+    draw.m_depth = next(MAX_DEPTH);
+    draw.m_color = 0xFF000000 | (next(0x10000) << 8) | next(0x100);
+    draw.m_bDepthTest = DepthTest;
+    draw.m_bDepthWrite = DepthWrite;
+    draw.m_bDepthOnly = false;
+
+    return draw;
+}
+
+//
+// Snapshots of the memory after each frame of the scene
+//
+struct ModelFrames {
+    std::vector<ModelMemory> m_frames;
+    ULONGLONG m_depthStencilLoadBytes;
+    ULONGLONG m_depthStencilStoreBytes;
+    ULONGLONG m_passes;
+    ULONGLONG m_tileLoads;
+    ULONGLONG m_tileStores;
+    ULONGLONG m_depthOnlyPasses;
+};
+
+//
+// Frames of a depth tested scene: a stencil only clear after draws wrote
+// depth, draws testing against the depth of the frame before and
+// discarding it, a clear and a clear only tested against
+//
+static ModelFrames RenderDepthTestedScene (UINT DrawsPerCommandBuffer, bool SplitPasses, bool TrackDirtyTiles)
+{
+    const UINT NUM_FRAMES = 4;
+
+    ModelMemory memory;
+    for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+        memory.m_color[i] = 0;
+        memory.m_depthStencil[i] = 0;
+    }
+
+    DepthTestedContext context(DrawsPerCommandBuffer, TrackDirtyTiles);
+    RosRenderPass pass;
+    ModelFrames result = ModelFrames();
+    UINT seed = 42;
+
+    for (UINT frame = 0; frame < NUM_FRAMES; ++frame) {
+        switch (frame) {
+        case 0:
+            context.ClearRenderTargetView(0xFF000000);
+            context.ClearDepthStencilView(true, true, MAX_DEPTH, 0);
+            for (UINT i = 0; i < 8; ++i) {
+                context.Draw(RandomDraw(seed, true, true));
+            }
+            context.ClearDepthStencilView(false, true, 0, 0x5A);
+            for (UINT i = 0; i < 4; ++i) {
+                context.Draw(RandomDraw(seed, true, true));
+            }
+            for (UINT i = 0; i < 2; ++i) {
+                context.Draw(RandomDraw(seed, true, false));
+            }
+            break;
+        case 1:
+            context.ClearRenderTargetView(0xFF202020);
+            for (UINT i = 0; i < 4; ++i) {
+                context.Draw(RandomDraw(seed, true, false));
+            }
+            for (UINT i = 0; i < 2; ++i) {
+                context.Draw(RandomDraw(seed, true, true));
+            }
+            context.Discard();
+            break;
+        case 2:
+            context.ClearRenderTargetView(0xFF404040);
+            context.ClearDepthStencilView(true, true, MAX_DEPTH / 2, 1);
+            for (UINT i = 0; i < 6; ++i) {
+                context.Draw(RandomDraw(seed, true, true));
+            }
+            context.Draw(RandomDraw(seed, false, false));
+            break;
+        case 3:
+            context.ClearRenderTargetView(0xFF606060);
+            context.ClearDepthStencilView(true, true, MAX_DEPTH, 0);
+            for (UINT i = 0; i < 5; ++i) {
+                context.Draw(RandomDraw(seed, true, false));
+            }
+            break;
+        }
+
+        context.Flush();
+
+        RenderModelDmaBuffers(memory, pass, context.TakeDmaBuffers(), SplitPasses);
+
+        result.m_frames.push_back(memory);
+    }
+
+    result.m_depthStencilLoadBytes = pass.GetDepthStencilLoadBytes();
+    result.m_depthStencilStoreBytes = pass.GetDepthStencilStoreBytes();
+    result.m_passes = pass.GetPassCount();
+    result.m_tileStores = pass.GetTileStores();
+
+    return result;
+}
+
+void RenderPassTests::TestDepthStencilPasses ()
+{
+    const ULONGLONG passBytes = ULONGLONG(NUM_TILES) * RosRenderPass::kTileDepthStencilBytes;
+
+    ModelFrames single = RenderDepthTestedScene(64, false, false);
+    ModelFrames merged = RenderDepthTestedScene(3, false, false);
+    ModelFrames split = RenderDepthTestedScene(3, true, false);
+
+    LogComment(
+        L"Single DMA buffer: %u passes, %u bytes of depth stencil loaded, %u bytes stored",
+        UINT(single.m_passes),
+        UINT(single.m_depthStencilLoadBytes),
+        UINT(single.m_depthStencilStoreBytes));
+    LogComment(
+        L"Merged: %u passes, %u bytes of depth stencil loaded, %u bytes stored",
+        UINT(merged.m_passes),
+        UINT(merged.m_depthStencilLoadBytes),
+        UINT(merged.m_depthStencilStoreBytes));
+    LogComment(
+        L"Split: %u passes, %u bytes of depth stencil loaded, %u bytes stored",
+        UINT(split.m_passes),
+        UINT(split.m_depthStencilLoadBytes),
+        UINT(split.m_depthStencilStoreBytes));
+
+    //
+    // Frame 0 stores the cleared pass and loads it again after the stencil
+    // fill, frame 1 loads and discards it, frame 2 only stores the clear
+    // and frame 3 only tests against a clear
+    //
+    VERIFY_ARE_EQUAL(5ull, single.m_passes);
+    VERIFY_ARE_EQUAL(2 * passBytes, single.m_depthStencilLoadBytes);
+    VERIFY_ARE_EQUAL(3 * passBytes, single.m_depthStencilStoreBytes);
+
+    VERIFY_ARE_EQUAL(single.m_passes, merged.m_passes);
+    VERIFY_ARE_EQUAL(single.m_depthStencilLoadBytes, merged.m_depthStencilLoadBytes);
+    VERIFY_ARE_EQUAL(single.m_depthStencilStoreBytes, merged.m_depthStencilStoreBytes);
+
+    VERIFY_IS_TRUE(split.m_passes > merged.m_passes);
+    VERIFY_IS_TRUE(split.m_depthStencilLoadBytes > merged.m_depthStencilLoadBytes);
+    VERIFY_IS_TRUE(split.m_depthStencilStoreBytes > merged.m_depthStencilStoreBytes);
+
+    //
+    // The same images however the frames are split into passes. The depth
+    // stencil buffer is undefined after the discard of frame 1 and only
+    // compared after frames 0 and 2.
+    //
+    for (UINT frame = 0; frame < single.m_frames.size(); ++frame) {
+        const ModelMemory & expected = single.m_frames[frame];
+
+        for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+            VERIFY_ARE_EQUAL(expected.m_color[i], merged.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(expected.m_color[i], split.m_frames[frame].m_color[i]);
+
+            if ((frame == 0) || (frame == 2)) {
+                VERIFY_ARE_EQUAL(expected.m_depthStencil[i], merged.m_frames[frame].m_depthStencil[i]);
+                VERIFY_ARE_EQUAL(expected.m_depthStencil[i], split.m_frames[frame].m_depthStencil[i]);
+            }
+        }
+    }
+
+    //
+    // The stencil only clear was filled into memory under the depth the
+    // draws wrote
+    //
+    for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+        VERIFY_ARE_EQUAL(0x5Au, single.m_frames[0].m_depthStencil[i] & STENCIL_MASK);
+        VERIFY_ARE_EQUAL(1u, single.m_frames[2].m_depthStencil[i] & STENCIL_MASK);
+    }
+
+    //
+    // Frame 3 neither loads nor stores the depth stencil buffer
+    //
+    for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+        VERIFY_ARE_EQUAL(single.m_frames[2].m_depthStencil[i], single.m_frames[3].m_depthStencil[i]);
+    }
+}
+
+//
+// Frames of a user interface updated in place: a cleared frame, then small
+// draws without a clear, as a cursor, a caret or a widget, and a depth
+// tested widget over a cleared depth stencil buffer
+//
+static ModelFrames RenderUpdatedScene (bool TrackDirtyTiles)
+{
+    const UINT NUM_FRAMES = 8;
+
+    ModelMemory memory;
+    for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+        memory.m_color[i] = 0;
+        memory.m_depthStencil[i] = 0;
+    }
+
+    DepthTestedContext context(3, TrackDirtyTiles);
+    RosRenderPass pass;
+    ModelFrames result = ModelFrames();
+    UINT seed = 7;
+
+    auto next = [&seed] (UINT Range) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % Range;
+    };
+
+    for (UINT frame = 0; frame < NUM_FRAMES; ++frame) {
+        if (frame == 0) {
+            context.ClearRenderTargetView(0xFF000000);
+            context.Draw(RandomDraw(seed, false, false));
+        } else if (frame == NUM_FRAMES - 1) {
+            context.ClearDepthStencilView(true, true, MAX_DEPTH, 0);
+            for (UINT i = 0; i < 2; ++i) {
+                ModelDraw draw = RandomDraw(seed, true, true);
+                draw.m_right = min(draw.m_left + 3, draw.m_right);
+                draw.m_bottom = min(draw.m_top + 3, draw.m_bottom);
+                context.Draw(draw);
+            }
+        } else {
+            for (UINT i = 0; i < 1 + next(4); ++i) {
+                ModelDraw draw = RandomDraw(seed, false, false);
+                draw.m_right = min(draw.m_left + 1 + next(3), draw.m_right);
+                draw.m_bottom = min(draw.m_top + 1 + next(3), draw.m_bottom);
+                context.Draw(draw);
+            }
+        }
+
+        context.Flush();
+
+        RenderModelDmaBuffers(memory, pass, context.TakeDmaBuffers(), false);
+
+        result.m_frames.push_back(memory);
+    }
+
+    result.m_depthStencilLoadBytes = pass.GetDepthStencilLoadBytes();
+    result.m_depthStencilStoreBytes = pass.GetDepthStencilStoreBytes();
+    result.m_passes = pass.GetPassCount();
+    result.m_tileStores = pass.GetTileStores();
+
+    return result;
+}
+
+//
+// Tiles of the Rendering Control List under pixels of the render target,
+// as the KMD converts the dirty rectangle of the UMD
+//
+static RosRenderPassTiles TilesUnder (UINT Left, UINT Top, UINT Right, UINT Bottom)
+{
+    RosRenderPassTiles tiles = {
+        Left / TILE_PIXELS,
+        Top / TILE_PIXELS,
+        (Right + TILE_PIXELS - 1) / TILE_PIXELS,
+        (Bottom + TILE_PIXELS - 1) / TILE_PIXELS };
+
+    return tiles;
+}
+
+void RenderPassTests::TestDirtyTiles ()
+{
+    //
+    // Small updates of the back buffer, each a DMA buffer of its own
+    //
+    struct Update {
+        const wchar_t * m_name;
+        UINT m_left;
+        UINT m_top;
+        UINT m_width;
+        UINT m_height;
+        UINT m_tiles;
+    };
+
+    const Update updates[] = {
+        { L"cursor", 500, 300, 32, 32, 4 },
+        { L"text caret", 130, 70, 2, 18, 1 },
+        { L"widget", 300, 420, 200, 40, 8 },
+        { L"full frame", 0, 0, FRAME_WIDTH, FRAME_HEIGHT, NUM_TILES },
+    };
+
+    RosRenderPass pass;
+    ULONGLONG stores = 0;
+
+    for (const Update & update : updates) {
+        RosRenderPassDmaBuf dmaBuf = {
+            BACK_BUFFER,
+            WIDTH_IN_TILES,
+            HEIGHT_IN_TILES,
+            TilesUnder(update.m_left, update.m_top, update.m_left + update.m_width, update.m_top + update.m_height) };
+
+        VERIFY_IS_FALSE(pass.Add(dmaBuf));
+        VERIFY_ARE_EQUAL(update.m_tiles, pass.GetDirtyTiles().GetCount());
+        pass.Close();
+
+        LogComment(
+            L"%s %ux%u at (%u, %u): %u of %u tiles rendered",
+            update.m_name,
+            update.m_width,
+            update.m_height,
+            update.m_left,
+            update.m_top,
+            UINT(pass.GetTileStores() - stores),
+            NUM_TILES);
+
+        VERIFY_ARE_EQUAL(ULONGLONG(update.m_tiles), pass.GetTileStores() - stores);
+        VERIFY_ARE_EQUAL(pass.GetTileStores(), pass.GetTileLoads());
+        stores = pass.GetTileStores();
+    }
+
+    //
+    // The DMA buffers of a pass render the tiles around all their draws, the
+    // window of the pass is clipped to the render target
+    //
+    RosRenderPassDmaBuf cursor = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, TilesUnder(500, 300, 532, 332), false, true };
+    RosRenderPassDmaBuf caret = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, TilesUnder(130, 70, 132, 88) };
+    RosRenderPassDmaBuf offscreen = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, TilesUnder(780, 460, 2000, 2000) };
+
+    VERIFY_IS_TRUE(pass.Add(cursor));
+    VERIFY_IS_FALSE(pass.Add(caret));
+    VERIFY_ARE_EQUAL(7u * 5u, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    VERIFY_IS_FALSE(pass.Add(offscreen));
+    VERIFY_ARE_EQUAL(WIDTH_IN_TILES, pass.GetDirtyTiles().m_right);
+    VERIFY_ARE_EQUAL(HEIGHT_IN_TILES, pass.GetDirtyTiles().m_bottom);
+    VERIFY_ARE_EQUAL(1u, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    //
+    // Nothing drawn still renders a tile to end the frame, a clear renders
+    // them all
+    //
+    RosRenderPassDmaBuf empty = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES };
+    VERIFY_IS_FALSE(pass.Add(empty));
+    VERIFY_ARE_EQUAL(1u, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    RosRenderPassDmaBuf cleared = caret;
+    cleared.m_bClear = true;
+    VERIFY_IS_FALSE(pass.Add(cleared));
+    VERIFY_ARE_EQUAL(NUM_TILES, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    //
+    // So does a stored depth stencil buffer the pass clears, not one only
+    // tested against
+    //
+    RosRenderPassDmaBuf depthCleared = caret;
+    depthCleared.m_depthStencil = DEPTH_BUFFER;
+    depthCleared.m_bClearDepthStencil = true;
+    depthCleared.m_bDepthStencilUsed = true;
+    VERIFY_IS_FALSE(pass.Add(depthCleared));
+    VERIFY_ARE_EQUAL(1u, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    depthCleared.m_bDepthStencilWritten = true;
+    VERIFY_IS_FALSE(pass.Add(depthCleared));
+    VERIFY_ARE_EQUAL(NUM_TILES, pass.GetDirtyTiles().GetCount());
+    pass.Close();
+
+    //
+    // The same images as rendering every tile, with the depth stencil
+    // buffer loaded and stored around the draws only
+    //
+    ModelFrames depthTested = RenderDepthTestedScene(3, false, false);
+    ModelFrames depthTestedDirty = RenderDepthTestedScene(3, false, true);
+    ModelFrames updated = RenderUpdatedScene(false);
+    ModelFrames updatedDirty = RenderUpdatedScene(true);
+
+    LogComment(
+        L"Depth tested scene: %u tiles rendered, %u rendering all tiles",
+        UINT(depthTestedDirty.m_tileStores),
+        UINT(depthTested.m_tileStores));
+    LogComment(
+        L"Updated scene: %u tiles rendered, %u rendering all tiles",
+        UINT(updatedDirty.m_tileStores),
+        UINT(updated.m_tileStores));
+
+    VERIFY_IS_TRUE(depthTestedDirty.m_tileStores <= depthTested.m_tileStores);
+    VERIFY_IS_TRUE(updatedDirty.m_tileStores * 2 < updated.m_tileStores);
+
+    for (UINT frame = 0; frame < depthTested.m_frames.size(); ++frame) {
+        for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+            VERIFY_ARE_EQUAL(depthTested.m_frames[frame].m_color[i], depthTestedDirty.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(depthTested.m_frames[frame].m_depthStencil[i], depthTestedDirty.m_frames[frame].m_depthStencil[i]);
+        }
+    }
+
+    for (UINT frame = 0; frame < updated.m_frames.size(); ++frame) {
+        for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+            VERIFY_ARE_EQUAL(updated.m_frames[frame].m_color[i], updatedDirty.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(updated.m_frames[frame].m_depthStencil[i], updatedDirty.m_frames[frame].m_depthStencil[i]);
+        }
+    }
+}
+
+//
+// Frames of a scene with depth-only draws: a Z-prepass flushed before the
+// color draws testing against it, a depth-only pass updating the depth
+// stencil buffer without a clear of the render target, then depth-only
+// and color draws in one pass. Without FastPath the KMD loads and stores
+// the render target around the depth-only draws as around any other.
+//
+static ModelFrames RenderDepthOnlyScene (UINT DrawsPerCommandBuffer, bool SplitPasses, bool FastPath)
+{
+    const UINT NUM_FRAMES = 3;
+
+    ModelMemory memory;
+    for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+        memory.m_color[i] = 0;
+        memory.m_depthStencil[i] = 0;
+    }
+
+    DepthTestedContext context(DrawsPerCommandBuffer, false);
+    RosRenderPass pass;
+    ModelFrames result = ModelFrames();
+    UINT seed = 11;
+
+    auto drawDepthOnly = [&] (UINT Count) {
+        for (UINT i = 0; i < Count; ++i) {
+            ModelDraw draw = RandomDraw(seed, true, true);
+            draw.m_bDepthOnly = true;
+            context.Draw(draw);
+        }
+    };
+
+    auto drawColor = [&] (UINT Count, bool DepthTest) {
+        for (UINT i = 0; i < Count; ++i) {
+            context.Draw(RandomDraw(seed, DepthTest, false));
+        }
+    };
+
+    for (UINT frame = 0; frame < NUM_FRAMES; ++frame) {
+        switch (frame) {
+        case 0:
+            context.ClearRenderTargetView(0xFF000000);
+            context.ClearDepthStencilView(true, true, MAX_DEPTH, 0);
+            drawDepthOnly(6);
+            context.Flush();
+            drawColor(4, true);
+            break;
+        case 1:
+            context.ClearDepthStencilView(true, true, MAX_DEPTH, 0);
+            drawDepthOnly(5);
+            context.Flush();
+            drawColor(3, false);
+            break;
+        case 2:
+            drawDepthOnly(3);
+            drawColor(3, true);
+            break;
+        }
+
+        context.Flush();
+
+        std::vector<ModelDmaBuf> dmaBuffers = context.TakeDmaBuffers();
+
+        if (!FastPath) {
+            for (ModelDmaBuf & dmaBuf : dmaBuffers) {
+                dmaBuf.m_pass.m_bDepthOnly = false;
+            }
+        }
+
+        RenderModelDmaBuffers(memory, pass, dmaBuffers, SplitPasses);
+
+        result.m_frames.push_back(memory);
+    }
+
+    result.m_depthStencilLoadBytes = pass.GetDepthStencilLoadBytes();
+    result.m_depthStencilStoreBytes = pass.GetDepthStencilStoreBytes();
+    result.m_passes = pass.GetPassCount();
+    result.m_tileLoads = pass.GetTileLoads();
+    result.m_tileStores = pass.GetTileStores();
+    result.m_depthOnlyPasses = pass.GetDepthOnlyCount();
+
+    return result;
+}
+
+void RenderPassTests::TestDepthOnlyPasses ()
+{
+    //
+    // Draws without a render target or with color writes masked off are
+    // depth-only, the trivial fragment shader only replaces pixel shaders
+    // that neither discard nor write oDepth
+    //
+    VERIFY_IS_TRUE(RosDepthOnly::IsDepthOnly(false, 0xF));
+    VERIFY_IS_TRUE(RosDepthOnly::IsDepthOnly(true, 0));
+    VERIFY_IS_FALSE(RosDepthOnly::IsDepthOnly(true, 0x8));
+
+    VERIFY_IS_TRUE(RosDepthOnly::ReplacesShader(true, false, false));
+    VERIFY_IS_FALSE(RosDepthOnly::ReplacesShader(true, true, false));
+    VERIFY_IS_FALSE(RosDepthOnly::ReplacesShader(true, false, true));
+    VERIFY_IS_FALSE(RosDepthOnly::ReplacesShader(false, false, false));
+
+    //
+    // The shader ends with the program end signal and its 2 delay slots,
+    // the last one unlocks the scoreboard
+    //
+    const UINT last = RosDepthOnly::kShaderInstructions - 1;
+    VERIFY_ARE_EQUAL(3ull, RosDepthOnly::s_shader[last - 2] >> 60);
+    VERIFY_ARE_EQUAL(5ull, RosDepthOnly::s_shader[last] >> 60);
+
+    //
+    // A pass of depth-only DMA buffers neither loads nor stores the render
+    // target unless it clears it, a pass with a color draw does both
+    //
+    RosRenderPassDmaBuf depthOnly = { BACK_BUFFER, WIDTH_IN_TILES, HEIGHT_IN_TILES, ALL_TILES, false, true, false, false,
+                                      DEPTH_BUFFER, 0, false, true, true, false, true };
+    RosRenderPassDmaBuf color = depthOnly;
+    color.m_bDepthOnly = false;
+    color.m_bContinues = false;
+
+    RosRenderPass pass;
+
+    VERIFY_IS_TRUE(pass.Add(depthOnly));
+    VERIFY_IS_FALSE(pass.LoadsColor());
+    VERIFY_IS_FALSE(pass.StoresColor());
+    VERIFY_IS_FALSE(pass.Add(color));
+    VERIFY_IS_TRUE(pass.LoadsColor());
+    VERIFY_IS_TRUE(pass.StoresColor());
+    pass.Close();
+
+    RosRenderPassDmaBuf cleared = depthOnly;
+    cleared.m_bClear = true;
+    cleared.m_bContinues = false;
+    VERIFY_IS_FALSE(pass.Add(cleared));
+    VERIFY_IS_FALSE(pass.LoadsColor());
+    VERIFY_IS_TRUE(pass.StoresColor());
+    pass.Close();
+
+    depthOnly.m_bContinues = false;
+    VERIFY_IS_FALSE(pass.Add(depthOnly));
+    pass.Close();
+
+    VERIFY_ARE_EQUAL(3ull, pass.GetPassCount());
+    VERIFY_ARE_EQUAL(1ull, pass.GetDepthOnlyCount());
+    VERIFY_ARE_EQUAL(ULONGLONG(NUM_TILES), pass.GetTileLoads());
+    VERIFY_ARE_EQUAL(ULONGLONG(2 * NUM_TILES), pass.GetTileStores());
+
+    //
+    // The same images with and without the fast path, merged into passes
+    // and split into a pass per DMA buffer
+    //
+    ModelFrames merged = RenderDepthOnlyScene(3, false, true);
+    ModelFrames mergedSlow = RenderDepthOnlyScene(3, false, false);
+    ModelFrames split = RenderDepthOnlyScene(3, true, true);
+    ModelFrames splitSlow = RenderDepthOnlyScene(3, true, false);
+
+    LogComment(
+        L"Merged: %u passes, %u depth-only, %u tile loads and %u tile stores, %u and %u without the fast path",
+        UINT(merged.m_passes),
+        UINT(merged.m_depthOnlyPasses),
+        UINT(merged.m_tileLoads),
+        UINT(merged.m_tileStores),
+        UINT(mergedSlow.m_tileLoads),
+        UINT(mergedSlow.m_tileStores));
+    LogComment(
+        L"Split: %u passes, %u depth-only, %u tile loads and %u tile stores, %u and %u without the fast path",
+        UINT(split.m_passes),
+        UINT(split.m_depthOnlyPasses),
+        UINT(split.m_tileLoads),
+        UINT(split.m_tileStores),
+        UINT(splitSlow.m_tileLoads),
+        UINT(splitSlow.m_tileStores));
+
+    //
+    // The depth-only pass of frame 1 when merged. Split, the second DMA
+    // buffer of the prepass, both of frame 1 and the first of frame 2. The
+    // prepass of frame 0 stores the clear.
+    //
+    VERIFY_ARE_EQUAL(5ull, merged.m_passes);
+    VERIFY_ARE_EQUAL(1ull, merged.m_depthOnlyPasses);
+    VERIFY_ARE_EQUAL(4ull, split.m_depthOnlyPasses);
+    VERIFY_ARE_EQUAL(0ull, mergedSlow.m_depthOnlyPasses);
+    VERIFY_ARE_EQUAL(0ull, splitSlow.m_depthOnlyPasses);
+
+    VERIFY_ARE_EQUAL(merged.m_passes, mergedSlow.m_passes);
+    VERIFY_ARE_EQUAL(split.m_passes, splitSlow.m_passes);
+
+    const ULONGLONG mergedSaved = merged.m_depthOnlyPasses * NUM_TILES;
+    const ULONGLONG splitSaved = split.m_depthOnlyPasses * NUM_TILES;
+
+    VERIFY_ARE_EQUAL(mergedSlow.m_tileLoads, merged.m_tileLoads + mergedSaved);
+    VERIFY_ARE_EQUAL(mergedSlow.m_tileStores, merged.m_tileStores + mergedSaved);
+    VERIFY_ARE_EQUAL(splitSlow.m_tileLoads, split.m_tileLoads + splitSaved);
+    VERIFY_ARE_EQUAL(splitSlow.m_tileStores, split.m_tileStores + splitSaved);
+
+    VERIFY_ARE_EQUAL(mergedSlow.m_depthStencilLoadBytes, merged.m_depthStencilLoadBytes);
+    VERIFY_ARE_EQUAL(mergedSlow.m_depthStencilStoreBytes, merged.m_depthStencilStoreBytes);
+
+    for (UINT frame = 0; frame < merged.m_frames.size(); ++frame) {
+        const ModelMemory & expected = mergedSlow.m_frames[frame];
+
+        for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+            VERIFY_ARE_EQUAL(expected.m_color[i], merged.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(expected.m_color[i], split.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(expected.m_color[i], splitSlow.m_frames[frame].m_color[i]);
+            VERIFY_ARE_EQUAL(expected.m_depthStencil[i], merged.m_frames[frame].m_depthStencil[i]);
+            VERIFY_ARE_EQUAL(expected.m_depthStencil[i], split.m_frames[frame].m_depthStencil[i]);
+            VERIFY_ARE_EQUAL(expected.m_depthStencil[i], splitSlow.m_frames[frame].m_depthStencil[i]);
+        }
+    }
+
+    //
+    // No pass stored the color of a tile buffer it neither loaded nor
+    // cleared
+    //
+    for (UINT frame = 0; frame < merged.m_frames.size(); ++frame) {
+        for (UINT i = 0; i < MODEL_PIXELS; ++i) {
+            VERIFY_ARE_NOT_EQUAL(UNDEFINED_COLOR, merged.m_frames[frame].m_color[i]);
+            VERIFY_ARE_NOT_EQUAL(UNDEFINED_COLOR, split.m_frames[frame].m_color[i]);
+        }
+    }
+}
+
+//
+// 1024x1024 shadow map, its casters rasterize 2.5 fragments per texel
+//
+const UINT SHADOW_MAP_TILES = 1024 / TILE_PIXELS;
+const ULONGLONG SHADOW_MAP_FRAGMENTS = 1024ull * 1024ull * 5 / 2;
+
+//
+// The fragment shader of roscompiler.cpp writing the interpolated color,
+// a QPU runs an instruction for 16 fragments in 4 cycles
+//
+const ULONGLONG COLOR_SHADER_INSTRUCTIONS = 10;
+const ULONGLONG QPU_CYCLES_PER_INSTRUCTION = 4;
+const ULONGLONG QPU_FRAGMENTS_PER_INSTRUCTION = 16;
+
+void RenderPassTests::TestShadowMapPass ()
+{
+    const RosRenderPassTiles allTiles = { 0, 0, SHADOW_MAP_TILES, SHADOW_MAP_TILES };
+
+    //
+    // Before the fast path the shadow map was rendered with a cleared color
+    // target of its size and the pixel shader of the casters, now without a
+    // render target and with the depth-only fragment shader
+    //
+    RosRenderPassDmaBuf withColor = { SHADOW_MAP, SHADOW_MAP_TILES, SHADOW_MAP_TILES, allTiles, true, false, false, false,
+                                      SHADOW_MAP, MAX_DEPTH << 8, true, true, true, false, false };
+    RosRenderPassDmaBuf depthOnly = withColor;
+    depthOnly.m_bClear = false;
+    depthOnly.m_bDepthOnly = true;
+
+    RosRenderPass colorPass;
+    VERIFY_IS_FALSE(colorPass.Add(withColor));
+    colorPass.Close();
+
+    RosRenderPass depthOnlyPass;
+    VERIFY_IS_FALSE(depthOnlyPass.Add(depthOnly));
+    depthOnlyPass.Close();
+
+    const ULONGLONG colorBytesWritten =
+        colorPass.GetTileStores() * RosRenderPass::kTileColorBytes +
+        colorPass.GetDepthStencilStoreBytes();
+    const ULONGLONG colorBytesRead =
+        colorPass.GetTileLoads() * RosRenderPass::kTileColorBytes +
+        colorPass.GetDepthStencilLoadBytes();
+    const ULONGLONG depthOnlyBytesWritten =
+        depthOnlyPass.GetTileStores() * RosRenderPass::kTileColorBytes +
+        depthOnlyPass.GetDepthStencilStoreBytes();
+    const ULONGLONG depthOnlyBytesRead =
+        depthOnlyPass.GetTileLoads() * RosRenderPass::kTileColorBytes +
+        depthOnlyPass.GetDepthStencilLoadBytes();
+
+    const ULONGLONG colorCycles =
+        SHADOW_MAP_FRAGMENTS / QPU_FRAGMENTS_PER_INSTRUCTION * COLOR_SHADER_INSTRUCTIONS * QPU_CYCLES_PER_INSTRUCTION;
+    const ULONGLONG depthOnlyCycles =
+        SHADOW_MAP_FRAGMENTS / QPU_FRAGMENTS_PER_INSTRUCTION * RosDepthOnly::kShaderInstructions * QPU_CYCLES_PER_INSTRUCTION;
+
+    LogComment(
+        L"Shadow map with a color target: %u bytes written, %u bytes read, %u shader cycles",
+        UINT(colorBytesWritten),
+        UINT(colorBytesRead),
+        UINT(colorCycles));
+    LogComment(
+        L"Depth-only shadow map: %u bytes written, %u bytes read, %u shader cycles",
+        UINT(depthOnlyBytesWritten),
+        UINT(depthOnlyBytesRead),
+        UINT(depthOnlyCycles));
+
+    const ULONGLONG mapBytes = ULONGLONG(SHADOW_MAP_TILES * SHADOW_MAP_TILES) * RosRenderPass::kTileDepthStencilBytes;
+
+    VERIFY_ARE_EQUAL(1ull, depthOnlyPass.GetDepthOnlyCount());
+    VERIFY_ARE_EQUAL(0ull, depthOnlyPass.GetTileStores());
+    VERIFY_ARE_EQUAL(0ull, depthOnlyPass.GetTileLoads());
+    VERIFY_ARE_EQUAL(mapBytes, depthOnlyBytesWritten);
+    VERIFY_ARE_EQUAL(0ull, depthOnlyBytesRead);
+    VERIFY_ARE_EQUAL(2 * mapBytes, colorBytesWritten);
+    VERIFY_ARE_EQUAL(0ull, colorBytesRead);
+    VERIFY_IS_TRUE(2 * depthOnlyCycles == colorCycles);
+}
@@ -0,0 +1,51 @@
+#ifndef _RENDER_PASS_TESTS_H_
+#define _RENDER_PASS_TESTS_H_
+
+//
+// Tests of the render passes the KMD builds from the DMA buffers of the
+// UMD. These run on the host without a device, the flushes of the UMD are
+// replayed for the calls of a demo frame.
+//
+class RenderPassTests {
+    BEGIN_TEST_CLASS(RenderPassTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestReplayedFrame)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that the DMA buffers of a replayed Dolphin frame with its text overlay are rendered as a single pass, the render target stored once and never loaded, where each DMA buffer used to load and store every tile.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestPassBoundaries)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a clear, another render target, aperture copies, performance counters, the longest chain and an idle GPU end the pass, and that only the passes that don't start with a clear load the render target.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestDepthStencilPasses)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Renders a depth tested scene with a model of the tile buffer as one merged pass and split into a pass per DMA buffer, verifies the same images and that the depth stencil buffer is only loaded when the pass doesn't clear it and only stored when written and not discarded.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestDirtyTiles)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a pass only renders the tiles under its draws unless it clears the render target or stores a depth stencil buffer it clears, reports the tiles of a cursor, a text caret and a widget update of an 800x480 frame, and verifies the same images as rendering every tile.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestDepthOnlyPasses)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Renders a Z-prepass, a depth-only pass and depth-only draws mixed with color draws with a model of the tile buffer, verifies the same images as loading and storing the render target around every pass, that only passes of depth-only draws that don't clear skip them, and which draws run the depth-only fragment shader.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestShadowMapPass)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Reports the bytes written and read and the fragment shader cycles of a 1024x1024 shadow map pass rendered with a color target and as a depth-only pass, and verifies that the depth-only pass only stores the shadow map.")
+    END_TEST_METHOD()
+};
+
+#endif // _RENDER_PASS_TESTS_H_
@@ -0,0 +1,421 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "SegmentAllocatorTests.h"
+
+#include "RosSegmentAllocator.h"
+
+#include <vector>
+#include <fstream>
+#include <map>
+
+using namespace WEX::TestExecution;
+
+const UINT PAGE_GRANULARITY = 4096;
+
+static UINT RoundToPage (UINT Size)
+{
+    return (Size + PAGE_GRANULARITY - 1) & ~(PAGE_GRANULARITY - 1);
+}
+
+//
+// Allocator with metadata for the worst case of page sized allocations
+//
+class HostSegmentAllocator : public RosSegmentAllocator {
+public:
+    HostSegmentAllocator (UINT Size) :
+        m_blocks(Size / PAGE_GRANULARITY + 1),
+        m_handles(Size / PAGE_GRANULARITY),
+        m_slabs(Size / ROS_SEGMENT_SLAB_SIZE)
+    {
+        Init(
+            Size,
+            PAGE_GRANULARITY,
+            m_blocks.data(),
+            UINT(m_blocks.size()),
+            m_handles.data(),
+            UINT(m_handles.size()),
+            m_slabs.data(),
+            UINT(m_slabs.size()));
+    }
+
+private:
+    std::vector<RosSegmentBlock> m_blocks;
+    std::vector<UINT> m_handles;
+    std::vector<RosSegmentSlab> m_slabs;
+};
+
+class HostSegmentMover : public RosSegmentMover {
+public:
+    HostSegmentMover (BYTE* Memory) :
+        m_memory(Memory),
+        m_bytesMoved(0)
+    {}
+
+    virtual void MoveBlock (UINT DstOffset, UINT SrcOffset, UINT Size)
+    {
+        VERIFY_IS_TRUE(
+            (DstOffset + Size <= SrcOffset) || (SrcOffset + Size <= DstOffset),
+            L"Compaction moves don't overlap");
+
+        if (m_memory) {
+            memcpy(m_memory + DstOffset, m_memory + SrcOffset, Size);
+        }
+
+        m_bytesMoved += Size;
+    }
+
+    BYTE* m_memory;
+    ULONGLONG m_bytesMoved;
+};
+
+static double Fragmentation (const RosSegmentStats& Stats)
+{
+    if (Stats.m_freeBytes == 0) {
+        return 0.0;
+    }
+
+    return 1.0 - double(Stats.m_largestFreeBlock) / Stats.m_freeBytes;
+}
+
+struct LIVE_ALLOCATION {
+    RosSegmentHandle Handle;
+    UINT Size;
+    BYTE Tag;
+};
+
+void SegmentAllocatorTests::TestAllocationIntegrity ()
+{
+    const UINT segmentSize = 32 * 1024 * 1024;
+    const UINT numOperations = 50000;
+    const UINT compactionInterval = 2500;
+
+    std::vector<BYTE> memory(segmentSize);
+    HostSegmentAllocator allocator(segmentSize);
+    HostSegmentMover mover(memory.data());
+
+    std::vector<LIVE_ALLOCATION> live;
+
+    auto verifyContents = [&] (const LIVE_ALLOCATION& Allocation) {
+        const UINT offset = allocator.GetOffset(Allocation.Handle);
+        for (UINT i = 0; i < Allocation.Size; i += 61) {
+            if (memory[offset + i] != Allocation.Tag) {
+                VERIFY_FAIL(L"Allocation contents were lost");
+            }
+        }
+    };
+
+    UINT seed = 1;
+    auto random = [&seed] () {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+
+    for (UINT op = 0; op < numOperations; ++op) {
+        if ((live.size() < 1500) && (random() % 3)) {
+            const UINT size = (random() % 4) ? (random() % 20000 + 1) : (random() % (512 * 1024) + 1);
+            const UINT alignment = 1 << (random() % 8);
+            const UINT flags = (random() % 10) ? ROS_SEGMENT_ALLOC_DEFAULT : ROS_SEGMENT_ALLOC_PINNED;
+
+            LIVE_ALLOCATION allocation;
+            if (!allocator.Allocate(size, alignment, flags, &allocation.Handle)) {
+                continue;
+            }
+
+            const UINT offset = allocator.GetOffset(allocation.Handle);
+            VERIFY_ARE_EQUAL(0u, offset % alignment);
+            VERIFY_IS_TRUE(offset + size <= segmentSize);
+
+            allocation.Size = size;
+            allocation.Tag = BYTE(random());
+            memset(&memory[offset], allocation.Tag, size);
+
+            live.push_back(allocation);
+        } else if (!live.empty()) {
+            const size_t index = random() % live.size();
+
+            verifyContents(live[index]);
+            allocator.Free(live[index].Handle);
+
+            live[index] = live.back();
+            live.pop_back();
+        }
+
+        if ((op % compactionInterval) == compactionInterval - 1) {
+            allocator.Compact(&mover, 8 * 1024 * 1024);
+
+            std::map<UINT, UINT> ranges;
+            for (const LIVE_ALLOCATION& allocation : live) {
+                verifyContents(allocation);
+                ranges[allocator.GetOffset(allocation.Handle)] = allocation.Size;
+            }
+
+            UINT end = 0;
+            for (const auto& range : ranges) {
+                VERIFY_IS_TRUE(range.first >= end, L"Live allocations don't overlap");
+                end = range.first + range.second;
+            }
+
+            RosSegmentStats stats;
+            allocator.GetStats(&stats);
+            VERIFY_ARE_EQUAL(stats.m_size, stats.m_usedBytes + stats.m_freeBytes);
+        }
+    }
+
+    for (const LIVE_ALLOCATION& allocation : live) {
+        allocator.Free(allocation.Handle);
+    }
+
+    RosSegmentStats stats;
+    allocator.GetStats(&stats);
+
+    LogComment(
+        L"Moved %llu bytes, %u slabs kept, %u free blocks left",
+        mover.m_bytesMoved,
+        stats.m_slabCount,
+        stats.m_freeBlockCount);
+
+    VERIFY_IS_TRUE(mover.m_bytesMoved > 0, L"Compaction moved allocations");
+    VERIFY_ARE_EQUAL(0u, stats.m_largeAllocationCount);
+    VERIFY_ARE_EQUAL(stats.m_size, stats.m_freeBytes + stats.m_slabCount * ROS_SEGMENT_SLAB_SIZE);
+}
+
+//
+// Trace operations. Recorded traces are text files with one operation per
+// line:
+//
+//   a <id> <size> <alignment>      allocate
+//   f <id>                         free
+//   m                              measure the footprint here
+//
+struct TRACE_OP {
+    char Type;
+    UINT Id;
+    UINT Size;
+    UINT Alignment;
+};
+
+static bool LoadTrace (const wchar_t* Path, std::vector<TRACE_OP>* Ops)
+{
+    std::ifstream file(Path);
+    if (!file) {
+        return false;
+    }
+
+    TRACE_OP op = {};
+    while (file >> op.Type) {
+        if (op.Type == 'a') {
+            file >> op.Id >> op.Size >> op.Alignment;
+        } else if (op.Type == 'f') {
+            file >> op.Id;
+        }
+
+        Ops->push_back(op);
+    }
+
+    return true;
+}
+
+//
+// Synthetic trace of three levels of a game: each level loads shaders,
+// constant buffers, vertex and index buffers and textures, then runs frames
+// that allocate and free small dynamic buffers, and unloads most of its
+// resources before the next level loads.
+//
+static void GenerateTrace (std::vector<TRACE_OP>* Ops)
+{
+    UINT seed = 1;
+    auto random = [&seed] () {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+
+    UINT nextId = 0;
+    auto allocate = [&] (UINT Size, UINT Alignment) {
+        Ops->push_back({'a', nextId, Size, Alignment});
+        return nextId++;
+    };
+
+    auto release = [&] (std::vector<UINT>& Ids, size_t Index) {
+        Ops->push_back({'f', Ids[Index], 0, 0});
+        Ids[Index] = Ids.back();
+        Ids.pop_back();
+    };
+
+    std::vector<UINT> levelIds;
+    std::vector<UINT> dynamicIds;
+
+    for (UINT level = 0; level < 3; ++level) {
+        for (UINT i = 0; i < 500; ++i) {
+            levelIds.push_back(allocate(128 + random() % 1920, 64));
+        }
+
+        for (UINT i = 0; i < 300; ++i) {
+            levelIds.push_back(allocate(16 * (1 + random() % 256), 64));
+        }
+
+        for (UINT i = 0; i < 200; ++i) {
+            levelIds.push_back(allocate(4096 + random() % (256 * 1024), 64));
+        }
+
+        for (UINT i = 0; i < 40; ++i) {
+            levelIds.push_back(allocate((64 * 1024) << (random() % 6), 4096));
+        }
+
+        Ops->push_back({'m', 0, 0, 0});
+
+        for (UINT frame = 0; frame < 300; ++frame) {
+            for (UINT i = 0; i < 20; ++i) {
+                dynamicIds.push_back(allocate(64 + random() % 4032, 64));
+            }
+
+            while (dynamicIds.size() > 60) {
+                release(dynamicIds, random() % dynamicIds.size());
+            }
+        }
+
+        for (size_t i = 0; i < levelIds.size();) {
+            if (random() % 4) {
+                release(levelIds, i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+void SegmentAllocatorTests::TestTraceReplay ()
+{
+    const UINT segmentSize = 128 * 1024 * 1024;
+
+    std::vector<TRACE_OP> ops;
+
+    WEX::Common::String tracePath;
+    if (SUCCEEDED(RuntimeParameters::TryGetValue(L"AllocationTrace", tracePath))) {
+        LogComment(L"Replaying allocation trace: %s", static_cast<const wchar_t*>(tracePath));
+        VERIFY_IS_TRUE(LoadTrace(tracePath, &ops), L"Allocation trace can be read");
+    } else {
+        GenerateTrace(&ops);
+    }
+
+    UINT maxId = 0;
+    for (const TRACE_OP& op : ops) {
+        maxId = max(maxId, op.Id);
+    }
+
+    HostSegmentAllocator allocator(segmentSize);
+
+    std::vector<RosSegmentHandle> handles(maxId + 1, ROS_SEGMENT_INVALID_HANDLE);
+    std::vector<UINT> sizes(maxId + 1, 0);
+
+    UINT numAllocations = 0;
+    UINT numFailures = 0;
+
+    // Small allocations as they'd be placed by a page granular allocator
+    ULONGLONG smallBytes = 0;
+    ULONGLONG smallPageBytes = 0;
+
+    ULONGLONG peakSmallBytes = 0;
+    ULONGLONG peakSmallPageBytes = 0;
+    ULONGLONG peakSmallSlotBytes = 0;
+    ULONGLONG peakSmallSlabBytes = 0;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    LONGLONG replayTicks = 0;
+
+    for (const TRACE_OP& op : ops) {
+        QueryPerformanceCounter(&start);
+
+        if (op.Type == 'a') {
+            ++numAllocations;
+
+            if (!allocator.Allocate(op.Size, op.Alignment, ROS_SEGMENT_ALLOC_DEFAULT, &handles[op.Id])) {
+                handles[op.Id] = ROS_SEGMENT_INVALID_HANDLE;
+                ++numFailures;
+            }
+        } else if ((op.Type == 'f') && (handles[op.Id] != ROS_SEGMENT_INVALID_HANDLE)) {
+            allocator.Free(handles[op.Id]);
+            handles[op.Id] = ROS_SEGMENT_INVALID_HANDLE;
+        }
+
+        QueryPerformanceCounter(&end);
+        replayTicks += end.QuadPart - start.QuadPart;
+
+        if (op.Type == 'a') {
+            sizes[op.Id] = (handles[op.Id] != ROS_SEGMENT_INVALID_HANDLE) ? op.Size : 0;
+
+            if (sizes[op.Id] <= RosSegmentAllocator::kSmallLimit) {
+                smallBytes += op.Size;
+                smallPageBytes += RoundToPage(op.Size);
+            }
+        } else if (op.Type == 'f') {
+            if (sizes[op.Id] <= RosSegmentAllocator::kSmallLimit) {
+                smallBytes -= sizes[op.Id];
+                smallPageBytes -= RoundToPage(sizes[op.Id]);
+            }
+        } else if (op.Type == 'm') {
+            RosSegmentStats stats;
+            allocator.GetStats(&stats);
+
+            if (smallPageBytes > peakSmallPageBytes) {
+                peakSmallBytes = smallBytes;
+                peakSmallPageBytes = smallPageBytes;
+                peakSmallSlotBytes = stats.m_slotBytes;
+                peakSmallSlabBytes = ULONGLONG(stats.m_slabCount) * ROS_SEGMENT_SLAB_SIZE;
+            }
+        }
+    }
+
+    const double replayMs = 1000.0 * replayTicks / frequency.QuadPart;
+
+    LogComment(
+        L"Replayed %u operations (%u allocations, %u failed) in %.3f ms, %.1f Mops/s",
+        UINT(ops.size()),
+        numAllocations,
+        numFailures,
+        replayMs,
+        ops.size() / replayMs / 1000.0);
+
+    LogComment(
+        L"Small allocations at peak: %llu bytes requested, %llu bytes page rounded, %llu bytes in slots, %llu bytes of slabs",
+        peakSmallBytes,
+        peakSmallPageBytes,
+        peakSmallSlotBytes,
+        peakSmallSlabBytes);
+
+    RosSegmentStats before;
+    allocator.GetStats(&before);
+
+    HostSegmentMover mover(nullptr);
+
+    QueryPerformanceCounter(&start);
+    allocator.Compact(&mover, segmentSize);
+    QueryPerformanceCounter(&end);
+
+    RosSegmentStats after;
+    allocator.GetStats(&after);
+
+    LogComment(
+        L"Before compaction: %u free blocks, largest %u of %u free bytes, fragmentation %.3f",
+        before.m_freeBlockCount,
+        before.m_largestFreeBlock,
+        before.m_freeBytes,
+        Fragmentation(before));
+
+    LogComment(
+        L"After compaction: %u free blocks, largest %u of %u free bytes, fragmentation %.3f, %llu bytes moved in %.3f ms",
+        after.m_freeBlockCount,
+        after.m_largestFreeBlock,
+        after.m_freeBytes,
+        Fragmentation(after),
+        mover.m_bytesMoved,
+        1000.0 * (end.QuadPart - start.QuadPart) / frequency.QuadPart);
+
+    VERIFY_ARE_EQUAL(0u, numFailures);
+    VERIFY_IS_TRUE(peakSmallSlabBytes < peakSmallPageBytes, L"Slabs use less memory than page rounding");
+    VERIFY_ARE_EQUAL(before.m_freeBytes, after.m_freeBytes);
+    VERIFY_IS_TRUE(after.m_largestFreeBlock >= before.m_largestFreeBlock);
+    VERIFY_IS_TRUE(Fragmentation(after) <= Fragmentation(before));
+}
@@ -0,0 +1,26 @@
+#ifndef _SEGMENT_ALLOCATOR_TESTS_H_
+#define _SEGMENT_ALLOCATOR_TESTS_H_
+
+//
+// Tests of the video memory suballocator. These run on the host, the
+// managed range is backed by system memory.
+//
+class SegmentAllocatorTests {
+    BEGIN_TEST_CLASS(SegmentAllocatorTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestAllocationIntegrity)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies alignment, overlap and contents of allocations across random allocations, frees and compaction passes.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestTraceReplay)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Replays an allocation trace and measures throughput, small allocation overhead against page rounding and fragmentation before and after compaction.")
+    END_TEST_METHOD()
+};
+
+#endif // _SEGMENT_ALLOCATOR_TESTS_H_
@@ -0,0 +1,331 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "ShaderHeapTests.h"
+
+#include "RosUmdShaderHeap.h"
+
+#include <vector>
+#include <set>
+
+using namespace WEX::TestExecution;
+
+const UINT PAGE_GRANULARITY = 4096;
+
+static UINT RoundToPage (UINT Size)
+{
+    return (Size + PAGE_GRANULARITY - 1) & ~(PAGE_GRANULARITY - 1);
+}
+
+//
+// Heap whose chunks are system memory, the data pointer doubles as the
+// buffer of the chunk
+//
+class HostShaderHeap : public RosUmdShaderHeap {
+public:
+    HostShaderHeap () :
+        m_maps(0),
+        m_unmaps(0),
+        m_mappedBytes(0),
+        m_peakMappedBytes(0)
+    {}
+
+    ~HostShaderHeap ()
+    {
+        Teardown();
+    }
+
+    UINT m_maps;
+    UINT m_unmaps;
+    UINT m_mappedBytes;
+    UINT m_peakMappedBytes;
+
+protected:
+
+    virtual void MapChunk (RosUmdShaderHeapChunk* pChunk)
+    {
+        pChunk->m_pData = new BYTE[pChunk->m_size];
+        pChunk->m_pBuffer = reinterpret_cast<RosUmdResource*>(pChunk->m_pData);
+
+        ++m_maps;
+        m_mappedBytes += pChunk->m_size;
+        m_peakMappedBytes = max(m_peakMappedBytes, m_mappedBytes);
+    }
+
+    virtual void UnmapChunk (RosUmdShaderHeapChunk* pChunk)
+    {
+        delete[] pChunk->m_pData;
+
+        ++m_unmaps;
+        m_mappedBytes -= pChunk->m_size;
+    }
+};
+
+struct SHADER_RECORD {
+    RosUmdShaderCode Code;
+    UINT Size;
+    BYTE Pattern;
+};
+
+//
+// Sizes of compiled VC4 shaders range from a few instructions to a couple
+// of kilobytes, in 8 byte instructions
+//
+static UINT NextShaderSize (UINT* pSeed)
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+    return 128 + ((*pSeed >> 16) % 240) * 8;
+}
+
+static void CreateShader (HostShaderHeap& Heap, SHADER_RECORD* pShader, UINT Size, BYTE Pattern)
+{
+    memset(&pShader->Code, 0, sizeof(pShader->Code));
+    pShader->Size = Size;
+    pShader->Pattern = Pattern;
+
+    VERIFY_IS_TRUE(Heap.Allocate(Size, &pShader->Code));
+    VERIFY_ARE_EQUAL(0u, Heap.GetCodeOffset(pShader->Code) % RosUmdShaderHeap::kCodeAlignment);
+    VERIFY_IS_TRUE(Heap.GetCodeOffset(pShader->Code) + Size <= Heap.GetChunkSize());
+
+    memset(Heap.GetCodePointer(pShader->Code), Pattern, Size);
+}
+
+//
+// Allocation a draw references for the code of a shader, the code must be
+// in the current chunk
+//
+static RosUmdResource* CodeAllocation (const HostShaderHeap& Heap, const SHADER_RECORD& Shader)
+{
+    const BYTE* pChunk = reinterpret_cast<const BYTE*>(Heap.GetBuffer());
+    const BYTE* pCode = Heap.GetCodePointer(Shader.Code);
+
+    VERIFY_IS_TRUE((pCode >= pChunk) && (pCode + Shader.Size <= pChunk + Heap.GetChunkSize()));
+
+    return Heap.GetBuffer();
+}
+
+static bool CodeIsIntact (const HostShaderHeap& Heap, const SHADER_RECORD& Shader)
+{
+    const BYTE* pCode = Heap.GetCodePointer(Shader.Code);
+    for (UINT i = 0; i < Shader.Size; ++i) {
+        if (pCode[i] != Shader.Pattern) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ShaderHeapTests::TestAllocationsPerDraw ()
+{
+    HostShaderHeap heap;
+
+    const UINT numShaders = 500;
+    const UINT numDraws = 20000;
+
+    std::vector<SHADER_RECORD> shaders(numShaders);
+
+    UINT seed = 1;
+    for (UINT i = 0; i < numShaders; ++i) {
+        CreateShader(heap, &shaders[i], NextShaderSize(&seed), BYTE(i));
+    }
+
+    UINT recreated = 0;
+    UINT maxAllocationsPerDraw = 0;
+
+    for (UINT draw = 0; draw < numDraws; ++draw) {
+        seed = seed * 1103515245 + 12345;
+        const UINT vs = (seed >> 16) % numShaders;
+        seed = seed * 1103515245 + 12345;
+        const UINT ps = (seed >> 16) % numShaders;
+
+        //
+        // The draw references the vertex, coordinate and pixel shader code
+        //
+        std::set<RosUmdResource*> allocations;
+        allocations.insert(CodeAllocation(heap, shaders[vs]));
+        allocations.insert(CodeAllocation(heap, shaders[ps]));
+
+        maxAllocationsPerDraw = max(maxAllocationsPerDraw, UINT(allocations.size()));
+
+        VERIFY_IS_TRUE(CodeIsIntact(heap, shaders[vs]));
+        VERIFY_IS_TRUE(CodeIsIntact(heap, shaders[ps]));
+
+        //
+        // Applications create and destroy shaders between draws, every
+        // 8th draw replaces a shader
+        //
+        if ((draw % 8) == 0) {
+            seed = seed * 1103515245 + 12345;
+            const UINT victim = (seed >> 16) % numShaders;
+
+            heap.Free(&shaders[victim].Code);
+            CreateShader(heap, &shaders[victim], NextShaderSize(&seed), BYTE(draw));
+            ++recreated;
+        }
+    }
+
+    LogComment(
+        L"%u shaders, %u draws, %u shaders recreated, %u migrations, %I64u bytes migrated",
+        numShaders,
+        numDraws,
+        recreated,
+        heap.GetMigrationCount(),
+        heap.GetBytesMigrated());
+
+    LogComment(
+        L"Shader code allocations per draw: %u, one allocation per shader: 2",
+        maxAllocationsPerDraw);
+
+    VERIFY_ARE_EQUAL(1u, maxAllocationsPerDraw);
+    VERIFY_IS_TRUE(heap.GetMigrationCount() > 0, L"Destroyed shaders are reclaimed by migration");
+    VERIFY_ARE_EQUAL(numShaders, heap.GetLiveCount());
+
+    for (UINT i = 0; i < numShaders; ++i) {
+        VERIFY_IS_TRUE(CodeIsIntact(heap, shaders[i]));
+        heap.Free(&shaders[i].Code);
+    }
+
+    VERIFY_ARE_EQUAL(0u, heap.GetLiveCount());
+    VERIFY_ARE_EQUAL(0u, heap.GetLiveBytes());
+    VERIFY_ARE_EQUAL(heap.m_maps, heap.m_unmaps + 1);
+}
+
+void ShaderHeapTests::TestMemoryUsage ()
+{
+    HostShaderHeap heap;
+
+    const UINT numShaders = 500;
+
+    std::vector<SHADER_RECORD> shaders(numShaders);
+
+    UINT seed = 7;
+    UINT codeBytes = 0;
+    UINT pageRoundedBytes = 0;
+
+    for (UINT i = 0; i < numShaders; ++i) {
+        const UINT size = NextShaderSize(&seed);
+
+        CreateShader(heap, &shaders[i], size, BYTE(i));
+
+        codeBytes += size;
+        pageRoundedBytes += RoundToPage(size);
+    }
+
+    LogComment(
+        L"%u shaders, %u bytes of code, average %u bytes",
+        numShaders,
+        codeBytes,
+        codeBytes / numShaders);
+
+    LogComment(
+        L"One allocation per shader: %u allocations, %u bytes",
+        numShaders,
+        pageRoundedBytes);
+
+    LogComment(
+        L"Shader heap: 1 allocation, %u bytes, %u live bytes, %u dead bytes, peak %u bytes during %u migrations",
+        heap.GetChunkSize(),
+        heap.GetLiveBytes(),
+        heap.GetDeadBytes(),
+        heap.m_peakMappedBytes,
+        heap.GetMigrationCount());
+
+    VERIFY_IS_TRUE(heap.GetLiveBytes() >= codeBytes);
+    VERIFY_IS_TRUE(heap.GetLiveBytes() < codeBytes + numShaders * RosUmdShaderHeap::kCodeAlignment);
+    VERIFY_IS_TRUE(heap.GetChunkSize() < pageRoundedBytes);
+
+    //
+    // Destroying half of the shaders leaves dead ranges until the next
+    // migration, the heap never grows past what the live code needs
+    //
+    for (UINT i = 0; i < numShaders; i += 2) {
+        heap.Free(&shaders[i].Code);
+    }
+
+    for (UINT i = 0; i < numShaders; i += 2) {
+        CreateShader(heap, &shaders[i], shaders[i].Size, shaders[i].Pattern);
+    }
+
+    LogComment(
+        L"After recreating half of the shaders: %u bytes, %u live bytes, %u dead bytes, %u migrations",
+        heap.GetChunkSize(),
+        heap.GetLiveBytes(),
+        heap.GetDeadBytes(),
+        heap.GetMigrationCount());
+
+    VERIFY_IS_TRUE(heap.GetChunkSize() < pageRoundedBytes);
+
+    for (UINT i = 0; i < numShaders; ++i) {
+        VERIFY_IS_TRUE(CodeIsIntact(heap, shaders[i]));
+        heap.Free(&shaders[i].Code);
+    }
+}
+
+void ShaderHeapTests::TestMigrationFailure ()
+{
+    HostShaderHeap heap;
+
+    //
+    // The allocator rounds a request up by up to 1/16 of its size, the
+    // oldest shader is migrated last and needs 64KB more than its size.
+    // Power of two fillers aren't rounded, they leave 64000 bytes of the
+    // largest chunk free.
+    //
+    const UINT largeSize = 1024 * 1024 + RosUmdShaderHeap::kCodeAlignment;
+    const UINT fillerSize = 64 * 1024;
+    const UINT numFillers = 47;
+    const UINT slack = 64000;
+    const UINT tailSize =
+        RosUmdShaderHeap::kMaxChunkSize - slack - largeSize - numFillers * fillerSize;
+
+    std::vector<SHADER_RECORD> shaders(numFillers + 2);
+
+    CreateShader(heap, &shaders[0], largeSize, 1);
+    for (UINT i = 1; i <= numFillers; ++i) {
+        CreateShader(heap, &shaders[i], fillerSize, BYTE(i + 1));
+    }
+    CreateShader(heap, &shaders[numFillers + 1], tailSize, BYTE(numFillers + 2));
+
+    VERIFY_ARE_EQUAL(RosUmdShaderHeap::kMaxChunkSize, heap.GetChunkSize());
+    VERIFY_ARE_EQUAL(RosUmdShaderHeap::kMaxChunkSize - slack, heap.GetLiveBytes());
+
+    //
+    // The new shader doesn't fit the free range once rounded, the live code
+    // and it fill less than the largest chunk
+    //
+    const RosUmdResource* pBuffer = heap.GetBuffer();
+    const UINT liveCount = heap.GetLiveCount();
+    const UINT migrationCount = heap.GetMigrationCount();
+    const UINT maps = heap.m_maps;
+    const UINT unmaps = heap.m_unmaps;
+
+    std::vector<UINT> offsets(shaders.size());
+    for (UINT i = 0; i < shaders.size(); ++i) {
+        offsets[i] = heap.GetCodeOffset(shaders[i].Code);
+    }
+
+    RosUmdShaderCode code;
+    memset(&code, 0, sizeof(code));
+
+    VERIFY_IS_FALSE(heap.Allocate(slack - 20 * RosUmdShaderHeap::kCodeAlignment, &code));
+
+    LogComment(
+        L"Failed allocation mapped %u chunk(s) and unmapped %u",
+        heap.m_maps - maps,
+        heap.m_unmaps - unmaps);
+
+    VERIFY_ARE_EQUAL(maps + 1, heap.m_maps, L"The live code was migrated");
+    VERIFY_ARE_EQUAL(unmaps + 1, heap.m_unmaps, L"The new chunk was released");
+    VERIFY_ARE_EQUAL(pBuffer, heap.GetBuffer());
+    VERIFY_ARE_EQUAL(RosUmdShaderHeap::kMaxChunkSize, heap.GetChunkSize());
+    VERIFY_ARE_EQUAL(migrationCount, heap.GetMigrationCount());
+    VERIFY_ARE_EQUAL(liveCount, heap.GetLiveCount());
+    VERIFY_ARE_EQUAL(RosUmdShaderHeap::kMaxChunkSize - slack, heap.GetLiveBytes());
+
+    for (UINT i = 0; i < shaders.size(); ++i) {
+        VERIFY_ARE_EQUAL(offsets[i], heap.GetCodeOffset(shaders[i].Code));
+        VERIFY_IS_TRUE(CodeIsIntact(heap, shaders[i]));
+        heap.Free(&shaders[i].Code);
+    }
+}
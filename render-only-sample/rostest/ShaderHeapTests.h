@@ -0,0 +1,32 @@
+#ifndef _SHADER_HEAP_TESTS_H_
+#define _SHADER_HEAP_TESTS_H_
+
+//
+// Tests of the UMD shader code heap. These run on the host without a
+// device, chunks are backed by system memory.
+//
+class ShaderHeapTests {
+    BEGIN_TEST_CLASS(ShaderHeapTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestAllocationsPerDraw)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that the shaders of every draw come from a single allocation and that shader code survives heap migrations while shaders are created and destroyed.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestMemoryUsage)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Reports the memory used by the code of 500 shaders in the heap against one page rounded allocation per shader.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestMigrationFailure)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that an allocation fails and leaves the current chunk and shader code intact when the live code of a nearly full heap doesn't fit a new chunk.")
+    END_TEST_METHOD()
+};
+
+#endif // _SHADER_HEAP_TESTS_H_
@@ -0,0 +1,120 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "ShaderStateTests.h"
+
+#include "d3dumddi_.h"
+#include "RosUmdElementLayout.h"
+
+using namespace WEX::TestExecution;
+
+struct VCD_FETCH_BYTES {
+    UINT Binning;
+    UINT Rendering;
+};
+
+//
+// Models the vertex cache DMA for a draw: each pass fetches the selected
+// attribute arrays of every vertex into VPM.
+//
+static VCD_FETCH_BYTES SimulateVertexFetch (
+    const VC4GLShaderStateRecord& Record,
+    const VC4VertexAttribute* Attributes,
+    UINT NumAttributes,
+    UINT NumVertices
+    )
+{
+    VCD_FETCH_BYTES bytes = {};
+
+    for (UINT i = 0; i < NumAttributes; ++i) {
+        const UINT attributeBytes = Attributes[i].NumberOfBytesMinusOne + 1;
+
+        if (Record.CoordinateShaderAttributeArraySelectBits & (1 << i)) {
+            bytes.Binning += attributeBytes * NumVertices;
+        }
+
+        if (Record.VertexShaderAttributeArraySelectBits & (1 << i)) {
+            bytes.Rendering += attributeBytes * NumVertices;
+        }
+    }
+
+    return bytes;
+}
+
+void ShaderStateTests::TestCoordinateShaderAttributes ()
+{
+    // Position, normal and texture coordinates, position only feeds the
+    // coordinate shader
+    const BYTE elementBytes[] = { 12, 12, 8 };
+    const UINT numElements = ARRAYSIZE(elementBytes);
+    const UINT numVertices = 10000;
+
+    VC4GLShaderStateRecord record = {};
+    VC4VertexAttribute attributes[numElements] = {};
+
+    RosUmdElementLayout::WriteVpmLayout(
+        numElements,
+        elementBytes,
+        0x1,
+        &record,
+        attributes);
+
+    VERIFY_ARE_EQUAL(0x7u, UINT(record.VertexShaderAttributeArraySelectBits));
+    VERIFY_ARE_EQUAL(32u, UINT(record.VertexShaderTotalAttributesSize));
+    VERIFY_ARE_EQUAL(0x1u, UINT(record.CoordinateShaderAttributeArraySelectBits));
+    VERIFY_ARE_EQUAL(12u, UINT(record.CoordinateShaderTotalAttributesSize));
+
+    UINT vsVpmOffset = 0;
+    for (UINT i = 0; i < numElements; ++i) {
+        VERIFY_ARE_EQUAL(UINT(elementBytes[i]) - 1, UINT(attributes[i].NumberOfBytesMinusOne));
+        VERIFY_ARE_EQUAL(vsVpmOffset, UINT(attributes[i].VertexShaderVPMOffset));
+        vsVpmOffset += elementBytes[i];
+    }
+    VERIFY_ARE_EQUAL(0u, UINT(attributes[0].CoordinateShaderVPMOffset));
+
+    // Coordinate shader reading position and texture coordinates gets them
+    // packed in VPM
+    VC4GLShaderStateRecord sparseRecord = {};
+    VC4VertexAttribute sparseAttributes[numElements] = {};
+
+    RosUmdElementLayout::WriteVpmLayout(
+        numElements,
+        elementBytes,
+        0x5,
+        &sparseRecord,
+        sparseAttributes);
+
+    VERIFY_ARE_EQUAL(0x5u, UINT(sparseRecord.CoordinateShaderAttributeArraySelectBits));
+    VERIFY_ARE_EQUAL(20u, UINT(sparseRecord.CoordinateShaderTotalAttributesSize));
+    VERIFY_ARE_EQUAL(12u, UINT(sparseAttributes[2].CoordinateShaderVPMOffset));
+
+    // Compare with the layout before trimming, where the coordinate shader
+    // fetched every attribute
+    VC4GLShaderStateRecord fullRecord = {};
+    VC4VertexAttribute fullAttributes[numElements] = {};
+
+    RosUmdElementLayout::WriteVpmLayout(
+        numElements,
+        elementBytes,
+        0xFF,
+        &fullRecord,
+        fullAttributes);
+
+    VERIFY_ARE_EQUAL(
+        UINT(fullRecord.VertexShaderTotalAttributesSize),
+        UINT(fullRecord.CoordinateShaderTotalAttributesSize));
+
+    VCD_FETCH_BYTES trimmed = SimulateVertexFetch(record, attributes, numElements, numVertices);
+    VCD_FETCH_BYTES full = SimulateVertexFetch(fullRecord, fullAttributes, numElements, numVertices);
+
+    LogComment(
+        L"%u vertices: binning fetches %u bytes (%u untrimmed), rendering fetches %u bytes",
+        numVertices,
+        trimmed.Binning,
+        full.Binning,
+        trimmed.Rendering);
+
+    VERIFY_ARE_EQUAL(full.Rendering, trimmed.Rendering);
+    VERIFY_ARE_EQUAL(numVertices * 12, trimmed.Binning);
+    VERIFY_IS_TRUE(trimmed.Binning < full.Binning);
+}
@@ -0,0 +1,20 @@
+#ifndef _SHADER_STATE_TESTS_H_
+#define _SHADER_STATE_TESTS_H_
+
+//
+// Tests of the GL shader state record the UMD emits for draws. These run
+// on the host without a device.
+//
+class ShaderStateTests {
+    BEGIN_TEST_CLASS(ShaderStateTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestCoordinateShaderAttributes)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that the coordinate shader only fetches the vertex attributes it reads and reports the bytes fetched by binning and rendering.")
+    END_TEST_METHOD()
+};
+
+#endif // _SHADER_STATE_TESTS_H_
@@ -0,0 +1,273 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "CacheModel.h"
+#include "TFormatTests.h"
+
+#include "RosTFormat.h"
+#include "RosTileOrder.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Tiles of the Rendering Control List (Vc4Ddi.h), 32 bit render targets
+//
+const UINT TILE_PIXELS = 64;
+const UINT PIXEL_BYTES = 4;
+
+//
+// Linear render targets are padded to whole tiles of the Rendering Control
+// List (RosUmdResource.cpp)
+//
+const UINT LINEAR_ALIGNMENT_PIXELS = 64;
+
+//
+// Texture cache of 64 byte lines
+//
+const UINT TEXTURE_CACHE_LINES = 64;
+const UINT CACHE_LINE_BYTES = 64;
+
+//
+// Frame of the Dolphin demo sampling a texture the previous pass rendered
+//
+const UINT FRAME_WIDTH = 800;
+const UINT FRAME_HEIGHT = 480;
+const UINT TEXTURE_SIZE = 512;
+
+const BYTE PADDING = 0xCD;
+
+static BYTE PixelByte (
+    UINT X,
+    UINT Y,
+    UINT Byte)
+{
+    return (BYTE)((X * 7) ^ (Y * 13) ^ (Byte * 101));
+}
+
+void TFormatTests::TestPixelLayout ()
+{
+    //
+    // 32 bit pixels: 4x4 microtiles, 16x16 subtiles, 32x32 tiles
+    //
+    const UINT widthInTiles = 2;
+
+    VERIFY_ARE_EQUAL(32u, RosTFormat::GetTileWidth(4));
+    VERIFY_ARE_EQUAL(32u, RosTFormat::GetTileHeight(4));
+    VERIFY_ARE_EQUAL(64u, RosTFormat::GetTileWidth(2));
+    VERIFY_ARE_EQUAL(32u, RosTFormat::GetTileHeight(2));
+    VERIFY_ARE_EQUAL(64u, RosTFormat::GetTileWidth(1));
+    VERIFY_ARE_EQUAL(64u, RosTFormat::GetTileHeight(1));
+
+    VERIFY_ARE_EQUAL(0u, RosTFormat::GetPixelOffset(widthInTiles, 0, 0, 4));
+    VERIFY_ARE_EQUAL(4u, RosTFormat::GetPixelOffset(widthInTiles, 1, 0, 4));
+    VERIFY_ARE_EQUAL(16u, RosTFormat::GetPixelOffset(widthInTiles, 0, 1, 4));
+    VERIFY_ARE_EQUAL(64u, RosTFormat::GetPixelOffset(widthInTiles, 4, 0, 4));
+    VERIFY_ARE_EQUAL(256u, RosTFormat::GetPixelOffset(widthInTiles, 0, 4, 4));
+
+    //
+    // Subtiles of a tile on an even row: top left, bottom left, bottom
+    // right, top right
+    //
+    VERIFY_ARE_EQUAL(1024u, RosTFormat::GetPixelOffset(widthInTiles, 0, 16, 4));
+    VERIFY_ARE_EQUAL(2048u, RosTFormat::GetPixelOffset(widthInTiles, 16, 16, 4));
+    VERIFY_ARE_EQUAL(3072u, RosTFormat::GetPixelOffset(widthInTiles, 16, 0, 4));
+    VERIFY_ARE_EQUAL(4096u, RosTFormat::GetPixelOffset(widthInTiles, 32, 0, 4));
+
+    //
+    // An odd row of tiles runs right to left, its tiles start with the
+    // bottom right subtile
+    //
+    VERIFY_ARE_EQUAL(2u * 4096u, RosTFormat::GetPixelOffset(widthInTiles, 48, 48, 4));
+    VERIFY_ARE_EQUAL(2u * 4096u + 1024u, RosTFormat::GetPixelOffset(widthInTiles, 48, 32, 4));
+    VERIFY_ARE_EQUAL(2u * 4096u + 2048u, RosTFormat::GetPixelOffset(widthInTiles, 32, 32, 4));
+    VERIFY_ARE_EQUAL(2u * 4096u + 3072u, RosTFormat::GetPixelOffset(widthInTiles, 32, 48, 4));
+    VERIFY_ARE_EQUAL(3u * 4096u + 2048u, RosTFormat::GetPixelOffset(widthInTiles, 0, 32, 4));
+
+    //
+    // 8 bit pixels: 8x8 microtiles
+    //
+    VERIFY_ARE_EQUAL(8u, RosTFormat::GetPixelOffset(1, 0, 1, 1));
+    VERIFY_ARE_EQUAL(64u, RosTFormat::GetPixelOffset(1, 8, 0, 1));
+
+    const UINT sizes[][2] = {
+        { 1, 1 },
+        { 33, 17 },
+        { 100, 100 },
+        { 800, 480 },
+    };
+
+    for (const auto & size : sizes) {
+        for (UINT bytesPerPixel = 1; bytesPerPixel <= 4; bytesPerPixel *= 2) {
+            const UINT width = size[0];
+            const UINT height = size[1];
+            const UINT sizeBytes = RosTFormat::GetSizeBytes(width, height, bytesPerPixel);
+            const UINT tiles = RosTFormat::GetWidthInTiles(width, bytesPerPixel);
+
+            std::vector<bool> written(sizeBytes / bytesPerPixel, false);
+
+            for (UINT y = 0; y < height; ++y) {
+                for (UINT x = 0; x < width; ++x) {
+                    const UINT offset = RosTFormat::GetPixelOffset(tiles, x, y, bytesPerPixel);
+
+                    VERIFY_ARE_EQUAL(0u, offset % bytesPerPixel);
+                    VERIFY_IS_TRUE(offset + bytesPerPixel <= sizeBytes);
+                    VERIFY_IS_FALSE(written[offset / bytesPerPixel]);
+
+                    written[offset / bytesPerPixel] = true;
+                }
+            }
+        }
+    }
+}
+
+void TFormatTests::TestRoundTrip ()
+{
+    const UINT sizes[][2] = {
+        { 1, 1 },
+        { 5, 3 },
+        { 17, 16 },
+        { 32, 32 },
+        { 33, 65 },
+        { 100, 100 },
+        { 800, 480 },
+    };
+
+    for (const auto & size : sizes) {
+        for (UINT bytesPerPixel = 1; bytesPerPixel <= 4; bytesPerPixel *= 2) {
+            const UINT width = size[0];
+            const UINT height = size[1];
+            const UINT pitch = width * bytesPerPixel + 12;
+            const UINT tiles = RosTFormat::GetWidthInTiles(width, bytesPerPixel);
+
+            std::vector<BYTE> linear(pitch * height, PADDING);
+            for (UINT y = 0; y < height; ++y) {
+                for (UINT i = 0; i < width * bytesPerPixel; ++i) {
+                    linear[y * pitch + i] = PixelByte(i / bytesPerPixel, y, i % bytesPerPixel);
+                }
+            }
+
+            std::vector<BYTE> tFormat(RosTFormat::GetSizeBytes(width, height, bytesPerPixel), PADDING);
+            RosTFormat::Tile(&linear[0], pitch, &tFormat[0], tiles, width, height, bytesPerPixel);
+
+            UINT written = 0;
+            for (UINT y = 0; y < height; ++y) {
+                for (UINT x = 0; x < width; ++x) {
+                    const UINT offset = RosTFormat::GetPixelOffset(tiles, x, y, bytesPerPixel);
+
+                    for (UINT b = 0; b < bytesPerPixel; ++b) {
+                        VERIFY_ARE_EQUAL(PixelByte(x, y, b), tFormat[offset + b]);
+                    }
+                }
+            }
+
+            for (BYTE value : tFormat) {
+                if (value != PADDING) {
+                    ++written;
+                }
+            }
+
+            //
+            // Only the pixels are written, a pixel byte may equal the padding
+            //
+            VERIFY_IS_TRUE(written <= width * height * bytesPerPixel);
+
+            std::vector<BYTE> detiled(pitch * height, PADDING);
+            RosTFormat::Detile(&tFormat[0], tiles, &detiled[0], pitch, width, height, bytesPerPixel);
+
+            VERIFY_IS_TRUE(detiled == linear);
+        }
+    }
+}
+
+struct TextureMapping {
+    const wchar_t * m_name;
+
+    // Texel of a pixel of the frame, in 1/256 of a texel
+    int m_uFromX;
+    int m_uFromY;
+    int m_vFromX;
+    int m_vFromY;
+};
+
+static const TextureMapping s_mappings[] = {
+    { L"stretched", TEXTURE_SIZE * 256 / FRAME_WIDTH, 0, 0, TEXTURE_SIZE * 256 / FRAME_HEIGHT },
+    { L"rotated", 0, TEXTURE_SIZE * 256 / FRAME_HEIGHT, TEXTURE_SIZE * 256 / FRAME_WIDTH, 0 },
+    { L"minified", 2 * 256, 0, 0, 2 * 256 },
+};
+
+//
+// Texture cache misses of a frame filtering the 2x2 texels around each
+// pixel, in the tiles of the Rendering Control List
+//
+static UINT SampleFrame (
+    const TextureMapping & Mapping,
+    bool Linear)
+{
+    const UINT linearWidth =
+        (TEXTURE_SIZE + LINEAR_ALIGNMENT_PIXELS - 1) / LINEAR_ALIGNMENT_PIXELS * LINEAR_ALIGNMENT_PIXELS;
+    const UINT widthInTiles = RosTFormat::GetWidthInTiles(TEXTURE_SIZE, PIXEL_BYTES);
+
+    LruCache cache(TEXTURE_CACHE_LINES);
+
+    RosTileOrder order(
+        RosTileOrder::Choose(true),
+        (FRAME_WIDTH + TILE_PIXELS - 1) / TILE_PIXELS,
+        (FRAME_HEIGHT + TILE_PIXELS - 1) / TILE_PIXELS);
+    UINT tileX;
+    UINT tileY;
+
+    while (order.Next(&tileX, &tileY)) {
+        for (UINT y = tileY * TILE_PIXELS; y < (tileY + 1) * TILE_PIXELS && y < FRAME_HEIGHT; ++y) {
+            for (UINT x = tileX * TILE_PIXELS; x < (tileX + 1) * TILE_PIXELS && x < FRAME_WIDTH; ++x) {
+                const int u = (x * Mapping.m_uFromX + y * Mapping.m_uFromY) / 256;
+                const int v = (x * Mapping.m_vFromX + y * Mapping.m_vFromY) / 256;
+
+                for (UINT texel = 0; texel < 4; ++texel) {
+                    const UINT s = (u + (texel & 1)) % TEXTURE_SIZE;
+                    const UINT t = (v + (texel >> 1)) % TEXTURE_SIZE;
+
+                    const UINT offset = Linear ?
+                        (t * linearWidth + s) * PIXEL_BYTES :
+                        RosTFormat::GetPixelOffset(widthInTiles, s, t, PIXEL_BYTES);
+
+                    cache.Access(offset / CACHE_LINE_BYTES);
+                }
+            }
+        }
+    }
+
+    return cache.Misses();
+}
+
+void TFormatTests::TestRenderToTextureSampling ()
+{
+    UINT linearMisses = 0;
+    UINT tFormatMisses = 0;
+
+    for (const TextureMapping & mapping : s_mappings) {
+        const UINT linear = SampleFrame(mapping, true);
+        const UINT tFormat = SampleFrame(mapping, false);
+
+        LogComment(
+            L"%ux%u texture %s over %ux%u: %u texture cache misses linear, %u T-format",
+            TEXTURE_SIZE,
+            TEXTURE_SIZE,
+            mapping.m_name,
+            FRAME_WIDTH,
+            FRAME_HEIGHT,
+            linear,
+            tFormat);
+
+        linearMisses += linear;
+        tFormatMisses += tFormat;
+    }
+
+    //
+    // Rows of texels are a cache line apart in a linear texture, and share
+    // them in a T-format one whichever way the texture is sampled
+    //
+    VERIFY_IS_TRUE(SampleFrame(s_mappings[1], false) < SampleFrame(s_mappings[1], true));
+    VERIFY_IS_TRUE(tFormatMisses < linearMisses);
+}
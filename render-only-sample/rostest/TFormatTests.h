@@ -0,0 +1,32 @@
+#ifndef _TFORMAT_TESTS_H_
+#define _TFORMAT_TESTS_H_
+
+//
+// Tests of the T-format layout of render targets and textures. These run on
+// the host, a cache model stands in for the TMU.
+//
+class TFormatTests {
+    BEGIN_TEST_CLASS(TFormatTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestPixelLayout)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies the offsets of pixels in the microtiles, subtiles and tiles of a T-format surface, that rows of tiles alternate direction, and that every pixel has its own offset within the size of the surface.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestRoundTrip)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Tiles linear surfaces of several sizes and pixel sizes to T-format and back, and verifies that the pixels are unchanged and that the padding of the surfaces isn't written.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestRenderToTextureSampling)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Samples a texture rendered to, stored linear and T-format, over a frame stretched, rotated and minified through a model of the texture cache, reports the misses and verifies that T-format has fewer.")
+    END_TEST_METHOD()
+};
+
+#endif // _TFORMAT_TESTS_H_
@@ -0,0 +1,303 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "CacheModel.h"
+#include "TileOrderTests.h"
+
+#include "RosTileOrder.h"
+
+#include <vector>
+
+using namespace WEX::TestExecution;
+
+//
+// Tiles of the Rendering Control List (Vc4Ddi.h), 32 bit render targets
+//
+const UINT TILE_PIXELS = 64;
+const UINT PIXEL_BYTES = 4;
+
+//
+// T-format: 4KB tiles of 32x32 pixels, rows of them alternate direction
+//
+const UINT T_FORMAT_TILE_PIXELS = 32;
+const UINT T_FORMAT_TILE_BYTES = 4096;
+
+//
+// Memory pages kept open, the pages of the tiles loaded and stored before
+// are least recently used first
+//
+const UINT PAGE_SIZE = 4096;
+const UINT OPEN_PAGES = 64;
+
+//
+// Texture cache of 64 byte lines, a line is the 4x4 texel microtile of a
+// T-format texture
+//
+const UINT TEXTURE_CACHE_LINES = 256;
+const UINT MICROTILE_TEXELS = 4;
+
+//
+// The texture covers the render target at half its resolution, the
+// bilinear filter fetches the 2x2 texels around each pixel
+//
+const UINT TEXTURE_SCALE = 2;
+
+static const RosTileOrderType s_orders[] = {
+    ROS_TILE_ORDER_COLUMN_MAJOR,
+    ROS_TILE_ORDER_ROW_MAJOR,
+    ROS_TILE_ORDER_SERPENTINE,
+    ROS_TILE_ORDER_MORTON,
+    ROS_TILE_ORDER_HILBERT,
+};
+
+static const wchar_t * s_orderNames[] = {
+    L"column-major",
+    L"row-major",
+    L"serpentine",
+    L"Morton",
+    L"Hilbert",
+};
+
+const UINT NUM_ORDERS = sizeof(s_orders) / sizeof(s_orders[0]);
+
+struct ReplayedFrame {
+    const wchar_t * m_name;
+    UINT m_widthInTiles;
+    UINT m_heightInTiles;
+};
+
+//
+// Frames of the Dolphin demo and of a 1080p desktop
+//
+static const ReplayedFrame s_frames[] = {
+    { L"800x480", 13, 8 },
+    { L"1920x1080", 30, 17 },
+};
+
+//
+// Pages of the render target under a tile, in the order the tile buffer
+// loads or stores them
+//
+static void AccessTilePages (
+    LruCache & Pages,
+    const ReplayedFrame & Frame,
+    bool Linear,
+    UINT X,
+    UINT Y)
+{
+    if (Linear) {
+        const UINT pitch = Frame.m_widthInTiles * TILE_PIXELS * PIXEL_BYTES;
+
+        for (UINT row = 0; row < TILE_PIXELS; ++row) {
+            const UINT offset =
+                (Y * TILE_PIXELS + row) * pitch + X * TILE_PIXELS * PIXEL_BYTES;
+
+            Pages.Access(offset / PAGE_SIZE);
+            Pages.Access((offset + TILE_PIXELS * PIXEL_BYTES - 1) / PAGE_SIZE);
+        }
+    } else {
+        const UINT tFormatTilesPerTile = TILE_PIXELS / T_FORMAT_TILE_PIXELS;
+        const UINT tFormatTilesPerRow = Frame.m_widthInTiles * tFormatTilesPerTile;
+
+        for (UINT j = 0; j < tFormatTilesPerTile; ++j) {
+            for (UINT i = 0; i < tFormatTilesPerTile; ++i) {
+                const UINT row = Y * tFormatTilesPerTile + j;
+                UINT column = X * tFormatTilesPerTile + i;
+
+                if (row & 1) {
+                    column = tFormatTilesPerRow - 1 - column;
+                }
+
+                const UINT offset = (row * tFormatTilesPerRow + column) * T_FORMAT_TILE_BYTES;
+
+                Pages.Access(offset / PAGE_SIZE);
+            }
+        }
+    }
+}
+
+//
+// Microtiles of the texels the pixels of a tile filter
+//
+static void AccessTileTexels (
+    LruCache & Texture,
+    const ReplayedFrame & Frame,
+    UINT X,
+    UINT Y)
+{
+    const UINT textureWidth = Frame.m_widthInTiles * TILE_PIXELS / TEXTURE_SCALE;
+    const UINT textureHeight = Frame.m_heightInTiles * TILE_PIXELS / TEXTURE_SCALE;
+    const UINT microtilesPerRow = textureWidth / MICROTILE_TEXELS;
+
+    //
+    // The texels around the pixels of the tile, clamped to the texture
+    //
+    const UINT texelsPerTile = TILE_PIXELS / TEXTURE_SCALE;
+    const UINT left = (X == 0) ? 0 : X * texelsPerTile - 1;
+    const UINT top = (Y == 0) ? 0 : Y * texelsPerTile - 1;
+    const UINT right = (X + 1 == Frame.m_widthInTiles) ?
+        textureWidth - 1 : (X + 1) * texelsPerTile;
+    const UINT bottom = (Y + 1 == Frame.m_heightInTiles) ?
+        textureHeight - 1 : (Y + 1) * texelsPerTile;
+
+    for (UINT v = top / MICROTILE_TEXELS; v <= bottom / MICROTILE_TEXELS; ++v) {
+        for (UINT u = left / MICROTILE_TEXELS; u <= right / MICROTILE_TEXELS; ++u) {
+            Texture.Access(v * microtilesPerRow + u);
+        }
+    }
+}
+
+struct TileOrderMisses {
+    UINT m_pageMisses;
+    UINT m_textureMisses;
+};
+
+//
+// Control list of a pass that loads and stores every tile of the render
+// target and samples the texture in the tile
+//
+static TileOrderMisses SimulateFrame (
+    const ReplayedFrame & Frame,
+    RosTileOrderType Order,
+    bool Linear)
+{
+    LruCache pages(OPEN_PAGES);
+    LruCache texture(TEXTURE_CACHE_LINES);
+
+    RosTileOrder order(Order, Frame.m_widthInTiles, Frame.m_heightInTiles);
+    UINT x;
+    UINT y;
+
+    while (order.Next(&x, &y)) {
+        AccessTilePages(pages, Frame, Linear, x, y);
+        AccessTileTexels(texture, Frame, x, y);
+        AccessTilePages(pages, Frame, Linear, x, y);
+    }
+
+    TileOrderMisses misses = { pages.Misses(), texture.Misses() };
+    return misses;
+}
+
+void TileOrderTests::TestEveryTileOnce ()
+{
+    const UINT sizes[][2] = {
+        { 1, 1 },
+        { 1, 7 },
+        { 5, 1 },
+        { 4, 4 },
+        { 13, 8 },
+        { 30, 17 },
+        { 16, 16 },
+    };
+
+    for (const auto & size : sizes) {
+        const UINT width = size[0];
+        const UINT height = size[1];
+
+        for (UINT i = 0; i < NUM_ORDERS; ++i) {
+            RosTileOrder order(s_orders[i], width, height);
+            VERIFY_ARE_EQUAL(width * height, order.GetCount());
+
+            std::vector<UINT> visits(width * height, 0);
+            UINT count = 0;
+            UINT x;
+            UINT y;
+            UINT lastX = 0;
+            UINT lastY = 0;
+
+            while (order.Next(&x, &y)) {
+                VERIFY_IS_TRUE(x < width);
+                VERIFY_IS_TRUE(y < height);
+                ++visits[y * width + x];
+
+                //
+                // Only the curves jump over the tiles outside of the render
+                // target
+                //
+                const bool square = (width == height) && ((width & (width - 1)) == 0);
+                if (count &&
+                    ((s_orders[i] == ROS_TILE_ORDER_SERPENTINE) ||
+                     ((s_orders[i] == ROS_TILE_ORDER_HILBERT) && square))) {
+                    const UINT distance =
+                        ((x > lastX) ? x - lastX : lastX - x) +
+                        ((y > lastY) ? y - lastY : lastY - y);
+                    VERIFY_ARE_EQUAL(1u, distance);
+                }
+
+                if (count && (s_orders[i] == ROS_TILE_ORDER_ROW_MAJOR) && x) {
+                    VERIFY_ARE_EQUAL(lastX + 1, x);
+                    VERIFY_ARE_EQUAL(lastY, y);
+                }
+
+                lastX = x;
+                lastY = y;
+                ++count;
+            }
+
+            VERIFY_ARE_EQUAL(width * height, count);
+            for (UINT visit : visits) {
+                VERIFY_ARE_EQUAL(1u, visit);
+            }
+
+            //
+            // The order restarts for the next pass
+            //
+            VERIFY_IS_TRUE(order.Next(&x, &y));
+            VERIFY_ARE_EQUAL(0u, x);
+            VERIFY_ARE_EQUAL(0u, y);
+        }
+    }
+}
+
+void TileOrderTests::TestCacheMisses ()
+{
+    for (const ReplayedFrame & frame : s_frames) {
+        for (UINT layout = 0; layout < 2; ++layout) {
+            const bool linear = (layout == 0);
+            const RosTileOrderType chosen = RosTileOrder::Choose(linear);
+
+            TileOrderMisses misses[NUM_ORDERS];
+            TileOrderMisses chosenMisses = {};
+
+            for (UINT i = 0; i < NUM_ORDERS; ++i) {
+                misses[i] = SimulateFrame(frame, s_orders[i], linear);
+
+                LogComment(
+                    L"%s %s, %s%s: %u page misses, %u texture cache misses",
+                    frame.m_name,
+                    linear ? L"linear" : L"T-format",
+                    s_orderNames[i],
+                    (s_orders[i] == chosen) ? L" (chosen)" : L"",
+                    misses[i].m_pageMisses,
+                    misses[i].m_textureMisses);
+
+                if (s_orders[i] == chosen) {
+                    chosenMisses = misses[i];
+                }
+            }
+
+            for (UINT i = 0; i < NUM_ORDERS; ++i) {
+                VERIFY_IS_TRUE(chosenMisses.m_pageMisses <= misses[i].m_pageMisses);
+
+                if (chosenMisses.m_pageMisses == misses[i].m_pageMisses) {
+                    VERIFY_IS_TRUE(chosenMisses.m_textureMisses <= misses[i].m_textureMisses);
+                }
+
+                //
+                // A T-format render target has pages of its own for every
+                // tile, only the texture cache tells the orders apart
+                //
+                if (!linear) {
+                    VERIFY_ARE_EQUAL(misses[0].m_pageMisses, misses[i].m_pageMisses);
+                    VERIFY_IS_TRUE(chosenMisses.m_textureMisses <= misses[i].m_textureMisses);
+                }
+            }
+
+            //
+            // Column-major order was used for both
+            //
+            VERIFY_IS_TRUE(chosenMisses.m_pageMisses + chosenMisses.m_textureMisses <
+                           misses[0].m_pageMisses + misses[0].m_textureMisses);
+        }
+    }
+}
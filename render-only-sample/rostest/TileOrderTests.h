@@ -0,0 +1,26 @@
+#ifndef _TILE_ORDER_TESTS_H_
+#define _TILE_ORDER_TESTS_H_
+
+//
+// Tests of the order the Rendering Control List renders tiles in. These run
+// on the host, a cache model stands in for the memory of the V3D.
+//
+class TileOrderTests {
+    BEGIN_TEST_CLASS(TileOrderTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestEveryTileOnce)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that every order renders each tile of render targets of several sizes once, and that row-major, serpentine and Hilbert orders move to a neighbouring tile.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestCacheMisses)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Replays the tile loads, stores and texture fetches of frames in each order through a model of the open memory pages and of the texture cache, reports the misses and verifies that the order chosen for a linear and a T-format render target has the fewest.")
+    END_TEST_METHOD()
+};
+
+#endif // _TILE_ORDER_TESTS_H_
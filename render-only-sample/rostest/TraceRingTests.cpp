@@ -0,0 +1,492 @@
+#include "precomp.h"
+
+#include "util.h"
+#include "TraceRingTests.h"
+
+#include "RosTraceRing.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <algorithm>
+
+using namespace WEX::TestExecution;
+
+//
+// Every field of an event written by the tests derives from the thread and
+// its event count, so a torn event doesn't check out
+//
+static ULONGLONG EventKey (UINT Thread, UINT Count)
+{
+    return (ULONGLONG(Thread) << 32) | (Count * 2654435761u);
+}
+
+static RosTraceStage EventStage (UINT Count)
+{
+    return RosTraceStage((Count / 2) % ROS_TRACE_NUM_STAGES);
+}
+
+static bool IsWellFormed (const RosTraceEvent& Event)
+{
+    return
+        (Event.m_submission == EventKey(Event.m_thread, Event.m_fenceId)) &&
+        (Event.m_stage == EventStage(Event.m_fenceId)) &&
+        (Event.m_phase == ((Event.m_fenceId & 1) ? ROS_TRACE_END : ROS_TRACE_BEGIN)) &&
+        (Event.m_cpu == Event.m_thread % RosTrace::kMaxRings);
+}
+
+static bool EarlierEvent (const RosTraceEvent& Left, const RosTraceEvent& Right)
+{
+    return Left.m_timestamp < Right.m_timestamp;
+}
+
+void TraceRingTests::TestConcurrentWriters ()
+{
+    const UINT numThreads = 2 * RosTrace::kMaxRings;
+    const UINT eventsPerThread = 20000;
+    const UINT eventsPerRing = 1 << 16;
+
+    std::vector<RosTraceEvent> events(RosTrace::kMaxRings * eventsPerRing);
+
+    RosTrace trace;
+    trace.Init(events.data(), eventsPerRing, RosTrace::kMaxRings);
+    trace.Enable(true);
+
+    //
+    // The clock is shared, so the timestamps order the events of all the
+    // threads
+    //
+    std::atomic<ULONGLONG> clock(1);
+    std::atomic<UINT> running(numThreads);
+    std::atomic<bool> start(false);
+
+    std::vector<std::thread> writers;
+    for (UINT thread = 0; thread < numThreads; ++thread) {
+        writers.emplace_back([&trace, &clock, &running, &start, thread, eventsPerThread] {
+            while (!start) {
+                std::this_thread::yield();
+            }
+
+            for (UINT count = 0; count < eventsPerThread; ++count) {
+                trace.Write(
+                    thread % RosTrace::kMaxRings,
+                    thread,
+                    clock++,
+                    EventStage(count),
+                    (count & 1) ? ROS_TRACE_END : ROS_TRACE_BEGIN,
+                    count,
+                    EventKey(thread, count));
+            }
+            --running;
+        });
+    }
+
+    //
+    // Snapshots taken while the threads write only hold complete events
+    //
+    std::vector<RosTraceEvent> snapshot(trace.GetMaxEvents());
+    UINT numSnapshots = 0;
+    UINT numChecked = 0;
+
+    start = true;
+
+    while (running != 0) {
+        const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+
+        for (UINT i = 0; i < numEvents; ++i) {
+            VERIFY_IS_TRUE(IsWellFormed(snapshot[i]), L"Snapshot holds a torn event");
+        }
+
+        ++numSnapshots;
+        numChecked += numEvents;
+    }
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    //
+    // Nothing wrapped, every event is in its ring in write order
+    //
+    for (UINT ring = 0; ring < RosTrace::kMaxRings; ++ring) {
+        VERIFY_ARE_EQUAL(2 * eventsPerThread, trace.GetRing(ring).GetWriteCount());
+    }
+
+    const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+    VERIFY_ARE_EQUAL(numThreads * eventsPerThread, numEvents);
+
+    UINT first = 0;
+    for (UINT ring = 0; ring < RosTrace::kMaxRings; ++ring) {
+        for (UINT i = 0; i < 2 * eventsPerThread; ++i) {
+            VERIFY_ARE_EQUAL(i + 1, snapshot[first + i].m_sequence);
+        }
+        first += 2 * eventsPerThread;
+    }
+
+    //
+    // In timestamp order the events of every thread come in the order the
+    // thread wrote them, begin and end alternating
+    //
+    std::stable_sort(snapshot.begin(), snapshot.begin() + numEvents, EarlierEvent);
+
+    std::vector<UINT> nextCount(numThreads, 0);
+    for (UINT i = 0; i < numEvents; ++i) {
+        const RosTraceEvent& event = snapshot[i];
+
+        VERIFY_IS_TRUE(IsWellFormed(event));
+        VERIFY_ARE_EQUAL(nextCount[event.m_thread], event.m_fenceId);
+
+        ++nextCount[event.m_thread];
+    }
+
+    LogComment(
+        L"%u threads wrote %u events to %u rings, %u snapshots checked %u events while they wrote",
+        numThreads,
+        numEvents,
+        RosTrace::kMaxRings,
+        numSnapshots,
+        numChecked);
+}
+
+void TraceRingTests::TestWrapAround ()
+{
+    const UINT eventsPerRing = 64;
+    const UINT numWrites = 1000;
+
+    std::vector<RosTraceEvent> events(eventsPerRing);
+
+    RosTrace trace;
+    trace.Init(events.data(), eventsPerRing, 1);
+
+    for (UINT count = 0; count < numWrites; ++count) {
+        trace.Write(0, 0, count, EventStage(count), (count & 1) ? ROS_TRACE_END : ROS_TRACE_BEGIN, count, EventKey(0, count));
+    }
+
+    std::vector<RosTraceEvent> snapshot(eventsPerRing);
+    const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+
+    VERIFY_ARE_EQUAL(eventsPerRing, numEvents);
+
+    for (UINT i = 0; i < numEvents; ++i) {
+        const UINT count = numWrites - eventsPerRing + i;
+
+        VERIFY_IS_TRUE(IsWellFormed(snapshot[i]));
+        VERIFY_ARE_EQUAL(count, snapshot[i].m_fenceId);
+        VERIFY_ARE_EQUAL(count + 1, snapshot[i].m_sequence);
+    }
+
+    //
+    // A smaller snapshot keeps the most recent events
+    //
+    const UINT numPartial = trace.Snapshot(snapshot.data(), 10);
+
+    VERIFY_ARE_EQUAL(10u, numPartial);
+    VERIFY_ARE_EQUAL(numWrites - 10, snapshot[0].m_fenceId);
+}
+
+static UINT CountOf (const std::string& Text, const char* pPattern)
+{
+    UINT count = 0;
+    for (size_t pos = Text.find(pPattern); pos != std::string::npos; pos = Text.find(pPattern, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+void TraceRingTests::TestChromeTrace ()
+{
+    const UINT eventsPerRing = 256;
+    const UINT numDmaBuffers = 10;
+
+    std::vector<RosTraceEvent> events(RosTrace::kMaxRings * eventsPerRing);
+
+    RosTrace trace;
+    trace.Init(events.data(), eventsPerRing, RosTrace::kMaxRings);
+    trace.Enable(true);
+
+    //
+    // DMA buffers rendered on the application thread and CPU, patched and
+    // queued on the scheduler's, and run by the worker
+    //
+    const UINT appThread = 100;
+    const UINT schedulerThread = 200;
+    const UINT workerThread = 300;
+
+    ULONGLONG clock = 1000;
+
+    for (UINT i = 0; i < numDmaBuffers; ++i) {
+        const UINT fenceId = 50 + i;
+        const ULONGLONG submission = 1 + i;
+
+        trace.Write(0, appThread, clock += 10, ROS_TRACE_RENDER, ROS_TRACE_BEGIN, 0, submission);
+        trace.Write(0, appThread, clock += 10, ROS_TRACE_RENDER, ROS_TRACE_END, 0, submission);
+
+        trace.Write(1, schedulerThread, clock += 10, ROS_TRACE_PATCH, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(1, schedulerThread, clock += 10, ROS_TRACE_PATCH, ROS_TRACE_END, fenceId, submission);
+        trace.Write(1, schedulerThread, clock += 10, ROS_TRACE_QUEUE, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(1, schedulerThread, clock += 10, ROS_TRACE_QUEUE, ROS_TRACE_END, fenceId, submission);
+
+        //
+        // The worker moves to another CPU halfway through
+        //
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_RUN, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_GENERATE_RCL, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_GENERATE_RCL, ROS_TRACE_END, fenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_BINNING, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(3, workerThread, clock += 10, ROS_TRACE_BINNING, ROS_TRACE_END, fenceId, submission);
+        trace.Write(3, workerThread, clock += 10, ROS_TRACE_RENDERING, ROS_TRACE_BEGIN, fenceId, submission);
+        trace.Write(3, workerThread, clock += 10, ROS_TRACE_RENDERING, ROS_TRACE_END, fenceId, submission);
+        trace.Write(3, workerThread, clock += 10, ROS_TRACE_COMPLETE, ROS_TRACE_INSTANT, fenceId, submission);
+        trace.Write(3, workerThread, clock += 10, ROS_TRACE_RUN, ROS_TRACE_END, fenceId, submission);
+    }
+
+    std::vector<RosTraceEvent> snapshot(trace.GetMaxEvents());
+    const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+
+    VERIFY_ARE_EQUAL(15 * numDmaBuffers, numEvents);
+
+    //
+    // 10 ticks per microsecond. The length doesn't depend on the buffer.
+    //
+    const size_t length = RosTrace::FormatChromeTrace(snapshot.data(), numEvents, 10000000, nullptr, 0);
+
+    char truncated[64];
+    VERIFY_ARE_EQUAL(length, RosTrace::FormatChromeTrace(snapshot.data(), numEvents, 10000000, truncated, sizeof(truncated)));
+    VERIFY_ARE_EQUAL(sizeof(truncated) - 1, strlen(truncated));
+
+    std::vector<char> buffer(length + 1);
+    VERIFY_ARE_EQUAL(length, RosTrace::FormatChromeTrace(snapshot.data(), numEvents, 10000000, buffer.data(), buffer.size()));
+
+    const std::string json(buffer.data());
+
+    VERIFY_ARE_EQUAL(length, json.size());
+    VERIFY_ARE_EQUAL(0u, json.find("{\"traceEvents\":["));
+    VERIFY_ARE_EQUAL(CountOf(json, "{"), CountOf(json, "}"));
+    VERIFY_ARE_EQUAL(CountOf(json, "["), CountOf(json, "]"));
+
+    VERIFY_ARE_EQUAL(7 * numDmaBuffers, CountOf(json, "\"ph\":\"B\""));
+    VERIFY_ARE_EQUAL(7 * numDmaBuffers, CountOf(json, "\"ph\":\"E\""));
+    VERIFY_ARE_EQUAL(numDmaBuffers, CountOf(json, "\"ph\":\"i\""));
+
+    //
+    // The first event is at 0, each one 1us after the previous one
+    //
+    VERIFY_IS_TRUE(json.find("\"ts\":0.000,") != std::string::npos);
+    VERIFY_IS_TRUE(json.find("\"ts\":149.000,") != std::string::npos);
+
+    //
+    // Every event of a DMA buffer carries its fence, including the ones
+    // before it was submitted
+    //
+    for (UINT i = 0; i < numDmaBuffers; ++i) {
+        char fence[32];
+        sprintf_s(fence, "\"fence\":%u,", 50 + i);
+
+        VERIFY_ARE_EQUAL(15u, CountOf(json, fence));
+    }
+
+    VERIFY_ARE_EQUAL(0u, CountOf(json, "\"fence\":0,"));
+
+    //
+    // The worker's nested stages are in order on its thread although they
+    // were written to two rings
+    //
+    const size_t binningBegin = json.find("\"name\":\"BinningControlList\",\"cat\":\"roskmd\",\"ph\":\"B\"");
+    const size_t binningEnd = json.find("\"name\":\"BinningControlList\",\"cat\":\"roskmd\",\"ph\":\"E\"");
+    const size_t renderingBegin = json.find("\"name\":\"RenderingControlList\",\"cat\":\"roskmd\",\"ph\":\"B\"");
+
+    VERIFY_IS_TRUE((binningBegin < binningEnd) && (binningEnd < renderingBegin));
+
+    //
+    // Cost of an event, against the time it takes to run a DMA buffer
+    // (milliseconds)
+    //
+    const UINT numWrites = 1000000;
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+
+    QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&start);
+    for (UINT i = 0; i < numWrites; ++i) {
+        LARGE_INTEGER timestamp;
+        QueryPerformanceCounter(&timestamp);
+
+        trace.Write(i % RosTrace::kMaxRings, workerThread, timestamp.QuadPart, ROS_TRACE_RUN, ROS_TRACE_BEGIN, i, 0x1000);
+    }
+    QueryPerformanceCounter(&end);
+
+    const double enabledNs = double(end.QuadPart - start.QuadPart) * 1e9 / double(frequency.QuadPart) / numWrites;
+
+    trace.Enable(false);
+
+    UINT numSkipped = 0;
+
+    QueryPerformanceCounter(&start);
+    for (UINT i = 0; i < numWrites; ++i) {
+        if (trace.IsEnabled()) {
+            trace.Write(i % RosTrace::kMaxRings, workerThread, i, ROS_TRACE_RUN, ROS_TRACE_BEGIN, i, 0x1000);
+        } else {
+            ++numSkipped;
+        }
+    }
+    QueryPerformanceCounter(&end);
+
+    const double disabledNs = double(end.QuadPart - start.QuadPart) * 1e9 / double(frequency.QuadPart) / numWrites;
+
+    VERIFY_ARE_EQUAL(numWrites, numSkipped);
+
+    LogComment(
+        L"Chrome trace of %u DMA buffers is %u bytes, an event costs %.1fns enabled (%u per DMA buffer) and %.2fns disabled",
+        numDmaBuffers,
+        UINT(length),
+        enabledNs,
+        15,
+        disabledNs);
+}
+
+void TraceRingTests::TestFrameRecords ()
+{
+    const UINT eventsPerRing = 256;
+
+    std::vector<RosTraceEvent> events(RosTrace::kMaxRings * eventsPerRing);
+
+    RosTrace trace;
+    trace.Init(events.data(), eventsPerRing, RosTrace::kMaxRings);
+    trace.Enable(true);
+
+    const UINT appThread = 100;
+    const UINT workerThread = 300;
+    const UINT displayThread = 0;
+
+    ULONGLONG clock = 1000;
+
+    struct DmaBufferTimes {
+        ULONGLONG m_submit;
+        ULONGLONG m_queue;
+        ULONGLONG m_renderingEnd;
+    };
+
+    auto writeDmaBuffer = [&] (UINT FenceId) {
+        const ULONGLONG submission = FenceId;
+        DmaBufferTimes times;
+
+        trace.Write(0, appThread, times.m_submit = clock += 10, ROS_TRACE_RENDER, ROS_TRACE_BEGIN, 0, submission);
+        trace.Write(0, appThread, clock += 10, ROS_TRACE_RENDER, ROS_TRACE_END, 0, submission);
+        trace.Write(1, appThread, times.m_queue = clock += 10, ROS_TRACE_QUEUE, ROS_TRACE_BEGIN, FenceId, submission);
+        trace.Write(1, appThread, clock += 10, ROS_TRACE_QUEUE, ROS_TRACE_END, FenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_BINNING, ROS_TRACE_BEGIN, FenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_BINNING, ROS_TRACE_END, FenceId, submission);
+        trace.Write(2, workerThread, clock += 10, ROS_TRACE_RENDERING, ROS_TRACE_BEGIN, FenceId, submission);
+        trace.Write(2, workerThread, times.m_renderingEnd = clock += 10, ROS_TRACE_RENDERING, ROS_TRACE_END, FenceId, submission);
+
+        return times;
+    };
+
+    //
+    // The first frame renders a texture, then the primary, and is flipped
+    // on vsync
+    //
+    const DmaBufferTimes texture = writeDmaBuffer(1);
+    const DmaBufferTimes firstFrame = writeDmaBuffer(2);
+
+    const ULONGLONG firstFlip = clock += 10;
+    trace.Write(3, displayThread, firstFlip, ROS_TRACE_QUEUE_FLIP, ROS_TRACE_INSTANT, 2, 0);
+    trace.Write(3, displayThread, clock += 10, ROS_TRACE_PROGRAM_FLIP, ROS_TRACE_INSTANT, 2, 0);
+
+    //
+    // The second frame waits behind it and is replaced by the third, an
+    // immediate flip
+    //
+    writeDmaBuffer(3);
+    trace.Write(3, displayThread, clock += 10, ROS_TRACE_QUEUE_FLIP, ROS_TRACE_INSTANT, 3, 0);
+
+    const ULONGLONG firstVSync = clock += 10;
+    trace.Write(3, displayThread, firstVSync, ROS_TRACE_SHOW_FLIP, ROS_TRACE_INSTANT, 2, 0);
+
+    const DmaBufferTimes thirdFrame = writeDmaBuffer(4);
+    trace.Write(3, displayThread, clock += 10, ROS_TRACE_QUEUE_FLIP, ROS_TRACE_INSTANT, 4, 0);
+    trace.Write(3, displayThread, clock += 10, ROS_TRACE_PROGRAM_FLIP, ROS_TRACE_INSTANT, 4, 0);
+
+    const ULONGLONG thirdVSync = clock += 10;
+    trace.Write(3, displayThread, thirdVSync, ROS_TRACE_SHOW_FLIP, ROS_TRACE_INSTANT, 4, 0);
+
+    //
+    // Not flipped yet
+    //
+    writeDmaBuffer(5);
+
+    std::vector<RosTraceEvent> snapshot(trace.GetMaxEvents());
+    const UINT numEvents = trace.Snapshot(snapshot.data(), UINT(snapshot.size()));
+
+    VERIFY_ARE_EQUAL(3u, RosTrace::GetFrameRecords(snapshot.data(), numEvents, nullptr, 0));
+
+    RosFrameRecord records[4];
+    VERIFY_ARE_EQUAL(3u, RosTrace::GetFrameRecords(snapshot.data(), numEvents, records, ARRAYSIZE(records)));
+
+    VERIFY_ARE_EQUAL(2u, records[0].m_fenceId);
+    VERIFY_ARE_EQUAL(2u, records[0].m_numDmaBuffers);
+    VERIFY_ARE_EQUAL(texture.m_submit, records[0].m_submit);
+    VERIFY_ARE_EQUAL(firstFrame.m_queue, records[0].m_queue);
+    VERIFY_ARE_EQUAL(texture.m_renderingEnd - 30, records[0].m_binningStart);
+    VERIFY_ARE_EQUAL(firstFrame.m_renderingEnd, records[0].m_renderingEnd);
+    VERIFY_ARE_EQUAL(firstFlip, records[0].m_flipQueued);
+    VERIFY_ARE_EQUAL(firstFlip + 10, records[0].m_flipProgrammed);
+    VERIFY_ARE_EQUAL(firstVSync, records[0].m_vsync);
+
+    VERIFY_ARE_EQUAL(3u, records[1].m_fenceId);
+    VERIFY_ARE_EQUAL(1u, records[1].m_numDmaBuffers);
+    VERIFY_ARE_EQUAL(0ull, records[1].m_flipProgrammed);
+    VERIFY_ARE_EQUAL(0ull, records[1].m_vsync);
+
+    VERIFY_ARE_EQUAL(4u, records[2].m_fenceId);
+    VERIFY_ARE_EQUAL(1u, records[2].m_numDmaBuffers);
+    VERIFY_ARE_EQUAL(thirdFrame.m_submit, records[2].m_submit);
+    VERIFY_ARE_EQUAL(thirdVSync, records[2].m_vsync);
+
+    //
+    // 10 ticks per microsecond, from the submission of the first frame
+    //
+    const size_t length = RosTrace::FormatFrameCsv(records, 3, 10000000, nullptr, 0);
+
+    std::vector<char> buffer(length + 1);
+    VERIFY_ARE_EQUAL(length, RosTrace::FormatFrameCsv(records, 3, 10000000, buffer.data(), buffer.size()));
+
+    const std::string csv(buffer.data());
+
+    VERIFY_ARE_EQUAL(length, csv.size());
+    VERIFY_ARE_EQUAL(0u, csv.find("frame,fence,dmaBuffers,submit,"));
+    VERIFY_ARE_EQUAL(4u, CountOf(csv, "\n"));
+    VERIFY_IS_TRUE(csv.find("\n0,2,2,0.000,") != std::string::npos);
+
+    //
+    // The frame replaced has no vsync, frame time or latency, the frame time
+    // of the next one is from the first frame
+    //
+    VERIFY_IS_TRUE(csv.find(",,,,\n2,4,1,") != std::string::npos);
+
+    char thirdTimes[64];
+    sprintf_s(
+        thirdTimes,
+        ",%.3f,%.3f\n",
+        double(thirdVSync - firstVSync) / 10.0,
+        double(thirdVSync - thirdFrame.m_submit) / 10.0);
+
+    VERIFY_IS_TRUE(csv.find(thirdTimes) == csv.size() - strlen(thirdTimes));
+
+    LogComment(L"%S", csv.c_str());
+
+    //
+    // Nearest rank
+    //
+    ULONGLONG values[] = { 5, 1, 4, 2, 3 };
+
+    VERIFY_ARE_EQUAL(1ull, RosTrace::GetPercentile(values, ARRAYSIZE(values), 0));
+    VERIFY_ARE_EQUAL(3ull, RosTrace::GetPercentile(values, ARRAYSIZE(values), 50));
+    VERIFY_ARE_EQUAL(4ull, RosTrace::GetPercentile(values, ARRAYSIZE(values), 80));
+    VERIFY_ARE_EQUAL(5ull, RosTrace::GetPercentile(values, ARRAYSIZE(values), 95));
+    VERIFY_ARE_EQUAL(5ull, RosTrace::GetPercentile(values, ARRAYSIZE(values), 100));
+}
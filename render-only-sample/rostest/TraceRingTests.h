@@ -0,0 +1,38 @@
+#ifndef _TRACE_RING_TESTS_H_
+#define _TRACE_RING_TESTS_H_
+
+//
+// Tests of the submission trace rings. These run on the host, threads
+// stand in for the CPUs writing to the rings.
+//
+class TraceRingTests {
+    BEGIN_TEST_CLASS(TraceRingTests)
+        TEST_CLASS_PROPERTY(L"ThreadingModel", L"MTA")
+    END_TEST_CLASS()
+
+    BEGIN_TEST_METHOD(TestConcurrentWriters)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Writes from several threads per ring while another thread takes snapshots, and verifies no event is lost or torn and that the events of every thread are in order.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestWrapAround)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Verifies that a ring that wrapped keeps its most recent events.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestChromeTrace)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Formats the trace of DMA buffers going through every stage as a Chrome trace and verifies the timeline, and reports the cost of an event.")
+    END_TEST_METHOD()
+
+    BEGIN_TEST_METHOD(TestFrameRecords)
+        TEST_METHOD_PROPERTY(
+            L"Description",
+            L"Builds the frame records of a trace of frames of several DMA buffers and of a flip replaced by an immediate flip, verifies their stages and CSV, and verifies the percentiles.")
+    END_TEST_METHOD()
+};
+
+#endif // _TRACE_RING_TESTS_H_
@@ -0,0 +1,348 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+// Controls the submission trace of the render-only driver and dumps it as a
+// Chrome trace (chrome://tracing) JSON timeline, or as the records of the
+// frames flipped.
+//
+//   rostrace start             Enables the trace
+//   rostrace stop              Disables the trace
+//   rostrace dump <file>       Writes the events in the rings to <file>
+//   rostrace frames <file>     Writes the frame records to <file> as CSV and
+//                              prints the percentiles of their frame time
+//                              and latency
+//
+// The driver only takes the trace escapes from callers with the system
+// profile privilege, rostrace runs elevated.
+//
+
+#include <windows.h>
+#include <winternl.h>
+#include <d3dkmthk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include <vector>
+
+#include "RosEscape.h"
+
+#ifndef NT_SUCCESS
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#endif
+
+//
+// Events of every ring of the KMD
+//
+const UINT MAX_TRACE_EVENTS = 4 * 1024;
+
+static bool IsRosAdapter (D3DKMT_HANDLE hAdapter)
+{
+    D3DKMT_UMDFILENAMEINFO umdFileNameInfo = {};
+    umdFileNameInfo.Version = KMTUMDVERSION_DX11;
+
+    D3DKMT_QUERYADAPTERINFO queryAdapterInfo = {};
+    queryAdapterInfo.hAdapter = hAdapter;
+    queryAdapterInfo.Type = KMTQAT_UMDFILENAMEINFO;
+    queryAdapterInfo.pPrivateDriverData = &umdFileNameInfo;
+    queryAdapterInfo.PrivateDriverDataSize = sizeof(umdFileNameInfo);
+
+    if (!NT_SUCCESS(D3DKMTQueryAdapterInfo(&queryAdapterInfo))) {
+        return false;
+    }
+
+    const wchar_t* pFileName = wcsrchr(umdFileNameInfo.UmdFileName, L'\\');
+    pFileName = pFileName ? pFileName + 1 : umdFileNameInfo.UmdFileName;
+
+    return _wcsicmp(pFileName, L"rosumd.dll") == 0;
+}
+
+//
+// Opens the first adapter driven by the render-only driver
+//
+static D3DKMT_HANDLE OpenRosAdapter ()
+{
+    D3DKMT_ENUMADAPTERS2 enumAdapters = {};
+
+    if (!NT_SUCCESS(D3DKMTEnumAdapters2(&enumAdapters))) {
+        return 0;
+    }
+
+    std::vector<D3DKMT_ADAPTERINFO> adapters(enumAdapters.NumAdapters);
+    enumAdapters.pAdapters = adapters.data();
+
+    if (!NT_SUCCESS(D3DKMTEnumAdapters2(&enumAdapters))) {
+        return 0;
+    }
+
+    D3DKMT_HANDLE hRosAdapter = 0;
+
+    for (ULONG i = 0; i < enumAdapters.NumAdapters; ++i) {
+        if (!hRosAdapter && IsRosAdapter(adapters[i].hAdapter)) {
+            hRosAdapter = adapters[i].hAdapter;
+            continue;
+        }
+
+        D3DKMT_CLOSEADAPTER closeAdapter = {};
+        closeAdapter.hAdapter = adapters[i].hAdapter;
+        D3DKMTCloseAdapter(&closeAdapter);
+    }
+
+    return hRosAdapter;
+}
+
+//
+// Enables the system profile privilege of the process, administrators hold
+// it disabled
+//
+static bool EnableProfilePrivilege ()
+{
+    HANDLE hToken;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &hToken)) {
+        return false;
+    }
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool enabled =
+        LookupPrivilegeValueW(nullptr, SE_SYSTEM_PROFILE_NAME, &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, nullptr, nullptr) &&
+        (GetLastError() != ERROR_NOT_ALL_ASSIGNED);
+
+    CloseHandle(hToken);
+
+    return enabled;
+}
+
+static NTSTATUS Escape (D3DKMT_HANDLE hAdapter, void* pData, UINT Size)
+{
+    D3DKMT_ESCAPE escape = {};
+    escape.hAdapter = hAdapter;
+    escape.Type = D3DKMT_ESCAPE_DRIVERPRIVATE;
+    escape.pPrivateDriverData = pData;
+    escape.PrivateDriverDataSize = Size;
+
+    return D3DKMTEscape(&escape);
+}
+
+static int ControlTrace (D3DKMT_HANDLE hAdapter, bool Enable)
+{
+    ROS_ESCAPE_TRACE_CONTROL traceControl = {};
+    traceControl.m_escapeId = ROS_ESCAPE_TRACE_CONTROL;
+    traceControl.m_enable = Enable;
+
+    NTSTATUS status = Escape(hAdapter, &traceControl, sizeof(traceControl));
+    if (!NT_SUCCESS(status)) {
+        fwprintf(stderr, L"Failed to %s the trace. (status = 0x%x)\n", Enable ? L"start" : L"stop", status);
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// Reads the events of the rings into Data
+//
+static ROS_ESCAPE_TRACE_READ* ReadTrace (D3DKMT_HANDLE hAdapter, std::vector<BYTE>& Data)
+{
+    const UINT size = FIELD_OFFSET(ROS_ESCAPE_TRACE_READ, m_events) + MAX_TRACE_EVENTS * sizeof(RosTraceEvent);
+
+    Data.resize(size);
+
+    ROS_ESCAPE_TRACE_READ* pTraceRead = reinterpret_cast<ROS_ESCAPE_TRACE_READ*>(Data.data());
+    pTraceRead->m_escapeId = ROS_ESCAPE_TRACE_READ;
+    pTraceRead->m_maxEvents = MAX_TRACE_EVENTS;
+
+    NTSTATUS status = Escape(hAdapter, pTraceRead, size);
+    if (!NT_SUCCESS(status)) {
+        fwprintf(stderr, L"Failed to read the trace. (status = 0x%x)\n", status);
+        return nullptr;
+    }
+
+    return pTraceRead;
+}
+
+static bool WriteTextFile (const wchar_t* pFileName, const char* pText, size_t Length)
+{
+    FILE* pFile;
+    if (_wfopen_s(&pFile, pFileName, L"wb") != 0) {
+        fwprintf(stderr, L"Failed to open %s\n", pFileName);
+        return false;
+    }
+
+    fwrite(pText, 1, Length, pFile);
+    fclose(pFile);
+
+    return true;
+}
+
+static int DumpTrace (D3DKMT_HANDLE hAdapter, const wchar_t* pFileName)
+{
+    std::vector<BYTE> data;
+
+    ROS_ESCAPE_TRACE_READ* pTraceRead = ReadTrace(hAdapter, data);
+    if (!pTraceRead) {
+        return 1;
+    }
+
+    size_t length = RosTrace::FormatChromeTrace(
+        pTraceRead->m_events,
+        pTraceRead->m_numEvents,
+        pTraceRead->m_frequency,
+        nullptr,
+        0);
+
+    std::vector<char> json(length + 1);
+
+    RosTrace::FormatChromeTrace(
+        pTraceRead->m_events,
+        pTraceRead->m_numEvents,
+        pTraceRead->m_frequency,
+        json.data(),
+        json.size());
+
+    if (!WriteTextFile(pFileName, json.data(), length)) {
+        return 1;
+    }
+
+    wprintf(L"Wrote %u events to %s\n", pTraceRead->m_numEvents, pFileName);
+
+    return 0;
+}
+
+static void PrintPercentiles (const wchar_t* pName, std::vector<ULONGLONG>& Values, ULONGLONG Frequency)
+{
+    if (Values.empty()) {
+        return;
+    }
+
+    const UINT percentiles[] = { 50, 95, 99 };
+
+    wprintf(L"%s:", pName);
+
+    for (UINT percentile : percentiles) {
+        const ULONGLONG value = RosTrace::GetPercentile(Values.data(), UINT(Values.size()), percentile);
+
+        wprintf(L" p%u %.2fms", percentile, double(value) * 1000.0 / double(Frequency));
+    }
+
+    wprintf(L"\n");
+}
+
+static int DumpFrames (D3DKMT_HANDLE hAdapter, const wchar_t* pFileName)
+{
+    std::vector<BYTE> data;
+
+    ROS_ESCAPE_TRACE_READ* pTraceRead = ReadTrace(hAdapter, data);
+    if (!pTraceRead) {
+        return 1;
+    }
+
+    const UINT numFrames = RosTrace::GetFrameRecords(
+        pTraceRead->m_events,
+        pTraceRead->m_numEvents,
+        nullptr,
+        0);
+
+    std::vector<RosFrameRecord> frames(numFrames);
+
+    RosTrace::GetFrameRecords(
+        pTraceRead->m_events,
+        pTraceRead->m_numEvents,
+        frames.data(),
+        numFrames);
+
+    size_t length = RosTrace::FormatFrameCsv(
+        frames.data(),
+        numFrames,
+        pTraceRead->m_frequency,
+        nullptr,
+        0);
+
+    std::vector<char> csv(length + 1);
+
+    RosTrace::FormatFrameCsv(
+        frames.data(),
+        numFrames,
+        pTraceRead->m_frequency,
+        csv.data(),
+        csv.size());
+
+    if (!WriteTextFile(pFileName, csv.data(), length)) {
+        return 1;
+    }
+
+    wprintf(L"Wrote %u frames to %s\n", numFrames, pFileName);
+
+    //
+    // Frame time between the frames shown, latency from the submission of
+    // a frame to the vsync showing it
+    //
+    std::vector<ULONGLONG> frameTimes;
+    std::vector<ULONGLONG> latencies;
+    ULONGLONG lastVSync = 0;
+
+    for (const RosFrameRecord& frame : frames) {
+        if (!frame.m_vsync) {
+            continue;
+        }
+
+        if (lastVSync) {
+            frameTimes.push_back(frame.m_vsync - lastVSync);
+        }
+
+        if (frame.m_submit) {
+            latencies.push_back(frame.m_vsync - frame.m_submit);
+        }
+
+        lastVSync = frame.m_vsync;
+    }
+
+    PrintPercentiles(L"Frame time", frameTimes, pTraceRead->m_frequency);
+    PrintPercentiles(L"Latency", latencies, pTraceRead->m_frequency);
+
+    return 0;
+}
+
+int __cdecl wmain (int argc, wchar_t** argv)
+{
+    const bool start = (argc == 2) && (_wcsicmp(argv[1], L"start") == 0);
+    const bool stop = (argc == 2) && (_wcsicmp(argv[1], L"stop") == 0);
+    const bool dump = (argc == 3) && (_wcsicmp(argv[1], L"dump") == 0);
+    const bool frames = (argc == 3) && (_wcsicmp(argv[1], L"frames") == 0);
+
+    if (!start && !stop && !dump && !frames) {
+        fwprintf(stderr, L"Usage: rostrace start | stop | dump <file> | frames <file>\n");
+        return 1;
+    }
+
+    if (!EnableProfilePrivilege()) {
+        fwprintf(stderr, L"Failed to enable the system profile privilege, run rostrace as administrator.\n");
+        return 1;
+    }
+
+    D3DKMT_HANDLE hAdapter = OpenRosAdapter();
+    if (!hAdapter) {
+        fwprintf(stderr, L"No adapter of the render-only driver was found.\n");
+        return 1;
+    }
+
+    int result;
+
+    if (dump) {
+        result = DumpTrace(hAdapter, argv[2]);
+    } else if (frames) {
+        result = DumpFrames(hAdapter, argv[2]);
+    } else {
+        result = ControlTrace(hAdapter, start);
+    }
+
+    D3DKMT_CLOSEADAPTER closeAdapter = {};
+    closeAdapter.hAdapter = hAdapter;
+    D3DKMTCloseAdapter(&closeAdapter);
+
+    return result;
+}
@@ -0,0 +1,208 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Cache maintenance of the command buffer implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdCacheMaintenance.h"
+
+void
+RosUmdDirtyRanges::Add(
+    UINT    offset,
+    UINT    size)
+{
+    if (0 == size)
+    {
+        return;
+    }
+
+    UINT    start = offset & ~(kLineSize - 1);
+    UINT    end = (offset + size + kLineSize - 1) & ~(kLineSize - 1);
+
+    //
+    // Absorb the ranges the new one overlaps or touches
+    //
+
+    UINT    first = 0;
+
+    while ((first < m_numRanges) && (m_ranges[first].m_end < start))
+    {
+        first++;
+    }
+
+    UINT    last = first;
+
+    while ((last < m_numRanges) && (m_ranges[last].m_start <= end))
+    {
+        if (m_ranges[last].m_start < start)
+        {
+            start = m_ranges[last].m_start;
+        }
+
+        if (m_ranges[last].m_end > end)
+        {
+            end = m_ranges[last].m_end;
+        }
+
+        last++;
+    }
+
+    if (last > first)
+    {
+        m_ranges[first].m_start = start;
+        m_ranges[first].m_end = end;
+
+        for (UINT i = last; i < m_numRanges; i++)
+        {
+            m_ranges[first + 1 + i - last] = m_ranges[i];
+        }
+
+        m_numRanges -= last - first - 1;
+
+        return;
+    }
+
+    //
+    // Full, merge the two closest of the ranges and the new one
+    //
+
+    if (m_numRanges == kMaxRanges)
+    {
+        Range   ranges[kMaxRanges + 1];
+
+        for (UINT i = 0, j = 0; i <= kMaxRanges; i++)
+        {
+            if (i == first)
+            {
+                ranges[i].m_start = start;
+                ranges[i].m_end = end;
+            }
+            else
+            {
+                ranges[i] = m_ranges[j++];
+            }
+        }
+
+        UINT    closest = 0;
+
+        for (UINT i = 1; i < kMaxRanges; i++)
+        {
+            if (ranges[i + 1].m_start - ranges[i].m_end < ranges[closest + 1].m_start - ranges[closest].m_end)
+            {
+                closest = i;
+            }
+        }
+
+        for (UINT i = 0, j = 0; i <= kMaxRanges; i++)
+        {
+            if (i == closest + 1)
+            {
+                m_ranges[closest].m_end = ranges[i].m_end;
+            }
+            else
+            {
+                m_ranges[j++] = ranges[i];
+            }
+        }
+
+        return;
+    }
+
+    for (UINT i = m_numRanges; i > first; i--)
+    {
+        m_ranges[i] = m_ranges[i - 1];
+    }
+
+    m_ranges[first].m_start = start;
+    m_ranges[first].m_end = end;
+
+    m_numRanges++;
+}
+
+UINT
+RosUmdDirtyRanges::GetBytes() const
+{
+    UINT    bytes = 0;
+
+    for (UINT i = 0; i < m_numRanges; i++)
+    {
+        bytes += m_ranges[i].m_end - m_ranges[i].m_start;
+    }
+
+    return bytes;
+}
+
+RosUmdCacheMaintenance::RosUmdCacheMaintenance()
+{
+    Reset();
+}
+
+void
+RosUmdCacheMaintenance::Reset()
+{
+    memset(&m_maintenance, 0, sizeof(m_maintenance));
+}
+
+void
+RosUmdCacheMaintenance::Reference(
+    UINT                allocationIndex,
+    RosUmdDirtyRanges * pDirtyRanges,
+    UINT *              pStaleGpuCaches)
+{
+    m_maintenance.m_gpuCaches |= *pStaleGpuCaches;
+    *pStaleGpuCaches = 0;
+
+    if (pDirtyRanges->IsEmpty() || m_maintenance.m_bCleanAll)
+    {
+        pDirtyRanges->Clear();
+        return;
+    }
+
+    UINT    numRanges = pDirtyRanges->GetCount();
+    UINT    available = VC4_MAX_CACHE_CLEAN - m_maintenance.m_numCleans;
+
+    if (numRanges <= available)
+    {
+        for (UINT i = 0; i < numRanges; i++)
+        {
+            AddClean(allocationIndex, pDirtyRanges->GetOffset(i), pDirtyRanges->GetSize(i));
+        }
+    }
+    else if (available)
+    {
+        //
+        // One range from the first to the last dirty line
+        //
+
+        UINT    start = pDirtyRanges->GetOffset(0);
+        UINT    end = pDirtyRanges->GetOffset(numRanges - 1) + pDirtyRanges->GetSize(numRanges - 1);
+
+        AddClean(allocationIndex, start, end - start);
+    }
+    else
+    {
+        m_maintenance.m_bCleanAll = 1;
+    }
+
+    pDirtyRanges->Clear();
+}
+
+void
+RosUmdCacheMaintenance::AddClean(
+    UINT    allocationIndex,
+    UINT    offset,
+    UINT    size)
+{
+    UINT    i = m_maintenance.m_numCleans;
+
+    assert(i < VC4_MAX_CACHE_CLEAN);
+
+    m_allocationIndices[i] = allocationIndex;
+    m_offsets[i] = offset;
+    m_maintenance.m_cleanSizes[i] = size;
+
+    m_maintenance.m_numCleans++;
+}
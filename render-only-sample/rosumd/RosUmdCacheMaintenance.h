@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Cache maintenance of the command buffer
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "RosUmdDebug.h"
+#include "Vc4Ddi.h"
+
+//
+// Video memory is mapped cached, what the CPU writes has to be cleaned from
+// the CPU caches before the GPU reads it, and the GPU caches may keep what
+// the GPU read from memory before the CPU or the GPU wrote it again.
+//
+// Each resource keeps the ranges the CPU wrote since a DMA buffer last read
+// it, and the GPU caches that may hold its old contents. A DMA buffer
+// reading the resource gets the ranges cleaned and those caches flushed by
+// the KMD before it runs, a resource the CPU and the GPU don't both touch
+// costs no maintenance.
+//
+
+//
+// Ranges in cache lines, overlapping and adjacent ranges merge. When the
+// ranges are full the two closest are merged.
+//
+
+class RosUmdDirtyRanges
+{
+public:
+
+    // Covers the data cache lines of the Cortex-A7 and the ARM1176
+    static const UINT kLineSize = 64;
+    static const UINT kMaxRanges = 4;
+
+    RosUmdDirtyRanges()
+    {
+        Clear();
+    }
+
+    void Add(UINT offset, UINT size);
+
+    void Clear()
+    {
+        m_numRanges = 0;
+    }
+
+    bool IsEmpty() const
+    {
+        return 0 == m_numRanges;
+    }
+
+    UINT GetCount() const
+    {
+        return m_numRanges;
+    }
+
+    UINT GetOffset(UINT i) const
+    {
+        assert(i < m_numRanges);
+        return m_ranges[i].m_start;
+    }
+
+    UINT GetSize(UINT i) const
+    {
+        assert(i < m_numRanges);
+        return m_ranges[i].m_end - m_ranges[i].m_start;
+    }
+
+    UINT GetBytes() const;
+
+private:
+
+    struct Range
+    {
+        UINT    m_start;
+        UINT    m_end;
+    };
+
+    // Sorted by offset, disjoint and not adjacent
+    Range   m_ranges[kMaxRanges];
+    UINT    m_numRanges;
+};
+
+//
+// Maintenance of the DMA buffer being built, the command buffer adds a
+// patch location for each clean
+//
+
+class RosUmdCacheMaintenance
+{
+public:
+
+    RosUmdCacheMaintenance();
+
+    void Reset();
+
+    //
+    // Called for every reference of a hardware DMA buffer to a resource,
+    // takes the resource's ranges and stale GPU caches. allocationIndex is
+    // the resource's index in the allocation list.
+    //
+
+    void
+    Reference(
+        UINT                allocationIndex,
+        RosUmdDirtyRanges * pDirtyRanges,
+        UINT *              pStaleGpuCaches);
+
+    // Flushes GPU caches the DMA buffer reads through
+    void FlushGpuCaches(UINT gpuCaches)
+    {
+        m_maintenance.m_gpuCaches |= gpuCaches;
+    }
+
+    bool IsEmpty() const
+    {
+        return (0 == m_maintenance.m_numCleans) &&
+               (0 == m_maintenance.m_bCleanAll) &&
+               (0 == m_maintenance.m_gpuCaches);
+    }
+
+    const VC4CacheMaintenance & GetMaintenance() const
+    {
+        return m_maintenance;
+    }
+
+    UINT GetCleanAllocationIndex(UINT i) const
+    {
+        assert(i < m_maintenance.m_numCleans);
+        return m_allocationIndices[i];
+    }
+
+    UINT GetCleanOffset(UINT i) const
+    {
+        assert(i < m_maintenance.m_numCleans);
+        return m_offsets[i];
+    }
+
+private:
+
+    void AddClean(UINT allocationIndex, UINT offset, UINT size);
+
+    VC4CacheMaintenance m_maintenance;
+
+    UINT                m_allocationIndices[VC4_MAX_CACHE_CLEAN];
+    UINT                m_offsets[VC4_MAX_CACHE_CLEAN];
+};
@@ -41,6 +41,25 @@ void RosUmdCommandBuffer::Standup(RosUmdDevice * pRosUmdDevice, D3DDDICB_CREATEC
     m_pCmdBufHeader = (GpuCommand *)m_pCommandBuffer;
     m_pCmdBufHeader->m_commandId = Header;
     m_pCmdBufHeader->m_commandBufferHeader.m_swCommandBuffer = 1;
+
+#if VC4
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassContinues = 0;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassBodyOffset = 0;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassEpilogOffset = 0;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthOnly = 0;
+    m_bColorWritten = false;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil = VC4DepthStencilUse();
+    m_pDepthStencil = NULL;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4Resolve = VC4ResolveUse();
+    m_pResolveTarget = NULL;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DirtyRect = VC4DirtyRect();
+
+#endif
 }
 
 bool RosUmdCommandBuffer::IsCommandBufferEmpty()
@@ -96,6 +115,80 @@ void RosUmdCommandBuffer::CopyResource(RosUmdResource * pDstResource, RosUmdReso
     CommitCommandBufferSpace(sizeof(*command), 2);
 }
 
+void RosUmdCommandBuffer::WriteTimestamp(RosUmdResource * pReportBuffer, UINT reportOffset)
+{
+    assert(m_pRosUmdDevice != NULL);
+
+    BYTE *  pCommandBuffer;
+    UINT    curCommandOffset;
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocationList;
+
+    GpuCommand * command;
+
+    ReserveCommandBufferSpace(
+        true,                           // SW command
+        sizeof(*command),
+        &pCommandBuffer,
+        1,
+        1,
+        &curCommandOffset,
+        &pPatchLocationList);
+
+    command = reinterpret_cast<GpuCommand *>(pCommandBuffer);
+
+    command->m_commandId = GpuCommandId::Timestamp;
+    command->m_timestamp.m_reportGpuAddress.QuadPart = 0;
+
+    UINT allocIndex = UseResource(pReportBuffer, true);
+
+    SetPatchLocation(pPatchLocationList, allocIndex, curCommandOffset + offsetof(GpuCommand, m_timestamp.m_reportGpuAddress), 0, reportOffset);
+
+    CommitCommandBufferSpace(sizeof(*command), 1);
+}
+
+void RosUmdCommandBuffer::InvalidateCpuCaches(RosUmdResource * pResource)
+{
+    assert(m_pRosUmdDevice != NULL);
+
+    pResource->m_bStaleCpuCaches = false;
+
+    //
+    // The GPU only writes to render targets in local video memory
+    //
+
+    if (RosAllocationUsesAperture(*pResource))
+    {
+        return;
+    }
+
+    BYTE *  pCommandBuffer;
+    UINT    curCommandOffset;
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocationList;
+
+    GpuCommand * command;
+
+    ReserveCommandBufferSpace(
+        true,                           // SW command
+        sizeof(*command),
+        &pCommandBuffer,
+        1,
+        1,
+        &curCommandOffset,
+        &pPatchLocationList);
+
+    command = reinterpret_cast<GpuCommand *>(pCommandBuffer);
+
+    command->m_commandId = GpuCommandId::CacheInvalidate;
+    command->m_cacheInvalidate.m_gpuAddress.QuadPart = 0;
+    command->m_cacheInvalidate.m_sizeBytes = pResource->m_hwSizeBytes;
+
+    UINT allocIndex = UseResource(pResource, false);
+
+    SetPatchLocation(pPatchLocationList, allocIndex, curCommandOffset + offsetof(GpuCommand, m_cacheInvalidate.m_gpuAddress));
+
+    CommitCommandBufferSpace(sizeof(*command), 1);
+}
+
 void RosUmdCommandBuffer::WriteResource(RosUmdResource * pResource, void * pData)
 {
     assert(m_pRosUmdDevice != NULL);
@@ -145,9 +238,25 @@ RosUmdCommandBuffer::Flush(
 {
     assert(m_pRosUmdDevice != NULL);
 
-    if (false == m_pCmdBufHeader->m_commandBufferHeader.m_swCommandBuffer)
+    bool    bSwCommandBuffer = (m_pCmdBufHeader->m_commandBufferHeader.m_swCommandBuffer != 0);
+
+    if (!bSwCommandBuffer)
     {
+#if VC4
+
+        m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassEpilogOffset = m_commandBufferPos;
+
+#endif
+
         m_pRosUmdDevice->WriteEpilog();
+
+#if VC4
+
+        m_pRosUmdDevice->WritePerfCounterSelect();
+
+        WriteCacheMaintenance();
+
+#endif
     }
 
     D3DDDICB_RENDER render;
@@ -176,8 +285,36 @@ RosUmdCommandBuffer::Flush(
     m_pCmdBufHeader->m_commandBufferHeader.m_swCommandBuffer   = 1;
 #if VC4
 
-    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4ClearColors = 0;
-    m_pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors = vc4ClearColors;
+    //
+    // A clear is for the draws of the next HW command buffer, software
+    // commands issued before them don't drop it
+    //
+
+    if (!bSwCommandBuffer)
+    {
+        m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4ClearColors = 0;
+        m_pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors = vc4ClearColors;
+    }
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4PerfCounters = 0;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4CacheMaintenance = 0;
+    m_cacheMaintenance.Reset();
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassContinues = 0;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassBodyOffset = 0;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassEpilogOffset = 0;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthOnly = 0;
+    m_bColorWritten = false;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil = VC4DepthStencilUse();
+    m_pDepthStencil = NULL;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4Resolve = VC4ResolveUse();
+    m_pResolveTarget = NULL;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DirtyRect = VC4DirtyRect();
 
 #endif
 
@@ -211,6 +348,20 @@ RosUmdCommandBuffer::ReserveCommandBufferSpace(
         ((m_allocationListPos + allocationListSize + ALLOCATION_LIST_FLUSH_THRESHOLD) > m_allocationListSize) ||
         ((m_patchLocationListPos + patchLocationSize + PACTH_LOCATION_LIST_FLUSH_THRESHOLD) > m_patchLocationListSize))
     {
+#if VC4
+
+        //
+        // Out of room in the middle of the draws to the render target, the
+        // KMD chains the next DMA buffer to this one
+        //
+
+        if (!bSwCommand && m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassBodyOffset)
+        {
+            m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassContinues = 1;
+        }
+
+#endif
+
         Flush(0);
     }
 
@@ -269,6 +420,36 @@ RosUmdCommandBuffer::UseResource(
         assert(pResource->m_mostRecentFence == m_submissionFence);
     }
 
+#if VC4
+
+    //
+    // Software commands are run by the CPU, the KMD cleans what they write
+    //
+
+    if (IsSwCommandBuffer())
+    {
+        if (bWriteOperation)
+        {
+            pResource->m_staleGpuCaches |= pResource->GetGpuReadCaches();
+            pResource->m_bStaleCpuCaches = false;
+        }
+    }
+    else
+    {
+        m_cacheMaintenance.Reference(
+            pResource->m_allocationListIndex,
+            &pResource->m_cpuDirtyRanges,
+            &pResource->m_staleGpuCaches);
+
+        if (bWriteOperation)
+        {
+            pResource->m_staleGpuCaches |= pResource->GetGpuReadCaches();
+            pResource->m_bStaleCpuCaches = true;
+        }
+    }
+
+#endif
+
     return pResource->m_allocationListIndex;
 }
 
@@ -294,20 +475,279 @@ void RosUmdCommandBuffer::UpdateClearColor(
     pVC4ClearColor->ClearColor8Dup = clearColor;
 }
 
-void RosUmdCommandBuffer::UpdateClearDepthStencil(
-    FLOAT depthValue,
-    UINT8 stencilValue)
+void RosUmdCommandBuffer::SetDepthStencil(
+    RosUmdResource * pDepthStencil)
 {
-    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4ClearColors = 1;
+    m_pDepthStencil = pDepthStencil;
 
-    VC4ClearColors *    pVC4ClearColor = &m_pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors;
+    VC4DepthStencilUse *    pUse = &m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil;
+
+    *pUse = VC4DepthStencilUse();
+
+    if (pDepthStencil->m_bDepthUniform && pDepthStencil->m_bStencilUniform)
+    {
+        VC4ClearColors *    pVC4ClearColor = &m_pCmdBufHeader->m_commandBufferHeader.m_vc4ClearColors;
+
+        pVC4ClearColor->CommandCode = VC4_CMD_CLEAR_COLOR;
+
+        pVC4ClearColor->ClearZ = pDepthStencil->m_uniformDepth;
+        pVC4ClearColor->ClearStencil = pDepthStencil->m_uniformStencil;
+
+        pUse->m_bClear = 1;
+    }
+}
+
+void RosUmdCommandBuffer::UseDepthStencil(
+    bool bWrite)
+{
+    VC4DepthStencilUse *    pUse = &m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil;
+
+    assert(m_pDepthStencil != NULL);
 
-    pVC4ClearColor->CommandCode = VC4_CMD_CLEAR_COLOR;
+    pUse->m_bUsed = 1;
+
+    if (bWrite)
+    {
+        pUse->m_bWritten = 1;
+        pUse->m_bDiscard = 0;
+
+        m_pDepthStencil->m_bDepthUniform = false;
+    }
+}
+
+void RosUmdCommandBuffer::UseRenderTarget(
+    bool bWrite)
+{
+    if (bWrite)
+    {
+        m_bColorWritten = true;
+
+        m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthOnly = 0;
+    }
+    else if (!m_bColorWritten)
+    {
+        m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthOnly = 1;
+    }
+}
+
+void RosUmdCommandBuffer::AddDirtyRect(
+    UINT left,
+    UINT top,
+    UINT right,
+    UINT bottom)
+{
+    VC4DirtyRect *  pDirtyRect = &m_pCmdBufHeader->m_commandBufferHeader.m_vc4DirtyRect;
+
+    if ((left >= right) || (top >= bottom))
+    {
+        return;
+    }
+
+    if (pDirtyRect->m_left >= pDirtyRect->m_right)
+    {
+        pDirtyRect->m_left = (USHORT)left;
+        pDirtyRect->m_top = (USHORT)top;
+        pDirtyRect->m_right = (USHORT)right;
+        pDirtyRect->m_bottom = (USHORT)bottom;
+    }
+    else
+    {
+        pDirtyRect->m_left = (USHORT)min(pDirtyRect->m_left, left);
+        pDirtyRect->m_top = (USHORT)min(pDirtyRect->m_top, top);
+        pDirtyRect->m_right = (USHORT)max(pDirtyRect->m_right, right);
+        pDirtyRect->m_bottom = (USHORT)max(pDirtyRect->m_bottom, bottom);
+    }
+}
+
+void RosUmdCommandBuffer::DiscardDepthStencil()
+{
+    assert(m_pDepthStencil != NULL);
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4DepthStencil.m_bDiscard = 1;
+}
+
+void RosUmdCommandBuffer::FillDepthStencil(
+    RosUmdResource *    pDepthStencil,
+    UINT                mask,
+    UINT                value)
+{
+    assert(m_pRosUmdDevice != NULL);
+
+    BYTE *  pCommandBuffer;
+    UINT    curCommandOffset;
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocationList;
+
+    GpuCommand * command;
+
+    ReserveCommandBufferSpace(
+        true,                           // SW command
+        sizeof(*command),
+        &pCommandBuffer,
+        1,
+        1,
+        &curCommandOffset,
+        &pPatchLocationList);
+
+    command = reinterpret_cast<GpuCommand *>(pCommandBuffer);
+
+    command->m_commandId = GpuCommandId::MaskedFill;
+    command->m_maskedFill.m_gpuAddress.QuadPart = 0;
+    command->m_maskedFill.m_sizeBytes = pDepthStencil->m_hwSizeBytes;
+    command->m_maskedFill.m_mask = mask;
+    command->m_maskedFill.m_value = value & mask;
+
+    UINT allocIndex = UseResource(pDepthStencil, true);
+
+    SetPatchLocation(pPatchLocationList, allocIndex, curCommandOffset + offsetof(GpuCommand, m_maskedFill.m_gpuAddress));
+
+    CommitCommandBufferSpace(sizeof(*command), 1);
+}
+
+void RosUmdCommandBuffer::SetResolveTarget(
+    RosUmdResource * pResolveTarget)
+{
+    assert(m_pResolveTarget == NULL);
+    assert(!IsSwCommandBuffer());
+
+    //
+    // Like the depth stencil buffer the resolve target is patched into the
+    // header, the flush thresholds leave room for it
+    //
+
+    assert((m_patchLocationListPos + 1) <= m_patchLocationListSize);
+
+    UINT    allocIndex = UseResource(pResolveTarget, true);
+
+    m_pAllocationList[allocIndex].WriteOperation = 1;
+
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation = m_pPatchLocationList + m_patchLocationListPos;
+
+    SetPatchLocation(
+        pPatchLocation,
+        allocIndex,
+        offsetof(GpuCommand, m_commandBufferHeader.m_vc4Resolve),
+        VC4_SLOT_RESOLVE_TARGET);
+
+    m_patchLocationListPos++;
+
+    m_pResolveTarget = pResolveTarget;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4Resolve = VC4ResolveUse();
+}
+
+void RosUmdCommandBuffer::DiscardRenderTarget()
+{
+    assert(m_pResolveTarget != NULL);
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4Resolve.m_bDiscard = 1;
+}
+
+void RosUmdCommandBuffer::ResolveResource(
+    RosUmdResource *    pDstResource,
+    RosUmdResource *    pSrcResource)
+{
+    assert(m_pRosUmdDevice != NULL);
+
+    BYTE *  pCommandBuffer;
+    UINT    curCommandOffset;
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocationList;
+
+    GpuCommand * command;
+
+    ReserveCommandBufferSpace(
+        true,                           // SW command
+        sizeof(*command),
+        &pCommandBuffer,
+        2,
+        2,
+        &curCommandOffset,
+        &pPatchLocationList);
+
+    command = reinterpret_cast<GpuCommand *>(pCommandBuffer);
+
+    command->m_commandId = GpuCommandId::MsaaResolve;
+    command->m_msaaResolve.m_dstGpuAddress.QuadPart = 0;
+    command->m_msaaResolve.m_srcGpuAddress.QuadPart = 0;
+    command->m_msaaResolve.m_width = pSrcResource->m_mip0Info.TexelWidth;
+    command->m_msaaResolve.m_height = pSrcResource->m_mip0Info.TexelHeight;
+    command->m_msaaResolve.m_srcWidthInTiles = pSrcResource->m_hwWidthTiles;
+    command->m_msaaResolve.m_dstPitchBytes = pDstResource->m_hwPitchBytes;
+    command->m_msaaResolve.m_bDstTFormat = (pDstResource->m_hwLayout == RosHwLayout::Tiled);
+
+    UINT dstAllocIndex = UseResource(pDstResource, true);
+    UINT srcAllocIndex = UseResource(pSrcResource, false);
+
+    SetPatchLocation(pPatchLocationList, dstAllocIndex, curCommandOffset + offsetof(GpuCommand, m_msaaResolve.m_dstGpuAddress));
+    SetPatchLocation(pPatchLocationList, srcAllocIndex, curCommandOffset + offsetof(GpuCommand, m_msaaResolve.m_srcGpuAddress));
+
+    CommitCommandBufferSpace(sizeof(*command), 2);
+}
+
+void
+RosUmdCommandBuffer::SetPerfCounterSelect(
+    const VC4PerfCounterSelect &    select,
+    RosUmdResource *                pReportBuffer,
+    const UINT *                    pReportOffsets)
+{
+    //
+    // Called by Flush, the flush thresholds leave room for the report buffer
+    // and the patch locations
+    //
+
+    assert((m_patchLocationListPos + select.m_numCounters) <= m_patchLocationListSize);
+
+    UINT    allocIndex = UseResource(pReportBuffer, true);
+
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation = m_pPatchLocationList + m_patchLocationListPos;
+
+    for (UINT i = 0; i < select.m_numCounters; i++)
+    {
+        SetPatchLocation(
+            pPatchLocation,
+            allocIndex,
+            offsetof(GpuCommand, m_commandBufferHeader.m_vc4PerfCounters.m_sources) + i,
+            VC4_SLOT_PERF_COUNTER_REPORT,
+            pReportOffsets[i]);
+    }
+
+    m_patchLocationListPos += select.m_numCounters;
+
+    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4PerfCounters = 1;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4PerfCounters = select;
+}
+
+void
+RosUmdCommandBuffer::WriteCacheMaintenance()
+{
+    if (m_cacheMaintenance.IsEmpty())
+    {
+        return;
+    }
+
+    const VC4CacheMaintenance & maintenance = m_cacheMaintenance.GetMaintenance();
+
+    //
+    // Called by Flush, the flush thresholds leave room for the patch
+    // locations
+    //
+
+    assert((m_patchLocationListPos + maintenance.m_numCleans) <= m_patchLocationListSize);
+
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation = m_pPatchLocationList + m_patchLocationListPos;
+
+    for (UINT i = 0; i < maintenance.m_numCleans; i++)
+    {
+        SetPatchLocation(
+            pPatchLocation,
+            m_cacheMaintenance.GetCleanAllocationIndex(i),
+            offsetof(GpuCommand, m_commandBufferHeader.m_vc4CacheMaintenance.m_cleanSizes) + i*sizeof(UINT),
+            VC4_SLOT_CACHE_CLEAN,
+            m_cacheMaintenance.GetCleanOffset(i));
+    }
 
-    UINT    max24BitDepthValue = 0xFFFFFF;
-    pVC4ClearColor->ClearZ = (UINT)round(max24BitDepthValue*depthValue);
+    m_patchLocationListPos += maintenance.m_numCleans;
 
-    pVC4ClearColor->ClearStencil = stencilValue;
+    m_pCmdBufHeader->m_commandBufferHeader.m_hasVC4CacheMaintenance = 1;
+    m_pCmdBufHeader->m_commandBufferHeader.m_vc4CacheMaintenance = maintenance;
 }
 
 #endif
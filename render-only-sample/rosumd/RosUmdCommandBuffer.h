@@ -1,6 +1,7 @@
 #pragma once
 
 #include "RosGpuCommand.h"
+#include "RosUmdCacheMaintenance.h"
 
 class RosUmdDevice;
 class RosUmdResource;
@@ -24,6 +25,22 @@ public:
     void CopyResource(RosUmdResource * pDstResource, RosUmdResource * pSrcResource);
     void WriteResource(RosUmdResource * pResource, void * pData);
 
+    // Software command writing the time the DMA buffers before it completed
+    // to the VC4PerfCounterReport at reportOffset
+    void WriteTimestamp(RosUmdResource * pReportBuffer, UINT reportOffset);
+
+    // Software command invalidating the CPU caches over a resource the GPU
+    // wrote, locking the resource waits for it
+    void InvalidateCpuCaches(RosUmdResource * pResource);
+
+#if VC4
+
+    // Software command resolving the samples of a multisample resource the
+    // tile buffer already stored into a linear or T-format resource
+    void ResolveResource(RosUmdResource * pDstResource, RosUmdResource * pSrcResource);
+
+#endif
+
     void Flush(UINT flushFlags);
 
     void
@@ -82,13 +99,69 @@ public:
     // value matches the current command buffers fence value.
     void FlushIfMatching(ULONGLONG fence);
 
+    ULONGLONG GetSubmissionFence() const
+    {
+        return m_submissionFence;
+    }
+
     bool IsCommandBufferEmpty();
     bool IsSwCommandBuffer();
 
 #if VC4
 
     void UpdateClearColor(UINT clearColor);
-    void UpdateClearDepthStencil(FLOAT depthValue, UINT8 stencilValue);
+
+    // Depth stencil buffer of the render pass, the tile buffer is cleared
+    // rather than loaded when its depth and stencil are uniform
+    void SetDepthStencil(RosUmdResource * pDepthStencil);
+
+    RosUmdResource * GetDepthStencil() const
+    {
+        return m_pDepthStencil;
+    }
+
+    // A draw tests depth of the depth stencil buffer, and may write it
+    void UseDepthStencil(bool bWrite);
+
+    // The depth stencil buffer is undefined after the render pass
+    void DiscardDepthStencil();
+
+    // Software command clearing the depth or the stencil of a depth
+    // stencil buffer, mask has VC4_DEPTH_MASK or VC4_STENCIL_MASK bits
+    void FillDepthStencil(RosUmdResource * pDepthStencil, UINT mask, UINT value);
+
+    // A draw writes color, or only the depth stencil buffer. The KMD
+    // neither loads nor stores the render target of a render pass of
+    // depth-only draws.
+    void UseRenderTarget(bool bWrite);
+
+    // A draw may write the pixels of the clip window, the KMD only renders
+    // the tiles under the draws of the render pass
+    void AddDirtyRect(UINT left, UINT top, UINT right, UINT bottom);
+
+    // Draws of the Binning Control List start after the Start Tile Binning
+    void SetPassBodyOffset(UINT bodyOffset)
+    {
+        m_pCmdBufHeader->m_commandBufferHeader.m_vc4PassBodyOffset = bodyOffset;
+    }
+
+    // The render pass resolves its multisample render target into the
+    // resource when the tile buffer stores it
+    void SetResolveTarget(RosUmdResource * pResolveTarget);
+
+    RosUmdResource * GetResolveTarget() const
+    {
+        return m_pResolveTarget;
+    }
+
+    // The samples of the render target are undefined after the resolve
+    void DiscardRenderTarget();
+
+    void
+    SetPerfCounterSelect(
+        const VC4PerfCounterSelect &    select,
+        RosUmdResource *                pReportBuffer,
+        const UINT *                    pReportOffsets);
 
 #endif
 
@@ -124,9 +197,29 @@ private:
 
     GpuCommand *                        m_pCmdBufHeader;
 
+#if VC4
+
+    // Cleans and GPU cache flushes before the DMA buffer runs
+    RosUmdCacheMaintenance              m_cacheMaintenance;
+
+    void WriteCacheMaintenance();
+
+    // Depth stencil buffer of the render pass, NULL without one
+    RosUmdResource *                    m_pDepthStencil;
+
+    // Resolve target of the render pass, NULL without one
+    RosUmdResource *                    m_pResolveTarget;
+
+    // A draw of the command buffer wrote color
+    bool                                m_bColorWritten;
+
+#endif
+
+    // Flush adds the performance counter report buffer and a patch location
+    // for each sampled counter and each clean, a resolve adds its target
     CONST UINT  COMMAND_BUFFER_FLUSH_THRESHOLD = 512;
-    CONST UINT  ALLOCATION_LIST_FLUSH_THRESHOLD = 2;
-    CONST UINT  PACTH_LOCATION_LIST_FLUSH_THRESHOLD = 2;
+    CONST UINT  ALLOCATION_LIST_FLUSH_THRESHOLD = 4;
+    CONST UINT  PACTH_LOCATION_LIST_FLUSH_THRESHOLD = 3 + V3D_NUM_PERF_COUNTERS + VC4_MAX_CACHE_CLEAN;
 };
 
 template<typename TypeCur, typename TypeNext>
@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Constant buffer ring allocator implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdConstantRing.h"
+
+RosUmdConstantRing::RosUmdConstantRing()
+{
+    memset(m_chunks, 0, sizeof(m_chunks));
+    m_numChunks = 0;
+
+    m_currentChunk = 0;
+    m_currentOffset = kChunkSize;
+
+    m_recycleCount = 0;
+    m_bytesAllocated = 0;
+}
+
+RosUmdConstantRing::~RosUmdConstantRing()
+{
+    assert(m_numChunks == 0);
+}
+
+bool
+RosUmdConstantRing::Allocate(
+    UINT                    size,
+    ULONGLONG               currentFence,
+    RosUmdConstantSlice *   pSlice)
+{
+    assert(size <= kChunkSize);
+
+    UINT    alignedSize = (size + kSliceAlignment - 1) & ~(kSliceAlignment - 1);
+
+    if (m_currentOffset + alignedSize > kChunkSize)
+    {
+        //
+        // Move on to the next chunk whose slices are all dead, or add one
+        //
+
+        UINT    nextChunk = kMaxChunks;
+
+        for (UINT i = 1; i <= m_numChunks; i++)
+        {
+            UINT    chunk = (m_currentChunk + i) % m_numChunks;
+
+            if (IsRecyclable(m_chunks[chunk], currentFence))
+            {
+                nextChunk = chunk;
+                break;
+            }
+        }
+
+        if (nextChunk != kMaxChunks)
+        {
+            MapChunk(&m_chunks[nextChunk], true);
+
+            m_recycleCount++;
+        }
+        else if (m_numChunks < kMaxChunks)
+        {
+            nextChunk = m_numChunks;
+
+            MapChunk(&m_chunks[nextChunk], false);
+
+            m_numChunks++;
+        }
+        else
+        {
+            return false;
+        }
+
+        m_currentChunk = nextChunk;
+        m_currentOffset = 0;
+    }
+
+    RosUmdConstantRingChunk *   pChunk = &m_chunks[m_currentChunk];
+
+    pSlice->m_chunk = m_currentChunk;
+    pSlice->m_offset = m_currentOffset;
+    pSlice->m_size = size;
+    pSlice->m_pData = pChunk->m_pData + m_currentOffset;
+
+    pChunk->m_liveSlices++;
+    pChunk->m_lastUseFence = currentFence;
+
+    m_currentOffset += alignedSize;
+    m_bytesAllocated += alignedSize;
+
+    return true;
+}
+
+void
+RosUmdConstantRing::Release(
+    const RosUmdConstantSlice & slice,
+    ULONGLONG                   currentFence)
+{
+    if (NULL == slice.m_pData)
+    {
+        return;
+    }
+
+    RosUmdConstantRingChunk *   pChunk = &m_chunks[slice.m_chunk];
+
+    assert(pChunk->m_liveSlices > 0);
+
+    pChunk->m_liveSlices--;
+    pChunk->m_lastUseFence = max(pChunk->m_lastUseFence, currentFence);
+}
+
+void
+RosUmdConstantRing::Teardown()
+{
+    for (UINT i = 0; i < m_numChunks; i++)
+    {
+        UnmapChunk(&m_chunks[i]);
+    }
+
+    memset(m_chunks, 0, sizeof(m_chunks));
+    m_numChunks = 0;
+
+    m_currentChunk = 0;
+    m_currentOffset = kChunkSize;
+}
@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Constant buffer ring allocator
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "RosUmdDebug.h"
+
+class RosUmdResource;
+
+//
+// Constant buffer contents live in slices of a set of CPU mapped GPU
+// buffers (chunks), so the uniform stream can point at them directly.
+// Map with DISCARD renames the constant buffer to a fresh slice instead of
+// waiting for the GPU to finish with the old one, NOOVERWRITE keeps
+// writing to the live slice.
+//
+// A chunk is recycled once none of its slices is live and it isn't
+// referenced by the command buffer being built, i.e. every draw that read
+// from it has been submitted. The recycled chunk is discarded, so the GPU
+// keeps reading the old allocation instance.
+//
+
+typedef struct _RosUmdConstantSlice
+{
+    UINT    m_chunk;
+    UINT    m_offset;           // Byte offset within the chunk
+    UINT    m_size;
+    BYTE *  m_pData;            // CPU mapping
+} RosUmdConstantSlice;
+
+typedef struct _RosUmdConstantRingChunk
+{
+    RosUmdResource *    m_pBuffer;
+    BYTE *              m_pData;
+
+    UINT                m_liveSlices;
+
+    // Submission fence of the last command buffer that may read from the chunk
+    ULONGLONG           m_lastUseFence;
+} RosUmdConstantRingChunk;
+
+class RosUmdConstantRing
+{
+public:
+
+    static const UINT kChunkSize = 64*1024;     // Largest D3D11 constant buffer
+    static const UINT kMaxChunks = 64;
+    static const UINT kSliceAlignment = 16;
+
+    RosUmdConstantRing();
+    virtual ~RosUmdConstantRing();
+
+    //
+    // Returns false when every chunk is full or still referenced by the
+    // current command buffer, the caller has to submit it and retry
+    //
+
+    bool
+    Allocate(
+        UINT                    size,
+        ULONGLONG               currentFence,
+        RosUmdConstantSlice *   pSlice);
+
+    //
+    // The slice's chunk can't be recycled until the command buffer
+    // current at release is submitted
+    //
+
+    void
+    Release(
+        const RosUmdConstantSlice & slice,
+        ULONGLONG                   currentFence);
+
+    void Teardown();
+
+    RosUmdResource * GetChunkBuffer(UINT chunk)
+    {
+        assert(chunk < m_numChunks);
+        return m_chunks[chunk].m_pBuffer;
+    }
+
+    UINT GetChunkCount() const
+    {
+        return m_numChunks;
+    }
+
+    UINT GetRecycleCount() const
+    {
+        return m_recycleCount;
+    }
+
+    ULONGLONG GetBytesAllocated() const
+    {
+        return m_bytesAllocated;
+    }
+
+protected:
+
+    //
+    // Provides the CPU mapped buffer of a chunk, bRecycle asks for a new
+    // allocation instance of the chunk's existing buffer
+    //
+
+    virtual void MapChunk(RosUmdConstantRingChunk * pChunk, bool bRecycle) = 0;
+    virtual void UnmapChunk(RosUmdConstantRingChunk * pChunk) = 0;
+
+private:
+
+    bool
+    IsRecyclable(
+        const RosUmdConstantRingChunk & chunk,
+        ULONGLONG                       currentFence) const
+    {
+        return (chunk.m_liveSlices == 0) && (chunk.m_lastUseFence < currentFence);
+    }
+
+    RosUmdConstantRingChunk m_chunks[kMaxChunks];
+    UINT                    m_numChunks;
+
+    UINT                    m_currentChunk;
+    UINT                    m_currentOffset;
+
+    UINT                    m_recycleCount;
+    ULONGLONG               m_bytesAllocated;
+};
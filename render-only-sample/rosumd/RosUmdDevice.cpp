@@ -24,6 +24,7 @@
 #include "RosUmdRasterizerState.h"
 #include "RosUmdDepthStencilState.h"
 #include "RosUmdElementLayout.h"
+#include "RosUmdQuery.h"
 #include "RosContext.h"
 #include "RosUmdUtil.h"
 
@@ -31,6 +32,9 @@
 
 #include "Vc4Hw.h"
 #include "Vc4Ddi.h"
+#include "RosTFormat.h"
+#include "RosEarlyZ.h"
+#include "RosDepthOnly.h"
 
 // #define NV_SHADER 1
 
@@ -77,8 +81,7 @@ RosUmdDevice::RosUmdDevice(
     m_pAdapter(pAdapter),
     m_Interface(pArgs->Interface),
     m_hRTDevice(pArgs->hRTDevice),
-    m_hRTCoreLayer(pArgs->hRTCoreLayer),
-    m_bPredicateValue(FALSE)
+    m_hRTCoreLayer(pArgs->hRTCoreLayer)
 {
     // Location of function table for runtime callbacks. Can not change these function pointers, as they are runtime-owned;
     // but the pointer should be saved. Do not cache function pointers, as the runtime may change the table entries at will.
@@ -188,11 +191,64 @@ void RosUmdDevice::Standup()
     //
 
     CreateInternalBuffer(&m_dummyBuffer, PAGE_SIZE);
+
+    m_constantRing.m_pDevice = this;
+    m_shaderHeap.m_pDevice = this;
+    m_perfCounters.m_pDevice = this;
+
+    memset(&m_depthOnlyShader, 0, sizeof(m_depthOnlyShader));
+
+    m_constantBytesCopied = 0;
+    m_uniformDraws = 0;
+
+    m_drawnVertices = 0;
+    m_drawnPrimitives = 0;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
 void RosUmdDevice::Teardown()
 {
+#if VC4
+
+    ROS_LOG_TRACE(
+        "Index range cache statistics. (hits = %u, misses = %u)",
+        m_indexRangeCache.GetHitCount(),
+        m_indexRangeCache.GetMissCount());
+
+    for (UINT i = 0; i < RosUmdIndexRangeCache::kMaxEntries; i++)
+    {
+        DestroyShadowIndexBuffer(m_indexRangeCache.GetEntry(i));
+    }
+
+#endif
+
+    ROS_LOG_TRACE(
+        "Constant ring statistics. (chunks = %u, recycled = %u, bytes allocated = %I64u, bytes copied = %I64u, draws = %I64u)",
+        m_constantRing.GetChunkCount(),
+        m_constantRing.GetRecycleCount(),
+        m_constantRing.GetBytesAllocated(),
+        m_constantBytesCopied,
+        m_uniformDraws);
+
+    m_constantRing.Teardown();
+
+    ROS_LOG_TRACE(
+        "Shader heap statistics. (chunk size = %u, live shaders = %u, live bytes = %u, migrations = %u, bytes migrated = %I64u)",
+        m_shaderHeap.GetChunkSize(),
+        m_shaderHeap.GetLiveCount(),
+        m_shaderHeap.GetLiveBytes(),
+        m_shaderHeap.GetMigrationCount(),
+        m_shaderHeap.GetBytesMigrated());
+
+    m_shaderHeap.Free(&m_depthOnlyShader);
+    m_shaderHeap.Teardown();
+
+    ROS_LOG_TRACE(
+        "Predication statistics. (draws and clears skipped = %I64u)",
+        m_predication.GetSkipCount());
+
+    m_perfCounters.Teardown();
+
     if( m_hContext != NULL )
     {
         D3DDDICB_DESTROYCONTEXT destroyContext =
@@ -222,21 +278,18 @@ void RosUmdDevice::CreateResource(const D3D11DDIARG_CREATERESOURCE* pCreateResou
     pResource->Standup(this, pCreateResource, hRTResource);
     
     //
-    // Constant buffer is created in system memory
+    // Constant buffer is created in a slice of the constant ring
     //
 
     if (pCreateResource->BindFlags & D3D10_DDI_BIND_CONSTANT_BUFFER)
     {
-        pResource->m_pSysMemCopy = new BYTE[pResource->m_hwSizeBytes];
-
-        if (NULL == pResource->m_pSysMemCopy)
-        {
-            throw RosUmdException(E_OUTOFMEMORY);
-        }
+        RenameConstantBuffer(pResource, false);
 
         if (pCreateResource->pInitialDataUP != NULL && pCreateResource->pInitialDataUP[0].pSysMem != NULL)
         {
             memcpy(pResource->m_pSysMemCopy, pCreateResource->pInitialDataUP[0].pSysMem, pResource->m_hwSizeBytes);
+
+            MarkConstantSliceWritten(pResource);
         }
 
         return;
@@ -321,6 +374,8 @@ void RosUmdDevice::CreateResource(const D3D11DDIARG_CREATERESOURCE* pCreateResou
             assert(false);
         }
 
+        pResource->MarkCpuWritten();
+
         D3DDDICB_UNLOCK unlock;
         memset(&unlock, 0, sizeof(unlock));
 
@@ -368,22 +423,132 @@ void RosUmdDevice::OpenResource(
 void RosUmdDevice::DestroyResource(
     RosUmdResource * pResource)
 {
+    if (pResource->m_bindFlags & D3D10_DDI_BIND_CONSTANT_BUFFER)
+    {
+        m_constantRing.Release(pResource->m_constantSlice, m_commandBuffer.GetSubmissionFence());
+    }
+
     pResource->Teardown();
     pResource->~RosUmdResource();
 }
 
+void RosUmdDevice::ResourceResolveSubresource(
+    RosUmdResource * pDestinationResource,
+    UINT DstSubresource,
+    RosUmdResource * pSourceResource,
+    UINT SrcSubresource,
+    DXGI_FORMAT ResolveFormat)
+{
+    ResolveFormat; // unused, the resources are of the formats the tile buffer resolves
+
+    if (!pSourceResource->IsMultisampled() ||
+        pDestinationResource->IsMultisampled() ||
+        (DstSubresource != 0) ||
+        (SrcSubresource != 0) ||
+        (pDestinationResource->m_mip0Info.TexelWidth != pSourceResource->m_mip0Info.TexelWidth) ||
+        (pDestinationResource->m_mip0Info.TexelHeight != pSourceResource->m_mip0Info.TexelHeight))
+    {
+        throw RosUmdException(E_INVALIDARG);
+    }
+
+    pDestinationResource->MarkContentChanged();
+
+#if VC4
+
+    //
+    // The tile buffer resolves the samples of the render target it draws
+    // when it stores them at the end of the pass, the resolve is deferred
+    // until the next draw. Otherwise the samples were stored and the CPU
+    // resolves them.
+    //
+
+    RosUmdResource *    pResolveTarget = m_commandBuffer.GetResolveTarget();
+
+    if (pResolveTarget && (pResolveTarget != pDestinationResource))
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    if (m_flags.m_hasDrawCall &&
+        m_renderTargetViews[0] &&
+        (pSourceResource == RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource)))
+    {
+        if (!m_commandBuffer.GetResolveTarget())
+        {
+            m_commandBuffer.SetResolveTarget(pDestinationResource);
+        }
+
+        return;
+    }
+
+    m_commandBuffer.ResolveResource(pDestinationResource, pSourceResource);
+
+#endif
+}
+
 void RosUmdDevice::ResourceCopy(
     RosUmdResource * pDestinationResource,
     RosUmdResource * pSourceResource)
 {
+    pDestinationResource->MarkContentChanged();
+
+#if VC4
+
+    //
+    // Clears of a depth stencil buffer are only recorded until a render
+    // pass draws it, the copy reads them from memory
+    //
+
+    if (pSourceResource->m_bindFlags & D3D10_DDI_BIND_DEPTH_STENCIL)
+    {
+        UINT    mask =
+            (pSourceResource->m_bDepthUniform ? VC4_DEPTH_MASK : 0) |
+            (pSourceResource->m_bStencilUniform ? VC4_STENCIL_MASK : 0);
+
+        if (mask)
+        {
+            m_commandBuffer.FillDepthStencil(
+                pSourceResource,
+                mask,
+                (pSourceResource->m_uniformDepth << 8) | pSourceResource->m_uniformStencil);
+
+            pSourceResource->m_bDepthUniform = false;
+            pSourceResource->m_bStencilUniform = false;
+        }
+    }
+
+    if (pDestinationResource->m_bindFlags & D3D10_DDI_BIND_DEPTH_STENCIL)
+    {
+        pDestinationResource->m_bDepthUniform = false;
+        pDestinationResource->m_bStencilUniform = false;
+    }
+
+#endif
+
     if (pDestinationResource->m_usage == D3D10_DDI_USAGE_DEFAULT &&
-        pSourceResource->m_usage == D3D10_DDI_USAGE_DEFAULT)
+        pSourceResource->m_usage == D3D10_DDI_USAGE_DEFAULT &&
+        pDestinationResource->m_hwLayout == pSourceResource->m_hwLayout)
     {
         // We can use GPU to do copy
         m_commandBuffer.CopyResource(pDestinationResource, pSourceResource);
     }
     else
     {
+        //
+        // The CPU caches may have old contents of what the GPU wrote, the
+        // lock below waits for the invalidation
+        //
+
+        if (pDestinationResource->m_bStaleCpuCaches)
+        {
+            m_commandBuffer.InvalidateCpuCaches(pDestinationResource);
+        }
+
+        if (pSourceResource->m_bStaleCpuCaches)
+        {
+            m_commandBuffer.InvalidateCpuCaches(pSourceResource);
+        }
+
         // Before accessing the resources on CPU, flush if there is pending
         // GPU operation
         m_commandBuffer.FlushIfMatching(pDestinationResource->m_mostRecentFence);
@@ -407,7 +572,39 @@ void RosUmdDevice::ResourceCopy(
 
         Lock(&sourceLock);
 
-        if (pDestinationResource->m_usage == D3D10_DDI_USAGE_STAGING &&
+        //
+        // Staging resources and render targets that are scanned out are
+        // linear, render targets and textures are T-format
+        //
+
+        UINT    width = pSourceResource->m_mip0Info.TexelWidth;
+        UINT    height = pSourceResource->m_mip0Info.TexelHeight;
+
+        if ((pSourceResource->m_hwLayout == RosHwLayout::Tiled) &&
+            (pDestinationResource->m_hwLayout == RosHwLayout::Linear))
+        {
+            RosTFormat::Detile(
+                (const BYTE *)sourceLock.pData,
+                pSourceResource->m_hwWidthTiles,
+                (BYTE *)destinationLock.pData,
+                pDestinationResource->m_hwPitchBytes,
+                width,
+                height,
+                (pSourceResource->m_hwFormat == RosHwFormat::X8) ? 1 : 4);
+        }
+        else if ((pSourceResource->m_hwLayout == RosHwLayout::Linear) &&
+                 (pDestinationResource->m_hwLayout == RosHwLayout::Tiled))
+        {
+            RosTFormat::Tile(
+                (const BYTE *)sourceLock.pData,
+                pSourceResource->m_hwPitchBytes,
+                (BYTE *)destinationLock.pData,
+                pDestinationResource->m_hwWidthTiles,
+                width,
+                height,
+                (pDestinationResource->m_hwFormat == RosHwFormat::X8) ? 1 : 4);
+        }
+        else if (pDestinationResource->m_usage == D3D10_DDI_USAGE_STAGING &&
             pSourceResource->m_usage == D3D10_DDI_USAGE_STAGING)
         {
             assert(pSourceResource->m_hwSizeBytes == pDestinationResource->m_hwSizeBytes);
@@ -416,13 +613,11 @@ void RosUmdDevice::ResourceCopy(
         else if (pDestinationResource->m_usage == D3D10_DDI_USAGE_STAGING &&
             pSourceResource->m_usage == D3D10_DDI_USAGE_DEFAULT)
         {
-            // TODO(bhouse) Implement CPU side tile to linear swizzle
             assert(pSourceResource->m_hwSizeBytes >= pDestinationResource->m_hwSizeBytes);
             memcpy(destinationLock.pData, sourceLock.pData, pDestinationResource->m_hwSizeBytes);
         }
         else
         {
-            // TODO(bhouse) Implement CPU side liner to tile swizzle
             assert(pSourceResource->m_hwSizeBytes <= pDestinationResource->m_hwSizeBytes);
             memcpy(destinationLock.pData, sourceLock.pData, pSourceResource->m_hwSizeBytes);
         }
@@ -430,6 +625,8 @@ void RosUmdDevice::ResourceCopy(
         D3DDDICB_UNLOCK unlock;
         memset(&unlock, 0, sizeof(unlock));
 
+        pDestinationResource->MarkCpuWritten();
+
         D3DKMT_HANDLE hAllocations[2] = { pSourceResource->m_hKMAllocation , pDestinationResource->m_hKMAllocation };
 
         unlock.NumAllocations = 2;
@@ -448,7 +645,7 @@ void RosUmdDevice::ConstantBufferUpdateSubresourceUP(
     UINT DepthPitch,
     UINT CopyFlags)
 {
-    pDstResource->ConstantBufferUpdateSubresourceUP(DstSubresource, pDstBox, pSysMemUP, RowPitch, DepthPitch, CopyFlags);
+    pDstResource->ConstantBufferUpdateSubresourceUP(this, DstSubresource, pDstBox, pSysMemUP, RowPitch, DepthPitch, CopyFlags);
 }
 
 void RosUmdDevice::CreatePixelShader(
@@ -540,8 +737,6 @@ void RosUmdDevice::CheckFormatSupport(
     DXGI_FORMAT inFormat,
     UINT* pOutFormatSupport)
 {
-    inFormat; // unused
-
     *pOutFormatSupport = 0;
 
     *pOutFormatSupport |= D3D10_DDI_FORMAT_SUPPORT_SHADER_SAMPLE;
@@ -550,33 +745,129 @@ void RosUmdDevice::CheckFormatSupport(
     *pOutFormatSupport |= D3D11_1DDI_FORMAT_SUPPORT_VERTEX_BUFFER;
     *pOutFormatSupport |= D3D11_1DDI_FORMAT_SUPPORT_UAV_WRITES;
     *pOutFormatSupport |= D3D11_1DDI_FORMAT_SUPPORT_SHADER_GATHER;
+
+#if VC4
+
+    //
+    // The tile buffer renders 4 samples of the formats it stores, and
+    // resolves the color ones when it stores the tiles
+    //
+
+    switch (inFormat)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+        *pOutFormatSupport |= D3D10_DDI_FORMAT_SUPPORT_MULTISAMPLE_RENDERTARGET;
+        *pOutFormatSupport |= D3D10_DDI_FORMAT_SUPPORT_MULTISAMPLE_RESOLVE;
+        break;
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+        *pOutFormatSupport |= D3D10_DDI_FORMAT_SUPPORT_MULTISAMPLE_RENDERTARGET;
+        break;
+    default:
+        break;
+    }
+
+#else
+
+    inFormat; // unused
+
+#endif
 }
 
 void RosUmdDevice::CheckCounterInfo(
     D3D10DDI_COUNTER_INFO* pOutCounterInfo)
 {
-    // We do not support any counters, use "no-support" values
+    // One device dependent counter per V3D performance counter source
     static const D3D10DDI_COUNTER_INFO Info =
     {
-        D3D10DDI_QUERY(D3D10DDI_COUNTER_DEVICE_DEPENDENT_0 + 3),
-        3,
+        D3D10DDI_QUERY(D3D10DDI_COUNTER_DEVICE_DEPENDENT_0 + V3D_NUM_PERF_COUNTER_SOURCES - 1),
+        V3D_NUM_PERF_COUNTERS,
         1,
     };
 
     *pOutCounterInfo = Info;
 }
 
+static void CopyCounterString(const char * pString, LPSTR pBuffer, UINT * pLength)
+{
+    if (NULL == pLength)
+    {
+        return;
+    }
+
+    if (pBuffer && *pLength)
+    {
+        StringCchCopyA(pBuffer, *pLength, pString);
+    }
+
+    *pLength = (UINT)strlen(pString) + 1;
+}
+
+void RosUmdDevice::CheckCounter(
+    D3D10DDI_QUERY query,
+    D3D10DDI_COUNTER_TYPE* pCounterType,
+    UINT* pActiveCounters,
+    LPSTR pName,
+    UINT* pNameLength,
+    LPSTR pUnits,
+    UINT* pUnitsLength,
+    LPSTR pDescription,
+    UINT* pDescriptionLength)
+{
+    if (!RosUmdQuery::IsPerfCounter(query))
+    {
+        throw RosUmdException(E_INVALIDARG);
+    }
+
+    const RosUmdPerfCounterDesc &   desc = RosUmdPerfCounters::GetDesc(RosUmdQuery::GetPerfCounterSource(query));
+
+    *pCounterType = D3D10DDI_COUNTER_TYPE_UINT64;
+    *pActiveCounters = 1;
+
+    CopyCounterString(desc.m_pName, pName, pNameLength);
+    CopyCounterString(desc.m_pUnits, pUnits, pUnitsLength);
+    CopyCounterString(desc.m_pDescription, pDescription, pDescriptionLength);
+}
+
 void RosUmdDevice::CheckMultisampleQualityLevels(
     DXGI_FORMAT inFormat,
     UINT inSampleCount,
     UINT inFlags,
     UINT* pOutNumQualityLevels)
 {
-    inFormat; // unused
-    inSampleCount; // unused
     inFlags; // unused
 
     *pOutNumQualityLevels = 0;
+
+    if (inSampleCount == 1)
+    {
+        *pOutNumQualityLevels = 1;
+        return;
+    }
+
+#if VC4
+
+    //
+    // Only the 4x multisample mode of the tile buffer, at one quality
+    //
+
+    if (inSampleCount == VC4_MAX_SAMPLES)
+    {
+        UINT    formatSupport;
+
+        CheckFormatSupport(inFormat, &formatSupport);
+
+        if (formatSupport & D3D10_DDI_FORMAT_SUPPORT_MULTISAMPLE_RENDERTARGET)
+        {
+            *pOutNumQualityLevels = 1;
+        }
+    }
+
+#else
+
+    inFormat; // unused
+
+#endif
 }
 
 //
@@ -595,6 +886,13 @@ void RosUmdDevice::Lock(D3DDDICB_LOCK * pLock)
     if (hr != S_OK) throw RosUmdException(hr);
 }
 
+void RosUmdDevice::Deallocate(D3DDDICB_DEALLOCATE * pDeallocate)
+{
+    HRESULT hr = m_pMSKTCallbacks->pfnDeallocateCb(m_hRTDevice.handle, pDeallocate);
+
+    if (hr != S_OK) throw RosUmdException(hr);
+}
+
 void RosUmdDevice::Unlock(D3DDDICB_UNLOCK * pUnlock)
 {
     HRESULT hr = m_pMSKTCallbacks->pfnUnlockCb(m_hRTDevice.handle, pUnlock);
@@ -620,11 +918,15 @@ HRESULT RosUmdDevice::Present(DXGI_DDI_ARG_PRESENT* Args)
 {
     assert(this == CastFrom(Args->hDevice));
 
+    //
+    // Immediate flips tear, the OS paces the flips of the other intervals
+    // on vsync and the KMD queues them (RosFlipQueue)
+    //
     if (Args->Flags.Flip)
     {
-        if (Args->FlipInterval != DXGI_DDI_FLIP_INTERVAL_ONE)
+        if (Args->FlipInterval > DXGI_DDI_FLIP_INTERVAL_FOUR)
         {
-            assert(!"The only supported flip interval is 1.");
+            assert(!"The supported flip intervals are 0 to 4.");
             return E_INVALIDARG;
         }
     }
@@ -751,9 +1053,9 @@ HRESULT RosUmdDevice::Present1(DXGI_DDI_ARG_PRESENT1* Args)
 
     if (Args->Flags.Flip)
     {
-        if (Args->FlipInterval != DXGI_DDI_FLIP_INTERVAL_ONE)
+        if (Args->FlipInterval > DXGI_DDI_FLIP_INTERVAL_FOUR)
         {
-            assert(!"The only supported flip interval is 1.");
+            assert(!"The supported flip intervals are 0 to 4.");
             return E_INVALIDARG;
         }
     }
@@ -880,6 +1182,14 @@ void RosUmdDevice::SetException(const std::exception & e)
 
 void RosUmdDevice::Draw(UINT vertexCount, UINT startVertexLocation)
 {
+    if (IsPredicatedOut())
+    {
+        return;
+    }
+
+    m_drawnVertices += vertexCount;
+    m_drawnPrimitives += GetPrimitiveCount(m_topology, vertexCount);
+
     //
     // Refresh render state
     //
@@ -919,133 +1229,531 @@ void RosUmdDevice::DrawIndexed(UINT indexCount, UINT startIndexLocation, INT bas
     // TODO[indyz]: Need to guarantee that Draw command goes with Start Tile Binning command
     //
 
+    assert((m_indexFormat == DXGI_FORMAT_R16_UINT) || (m_indexFormat == DXGI_FORMAT_R32_UINT));
+
+    if ((0 == indexCount) || IsPredicatedOut())
+    {
+        return;
+    }
+
+    m_drawnVertices += indexCount;
+    m_drawnPrimitives += GetPrimitiveCount(m_topology, indexCount);
+
+#if VC4
+
+    VC4PrimitiveMode    primitiveMode = ConvertD3D11Topology(m_topology);
+
     //
-    // Refresh render state
+    // The scanned index range bounds the vertex fetch through MaximumIndex.
+    // 32 bit indices are drawn from the range's 16 bit shadow copy, one batch
+    // at a time with the vertex data rebased to the batch's minimal index.
     //
 
-    RefreshPipelineState(baseVertexLocation);
+    RosUmdIndexRangeEntry * pIndexRange = GetIndexRange(indexCount, startIndexLocation, primitiveMode);
 
-    BYTE *  pCommandBuffer;
-    UINT    curCommandOffset;
-    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation;
-    UINT    allocListIndex, indexSize;
+    UINT    shadowIndexOffset = 0;
 
-    m_commandBuffer.ReserveCommandBufferSpace(
-        false,                                  // HW command
-        sizeof(VC4IndexedPrimitiveList),
-        &pCommandBuffer,
-        1,
-        1,
-        &curCommandOffset,
-        &pPatchLocation);
+    for (UINT i = 0; i < pIndexRange->m_numBatches; i++)
+    {
+        const RosUmdIndexBatch &    batch = pIndexRange->m_pBatches[i];
 
-#if VC4
+        RosUmdResource *    pIndexBuffer;
+        UINT    indicesOffset;
+        UINT    batchIndexCount;
+        UINT    vertexRebase;
+
+        if (pIndexRange->m_key.m_indexSize == sizeof(UINT))
+        {
+            pIndexBuffer = pIndexRange->m_pShadowBuffer;
+            indicesOffset = shadowIndexOffset*sizeof(USHORT);
+            batchIndexCount = batch.m_leadingPad + batch.m_indexCount;
+            vertexRebase = batch.m_minIndex;
 
-    VC4IndexedPrimitiveList *   pVC4IndexedPrimitiveList = (VC4IndexedPrimitiveList *)pCommandBuffer;
+            shadowIndexOffset += batchIndexCount;
+        }
+        else
+        {
+            pIndexBuffer = m_indexBuffer;
+            indicesOffset = startIndexLocation*sizeof(USHORT) + m_indexOffset;
+            batchIndexCount = batch.m_indexCount;
+            vertexRebase = 0;
+        }
+
+        //
+        // Refresh render state
+        //
+
+        RefreshPipelineState(baseVertexLocation + vertexRebase);
 
-    *pVC4IndexedPrimitiveList = vc4IndexedPrimitiveList;
+        BYTE *  pCommandBuffer;
+        UINT    curCommandOffset;
+        D3DDDI_PATCHLOCATIONLIST *  pPatchLocation;
+        UINT    allocListIndex;
 
-    pVC4IndexedPrimitiveList->PrimitiveMode = ConvertD3D11Topology(m_topology);
+        m_commandBuffer.ReserveCommandBufferSpace(
+            false,                                  // HW command
+            sizeof(VC4IndexedPrimitiveList),
+            &pCommandBuffer,
+            1,
+            1,
+            &curCommandOffset,
+            &pPatchLocation);
 
-    assert(m_indexFormat == DXGI_FORMAT_R16_UINT);
-    pVC4IndexedPrimitiveList->IndexType = 1;    // 16 bit index
-    indexSize = 2;                              // 2 bytes
+        VC4IndexedPrimitiveList *   pVC4IndexedPrimitiveList = (VC4IndexedPrimitiveList *)pCommandBuffer;
 
-    pVC4IndexedPrimitiveList->Length = indexCount;
+        RosUmdIndexRange::WriteIndexedPrimitiveList(
+            pVC4IndexedPrimitiveList,
+            primitiveMode,
+            batchIndexCount,
+            batch.m_maxIndex - vertexRebase);
 
 #if DBG
-    pVC4IndexedPrimitiveList->AddressOfIndicesList = 0xDEADBEEF;
+        pVC4IndexedPrimitiveList->AddressOfIndicesList = 0xDEADBEEF;
 #endif
 
-    allocListIndex = m_commandBuffer.UseResource(m_indexBuffer, false);
+        allocListIndex = m_commandBuffer.UseResource(pIndexBuffer, false);
 
-    m_commandBuffer.SetPatchLocation(
-        pPatchLocation,
-        allocListIndex,
-        curCommandOffset + offsetof(VC4IndexedPrimitiveList, AddressOfIndicesList),
-        0,
-        startIndexLocation*indexSize + m_indexOffset);
+        m_commandBuffer.SetPatchLocation(
+            pPatchLocation,
+            allocListIndex,
+            curCommandOffset + offsetof(VC4IndexedPrimitiveList, AddressOfIndicesList),
+            0,
+            indicesOffset);
 
-    pVC4IndexedPrimitiveList->MaximumIndex = 0xffff;    // Maximal USHORT
+        m_commandBuffer.CommitCommandBufferSpace(sizeof(VC4IndexedPrimitiveList), 1);
+    }
 
 #endif
 
-    m_commandBuffer.CommitCommandBufferSpace(sizeof(VC4IndexedPrimitiveList), 1);
-
     // Update device flag to indicate comamnd buffer has Draw call
     m_flags.m_hasDrawCall = true;
 }
 
-void RosUmdDevice::ClearRenderTargetView(RosUmdRenderTargetView * pRenderTargetView, FLOAT clearColor[4])
-{
 #if VC4
 
-    RosUmdResource * pRenderTarget = RosUmdResource::CastFrom(pRenderTargetView->m_create.hDrvResource);
-
-    //
-    // KMD issumes Clear Colors command before Draw call
-    //
-
-    if (m_flags.m_hasDrawCall)
+RosUmdIndexRangeEntry * RosUmdDevice::GetIndexRange(
+    UINT                indexCount,
+    UINT                startIndexLocation,
+    VC4PrimitiveMode    primitiveMode)
+{
+    RosUmdIndexRangeKey key;
+    memset(&key, 0, sizeof(key));
+
+    key.m_pIndexBuffer = m_indexBuffer;
+    key.m_contentVersion = m_indexBuffer->m_contentVersion;
+    key.m_indexSize = (m_indexFormat == DXGI_FORMAT_R32_UINT) ? sizeof(UINT) : sizeof(USHORT);
+    key.m_byteOffset = startIndexLocation*key.m_indexSize + m_indexOffset;
+    key.m_indexCount = indexCount;
+    key.m_primitiveMode = primitiveMode;
+
+    RosUmdIndexRangeEntry * pEntry = m_indexRangeCache.Find(key);
+    if (pEntry)
     {
-        m_commandBuffer.Flush(0);
+        return pEntry;
     }
 
-    // Set clear color into command buffer header for KMD to generate Rendering Control List
-    m_commandBuffer.UpdateClearColor(ConvertFloatColor(pRenderTarget->m_format, clearColor));
+    assert(key.m_byteOffset + indexCount*key.m_indexSize <= m_indexBuffer->m_hwSizeBytes);
 
-#endif
-}
+    pEntry = m_indexRangeCache.Insert(key);
 
-void RosUmdDevice::ClearDepthStencilView(RosUmdDepthStencilView * pDepthStencilView, UINT clearFlags, FLOAT depthValue, UINT8 stencilValue)
-{
-    pDepthStencilView;  // unused
+    //
+    // The entry only becomes valid once the scan completes
+    //
 
-    // TODO[indyz]: Clear depth and stencil separately
-    clearFlags;         // unused;
+    pEntry->m_bValid = false;
 
     //
-    // KMD issumes Clear Colors command before Draw call
+    // GPU never writes index buffers, so reading them doesn't require
+    // flushing the current command buffer
     //
 
-    if (m_flags.m_hasDrawCall)
-    {
-        m_commandBuffer.Flush(0);
-    }
+    D3DDDICB_LOCK lock;
+    memset(&lock, 0, sizeof(lock));
 
-    // Set clear depth and stencil into command buffer header for KMD to generate Rendering Control List
-    m_commandBuffer.UpdateClearDepthStencil(depthValue, stencilValue);
-}
+    lock.hAllocation = m_indexBuffer->m_hKMAllocation;
+    lock.Flags.ReadOnly = true;
 
-//
-// Graphics State Management
-//
+    Lock(&lock);
 
-void RosUmdDevice::SetVertexBuffers(UINT startBuffer, UINT numBuffers, const D3D10DDI_HRESOURCE* phBuffers, const UINT* pStrides, const UINT* pOffsets)
-{
-    assert(startBuffer + numBuffers <= kMaxVertexBuffers);
+    const BYTE *    pIndices = ((const BYTE *)lock.pData) + key.m_byteOffset;
 
-    for (UINT i = 0; i < numBuffers; i++)
+    try
     {
-        m_vertexBuffers[i+startBuffer] = RosUmdResource::CastFrom(phBuffers[i]);
-    }
-    m_numVertexBuffers = numBuffers;
+        if (key.m_indexSize == sizeof(USHORT))
+        {
+            m_indexRangeCache.ReserveBatches(pEntry, 1);
 
-    memcpy(&m_vertexStrides[startBuffer], pStrides, numBuffers * sizeof(UINT));
-    memcpy(&m_vertexOffsets[startBuffer], pOffsets, numBuffers * sizeof(UINT));
+            RosUmdIndexBatch *  pBatch = pEntry->m_pBatches;
 
-}
+            pBatch->m_firstIndex = 0;
+            pBatch->m_indexCount = indexCount;
+            pBatch->m_leadingPad = 0;
 
-void RosUmdDevice::SetIndexBuffer(const D3D10DDI_HRESOURCE indexBuffer, DXGI_FORMAT indexFormat, UINT offset)
-{
-    m_indexBuffer = RosUmdResource::CastFrom(indexBuffer);
-    m_indexFormat = indexFormat;
-    m_indexOffset = offset;
-}
+            RosUmdIndexRange::Scan(pIndices, sizeof(USHORT), indexCount, &pBatch->m_minIndex, &pBatch->m_maxIndex);
 
-void RosUmdDevice::VsSetConstantBuffers11_1(
-    UINT startBuffer,
-    UINT numberBuffers,
+            pEntry->m_numBatches = 1;
+        }
+        else
+        {
+            UINT    numDropped;
+            UINT    numBatches = RosUmdIndexRange::Split(pIndices, sizeof(UINT), indexCount, primitiveMode, NULL, 0, &numDropped);
+
+            if (numDropped)
+            {
+                ROS_LOG_WARNING(
+                    "Primitives spanning more than 64K vertices are not drawn. (numDropped = %u, indexCount = %u)",
+                    numDropped,
+                    indexCount);
+            }
+
+            m_indexRangeCache.ReserveBatches(pEntry, numBatches);
+
+            pEntry->m_numBatches = RosUmdIndexRange::Split(
+                pIndices,
+                sizeof(UINT),
+                indexCount,
+                primitiveMode,
+                pEntry->m_pBatches,
+                numBatches,
+                NULL);
+
+            WriteShadowIndices(pEntry, pIndices);
+        }
+    }
+    catch (...)
+    {
+        D3DDDICB_UNLOCK unlock;
+        memset(&unlock, 0, sizeof(unlock));
+
+        unlock.NumAllocations = 1;
+        unlock.phAllocations = &m_indexBuffer->m_hKMAllocation;
+
+        Unlock(&unlock);
+
+        throw;
+    }
+
+    D3DDDICB_UNLOCK unlock;
+    memset(&unlock, 0, sizeof(unlock));
+
+    unlock.NumAllocations = 1;
+    unlock.phAllocations = &m_indexBuffer->m_hKMAllocation;
+
+    Unlock(&unlock);
+
+    pEntry->m_bValid = true;
+
+    return pEntry;
+}
+
+void RosUmdDevice::WriteShadowIndices(
+    RosUmdIndexRangeEntry * pEntry,
+    const BYTE *            pIndices)
+{
+    UINT    shadowIndexCount = 0;
+
+    for (UINT i = 0; i < pEntry->m_numBatches; i++)
+    {
+        shadowIndexCount += pEntry->m_pBatches[i].m_leadingPad + pEntry->m_pBatches[i].m_indexCount;
+    }
+
+    UINT    shadowSize = shadowIndexCount*sizeof(USHORT);
+
+    if ((NULL == pEntry->m_pShadowBuffer) || (pEntry->m_shadowBufferSize < shadowSize))
+    {
+        DestroyShadowIndexBuffer(pEntry);
+
+        UINT    bufferSize = max(shadowSize, (UINT)PAGE_SIZE);
+        AlignValue(bufferSize, PAGE_SIZE);
+
+        pEntry->m_pShadowBuffer = new RosUmdResource();
+        if (NULL == pEntry->m_pShadowBuffer)
+        {
+            throw RosUmdException(E_OUTOFMEMORY);
+        }
+
+        CreateInternalBuffer(pEntry->m_pShadowBuffer, bufferSize);
+
+        pEntry->m_shadowBufferSize = bufferSize;
+    }
+
+    RosUmdResource *    pShadowBuffer = pEntry->m_pShadowBuffer;
+
+    //
+    // Shadow buffer may still be used by a previous draw, discard gives
+    // a new allocation instance instead of waiting for the GPU
+    //
+
+    D3DDDICB_LOCK lock;
+    memset(&lock, 0, sizeof(lock));
+
+    lock.hAllocation = pShadowBuffer->m_hKMAllocation;
+    lock.Flags.WriteOnly = true;
+    lock.Flags.Discard = (pShadowBuffer->m_mostRecentFence != RosUmdCommandBuffer::s_nullFence);
+
+    Lock(&lock);
+
+    if (lock.Flags.Discard && (pShadowBuffer->m_hKMAllocation != lock.hAllocation))
+    {
+        pShadowBuffer->m_hKMAllocation = lock.hAllocation;
+
+        if (m_commandBuffer.IsResourceUsed(pShadowBuffer))
+        {
+            pShadowBuffer->m_mostRecentFence -= 1;
+        }
+    }
+
+    USHORT *    pDst = (USHORT *)lock.pData;
+
+    for (UINT i = 0; i < pEntry->m_numBatches; i++)
+    {
+        const RosUmdIndexBatch &    batch = pEntry->m_pBatches[i];
+
+        RosUmdIndexRange::WriteBatchIndices(pIndices, sizeof(UINT), batch, pDst);
+
+        pDst += batch.m_leadingPad + batch.m_indexCount;
+    }
+
+    pShadowBuffer->MarkCpuWritten(0, (UINT)((BYTE *)pDst - (BYTE *)lock.pData), 0);
+
+    D3DDDICB_UNLOCK unlock;
+    memset(&unlock, 0, sizeof(unlock));
+
+    unlock.NumAllocations = 1;
+    unlock.phAllocations = &pShadowBuffer->m_hKMAllocation;
+
+    Unlock(&unlock);
+}
+
+void RosUmdDevice::DestroyShadowIndexBuffer(
+    RosUmdIndexRangeEntry * pEntry)
+{
+    RosUmdResource *    pShadowBuffer = pEntry->m_pShadowBuffer;
+
+    if (NULL == pShadowBuffer)
+    {
+        return;
+    }
+
+    //
+    // Pending command buffer may reference the allocation
+    //
+
+    m_commandBuffer.FlushIfMatching(pShadowBuffer->m_mostRecentFence);
+
+    D3DDDICB_DEALLOCATE deallocate;
+    memset(&deallocate, 0, sizeof(deallocate));
+
+    deallocate.NumAllocations = 1;
+    deallocate.HandleList = &pShadowBuffer->m_hKMAllocation;
+
+    Deallocate(&deallocate);
+
+    pShadowBuffer->Teardown();
+    delete pShadowBuffer;
+
+    pEntry->m_pShadowBuffer = NULL;
+    pEntry->m_shadowBufferSize = 0;
+}
+
+#endif
+
+void RosUmdDevice::ClearRenderTargetView(RosUmdRenderTargetView * pRenderTargetView, FLOAT clearColor[4])
+{
+    if (IsPredicatedOut())
+    {
+        return;
+    }
+
+#if VC4
+
+    RosUmdResource * pRenderTarget = RosUmdResource::CastFrom(pRenderTargetView->m_create.hDrvResource);
+
+    //
+    // KMD issumes Clear Colors command before Draw call
+    //
+
+    if (m_flags.m_hasDrawCall)
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    // Set clear color into command buffer header for KMD to generate Rendering Control List
+    m_commandBuffer.UpdateClearColor(ConvertFloatColor(pRenderTarget->m_format, clearColor));
+
+#endif
+}
+
+void RosUmdDevice::ClearDepthStencilView(RosUmdDepthStencilView * pDepthStencilView, UINT clearFlags, FLOAT depthValue, UINT8 stencilValue)
+{
+    if (IsPredicatedOut())
+    {
+        return;
+    }
+
+#if VC4
+
+    RosUmdResource * pDepthStencil = RosUmdResource::CastFrom(pDepthStencilView->m_create.hDrvResource);
+
+    //
+    // The draws to the depth stencil buffer before the clear are rendered
+    // in a pass of their own
+    //
+
+    if (pDepthStencil == m_commandBuffer.GetDepthStencil())
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    //
+    // Only recorded, the KMD clears the tile buffer of the next render pass
+    // of the depth stencil buffer
+    //
+
+    UINT    max24BitDepthValue = 0xFFFFFF;
+    UINT    depth = (UINT)round(max24BitDepthValue*depthValue);
+    UINT    mask = 0;
+
+    if (clearFlags & D3D10_DDI_CLEAR_DEPTH)
+    {
+        pDepthStencil->m_bDepthUniform = true;
+        pDepthStencil->m_uniformDepth = depth;
+
+        mask |= VC4_DEPTH_MASK;
+    }
+
+    if (clearFlags & D3D10_DDI_CLEAR_STENCIL)
+    {
+        pDepthStencil->m_bStencilUniform = true;
+        pDepthStencil->m_uniformStencil = stencilValue;
+
+        mask |= VC4_STENCIL_MASK;
+    }
+
+    //
+    // The tile buffer is cleared of both depth and stencil, when draws
+    // wrote the other one it is loaded and the clear is written to memory
+    //
+
+    if (mask &&
+        !(pDepthStencil->m_bDepthUniform && pDepthStencil->m_bStencilUniform))
+    {
+        m_commandBuffer.FillDepthStencil(pDepthStencil, mask, (depth << 8) | stencilValue);
+    }
+
+#endif
+}
+
+void RosUmdDevice::Discard(D3D11DDI_HANDLETYPE handleType, VOID * hResourceOrView, const D3D10_DDI_RECT * pRects, UINT numRects)
+{
+    pRects; // unused
+
+#if VC4
+
+    RosUmdResource * pResource = NULL;
+
+    switch (handleType)
+    {
+    case D3D10DDI_HT_RESOURCE:
+        {
+            D3D10DDI_HRESOURCE hResource = { hResourceOrView };
+
+            pResource = RosUmdResource::CastFrom(hResource);
+        }
+        break;
+    case D3D10DDI_HT_DEPTHSTENCILVIEW:
+        {
+            D3D10DDI_HDEPTHSTENCILVIEW hDepthStencilView = { hResourceOrView };
+
+            pResource = RosUmdResource::CastFrom(RosUmdDepthStencilView::CastFrom(hDepthStencilView)->m_create.hDrvResource);
+        }
+        break;
+    case D3D10DDI_HT_RENDERTARGETVIEW:
+        {
+            D3D10DDI_HRENDERTARGETVIEW hRenderTargetView = { hResourceOrView };
+
+            pResource = RosUmdResource::CastFrom(RosUmdRenderTargetView::CastFrom(hRenderTargetView)->m_create.hDrvResource);
+        }
+        break;
+    default:
+        break;
+    }
+
+    if ((pResource == NULL) || numRects)
+    {
+        return;
+    }
+
+    //
+    // The samples of a multisample render target discarded after its
+    // resolve aren't stored by the render pass resolving them
+    //
+
+    if (pResource->IsMultisampled() &&
+        (pResource->m_bindFlags & D3D10_DDI_BIND_RENDER_TARGET) &&
+        m_commandBuffer.GetResolveTarget() &&
+        m_renderTargetViews[0] &&
+        (pResource == RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource)))
+    {
+        m_commandBuffer.DiscardRenderTarget();
+    }
+
+    //
+    // A whole depth stencil buffer discarded isn't stored by the render pass
+    // that drew it, nor loaded by the next one
+    //
+
+    if (!(pResource->m_bindFlags & D3D10_DDI_BIND_DEPTH_STENCIL))
+    {
+        return;
+    }
+
+    pResource->m_bDepthUniform = true;
+    pResource->m_bStencilUniform = true;
+
+    if (pResource == m_commandBuffer.GetDepthStencil())
+    {
+        m_commandBuffer.DiscardDepthStencil();
+    }
+
+#else
+
+    handleType;         // unused
+    hResourceOrView;    // unused
+    numRects;           // unused
+
+#endif
+}
+
+//
+// Graphics State Management
+//
+
+void RosUmdDevice::SetVertexBuffers(UINT startBuffer, UINT numBuffers, const D3D10DDI_HRESOURCE* phBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+    assert(startBuffer + numBuffers <= kMaxVertexBuffers);
+
+    for (UINT i = 0; i < numBuffers; i++)
+    {
+        m_vertexBuffers[i+startBuffer] = RosUmdResource::CastFrom(phBuffers[i]);
+    }
+    m_numVertexBuffers = numBuffers;
+
+    memcpy(&m_vertexStrides[startBuffer], pStrides, numBuffers * sizeof(UINT));
+    memcpy(&m_vertexOffsets[startBuffer], pOffsets, numBuffers * sizeof(UINT));
+
+}
+
+void RosUmdDevice::SetIndexBuffer(const D3D10DDI_HRESOURCE indexBuffer, DXGI_FORMAT indexFormat, UINT offset)
+{
+    m_indexBuffer = RosUmdResource::CastFrom(indexBuffer);
+    m_indexFormat = indexFormat;
+    m_indexOffset = offset;
+}
+
+void RosUmdDevice::VsSetConstantBuffers11_1(
+    UINT startBuffer,
+    UINT numberBuffers,
     const D3D10DDI_HRESOURCE *  phResources,
     const UINT *    pFirstConstant,
     const UINT *    pNumberConstants)
@@ -1067,6 +1775,15 @@ void RosUmdDevice::VsSetConstantBuffers11_1(
             m_vsNumberContants[bufIndex] = pNumberConstants[i];
         }
     }
+    else
+    {
+        bufIndex = startBuffer;
+        for (UINT i = 0; i < numberBuffers; i++, bufIndex++)
+        {
+            m_vs1stConstant[bufIndex] = 0;
+            m_vsNumberContants[bufIndex] = 0;
+        }
+    }
 }
 
 void RosUmdDevice::SetTopology(D3D10_DDI_PRIMITIVE_TOPOLOGY topology)
@@ -1098,10 +1815,20 @@ void RosUmdDevice::SetRenderTargets(const D3D10DDI_HRENDERTARGETVIEW* phRenderTa
 
     //
     // Flush is necessary for tile based render
-    // if there is Draw command for the previous render target
+    // if there is Draw command for the previous render target,
+    // binding the same targets again continues the pass
     //
 
-    if (m_flags.m_hasDrawCall)
+    bool    bSameTargets =
+        (numRTVs == m_numRenderTargetViews) &&
+        (RosUmdDepthStencilView::CastFrom(hDepthStencilView) == m_depthStencilView);
+
+    for (UINT i = 0; bSameTargets && (i < numRTVs); i++)
+    {
+        bSameTargets = (RosUmdRenderTargetView::CastFrom(phRenderTargetView[i]) == m_renderTargetViews[i]);
+    }
+
+    if (m_flags.m_hasDrawCall && !bSameTargets)
     {
         m_commandBuffer.Flush(0);
     }
@@ -1170,6 +1897,15 @@ void RosUmdDevice::PsSetConstantBuffers11_1(
             m_psNumberContants[bufIndex] = pNumberConstants[i];
         }
     }
+    else
+    {
+        bufIndex = startBuffer;
+        for (UINT i = 0; i < numberBuffers; i++, bufIndex++)
+        {
+            m_ps1stConstant[bufIndex] = 0;
+            m_psNumberContants[bufIndex] = 0;
+        }
+    }
 }
 
 void RosUmdDevice::SetVertexShader(RosUmdShader * pShader)
@@ -1278,14 +2014,30 @@ void RosUmdDevice::SetScissorRects(UINT NumScissorRects, UINT ClearScissorRects,
 #endif // VC4
 }
 
+RosUmdResource * RosUmdDevice::GetDrawTarget()
+{
+    if (m_numRenderTargetViews && m_renderTargetViews[0])
+    {
+        return RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource);
+    }
+
+    assert(m_depthStencilView);
+
+    return RosUmdResource::CastFrom(m_depthStencilView->m_create.hDrvResource);
+}
+
 void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
 {
-    RosUmdResource * pRenderTarget = RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource);
+    bool    bRenderTarget = m_numRenderTargetViews && m_renderTargetViews[0];
+
+    RosUmdResource * pRenderTarget = GetDrawTarget();
 
     // TODO[indyz] : Update RosHwFormat
-    assert(pRenderTarget->m_hwFormat == RosHwFormat::X8888);
-    // TODO[indyz] : Handle T and LT tiled formats
-    assert(pRenderTarget->m_hwLayout == RosHwLayout::Linear);
+    assert(!bRenderTarget || (pRenderTarget->m_hwFormat == RosHwFormat::X8888));
+    assert(!bRenderTarget ||
+           (pRenderTarget->m_hwLayout == RosHwLayout::Linear) ||
+           (pRenderTarget->m_hwLayout == RosHwLayout::Tiled) ||
+           (pRenderTarget->m_hwLayout == RosHwLayout::Multisample));
 
     //
     // Update shaders
@@ -1317,11 +2069,31 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
 
 #if VC4
 
-    BYTE *  pCommandBuffer;
-    BYTE *  pCurCommand;
-    UINT    curCommandOffset;
-    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation;
-    D3DDDI_PATCHLOCATIONLIST *  pCurPatchLocation;
+    //
+    // Without a render target or with color writes masked off, the draw
+    // renders depth alone. It runs the trivial fragment shader writing Z in
+    // place of a pixel shader whose color goes nowhere.
+    //
+
+    bool    bDepthOnly = RosDepthOnly::IsDepthOnly(
+        bRenderTarget,
+        m_blendState ? m_blendState->GetDesc()->RenderTarget[0].RenderTargetWriteMask : D3D10_DDI_COLOR_WRITE_ENABLE_ALL);
+
+    bool    bDepthOnlyShader = m_pixelShader && RosDepthOnly::ReplacesShader(
+        bDepthOnly,
+        m_pixelShader->UsesDiscard(),
+        m_pixelShader->OutputsDepth());
+
+    if (bDepthOnlyShader)
+    {
+        UpdateDepthOnlyShader();
+    }
+
+    BYTE *  pCommandBuffer;
+    BYTE *  pCurCommand;
+    UINT    curCommandOffset;
+    D3DDDI_PATCHLOCATIONLIST *  pPatchLocation;
+    D3DDDI_PATCHLOCATIONLIST *  pCurPatchLocation;
     UINT    dummyAllocIndex;
     UINT    allocListIndex;
 
@@ -1330,12 +2102,42 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     //
 
     UINT    maxStateComamnds = 170;
-    UINT    maxAllocationsUsed = 15;
-    UINT    maxPatchLocations = 22;
+    UINT    maxAllocationsUsed = 18;
+    UINT    maxPatchLocations = 23;
+
+    //
+    // The pass resolving the render target ends before the next draw
+    //
+
+    if (m_commandBuffer.GetResolveTarget())
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    //
+    // The tile buffer loads and stores a depth stencil buffer of the size
+    // and the samples of the render target, draws test against another one
+    // in the tile buffer only
+    //
+
+    RosUmdResource *    pDepthStencil = NULL;
+
+    if (m_depthStencilView)
+    {
+        pDepthStencil = RosUmdResource::CastFrom(m_depthStencilView->m_create.hDrvResource);
+
+        if ((pDepthStencil->m_mip0Info.TexelWidth != pRenderTarget->m_mip0Info.TexelWidth) ||
+            (pDepthStencil->m_mip0Info.TexelHeight != pRenderTarget->m_mip0Info.TexelHeight) ||
+            (pDepthStencil->IsMultisampled() != pRenderTarget->IsMultisampled()))
+        {
+            pDepthStencil = NULL;
+        }
+    }
 
     //
     // To simplify patching and merging of internal and user constant data,
-    // the pixel shader constant buffer is copied directly into command buffer.
+    // uniforms are copied into command buffer, unless the stream can be
+    // read in place from a constant buffer's ring slice.
     //
 
     UINT    psContantDataSize;
@@ -1361,6 +2163,31 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     vsContantDataSize = numVSUniformEntries*sizeof(FLOAT);
     csContantDataSize = numCSUniformEntries*sizeof(FLOAT);
 
+    UINT    psDirectOffset = 0;
+    UINT    vsDirectOffset = 0;
+    UINT    csDirectOffset = 0;
+
+    RosUmdResource *    pPSDirectBuffer = GetDirectUniformBuffer(true, pPSUniformEntries, numPSUniformEntries, &psDirectOffset);
+    RosUmdResource *    pVSDirectBuffer = GetDirectUniformBuffer(false, pVSUniformEntries, numVSUniformEntries, &vsDirectOffset);
+    RosUmdResource *    pCSDirectBuffer = GetDirectUniformBuffer(false, pCSUniformEntries, numCSUniformEntries, &csDirectOffset);
+
+    if (pPSDirectBuffer)
+    {
+        psContantDataSize = 0;
+    }
+
+    if (pVSDirectBuffer)
+    {
+        vsContantDataSize = 0;
+    }
+
+    if (pCSDirectBuffer)
+    {
+        csContantDataSize = 0;
+    }
+
+    m_uniformDraws++;
+
     maxStateComamnds += (psContantDataSize + vsContantDataSize + csContantDataSize);
 
     m_commandBuffer.ReserveCommandBufferSpace(
@@ -1397,11 +2224,14 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
         pVC4TileBinningModeConfig->TileStateDataArrayBaseAddress = 0xDEADBEEF;
 #endif
 
-        pVC4TileBinningModeConfig->WidthInTiles = (BYTE)pRenderTarget->m_hwWidthTiles;
-        pVC4TileBinningModeConfig->HeightInTiles = (BYTE)pRenderTarget->m_hwHeightTiles;
+        pVC4TileBinningModeConfig->WidthInTiles = (BYTE)Vc4WidthInTiles(*pRenderTarget);
+        pVC4TileBinningModeConfig->HeightInTiles = (BYTE)Vc4HeightInTiles(*pRenderTarget);
 
         pVC4TileBinningModeConfig->AutoInitialiseTileStateDataArray = 1;
 
+        // Bins into the smaller tiles of the multisample mode
+        pVC4TileBinningModeConfig->MultisampleMode = pRenderTarget->IsMultisampled() ? 1 : 0;
+
         // Tile allocation memory and stata data array are provided by KMD
 
         m_commandBuffer.SetPatchLocation(
@@ -1424,6 +2254,19 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
             curCommandOffset + offsetof(VC4TileBinningModeConfig, WidthInTiles),
             VC4_SLOT_RT_BINNING_CONFIG);
 
+        if (pDepthStencil)
+        {
+            allocListIndex = m_commandBuffer.UseResource(pDepthStencil, true);
+
+            m_commandBuffer.SetPatchLocation(
+                pCurPatchLocation,
+                allocListIndex,
+                offsetof(GpuCommand, m_commandBufferHeader.m_vc4DepthStencil),
+                VC4_SLOT_DEPTH_STENCIL);
+
+            m_commandBuffer.SetDepthStencil(pDepthStencil);
+        }
+
         //
         // Write Start Tile Binning command
         //
@@ -1440,6 +2283,8 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
         m_flags.m_binningStarted = true;
 
         MoveToNextCommand(pVC4StartTileBinning, pVC4PrimitiveListFormat, curCommandOffset);
+
+        m_commandBuffer.SetPassBodyOffset(curCommandOffset);
     }
     else
     {
@@ -1496,6 +2341,16 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
         pVC4ClipWindow->ClipWindowHeight = (USHORT)round(m_viewports[0].Height);
     }
 
+    //
+    // ClipWindowBottom is the top of the window in render target pixels
+    //
+
+    m_commandBuffer.AddDirtyRect(
+        pVC4ClipWindow->ClipWindowLeft,
+        pVC4ClipWindow->ClipWindowBottom,
+        pVC4ClipWindow->ClipWindowLeft + pVC4ClipWindow->ClipWindowWidth,
+        pVC4ClipWindow->ClipWindowBottom + pVC4ClipWindow->ClipWindowHeight);
+
     //
     // Write Configuration Bits command to update render state
     //
@@ -1528,6 +2383,15 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
 
     pVC4ConfigBits->ClockwisePrimitives = m_rasterizerState->m_desc.FrontCounterClockwise;
 
+    //
+    // Coverage of the 4 samples of each pixel of a multisample render target
+    //
+
+    if (pRenderTarget->IsMultisampled())
+    {
+        pVC4ConfigBits->RasteriserOversampleMode = 1;
+    }
+
     //
     // The D3D11 default depth stencil state is DepthEnable of true with
     // comparison function of less, and VC4's Tile Buffer has Z of 0.0 by
@@ -1537,16 +2401,47 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
 
     if (m_depthStencilState->m_desc.DepthEnable && m_depthStencilView)
     {
-        pVC4ConfigBits->EarlyZEnable = 1;
-
         pVC4ConfigBits->DepthTestFunction = ConvertD3D11DepthComparisonFunc(
             m_depthStencilState->m_desc.DepthFunc);
 
-        if (m_depthStencilState->m_desc.DepthWriteMask == D3D10_DDI_DEPTH_WRITE_MASK_ALL)
+        bool    bDepthWrite = (m_depthStencilState->m_desc.DepthWriteMask == D3D10_DDI_DEPTH_WRITE_MASK_ALL);
+
+        //
+        // Early-Z stays on unless the pixel shader discards or writes
+        // oDepth, a discarding shader then tests early and writes late
+        // when the depth function allows it
+        //
+
+        static_assert(
+            (VC4_DEPTH_TEST_LESS == ROS_DEPTH_FUNC_LESS) &&
+            (VC4_DEPTH_TEST_NOT_EQUAL == ROS_DEPTH_FUNC_NOT_EQUAL) &&
+            (VC4_DEPTH_TEST_ALWAYS == ROS_DEPTH_FUNC_ALWAYS),
+            "RosDepthFunc is in the encoding of VC4DepthTestFunc");
+
+        RosZMode    zMode = RosEarlyZ::GetZMode(
+            (RosDepthFunc)pVC4ConfigBits->DepthTestFunction,
+            bDepthWrite,
+            m_pixelShader && m_pixelShader->UsesDiscard(),
+            m_pixelShader && m_pixelShader->OutputsDepth());
+
+        if (ROS_Z_MODE_LATE != zMode)
         {
-            pVC4ConfigBits->EarlyZUpdatesEnable = 1;
+            pVC4ConfigBits->EarlyZEnable = 1;
+        }
+
+        if (bDepthWrite)
+        {
+            if (ROS_Z_MODE_EARLY == zMode)
+            {
+                pVC4ConfigBits->EarlyZUpdatesEnable = 1;
+            }
             pVC4ConfigBits->ZUpdatesEnable = 1;
         }
+
+        if (m_commandBuffer.GetDepthStencil())
+        {
+            m_commandBuffer.UseDepthStencil(bDepthWrite);
+        }
     }
     else
     {
@@ -1555,6 +2450,8 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
         pVC4ConfigBits->EarlyZUpdatesEnable = 1;
     }
 
+    m_commandBuffer.UseRenderTarget(!bDepthOnly);
+
 #if NV_SHADER
 
     //
@@ -1621,12 +2518,14 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     pVC4NVShaderStateRecord->ShadedVertexDataAddress        = 0xDEADBEEF;
 #endif
 
-    allocListIndex = m_commandBuffer.UseResource(m_pixelShader->GetCodeResource(), false);
+    allocListIndex = m_commandBuffer.UseResource(m_shaderHeap.GetBuffer(), false);
 
     m_commandBuffer.SetPatchLocation(
         pCurPatchLocation,
         allocListIndex,
-        vc4NVShaderStateRecordOffset + offsetof(VC4NVShaderStateRecord, FragmentShaderCodeAddress));
+        vc4NVShaderStateRecordOffset + offsetof(VC4NVShaderStateRecord, FragmentShaderCodeAddress),
+        0,
+        m_pixelShader->GetCodeOffset());
 
     // TODO[indyz] : Set FragmentShaderUniformsAddress to constant buffer's address
     //
@@ -1819,7 +2718,21 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
 
     pVC4GLShaderStateRecord->EnableClipping = 1;
 
-    pVC4GLShaderStateRecord->FragmentShaderIsSingleThreaded = 1;
+    //
+    // Pixel shader that qualifies runs as 2 threads per QPU to hide texture fetch latency
+    //
+
+    pVC4GLShaderStateRecord->FragmentShaderIsSingleThreaded = m_pixelShader->IsThreaded() ? 0 : 1;
+
+    //
+    // The vertex shader still writes the varyings of the pixel shader, the
+    // depth-only fragment shader leaves them unread
+    //
+
+    if (bDepthOnlyShader)
+    {
+        pVC4GLShaderStateRecord->FragmentShaderIsSingleThreaded = 1;
+    }
 
     UINT numVaryings = m_pixelShader->GetShaderInputCount();
     assert(numVaryings < 0x100);
@@ -1830,12 +2743,18 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     pVC4GLShaderStateRecord->FragmentShaderUniformsAddress  = 0xDEADBEEF;
 #endif
 
-    allocListIndex = m_commandBuffer.UseResource(m_pixelShader->GetCodeResource(), false);
+    //
+    // Vertex, coordinate and pixel shader code share the shader heap allocation
+    //
+
+    UINT    shaderHeapAllocIndex = m_commandBuffer.UseResource(m_shaderHeap.GetBuffer(), false);
 
     m_commandBuffer.SetPatchLocation(
         pCurPatchLocation,
-        allocListIndex,
-        vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, FragmentShaderCodeAddress));
+        shaderHeapAllocIndex,
+        vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, FragmentShaderCodeAddress),
+        0,
+        bDepthOnlyShader ? m_shaderHeap.GetCodeOffset(m_depthOnlyShader) : m_pixelShader->GetCodeOffset());
 
     //
     // Set Fragment Shader Uniforms Address
@@ -1845,7 +2764,18 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
                               sizeof(VC4GLShaderStateRecord) +
                               m_elementLayout->m_numElements*sizeof(VC4VertexAttribute);
 
-    if (psContantDataSize)
+    if (pPSDirectBuffer)
+    {
+        allocListIndex = m_commandBuffer.UseResource(m_constantRing.GetChunkBuffer(pPSDirectBuffer->m_constantSlice.m_chunk), false);
+
+        m_commandBuffer.SetPatchLocation(
+            pCurPatchLocation,
+            allocListIndex,
+            vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, FragmentShaderUniformsAddress),
+            VC4_SLOT_FS_UNIFORM_ADDRESS,
+            pPSDirectBuffer->m_constantSlice.m_offset + psDirectOffset);
+    }
+    else if (psContantDataSize)
     {
         m_commandBuffer.SetPatchLocation(
             pCurPatchLocation,
@@ -1872,18 +2802,29 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     pVC4GLShaderStateRecord->VertexShaderUniformsAddress    = 0xDEADBEEF;
 #endif
 
-    allocListIndex = m_commandBuffer.UseResource(m_vertexShader->GetCodeResource(), false);
-
     m_commandBuffer.SetPatchLocation(
         pCurPatchLocation,
-        allocListIndex,
-        vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, VertexShaderCodeAddress));
+        shaderHeapAllocIndex,
+        vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, VertexShaderCodeAddress),
+        0,
+        m_vertexShader->GetCodeOffset());
 
     //
     // Set Vertex Shader Uniform Address
     //
 
-    if (vsContantDataSize)
+    if (pVSDirectBuffer)
+    {
+        allocListIndex = m_commandBuffer.UseResource(m_constantRing.GetChunkBuffer(pVSDirectBuffer->m_constantSlice.m_chunk), false);
+
+        m_commandBuffer.SetPatchLocation(
+            pCurPatchLocation,
+            allocListIndex,
+            vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, VertexShaderUniformsAddress),
+            VC4_SLOT_VS_UNIFORM_ADDRESS,
+            pVSDirectBuffer->m_constantSlice.m_offset + vsDirectOffset);
+    }
+    else if (vsContantDataSize)
     {
         m_commandBuffer.SetPatchLocation(
             pCurPatchLocation,
@@ -1905,20 +2846,29 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     pVC4GLShaderStateRecord->CoordinateShaderUniformsAddress    = 0xDEADBEEF;
 #endif
 
-    allocListIndex = m_commandBuffer.UseResource(m_vertexShader->GetCodeResource(), false);
-
     m_commandBuffer.SetPatchLocation(
         pCurPatchLocation,
-        allocListIndex,
+        shaderHeapAllocIndex,
         vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, CoordinateShaderCodeAddress),
         0,
-        m_vertexShader->m_vc4CoordinateShaderOffset);
+        m_vertexShader->GetCodeOffset() + m_vertexShader->m_vc4CoordinateShaderOffset);
 
     //
     // Set Vertex Shader Uniform Address
     //
 
-    if (csContantDataSize)
+    if (pCSDirectBuffer)
+    {
+        allocListIndex = m_commandBuffer.UseResource(m_constantRing.GetChunkBuffer(pCSDirectBuffer->m_constantSlice.m_chunk), false);
+
+        m_commandBuffer.SetPatchLocation(
+            pCurPatchLocation,
+            allocListIndex,
+            vc4GLShaderStateRecordOffset + offsetof(VC4GLShaderStateRecord, CoordinateShaderUniformsAddress),
+            VC4_SLOT_CS_UNIFORM_ADDRESS,
+            pCSDirectBuffer->m_constantSlice.m_offset + csDirectOffset);
+    }
+    else if (csContantDataSize)
     {
         m_commandBuffer.SetPatchLocation(
             pCurPatchLocation,
@@ -1940,13 +2890,26 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
     VC4VertexAttribute *    pVC4VertexAttribute;
     MoveToNextCommand(pVC4GLShaderStateRecord, pVC4VertexAttribute, curCommandOffset);
 
+    D3D10DDIARG_INPUT_ELEMENT_DESC *    pElementDesc = m_elementLayout->m_pElementDesc;
+    BYTE    elementBytes[8];
+
+    assert(m_elementLayout->m_numElements <= ARRAYSIZE(elementBytes));
+
+    for (UINT i = 0; i < m_elementLayout->m_numElements; i++)
+    {
+        elementBytes[i] = (BYTE)CPixel::BytesPerPixel(pElementDesc[i].Format);
+    }
+
     //
-    // TODO[indyz]: Avoid reading vertex data that Coordinate shader doesn't need
+    // Coordinate shader only reads the attributes position depends on
     //
 
-    D3D10DDIARG_INPUT_ELEMENT_DESC *    pElementDesc = m_elementLayout->m_pElementDesc;
-    BYTE    vpmOffset = 0;
-    BYTE    elementBytes;
+    RosUmdElementLayout::WriteVpmLayout(
+        m_elementLayout->m_numElements,
+        elementBytes,
+        m_vertexShader->GetCoordinateShaderInputMask(),
+        pVC4GLShaderStateRecord,
+        pVC4VertexAttribute);
 
     for (UINT i = 0; i < m_elementLayout->m_numElements; i++)
     {
@@ -1954,12 +2917,7 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
         pVC4VertexAttribute->VertexBaseMemoryAddress = 0xDEADBEEF;
 #endif
 
-        elementBytes = (BYTE)CPixel::BytesPerPixel(pElementDesc[i].Format);
-
-        pVC4VertexAttribute->NumberOfBytesMinusOne = elementBytes - 1;
         pVC4VertexAttribute->MemoryStride = (BYTE)m_vertexStrides[pElementDesc[i].InputSlot];
-        pVC4VertexAttribute->VertexShaderVPMOffset = vpmOffset;
-        pVC4VertexAttribute->CoordinateShaderVPMOffset = vpmOffset;
 
         allocListIndex = m_commandBuffer.UseResource(m_vertexBuffers[pElementDesc[i].InputSlot], false);
 
@@ -1970,19 +2928,9 @@ void RosUmdDevice::RefreshPipelineState(UINT vertexOffset)
             0,
             vertexOffset*m_vertexStrides[pElementDesc[i].InputSlot] + pElementDesc[i].AlignedByteOffset);
 
-        vpmOffset += elementBytes;
         MoveToNextCommand(pVC4VertexAttribute, pVC4VertexAttribute, curCommandOffset);
     }
 
-    //
-    // Set the Total Attributes Size and Attribute Array Select Bits
-    //
-    pVC4GLShaderStateRecord->VertexShaderAttributeArraySelectBits = (1 << m_elementLayout->m_numElements) - 1;
-    pVC4GLShaderStateRecord->VertexShaderTotalAttributesSize = vpmOffset;
-
-    pVC4GLShaderStateRecord->CoordinateShaderAttributeArraySelectBits = (1 << m_elementLayout->m_numElements) - 1;
-    pVC4GLShaderStateRecord->CoordinateShaderTotalAttributesSize = vpmOffset;
-
     //
     // Copy internal Fragment Shader Uniforms (Texture Config Paramater0/1/2/3)
     // and Uniforms from PS constant buffers into the command buffer
@@ -2100,8 +3048,10 @@ VC4TextureType RosUmdDevice::MapDXGITextureFormatToVC4Type(RosHwLayout layout, D
         switch (format)
         {
             case DXGI_FORMAT_R8G8B8A8_UNORM:
+            case DXGI_FORMAT_B8G8R8A8_UNORM:
             {
-                textureType.TextureType = VC4_TEX_RGBX8888;
+                // Alpha of a texture rendered to, like the linear RGBA32R
+                textureType.TextureType = VC4_TEX_RGBA8888;
             } 
             break;
             case DXGI_FORMAT_R8_UNORM:
@@ -2137,6 +3087,87 @@ VC4TextureType RosUmdDevice::MapDXGITextureFormatToVC4Type(RosHwLayout layout, D
     return textureType;
 }
 
+void RosUmdDevice::UpdateDepthOnlyShader()
+{
+    if (0 == m_depthOnlyShader.m_size)
+    {
+        if (!m_shaderHeap.Allocate(sizeof(RosDepthOnly::s_shader), &m_depthOnlyShader))
+        {
+            throw RosUmdException(E_OUTOFMEMORY);
+        }
+
+        memcpy(
+            m_shaderHeap.GetCodePointer(m_depthOnlyShader),
+            RosDepthOnly::s_shader,
+            sizeof(RosDepthOnly::s_shader));
+
+        m_shaderHeap.GetBuffer()->MarkCpuWritten(
+            m_shaderHeap.GetCodeOffset(m_depthOnlyShader),
+            sizeof(RosDepthOnly::s_shader),
+            VC4_GPU_CACHE_INSTRUCTION);
+    }
+}
+
+//
+// Returns the constant buffer a uniform stream can be read from in place,
+// i.e. when the stream is consecutive constants of a single buffer
+//
+
+RosUmdResource * RosUmdDevice::GetDirectUniformBuffer(
+    BOOLEAN                     bPSUniform,
+    const VC4_UNIFORM_FORMAT *  pUniformEntries,
+    UINT                        numUniformEntries,
+    UINT *                      pByteOffset)
+{
+    if (0 == numUniformEntries)
+    {
+        return NULL;
+    }
+
+    UINT    bufferSlot = pUniformEntries[0].userConstant.bufferSlot;
+    UINT    firstOffset = pUniformEntries[0].userConstant.bufferOffset;
+
+    for (UINT i = 0; i < numUniformEntries; i++)
+    {
+        if ((pUniformEntries[i].Type != VC4_UNIFORM_TYPE_USER_CONSTANT) ||
+            (pUniformEntries[i].userConstant.bufferSlot != bufferSlot) ||
+            (pUniformEntries[i].userConstant.bufferOffset != firstOffset + i))
+        {
+            return NULL;
+        }
+    }
+
+    RosUmdResource *    pConstantBuffer;
+    UINT                firstConstant;
+
+    if (bPSUniform)
+    {
+        pConstantBuffer = m_psConstantBuffer[bufferSlot];
+        firstConstant = m_ps1stConstant[bufferSlot];
+    }
+    else
+    {
+        pConstantBuffer = m_vsConstantBuffer[bufferSlot];
+        firstConstant = m_vs1stConstant[bufferSlot];
+    }
+
+    if (NULL == pConstantBuffer)
+    {
+        return NULL;
+    }
+
+    UINT    byteOffset = (firstConstant*4 + firstOffset)*sizeof(FLOAT);
+
+    if (byteOffset + numUniformEntries*sizeof(FLOAT) > pConstantBuffer->m_constantSlice.m_size)
+    {
+        return NULL;
+    }
+
+    *pByteOffset = byteOffset;
+
+    return pConstantBuffer;
+}
+
 void RosUmdDevice::WriteUniforms(
     BOOLEAN                     bPSUniform,
     VC4_UNIFORM_FORMAT *        pUniformEntries,
@@ -2158,17 +3189,22 @@ void RosUmdDevice::WriteUniforms(
                 FLOAT * pUniform = (FLOAT *)pCurCommand;
 
                 RosUmdResource *    pConstantBuffer;
+                UINT                firstConstant;
 
                 if (bPSUniform)
                 {
                     pConstantBuffer = m_psConstantBuffer[pCurUniformEntry->userConstant.bufferSlot];
+                    firstConstant = m_ps1stConstant[pCurUniformEntry->userConstant.bufferSlot];
                 }
                 else
                 {
                     pConstantBuffer = m_vsConstantBuffer[pCurUniformEntry->userConstant.bufferSlot];
+                    firstConstant = m_vs1stConstant[pCurUniformEntry->userConstant.bufferSlot];
                 }
 
-                *pUniform = *(((FLOAT *)pConstantBuffer->m_pSysMemCopy) + pCurUniformEntry->userConstant.bufferOffset);
+                *pUniform = *(((FLOAT *)pConstantBuffer->m_pSysMemCopy) + firstConstant*4 + pCurUniformEntry->userConstant.bufferOffset);
+
+                m_constantBytesCopied += sizeof(FLOAT);
 
                 MoveToNextCommand(pUniform, pCurCommand, curCommandOffset);
             }
@@ -2236,8 +3272,21 @@ void RosUmdDevice::WriteUniforms(
                 pVC4TexConfigParam1->MINFILT = ConvertD3D11TextureMinFilter(pSamplerDesc->Filter, pTexture->m_mipLevels <= 1);
                 pVC4TexConfigParam1->MAGFILT = ConvertD3D11TextureMagFilter(pSamplerDesc->Filter);
 
-                pVC4TexConfigParam1->WIDTH = pTexture->m_hwWidthPixels;
-                pVC4TexConfigParam1->HEIGHT = pTexture->m_hwHeightPixels;
+                //
+                // The TMU finds the rows of a linear texture from its width,
+                // and pads the width of a T-format one to whole tiles itself
+                //
+
+                if (pTexture->m_hwLayout == RosHwLayout::Tiled)
+                {
+                    pVC4TexConfigParam1->WIDTH = pTexture->m_mip0Info.TexelWidth;
+                    pVC4TexConfigParam1->HEIGHT = pTexture->m_mip0Info.TexelHeight;
+                }
+                else
+                {
+                    pVC4TexConfigParam1->WIDTH = pTexture->m_hwWidthPixels;
+                    pVC4TexConfigParam1->HEIGHT = pTexture->m_hwHeightPixels;
+                }
 
                 pVC4TexConfigParam1->TYPE4 = vc4TextureType.TYPE4;
 
@@ -2261,21 +3310,21 @@ void RosUmdDevice::WriteUniforms(
             break;
         case VC4_UNIFORM_TYPE_VIEWPORT_SCALE_X:
             {
-                RosUmdResource * pRenderTarget = RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource);
+                RosUmdResource * pRenderTarget = GetDrawTarget();
 
                 FLOAT * pScaleX = (FLOAT *)pCurCommand;
 
-                *pScaleX = pRenderTarget->m_hwWidthPixels*16.0f/2.0f;
+                *pScaleX = pRenderTarget->m_mip0Info.TexelWidth*16.0f/2.0f;
                 MoveToNextCommand(pScaleX, pCurCommand, curCommandOffset);
             }
             break;
         case VC4_UNIFORM_TYPE_VIEWPORT_SCALE_Y:
             {
-                RosUmdResource * pRenderTarget = RosUmdResource::CastFrom(m_renderTargetViews[0]->m_create.hDrvResource);
+                RosUmdResource * pRenderTarget = GetDrawTarget();
 
                 FLOAT * pScaleY = (FLOAT *)pCurCommand;
 
-                *pScaleY = pRenderTarget->m_hwHeightPixels*-16.0f/2.0f;
+                *pScaleY = pRenderTarget->m_mip0Info.TexelHeight*-16.0f/2.0f;
                 MoveToNextCommand(pScaleY, pCurCommand, curCommandOffset);
             }
             break;
@@ -2314,18 +3363,20 @@ void RosUmdDevice::WriteEpilog()
 
     m_commandBuffer.ReserveCommandBufferSpace(
         false,
-        4,
+        VC4_BINNING_EPILOG_SIZE,
         &pCommandBuffer);
 
     //
-    // Write Flush All State, NOP and Halt commands
+    // Write Flush All State, NOP and Halt commands, the KMD replaces them
+    // with a Branch to the DMA buffer continuing the pass
     //
     pCommandBuffer[0] = VC4_CMD_INCREMENT_SEMAPHORE;
     pCommandBuffer[1] = VC4_CMD_FLUSH_ALL_STATE;
     pCommandBuffer[2] = VC4_CMD_NOP;
-    pCommandBuffer[3] = VC4_CMD_HALT;
+    pCommandBuffer[3] = VC4_CMD_NOP;
+    pCommandBuffer[4] = VC4_CMD_HALT;
 
-    m_commandBuffer.CommitCommandBufferSpace(4);
+    m_commandBuffer.CommitCommandBufferSpace(VC4_BINNING_EPILOG_SIZE);
 
     //
     // Clear up state flag
@@ -2352,38 +3403,587 @@ void RosUmdDevice::CreateInternalBuffer(RosUmdResource * pRes, UINT size)
         MAKE_D3D10DDI_HRTRESOURCE(NULL));
 }
 
-void RosUmdDevice::SetPredication(D3D10DDI_HQUERY hQuery, BOOL bPredicateValue)
+void RosUmdDevice::RenameConstantBuffer(RosUmdResource * pConstantBuffer, bool bPreserveContents)
 {
+    if (pConstantBuffer->m_hwSizeBytes > RosUmdConstantRing::kChunkSize)
+    {
+        throw RosUmdException(E_INVALIDARG);
+    }
+
+    RosUmdConstantSlice slice;
+
+    if (!m_constantRing.Allocate(pConstantBuffer->m_hwSizeBytes, m_commandBuffer.GetSubmissionFence(), &slice))
+    {
+        //
+        // Every chunk is referenced by the current command buffer, once it
+        // is submitted the chunks without live slices can be discarded
+        //
+
+        m_commandBuffer.Flush(0);
+
+        if (!m_constantRing.Allocate(pConstantBuffer->m_hwSizeBytes, m_commandBuffer.GetSubmissionFence(), &slice))
+        {
+            throw RosUmdException(E_OUTOFMEMORY);
+        }
+    }
+
+    if (bPreserveContents && pConstantBuffer->m_pSysMemCopy)
+    {
+        memcpy(slice.m_pData, pConstantBuffer->m_pSysMemCopy, pConstantBuffer->m_hwSizeBytes);
+
+        m_constantBytesCopied += pConstantBuffer->m_hwSizeBytes;
+    }
+
+    m_constantRing.Release(pConstantBuffer->m_constantSlice, m_commandBuffer.GetSubmissionFence());
+
+    pConstantBuffer->m_constantSlice = slice;
+    pConstantBuffer->m_pSysMemCopy = slice.m_pData;
+}
+
+void RosUmdDevice::MarkConstantSliceWritten(RosUmdResource * pConstantBuffer)
+{
+    const RosUmdConstantSlice & slice = pConstantBuffer->m_constantSlice;
+
+    m_constantRing.GetChunkBuffer(slice.m_chunk)->MarkCpuWritten(slice.m_offset, slice.m_size, VC4_GPU_CACHE_UNIFORM);
+}
+
+//
+// Chunks stay locked while they are in use, VC4 memory is shared with the
+// CPU so ring slices are written in place
+//
+
+void RosUmdDeviceConstantRing::MapChunk(RosUmdConstantRingChunk * pChunk, bool bRecycle)
+{
+    if (bRecycle)
+    {
+        D3DDDICB_UNLOCK unlock;
+        memset(&unlock, 0, sizeof(unlock));
+
+        unlock.NumAllocations = 1;
+        unlock.phAllocations = &pChunk->m_pBuffer->m_hKMAllocation;
+
+        m_pDevice->Unlock(&unlock);
+    }
+    else
+    {
+        pChunk->m_pBuffer = new RosUmdResource();
+        if (NULL == pChunk->m_pBuffer)
+        {
+            throw RosUmdException(E_OUTOFMEMORY);
+        }
+
+        m_pDevice->CreateInternalBuffer(pChunk->m_pBuffer, kChunkSize);
+    }
+
     //
-    // https://msdn.microsoft.com/en-us/library/windows/hardware/ff569547(v=vs.85).aspx
-    // per doc, hQuery can contain nullptr - supposed to save the predicate value for future use
+    // Submitted command buffers may still read the recycled chunk, discard
+    // gives a new allocation instance instead of waiting for the GPU
     //
 
-    if (nullptr == hQuery.pDrvPrivate)
+    D3DDDICB_LOCK lock;
+    memset(&lock, 0, sizeof(lock));
+
+    lock.hAllocation = pChunk->m_pBuffer->m_hKMAllocation;
+    lock.Flags.Discard = bRecycle;
+
+    m_pDevice->Lock(&lock);
+
+    if (lock.Flags.Discard && (pChunk->m_pBuffer->m_hKMAllocation != lock.hAllocation))
     {
-        m_bPredicateValue = bPredicateValue;
+        assert(!m_pDevice->m_commandBuffer.IsResourceUsed(pChunk->m_pBuffer));
+
+        pChunk->m_pBuffer->m_hKMAllocation = lock.hAllocation;
     }
-    else
+
+    pChunk->m_pData = (BYTE *)lock.pData;
+}
+
+void RosUmdDeviceConstantRing::UnmapChunk(RosUmdConstantRingChunk * pChunk)
+{
+    RosUmdResource *    pBuffer = pChunk->m_pBuffer;
+
+    //
+    // Pending command buffer may reference the allocation
+    //
+
+    m_pDevice->m_commandBuffer.FlushIfMatching(pBuffer->m_mostRecentFence);
+
+    D3DDDICB_UNLOCK unlock;
+    memset(&unlock, 0, sizeof(unlock));
+
+    unlock.NumAllocations = 1;
+    unlock.phAllocations = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Unlock(&unlock);
+
+    D3DDDICB_DEALLOCATE deallocate;
+    memset(&deallocate, 0, sizeof(deallocate));
+
+    deallocate.NumAllocations = 1;
+    deallocate.HandleList = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Deallocate(&deallocate);
+
+    pBuffer->Teardown();
+    delete pBuffer;
+
+    pChunk->m_pBuffer = NULL;
+    pChunk->m_pData = NULL;
+}
+
+//
+// The shader heap chunk stays locked for its lifetime like the constant
+// ring chunks, code is written in place
+//
+
+void RosUmdDeviceShaderHeap::MapChunk(RosUmdShaderHeapChunk * pChunk)
+{
+    pChunk->m_pBuffer = new RosUmdResource();
+    if (NULL == pChunk->m_pBuffer)
+    {
+        throw RosUmdException(E_OUTOFMEMORY);
+    }
+
+    m_pDevice->CreateInternalBuffer(pChunk->m_pBuffer, pChunk->m_size);
+
+    D3DDDICB_LOCK lock;
+    memset(&lock, 0, sizeof(lock));
+
+    lock.hAllocation = pChunk->m_pBuffer->m_hKMAllocation;
+
+    m_pDevice->Lock(&lock);
+
+    pChunk->m_pData = (BYTE *)lock.pData;
+
+    // The live code is copied to the new chunk
+    pChunk->m_pBuffer->MarkCpuWritten(0, pChunk->m_size, VC4_GPU_CACHE_INSTRUCTION);
+}
+
+void RosUmdDeviceShaderHeap::UnmapChunk(RosUmdShaderHeapChunk * pChunk)
+{
+    RosUmdResource *    pBuffer = pChunk->m_pBuffer;
+
+    //
+    // Draws already recorded in the pending command buffer read the code
+    // from this chunk, submit them before the allocation goes away
+    //
+
+    m_pDevice->m_commandBuffer.FlushIfMatching(pBuffer->m_mostRecentFence);
+
+    D3DDDICB_UNLOCK unlock;
+    memset(&unlock, 0, sizeof(unlock));
+
+    unlock.NumAllocations = 1;
+    unlock.phAllocations = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Unlock(&unlock);
+
+    D3DDDICB_DEALLOCATE deallocate;
+    memset(&deallocate, 0, sizeof(deallocate));
+
+    deallocate.NumAllocations = 1;
+    deallocate.HandleList = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Deallocate(&deallocate);
+
+    pBuffer->Teardown();
+    delete pBuffer;
+
+    pChunk->m_pBuffer = NULL;
+    pChunk->m_pData = NULL;
+}
+
+void RosUmdDevicePerfCounters::MapReports(RosUmdPerfCounterReports * pReports)
+{
+    pReports->m_pBuffer = new RosUmdResource();
+    if (NULL == pReports->m_pBuffer)
     {
+        throw RosUmdException(E_OUTOFMEMORY);
+    }
+
+    m_pDevice->CreateInternalBuffer(pReports->m_pBuffer, kMaxReports * sizeof(VC4PerfCounterReport));
+
+    //
+    // The KMD writes the reports through its own mapping of video memory,
+    // they stay locked for the life of the device
+    //
+
+    D3DDDICB_LOCK lock;
+    memset(&lock, 0, sizeof(lock));
+
+    lock.hAllocation = pReports->m_pBuffer->m_hKMAllocation;
+
+    m_pDevice->Lock(&lock);
+
+    pReports->m_pReports = (VC4PerfCounterReport *)lock.pData;
+
+    memset(pReports->m_pReports, 0, kMaxReports * sizeof(VC4PerfCounterReport));
+}
+
+void RosUmdDevicePerfCounters::UnmapReports(RosUmdPerfCounterReports * pReports)
+{
+    RosUmdResource *    pBuffer = pReports->m_pBuffer;
+
+    D3DDDICB_UNLOCK unlock;
+    memset(&unlock, 0, sizeof(unlock));
+
+    unlock.NumAllocations = 1;
+    unlock.phAllocations = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Unlock(&unlock);
+
+    D3DDDICB_DEALLOCATE deallocate;
+    memset(&deallocate, 0, sizeof(deallocate));
+
+    deallocate.NumAllocations = 1;
+    deallocate.HandleList = &pBuffer->m_hKMAllocation;
+
+    m_pDevice->Deallocate(&deallocate);
+
+    pBuffer->Teardown();
+    delete pBuffer;
+
+    pReports->m_pBuffer = NULL;
+    pReports->m_pReports = NULL;
+}
+
+void RosUmdDevice::CreateQuery(const D3D10DDIARG_CREATEQUERY* pCreateQuery, D3D10DDI_HQUERY hQuery, D3D10DDI_HRTQUERY hRTQuery)
+{
+    if (!RosUmdQuery::IsSupported(pCreateQuery->Query))
+    {
+        throw RosUmdException(E_NOTIMPL);
+    }
+
+    RosUmdQuery *   pQuery = new (hQuery.pDrvPrivate) RosUmdQuery(pCreateQuery, hRTQuery);
+
+    if (pQuery->IsPerfCounter())
+    {
+        pQuery->m_numCounters = 1;
+        m_perfCounters.InitQuery(RosUmdQuery::GetPerfCounterSource(pQuery->m_query), &pQuery->m_counters[0]);
+    }
+    else if (pQuery->IsOcclusion())
+    {
+        pQuery->m_numCounters = 1;
+        m_perfCounters.InitQuery(V3D_PCTRS_TLB_QUADS_Z_STENCIL_PASS, &pQuery->m_counters[0]);
+    }
+    else if (pQuery->m_query == D3D10DDI_QUERY_PIPELINESTATS)
+    {
+        pQuery->m_numCounters = 2;
+        m_perfCounters.InitQuery(V3D_PCTRS_PTB_PRIMS_VIEWPORT_DISCARDED, &pQuery->m_counters[0]);
+        m_perfCounters.InitQuery(V3D_PCTRS_FEP_VALID_QUADS, &pQuery->m_counters[1]);
+    }
+    else if (pQuery->IsTimestamp())
+    {
+        pQuery->m_numCounters = 1;
+        m_perfCounters.InitTimestampQuery(&pQuery->m_counters[0]);
+    }
+}
+
+void RosUmdDevice::DestroyQuery(RosUmdQuery * pQuery)
+{
+    m_predication.Release(&pQuery->m_counters[0]);
+
+    for (UINT i = 0; i < pQuery->m_numCounters; i++)
+    {
+        m_perfCounters.DestroyQuery(&pQuery->m_counters[i]);
+    }
+
+    pQuery->~RosUmdQuery();
+}
+
+void RosUmdDevice::QueryBegin(RosUmdQuery * pQuery)
+{
+    //
+    // Timestamp and event queries are only ended, a disjoint query's
+    // timestamps are never disjoint
+    //
+
+    if (pQuery->IsTimestamp() || (pQuery->m_query == D3D10DDI_QUERY_TIMESTAMPDISJOINT))
+    {
+        return;
+    }
+
+    pQuery->m_vertices = m_drawnVertices;
+    pQuery->m_primitives = m_drawnPrimitives;
+
+    //
+    // Counters are sampled per DMA buffer, submit the work recorded so far
+    // so the query doesn't count it
+    //
+
+    if (!m_commandBuffer.IsCommandBufferEmpty())
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    for (UINT i = 0; i < pQuery->m_numCounters; i++)
+    {
+        if (!m_perfCounters.Begin(&pQuery->m_counters[i]))
+        {
+            ROS_LOG_TRACE(
+                "No performance counter left for the query. (query = %u, source = %u)",
+                pQuery->m_query,
+                pQuery->m_counters[i].m_source);
+        }
+    }
+}
+
+void RosUmdDevice::QueryEnd(RosUmdQuery * pQuery)
+{
+    if (pQuery->m_query == D3D10DDI_QUERY_TIMESTAMPDISJOINT)
+    {
+        return;
+    }
+
+    if (pQuery->IsTimestamp())
+    {
+        if (!m_perfCounters.Timestamp(&pQuery->m_counters[0]))
+        {
+            ROS_LOG_TRACE("No report left for the timestamp, it reports 0. (query = %u)", pQuery->m_query);
+            return;
+        }
+
+        m_commandBuffer.WriteTimestamp(
+            m_perfCounters.GetReportBuffer(),
+            m_perfCounters.GetReportOffset(pQuery->m_counters[0]));
+
         //
-        // TODO: Implement remaining query values other than null
+        // The timestamp is taken when the DMA buffer runs, submit it now
         //
 
-        assert(false);
+        m_commandBuffer.Flush(0);
+        return;
     }
 
+    pQuery->m_vertices = m_drawnVertices - pQuery->m_vertices;
+    pQuery->m_primitives = m_drawnPrimitives - pQuery->m_primitives;
+
+    if (!m_commandBuffer.IsCommandBufferEmpty())
+    {
+        m_commandBuffer.Flush(0);
+    }
+
+    for (UINT i = 0; i < pQuery->m_numCounters; i++)
+    {
+        m_perfCounters.End(&pQuery->m_counters[i]);
+    }
+}
+
+template<typename DataType>
+static void
+WriteQueryData(
+    const DataType &    data,
+    void *              pData,
+    UINT                dataSize)
+{
+    if (dataSize < sizeof(data))
+    {
+        throw RosUmdException(E_INVALIDARG);
+    }
+
+    memcpy(pData, &data, sizeof(data));
+}
+
+void RosUmdDevice::QueryGetData(RosUmdQuery * pQuery, void* pData, UINT dataSize, UINT flags)
+{
     //
-    // per MDSN Predication should set an error in the case one was seen
-    // D3D will interpret an error as critical
+    // QueryEnd submitted every DMA buffer the query waits for
     //
-    /*
-    HRESULT hr = S_OK;
 
-    if (FAILED(hr))
+    flags; // unused
+
+    ULONGLONG   values[RosUmdQuery::kMaxCounters];
+
+    for (UINT i = 0; i < pQuery->m_numCounters; i++)
+    {
+        if (!m_perfCounters.GetData(pQuery->m_counters[i], &values[i]))
+        {
+            SetError(DXGI_DDI_ERR_WASSTILLDRAWING);
+            return;
+        }
+    }
+
+    if (NULL == pData)
+    {
+        return;
+    }
+
+    //
+    // An occlusion query that got no counter reports everything it drew as
+    // visible
+    //
+
+    bool    bCounted = (pQuery->m_counters[0].m_report != RosUmdPerfCounters::kInvalidReport);
+
+    switch (pQuery->m_query)
+    {
+    case D3D10DDI_QUERY_EVENT:
+    {
+        BOOL    bDone = TRUE;
+
+        WriteQueryData(bDone, pData, dataSize);
+    }
+    break;
+    case D3D10DDI_QUERY_OCCLUSION:
+    {
+        //
+        // Each quad is 2x2 pixels, the count is an upper bound of the
+        // samples that passed. Uncounted, each primitive drawn passes a
+        // sample.
+        //
+
+        UINT64  passedSamples = bCounted ? values[0] * 4 : pQuery->m_primitives;
+
+        WriteQueryData(passedSamples, pData, dataSize);
+    }
+    break;
+    case D3D10DDI_QUERY_OCCLUSIONPREDICATE:
+    {
+        BOOL    bVisible = !bCounted || (values[0] != 0);
+
+        WriteQueryData(bVisible, pData, dataSize);
+    }
+    break;
+    case D3D10DDI_QUERY_TIMESTAMP:
+    {
+        UINT64  timestamp = values[0];
+
+        WriteQueryData(timestamp, pData, dataSize);
+    }
+    break;
+    case D3D10DDI_QUERY_TIMESTAMPDISJOINT:
+    {
+        //
+        // The KMD takes the timestamps with the performance counter
+        //
+
+        LARGE_INTEGER   frequency;
+
+        QueryPerformanceFrequency(&frequency);
+
+        D3D10_DDI_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+
+        disjoint.Frequency = frequency.QuadPart;
+        disjoint.Disjoint = FALSE;
+
+        WriteQueryData(disjoint, pData, dataSize);
+    }
+    break;
+    case D3D10DDI_QUERY_PIPELINESTATS:
+    {
+        //
+        // Vertex and primitive counts are from the draws, the clipper's
+        // output is what the PTB didn't discard by the viewport and the
+        // pixel shader invocations are bound by the valid quads
+        //
+
+        ULONGLONG   discardedPrimitives = values[0];
+        ULONGLONG   validQuads = values[1];
+
+        D3D11_DDI_QUERY_DATA_PIPELINE_STATISTICS    statistics;
+
+        memset(&statistics, 0, sizeof(statistics));
+
+        statistics.IAVertices = pQuery->m_vertices;
+        statistics.IAPrimitives = pQuery->m_primitives;
+        statistics.VSInvocations = pQuery->m_vertices;
+        statistics.CInvocations = pQuery->m_primitives;
+        statistics.CPrimitives = (pQuery->m_primitives > discardedPrimitives) ? pQuery->m_primitives - discardedPrimitives : 0;
+        statistics.PSInvocations = validQuads * 4;
+
+        if (dataSize < sizeof(statistics))
+        {
+            //
+            // D3D10 statistics are the leading fields of D3D11's
+            //
+
+            WriteQueryData(*(D3D10_DDI_QUERY_DATA_PIPELINE_STATISTICS *)&statistics, pData, dataSize);
+        }
+        else
+        {
+            WriteQueryData(statistics, pData, dataSize);
+        }
+    }
+    break;
+    default:
     {
-    SetError(hr);
+        assert(pQuery->IsPerfCounter());
+
+        WriteQueryData(values[0], pData, dataSize);
+    }
+    break;
     }
-    */
+}
+
+#if VC4
+
+void RosUmdDevice::WritePerfCounterSelect()
+{
+    if (0 == m_perfCounters.GetActiveCount())
+    {
+        return;
+    }
+
+    VC4PerfCounterSelect    select;
+    UINT                    reportOffsets[V3D_NUM_PERF_COUNTERS];
+
+    m_perfCounters.Sample(&select, reportOffsets);
+
+    m_commandBuffer.SetPerfCounterSelect(select, m_perfCounters.GetReportBuffer(), reportOffsets);
+}
+
+#endif
+
+void RosUmdDevice::SetPredication(D3D10DDI_HQUERY hQuery, BOOL bPredicateValue)
+{
+    //
+    // https://msdn.microsoft.com/en-us/library/windows/hardware/ff569547(v=vs.85).aspx
+    // per doc, hQuery can contain nullptr - supposed to save the predicate value for future use
+    //
+
+    RosUmdQuery *   pQuery = RosUmdQuery::CastFrom(hQuery);
+
+    if (NULL == pQuery)
+    {
+        m_predication.Set(NULL, bPredicateValue != FALSE, false);
+        return;
+    }
+
+    // Occlusion predicates are the only predicates that can be created
+    assert(pQuery->m_query == D3D10DDI_QUERY_OCCLUSIONPREDICATE);
+
+    m_predication.Set(&pQuery->m_counters[0], bPredicateValue != FALSE, pQuery->IsPredicateHint());
+}
+
+bool RosUmdDevice::IsPredicatedOut()
+{
+    RosUmdPredicateResult   result = m_predication.Evaluate(m_perfCounters);
+
+    //
+    // QueryEnd submitted the DMA buffers the predicate counts, they
+    // complete without more work from the device unless the GPU is reset
+    //
+
+    ULONGLONG   deadline = GetTickCount64() + kPredicateTimeoutMs;
+
+    while (result == ROS_PREDICATE_PENDING)
+    {
+        if (GetTickCount64() >= deadline)
+        {
+            ROS_LOG_WARNING(
+                "The predicate result didn't come, rendering without predication. (timeout = %u ms)",
+                kPredicateTimeoutMs);
+
+            m_predication.Set(NULL, false, false);
+            return false;
+        }
+
+        Sleep(0);
+
+        result = m_predication.Evaluate(m_perfCounters);
+    }
+
+    return (result == ROS_PREDICATE_SKIP);
 }
 
 void RosUmdDevice::ResourceCopyRegion11_1(
@@ -2408,6 +4008,8 @@ void RosUmdDevice::ResourceCopyRegion11_1(
     assert(nullptr != pDestinationResource);
     assert(nullptr != pSourceResource);
 
+    pDestinationResource->MarkContentChanged();
+
     //
     // https://msdn.microsoft.com/en-us/library/windows/hardware/hh439845(v=vs.85).aspx
     //
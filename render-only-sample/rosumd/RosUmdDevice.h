@@ -13,6 +13,11 @@
 #include "RosUmdDebug.h"
 
 #include "RosUmdResource.h"
+#include "RosUmdIndexRange.h"
+#include "RosUmdConstantRing.h"
+#include "RosUmdShaderHeap.h"
+#include "RosUmdPerfCounters.h"
+#include "RosUmdPredication.h"
 
 #include "RosUmdShader.h"
 
@@ -25,6 +30,7 @@
 #endif
 
 class RosUmdAdapter;
+class RosUmdDevice;
 class RosUmdRenderTargetView;
 class RosUmdDepthStencilView;
 class RosUmdShader;
@@ -32,6 +38,7 @@ class RosUmdElementLayout;
 
 class RosUmdSampler;
 class RosUmdShaderResourceView;
+class RosUmdQuery;
 
 typedef union _RosUmdDeviceFlags
 {
@@ -49,6 +56,70 @@ typedef union _RosUmdDeviceFlags
     UINT        m_value;
 } RosUmdDeviceFlags;
 
+//
+// Constant buffer ring whose chunks are internal buffers of the device
+//
+
+class RosUmdDeviceConstantRing : public RosUmdConstantRing
+{
+public:
+
+    RosUmdDeviceConstantRing() :
+        m_pDevice(NULL)
+    {
+    }
+
+    RosUmdDevice *  m_pDevice;
+
+protected:
+
+    virtual void MapChunk(RosUmdConstantRingChunk * pChunk, bool bRecycle);
+    virtual void UnmapChunk(RosUmdConstantRingChunk * pChunk);
+};
+
+//
+// Shader code heap whose chunk is an internal buffer of the device
+//
+
+class RosUmdDeviceShaderHeap : public RosUmdShaderHeap
+{
+public:
+
+    RosUmdDeviceShaderHeap() :
+        m_pDevice(NULL)
+    {
+    }
+
+    RosUmdDevice *  m_pDevice;
+
+protected:
+
+    virtual void MapChunk(RosUmdShaderHeapChunk * pChunk);
+    virtual void UnmapChunk(RosUmdShaderHeapChunk * pChunk);
+};
+
+//
+// Performance counter queries whose reports are in an internal buffer of
+// the device
+//
+
+class RosUmdDevicePerfCounters : public RosUmdPerfCounters
+{
+public:
+
+    RosUmdDevicePerfCounters() :
+        m_pDevice(NULL)
+    {
+    }
+
+    RosUmdDevice *  m_pDevice;
+
+protected:
+
+    virtual void MapReports(RosUmdPerfCounterReports * pReports);
+    virtual void UnmapReports(RosUmdPerfCounterReports * pReports);
+};
+
 //==================================================================================================================================
 //
 // RosUmdDevice
@@ -73,6 +144,7 @@ public:
     void OpenResource(const D3D10DDIARG_OPENRESOURCE*, D3D10DDI_HRESOURCE, D3D10DDI_HRTRESOURCE);
     void DestroyResource(RosUmdResource * pResource);
     void ResourceCopy(RosUmdResource *pDestinationResource, RosUmdResource * pSourceResource);
+    void ResourceResolveSubresource(RosUmdResource *pDestinationResource, UINT DstSubresource, RosUmdResource * pSourceResource, UINT SrcSubresource, DXGI_FORMAT ResolveFormat);
     void ResourceCopyRegion11_1(RosUmdResource *pDestinationResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ, RosUmdResource * pSourceResource, UINT SrcSubresource, const D3D10_DDI_BOX* pSrcBox, UINT copyFlags);
     void ConstantBufferUpdateSubresourceUP(RosUmdResource *pDestinationResource, UINT DstSubresource, _In_opt_ const D3D10_DDI_BOX *pDstBox, _In_ const VOID *pSysMemUP, UINT RowPitch, UINT DepthPitch, UINT CopyFlags);
 
@@ -89,10 +161,17 @@ public:
 
     void SetPredication(D3D10DDI_HQUERY hQuery, BOOL bPredicateValue);
 
+    void CreateQuery(const D3D10DDIARG_CREATEQUERY* pCreateQuery, D3D10DDI_HQUERY hQuery, D3D10DDI_HRTQUERY hRTQuery);
+    void DestroyQuery(RosUmdQuery * pQuery);
+    void QueryBegin(RosUmdQuery * pQuery);
+    void QueryEnd(RosUmdQuery * pQuery);
+    void QueryGetData(RosUmdQuery * pQuery, void* pData, UINT dataSize, UINT flags);
+
 public:
 
     void CheckFormatSupport(DXGI_FORMAT inFormat, UINT* pOutFormatSupport);
     void CheckCounterInfo(D3D10DDI_COUNTER_INFO* pOutCounterInfo);
+    void CheckCounter(D3D10DDI_QUERY query, D3D10DDI_COUNTER_TYPE* pCounterType, UINT* pActiveCounters, LPSTR pName, UINT* pNameLength, LPSTR pUnits, UINT* pUnitsLength, LPSTR pDescription, UINT* pDescriptionLength);
     void CheckMultisampleQualityLevels(DXGI_FORMAT inFormat, UINT inSampleCount, UINT inFlags, UINT* pOutNumQualityLevels);
 
 public:
@@ -102,6 +181,7 @@ public:
     //
 
     void Allocate(D3DDDICB_ALLOCATE * pAllocate);
+    void Deallocate(D3DDDICB_DEALLOCATE * pDeallocate);
     void Lock(D3DDDICB_LOCK * pLock);
     void Unlock(D3DDDICB_UNLOCK * pLock);
     void Render(D3DDDICB_RENDER * pRender);
@@ -166,6 +246,29 @@ public:
 
     RosUmdResource                  m_dummyBuffer;
 
+    RosUmdDeviceConstantRing        m_constantRing;
+
+    RosUmdDeviceShaderHeap          m_shaderHeap;
+
+    // Copied into the shader heap by the first depth-only draw
+    RosUmdShaderCode                m_depthOnlyShader;
+
+    RosUmdDevicePerfCounters        m_perfCounters;
+
+    RosUmdPredication               m_predication;
+
+    // Longest wait for the result of a predicate, past the GPU timeout
+    // its DMA buffers were lost to a reset
+    static const DWORD kPredicateTimeoutMs = 2000;
+
+    // Vertices and primitives drawn, for pipeline statistics queries
+    ULONGLONG                       m_drawnVertices;
+    ULONGLONG                       m_drawnPrimitives;
+
+    // Constant data copied by the driver, into new slices or uniform streams
+    ULONGLONG                       m_constantBytesCopied;
+    ULONGLONG                       m_uniformDraws;
+
 public:
 
     //
@@ -176,6 +279,7 @@ public:
     void DrawIndexed(UINT indexCount, UINT startIndexLocation, INT baseVertexLocation);
     void ClearRenderTargetView(RosUmdRenderTargetView * pRenderTargetView, FLOAT clearColor[4]);
     void ClearDepthStencilView(RosUmdDepthStencilView * pDepthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil);
+    void Discard(D3D11DDI_HANDLETYPE handleType, VOID * hResourceOrView, const D3D10_DDI_RECT * pRects, UINT numRects);
 
 public:
 
@@ -226,6 +330,8 @@ public:
     DXGI_FORMAT                     m_indexFormat;
     UINT                            m_indexOffset;
 
+    RosUmdIndexRangeCache           m_indexRangeCache;
+
     D3D10_DDI_PRIMITIVE_TOPOLOGY    m_topology;
 
     D3D10_DDI_VIEWPORT              m_viewports[kMaxViewports];
@@ -277,12 +383,20 @@ public:
     BOOL                            m_scissorRectSet;
     D3D10_DDI_RECT                  m_scissorRect;
 
-    BOOL                            m_bPredicateValue;
-
 public:
 
     void CreateInternalBuffer(RosUmdResource * pRes, UINT size);
 
+    //
+    // Moves the constant buffer to a new ring slice, the GPU keeps reading
+    // the old slice for the draws already recorded
+    //
+
+    void RenameConstantBuffer(RosUmdResource * pConstantBuffer, bool bPreserveContents);
+
+    // Called when the CPU writes to the constant buffer's slice
+    void MarkConstantSliceWritten(RosUmdResource * pConstantBuffer);
+
 private:
 
     //
@@ -291,8 +405,35 @@ private:
 
     void RefreshPipelineState(UINT vertexOffset);
 
+    //
+    // The render target of the draws, the depth stencil buffer stands in
+    // for it when depth-only draws have none
+    //
+
+    RosUmdResource * GetDrawTarget();
+
+    //
+    // Whether the draw or clear is skipped by predication, waits for the
+    // result of a predicate that isn't a hint. Renders unconditionally until
+    // the next SetPredication if the result doesn't come.
+    //
+
+    bool IsPredicatedOut();
+
 #if VC4
 
+    RosUmdIndexRangeEntry * GetIndexRange(
+        UINT                indexCount,
+        UINT                startIndexLocation,
+        VC4PrimitiveMode    primitiveMode);
+
+    void WriteShadowIndices(
+        RosUmdIndexRangeEntry * pEntry,
+        const BYTE *            pIndices);
+
+    void DestroyShadowIndexBuffer(
+        RosUmdIndexRangeEntry * pEntry);
+
     void WriteUniforms(
         BOOLEAN                     bPSUniform,
         VC4_UNIFORM_FORMAT *        pUniformEntries,
@@ -301,14 +442,29 @@ private:
         UINT                       &curCommandOffset,
         D3DDDI_PATCHLOCATIONLIST * &pCurPatchLocation);
 
+    RosUmdResource * GetDirectUniformBuffer(
+        BOOLEAN                     bPSUniform,
+        const VC4_UNIFORM_FORMAT *  pUniformEntries,
+        UINT                        numUniformEntries,
+        UINT *                      pByteOffset);
+
     VC4TextureType MapDXGITextureFormatToVC4Type(
         RosHwLayout layout,
         DXGI_FORMAT format);
 
+    // Copies the fragment shader of depth-only draws into the shader heap
+    void UpdateDepthOnlyShader();
+
 #endif
 
 public:
     void WriteEpilog();
+
+#if VC4
+
+    void WritePerfCounterSelect();
+
+#endif
 };
 
 inline RosUmdDevice* RosUmdDevice::CastFrom(D3D10DDI_HDEVICE hDevice)
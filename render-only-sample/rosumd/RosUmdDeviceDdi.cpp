@@ -16,6 +16,7 @@
 #include "RosUmdRenderTargetView.h"
 #include "RosUmdDepthStencilView.h"
 #include "RosUmdShaderResourceView.h"
+#include "RosUmdQuery.h"
 
 #include "RosContext.h"
 
@@ -62,8 +63,8 @@ const D3DWDDM1_3DDI_DEVICEFUNCS RosUmdDeviceDdi::s_deviceFuncsWDDM1_3 =
     RosUmdDeviceDdi::DdiSetBlendState,
     RosUmdDeviceDdi::DdiSetDepthStencilState,
     RosUmdDeviceDdi::DdiSetRasterizerState,
-    RosUmdDeviceDdi::QueryEnd_Default,
-    RosUmdDeviceDdi::QueryBegin_Default,
+    RosUmdDeviceDdi::DdiQueryEnd,
+    RosUmdDeviceDdi::DdiQueryBegin,
     RosUmdDeviceDdi::DdiResourceCopyRegion11_1,
     RosUmdDeviceDdi::ResourceUpdateSubresourceUP11_1_Default,
     RosUmdDeviceDdi::SOSetTargets_Default,
@@ -73,11 +74,11 @@ const D3DWDDM1_3DDI_DEVICEFUNCS RosUmdDeviceDdi::s_deviceFuncsWDDM1_3 =
     RosUmdDeviceDdi::DdiClearRenderTargetView,
     RosUmdDeviceDdi::DdiClearDepthStencilView,
     RosUmdDeviceDdi::DdiSetPredication,
-    RosUmdDeviceDdi::QueryGetData_Default,
+    RosUmdDeviceDdi::DdiQueryGetData,
     RosUmdDeviceDdi::DdiFlush,
     RosUmdDeviceDdi::GenerateMips_Default,
     RosUmdDeviceDdi::DdiResourceCopy,
-    RosUmdDeviceDdi::ResourceResolveSubresource_Default,
+    RosUmdDeviceDdi::DdiResourceResolveSubresource,
 
     RosUmdDeviceDdi::ResourceMap_Default,
     RosUmdDeviceDdi::ResourceUnmap_Default,
@@ -119,14 +120,14 @@ const D3DWDDM1_3DDI_DEVICEFUNCS RosUmdDeviceDdi::s_deviceFuncsWDDM1_3 =
     RosUmdDeviceDdi::DdiCalcPrivateSamplerSize,
     RosUmdDeviceDdi::DdiCreateSampler,
     RosUmdDeviceDdi::DdiDestroySampler,
-    RosUmdDeviceDdi::CalcPrivateQuerySize_Default,
-    RosUmdDeviceDdi::CreateQuery_Default,
-    RosUmdDeviceDdi::DestroyQuery_Default,
+    RosUmdDeviceDdi::DdiCalcPrivateQuerySize,
+    RosUmdDeviceDdi::DdiCreateQuery,
+    RosUmdDeviceDdi::DdiDestroyQuery,
 
     RosUmdDeviceDdi::DdiCheckFormatSupport,
     RosUmdDeviceDdi::DdiCheckMultisampleQualityLevels,
     RosUmdDeviceDdi::DdiCheckCounterInfo,
-    RosUmdDeviceDdi::CheckCounter_Default,
+    RosUmdDeviceDdi::DdiCheckCounter,
     RosUmdDeviceDdi::DdiDestroyDevice,
     RosUmdDeviceDdi::SetTextFilter_Default,
     RosUmdDeviceDdi::DdiResourceCopy,
@@ -179,7 +180,7 @@ const D3DWDDM1_3DDI_DEVICEFUNCS RosUmdDeviceDdi::s_deviceFuncsWDDM1_3 =
     NULL, // RosUmdDeviceDdi::RecycleCreateCommandList_Default,
     NULL, // RosUmdDeviceDdi::RecycleCreateDeferredContext_Default,
     NULL, // RosUmdDeviceDdi::RecycleDestroyCommandList_Default,
-    RosUmdDeviceDdi::Discard_Default,
+    RosUmdDeviceDdi::DdiDiscard,
     RosUmdDeviceDdi::AssignDebugBinary_Default,
     RosUmdDeviceDdi::DynamicConstantBufferMapNoOverwrite_Default,
     RosUmdDeviceDdi::CheckDirectFlipSupport,
@@ -328,6 +329,29 @@ void APIENTRY RosUmdDeviceDdi::DdiResourceCopy(
     }
 }
 
+void APIENTRY RosUmdDeviceDdi::DdiResourceResolveSubresource(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_HRESOURCE hDestinationResource,
+    UINT DstSubresource,
+    D3D10DDI_HRESOURCE hSourceResource,
+    UINT SrcSubresource,
+    DXGI_FORMAT ResolveFormat)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+    RosUmdResource * pDestinationResource = (RosUmdResource *)hDestinationResource.pDrvPrivate;
+    RosUmdResource * pSourceResource = (RosUmdResource *)hSourceResource.pDrvPrivate;
+
+    try
+    {
+        pRosUmdDevice->ResourceResolveSubresource(pDestinationResource, DstSubresource, pSourceResource, SrcSubresource, ResolveFormat);
+    }
+
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
 void APIENTRY RosUmdDeviceDdi::DdiConstantBufferUpdateSubresourceUP11_1(
     D3D10DDI_HDEVICE   hDevice,
     D3D10DDI_HRESOURCE hDstResource,
@@ -431,6 +455,30 @@ void APIENTRY RosUmdDeviceDdi::DdiCheckCounterInfo(
     pRosUmdDevice->CheckCounterInfo(pCounterInfo);
 }
 
+void APIENTRY RosUmdDeviceDdi::DdiCheckCounter(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_QUERY Query,
+    D3D10DDI_COUNTER_TYPE* pCounterType,
+    UINT* pActiveCounters,
+    LPSTR pName,
+    UINT* pNameLength,
+    LPSTR pUnits,
+    UINT* pUnitsLength,
+    LPSTR pDescription,
+    UINT* pDescriptionLength)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+
+    try
+    {
+        pRosUmdDevice->CheckCounter(Query, pCounterType, pActiveCounters, pName, pNameLength, pUnits, pUnitsLength, pDescription, pDescriptionLength);
+    }
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
 void APIENTRY RosUmdDeviceDdi::DdiCheckMultisampleQualityLevels(
     D3D10DDI_HDEVICE hDevice,
     DXGI_FORMAT Format,
@@ -558,6 +606,99 @@ void APIENTRY RosUmdDeviceDdi::DdiSetDepthStencilState(
     pDevice->SetDepthStencilState(pDepthStencilState, StencilRef);
 }
 
+//
+// Query
+//
+
+SIZE_T APIENTRY RosUmdDeviceDdi::DdiCalcPrivateQuerySize(
+    D3D10DDI_HDEVICE,
+    const D3D10DDIARG_CREATEQUERY*)
+{
+    return sizeof(RosUmdQuery);
+}
+
+void APIENTRY RosUmdDeviceDdi::DdiCreateQuery(
+    D3D10DDI_HDEVICE hDevice,
+    const D3D10DDIARG_CREATEQUERY* pCreateQuery,
+    D3D10DDI_HQUERY hQuery,
+    D3D10DDI_HRTQUERY hRTQuery)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+
+    try
+    {
+        pRosUmdDevice->CreateQuery(pCreateQuery, hQuery, hRTQuery);
+    }
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
+void APIENTRY RosUmdDeviceDdi::DdiDestroyQuery(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_HQUERY hQuery)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+    RosUmdQuery* pQuery = RosUmdQuery::CastFrom(hQuery);
+
+    pRosUmdDevice->DestroyQuery(pQuery);
+}
+
+void APIENTRY RosUmdDeviceDdi::DdiQueryBegin(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_HQUERY hQuery)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+    RosUmdQuery* pQuery = RosUmdQuery::CastFrom(hQuery);
+
+    try
+    {
+        pRosUmdDevice->QueryBegin(pQuery);
+    }
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
+void APIENTRY RosUmdDeviceDdi::DdiQueryEnd(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_HQUERY hQuery)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+    RosUmdQuery* pQuery = RosUmdQuery::CastFrom(hQuery);
+
+    try
+    {
+        pRosUmdDevice->QueryEnd(pQuery);
+    }
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
+void APIENTRY RosUmdDeviceDdi::DdiQueryGetData(
+    D3D10DDI_HDEVICE hDevice,
+    D3D10DDI_HQUERY hQuery,
+    void* pData,
+    UINT DataSize,
+    UINT Flags)
+{
+    RosUmdDevice* pRosUmdDevice = RosUmdDevice::CastFrom(hDevice);
+    RosUmdQuery* pQuery = RosUmdQuery::CastFrom(hQuery);
+
+    try
+    {
+        pRosUmdDevice->QueryGetData(pQuery, pData, DataSize, Flags);
+    }
+    catch (std::exception & e)
+    {
+        pRosUmdDevice->SetException(e);
+    }
+}
+
 //
 // Sampler
 //
@@ -1071,6 +1212,18 @@ void APIENTRY RosUmdDeviceDdi::DdiClearDepthStencilView(
     pDevice->ClearDepthStencilView(pDepthStencilView, clearFlags, depthValue, stencilValue);
 }
 
+void APIENTRY RosUmdDeviceDdi::DdiDiscard(
+    D3D10DDI_HDEVICE hDevice,
+    D3D11DDI_HANDLETYPE handleType,
+    VOID * hResourceOrView,
+    const D3D10_DDI_RECT * pRects,
+    UINT numRects)
+{
+    RosUmdDevice * pDevice = RosUmdDevice::CastFrom(hDevice);
+
+    pDevice->Discard(handleType, hResourceOrView, pRects, numRects);
+}
+
 void APIENTRY RosUmdDeviceDdi::DdiSetRenderTargets(
     D3D10DDI_HDEVICE hDevice,
     const D3D10DDI_HRENDERTARGETVIEW* phRenderTargetView,
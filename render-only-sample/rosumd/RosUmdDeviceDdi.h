@@ -66,14 +66,15 @@ public:
     static void APIENTRY ClearUnorderedAccessViewUint_Default(D3D10DDI_HDEVICE, D3D11DDI_HUNORDEREDACCESSVIEW, const UINT[4]) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY ClearUnorderedAccessViewFloat_Default(D3D10DDI_HDEVICE, D3D11DDI_HUNORDEREDACCESSVIEW, const FLOAT[4]) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY DdiClearDepthStencilView(D3D10DDI_HDEVICE, D3D10DDI_HDEPTHSTENCILVIEW, UINT, FLOAT, UINT8);
+    static void APIENTRY DdiDiscard(D3D10DDI_HDEVICE, D3D11DDI_HANDLETYPE, VOID*, const D3D10_DDI_RECT*, UINT);
     static void APIENTRY Flush_Default(D3D10DDI_HDEVICE) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static BOOL APIENTRY DdiFlush(D3D10DDI_HDEVICE, UINT);
     static void APIENTRY GenerateMips_Default(D3D10DDI_HDEVICE, D3D10DDI_HSHADERRESOURCEVIEW) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY SetResourceMinLOD_Default(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, FLOAT) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
 
-    static void APIENTRY QueryBegin_Default(D3D10DDI_HDEVICE, D3D10DDI_HQUERY) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
-    static void APIENTRY QueryEnd_Default(D3D10DDI_HDEVICE, D3D10DDI_HQUERY) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
-    static void APIENTRY QueryGetData_Default(D3D10DDI_HDEVICE, D3D10DDI_HQUERY, void*, UINT, UINT) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
+    static void APIENTRY DdiQueryBegin(D3D10DDI_HDEVICE, D3D10DDI_HQUERY);
+    static void APIENTRY DdiQueryEnd(D3D10DDI_HDEVICE, D3D10DDI_HQUERY);
+    static void APIENTRY DdiQueryGetData(D3D10DDI_HDEVICE, D3D10DDI_HQUERY, void*, UINT, UINT);
 
     static void APIENTRY DdiDynamicIABufferMapNoOverwrite(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, D3D10_DDI_MAP, UINT, D3D10DDI_MAPPED_SUBRESOURCE*);
     static void APIENTRY DdiDynamicIABufferMapDiscard(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, D3D10_DDI_MAP, UINT, D3D10DDI_MAPPED_SUBRESOURCE*);
@@ -93,7 +94,7 @@ public:
     static void APIENTRY DdiResourceCopyRegion(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, UINT, UINT, UINT, D3D10DDI_HRESOURCE, UINT, const D3D10_DDI_BOX*);
     static void APIENTRY DdiResourceCopyRegion11_1(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, UINT, UINT, UINT, D3D10DDI_HRESOURCE, UINT, const D3D10_DDI_BOX*, UINT);
     static void APIENTRY DdiResourceCopy(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, D3D10DDI_HRESOURCE);
-    static void APIENTRY ResourceResolveSubresource_Default(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, D3D10DDI_HRESOURCE, UINT, DXGI_FORMAT) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
+    static void APIENTRY DdiResourceResolveSubresource(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, D3D10DDI_HRESOURCE, UINT, DXGI_FORMAT);
     static void APIENTRY DefaultConstantBufferUpdateSubresourceUP_Default(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, const D3D10_DDI_BOX*, const VOID*, UINT, UINT) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY DdiConstantBufferUpdateSubresourceUP11_1(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, const D3D10_DDI_BOX*, const VOID*, UINT, UINT, UINT);
     static void APIENTRY ResourceUpdateSubresourceUP_Default(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, const D3D10_DDI_BOX*, const VOID*, UINT, UINT) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
@@ -200,9 +201,9 @@ public:
     static void APIENTRY DdiHSSetSamplers(D3D10DDI_HDEVICE, UINT, UINT, const D3D10DDI_HSAMPLER*);
     static void APIENTRY DdiDSSetSamplers(D3D10DDI_HDEVICE, UINT, UINT, const D3D10DDI_HSAMPLER*);
 
-    static SIZE_T APIENTRY CalcPrivateQuerySize_Default(D3D10DDI_HDEVICE, const D3D10DDIARG_CREATEQUERY*) { ::OutputDebugStringA(__FUNCTION__); return 0; }
-    static void APIENTRY CreateQuery_Default(D3D10DDI_HDEVICE, const D3D10DDIARG_CREATEQUERY*, D3D10DDI_HQUERY, D3D10DDI_HRTQUERY) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
-    static void APIENTRY DestroyQuery_Default(D3D10DDI_HDEVICE, D3D10DDI_HQUERY) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
+    static SIZE_T APIENTRY DdiCalcPrivateQuerySize(D3D10DDI_HDEVICE, const D3D10DDIARG_CREATEQUERY*);
+    static void APIENTRY DdiCreateQuery(D3D10DDI_HDEVICE, const D3D10DDIARG_CREATEQUERY*, D3D10DDI_HQUERY, D3D10DDI_HRTQUERY);
+    static void APIENTRY DdiDestroyQuery(D3D10DDI_HDEVICE, D3D10DDI_HQUERY);
     static SIZE_T APIENTRY CalcPrivateCommandListSize_Default(D3D10DDI_HDEVICE, CONST D3D11DDIARG_CREATECOMMANDLIST*) { ::OutputDebugStringA(__FUNCTION__); return 0; }
     static void APIENTRY CreateCommandList_Default(D3D10DDI_HDEVICE, CONST D3D11DDIARG_CREATECOMMANDLIST*, D3D11DDI_HCOMMANDLIST, D3D11DDI_HRTCOMMANDLIST) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY DestroyCommandList_Default(D3D10DDI_HDEVICE, D3D11DDI_HCOMMANDLIST) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
@@ -211,7 +212,7 @@ public:
     static void APIENTRY DdiCheckMultisampleQualityLevels(D3D10DDI_HDEVICE, DXGI_FORMAT, UINT, UINT, UINT*);
     static void APIENTRY CheckMultisampleQualityLevelsWDDM1_3_Default(D3D10DDI_HDEVICE, DXGI_FORMAT, UINT, UINT, UINT*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY DdiCheckCounterInfo(D3D10DDI_HDEVICE, D3D10DDI_COUNTER_INFO*);
-    static void APIENTRY CheckCounter_Default(D3D10DDI_HDEVICE, D3D10DDI_QUERY, D3D10DDI_COUNTER_TYPE*, UINT*, LPSTR, UINT*, LPSTR, UINT*, LPSTR, UINT*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
+    static void APIENTRY DdiCheckCounter(D3D10DDI_HDEVICE, D3D10DDI_QUERY, D3D10DDI_COUNTER_TYPE*, UINT*, LPSTR, UINT*, LPSTR, UINT*, LPSTR, UINT*);
     static void APIENTRY CheckDeferredContextHandleSizes_Default(D3D10DDI_HDEVICE, UINT*, D3D11DDI_HANDLESIZE*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static SIZE_T APIENTRY CalcDeferredContextHandleSize_Default(D3D10DDI_HDEVICE, D3D11DDI_HANDLETYPE, VOID*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak();  return 0; }
 
@@ -260,8 +261,6 @@ public:
     static void APIENTRY DsSetShaderWithInterfaces_Default(D3D10DDI_HDEVICE, D3D10DDI_HSHADER, UINT, const UINT*, const D3D11DDIARG_POINTERDATA*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY CsSetShaderWithInterfaces_Default(D3D10DDI_HDEVICE, D3D10DDI_HSHADER, UINT, const UINT*, const D3D11DDIARG_POINTERDATA*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
 
-    static void APIENTRY Discard_Default(D3D10DDI_HDEVICE, D3D11DDI_HANDLETYPE, VOID*, const D3D10_DDI_RECT*, UINT) { RosUmdLogging::Call(__FUNCTION__); /*__debugbreak();*/ }
-
     static void APIENTRY AssignDebugBinary_Default(D3D10DDI_HDEVICE, D3D10DDI_HSHADER, UINT, CONST VOID*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY DynamicConstantBufferMapNoOverwrite_Default(D3D10DDI_HDEVICE, D3D10DDI_HRESOURCE, UINT, D3D10_DDI_MAP, UINT, D3D10DDI_MAPPED_SUBRESOURCE*) { RosUmdLogging::Call(__FUNCTION__); __debugbreak(); }
     static void APIENTRY CheckDirectFlipSupport (
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "Vc4Hw.h"
+
+class RosUmdDevice;
+
 class RosUmdElementLayout
 {
 friend RosUmdDevice;
@@ -25,6 +29,52 @@ public:
     static RosUmdElementLayout* CastFrom(D3D10DDI_HELEMENTLAYOUT);
     D3D10DDI_HELEMENTLAYOUT CastTo() const;
 
+    //
+    // Lays out the attributes in VPM for both shaders, the coordinate shader
+    // only gets the attributes in csInputMask so binning doesn't fetch vertex
+    // data it doesn't need. Memory stride and base address are left to the caller.
+    //
+
+    static void WriteVpmLayout(
+        UINT                        numElements,
+        const BYTE *                pElementBytes,
+        UINT                        csInputMask,
+        VC4GLShaderStateRecord *    pVC4GLShaderStateRecord,
+        VC4VertexAttribute *        pVC4VertexAttributes)
+    {
+        BYTE    vsSelectBits = 0;
+        BYTE    vsVpmOffset = 0;
+        BYTE    csSelectBits = 0;
+        BYTE    csVpmOffset = 0;
+
+        for (UINT i = 0; i < numElements; i++)
+        {
+            pVC4VertexAttributes[i].NumberOfBytesMinusOne = pElementBytes[i] - 1;
+            pVC4VertexAttributes[i].VertexShaderVPMOffset = vsVpmOffset;
+
+            vsSelectBits |= (1 << i);
+            vsVpmOffset += pElementBytes[i];
+
+            if (csInputMask & (1 << i))
+            {
+                pVC4VertexAttributes[i].CoordinateShaderVPMOffset = csVpmOffset;
+
+                csSelectBits |= (1 << i);
+                csVpmOffset += pElementBytes[i];
+            }
+            else
+            {
+                pVC4VertexAttributes[i].CoordinateShaderVPMOffset = 0;
+            }
+        }
+
+        pVC4GLShaderStateRecord->VertexShaderAttributeArraySelectBits = vsSelectBits;
+        pVC4GLShaderStateRecord->VertexShaderTotalAttributesSize = vsVpmOffset;
+
+        pVC4GLShaderStateRecord->CoordinateShaderAttributeArraySelectBits = csSelectBits;
+        pVC4GLShaderStateRecord->CoordinateShaderTotalAttributesSize = csVpmOffset;
+    }
+
 private:
 
     UINT                                m_numElements;
@@ -0,0 +1,321 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Index buffer range scanning and batching implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdIndexRange.h"
+
+//
+// RosUmdIndexRange
+//
+
+void
+RosUmdIndexRange::Scan(
+    const void *    pIndices,
+    UINT            indexSize,
+    UINT            indexCount,
+    UINT *          pMinIndex,
+    UINT *          pMaxIndex)
+{
+    UINT    minIndex = 0xFFFFFFFF;
+    UINT    maxIndex = 0;
+
+    if (indexSize == 2)
+    {
+        const USHORT *  pIndex = (const USHORT *)pIndices;
+
+        for (UINT i = 0; i < indexCount; i++)
+        {
+            minIndex = min(minIndex, (UINT)pIndex[i]);
+            maxIndex = max(maxIndex, (UINT)pIndex[i]);
+        }
+    }
+    else
+    {
+        assert(indexSize == 4);
+
+        const UINT *    pIndex = (const UINT *)pIndices;
+
+        for (UINT i = 0; i < indexCount; i++)
+        {
+            minIndex = min(minIndex, pIndex[i]);
+            maxIndex = max(maxIndex, pIndex[i]);
+        }
+    }
+
+    *pMinIndex = minIndex;
+    *pMaxIndex = maxIndex;
+}
+
+UINT
+RosUmdIndexRange::Split(
+    const void *        pIndices,
+    UINT                indexSize,
+    UINT                indexCount,
+    VC4PrimitiveMode    primitiveMode,
+    RosUmdIndexBatch *  pBatches,
+    UINT                maxBatches,
+    UINT *              pNumDropped)
+{
+    UINT    primitiveSize;  // Indices of the first primitive
+    UINT    stepSize;       // Indices added by each following primitive
+    UINT    overlap;        // Indices a restarted batch shares with the previous one
+
+    switch (primitiveMode)
+    {
+    case VC4_POINTS:
+        primitiveSize = 1;
+        stepSize = 1;
+        overlap = 0;
+        break;
+    case VC4_LINES:
+        primitiveSize = 2;
+        stepSize = 2;
+        overlap = 0;
+        break;
+    case VC4_LINE_STRIP:
+        primitiveSize = 2;
+        stepSize = 1;
+        overlap = 1;
+        break;
+    case VC4_TRIANGLE_STRIP:
+        primitiveSize = 3;
+        stepSize = 1;
+        overlap = 2;
+        break;
+    default:
+        assert(primitiveMode == VC4_TRIANGLES);
+        primitiveSize = 3;
+        stepSize = 3;
+        overlap = 0;
+        break;
+    }
+
+    UINT    numBatches = 0;
+    UINT    numDropped = 0;
+    UINT    start = 0;
+
+    while (start + primitiveSize <= indexCount)
+    {
+        UINT    minIndex;
+        UINT    maxIndex;
+
+        Scan(((const BYTE *)pIndices) + start*indexSize, indexSize, primitiveSize, &minIndex, &maxIndex);
+
+        if (maxIndex - minIndex > kMaxBatchIndex)
+        {
+            numDropped++;
+
+            start += stepSize;
+            continue;
+        }
+
+        UINT    end = start + primitiveSize;
+
+        while (end + stepSize <= indexCount)
+        {
+            UINT    stepMinIndex;
+            UINT    stepMaxIndex;
+
+            Scan(((const BYTE *)pIndices) + end*indexSize, indexSize, stepSize, &stepMinIndex, &stepMaxIndex);
+
+            stepMinIndex = min(stepMinIndex, minIndex);
+            stepMaxIndex = max(stepMaxIndex, maxIndex);
+
+            if (stepMaxIndex - stepMinIndex > kMaxBatchIndex)
+            {
+                break;
+            }
+
+            minIndex = stepMinIndex;
+            maxIndex = stepMaxIndex;
+            end += stepSize;
+        }
+
+        if (numBatches < maxBatches)
+        {
+            RosUmdIndexBatch *  pBatch = &pBatches[numBatches];
+
+            pBatch->m_firstIndex = start;
+            pBatch->m_indexCount = end - start;
+            pBatch->m_minIndex = minIndex;
+            pBatch->m_maxIndex = maxIndex;
+
+            //
+            // Odd triangles of a strip have reversed winding, a batch that
+            // restarts the strip on an odd triangle begins with a degenerate
+            // triangle to keep the parity
+            //
+
+            pBatch->m_leadingPad = ((primitiveMode == VC4_TRIANGLE_STRIP) && (start & 1)) ? 1 : 0;
+        }
+
+        numBatches++;
+
+        if (end + stepSize > indexCount)
+        {
+            break;
+        }
+
+        start = end - overlap;
+    }
+
+    if (pNumDropped)
+    {
+        *pNumDropped = numDropped;
+    }
+
+    return numBatches;
+}
+
+void
+RosUmdIndexRange::WriteBatchIndices(
+    const void *                pIndices,
+    UINT                        indexSize,
+    const RosUmdIndexBatch &    batch,
+    USHORT *                    pDst)
+{
+    for (UINT i = 0; i < batch.m_leadingPad; i++)
+    {
+        *pDst++ = (USHORT)(ReadIndex(pIndices, indexSize, batch.m_firstIndex) - batch.m_minIndex);
+    }
+
+    for (UINT i = 0; i < batch.m_indexCount; i++)
+    {
+        *pDst++ = (USHORT)(ReadIndex(pIndices, indexSize, batch.m_firstIndex + i) - batch.m_minIndex);
+    }
+}
+
+void
+RosUmdIndexRange::WriteIndexedPrimitiveList(
+    VC4IndexedPrimitiveList *   pVC4IndexedPrimitiveList,
+    VC4PrimitiveMode            primitiveMode,
+    UINT                        indexCount,
+    UINT                        maximumIndex)
+{
+    assert(maximumIndex <= kMaxBatchIndex);
+
+    *pVC4IndexedPrimitiveList = vc4IndexedPrimitiveList;
+
+    pVC4IndexedPrimitiveList->PrimitiveMode = primitiveMode;
+    pVC4IndexedPrimitiveList->IndexType = 1;    // 16 bit index
+    pVC4IndexedPrimitiveList->Length = indexCount;
+    pVC4IndexedPrimitiveList->MaximumIndex = maximumIndex;
+}
+
+//
+// RosUmdIndexRangeCache
+//
+
+RosUmdIndexRangeCache::RosUmdIndexRangeCache()
+{
+    memset(m_entries, 0, sizeof(m_entries));
+
+    m_nextVictim = 0;
+
+    m_hitCount = 0;
+    m_missCount = 0;
+}
+
+RosUmdIndexRangeCache::~RosUmdIndexRangeCache()
+{
+    for (UINT i = 0; i < kMaxEntries; i++)
+    {
+        delete[] m_entries[i].m_pBatches;
+    }
+}
+
+static bool
+IsSameRange(
+    const RosUmdIndexRangeKey & key1,
+    const RosUmdIndexRangeKey & key2)
+{
+    return (key1.m_pIndexBuffer == key2.m_pIndexBuffer) &&
+           (key1.m_byteOffset == key2.m_byteOffset) &&
+           (key1.m_indexCount == key2.m_indexCount) &&
+           (key1.m_indexSize == key2.m_indexSize) &&
+           (key1.m_primitiveMode == key2.m_primitiveMode);
+}
+
+RosUmdIndexRangeEntry *
+RosUmdIndexRangeCache::Find(
+    const RosUmdIndexRangeKey & key)
+{
+    for (UINT i = 0; i < kMaxEntries; i++)
+    {
+        RosUmdIndexRangeEntry * pEntry = &m_entries[i];
+
+        if (pEntry->m_bValid &&
+            IsSameRange(pEntry->m_key, key) &&
+            (pEntry->m_key.m_contentVersion == key.m_contentVersion))
+        {
+            m_hitCount++;
+
+            return pEntry;
+        }
+    }
+
+    m_missCount++;
+
+    return NULL;
+}
+
+RosUmdIndexRangeEntry *
+RosUmdIndexRangeCache::Insert(
+    const RosUmdIndexRangeKey & key)
+{
+    RosUmdIndexRangeEntry * pEntry = NULL;
+
+    //
+    // Rescan of a range whose index buffer has been updated replaces the
+    // stale entry, so dynamic index buffers don't flush the whole cache
+    //
+
+    for (UINT i = 0; i < kMaxEntries; i++)
+    {
+        if (m_entries[i].m_bValid && IsSameRange(m_entries[i].m_key, key))
+        {
+            pEntry = &m_entries[i];
+            break;
+        }
+    }
+
+    if (NULL == pEntry)
+    {
+        pEntry = &m_entries[m_nextVictim];
+
+        m_nextVictim = (m_nextVictim + 1) % kMaxEntries;
+    }
+
+    pEntry->m_key = key;
+    pEntry->m_bValid = true;
+    pEntry->m_numBatches = 0;
+
+    return pEntry;
+}
+
+void
+RosUmdIndexRangeCache::ReserveBatches(
+    RosUmdIndexRangeEntry * pEntry,
+    UINT                    numBatches)
+{
+    if (pEntry->m_maxBatches < numBatches)
+    {
+        delete[] pEntry->m_pBatches;
+        pEntry->m_maxBatches = 0;
+
+        pEntry->m_pBatches = new RosUmdIndexBatch[numBatches];
+
+        if (NULL == pEntry->m_pBatches)
+        {
+            pEntry->m_bValid = false;
+            throw RosUmdException(E_OUTOFMEMORY);
+        }
+
+        pEntry->m_maxBatches = numBatches;
+    }
+}
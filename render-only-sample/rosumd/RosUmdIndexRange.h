@@ -0,0 +1,166 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Index buffer range scanning and batching
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "Vc4Hw.h"
+#include "RosUmdDebug.h"
+
+class RosUmdResource;
+
+//
+// VC4's Indexed Primitive List only takes 8 or 16 bit indices and uses
+// MaximumIndex to bound the vertex fetch. 32 bit index ranges are split
+// into batches whose indices fit in 16 bits once rebased to the batch's
+// minimal index, the rebase is applied through the vertex attribute
+// base address.
+//
+
+typedef struct _RosUmdIndexBatch
+{
+    UINT    m_firstIndex;       // First index of the batch within the drawn range
+    UINT    m_indexCount;
+    UINT    m_minIndex;
+    UINT    m_maxIndex;
+    UINT    m_leadingPad;       // Duplicated first indices, keeps winding of restarted triangle strips
+} RosUmdIndexBatch;
+
+class RosUmdIndexRange
+{
+public:
+
+    static const UINT kMaxBatchIndex = 0xFFFF;
+
+    static void
+    Scan(
+        const void *    pIndices,
+        UINT            indexSize,
+        UINT            indexCount,
+        UINT *          pMinIndex,
+        UINT *          pMaxIndex);
+
+    //
+    // Splits the range into batches on primitive boundaries, strips are
+    // restarted with the overlapping vertices of the previous batch.
+    // Returns the number of batches needed, only up to maxBatches are written.
+    // A primitive spanning more than 64K vertices can't be drawn with 16 bit
+    // indices, it is dropped and counted in pNumDropped, which may be NULL.
+    //
+
+    static UINT
+    Split(
+        const void *        pIndices,
+        UINT                indexSize,
+        UINT                indexCount,
+        VC4PrimitiveMode    primitiveMode,
+        RosUmdIndexBatch *  pBatches,
+        UINT                maxBatches,
+        UINT *              pNumDropped);
+
+    //
+    // Writes m_leadingPad + m_indexCount indices rebased to m_minIndex
+    //
+
+    static void
+    WriteBatchIndices(
+        const void *                pIndices,
+        UINT                        indexSize,
+        const RosUmdIndexBatch &    batch,
+        USHORT *                    pDst);
+
+    //
+    // Fills in everything but AddressOfIndicesList, which is patched
+    //
+
+    static void
+    WriteIndexedPrimitiveList(
+        VC4IndexedPrimitiveList *   pVC4IndexedPrimitiveList,
+        VC4PrimitiveMode            primitiveMode,
+        UINT                        indexCount,
+        UINT                        maximumIndex);
+
+private:
+
+    static UINT
+    ReadIndex(
+        const void *    pIndices,
+        UINT            indexSize,
+        UINT            i)
+    {
+        return (indexSize == 2) ? ((const USHORT *)pIndices)[i] : ((const UINT *)pIndices)[i];
+    }
+};
+
+//
+// Cache of recently scanned index buffer ranges. An entry is only valid
+// while the index buffer contents are unchanged, i.e. while the resource's
+// content version is the one recorded at scan time.
+//
+
+typedef struct _RosUmdIndexRangeKey
+{
+    const RosUmdResource *  m_pIndexBuffer;
+    ULONGLONG               m_contentVersion;
+    UINT                    m_byteOffset;
+    UINT                    m_indexCount;
+    UINT                    m_indexSize;
+    VC4PrimitiveMode        m_primitiveMode;
+} RosUmdIndexRangeKey;
+
+typedef struct _RosUmdIndexRangeEntry
+{
+    RosUmdIndexRangeKey     m_key;
+    bool                    m_bValid;
+
+    RosUmdIndexBatch *      m_pBatches;
+    UINT                    m_numBatches;
+    UINT                    m_maxBatches;
+
+    // 16 bit rebased copy of the batches for 32 bit index ranges
+    RosUmdResource *        m_pShadowBuffer;
+    UINT                    m_shadowBufferSize;
+} RosUmdIndexRangeEntry;
+
+class RosUmdIndexRangeCache
+{
+public:
+
+    static const UINT kMaxEntries = 16;
+
+    RosUmdIndexRangeCache();
+    ~RosUmdIndexRangeCache();
+
+    RosUmdIndexRangeEntry * Find(const RosUmdIndexRangeKey & key);
+
+    // Returns the entry to be filled for the key, evicting the oldest one
+    RosUmdIndexRangeEntry * Insert(const RosUmdIndexRangeKey & key);
+
+    void ReserveBatches(RosUmdIndexRangeEntry * pEntry, UINT numBatches);
+
+    RosUmdIndexRangeEntry * GetEntry(UINT i)
+    {
+        return &m_entries[i];
+    }
+
+    UINT GetHitCount() const
+    {
+        return m_hitCount;
+    }
+
+    UINT GetMissCount() const
+    {
+        return m_missCount;
+    }
+
+private:
+
+    RosUmdIndexRangeEntry   m_entries[kMaxEntries];
+    UINT                    m_nextVictim;
+
+    UINT                    m_hitCount;
+    UINT                    m_missCount;
+};
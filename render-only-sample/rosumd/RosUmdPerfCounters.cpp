@@ -0,0 +1,313 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Performance counter query implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdPerfCounters.h"
+
+const RosUmdPerfCounterDesc RosUmdPerfCounters::s_descs[V3D_NUM_PERF_COUNTER_SOURCES] =
+{
+    { "FEP valid primitives with no pixels",    "primitives",   "Valid primitives that result in no rendered pixels, for all rendered tiles" },
+    { "FEP valid primitives",                   "primitives",   "Valid primitives for all rendered tiles, a primitive is counted in every tile it covers" },
+    { "FEP early-Z/near/far clipped quads",     "quads",        "Quads discarded by early-Z or clipped by the near or far planes" },
+    { "FEP valid quads",                        "quads",        "Valid quads" },
+    { "TLB quads failing stencil",              "quads",        "Quads with no pixels passing the stencil test" },
+    { "TLB quads failing Z and stencil",        "quads",        "Quads with no pixels passing the Z and stencil tests" },
+    { "TLB quads passing Z and stencil",        "quads",        "Quads with any pixels passing the Z and stencil tests" },
+    { "TLB quads with zero coverage",           "quads",        "Quads with all pixels having zero coverage" },
+    { "TLB quads with coverage",                "quads",        "Quads with any pixels having non-zero coverage" },
+    { "TLB quads written to color buffer",      "quads",        "Quads with valid pixels written to the tile color buffer" },
+    { "PTB primitives outside viewport",        "primitives",   "Primitives discarded by being outside the viewport" },
+    { "PTB primitives clipped",                 "primitives",   "Primitives that need clipping" },
+    { "PSE primitives reversed",                "primitives",   "Primitives discarded because they are reversed" },
+    { "QPU idle cycles",                        "cycles",       "Idle clock cycles for all QPUs" },
+    { "QPU vertex/coordinate shading cycles",   "cycles",       "Clock cycles of QPUs doing vertex or coordinate shading" },
+    { "QPU fragment shading cycles",            "cycles",       "Clock cycles of QPUs doing fragment shading" },
+    { "QPU valid instruction cycles",           "cycles",       "Clock cycles of QPUs executing valid instructions" },
+    { "QPU TMU stall cycles",                   "cycles",       "Clock cycles of QPUs stalled waiting for the TMUs" },
+    { "QPU scoreboard stall cycles",            "cycles",       "Clock cycles of QPUs stalled waiting for the scoreboard" },
+    { "QPU varyings stall cycles",              "cycles",       "Clock cycles of QPUs stalled waiting for varyings" },
+    { "QPU instruction cache hits",             "hits",         "Instruction cache hits for all slices" },
+    { "QPU instruction cache misses",           "misses",       "Instruction cache misses for all slices" },
+    { "QPU uniforms cache hits",                "hits",         "Uniforms cache hits for all slices" },
+    { "QPU uniforms cache misses",              "misses",       "Uniforms cache misses for all slices" },
+    { "TMU texture quads",                      "quads",        "Texture quads processed by the TMUs" },
+    { "TMU texture cache misses",               "misses",       "Texture cache misses" },
+    { "VPM VDW stall cycles",                   "cycles",       "Clock cycles the VDW is stalled waiting for VPM access" },
+    { "VPM VCD stall cycles",                   "cycles",       "Clock cycles the VCD is stalled waiting for VPM access" },
+    { "L2C hits",                               "hits",         "Level 2 cache hits" },
+    { "L2C misses",                             "misses",       "Level 2 cache misses" },
+};
+
+RosUmdPerfCounters::RosUmdPerfCounters()
+{
+    memset(&m_reports, 0, sizeof(m_reports));
+
+    for (UINT i = 0; i < kMaxReports; i++)
+    {
+        m_reportState[i] = kReportFree;
+    }
+
+    m_nextReport = 0;
+    m_numActive = 0;
+}
+
+RosUmdPerfCounters::~RosUmdPerfCounters()
+{
+    assert(m_reports.m_pReports == NULL);
+}
+
+void
+RosUmdPerfCounters::InitQuery(
+    V3D_PERF_COUNTER_SOURCE     source,
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    assert(source < V3D_NUM_PERF_COUNTER_SOURCES);
+
+    pQuery->m_source = source;
+    pQuery->m_report = kInvalidReport;
+    pQuery->m_sampleCount = 0;
+    pQuery->m_bActive = false;
+}
+
+void
+RosUmdPerfCounters::InitTimestampQuery(
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    pQuery->m_source = V3D_NUM_PERF_COUNTER_SOURCES;
+    pQuery->m_report = kInvalidReport;
+    pQuery->m_sampleCount = 0;
+    pQuery->m_bActive = false;
+}
+
+void
+RosUmdPerfCounters::DestroyQuery(
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    if (pQuery->m_bActive)
+    {
+        End(pQuery);
+    }
+
+    if (pQuery->m_report != kInvalidReport)
+    {
+        ReleaseReport(*pQuery);
+        pQuery->m_report = kInvalidReport;
+    }
+}
+
+bool
+RosUmdPerfCounters::Begin(
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    if (pQuery->m_bActive)
+    {
+        End(pQuery);
+    }
+
+    //
+    // DMA buffers of the previous Begin/End may not have run yet, they keep
+    // adding to the old report
+    //
+
+    if (pQuery->m_report != kInvalidReport)
+    {
+        ReleaseReport(*pQuery);
+        pQuery->m_report = kInvalidReport;
+    }
+
+    pQuery->m_sampleCount = 0;
+
+    assert(pQuery->m_source < V3D_NUM_PERF_COUNTER_SOURCES);
+
+    if (m_numActive == V3D_NUM_PERF_COUNTERS)
+    {
+        return false;
+    }
+
+    UINT    report = AllocateReport();
+
+    if (report == kInvalidReport)
+    {
+        return false;
+    }
+
+    VC4PerfCounterReport *  pReport = &m_reports.m_pReports[report];
+
+    pReport->m_value = 0;
+    pReport->m_sampleCount = 0;
+
+    pQuery->m_report = report;
+    pQuery->m_bActive = true;
+
+    m_pActive[m_numActive++] = pQuery;
+
+    return true;
+}
+
+void
+RosUmdPerfCounters::End(
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    if (!pQuery->m_bActive)
+    {
+        return;
+    }
+
+    for (UINT i = 0; i < m_numActive; i++)
+    {
+        if (m_pActive[i] == pQuery)
+        {
+            m_pActive[i] = m_pActive[--m_numActive];
+            break;
+        }
+    }
+
+    pQuery->m_bActive = false;
+}
+
+bool
+RosUmdPerfCounters::Timestamp(
+    RosUmdPerfCounterQuery *    pQuery)
+{
+    assert(pQuery->m_source == V3D_NUM_PERF_COUNTER_SOURCES);
+
+    if (pQuery->m_report != kInvalidReport)
+    {
+        ReleaseReport(*pQuery);
+        pQuery->m_report = kInvalidReport;
+    }
+
+    pQuery->m_sampleCount = 0;
+
+    UINT    report = AllocateReport();
+
+    if (report == kInvalidReport)
+    {
+        return false;
+    }
+
+    VC4PerfCounterReport *  pReport = &m_reports.m_pReports[report];
+
+    pReport->m_value = 0;
+    pReport->m_sampleCount = 0;
+
+    //
+    // Written once, by the timestamp command
+    //
+
+    pQuery->m_report = report;
+    pQuery->m_sampleCount = 1;
+
+    return true;
+}
+
+void
+RosUmdPerfCounters::Sample(
+    VC4PerfCounterSelect *  pSelect,
+    UINT *                  pReportOffsets)
+{
+    pSelect->m_numCounters = m_numActive;
+
+    for (UINT i = 0; i < m_numActive; i++)
+    {
+        RosUmdPerfCounterQuery *    pQuery = m_pActive[i];
+
+        pSelect->m_sources[i] = (BYTE)pQuery->m_source;
+        pReportOffsets[i] = pQuery->m_report * sizeof(VC4PerfCounterReport);
+
+        pQuery->m_sampleCount++;
+    }
+}
+
+bool
+RosUmdPerfCounters::GetData(
+    const RosUmdPerfCounterQuery &  query,
+    ULONGLONG *                     pValue) const
+{
+    assert(!query.m_bActive);
+
+    if (query.m_report == kInvalidReport)
+    {
+        *pValue = 0;
+        return true;
+    }
+
+    const volatile VC4PerfCounterReport *   pReport = &m_reports.m_pReports[query.m_report];
+
+    //
+    // The KMD adds the count before incrementing the sample count
+    //
+
+    if (pReport->m_sampleCount != query.m_sampleCount)
+    {
+        return false;
+    }
+
+    *pValue = pReport->m_value;
+
+    return true;
+}
+
+void
+RosUmdPerfCounters::Teardown()
+{
+    assert(m_numActive == 0);
+
+    if (m_reports.m_pReports)
+    {
+        UnmapReports(&m_reports);
+    }
+
+    memset(&m_reports, 0, sizeof(m_reports));
+
+    for (UINT i = 0; i < kMaxReports; i++)
+    {
+        m_reportState[i] = kReportFree;
+    }
+}
+
+UINT
+RosUmdPerfCounters::AllocateReport()
+{
+    if (NULL == m_reports.m_pReports)
+    {
+        MapReports(&m_reports);
+    }
+
+    //
+    // Released reports usually complete in the order they were released,
+    // look for a reusable one from where the last search stopped
+    //
+
+    for (UINT i = 0; i < kMaxReports; i++)
+    {
+        UINT    report = (m_nextReport + i) % kMaxReports;
+        UINT    state = m_reportState[report];
+
+        if ((state == kReportFree) ||
+            ((state != kReportLive) &&
+             (((const volatile VC4PerfCounterReport *)m_reports.m_pReports)[report].m_sampleCount == state)))
+        {
+            m_reportState[report] = kReportLive;
+            m_nextReport = (report + 1) % kMaxReports;
+
+            return report;
+        }
+    }
+
+    return kInvalidReport;
+}
+
+void
+RosUmdPerfCounters::ReleaseReport(
+    const RosUmdPerfCounterQuery &  query)
+{
+    assert(m_reportState[query.m_report] == kReportLive);
+
+    m_reportState[query.m_report] = query.m_sampleCount;
+}
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Performance counter queries
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "RosUmdDebug.h"
+#include "Vc4Ddi.h"
+
+class RosUmdResource;
+
+//
+// Each active counter query maps one V3D performance counter to its source.
+// The KMD samples the counters around the control lists of every DMA buffer
+// submitted while the query is active and adds the counts to the query's
+// report, a VC4PerfCounterReport in a CPU mapped buffer shared by the
+// queries of the device.
+//
+// The report is complete once its sample count matches the number of DMA
+// buffers that sampled the query. A report released while DMA buffers may
+// still add to it is only reused after they have run.
+//
+// Timestamp queries share the reports, the KMD writes the performance
+// counter to the report of a timestamp command once the DMA buffers
+// submitted before it have run.
+//
+
+typedef struct _RosUmdPerfCounterQuery
+{
+    V3D_PERF_COUNTER_SOURCE m_source;       // V3D_NUM_PERF_COUNTER_SOURCES for timestamps
+    UINT                    m_report;       // kInvalidReport when the query has no report
+    UINT                    m_sampleCount;  // DMA buffers that sampled the counter for the query
+    bool                    m_bActive;
+} RosUmdPerfCounterQuery;
+
+typedef struct _RosUmdPerfCounterDesc
+{
+    const char *    m_pName;
+    const char *    m_pUnits;
+    const char *    m_pDescription;
+} RosUmdPerfCounterDesc;
+
+typedef struct _RosUmdPerfCounterReports
+{
+    RosUmdResource *        m_pBuffer;
+    VC4PerfCounterReport *  m_pReports;
+} RosUmdPerfCounterReports;
+
+class RosUmdPerfCounters
+{
+public:
+
+    // One page of reports
+    static const UINT kMaxReports = 4096 / sizeof(VC4PerfCounterReport);
+    static const UINT kInvalidReport = 0xFFFFFFFF;
+
+    RosUmdPerfCounters();
+    virtual ~RosUmdPerfCounters();
+
+    void InitQuery(V3D_PERF_COUNTER_SOURCE source, RosUmdPerfCounterQuery * pQuery);
+    void InitTimestampQuery(RosUmdPerfCounterQuery * pQuery);
+    void DestroyQuery(RosUmdPerfCounterQuery * pQuery);
+
+    //
+    // Returns false when V3D_NUM_PERF_COUNTERS queries are already active
+    // or every report is still in use, the query then reports no data
+    //
+
+    bool Begin(RosUmdPerfCounterQuery * pQuery);
+    void End(RosUmdPerfCounterQuery * pQuery);
+
+    //
+    // Takes a new report for the timestamp command about to be written,
+    // returns false when every report is still in use, the query then
+    // reports 0
+    //
+
+    bool Timestamp(RosUmdPerfCounterQuery * pQuery);
+
+    UINT GetReportOffset(const RosUmdPerfCounterQuery & query) const
+    {
+        assert(query.m_report != kInvalidReport);
+        return query.m_report * sizeof(VC4PerfCounterReport);
+    }
+
+    //
+    // Selects the counters of the active queries for the DMA buffer about
+    // to be submitted, pReportOffsets receives the offset of each counter's
+    // report in the report buffer
+    //
+
+    void
+    Sample(
+        VC4PerfCounterSelect *  pSelect,
+        UINT *                  pReportOffsets);
+
+    //
+    // Returns false until every DMA buffer that sampled the query has run
+    //
+
+    bool
+    GetData(
+        const RosUmdPerfCounterQuery &  query,
+        ULONGLONG *                     pValue) const;
+
+    void Teardown();
+
+    UINT GetActiveCount() const
+    {
+        return m_numActive;
+    }
+
+    RosUmdResource * GetReportBuffer() const
+    {
+        return m_reports.m_pBuffer;
+    }
+
+    static const RosUmdPerfCounterDesc & GetDesc(V3D_PERF_COUNTER_SOURCE source)
+    {
+        assert(source < V3D_NUM_PERF_COUNTER_SOURCES);
+        return s_descs[source];
+    }
+
+protected:
+
+    //
+    // Provides a CPU mapped buffer of kMaxReports reports
+    //
+
+    virtual void MapReports(RosUmdPerfCounterReports * pReports) = 0;
+    virtual void UnmapReports(RosUmdPerfCounterReports * pReports) = 0;
+
+private:
+
+    // m_reportState of a report without a query and of one a query owns
+    static const UINT kReportFree = 0xFFFFFFFF;
+    static const UINT kReportLive = 0xFFFFFFFE;
+
+    static const RosUmdPerfCounterDesc s_descs[V3D_NUM_PERF_COUNTER_SOURCES];
+
+    UINT AllocateReport();
+    void ReleaseReport(const RosUmdPerfCounterQuery & query);
+
+    RosUmdPerfCounterReports    m_reports;
+
+    // kReportFree, kReportLive or the sample count a released report waits for
+    UINT                        m_reportState[kMaxReports];
+    UINT                        m_nextReport;
+
+    RosUmdPerfCounterQuery *    m_pActive[V3D_NUM_PERF_COUNTERS];
+    UINT                        m_numActive;
+};
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Predicated rendering implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdPredication.h"
+
+RosUmdPredication::RosUmdPredication()
+{
+    m_pQuery = NULL;
+    m_bPredicateValue = false;
+    m_bHint = false;
+    m_skipCount = 0;
+}
+
+void
+RosUmdPredication::Set(
+    const RosUmdPerfCounterQuery *  pQuery,
+    bool                            bPredicateValue,
+    bool                            bHint)
+{
+    m_pQuery = pQuery;
+    m_bPredicateValue = bPredicateValue;
+    m_bHint = bHint;
+}
+
+void
+RosUmdPredication::Release(
+    const RosUmdPerfCounterQuery *  pQuery)
+{
+    if (m_pQuery == pQuery)
+    {
+        m_pQuery = NULL;
+    }
+}
+
+RosUmdPredicateResult
+RosUmdPredication::Evaluate(
+    const RosUmdPerfCounters &  counters)
+{
+    //
+    // A predicate still being counted has no result, D3D doesn't allow
+    // one to be set while active
+    //
+
+    if ((NULL == m_pQuery) || m_pQuery->m_bActive)
+    {
+        return ROS_PREDICATE_RENDER;
+    }
+
+    bool    bVisible = true;
+
+    if (m_pQuery->m_report != RosUmdPerfCounters::kInvalidReport)
+    {
+        ULONGLONG   passedQuads;
+
+        if (!counters.GetData(*m_pQuery, &passedQuads))
+        {
+            return m_bHint ? ROS_PREDICATE_RENDER : ROS_PREDICATE_PENDING;
+        }
+
+        bVisible = (passedQuads != 0);
+    }
+
+    if (bVisible != m_bPredicateValue)
+    {
+        return ROS_PREDICATE_RENDER;
+    }
+
+    m_skipCount++;
+
+    return ROS_PREDICATE_SKIP;
+}
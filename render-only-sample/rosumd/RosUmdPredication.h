@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Predicated rendering
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "RosUmdPerfCounters.h"
+
+//
+// Draws and clears under an occlusion predicate are skipped when the
+// predicate's result matches the value given to SetPredication. The result
+// is whether any quad passed the Z and stencil tests while the query was
+// active, a query that got no counter counts as visible.
+//
+// Only hint predicates may render before the result is available, the
+// device waits for the result of the others.
+//
+
+typedef enum _RosUmdPredicateResult
+{
+    ROS_PREDICATE_RENDER,
+    ROS_PREDICATE_SKIP,
+    ROS_PREDICATE_PENDING,
+} RosUmdPredicateResult;
+
+class RosUmdPredication
+{
+public:
+
+    RosUmdPredication();
+
+    //
+    // pQuery is the Z and stencil counter of the predicate query, NULL
+    // renders unconditionally
+    //
+
+    void
+    Set(
+        const RosUmdPerfCounterQuery *  pQuery,
+        bool                            bPredicateValue,
+        bool                            bHint);
+
+    // Called when the query is destroyed
+    void Release(const RosUmdPerfCounterQuery * pQuery);
+
+    RosUmdPredicateResult Evaluate(const RosUmdPerfCounters & counters);
+
+    ULONGLONG GetSkipCount() const
+    {
+        return m_skipCount;
+    }
+
+private:
+
+    const RosUmdPerfCounterQuery *  m_pQuery;
+    bool                            m_bPredicateValue;
+    bool                            m_bHint;
+
+    // Draws and clears skipped by predication
+    ULONGLONG                       m_skipCount;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "RosUmdPerfCounters.h"
+
+//
+// Occlusion queries count the quads with any pixel passing the Z and stencil
+// tests in the tile buffer, pipeline statistics combine the draws recorded
+// by the device with the V3D counters. Timestamp and event queries are
+// backed by the report of a timestamp command, written once the DMA buffers
+// before it have completed.
+//
+
+class RosUmdQuery
+{
+    friend class RosUmdDevice;
+
+public:
+
+    // V3D counters of a pipeline statistics query
+    static const UINT kMaxCounters = 2;
+
+    RosUmdQuery(const D3D10DDIARG_CREATEQUERY * pCreateQuery, D3D10DDI_HRTQUERY hRTQuery) :
+        m_query(pCreateQuery->Query), m_miscFlags(pCreateQuery->MiscFlags), m_hRTQuery(hRTQuery),
+        m_numCounters(0), m_vertices(0), m_primitives(0)
+    {
+        memset(m_counters, 0, sizeof(m_counters));
+    }
+
+    static RosUmdQuery* CastFrom(D3D10DDI_HQUERY hQuery);
+    D3D10DDI_HQUERY CastTo() const;
+
+    bool IsPerfCounter() const
+    {
+        return IsPerfCounter(m_query);
+    }
+
+    static bool IsPerfCounter(D3D10DDI_QUERY query)
+    {
+        return ((UINT)query >= D3D10DDI_COUNTER_DEVICE_DEPENDENT_0) &&
+               ((UINT)query < D3D10DDI_COUNTER_DEVICE_DEPENDENT_0 + V3D_NUM_PERF_COUNTER_SOURCES);
+    }
+
+    static V3D_PERF_COUNTER_SOURCE GetPerfCounterSource(D3D10DDI_QUERY query)
+    {
+        return (V3D_PERF_COUNTER_SOURCE)((UINT)query - D3D10DDI_COUNTER_DEVICE_DEPENDENT_0);
+    }
+
+    static bool IsSupported(D3D10DDI_QUERY query)
+    {
+        switch (query)
+        {
+        case D3D10DDI_QUERY_EVENT:
+        case D3D10DDI_QUERY_OCCLUSION:
+        case D3D10DDI_QUERY_TIMESTAMP:
+        case D3D10DDI_QUERY_TIMESTAMPDISJOINT:
+        case D3D10DDI_QUERY_PIPELINESTATS:
+        case D3D10DDI_QUERY_OCCLUSIONPREDICATE:
+            return true;
+        default:
+            return IsPerfCounter(query);
+        }
+    }
+
+    bool IsOcclusion() const
+    {
+        return (m_query == D3D10DDI_QUERY_OCCLUSION) || (m_query == D3D10DDI_QUERY_OCCLUSIONPREDICATE);
+    }
+
+    // Queries ended by a timestamp command
+    bool IsTimestamp() const
+    {
+        return (m_query == D3D10DDI_QUERY_EVENT) || (m_query == D3D10DDI_QUERY_TIMESTAMP);
+    }
+
+    bool IsPredicateHint() const
+    {
+        return (m_miscFlags & D3D10DDI_QUERY_MISCFLAG_PREDICATEHINT) != 0;
+    }
+
+private:
+
+    D3D10DDI_QUERY          m_query;
+    UINT                    m_miscFlags;
+    D3D10DDI_HRTQUERY       m_hRTQuery;
+
+    // V3D counters of counter, occlusion and pipeline statistics queries,
+    // the timestamp report of timestamp and event queries
+    RosUmdPerfCounterQuery  m_counters[kMaxCounters];
+    UINT                    m_numCounters;
+
+    // Vertices and primitives drawn while a pipeline statistics query is
+    // active, the device's totals at QueryBegin until QueryEnd
+    ULONGLONG               m_vertices;
+    ULONGLONG               m_primitives;
+};
+
+inline RosUmdQuery* RosUmdQuery::CastFrom(D3D10DDI_HQUERY hQuery)
+{
+    return static_cast< RosUmdQuery* >(hQuery.pDrvPrivate);
+}
+
+inline D3D10DDI_HQUERY RosUmdQuery::CastTo() const
+{
+    return MAKE_D3D10DDI_HQUERY(const_cast< RosUmdQuery* >(this));
+}
@@ -17,9 +17,12 @@
 #include "RosContext.h"
 
 #include "Vc4Hw.h"
+#include "RosTFormat.h"
 
 #include <memory>
 
+LONGLONG RosUmdResource::s_contentVersion = 0;
+
 RosUmdResource::RosUmdResource() :
     m_signature(_SIGNATURE::CONSTRUCTED),
     m_hKMAllocation(NULL)
@@ -89,6 +92,20 @@ RosUmdResource::Standup(
 
     m_pData = nullptr;
     m_pSysMemCopy = nullptr;
+    memset(&m_constantSlice, 0, sizeof(m_constantSlice));
+
+    m_cpuDirtyRanges.Clear();
+    m_staleGpuCaches = 0;
+    m_bStaleCpuCaches = false;
+
+    // Undefined until written
+    m_bDepthUniform = true;
+    m_bStencilUniform = true;
+    m_uniformDepth = 0;
+    m_uniformStencil = 0;
+
+    MarkContentChanged();
+
     m_signature = _SIGNATURE::INITIALIZED;
 }
 
@@ -143,6 +160,19 @@ void RosUmdResource::InitSharedResourceFromExistingAllocation (
 
     m_pData = nullptr;
     m_pSysMemCopy = nullptr;
+    memset(&m_constantSlice, 0, sizeof(m_constantSlice));
+
+    m_cpuDirtyRanges.Clear();
+    m_staleGpuCaches = 0;
+    m_bStaleCpuCaches = false;
+
+    // Another device may have written it
+    m_bDepthUniform = false;
+    m_bStencilUniform = false;
+    m_uniformDepth = 0;
+    m_uniformStencil = 0;
+
+    MarkContentChanged();
     
     m_signature = _SIGNATURE::INITIALIZED;
 }
@@ -156,6 +186,7 @@ RosUmdResource::Teardown(void)
 
 void
 RosUmdResource::ConstantBufferUpdateSubresourceUP(
+    RosUmdDevice *pUmdDevice,
     UINT DstSubresource,
     _In_opt_ const D3D10_DDI_BOX *pDstBox,
     _In_ const VOID *pSysMemUP,
@@ -169,7 +200,7 @@ RosUmdResource::ConstantBufferUpdateSubresourceUP(
     assert(m_bindFlags & D3D10_DDI_BIND_CONSTANT_BUFFER); // must be constant buffer
     assert(m_resourceDimension == D3D10DDIRESOURCE_BUFFER);
 
-    BYTE *pSysMemCopy = m_pSysMemCopy;
+    UINT Offset = 0;
     UINT BytesToCopy = RowPitch;
     if (pDstBox)
     {
@@ -181,7 +212,7 @@ RosUmdResource::ConstantBufferUpdateSubresourceUP(
             return; // box is outside of buffer size. Nothing to copy.
         }
 
-        pSysMemCopy += pDstBox->left;
+        Offset = pDstBox->left;
         BytesToCopy = (pDstBox->right - pDstBox->left);
     }
     else if (BytesToCopy == 0)
@@ -193,12 +224,30 @@ RosUmdResource::ConstantBufferUpdateSubresourceUP(
         BytesToCopy = min(BytesToCopy, m_hwSizeBytes);
     }
 
-    CopyMemory(pSysMemCopy, pSysMemUP, BytesToCopy);
+    //
+    // Draws already recorded keep reading the old slice, a partial update
+    // starts from a copy of the current contents. NO_OVERWRITE updates the
+    // live slice in place.
+    //
+
+    if (0 == (CopyFlags & D3D11_1_DDI_COPY_NO_OVERWRITE))
+    {
+        bool bPreserveContents =
+            (0 == (CopyFlags & D3D11_1_DDI_COPY_DISCARD)) &&
+            (BytesToCopy < m_hwSizeBytes);
+
+        pUmdDevice->RenameConstantBuffer(this, bPreserveContents);
+    }
+
+    MarkContentChanged();
+
+    CopyMemory(m_pSysMemCopy + Offset, pSysMemUP, BytesToCopy);
+
+    pUmdDevice->MarkConstantSliceWritten(this);
 
     return;
 
     DepthPitch;
-    CopyFlags;
 }
 
 void
@@ -214,12 +263,36 @@ RosUmdResource::Map(
 
     UNREFERENCED_PARAMETER(subResource);
 
+    if (mapType != D3D10_DDI_MAP_READ)
+    {
+        MarkContentChanged();
+    }
+
     //
-    // Constant data is copied into command buffer, so there is no need for flushing
+    // Constant buffer is renamed to a new ring slice instead of waiting for
+    // the GPU, NOOVERWRITE promises draws in flight don't read what is written
     //
 
     if (m_bindFlags & D3D10_DDI_BIND_CONSTANT_BUFFER)
     {
+        switch (mapType)
+        {
+        case D3D10_DDI_MAP_WRITE_DISCARD:
+            pUmdDevice->RenameConstantBuffer(this, false);
+            break;
+        case D3D10_DDI_MAP_READ:
+        case D3D10_DDI_MAP_WRITE_NOOVERWRITE:
+            break;
+        default:
+            pUmdDevice->RenameConstantBuffer(this, true);
+            break;
+        }
+
+        if (mapType != D3D10_DDI_MAP_READ)
+        {
+            pUmdDevice->MarkConstantSliceWritten(this);
+        }
+
         pMappedSubRes->pData = m_pSysMemCopy;
 
         pMappedSubRes->RowPitch = m_hwPitchBytes;
@@ -228,25 +301,41 @@ RosUmdResource::Map(
         return;
     }
 
-    pUmdDevice->m_commandBuffer.FlushIfMatching(m_mostRecentFence);
+    //
+    // D3DDDICB_LOCKFLAGS::IgnoreSync is only allowed for allocations that
+    // reside in the aperture segment. NOOVERWRITE promises that the GPU
+    // doesn't read what is written, so neither the command buffer nor the
+    // GPU needs to be waited for.
+    //
+
+    bool bIgnoreSync =
+        (mapType == D3D10_DDI_MAP_WRITE_NOOVERWRITE) &&
+        RosAllocationUsesAperture(*this);
+
+    //
+    // The CPU caches may have old contents of what the GPU wrote, the lock
+    // waits for the invalidation. A discarded resource gets a new instance.
+    //
+
+    if (m_bStaleCpuCaches && (mapType != D3D10_DDI_MAP_WRITE_DISCARD))
+    {
+        pUmdDevice->m_commandBuffer.InvalidateCpuCaches(this);
+    }
+
+    if (!bIgnoreSync)
+    {
+        pUmdDevice->m_commandBuffer.FlushIfMatching(m_mostRecentFence);
+    }
 
     D3DDDICB_LOCK lock;
     memset(&lock, 0, sizeof(lock));
 
     lock.hAllocation = m_hKMAllocation;
 
-    //
-    // TODO[indyz]: Consider how to optimize D3D10_DDI_MAP_WRITE_NOOVERWRITE
-    //
-    //    D3DDDICB_LOCKFLAGS::IgnoreSync and IgnoreReadSync are used for
-    //    D3D10_DDI_MAP_WRITE_NOOVERWRITE optimization and are only allowed
-    //    for allocations that can resides in aperture segment.
-    //
-    //    Currently ROS driver puts all allocations in local video memory.
-    //
-
     SetLockFlags(mapType, mapFlags, &lock.Flags);
 
+    lock.Flags.IgnoreSync = bIgnoreSync;
+
     pUmdDevice->Lock(&lock);
 
     if (lock.Flags.Discard)
@@ -269,6 +358,11 @@ RosUmdResource::Map(
     pMappedSubRes->pData = lock.pData;
     m_pData = (BYTE*)lock.pData;
 
+    if (mapType != D3D10_DDI_MAP_READ)
+    {
+        MarkCpuWritten();
+    }
+
     pMappedSubRes->RowPitch = m_hwPitchBytes;
     pMappedSubRes->DepthPitch = (UINT)m_hwSizeBytes;
 }
@@ -296,54 +390,7 @@ RosUmdResource::Unmap(
     pUmdDevice->Unlock(&unlock);
 }
 
-VC4TileInfo RosUmdResource::FillTileInfo(UINT bpp)
-{
-    // Provide detailed information about tile.
-    // Partial information about 4kB tiles, 1kB sub-tiles and micro-tiles for
-    // given bpp is precalculated.
-    // Values are used i.e. during converting bitmap to tiled texture
-
-    VC4TileInfo info = { 0 };
-
-    if (bpp == 8)
-    {
-        info.VC4_1kBSubTileWidthPixels        = VC4_1KB_SUB_TILE_WIDTH_8BPP;
-        info.VC4_1kBSubTileHeightPixels       = VC4_1KB_SUB_TILE_HEIGHT_8BPP;
-        info.VC4_MicroTileWidthBytes          = VC4_MICRO_TILE_WIDTH_BYTES_8BPP;
-        info.vC4_MicroTileHeight              = VC4_MICRO_TILE_HEIGHT_8BPP;
-    }
-    else if (bpp == 16)
-    {
-        info.VC4_1kBSubTileWidthPixels        = VC4_1KB_SUB_TILE_WIDTH_16BPP;
-        info.VC4_1kBSubTileHeightPixels       = VC4_1KB_SUB_TILE_HEIGHT_16BPP;
-        info.VC4_MicroTileWidthBytes          = VC4_MICRO_TILE_WIDTH_BYTES_16BPP;
-        info.vC4_MicroTileHeight              = VC4_MICRO_TILE_HEIGHT_16BPP;
-    }
-    else if (bpp == 32)
-    {
-        info.VC4_1kBSubTileWidthPixels        = VC4_1KB_SUB_TILE_WIDTH_32BPP;
-        info.VC4_1kBSubTileHeightPixels       = VC4_1KB_SUB_TILE_HEIGHT_32BPP;
-        info.VC4_MicroTileWidthBytes          = VC4_MICRO_TILE_WIDTH_BYTES_32BPP;
-        info.vC4_MicroTileHeight              = VC4_MICRO_TILE_HEIGHT_32BPP;
-    }
-    else
-    {
-        // We expect 8, 16 or 32 bpp only
-        assert(false);
-    }
-
-    // Calculate sub-tile width in bytes
-    info.VC4_1kBSubTileWidthBytes = info.VC4_1kBSubTileWidthPixels * (bpp / 8);
-    
-    // 4kB tile consists of four 1kB sub-tiles
-    info.VC4_4kBTileWidthPixels = info.VC4_1kBSubTileWidthPixels * 2;
-    info.VC4_4kBTileHeightPixels = info.VC4_1kBSubTileHeightPixels * 2;
-    info.VC4_4kBTileWidthBytes = info.VC4_1kBSubTileWidthBytes * 2;
-
-    return info;
-}
-
-void 
+bool
 RosUmdResource::MapDxgiFormatToInternalFormats(DXGI_FORMAT format, _Out_ UINT &bpp, _Out_ RosHwFormat &rosFormat)
 {
 
@@ -354,6 +401,7 @@ RosUmdResource::MapDxgiFormatToInternalFormats(DXGI_FORMAT format, _Out_ UINT &b
     switch (format)
     {
     case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
     {
         bpp = 32;
         rosFormat = RosHwFormat::X8888;
@@ -383,8 +431,8 @@ RosUmdResource::MapDxgiFormatToInternalFormats(DXGI_FORMAT format, _Out_ UINT &b
 
     case DXGI_FORMAT_D24_UNORM_S8_UINT:
     {
-        bpp = 8;
-        rosFormat = RosHwFormat::X8;
+        bpp = 32;
+        rosFormat = RosHwFormat::D24S8;
     }
     break;
 
@@ -398,10 +446,12 @@ RosUmdResource::MapDxgiFormatToInternalFormats(DXGI_FORMAT format, _Out_ UINT &b
     default:
     {
         // Formats that are not on the list.
-        assert(false);
+        return false;
     }
 
     }
+
+    return true;
 }
 
 void
@@ -410,22 +460,19 @@ RosUmdResource::CalculateTilesInfo()
     UINT bpp = 0;
 
     // Provide information about hardware formats
-    MapDxgiFormatToInternalFormats(m_format, bpp, m_hwFormat);
+    bool bMapped = MapDxgiFormatToInternalFormats(m_format, bpp, m_hwFormat);
+    assert(bMapped);
+    bMapped; // unused in free builds
 
-    // Prepare information about tiles
-    m_TileInfo = FillTileInfo(bpp);
-
-    m_hwWidthTilePixels = m_TileInfo.VC4_4kBTileWidthPixels;
-    m_hwHeightTilePixels = m_TileInfo.VC4_4kBTileHeightPixels;
+    m_hwWidthTilePixels = RosTFormat::GetTileWidth(bpp / 8);
+    m_hwHeightTilePixels = RosTFormat::GetTileHeight(bpp / 8);
 
     m_hwWidthTiles = (m_hwWidthPixels + m_hwWidthTilePixels - 1) / m_hwWidthTilePixels;
     m_hwHeightTiles = (m_hwHeightPixels + m_hwHeightTilePixels - 1) / m_hwHeightTilePixels;
     m_hwWidthPixels = m_hwWidthTiles*m_hwWidthTilePixels;
     m_hwHeightPixels = m_hwHeightTiles*m_hwHeightTilePixels;
 
-    UINT sizeTileBytes = m_hwWidthTilePixels * m_hwHeightTilePixels * (bpp/8);
-
-    m_hwSizeBytes = m_hwWidthTiles * m_hwHeightTiles * sizeTileBytes;
+    m_hwSizeBytes = m_hwWidthTiles * m_hwHeightTiles * RosTFormat::kTileBytes;
     m_hwPitchBytes = 0;
 
 }
@@ -492,11 +539,32 @@ RosUmdResource::CalculateMemoryLayout(
 
 #if VC4
 
-            // TODO[indyz]: Enable tiled render target
-            if ((m_bindFlags & D3D10_DDI_BIND_RENDER_TARGET) ||
-                (m_bindFlags & D3D10_DDI_BIND_SHADER_RESOURCE))
+            //
+            // The tile buffer stores render targets and the TMU samples
+            // textures in T-format, a texture rendered to is sampled as the
+            // tile buffer stored it. Linear is left to what the display scans
+            // out or GDI draws to, and to what T-format doesn't describe
+            // here: mipmaps, arrays, formats without a T-format layout and
+            // textures small enough for the TMU to sample as LT-format.
+            //
+
+            if ((m_hwLayout == RosHwLayout::Tiled) &&
+                !(m_bindFlags & D3D10_DDI_BIND_DEPTH_STENCIL))
             {
-                m_hwLayout = RosHwLayout::Linear;
+                UINT        bpp = 0;
+                RosHwFormat hwFormat;
+
+                if ((m_bindFlags & D3D10_DDI_BIND_PRESENT) ||
+                    (m_miscFlags & D3D10_DDI_RESOURCE_MISC_GDI_COMPATIBLE) ||
+                    m_isPrimary ||
+                    (m_mipLevels > 1) ||
+                    (m_arraySize > 1) ||
+                    !MapDxgiFormatToInternalFormats(m_format, bpp, hwFormat) ||
+                    ((m_bindFlags & D3D10_DDI_BIND_SHADER_RESOURCE) &&
+                     RosTFormat::IsLtFormat(m_mip0Info.TexelWidth, m_mip0Info.TexelHeight, bpp / 8)))
+                {
+                    m_hwLayout = RosHwLayout::Linear;
+                }
             }
 
 #endif
@@ -511,15 +579,6 @@ RosUmdResource::CalculateMemoryLayout(
                 m_hwFormat = RosHwFormat::X8888;
             }
 
-            // Disable tiled format until issue #48 is fixed.
-            //
-            // Force tiled layout for given configuration only
-            /*if ((m_usage == D3D10_DDI_USAGE_DEFAULT) &&
-               (m_bindFlags == D3D10_DDI_BIND_SHADER_RESOURCE))
-            {
-                m_hwLayout = RosHwLayout::Tiled;
-            }*/
-
             // Using system memory linear MipMap as example
             m_hwWidthPixels = m_mip0Info.TexelWidth;
             m_hwHeightPixels = m_mip0Info.TexelHeight;
@@ -528,7 +587,43 @@ RosUmdResource::CalculateMemoryLayout(
             // Align width and height to VC4_BINNING_TILE_PIXELS for binning
 #endif
 
-            if (m_hwLayout == RosHwLayout::Linear)
+#if VC4
+
+            //
+            // The samples of a multisample render target or depth stencil
+            // buffer are only rendered and resolved by the tile buffer, in
+            // its full resolution tile dumps
+            //
+
+            if (IsMultisampled())
+            {
+                if ((m_sampleDesc.Count != VC4_MAX_SAMPLES) ||
+                    (m_sampleDesc.Quality != 0) ||
+                    (m_mipLevels != 1) ||
+                    (m_arraySize != 1) ||
+                    (m_bindFlags & ~(D3D10_DDI_BIND_RENDER_TARGET | D3D10_DDI_BIND_DEPTH_STENCIL)))
+                {
+                    throw RosUmdException(DXGI_DDI_ERR_UNSUPPORTED);
+                }
+
+                m_hwLayout = RosHwLayout::Multisample;
+            }
+
+#endif
+
+            if (m_hwLayout == RosHwLayout::Multisample)
+            {
+                m_hwWidthTilePixels = VC4_MS_TILE_PIXELS;
+                m_hwHeightTilePixels = VC4_MS_TILE_PIXELS;
+                m_hwWidthTiles = (m_hwWidthPixels + m_hwWidthTilePixels - 1) / m_hwWidthTilePixels;
+                m_hwHeightTiles = (m_hwHeightPixels + m_hwHeightTilePixels - 1) / m_hwHeightTilePixels;
+                m_hwWidthPixels = m_hwWidthTiles*m_hwWidthTilePixels;
+                m_hwHeightPixels = m_hwHeightTiles*m_hwHeightTilePixels;
+
+                m_hwSizeBytes = m_hwWidthTiles * m_hwHeightTiles * VC4_TILE_BUFFER_BYTES;
+                m_hwPitchBytes = 0;
+            }
+            else if (m_hwLayout == RosHwLayout::Linear)
             {
                 m_hwWidthTilePixels = VC4_BINNING_TILE_PIXELS;
                 m_hwHeightTilePixels = VC4_BINNING_TILE_PIXELS;
@@ -697,7 +792,14 @@ void RosUmdResource::ConvertInitialTextureFormatToInternal(const BYTE *pSrc, BYT
         else
         {
             // Swizzle texture to HW format
-            ConvertBitmapTo4kTileBlocks(pSrc, pDst, rowStride);
+            RosTFormat::Tile(
+                pSrc,
+                rowStride,
+                pDst,
+                m_hwWidthTiles,
+                m_mip0Info.TexelWidth,
+                m_mip0Info.TexelHeight,
+                (m_format == DXGI_FORMAT_A8_UNORM) ? 1 : 4);
         }
     }
     else
@@ -720,129 +822,14 @@ void RosUmdResource::ConvertInitialTextureFormatToInternal(const BYTE *pSrc, BYT
 
             ConvertBufferto32Bpp(pSrc, temporary.get(), srcBpp, swizzleMask, rowStride, dstStride);
 
-            ConvertBitmapTo4kTileBlocks(temporary.get(), pDst, dstStride);
-
-        }
-    }
-}
-
-// Form 1k sub-tile block
-BYTE *RosUmdResource::Form1kSubTileBlock(const BYTE *pInputBuffer, BYTE *pOutBuffer, UINT rowStride)
-{    
-    // 1k sub-tile block is formed from micro-tiles blocks
-    for (UINT h = 0; h < m_TileInfo.VC4_1kBSubTileHeightPixels; h += m_TileInfo.vC4_MicroTileHeight)
-    {
-        const BYTE *currentBufferPos = pInputBuffer + h*rowStride;
-
-        // Process row of 4 micro-tiles blocks
-        for (UINT w = 0; w < m_TileInfo.VC4_1kBSubTileWidthBytes; w+= m_TileInfo.VC4_MicroTileWidthBytes)
-        {
-            const BYTE *microTileOffset = currentBufferPos + w;
-
-            // Process micro-tile block
-            for (UINT t = 0; t < m_TileInfo.vC4_MicroTileHeight; t++)
-            {
-                memcpy(pOutBuffer, microTileOffset, m_TileInfo.VC4_MicroTileWidthBytes);
-                pOutBuffer += m_TileInfo.VC4_MicroTileWidthBytes;
-                microTileOffset += rowStride;
-            }
-        }
-    }
-    return pOutBuffer;
-}
-
-// Form one 4k tile block from pInputBuffer and store in pOutBuffer
-BYTE *RosUmdResource::Form4kTileBlock(const BYTE *pInputBuffer, BYTE *pOutBuffer, UINT rowStride, BOOLEAN OddRow)
-{
-    const BYTE *currentTileOffset = NULL;
-   
-    UINT subTileHeightPixels        = m_TileInfo.VC4_1kBSubTileHeightPixels;
-    UINT subTileWidthBytes          = m_TileInfo.VC4_1kBSubTileWidthBytes;
-
-    if (OddRow)
-    {
-        // For even rows, process sub-tile blocks in ABCD order, where
-        // each sub-tile is stored in memory as follows:
-        //
-        //  [C  B]   
-        //  [D  A]
-        //                  
-
-        // Get A block
-        currentTileOffset = pInputBuffer + rowStride * subTileHeightPixels + subTileWidthBytes;
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // Get B block
-        currentTileOffset = pInputBuffer + subTileWidthBytes;
-
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // Get C block
-        pOutBuffer = Form1kSubTileBlock(pInputBuffer, pOutBuffer, rowStride);
-
-        // Get D block
-        currentTileOffset = pInputBuffer + rowStride * subTileHeightPixels;
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // return current position in out buffer
-        return pOutBuffer;
-
-    }
-    else
-    {
-        // For even rows, process sub-tile blocks in ABCD order, where
-        // each sub-tile is stored in memory as follows:
-        // 
-        //  [A  D]    
-        //  [B  C] 
-        //
-
-        // Get A block
-        pOutBuffer = Form1kSubTileBlock(pInputBuffer, pOutBuffer, rowStride);
-
-        /// Get B block
-        currentTileOffset = pInputBuffer + rowStride * subTileHeightPixels;
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // Get C Block
-        currentTileOffset = pInputBuffer + rowStride * subTileHeightPixels + subTileWidthBytes;
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // Get D block
-        currentTileOffset = pInputBuffer + subTileWidthBytes;
-        pOutBuffer = Form1kSubTileBlock(currentTileOffset, pOutBuffer, rowStride);
-
-        // return current position in out buffer
-        return pOutBuffer;
-    }
-}
-
-// Form (CountX * CountY) tile blocks from InputBuffer and store them in OutBuffer
-void RosUmdResource::ConvertBitmapTo4kTileBlocks(const BYTE *InputBuffer, BYTE *OutBuffer, UINT rowStride)
-{
-    UINT CountX = m_hwWidthTiles;
-    UINT CountY = m_hwHeightTiles;
-
-    for (UINT k = 0; k < CountY; k++)
-    {
-        BOOLEAN oddRow = k & 1;
-        if (oddRow)
-        {
-            // Build 4k blocks from right to left for odd rows
-            for (int i = CountX - 1; i >= 0; i--)
-            {
-                const BYTE *blockStartOffset = InputBuffer + k * rowStride * m_TileInfo.VC4_4kBTileHeightPixels + i * m_TileInfo.VC4_4kBTileWidthBytes;
-                OutBuffer = Form4kTileBlock(blockStartOffset, OutBuffer, rowStride, oddRow);
-            }
-        }
-        else
-        {
-            // Build 4k blocks from left to right for even rows
-            for (UINT i = 0; i < CountX; i++)
-            {
-                const BYTE *blockStartOffset = InputBuffer + k * rowStride * m_TileInfo.VC4_4kBTileHeightPixels + i * m_TileInfo.VC4_4kBTileWidthBytes;
-                OutBuffer = Form4kTileBlock(blockStartOffset, OutBuffer, rowStride, oddRow);
-            }
+            RosTFormat::Tile(
+                temporary.get(),
+                dstStride,
+                pDst,
+                m_hwWidthTiles,
+                m_mip0Info.TexelWidth,
+                m_mip0Info.TexelHeight,
+                4);
         }
     }
 }
@@ -3,6 +3,8 @@
 #include "RosAllocation.h"
 #include "Pixel.hpp"
 #include "RosUmdDebug.h"
+#include "RosUmdConstantRing.h"
+#include "RosUmdCacheMaintenance.h"
 #include "Vc4Hw.h"
 
 class RosUmdResource : public RosAllocationExchange
@@ -37,11 +39,30 @@ public:
     // CPU mapping of the allocation
     BYTE                   *m_pData;
 
-    // Used by constant buffer
+    // Used by constant buffer, CPU mapping of its current ring slice
     BYTE                   *m_pSysMemCopy;
+    RosUmdConstantSlice     m_constantSlice;
 
-    // Tiled textures information
-    VC4TileInfo m_TileInfo;
+    // Changes whenever the CPU or GPU may have written new contents,
+    // used to validate data derived from the resource contents
+    ULONGLONG               m_contentVersion;
+
+    // Ranges the CPU wrote since a DMA buffer last read the resource, and
+    // the GPU caches (VC4GpuCache) that may hold its old contents
+    RosUmdDirtyRanges       m_cpuDirtyRanges;
+    UINT                    m_staleGpuCaches;
+
+    // The GPU wrote the resource since the CPU caches were invalidated
+    // over it, the CPU may read old contents
+    bool                    m_bStaleCpuCaches;
+
+    // Depth stencil buffer whose depth or stencil is the same everywhere.
+    // A clear only sets them, the next render pass clears the tile buffer
+    // rather than loading it. Otherwise the memory has both.
+    bool                    m_bDepthUniform;
+    bool                    m_bStencilUniform;
+    UINT                    m_uniformDepth;     // 24 bit
+    UINT8                   m_uniformStencil;
 
     void
     Standup(
@@ -73,6 +94,7 @@ public:
 
     void
     ConstantBufferUpdateSubresourceUP(
+        RosUmdDevice *pUmdDevice,
         UINT DstSubresource,
         _In_opt_ const D3D10_DDI_BOX *pDstBox,
         _In_ const VOID *pSysMemUP,
@@ -90,6 +112,28 @@ public:
     CalculateMemoryLayout(
         void);
 
+    void MarkContentChanged()
+    {
+        m_contentVersion = (ULONGLONG)InterlockedIncrement64(&s_contentVersion);
+    }
+
+    // GPU caches the shaders read the resource through
+    UINT GetGpuReadCaches() const
+    {
+        return (m_bindFlags & D3D10_DDI_BIND_SHADER_RESOURCE) ? VC4_GPU_CACHE_TEXTURE : 0;
+    }
+
+    void MarkCpuWritten(UINT offset, UINT size, UINT gpuCaches)
+    {
+        m_cpuDirtyRanges.Add(offset, size);
+        m_staleGpuCaches |= gpuCaches;
+    }
+
+    void MarkCpuWritten()
+    {
+        MarkCpuWritten(0, m_hwSizeBytes, GetGpuReadCaches());
+    }
+
     // Determines whether the supplied resource can be rotated into this one.
     // Resources must have equivalent dimensions and flags to rotate.
     bool CanRotateFrom(const RosUmdResource* Other) const;
@@ -131,32 +175,17 @@ private:
         UINT pSrcStride,
         UINT pDstStride);
 
-    // Tiled textures support
-    void ConvertBitmapTo4kTileBlocks(
-        const BYTE *InputBuffer,
-        BYTE *OutBuffer,
-        UINT rowStride);
-
-    // Tiled textures support
-    BYTE *Form1kSubTileBlock(
-        const BYTE *pInputBuffer, 
-        BYTE *pOutBuffer, 
-        UINT rowStride);
-
-    BYTE *Form4kTileBlock(
-        const BYTE *pInputBuffer, 
-        BYTE *pOutBuffer, 
-        UINT rowStride, 
-        BOOLEAN OddRow);
-
-    static void MapDxgiFormatToInternalFormats(
+    // False for a format without a T-format layout
+    static bool MapDxgiFormatToInternalFormats(
         DXGI_FORMAT format,
         _Out_ UINT &bpp,
         _Out_ RosHwFormat &rosFormat);
 
     void CalculateTilesInfo();
 
-    static VC4TileInfo FillTileInfo(UINT bpp);
+    // Content versions are unique across resources, so a destroyed resource
+    // whose memory is reused never matches data derived from the old one
+    static LONGLONG s_contentVersion;
 
 };
 
@@ -32,7 +32,13 @@ RosUmdShader::Teardown()
     delete m_pCompiler;
     delete[] m_pCode;
 
-    m_hwShaderCode.Teardown();
+    m_pDevice->m_shaderHeap.Free(&m_hwShaderCode);
+}
+
+UINT
+RosUmdShader::GetCodeOffset()
+{
+    return m_pDevice->m_shaderHeap.GetCodeOffset(m_hwShaderCode);
 }
 
 void
@@ -133,37 +139,21 @@ RosUmdPipelineShader::Update()
     {
         m_hwShaderCodeSize = m_pCompiler->GetShaderCodeSize();
         assert(m_hwShaderCodeSize != 0);
-           
-        m_pDevice->CreateInternalBuffer(
-            &m_hwShaderCode,
-            ROUND_TO_PAGES(m_hwShaderCodeSize)); // TODO: for now, for easier debugging, round allocation size to PAGE size aligned.
 
+        if (!m_pDevice->m_shaderHeap.Allocate(m_hwShaderCodeSize, &m_hwShaderCode))
         {
-            D3D10DDI_MAPPED_SUBRESOURCE mappedSubRes = { 0 };
-
-            m_hwShaderCode.Map(
-                m_pDevice,
-                0,
-                D3D10_DDI_MAP_WRITE,
-                0,
-                &mappedSubRes);
-
-            if (mappedSubRes.pData)
-            {
-                m_pCompiler->GetShaderCode(
-                    mappedSubRes.pData, 
-                    &m_vc4CoordinateShaderOffset);
-
-                m_hwShaderCode.Unmap(
-                    m_pDevice,
-                    0);
-
-                return;
-            }
+            throw RosUmdException(E_OUTOFMEMORY);
         }
-    }
 
-    throw RosUmdException(E_FAIL);
+        m_pCompiler->GetShaderCode(
+            m_pDevice->m_shaderHeap.GetCodePointer(m_hwShaderCode),
+            &m_vc4CoordinateShaderOffset);
+
+        m_pDevice->m_shaderHeap.GetBuffer()->MarkCpuWritten(
+            m_pDevice->m_shaderHeap.GetCodeOffset(m_hwShaderCode),
+            m_hwShaderCodeSize,
+            VC4_GPU_CACHE_INSTRUCTION);
+    }
 }
 
 void
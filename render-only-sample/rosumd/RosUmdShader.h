@@ -14,6 +14,7 @@ public:
           m_ProgramType(Type),
           m_pCompiler(NULL)
     {
+        memset(&m_hwShaderCode, 0, sizeof(m_hwShaderCode));
     }
 
     virtual ~RosUmdShader()
@@ -27,10 +28,8 @@ public:
     virtual void Teardown();
     virtual void Update();
 
-    RosUmdResource * GetCodeResource()
-    {
-        return &m_hwShaderCode;
-    }
+    // Offset of the code in the device's shader heap
+    UINT GetCodeOffset();
 
     UINT * GetHLSLCode()
     {
@@ -47,6 +46,26 @@ public:
         return m_pCompiler->GetShaderOutputCount();
     }
 
+    UINT GetCoordinateShaderInputMask()
+    {
+        return m_pCompiler->GetCoordinateShaderInputMask();
+    }
+
+    bool IsThreaded()
+    {
+        return m_pCompiler->IsThreaded();
+    }
+
+    bool UsesDiscard()
+    {
+        return m_pCompiler->UsesDiscard();
+    }
+
+    bool OutputsDepth()
+    {
+        return m_pCompiler->OutputsDepth();
+    }
+
 #if VC4
 
     VC4_UNIFORM_FORMAT * GetShaderUniformFormat(UINT Type, UINT *pUniformFormatEntries);
@@ -61,7 +80,7 @@ protected:
     D3D10DDI_HRTSHADER              m_hRTShader;
 
     RosUmdDevice *                  m_pDevice;
-    RosUmdResource                  m_hwShaderCode;
+    RosUmdShaderCode                m_hwShaderCode;
     UINT                            m_hwShaderCodeSize;
     UINT                            m_vc4CoordinateShaderOffset;
 
@@ -0,0 +1,261 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Shader code heap implementation
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include "precomp.h"
+
+#include "RosUmdShaderHeap.h"
+
+RosUmdShaderHeap::RosUmdShaderHeap()
+{
+    memset(&m_chunk, 0, sizeof(m_chunk));
+
+    m_pBlocks = NULL;
+    m_pHandles = NULL;
+
+    m_pLiveCode = NULL;
+    m_liveCount = 0;
+    m_liveBytes = 0;
+    m_deadBytes = 0;
+
+    m_migrationCount = 0;
+    m_bytesMigrated = 0;
+}
+
+RosUmdShaderHeap::~RosUmdShaderHeap()
+{
+    assert(m_chunk.m_pData == NULL);
+}
+
+bool
+RosUmdShaderHeap::Allocate(
+    UINT                size,
+    RosUmdShaderCode *  pCode)
+{
+    assert(size != 0);
+
+    UINT    alignedSize = AlignCodeSize(size);
+
+    if ((NULL == m_chunk.m_pData) ||
+        !m_allocator.Allocate(alignedSize, kCodeAlignment, ROS_SEGMENT_ALLOC_PINNED, &pCode->m_handle))
+    {
+        UINT    neededSize = m_liveBytes + alignedSize;
+        UINT    chunkSize = m_chunk.m_size ? m_chunk.m_size : kMinChunkSize;
+
+        //
+        // Keep the size while destroyed shaders free at least half of the
+        // chunk, otherwise leave room for half as much code again
+        //
+
+        if (neededSize > chunkSize / 2)
+        {
+            chunkSize = neededSize + neededSize / 2;
+            chunkSize = (chunkSize + kMinChunkSize - 1) & ~(kMinChunkSize - 1);
+
+            if (chunkSize > kMaxChunkSize)
+            {
+                chunkSize = kMaxChunkSize;
+            }
+        }
+
+        if ((neededSize > chunkSize) || !Migrate(chunkSize))
+        {
+            return false;
+        }
+
+        if (!m_allocator.Allocate(alignedSize, kCodeAlignment, ROS_SEGMENT_ALLOC_PINNED, &pCode->m_handle))
+        {
+            return false;
+        }
+    }
+
+    pCode->m_size = size;
+
+    pCode->m_pPrev = NULL;
+    pCode->m_pNext = m_pLiveCode;
+
+    if (m_pLiveCode)
+    {
+        m_pLiveCode->m_pPrev = pCode;
+    }
+
+    m_pLiveCode = pCode;
+
+    m_liveCount++;
+    m_liveBytes += alignedSize;
+
+    return true;
+}
+
+void
+RosUmdShaderHeap::Free(
+    RosUmdShaderCode *  pCode)
+{
+    if (pCode->m_size == 0)
+    {
+        return;
+    }
+
+    if (pCode->m_pPrev)
+    {
+        pCode->m_pPrev->m_pNext = pCode->m_pNext;
+    }
+    else
+    {
+        m_pLiveCode = pCode->m_pNext;
+    }
+
+    if (pCode->m_pNext)
+    {
+        pCode->m_pNext->m_pPrev = pCode->m_pPrev;
+    }
+
+    UINT    alignedSize = AlignCodeSize(pCode->m_size);
+
+    m_liveCount--;
+    m_liveBytes -= alignedSize;
+    m_deadBytes += alignedSize;
+
+    pCode->m_size = 0;
+}
+
+void
+RosUmdShaderHeap::Teardown()
+{
+    assert(m_pLiveCode == NULL);
+
+    if (m_chunk.m_pData)
+    {
+        UnmapChunk(&m_chunk);
+    }
+
+    delete[] m_pBlocks;
+    delete[] m_pHandles;
+
+    memset(&m_chunk, 0, sizeof(m_chunk));
+
+    m_pBlocks = NULL;
+    m_pHandles = NULL;
+
+    m_liveBytes = 0;
+    m_deadBytes = 0;
+}
+
+//
+// Moves the live code to a new chunk of chunkSize bytes. Returns false and
+// keeps the current chunk when the live code doesn't fit, the allocator
+// rounds requests up to its free list sizes so live bytes below chunkSize
+// aren't enough.
+//
+
+bool
+RosUmdShaderHeap::Migrate(
+    UINT    chunkSize)
+{
+    UINT    maxHandles = max(chunkSize / kTypicalCodeSize, 2 * (m_liveCount + 1));
+    UINT    maxBlocks = 2 * maxHandles + 1;
+
+    RosUmdShaderHeapChunk   chunk = { NULL, NULL, chunkSize };
+
+    RosSegmentBlock *   pBlocks = NULL;
+    UINT *              pHandles = NULL;
+    RosSegmentHandle *  pCodeHandles = NULL;
+
+    RosSegmentAllocator allocator;
+    ULONGLONG           bytesMigrated = 0;
+    bool                bFits = true;
+
+    try
+    {
+        pBlocks = new RosSegmentBlock[maxBlocks];
+        pHandles = new UINT[maxHandles];
+        pCodeHandles = new RosSegmentHandle[m_liveCount];
+
+        MapChunk(&chunk);
+
+        //
+        // Code never moves within a chunk, the GPU may be reading it
+        //
+
+        allocator.Init(chunkSize, kCodeAlignment, pBlocks, maxBlocks, pHandles, maxHandles, NULL, 0);
+
+        UINT    i = 0;
+
+        for (RosUmdShaderCode * pCode = m_pLiveCode; pCode != NULL; pCode = pCode->m_pNext, i++)
+        {
+            UINT    alignedSize = AlignCodeSize(pCode->m_size);
+
+            if (!allocator.Allocate(alignedSize, kCodeAlignment, ROS_SEGMENT_ALLOC_PINNED, &pCodeHandles[i]))
+            {
+                bFits = false;
+                break;
+            }
+
+            memcpy(chunk.m_pData + allocator.GetOffset(pCodeHandles[i]), GetCodePointer(*pCode), pCode->m_size);
+
+            bytesMigrated += pCode->m_size;
+        }
+    }
+    catch (...)
+    {
+        if (chunk.m_pData)
+        {
+            UnmapChunk(&chunk);
+        }
+
+        delete[] pBlocks;
+        delete[] pHandles;
+        delete[] pCodeHandles;
+
+        throw;
+    }
+
+    if (!bFits)
+    {
+        UnmapChunk(&chunk);
+
+        delete[] pBlocks;
+        delete[] pHandles;
+        delete[] pCodeHandles;
+
+        return false;
+    }
+
+    //
+    // The live code only switches to the new chunk once all of it fits
+    //
+
+    UINT    i = 0;
+
+    for (RosUmdShaderCode * pCode = m_pLiveCode; pCode != NULL; pCode = pCode->m_pNext, i++)
+    {
+        pCode->m_handle = pCodeHandles[i];
+    }
+
+    delete[] pCodeHandles;
+
+    m_bytesMigrated += bytesMigrated;
+
+    if (m_chunk.m_pData)
+    {
+        UnmapChunk(&m_chunk);
+
+        m_migrationCount++;
+    }
+
+    delete[] m_pBlocks;
+    delete[] m_pHandles;
+
+    m_chunk = chunk;
+
+    m_allocator = allocator;
+    m_pBlocks = pBlocks;
+    m_pHandles = pHandles;
+
+    m_deadBytes = 0;
+
+    return true;
+}
@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Shader code heap
+//
+// Copyright (C) Microsoft Corporation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "RosUmdDebug.h"
+#include "RosSegmentAllocator.h"
+
+class RosUmdResource;
+
+//
+// The code of every shader of the device is packed in one CPU mapped GPU
+// buffer (the chunk), so a draw references a single allocation for its
+// vertex, coordinate and pixel shaders.
+//
+// Submitted command buffers may still read the code of a destroyed shader,
+// its range isn't reused by the chunk. When the chunk is full, the live code
+// is copied to a new chunk, resized when the live code would fill more than
+// half of it, and the old chunk is released. That is also what reclaims the
+// space of destroyed shaders.
+//
+
+typedef struct _RosUmdShaderCode
+{
+    RosSegmentHandle            m_handle;
+    UINT                        m_size;         // 0 when the code isn't in the heap
+
+    // Live code of the heap
+    struct _RosUmdShaderCode *  m_pPrev;
+    struct _RosUmdShaderCode *  m_pNext;
+} RosUmdShaderCode;
+
+typedef struct _RosUmdShaderHeapChunk
+{
+    RosUmdResource *    m_pBuffer;
+    BYTE *              m_pData;
+    UINT                m_size;
+} RosUmdShaderHeapChunk;
+
+class RosUmdShaderHeap
+{
+public:
+
+    static const UINT kCodeAlignment = 16;
+    static const UINT kMinChunkSize = 64*1024;
+    static const UINT kMaxChunkSize = 4*1024*1024;
+
+    // Expected average code size, sizes the metadata of a chunk
+    static const UINT kTypicalCodeSize = 256;
+
+    RosUmdShaderHeap();
+    virtual ~RosUmdShaderHeap();
+
+    //
+    // Returns false when the live code doesn't fit in kMaxChunkSize, the
+    // heap and the live code are left unchanged
+    //
+
+    bool
+    Allocate(
+        UINT                size,
+        RosUmdShaderCode *  pCode);
+
+    void Free(RosUmdShaderCode * pCode);
+
+    void Teardown();
+
+    UINT GetCodeOffset(const RosUmdShaderCode & code) const
+    {
+        assert(code.m_size != 0);
+        return m_allocator.GetOffset(code.m_handle);
+    }
+
+    BYTE * GetCodePointer(const RosUmdShaderCode & code) const
+    {
+        return m_chunk.m_pData + GetCodeOffset(code);
+    }
+
+    RosUmdResource * GetBuffer() const
+    {
+        return m_chunk.m_pBuffer;
+    }
+
+    UINT GetChunkSize() const
+    {
+        return m_chunk.m_size;
+    }
+
+    UINT GetLiveCount() const
+    {
+        return m_liveCount;
+    }
+
+    UINT GetLiveBytes() const
+    {
+        return m_liveBytes;
+    }
+
+    UINT GetDeadBytes() const
+    {
+        return m_deadBytes;
+    }
+
+    UINT GetMigrationCount() const
+    {
+        return m_migrationCount;
+    }
+
+    ULONGLONG GetBytesMigrated() const
+    {
+        return m_bytesMigrated;
+    }
+
+protected:
+
+    //
+    // Provides a CPU mapped buffer of pChunk->m_size bytes
+    //
+
+    virtual void MapChunk(RosUmdShaderHeapChunk * pChunk) = 0;
+    virtual void UnmapChunk(RosUmdShaderHeapChunk * pChunk) = 0;
+
+private:
+
+    static UINT AlignCodeSize(UINT size)
+    {
+        return (size + kCodeAlignment - 1) & ~(kCodeAlignment - 1);
+    }
+
+    bool Migrate(UINT chunkSize);
+
+    RosUmdShaderHeapChunk   m_chunk;
+
+    RosSegmentAllocator     m_allocator;
+    RosSegmentBlock *       m_pBlocks;
+    UINT *                  m_pHandles;
+
+    RosUmdShaderCode *      m_pLiveCode;
+    UINT                    m_liveCount;
+    UINT                    m_liveBytes;
+    UINT                    m_deadBytes;
+
+    UINT                    m_migrationCount;
+    ULONGLONG               m_bytesMigrated;
+};
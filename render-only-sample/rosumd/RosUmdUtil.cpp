@@ -45,6 +45,28 @@ ConvertFloatColor(
     }
 }
 
+UINT
+GetPrimitiveCount(
+    D3D10_DDI_PRIMITIVE_TOPOLOGY    topology,
+    UINT                            vertexCount)
+{
+    switch (topology)
+    {
+    case D3D10_DDI_PRIMITIVE_TOPOLOGY_POINTLIST:
+        return vertexCount;
+    case D3D10_DDI_PRIMITIVE_TOPOLOGY_LINELIST:
+        return vertexCount / 2;
+    case D3D10_DDI_PRIMITIVE_TOPOLOGY_LINESTRIP:
+        return (vertexCount >= 2) ? vertexCount - 1 : 0;
+    case D3D10_DDI_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
+        return vertexCount / 3;
+    case D3D10_DDI_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
+        return (vertexCount >= 3) ? vertexCount - 2 : 0;
+    default:
+        return 0;
+    }
+}
+
 #if VC4
 
 VC4PrimitiveMode
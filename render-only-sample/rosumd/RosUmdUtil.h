@@ -29,6 +29,11 @@ ConvertFloatColor(
     DXGI_FORMAT Format,
     FLOAT * pColor);
 
+UINT
+GetPrimitiveCount(
+    D3D10_DDI_PRIMITIVE_TOPOLOGY    topology,
+    UINT                            vertexCount);
+
 #if VC4
 
 VC4PrimitiveMode